@@ -167,37 +167,65 @@ LOCAL_SRC_FILES := \
   $(subst $(LOCAL_PATH)/,,$(DEPENDENCIES_SDL_DIR))/src/main/android/SDL_android_main.c \
   $(PIE_NOON_RELATIVE_DIR)/src/ai_controller.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/async_loader.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/asset_archive.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/audio_engine.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/bus.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/character.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/character_state_machine.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/controller.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/fixed_step.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/frame_arena.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/frame_pacer.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/frame_profiler.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/full_screen_fader.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/gamepad_controller.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/game_camera.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/game_state.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/gl_stats.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/gpg_manager.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/gpu_particles.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/gpu_profiler.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/gui_menu.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/idle_throttle.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/impel_engine.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/impel_flatbuffers.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/impel_processor_overshoot.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/impel_processor_smooth.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/impel_processor_smooth_fixed.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/impel_worker_pool.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/input.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/input_recording.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/job_system.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/ktx.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/main.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/mapped_file.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/material.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/material_manager.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/memory_tracker.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/mesh.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/player_controller.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/particles.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/pixel_conversion.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/precompiled.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/program_binary.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/quad_batch.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/render_queue.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/renderer.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/renderer_android.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/replay_benchmark.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/replay_controller.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/resolution_scaler.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/rollback_match.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/rollback_session.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/runtime_config.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/shader.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/sound.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/sound_collection.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/startup_trace.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/pie_noon_game.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/touchscreen_button.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/touchscreen_controller.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/update_thread.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/utilities.cpp
 
 # Make each source file dependent upon the generated_includes and build_assets
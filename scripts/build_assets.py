@@ -22,12 +22,41 @@ rules. If you just want to build the flatbuffer binaries you can pass
 'flatbuffer' as an argument, or if you want to just build the webp files you can
 pass 'cwebp' as an argument. Additionally, if you would like to clean all
 generated files, you can call this script with the argument 'clean'.
+
+Passing '--atlases' after the target packs the textures of the materials
+listed in src/rawassets/atlases/ into shared atlas textures, and writes
+those materials with the part of the atlas that they use. This requires the
+Python Imaging Library (Pillow).
+
+Each texture is written with its mip chain precomputed, as foo.1.webp,
+foo.2.webp and so on down to 1x1 beside foo.webp, so the game doesn't have
+to generate the mips when it loads. This needs Pillow too; without it the
+mip levels are skipped, and the game generates them instead.
+
+Passing '--ktx' also writes GPU-compressed copies of every texture, such as
+assets/textures/foo.etc2.ktx beside assets/textures/foo.webp, in each of the
+formats in KTX_VARIANTS. The game loads the best one that the device decodes
+instead of the webp file. This requires PVRTexToolCLI.
+
+The cardboard quads that the game draws are baked into
+assets/cardboard_meshes.bin, with their normals and tangents, from
+config.json and the materials. The game maps the file and uploads the
+vertices as they are, instead of building the quads when it starts.
+
+Passing '--archives' also packs the built files into the archives in
+ARCHIVES, such as assets/data.pak, so that the game opens a few files at
+startup instead of hundreds. The game uses a file from an archive in
+preference to the loose file.
 """
 
 import distutils.spawn
 import glob
+import json
+import math
 import os
 import platform
+import re
+import struct
 import subprocess
 import sys
 
@@ -84,9 +113,33 @@ TEXTURE_PATH = os.path.join(ASSETS_PATH, 'textures')
 # Directory where unprocessed textures can be found.
 RAW_TEXTURE_PATH = os.path.join(RAW_ASSETS_PATH, 'textures')
 
+# Directory where texture atlas definitions can be found.
+RAW_ATLAS_PATH = os.path.join(RAW_ASSETS_PATH, 'atlases')
+
+# Directory for the atlas images and materials generated from the atlas
+# definitions, before they are converted.
+ATLAS_INTERMEDIATE_PATH = os.path.join(PROJECT_ROOT, 'obj', 'atlases')
+
+# Directory for the mip levels generated from the textures, before they are
+# converted.
+MIP_INTERMEDIATE_PATH = os.path.join(PROJECT_ROOT, 'obj', 'mips')
+
 # Directory where unprocessed assets can be found.
 SCHEMA_PATH = os.path.join(PROJECT_ROOT, 'src', 'flatbufferschemas')
 
+# The baked cardboard quads, and the JSON file they are converted from.
+CARDBOARD_MESHES_SCHEMA = os.path.join(SCHEMA_PATH, 'cardboard_meshes.fbs')
+CARDBOARD_MESHES_JSON = os.path.join(PROJECT_ROOT, 'obj',
+                                     'cardboard_meshes.json')
+CARDBOARD_MESHES_PATH = os.path.join(ASSETS_PATH, 'cardboard_meshes.bin')
+
+# Format of the baked quads. Must match kCardboardMeshesVersion in
+# pie_noon_game.cpp.
+CARDBOARD_MESHES_VERSION = 1
+
+# Triangles of a cardboard quad. Must match kQuadIndices in pie_noon_game.cpp.
+QUAD_INDICES = [0, 1, 2, 2, 1, 3]
+
 # Windows uses the .exe extension on executables.
 EXECUTABLE_EXTENSION = '.exe' if platform.system() == 'Windows' else ''
 
@@ -96,6 +149,47 @@ FLATC_EXECUTABLE_NAME = 'flatc' + EXECUTABLE_EXTENSION
 # Name of the cwebp executable.
 CWEBP_EXECUTABLE_NAME = 'cwebp' + EXECUTABLE_EXTENSION
 
+# Directory that contains the PVRTexTool command line tool, which writes the
+# KTX files.
+PVRTEXTOOL_BINARY_IN_PATH = distutils.spawn.find_executable('PVRTexToolCLI')
+PVRTEXTOOL_PATHS = [
+    os.path.join(PROJECT_ROOT, 'bin'),
+    os.path.join(PREBUILTS_ROOT, 'pvrtextool', platform.system().lower()),
+    (os.path.dirname(PVRTEXTOOL_BINARY_IN_PATH) if PVRTEXTOOL_BINARY_IN_PATH
+     else ''),
+]
+
+# Name of the PVRTexTool executable.
+PVRTEXTOOL_EXECUTABLE_NAME = 'PVRTexToolCLI' + EXECUTABLE_EXTENSION
+
+# GPU-compressed variants of each texture, best first, as (file suffix,
+# PVRTexTool format for textures with alpha, format for opaque textures).
+# Must match the variants in Renderer::InitializeCompressedTextures(). ETC1
+# has no alpha, so textures with alpha have no ETC1 variant.
+KTX_VARIANTS = [
+    ('astc', 'ASTC_6x6', 'ASTC_6x6'),
+    ('etc2', 'ETC2_RGBA', 'ETC2_RGB'),
+    ('etc1', None, 'ETC1'),
+]
+
+# Archives of built files, as (archive name, glob patterns relative to
+# ASSETS_PATH). Must match kAssetArchives in pie_noon_game.cpp.
+ARCHIVES = [
+    ('data.pak', ['*.bin', 'materials/*.bin', 'sounds/*.bin', 'shaders/*']),
+    ('textures.pak', ['textures/*.webp', 'textures/*.ktx']),
+    ('sounds.pak', ['sounds/*.ogg', 'sounds/*.wav']),
+]
+
+# "FPAK", and the version of the archive layout. Must match
+# asset_archive.cpp.
+ARCHIVE_MAGIC = 0x4B415046
+ARCHIVE_VERSION = 1
+
+# Files in an archive start at multiples of this, so that the game can use
+# them where they are once the archive is mapped. Must match
+# kAssetArchiveAlignment in asset_archive.h.
+ARCHIVE_ALIGNMENT = 16
+
 # What level of quality we want to apply to the webp files.
 # Ranges from 0 to 100.
 WEBP_QUALITY = 90
@@ -184,6 +278,9 @@ FLATC = find_executable(FLATC_EXECUTABLE_NAME, FLATBUFFERS_PATHS)
 # Location of webp compression tool.
 CWEBP = find_executable(CWEBP_EXECUTABLE_NAME, CWEBP_PATHS)
 
+# Location of the KTX compression tool.
+PVRTEXTOOL = find_executable(PVRTEXTOOL_EXECUTABLE_NAME, PVRTEXTOOL_PATHS)
+
 
 class BuildError(Exception):
   """Error indicating there was a problem building assets."""
@@ -232,6 +329,114 @@ def convert_png_image_to_webp(png, out, quality=80):
   run_subprocess(command)
 
 
+def png_has_alpha(png):
+  """Returns True if the color type in the png file's header has alpha."""
+  with open(png, 'rb') as f:
+    header = f.read(26)
+  # The color type is the tenth byte of the IHDR chunk, which follows the
+  # signature. Types 4 and 6 are grey and RGB with alpha.
+  color_type = struct.unpack('>B', header[25:26])[0]
+  return color_type in (4, 6)
+
+
+def ktx_texture_path(webp, suffix):
+  """Path of the compressed variant of a processed webp texture."""
+  return os.path.splitext(webp)[0] + '.' + suffix + '.ktx'
+
+
+def convert_png_image_to_ktx(png, webp):
+  """Write each of KTX_VARIANTS of the given png file, with full mip chains.
+
+  Args:
+    png: The path to the png file to compress.
+    webp: The path of the webp file built from it. The KTX files are written
+        beside it.
+
+  Raises:
+    BuildError: Process return code was nonzero.
+  """
+  has_alpha = png_has_alpha(png)
+  for suffix, alpha_format, opaque_format in KTX_VARIANTS:
+    format_name = alpha_format if has_alpha else opaque_format
+    out = ktx_texture_path(webp, suffix)
+    if format_name and needs_rebuild(png, out):
+      command = [PVRTEXTOOL, '-i', png, '-o', out, '-f', format_name, '-m',
+                 '-q', 'etcslow' if suffix.startswith('etc') else
+                 'astcthorough']
+      run_subprocess(command)
+
+
+def mip_texture_path(webp, level):
+  """Path of a precomputed mip level of a processed webp texture."""
+  return '%s.%d.webp' % (os.path.splitext(webp)[0], level)
+
+
+def generate_mips(png, webp):
+  """Write the mip levels after the first of a png file, as webp files.
+
+  Every level is scaled down from the full size image, down to 1x1, and
+  written beside the webp file of the full size image. The game loads them
+  instead of generating them with glGenerateMipmap, which stalls some
+  drivers.
+
+  Args:
+    png: The path to the png file.
+    webp: The path of the webp file built from it.
+
+  Raises:
+    BuildError: Process return code was nonzero.
+    ImportError: Pillow isn't installed.
+  """
+  from PIL import Image  # Only needed when building mips.
+  image = Image.open(png)
+  width, height = image.size
+  levels = []
+  while width > 1 or height > 1:
+    width = max(width // 2, 1)
+    height = max(height // 2, 1)
+    levels.append((width, height))
+  if not levels or not needs_rebuild(png, mip_texture_path(webp, len(levels))):
+    return
+  if image.mode not in ('RGB', 'RGBA'):
+    image = image.convert('RGBA' if 'A' in image.mode or
+                          'transparency' in image.info else 'RGB')
+  if not os.path.exists(MIP_INTERMEDIATE_PATH):
+    os.makedirs(MIP_INTERMEDIATE_PATH)
+  name = os.path.splitext(os.path.basename(webp))[0]
+  for level, size in enumerate(levels, 1):
+    mip_png = os.path.join(MIP_INTERMEDIATE_PATH, '%s.%d.png' % (name, level))
+    image.resize(size, Image.LANCZOS).save(mip_png)
+    convert_png_image_to_webp(mip_png, mip_texture_path(webp, level),
+                              WEBP_QUALITY)
+
+
+def clean_mip_textures(webp):
+  """Delete the precomputed mip levels of a processed webp texture."""
+  level = 1
+  while os.path.isfile(mip_texture_path(webp, level)):
+    os.remove(mip_texture_path(webp, level))
+    level += 1
+
+
+def has_pillow():
+  """Returns True if the Python Imaging Library is installed."""
+  try:
+    import PIL  # pylint: disable=unused-variable
+    return True
+  except ImportError:
+    sys.stderr.write('Pillow is not installed, so mip levels will not be '
+                     'precomputed.\n')
+    return False
+
+
+def clean_ktx_textures(webp):
+  """Delete the compressed variants of a processed webp texture."""
+  for suffix, _, _ in KTX_VARIANTS:
+    path = ktx_texture_path(webp, suffix)
+    if os.path.isfile(path):
+      os.remove(path)
+
+
 def needs_rebuild(source, target):
   """Checks if the source file needs to be rebuilt.
 
@@ -247,41 +452,545 @@ def needs_rebuild(source, target):
       os.path.getmtime(source) > os.path.getmtime(target))
 
 
+def archive_inputs(patterns):
+  """Returns (name, path) of the built files matching patterns, by name.
+
+  Names are relative to ASSETS_PATH, with forward slashes, as the game asks
+  for them.
+  """
+  files = {}
+  for pattern in patterns:
+    for path in glob.glob(os.path.join(ASSETS_PATH, pattern)):
+      if os.path.isfile(path):
+        name = os.path.relpath(path, ASSETS_PATH).replace(os.sep, '/')
+        files[name] = path
+  return sorted(files.items())
+
+
+def align(offset):
+  """Round offset up to the next multiple of ARCHIVE_ALIGNMENT."""
+  return (offset + ARCHIVE_ALIGNMENT - 1) // ARCHIVE_ALIGNMENT * \
+      ARCHIVE_ALIGNMENT
+
+
+def write_archive(out, files):
+  """Pack files into a single archive, with an index sorted by name.
+
+  The layout is read by AssetArchive: a header, an index entry of (name
+  offset, name length, offset, size) for each file, the null terminated
+  names, and then the files, each aligned to ARCHIVE_ALIGNMENT.
+
+  Args:
+    out: The path of the archive to write.
+    files: (name, path) of each file, sorted by name.
+  """
+  names = b''
+  name_offsets = []
+  names_start = 16 + 16 * len(files)
+  for name, _ in files:
+    encoded = name.encode('utf-8')
+    name_offsets.append((names_start + len(names), len(encoded)))
+    names += encoded + b'\0'
+  offset = align(names_start + len(names))
+  index = b''
+  contents = []
+  for (name_offset, name_length), (_, path) in zip(name_offsets, files):
+    with open(path, 'rb') as f:
+      data = f.read()
+    index += struct.pack('<4I', name_offset, name_length, offset, len(data))
+    contents.append((offset, data))
+    offset = align(offset + len(data))
+  with open(out, 'wb') as f:
+    f.write(struct.pack('<4I', ARCHIVE_MAGIC, ARCHIVE_VERSION, len(files), 0))
+    f.write(index)
+    f.write(names)
+    for start, data in contents:
+      f.write(b'\0' * (start - f.tell()))
+      f.write(data)
+
+
+def generate_archives():
+  """Pack the built files into each of ARCHIVES that is out of date."""
+  for archive, patterns in ARCHIVES:
+    out = os.path.join(ASSETS_PATH, archive)
+    files = archive_inputs(patterns)
+    if any(needs_rebuild(path, out) for _, path in files):
+      write_archive(out, files)
+
+
+def clean_archives():
+  """Delete the archives."""
+  for archive, _ in ARCHIVES:
+    path = os.path.join(ASSETS_PATH, archive)
+    if os.path.isfile(path):
+      os.remove(path)
+
+
 def processed_json_path(path):
   """Take the path to a raw json asset and convert it to target bin path."""
   return path.replace(RAW_ASSETS_PATH, ASSETS_PATH).replace('.json', '.bin')
 
 
-def generate_flatbuffer_binaries():
-  """Run the flatbuffer compiler on the all of the flatbuffer json files."""
+def load_flatbuffer_json(path):
+  """Parse a JSON file in the relaxed syntax that flatc accepts.
+
+  flatc allows comments, and unquoted field names and enum values, which the
+  json module does not, so comments are removed and the rest quoted before
+  parsing.
+
+  Args:
+    path: The path to the JSON file.
+
+  Returns:
+    The parsed JSON data.
+  """
+  with open(path) as f:
+    text = f.read()
+  # Remove comments, but not '//' in strings.
+  text = re.sub(r'("(?:[^"\\]|\\.)*")|//[^\n]*',
+                lambda match: match.group(1) or '', text)
+  # Quote field names, then bare words used as values.
+  text = re.sub(r'([{,]\s*)([A-Za-z_]\w*)\s*:', r'\1"\2":', text)
+  text = re.sub(r'([:\[,]\s*)([A-Za-z_]\w*)(?=\s*[,\]}])', r'\1"\2"', text)
+  # Allow trailing commas.
+  text = re.sub(r',(\s*[\]}])', r'\1', text)
+  return json.loads(text)
+
+
+class Atlas(object):
+  """A texture atlas definition, read from src/rawassets/atlases.
+
+  Every material in an atlas must have the same number of textures. For each
+  texture index, the n'th texture of every material is packed into the n'th
+  atlas image, at the same place in each image, so that a material's texture
+  coordinates stay valid for all of its textures.
+
+  Attributes:
+    name: Base name of the atlas images.
+    width: Width of the atlas images, in pixels.
+    height: Height of the atlas images, in pixels.
+    padding: Pixels left empty around each texture.
+    desired_format: If set, the desired_format of every material in the
+        atlas. The materials share their textures, which can only be loaded
+        in one format.
+    materials: Paths of the raw material JSON files in the atlas.
+    definition: Path of the atlas JSON file.
+  """
+
+  def __init__(self, definition):
+    """Initializes this object from the atlas JSON file 'definition'."""
+    with open(definition) as f:
+      data = json.load(f)
+    self.definition = definition
+    self.name = data['name']
+    self.width = data['width']
+    self.height = data['height']
+    self.padding = data.get('padding', 0)
+    self.desired_format = data.get('desired_format')
+    self.materials = [os.path.join(RAW_MATERIAL_PATH, m + '.json')
+                      for m in data['materials']]
+
+  def image_path(self, index):
+    """Path of the n'th generated atlas image, before conversion to webp."""
+    return os.path.join(ATLAS_INTERMEDIATE_PATH,
+                        '%s_%d.png' % (self.name, index))
+
+  def texture_filename(self, index):
+    """Path of the n'th atlas texture, as the game loads it."""
+    return 'textures/%s_%d.webp' % (self.name, index)
+
+
+def load_atlases():
+  """Returns an Atlas for each definition in src/rawassets/atlases."""
+  return [Atlas(path) for path in
+          sorted(glob.glob(os.path.join(RAW_ATLAS_PATH, '*.json')))]
+
+
+def raw_texture_path(texture_filename):
+  """Take the texture path a material uses and return its raw png path."""
+  return os.path.join(RAW_ASSETS_PATH,
+                      texture_filename.replace('.webp', '.png'))
+
+
+def atlas_material_path(material):
+  """Path of the material JSON file generated for an atlased material."""
+  return os.path.join(ATLAS_INTERMEDIATE_PATH, 'materials',
+                      os.path.basename(material))
+
+
+def pack_rectangles(sizes, width, height, padding):
+  """Place rectangles in a width x height area, in rows.
+
+  The largest rectangles are placed first. When the textures are powers of
+  two in size, as they are here, every rectangle lands on a multiple of its
+  own size and no space is wasted between them.
+
+  Args:
+    sizes: List of (width, height) tuples.
+    width: Width of the area to pack into.
+    height: Height of the area to pack into.
+    padding: Pixels to leave empty around each rectangle.
+
+  Returns:
+    A list of (x, y) positions, in the same order as 'sizes', or None if the
+    rectangles do not fit.
+  """
+  order = sorted(range(len(sizes)),
+                 key=lambda i: (sizes[i][1], sizes[i][0]), reverse=True)
+  positions = [None] * len(sizes)
+  x = y = row_height = 0
+  for i in order:
+    w = sizes[i][0] + 2 * padding
+    h = sizes[i][1] + 2 * padding
+    if x + w > width:
+      x = 0
+      y += row_height
+      row_height = 0
+    if x + w > width or y + h > height:
+      return None
+    positions[i] = (x + padding, y + padding)
+    x += w
+    row_height = max(row_height, h)
+  return positions
+
+
+def generate_atlas(atlas):
+  """Build the images and materials of one atlas, if they are out of date.
+
+  Args:
+    atlas: The Atlas to build.
+
+  Raises:
+    BuildError: The atlas is invalid, or an image could not be converted.
+  """
+  from PIL import Image  # Only needed when building atlases.
+
+  materials = [load_flatbuffer_json(m) for m in atlas.materials]
+  num_textures = len(materials[0]['texture_filenames'])
+  for material, path in zip(materials, atlas.materials):
+    if len(material['texture_filenames']) != num_textures:
+      sys.stderr.write('%s: %s has a different number of textures.\n' % (
+          atlas.definition, path))
+      raise BuildError([atlas.definition], 1)
+
+  sources = [atlas.definition] + atlas.materials + [
+      raw_texture_path(t) for m in materials for t in m['texture_filenames']]
+  targets = ([atlas.image_path(i) for i in range(num_textures)] +
+             [atlas_material_path(m) for m in atlas.materials])
+  if not any(needs_rebuild(source, target)
+             for source in sources for target in targets):
+    return
+
+  # The first texture decides the size of each material's rectangle. The
+  # others are scaled to match it.
+  images = [[Image.open(raw_texture_path(t)).convert('RGBA')
+             for t in m['texture_filenames']] for m in materials]
+  sizes = [material_images[0].size for material_images in images]
+  positions = pack_rectangles(sizes, atlas.width, atlas.height, atlas.padding)
+  if positions is None:
+    sys.stderr.write('%s: textures do not fit in %dx%d.\n' % (
+        atlas.definition, atlas.width, atlas.height))
+    raise BuildError([atlas.definition], 1)
+
+  if not os.path.exists(os.path.join(ATLAS_INTERMEDIATE_PATH, 'materials')):
+    os.makedirs(os.path.join(ATLAS_INTERMEDIATE_PATH, 'materials'))
+  for index in range(num_textures):
+    image = Image.new('RGBA', (atlas.width, atlas.height), (0, 0, 0, 0))
+    for material_images, size, position in zip(images, sizes, positions):
+      source = material_images[index]
+      if source.size != size:
+        source = source.resize(size, Image.BILINEAR)
+      image.paste(source, position)
+    image.save(atlas.image_path(index))
+
+  for material, path, size, position in zip(materials, atlas.materials,
+                                            sizes, positions):
+    material['texture_filenames'] = [atlas.texture_filename(i)
+                                     for i in range(num_textures)]
+    if atlas.desired_format:
+      material['desired_format'] = atlas.desired_format
+    material['texture_rect'] = {
+        'min_u': float(position[0]) / atlas.width,
+        'min_v': float(position[1]) / atlas.height,
+        'max_u': float(position[0] + size[0]) / atlas.width,
+        'max_v': float(position[1] + size[1]) / atlas.height,
+    }
+    with open(atlas_material_path(path), 'w') as f:
+      json.dump(material, f, indent=2, sort_keys=True)
+
+
+def generate_atlases(atlases, use_ktx):
+  """Build every atlas, and convert its images to webp, and KTX if asked."""
+  if not os.path.exists(TEXTURE_PATH):
+    os.makedirs(TEXTURE_PATH)
+  for atlas in atlases:
+    generate_atlas(atlas)
+    index = 0
+    while os.path.isfile(atlas.image_path(index)):
+      png = atlas.image_path(index)
+      out = os.path.join(ASSETS_PATH, atlas.texture_filename(index))
+      if needs_rebuild(png, out):
+        convert_png_image_to_webp(png, out, WEBP_QUALITY)
+      generate_mips(png, out)
+      if use_ktx:
+        convert_png_image_to_ktx(png, out)
+      index += 1
+
+
+def generate_flatbuffer_binaries(atlases):
+  """Run the flatbuffer compiler on the all of the flatbuffer json files.
+
+  Args:
+    atlases: The Atlases being built. Their materials are converted from the
+        generated JSON files instead of the raw ones. Pass an empty list to
+        convert every raw material.
+  """
+  atlased = dict((m, atlas_material_path(m))
+                 for atlas in atlases for m in atlas.materials)
+  # Materials that are in an atlas, but not built with it this time, may have
+  # been converted from a generated JSON file last time.
+  in_any_atlas = set(m for atlas in load_atlases() for m in atlas.materials)
   for element in FLATBUFFERS_CONVERSION_DATA:
     schema = element.schema
     output_path = element.output_path
     if not os.path.exists(output_path):
       os.makedirs(output_path)
-    for json in element.input_files:
-      target = processed_json_path(json)
-      if needs_rebuild(json, target) or needs_rebuild(schema, target):
+    for json_path in element.input_files:
+      target = processed_json_path(json_path)
+      source = atlased.get(json_path, json_path)
+      if (needs_rebuild(source, target) or needs_rebuild(schema, target) or
+          (json_path in in_any_atlas and json_path not in atlased)):
         convert_json_to_flatbuffer_binary(
-            json, schema, output_path)
+            source, schema, output_path)
+
+
+def raw_material_path(material_name, atlased):
+  """Path of the JSON file that the game's material file is built from.
+
+  Args:
+    material_name: The material file, as config.json names it.
+    atlased: Dictionary of the generated JSON files of atlased materials, by
+        raw JSON path.
+  """
+  path = os.path.join(RAW_ASSETS_PATH,
+                      material_name.replace('.bin', '.json'))
+  return atlased.get(path, path)
+
+
+def round_up_to_power_of_2(x):
+  """Same as mathfu::RoundUpToPowerOf2()."""
+  return 2.0 ** math.ceil(math.log(x) / math.log(2.0))
+
+
+def compute_normals_tangents(vertices, indices):
+  """Same as Mesh::ComputeNormalsTangents(), for vertices from bake_quad()."""
+  def add(a, b):
+    return [x + y for x, y in zip(a, b)]
+
+  def sub(a, b):
+    return [x - y for x, y in zip(a, b)]
+
+  def scale(a, s):
+    return [x * s for x in a]
+
+  def dot(a, b):
+    return sum(x * y for x, y in zip(a, b))
+
+  def cross(a, b):
+    return [a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2],
+            a[0] * b[1] - a[1] * b[0]]
+
+  def normalize(a):
+    return scale(a, 1.0 / math.sqrt(dot(a, a)))
+
+  norms = [[0.0] * 3 for _ in vertices]
+  tangents = [[0.0] * 3 for _ in vertices]
+  binormals = [[0.0] * 3 for _ in vertices]
+  for i in range(0, len(indices), 3):
+    triangle = indices[i:i + 3]
+    v0, v1, v2 = [vertices[index] for index in triangle]
+    q1 = sub(v1['pos'], v0['pos'])
+    q2 = sub(v2['pos'], v0['pos'])
+    norm = normalize(cross(q1, q2))
+    uv1 = sub(v1['tc'], v0['tc'])
+    uv2 = sub(v2['tc'], v0['tc'])
+    m = 1.0 / (uv1[0] * uv2[1] - uv2[0] * uv1[1])
+    tangent = scale(sub(scale(q1, uv2[1]), scale(q2, uv1[1])), m)
+    binormal = scale(sub(scale(q2, uv1[0]), scale(q1, uv2[0])), m)
+    for index in triangle:
+      norms[index] = add(norms[index], norm)
+      tangents[index] = add(tangents[index], tangent)
+      binormals[index] = binormal
+  for vertex, norm, tangent, binormal in zip(vertices, norms, tangents,
+                                             binormals):
+    norm = normalize(norm)
+    tangent = normalize(tangent)
+    tangent = normalize(sub(tangent, scale(norm, dot(norm, tangent))))
+    vertex['norm'] = norm
+    vertex['tangent'] = tangent + [dot(cross(norm, tangent),
+                                       normalize(binormal))]
+
+
+def bake_quad(material_name, offset, pixel_bounds, pixel_to_world_scale,
+              atlased):
+  """Bake a quad, as PieNoonGame::CreateVerticalQuadMesh() would build it.
+
+  Args:
+    material_name: The material file, as config.json names it, or None.
+    offset: (x, y, z) of the middle of the bottom edge.
+    pixel_bounds: (width, height) of the image in the texture, in pixels.
+    pixel_to_world_scale: World units per pixel.
+    atlased: Dictionary of the generated JSON files of atlased materials, by
+        raw JSON path.
 
+  Returns:
+    A BakedQuad, as a dictionary for flatc. It has no vertices if the
+    material is missing or has no textures.
+  """
+  if not material_name:
+    return {}
+  quad = {'material': material_name}
+  path = raw_material_path(material_name, atlased)
+  if not os.path.isfile(path):
+    return quad
+  material = load_flatbuffer_json(path)
+  if not material.get('texture_filenames') or not all(pixel_bounds):
+    return quad
+  rect = material.get('texture_rect', {'min_u': 0.0, 'min_v': 0.0,
+                                       'max_u': 1.0, 'max_v': 1.0})
+
+  def map_texture_coord(u, v):
+    return [rect['min_u'] + u * (rect['max_u'] - rect['min_u']),
+            rect['min_v'] + v * (rect['max_v'] - rect['min_v'])]
+
+  # Geometry in proportion to the image, at the bottom of the middle of
+  # the texture.
+  coord_width = pixel_bounds[0] / round_up_to_power_of_2(pixel_bounds[0])
+  coord_height = pixel_bounds[1] / round_up_to_power_of_2(pixel_bounds[1])
+  half_width = pixel_bounds[0] * pixel_to_world_scale * 0.5
+  height = pixel_bounds[1] * pixel_to_world_scale
+  left, right = offset[0] - half_width, offset[0] + half_width
+  bottom, top = offset[1], offset[1] + height
+  coord_left, coord_right = 0.5 - coord_width * 0.5, 0.5 + coord_width * 0.5
+  coord_bottom, coord_top = 1.0, 1.0 - coord_height
+  vertices = [
+      {'pos': [left, bottom, offset[2]],
+       'tc': map_texture_coord(coord_left, coord_bottom)},
+      {'pos': [right, bottom, offset[2]],
+       'tc': map_texture_coord(coord_right, coord_bottom)},
+      {'pos': [left, top, offset[2]],
+       'tc': map_texture_coord(coord_left, coord_top)},
+      {'pos': [right, top, offset[2]],
+       'tc': map_texture_coord(coord_right, coord_top)},
+  ]
+  compute_normals_tangents(vertices, QUAD_INDICES)
+  names = {'pos': 'xyz', 'tc': 'xy', 'norm': 'xyz', 'tangent': 'xyzw'}
+  quad['vertices'] = [
+      dict((field, dict(zip(names[field], vertex[field])))
+           for field in names) for vertex in vertices]
+  quad['indices'] = QUAD_INDICES
+  return quad
+
+
+def fnv1a_64(data):
+  """64-bit FNV-1a hash of 'data', as pie_noon_game.cpp computes it."""
+  value = 14695981039346656037
+  for byte in bytearray(data):
+    value = ((value ^ byte) * 1099511628211) & 0xFFFFFFFFFFFFFFFF
+  return value
+
+
+def generate_cardboard_meshes(atlases):
+  """Bake the cardboard quads into CARDBOARD_MESHES_PATH, if out of date.
+
+  The quads are baked every time, since they depend on many files, and on
+  whether atlases are built. They are only converted when they differ from
+  the last ones converted.
+
+  The file records the hash of the converted config.bin, so the game can
+  tell when it is stale. config.bin must already be converted.
+
+  Args:
+    atlases: The Atlases being built. Their materials' texture coordinates
+        are read from the generated JSON files.
 
-def generate_webp_textures():
-  """Run the webp converter on off of the png files."""
+  Raises:
+    BuildError: Process return code was nonzero.
+  """
+  atlased = dict((m, atlas_material_path(m))
+                 for atlas in atlases for m in atlas.materials)
+  config_path = os.path.join(RAW_ASSETS_PATH, 'config.json')
+  config = load_flatbuffer_json(config_path)
+  with open(processed_json_path(config_path), 'rb') as f:
+    config_hash = fnv1a_64(f.read())
+
+  def vec(value, fields):
+    return [0.0 if value is None else value.get(f, 0.0) for f in fields]
+
+  pixel_to_world_scale = config.get('pixel_to_world_scale', 0.0)
+  front_z = config.get('cardboard_front_z_offset', 0.0)
+  back_z = config.get('cardboard_back_z_offset', 0.0)
+  meshes = {'version': CARDBOARD_MESHES_VERSION, 'config_hash': config_hash,
+            'fronts': [], 'backs': []}
+  for renderable in config['renderables']:
+    x, y, z = vec(renderable.get('offset'), 'xyz')
+    pixel_bounds = vec(renderable.get('pixel_bounds'), 'xy')
+    scale = renderable.get('geometry_scale', 1.0) * pixel_to_world_scale
+    meshes['fronts'].append(bake_quad(
+        renderable.get('cardboard_front'), (x, y, z + front_z), pixel_bounds,
+        scale, atlased))
+    meshes['backs'].append(bake_quad(
+        renderable.get('cardboard_back'), (x, y, z + back_z), pixel_bounds,
+        scale, atlased))
+  stick_bounds = vec(config.get('stick_bounds'), 'xy')
+  stick_y = config.get('stick_y_offset', 0.0)
+  meshes['stick_front'] = bake_quad(
+      config.get('stick_front'),
+      (0.0, stick_y, config.get('stick_front_z_offset', 0.0)), stick_bounds,
+      pixel_to_world_scale, atlased)
+  meshes['stick_back'] = bake_quad(
+      config.get('stick_back'),
+      (0.0, stick_y, config.get('stick_back_z_offset', 0.0)), stick_bounds,
+      pixel_to_world_scale, atlased)
+
+  text = json.dumps(meshes, indent=2, sort_keys=True)
+  if (os.path.isfile(CARDBOARD_MESHES_JSON) and
+      not needs_rebuild(CARDBOARD_MESHES_JSON, CARDBOARD_MESHES_PATH) and
+      not needs_rebuild(CARDBOARD_MESHES_SCHEMA, CARDBOARD_MESHES_PATH)):
+    with open(CARDBOARD_MESHES_JSON) as f:
+      if f.read() == text:
+        return
+  if not os.path.exists(os.path.dirname(CARDBOARD_MESHES_JSON)):
+    os.makedirs(os.path.dirname(CARDBOARD_MESHES_JSON))
+  with open(CARDBOARD_MESHES_JSON, 'w') as f:
+    f.write(text)
+  convert_json_to_flatbuffer_binary(CARDBOARD_MESHES_JSON,
+                                    CARDBOARD_MESHES_SCHEMA, ASSETS_PATH)
+
+
+def generate_webp_textures(use_ktx):
+  """Run the webp converter on off of the png files, and KTX if asked."""
   input_files = PNG_TEXTURES['input_files']
   output_files = PNG_TEXTURES['output_files']
   if not os.path.exists(TEXTURE_PATH):
     os.makedirs(TEXTURE_PATH)
+  use_mips = has_pillow()
   for png, out in zip(input_files, output_files):
     if needs_rebuild(png, out):
       convert_png_image_to_webp(png, out, WEBP_QUALITY)
+    if use_mips:
+      generate_mips(png, out)
+    if use_ktx:
+      convert_png_image_to_ktx(png, out)
 
 
 def clean_webp_textures():
-  """Delete all the processed webp textures."""
+  """Delete all the processed webp and KTX textures."""
   for webp in PNG_TEXTURES['output_files']:
     if os.path.isfile(webp):
       os.remove(webp)
+    clean_mip_textures(webp)
+    clean_ktx_textures(webp)
 
 
 def clean_flatbuffer_binaries():
@@ -291,12 +1000,35 @@ def clean_flatbuffer_binaries():
       path = processed_json_path(json)
       if os.path.isfile(path):
         os.remove(path)
+  for path in (CARDBOARD_MESHES_PATH, CARDBOARD_MESHES_JSON):
+    if os.path.isfile(path):
+      os.remove(path)
+
+
+def clean_atlases():
+  """Delete all the generated atlas images and materials."""
+  for atlas in load_atlases():
+    index = 0
+    while os.path.isfile(atlas.image_path(index)):
+      os.remove(atlas.image_path(index))
+      webp = os.path.join(ASSETS_PATH, atlas.texture_filename(index))
+      if os.path.isfile(webp):
+        os.remove(webp)
+      clean_mip_textures(webp)
+      clean_ktx_textures(webp)
+      index += 1
+    for material in atlas.materials:
+      path = atlas_material_path(material)
+      if os.path.isfile(path):
+        os.remove(path)
 
 
 def clean():
   """Delete all the processed files."""
   clean_flatbuffer_binaries()
   clean_webp_textures()
+  clean_atlases()
+  clean_archives()
 
 
 def handle_build_error(error):
@@ -312,7 +1044,10 @@ def main(argv):
   alternatively, call it with the argument 'all'. To just convert the flatbuffer
   json files, call it with 'flatbuffers'. Likewise to convert the png files to
   webp files, call it with 'webp'. To clean all converted files, call it with
-  'clean'.
+  'clean'. Add '--atlases' to pack the materials listed in
+  src/rawassets/atlases into atlas textures, '--ktx' to also write
+  GPU-compressed textures, and '--archives' to pack the results into
+  archives.
 
   Args:
     argv: The command line argument containing which command to run.
@@ -320,22 +1055,38 @@ def main(argv):
   Returns:
     Returns 0 on success.
   """
-  target = argv[1] if len(argv) >= 2 else 'all'
+  use_atlases = '--atlases' in argv
+  use_ktx = '--ktx' in argv
+  use_archives = '--archives' in argv
+  args = [arg for arg in argv[1:]
+          if arg not in ('--atlases', '--ktx', '--archives')]
+  target = args[0] if args else 'all'
   if target not in ('all', 'flatbuffers', 'webp', 'clean'):
     sys.stderr.write('No rule to build target %s.\n' % target)
 
+  atlases = load_atlases() if use_atlases else []
   if target in ('all', 'flatbuffers'):
     try:
-      generate_flatbuffer_binaries()
+      # The generated materials must exist before they are converted.
+      generate_atlases(atlases, use_ktx)
+      generate_flatbuffer_binaries(atlases)
+      generate_cardboard_meshes(atlases)
     except BuildError as error:
       handle_build_error(error)
       return 1
+    except ImportError:
+      sys.stderr.write('Building atlases requires the Python Imaging '
+                       'Library (Pillow).\n')
+      return 1
   if target in ('all', 'webp'):
     try:
-      generate_webp_textures()
+      generate_webp_textures(use_ktx)
     except BuildError as error:
       handle_build_error(error)
       return 1
+  if use_archives and target != 'clean':
+    # After everything else, since the archives hold the built files.
+    generate_archives()
   if target == 'clean':
     try:
       clean()
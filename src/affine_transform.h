@@ -0,0 +1,50 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef AFFINE_TRANSFORM_H
+#define AFFINE_TRANSFORM_H
+
+#include "mathfu/matrix.h"
+#include "mathfu/vector.h"
+#include "mathfu/glsl_mappings.h"
+
+namespace fpl {
+
+// Inverse of 'matrix', which must be affine with orthogonal columns: a
+// rotation and translation, with any scale applied before the rotation.
+// The world matrices of the renderables all are. Much cheaper than
+// mathfu::mat4::Inverse(), which handles any matrix.
+//
+// With the upper 3x3 equal to R * S, its inverse is S^-1 * R^T, whose rows
+// are the columns of R * S divided by their squared lengths.
+inline mathfu::mat4 OrthogonalAffineInverse(const mathfu::mat4 &matrix) {
+  mathfu::mat4 inverse;
+  mathfu::vec3 translation(matrix(0, 3), matrix(1, 3), matrix(2, 3));
+  for (int col = 0; col < 3; ++col) {
+    const mathfu::vec3 column(matrix(0, col), matrix(1, col), matrix(2, col));
+    const mathfu::vec3 row = column / column.LengthSquared();
+    inverse(col, 0) = row.x();
+    inverse(col, 1) = row.y();
+    inverse(col, 2) = row.z();
+    inverse(col, 3) = -mathfu::vec3::DotProduct(row, translation);
+    inverse(3, col) = 0.0f;
+  }
+  inverse(3, 3) = 1.0f;
+  return inverse;
+}
+
+}  // fpl
+
+#endif  // AFFINE_TRANSFORM_H
@@ -32,6 +32,7 @@ void AiController::Initialize(GameState* gamestate,
   character_id_ = character_id;
   time_to_next_action_ = 0;
   block_timer_ = 0;
+  rng_.Seed(static_cast<uint64_t>(character_id));
 }
 
 void AiController::AdvanceFrame(WorldTime delta_time) {
@@ -62,11 +63,11 @@ void AiController::AdvanceFrame(WorldTime delta_time) {
     return;
 
   time_to_next_action_ =
-      mathfu::RandomInRange<WorldTime>(
+      rng_.IntInRange(
       config_->ai_minimum_time_between_actions(),
       config_->ai_maximum_time_between_actions());
 
-  float action = mathfu::Random<float>();
+  float action = rng_.Float();
   if (action < config_->ai_chance_to_change_aim()) {
       if (action < config_->ai_chance_to_change_aim() / 2) {
         SetLogicalInputs(LogicalInputs_Left, true);
@@ -81,8 +82,8 @@ void AiController::AdvanceFrame(WorldTime delta_time) {
   } // else do nothing.
 
   if (IsInDanger(character_id_) &&
-      mathfu::Random<float>() < config_->ai_chance_to_block()) {
-    block_timer_ = mathfu::RandomInRange<WorldTime>(
+      rng_.Float() < config_->ai_chance_to_block()) {
+    block_timer_ = rng_.IntInRange(
           config_->ai_block_min_duration(),
           config_->ai_block_max_duration());
     SetLogicalInputs(LogicalInputs_Deflect, true);
@@ -91,12 +92,7 @@ void AiController::AdvanceFrame(WorldTime delta_time) {
 
 // Utility function for checking if someone is in danger.
 bool AiController::IsInDanger(CharacterId id) const {
-  for (size_t i = 0; i < gamestate_->pies().size(); i++) {
-    if (gamestate_->pies()[i]->target() == id) {
-      return true;
-    }
-  }
-  return false;
+  return gamestate_->pies().IncomingCount(id) > 0;
 }
 
 }  // pie_noon
@@ -20,6 +20,7 @@
 #include "game_state.h"
 #include "controller.h"
 #include "common.h"
+#include "rng.h"
 #include "timeline_generated.h"
 #include "character_state_machine_def_generated.h"
 #include "pie_noon_common_generated.h" // TODO: put in alphabetical order when
@@ -44,6 +45,10 @@ class AiController : public Controller {
   // Decide what the robot is doing this frame.
   virtual void AdvanceFrame(WorldTime delta_time);
 
+  // Restart the AI's random choices. Initialize() seeds them with the
+  // character id.
+  void Seed(uint64_t seed) { rng_.Seed(seed); }
+
  private:
   bool IsInDanger(CharacterId id) const;
   WorldTime block_timer_;   // How many milliseconds we need to block.
@@ -51,6 +56,7 @@ class AiController : public Controller {
   GameState* gamestate_; // Pointer to the gamestate object
   const Config* config_; // Pointer to the config structure
   WorldTime time_to_next_action_;
+  Rng rng_;              // Source of the AI's random choices
 };
 
 }  // pie_noon
@@ -21,6 +21,7 @@
 #include "mathfu/matrix.h"
 #include "mathfu/vector.h"
 #include "mathfu/glsl_mappings.h"
+#include "impel_simd.h"
 
 #ifdef FPL_ANGLE_UNIT_TESTS
 #include "gtest/gtest.h"
@@ -49,6 +50,24 @@ static const float kDegreesPerCircle = 360.0f;
 // (-pi, pi], even when the math is perfect.
 static const float kMinUniqueAngle = -3.1415925f;
 
+// How the batch conversions at the end of this file compute trigonometry.
+enum AngleAccuracy {
+  // atan2f, sinf and cosf, one value at a time. Identical to FromXZVector()
+  // and ToXZVector().
+  kAngleExact,
+
+  // Polynomial approximations, four values at a time when SIMD is available.
+  // Within kFastAtan2MaxError or kFastSinCosMaxError of the exact results.
+  // Fine for rendering, but the simulation should stay exact so that
+  // recordings replay the same way.
+  kAngleFast
+};
+
+// Maximum errors of the kAngleFast conversions, in radians and in units of
+// the vector length respectively.
+static const float kFastAtan2MaxError = 0.000005f;
+static const float kFastSinCosMaxError = 0.000005f;
+
 
 //    Purpose
 //    =======
@@ -190,6 +209,18 @@ class Angle {
     return Angle(ModIfNegativePi(atan2f(v[2], v[0])));
   }
 
+  // The same as FromXZVector(), but within kFastAtan2MaxError of it, and
+  // faster.
+  static Angle FromXZVectorFast(const mathfu::vec3& v) {
+    return Angle(ModIfNegativePi(FastAtan2(v[2], v[0])));
+  }
+
+  // The same as ToXZVector(), but within kFastSinCosMaxError of it, and
+  // faster.
+  mathfu::vec3 ToXZVectorFast() const {
+    return mathfu::vec3(FastSin(angle_ + kHalfPi), 0.0f, FastSin(angle_));
+  }
+
   // Return true if 'angle' is within the valid range (-pi,pi], that is,
   // the range inclusive of +pi but exclusive of -pi.
   static bool IsAngleInRange(const float angle) {
@@ -228,6 +259,113 @@ class Angle {
     return angle < kMinUniqueAngle ? kMaxUniqueAngle : angle;
   }
 
+  // Polynomial approximation of atan(a) for 'a' in [0, 1], within about
+  // 2e-6 radians. The coefficients are a least squares fit.
+  static float AtanUnit(const float a) {
+    const float s = a * a;
+    return a * (0.99997726f + s * (-0.33262347f + s * (0.19354346f +
+           s * (-0.11643287f + s * (0.05265332f + s * -0.01172120f)))));
+  }
+
+  // Approximation of atan2f(z, x), in the range [-pi, pi]. Reduces to the
+  // first octant, where AtanUnit() applies, then reflects back.
+  static float FastAtan2(const float z, const float x) {
+    const float ax = fabsf(x);
+    const float az = fabsf(z);
+    const float hi = ax > az ? ax : az;
+    const float lo = ax > az ? az : ax;
+    const float octant = AtanUnit(hi > 0.0f ? lo / hi : 0.0f);
+    const float quadrant = az > ax ? kHalfPi - octant : octant;
+    const float half = x < 0.0f ? kPi - quadrant : quadrant;
+    return z < 0.0f ? -half : half;
+  }
+
+  // Approximation of sinf(angle) for 'angle' in (-pi, 3pi/2]. Reflects into
+  // [-pi/2, pi/2], where the Taylor series to x^9 is within 4e-6.
+  static float FastSin(const float angle) {
+    const float x = angle > kHalfPi ? kPi - angle :
+                    angle < -kHalfPi ? -kPi - angle : angle;
+    const float s = x * x;
+    return x * (1.0f + s * (-1.0f / 6.0f + s * (1.0f / 120.0f +
+           s * (-1.0f / 5040.0f + s * (1.0f / 362880.0f)))));
+  }
+
+#if defined(IMPEL_SIMD)
+  // Four-wide versions of the above. Same operations, in the same order.
+  static impel::Float4 AtanUnit4(const impel::Float4 a) {
+    using namespace impel;
+    const Float4 s = Mul4(a, a);
+    Float4 p = Add4(Splat4(0.05265332f), Mul4(s, Splat4(-0.01172120f)));
+    p = Add4(Splat4(-0.11643287f), Mul4(s, p));
+    p = Add4(Splat4(0.19354346f), Mul4(s, p));
+    p = Add4(Splat4(-0.33262347f), Mul4(s, p));
+    p = Add4(Splat4(0.99997726f), Mul4(s, p));
+    return Mul4(a, p);
+  }
+
+  static impel::Float4 FastAtan2_4(const impel::Float4 z,
+                                   const impel::Float4 x) {
+    using namespace impel;
+    const Float4 zero = Splat4(0.0f);
+    const Float4 ax = Abs4(x);
+    const Float4 az = Abs4(z);
+    const Float4 hi = Max4(ax, az);
+    const Float4 lo = Min4(ax, az);
+    // Avoid 0/0 when both coordinates are zero. 'lo' is zero too, so the
+    // quotient is still zero.
+    const Float4 safe_hi = Select4(Greater4(hi, zero), hi, Splat4(1.0f));
+    const Float4 octant = AtanUnit4(Div4(lo, safe_hi));
+    const Float4 quadrant = Select4(Greater4(az, ax),
+                                    Sub4(Splat4(kHalfPi), octant), octant);
+    const Float4 half = Select4(Greater4(zero, x),
+                                Sub4(Splat4(kPi), quadrant), quadrant);
+    const Float4 angle = Select4(Greater4(zero, z), Sub4(zero, half), half);
+    return ModIfNegativePi4(angle);
+  }
+
+  static impel::Float4 FastSin4(const impel::Float4 angle) {
+    using namespace impel;
+    const Float4 half_pi = Splat4(kHalfPi);
+    const Float4 negative_half_pi = Splat4(-kHalfPi);
+    const Float4 x = Select4(Greater4(angle, half_pi),
+                             Sub4(Splat4(kPi), angle),
+                             Select4(Greater4(negative_half_pi, angle),
+                                     Sub4(Splat4(-kPi), angle), angle));
+    const Float4 s = Mul4(x, x);
+    Float4 p = Add4(Splat4(-1.0f / 5040.0f),
+                    Mul4(s, Splat4(1.0f / 362880.0f)));
+    p = Add4(Splat4(1.0f / 120.0f), Mul4(s, p));
+    p = Add4(Splat4(-1.0f / 6.0f), Mul4(s, p));
+    p = Add4(Splat4(1.0f), Mul4(s, p));
+    return Mul4(x, p);
+  }
+
+  static impel::Float4 ModWithinThreePi4(const impel::Float4 angle) {
+    using namespace impel;
+    const Float4 two_pi = Splat4(kTwoPi);
+    const Float4 above = Select4(Greater4(Splat4(kMinUniqueAngle), angle),
+                                 Add4(angle, two_pi), angle);
+    return Select4(Greater4(above, Splat4(kMaxUniqueAngle)),
+                   Sub4(above, two_pi), above);
+  }
+
+  static impel::Float4 ModIfNegativePi4(const impel::Float4 angle) {
+    using namespace impel;
+    return Select4(Greater4(Splat4(kMinUniqueAngle), angle),
+                   Splat4(kMaxUniqueAngle), angle);
+  }
+
+  friend void AnglesFromXZVectors(const mathfu::vec3* vectors, int count,
+                                  AngleAccuracy accuracy, Angle* angles);
+  friend void AnglesToXZVectors(const Angle* angles, int count,
+                                AngleAccuracy accuracy,
+                                mathfu::vec3* vectors);
+  friend void AddAngles(const Angle* a, const Angle* b, int count,
+                        Angle* sums);
+  friend void SubtractAngles(const Angle* a, const Angle* b, int count,
+                             Angle* differences);
+#endif // defined(IMPEL_SIMD)
+
   float angle_; // Angle in radians, in range (-pi, pi]
 };
 
@@ -291,6 +429,95 @@ inline Angle Angle::Clamp(const Angle& center, const Angle& max_diff) const {
   return center + diff_clamped;
 }
 
+// Batch versions of FromXZVector() and ToXZVector(), and of + and -, for
+// when the same calculation is made for every character. The angle and
+// vector arrays hold 'count' elements, and needn't be aligned. With
+// kAngleFast and SIMD, four elements are processed at a time.
+inline void AnglesFromXZVectors(const mathfu::vec3* vectors, int count,
+                                AngleAccuracy accuracy, Angle* angles) {
+  int i = 0;
+#if defined(IMPEL_SIMD)
+  if (accuracy == kAngleFast) {
+    float x[impel::kSimdWidth];
+    float z[impel::kSimdWidth];
+    for (; i + impel::kSimdWidth <= count; i += impel::kSimdWidth) {
+      for (int j = 0; j < impel::kSimdWidth; ++j) {
+        x[j] = vectors[i + j][0];
+        z[j] = vectors[i + j][2];
+      }
+      impel::StoreUnaligned4(x, Angle::FastAtan2_4(impel::LoadUnaligned4(z),
+                                                   impel::LoadUnaligned4(x)));
+      for (int j = 0; j < impel::kSimdWidth; ++j) {
+        angles[i + j] = Angle(x[j]);
+      }
+    }
+  }
+#endif // defined(IMPEL_SIMD)
+  for (; i < count; ++i) {
+    angles[i] = accuracy == kAngleFast ? Angle::FromXZVectorFast(vectors[i]) :
+                                         Angle::FromXZVector(vectors[i]);
+  }
+}
+
+inline void AnglesToXZVectors(const Angle* angles, int count,
+                              AngleAccuracy accuracy, mathfu::vec3* vectors) {
+  int i = 0;
+#if defined(IMPEL_SIMD)
+  if (accuracy == kAngleFast) {
+    float x[impel::kSimdWidth];
+    float z[impel::kSimdWidth];
+    for (; i + impel::kSimdWidth <= count; i += impel::kSimdWidth) {
+      const impel::Float4 radians =
+          impel::LoadUnaligned4(&angles[i].angle_);
+      impel::StoreUnaligned4(x, Angle::FastSin4(
+          impel::Add4(radians, impel::Splat4(kHalfPi))));
+      impel::StoreUnaligned4(z, Angle::FastSin4(radians));
+      for (int j = 0; j < impel::kSimdWidth; ++j) {
+        vectors[i + j] = mathfu::vec3(x[j], 0.0f, z[j]);
+      }
+    }
+  }
+#endif // defined(IMPEL_SIMD)
+  for (; i < count; ++i) {
+    vectors[i] = accuracy == kAngleFast ? angles[i].ToXZVectorFast() :
+                                          angles[i].ToXZVector();
+  }
+}
+
+// sums[i] = a[i] + b[i]. Identical to operator+, at any accuracy. 'sums' may
+// be 'a' or 'b'.
+inline void AddAngles(const Angle* a, const Angle* b, int count,
+                      Angle* sums) {
+  int i = 0;
+#if defined(IMPEL_SIMD)
+  for (; i + impel::kSimdWidth <= count; i += impel::kSimdWidth) {
+    impel::StoreUnaligned4(&sums[i].angle_, Angle::ModWithinThreePi4(
+        impel::Add4(impel::LoadUnaligned4(&a[i].angle_),
+                    impel::LoadUnaligned4(&b[i].angle_))));
+  }
+#endif // defined(IMPEL_SIMD)
+  for (; i < count; ++i) {
+    sums[i] = a[i] + b[i];
+  }
+}
+
+// differences[i] = a[i] - b[i]. Identical to operator-, at any accuracy.
+// 'differences' may be 'a' or 'b'.
+inline void SubtractAngles(const Angle* a, const Angle* b, int count,
+                           Angle* differences) {
+  int i = 0;
+#if defined(IMPEL_SIMD)
+  for (; i + impel::kSimdWidth <= count; i += impel::kSimdWidth) {
+    impel::StoreUnaligned4(&differences[i].angle_, Angle::ModWithinThreePi4(
+        impel::Sub4(impel::LoadUnaligned4(&a[i].angle_),
+                    impel::LoadUnaligned4(&b[i].angle_))));
+  }
+#endif // defined(IMPEL_SIMD)
+  for (; i < count; ++i) {
+    differences[i] = a[i] - b[i];
+  }
+}
+
 }  // namespace fpl
 
 #endif  // PIE_NOON_SRC_ANGLE_H
@@ -0,0 +1,145 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "precompiled.h"
+#include "asset_archive.h"
+
+#include <cstring>
+#include <memory>
+
+namespace fpl {
+
+// "FPAK", then a version that changes whenever the layout does. Must match
+// build_assets.py.
+static const uint32_t kAssetArchiveMagic = 0x4B415046;
+static const uint32_t kAssetArchiveVersion = 1;
+
+// Little endian, as are all the devices the game runs on.
+struct AssetArchiveHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_entries;
+  uint32_t reserved;
+};
+
+// Offsets are from the start of the archive. Names are null terminated.
+struct AssetArchiveEntry {
+  uint32_t name_offset;
+  uint32_t name_length;
+  uint32_t offset;
+  uint32_t size;
+};
+
+static AssetArchiveEntry ReadEntry(const uint8_t *data, uint32_t index) {
+  AssetArchiveEntry entry;
+  memcpy(&entry, data + sizeof(AssetArchiveHeader) + index * sizeof(entry),
+         sizeof(entry));
+  return entry;
+}
+
+AssetArchive::AssetArchive() : data_(nullptr), size_(0), num_entries_(0) {}
+
+bool AssetArchive::Open(const char *filename) {
+  return file_.OpenOptional(filename) &&
+         Initialize(file_.data(), file_.size());
+}
+
+bool AssetArchive::Initialize(const uint8_t *data, size_t size) {
+  data_ = nullptr;
+  size_ = 0;
+  num_entries_ = 0;
+  AssetArchiveHeader header;
+  if (size < sizeof(header)) return false;
+  memcpy(&header, data, sizeof(header));
+  if (header.magic != kAssetArchiveMagic ||
+      header.version != kAssetArchiveVersion ||
+      header.num_entries > (size - sizeof(header)) / sizeof(AssetArchiveEntry))
+    return false;
+
+  // Check every entry up front, so that Find() can trust them. The names must
+  // be in order for the binary search.
+  const char *previous = nullptr;
+  for (uint32_t i = 0; i < header.num_entries; ++i) {
+    const AssetArchiveEntry entry = ReadEntry(data, i);
+    if (entry.name_offset >= size ||
+        size - entry.name_offset <= entry.name_length ||
+        data[entry.name_offset + entry.name_length] != '\0' ||
+        entry.offset > size || size - entry.offset < entry.size ||
+        entry.offset % kAssetArchiveAlignment != 0)
+      return false;
+    const char *name = reinterpret_cast<const char *>(data) +
+                       entry.name_offset;
+    if (strlen(name) != entry.name_length ||
+        (previous && strcmp(previous, name) >= 0))
+      return false;
+    previous = name;
+  }
+  data_ = data;
+  size_ = size;
+  num_entries_ = header.num_entries;
+  return true;
+}
+
+bool AssetArchive::Find(const char *name, const uint8_t **data,
+                        size_t *size) const {
+  uint32_t begin = 0;
+  uint32_t end = num_entries_;
+  while (begin < end) {
+    const uint32_t middle = begin + (end - begin) / 2;
+    const AssetArchiveEntry entry = ReadEntry(data_, middle);
+    const int order = strcmp(
+        name, reinterpret_cast<const char *>(data_) + entry.name_offset);
+    if (order == 0) {
+      *data = data_ + entry.offset;
+      *size = entry.size;
+      return true;
+    }
+    if (order < 0) {
+      end = middle;
+    } else {
+      begin = middle + 1;
+    }
+  }
+  return false;
+}
+
+// Newest last.
+static std::vector<std::unique_ptr<AssetArchive>> &MountedArchives() {
+  static std::vector<std::unique_ptr<AssetArchive>> archives;
+  return archives;
+}
+
+bool MountAssetArchive(const char *filename) {
+  std::unique_ptr<AssetArchive> archive(new AssetArchive());
+  if (!archive->Open(filename)) return false;
+  SDL_Log("Mounted %s: %d files", filename, archive->num_files());
+  MountedArchives().push_back(std::move(archive));
+  return true;
+}
+
+void UnmountAssetArchives() {
+  MountedArchives().clear();
+}
+
+bool FindInAssetArchives(const char *name, const uint8_t **data,
+                         size_t *size) {
+  auto &archives = MountedArchives();
+  for (size_t i = archives.size(); i > 0; --i) {
+    if (archives[i - 1]->Find(name, data, size)) return true;
+  }
+  return false;
+}
+
+}  // fpl
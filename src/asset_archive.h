@@ -0,0 +1,83 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef FPL_ASSET_ARCHIVE_H
+#define FPL_ASSET_ARCHIVE_H
+
+#include <cstddef>
+#include <cstdint>
+#include "mapped_file.h"
+
+namespace fpl {
+
+// Many assets packed into one file, so that loading them needs one open
+// instead of one each. On Android, every open is a lookup in the apk's zip
+// directory.
+//
+// build_assets.py writes the archives. A header is followed by an index of
+// entries sorted by name, then the names, then the files themselves, each
+// starting on a kAssetArchiveAlignment boundary. So once the archive is
+// mapped, every file in it can be used in place, even by code that reads
+// words, such as flatbuffers.
+static const size_t kAssetArchiveAlignment = 16;
+
+class AssetArchive {
+ public:
+  AssetArchive();
+
+  // Map the archive in 'filename', and check its index. Returns false, and
+  // logs nothing, if it's missing or damaged.
+  bool Open(const char *filename);
+
+  // Use the archive in the 'size' bytes at 'data', which must stay valid
+  // while the archive is used. Returns false if it's damaged.
+  bool Initialize(const uint8_t *data, size_t size);
+
+  // Find the file called 'name', such as "materials/pie.bin". The file is
+  // valid for as long as the archive is.
+  bool Find(const char *name, const uint8_t **data, size_t *size) const;
+
+  int num_files() const { return static_cast<int>(num_entries_); }
+
+ private:
+  // Disallow copies. The mapping is owned.
+  AssetArchive(const AssetArchive&);
+  AssetArchive& operator=(const AssetArchive&);
+
+  MappedFile file_;
+  const uint8_t *data_;
+  size_t size_;
+  uint32_t num_entries_;
+};
+
+// Make the archive in 'filename' visible to LoadFile(), MappedFile, and the
+// sound loaders, which look for files in the mounted archives before the
+// filesystem. Archives mounted later take precedence. Returns false if the
+// archive can't be opened.
+//
+// Mount every archive before loading starts. The lookups are made from the
+// loader threads, without a lock.
+bool MountAssetArchive(const char *filename);
+
+// Unmount all archives. Files found in them are no longer valid.
+void UnmountAssetArchives();
+
+// Find 'name' in the mounted archives.
+bool FindInAssetArchives(const char *name, const uint8_t **data,
+                         size_t *size);
+
+}  // fpl
+
+#endif  // FPL_ASSET_ARCHIVE_H
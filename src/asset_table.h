@@ -0,0 +1,113 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef FPL_ASSET_TABLE_H
+#define FPL_ASSET_TABLE_H
+
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fpl {
+
+// Identifies an asset by its position in an AssetTable, so that it can be
+// found without building or comparing strings.
+typedef uint32_t AssetHandle;
+
+// Returned when a name has never been interned.
+static const AssetHandle kInvalidAssetHandle = static_cast<AssetHandle>(-1);
+
+// Assets of type T, indexed by the AssetHandle of their name. The name is
+// hashed once, when it's interned, and then the asset is an array index
+// away. Handles stay valid for the life of the table, even once the asset
+// has been removed, so they can be resolved once and kept.
+//
+// The table doesn't own the assets.
+template<class T>
+class AssetTable {
+ public:
+  AssetTable() : name_bytes_(0) {}
+
+  // Return the handle for 'name', creating it if need be.
+  AssetHandle Intern(const char *name) {
+    auto it = handles_.find(name);
+    if (it != handles_.end()) return it->second;
+    const AssetHandle handle = static_cast<AssetHandle>(names_.size());
+    handles_[name] = handle;
+    names_.push_back(name);
+    name_bytes_ += names_.back().capacity();
+    assets_.push_back(nullptr);
+    return handle;
+  }
+
+  // Return the handle for 'name', or kInvalidAssetHandle if it has never
+  // been interned.
+  AssetHandle Find(const char *name) const {
+    auto it = handles_.find(name);
+    return it != handles_.end() ? it->second : kInvalidAssetHandle;
+  }
+
+  // Return the asset for 'handle', or nullptr if there is none.
+  T *Get(AssetHandle handle) const {
+    return handle < assets_.size() ? assets_[handle] : nullptr;
+  }
+
+  // Return the asset named 'name', or nullptr if there is none.
+  T *Get(const char *name) const { return Get(Find(name)); }
+
+  // Set the asset for 'handle', which must be valid. Pass nullptr to remove
+  // it.
+  void Set(AssetHandle handle, T *asset) {
+    assert(handle < assets_.size());
+    assets_[handle] = asset;
+  }
+
+  // The name 'handle' was interned with, which must be valid.
+  const std::string &Name(AssetHandle handle) const {
+    assert(handle < names_.size());
+    return names_[handle];
+  }
+
+  // One more than the largest handle. Loop up to this to visit every asset,
+  // skipping the nullptrs.
+  AssetHandle size() const { return static_cast<AssetHandle>(assets_.size()); }
+
+  // Estimated bytes of heap memory used by the table, not counting the
+  // assets. Each name is stored twice, in handles_ and in names_, and each
+  // entry of handles_ is a node of its own.
+  size_t MemorySize() const {
+    return handles_.bucket_count() * sizeof(void *) +
+           handles_.size() * (sizeof(typename HandleMap::value_type) +
+                              sizeof(void *)) +
+           names_.capacity() * sizeof(std::string) +
+           assets_.capacity() * sizeof(T *) + 2 * name_bytes_;
+  }
+
+ private:
+  typedef std::unordered_map<std::string, AssetHandle> HandleMap;
+
+  HandleMap handles_;
+  std::vector<std::string> names_;
+  std::vector<T *> assets_;
+
+  // Sum of the capacities of the names.
+  size_t name_bytes_;
+};
+
+}  // fpl
+
+#endif  // FPL_ASSET_TABLE_H
@@ -14,110 +14,199 @@
 
 #include "precompiled.h"
 #include "async_loader.h"
+#include "startup_trace.h"
 
 namespace fpl {
 
-// Push this to signal the worker thread that it's time to quit.
-class BookendAsyncResource : public AsyncResource {
-  static std::string kBookendFileName;
- public:
-  BookendAsyncResource() : AsyncResource(kBookendFileName) {}
-  virtual ~BookendAsyncResource() {}
-  virtual void Load() {}
-  virtual void Finalize() {}
-  static bool IsBookend(const AsyncResource& res) {
-    return res.filename() == kBookendFileName;
-  }
-};
-
-// static
-std::string BookendAsyncResource::kBookendFileName = "bookend";
+const int AsyncLoader::kDefaultPriority;
+const int AsyncLoader::kHighPriority;
+const int AsyncLoader::kPreviewPriority;
 
-AsyncLoader::AsyncLoader() {
+AsyncLoader::AsyncLoader(JobSystem *jobs)
+    : next_sequence_(0), max_loads_(0), num_loads_(0), stopping_(false),
+      num_queued_(0), num_finalized_(0),
+      unfinalized_head_(nullptr), unfinalized_tail_(nullptr),
+      loaded_(nullptr), jobs_(jobs ? jobs : &SharedJobSystem()) {
   mutex_ = SDL_CreateMutex();
-  job_semaphore_ = SDL_CreateSemaphore(0);
-  assert(mutex_ && job_semaphore_);
+  assert(mutex_);
 }
 
 AsyncLoader::~AsyncLoader() {
   StopLoadingWhenComplete();
-  SDL_WaitThread(worker_thread_, nullptr);
+  jobs_->Wait(&loads_);
 
   if (mutex_) {
     SDL_DestroyMutex(mutex_);
     mutex_ = nullptr;
   }
-  if (job_semaphore_) {
-    SDL_DestroySemaphore(job_semaphore_);
-    job_semaphore_ = nullptr;
+}
+
+void AsyncLoader::QueueJob(AsyncResource *res, int priority) {
+  num_queued_++;
+  res->loader_ = this;
+  res->staged_ = false;
+  SDL_LockMutex(mutex_);
+  Job job = { res, priority, next_sequence_++ };
+  queue_.push_back(job);
+  std::push_heap(queue_.begin(), queue_.end());
+  SubmitLoadJobs();
+  SDL_UnlockMutex(mutex_);
+}
+
+// Submit load jobs until there's one per queued resource, or as many as
+// StartLoading() allows. Call with mutex_ held.
+void AsyncLoader::SubmitLoadJobs() {
+  while (num_loads_ < max_loads_ &&
+         num_loads_ < static_cast<int>(queue_.size())) {
+    num_loads_++;
+    jobs_->Submit("Load", AsyncLoader::LoadJob, this, &loads_,
+                  JobSystem::kBackground);
   }
 }
 
-void AsyncLoader::QueueJob(AsyncResource *res) {
-  Lock([this,res]() {
-    queue_.push_back(res);
-  });
-  SDL_SemPost(job_semaphore_);
+void AsyncLoader::PushLoaded(AsyncResource *res) {
+  AsyncResource *head = loaded_.load(std::memory_order_relaxed);
+  do {
+    res->next_loaded_ = head;
+  } while (!loaded_.compare_exchange_weak(head, res,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed));
 }
 
-void AsyncLoader::LoaderWorker() {
+// Load the most urgent resource on the queue, then the next, until the queue
+// is empty. The JobSystem records each load job in the frame profiler.
+void AsyncLoader::LoadQueued() {
   for (;;) {
-    auto res = LockReturn<AsyncResource *>([this]() {
-      return queue_.empty() ? nullptr : queue_[0];
-    });
-    if (!res) {
-      SDL_SemWait(job_semaphore_);
-      continue;
+    SDL_LockMutex(mutex_);
+    if (queue_.empty()) {
+      num_loads_--;
+      if (stopping_ && num_loads_ == 0) {
+        stopping_ = false;
+        max_loads_ = 0;
+      }
+      SDL_UnlockMutex(mutex_);
+      return;
     }
-    // Stop loading once we reach the bookend enqueued by
-    // StopLoadingWhenComplete(). To start loading again, call StartLoading().
-    if (BookendAsyncResource::IsBookend(*res))
-      break;
+    AsyncResource *res = queue_.front().res;
+    std::pop_heap(queue_.begin(), queue_.end());
+    queue_.pop_back();
+    SDL_UnlockMutex(mutex_);
+
     SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "async load: %s",
                  res->filename_.c_str());
-    res->Load();
-    Lock([this, res]() {
-      queue_.erase(queue_.begin());
-      done_.push_back(res);
-    });
+    {
+      StartupTraceScope trace("load", res->filename_.c_str());
+      res->Load();
+    }
+    PushLoaded(res);
   }
 }
 
-int AsyncLoader::LoaderThread(void *user_data) {
-  reinterpret_cast<AsyncLoader *>(user_data)->LoaderWorker();
-  return 0;
+void AsyncLoader::LoadJob(void *context) {
+  static_cast<AsyncLoader *>(context)->LoadQueued();
 }
 
-void AsyncLoader::StartLoading() {
-  worker_thread_ = SDL_CreateThread(AsyncLoader::LoaderThread,
-                                    "FPL Loader Thread", this);
-  assert(worker_thread_);
+// Copy a staged resource, and hand it back to be finalized.
+void AsyncLoader::CopyJob(void *context) {
+  AsyncResource *res = static_cast<AsyncResource *>(context);
+  {
+    StartupTraceScope trace("copy", res->filename_.c_str());
+    res->Copy();
+  }
+  res->loader_->PushLoaded(res);
+}
+
+void AsyncLoader::StartLoading(int num_threads) {
+  SDL_LockMutex(mutex_);
+  max_loads_ = std::max(num_threads, 1);
+  stopping_ = false;
+  SubmitLoadJobs();
+  SDL_UnlockMutex(mutex_);
 }
 
 void AsyncLoader::StopLoadingWhenComplete() {
-  // When the loader thread hits the bookend, it will exit.
-  static BookendAsyncResource bookend;
-  QueueJob(&bookend);
+  // The last load job to find the queue empty stops loading.
+  SDL_LockMutex(mutex_);
+  if (num_loads_ == 0) {
+    max_loads_ = 0;
+  } else {
+    stopping_ = true;
+  }
+  SDL_UnlockMutex(mutex_);
 }
 
 bool AsyncLoader::TryFinalize() {
-  for (;;) {
-    auto res = LockReturn<AsyncResource *>([this]() {
-      return done_.empty() ? nullptr : done_[0];
-    });
-    if (!res) break;
+  return TryFinalize(0.0, 0);
+}
+
+bool AsyncLoader::TryFinalize(double max_seconds, size_t max_bytes) {
+  // Take every loaded resource at once, and reverse the list so that they
+  // are finalized in the order they loaded, after any left over from the
+  // last call.
+  AsyncResource *newest = loaded_.exchange(nullptr, std::memory_order_acquire);
+  AsyncResource *oldest = nullptr;
+  AsyncResource *tail = newest;
+  while (newest) {
+    AsyncResource *next = newest->next_loaded_;
+    newest->next_loaded_ = oldest;
+    oldest = newest;
+    newest = next;
+  }
+  if (oldest) {
+    if (unfinalized_tail_) {
+      unfinalized_tail_->next_loaded_ = oldest;
+    } else {
+      unfinalized_head_ = oldest;
+    }
+    unfinalized_tail_ = tail;
+  }
+
+  const uint64_t start = SDL_GetPerformanceCounter();
+  const uint64_t max_ticks = static_cast<uint64_t>(
+      max_seconds * static_cast<double>(SDL_GetPerformanceFrequency()));
+  size_t bytes = 0;
+  bool first = true;
+  while (unfinalized_head_) {
+    AsyncResource *res = unfinalized_head_;
+    // Staging is cheap, so it isn't held to the budget. The resource comes
+    // back through loaded_ once its copy is done.
+    if (!res->staged_ && res->Stage()) {
+      res->staged_ = true;
+      unfinalized_head_ = res->next_loaded_;
+      if (!unfinalized_head_) unfinalized_tail_ = nullptr;
+      res->next_loaded_ = nullptr;
+      jobs_->Submit("Copy", AsyncLoader::CopyJob, res, &loads_,
+                    JobSystem::kBackground);
+      continue;
+    }
+    bytes += res->FinalizeSize();
+    if (!first && ((max_bytes && bytes > max_bytes) ||
+                   (max_ticks &&
+                    SDL_GetPerformanceCounter() - start >= max_ticks))) {
+      break;
+    }
+    first = false;
+    unfinalized_head_ = res->next_loaded_;
+    if (!unfinalized_head_) unfinalized_tail_ = nullptr;
+    res->next_loaded_ = nullptr;
     SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "finalize: %s",
                  res->filename_.c_str());
-    res->Finalize();
-    Lock([this]() {
-      done_.erase(done_.begin());
-    });
+    {
+      StartupTraceScope trace("finalize", res->filename_.c_str());
+      res->Finalize();
+    }
+    num_finalized_++;
   }
-  return LockReturn<bool>([this]() {
-    return queue_.empty();
-  });
+
+  const bool done = num_finalized_ == num_queued_;
+  // Start counting progress afresh for the next batch of jobs.
+  if (done) num_queued_ = num_finalized_ = 0;
+  return done;
 }
 
+float AsyncLoader::Progress() const {
+  return num_queued_ ? static_cast<float>(num_finalized_) /
+                       static_cast<float>(num_queued_) : 1.0f;
+}
 
 }  // namespace fpl
-
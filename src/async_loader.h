@@ -15,6 +15,10 @@
 #ifndef FPL_ASYNC_LOADER_H
 #define FPL_ASYNC_LOADER_H
 
+#include <atomic>
+
+#include "job_system.h"
+
 namespace fpl {
 
 class AsyncLoader;
@@ -23,78 +27,164 @@ class AsyncLoader;
 class AsyncResource {
  public:
   AsyncResource(const std::string &filename)
-    : filename_(filename), data_(nullptr) {}
+    : filename_(filename), data_(nullptr), next_loaded_(nullptr),
+      loader_(nullptr), staged_(false) {}
   virtual ~AsyncResource() {}
 
   // Load should perform the actual loading of filename_, and store the
-  // result in data_, or nullptr upon failure. It is called on the loader
-  // thread, so should not access any program state outside of this object.
-  // Since there will be only one loader thread, any libraries called by Load
-  // need not be MT-safe as long as they're not also called by the main thread.
+  // result in data_, or nullptr upon failure. It is called on a JobSystem
+  // worker, so should not access any program state outside of this object.
+  // Several workers may be calling Load on different resources at once, so
+  // any libraries called by Load must be MT-safe.
   virtual void Load() = 0;
 
+  // Optionally claim GPU staging memory for the result of Load(), such as a
+  // mapped buffer. Called on the main thread after Load. Returns true to
+  // have Copy called on a JobSystem worker before Finalize, so that the
+  // copy into the staging memory doesn't hold up the main thread.
+  virtual bool Stage() { return false; }
+
+  // Fill the staging memory that Stage claimed. Like Load, must not access
+  // program state outside of this object.
+  virtual void Copy() {}
+
   // This should implement the behavior of turning data_ into the actual
   // desired resource. Called on the main thread only.
   virtual void Finalize() = 0;
 
+  // Roughly how many bytes Finalize will upload to the GPU, so that
+  // TryFinalize can spread large uploads over several frames. Called on the
+  // main thread, before Finalize.
+  virtual size_t FinalizeSize() const { return 0; }
+
   const std::string &filename() const { return filename_; }
 
  protected:
   std::string filename_;
   uint8_t *data_;
 
+ private:
+  // Links the resources that have loaded but not been finalized.
+  AsyncResource *next_loaded_;
+
+  // The loader the resource was queued on, and whether it has been through
+  // Stage and Copy.
+  AsyncLoader *loader_;
+  bool staged_;
+
   friend class AsyncLoader;
 };
 
 class AsyncLoader {
  public:
-  AsyncLoader();
+  // Jobs with a higher priority are loaded first. Jobs with the same
+  // priority are loaded in the order they were queued.
+  static const int kDefaultPriority = 0;
+  // For resources that are shown as soon as they are loaded, such as the
+  // loading screen and tutorial slides.
+  static const int kHighPriority = 1;
+  // For low resolution stand-ins of kHighPriority resources, which are worth
+  // showing while those load.
+  static const int kPreviewPriority = 2;
+
+  // Loads on the workers of 'jobs', or of SharedJobSystem() if null.
+  explicit AsyncLoader(JobSystem *jobs = nullptr);
   ~AsyncLoader();
 
-  // Call this any number of times before StartLoading.
-  void QueueJob(AsyncResource *res);
+  // Call this any number of times, before or after StartLoading, from the
+  // thread that calls TryFinalize.
+  void QueueJob(AsyncResource *res, int priority = kDefaultPriority);
 
-  // Launches the loading thread.
-  void StartLoading();
+  // Starts loading, on up to 'num_threads' workers at once, at least one.
+  // Loads are background jobs, so they never run on a thread that waits for
+  // other jobs. Once started, call StopLoadingWhenComplete() before starting
+  // again.
+  void StartLoading(int num_threads = 1);
 
-  // Cleans-up the background loading thread once all jobs have been completed.
-  // You can restart with StartLoading() if you like.
+  // Stops loading once all the queued jobs have been loaded. Jobs queued
+  // after that wait for the next StartLoading().
   void StopLoadingWhenComplete();
 
   // Call this once per frame after StartLoading. Will call Finalize on any
   // resources that have finished loading. One it returns true, that means
-  // the queue is empty, all resources have been processed, and the loading
-  // thread has terminated.
+  // the queue is empty, and all resources have been processed. Never waits
+  // for the loader threads.
   bool TryFinalize();
 
+  // Like TryFinalize, but stops once Finalize has taken 'max_seconds', or
+  // the resources finalized so far would upload 'max_bytes'. The rest are
+  // finalized by later calls, oldest first. At least one resource is
+  // finalized per call, so loading always makes progress. A limit of 0
+  // means no limit.
+  bool TryFinalize(double max_seconds, size_t max_bytes);
+
+  // Fraction of the jobs queued since the loader was last idle that have
+  // been finalized, from 0 to 1. For progress bars.
+  float Progress() const;
+
+  // True once every queued job has been finalized, as the last TryFinalize
+  // returned.
+  bool Finished() const { return num_finalized_ == num_queued_; }
+
  private:
-  void Lock(const std::function<void ()> &body) {
-    auto err = SDL_LockMutex(mutex_);
-    (void)err;
-    assert(err == 0);
-    body();
-    SDL_UnlockMutex(mutex_);
-  }
-  template<typename T> T LockReturn(const std::function<T ()> &body) {
-    T ret;
-    Lock([&ret, &body]() { ret = body(); });
-    return ret;
-  }
-
-  void LoaderWorker();
-  static int LoaderThread(void *user_data);
-
-  std::vector<AsyncResource *> queue_, done_;
-
-  // Keep handle to the worker thread around so that we can wait for it to
-  // finish before destroying the class.
-  SDL_Thread *worker_thread_;
-
-  // This lock protects ALL state in this class, i.e. the two vectors.
+  // A queued resource. Ordered so that the job to load next is the largest.
+  struct Job {
+    AsyncResource *res;
+    int priority;
+    unsigned int sequence;  // Counts up from the first job queued.
+
+    bool operator<(const Job &rhs) const {
+      return priority != rhs.priority ? priority < rhs.priority :
+                                        sequence > rhs.sequence;
+    }
+  };
+
+  static void LoadJob(void *context);
+  static void CopyJob(void *context);
+  void LoadQueued();
+  void SubmitLoadJobs();
+  void PushLoaded(AsyncResource *res);
+
+  // Heap of jobs not yet started, with the next to load at the front.
+  // Guarded by mutex_.
+  std::vector<Job> queue_;
+  unsigned int next_sequence_;
+
+  // The most load jobs allowed in the JobSystem at once, as passed to
+  // StartLoading(), or 0 when stopped. Each load job loads resources until
+  // queue_ is empty. Guarded by mutex_.
+  int max_loads_;
+  int num_loads_;
+
+  // Set by StopLoadingWhenComplete(), until the last load job finishes.
+  // Guarded by mutex_.
+  bool stopping_;
+
+  // Jobs queued and finalized since the loader was last idle. Only used by
+  // the thread that queues and finalizes jobs.
+  int num_queued_;
+  int num_finalized_;
+
+  // Resources taken from loaded_ that a budgeted TryFinalize didn't get to,
+  // oldest first. Only used by the finalizing thread.
+  AsyncResource *unfinalized_head_;
+  AsyncResource *unfinalized_tail_;
+
+  // Lock-free stack of resources that have loaded, newest first, linked
+  // through next_loaded_. Any worker can push onto it, and TryFinalize takes
+  // all of it at once, so neither side ever waits for the other.
+  std::atomic<AsyncResource *> loaded_;
+
+  JobSystem *jobs_;
+
+  // Counts the load and copy jobs in the JobSystem, so that we can wait for
+  // them to finish before destroying the class.
+  JobCounter loads_;
+
+  // Protects queue_, next_sequence_ and the load job state. The load jobs
+  // take it to pick their next resource, and the main thread only to queue
+  // one.
   SDL_mutex *mutex_;
-
-  // Kick-off the worker thread when a new job arrives.
-  SDL_semaphore *job_semaphore_;
 };
 
 }  // namespace fpl
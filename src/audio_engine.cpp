@@ -14,6 +14,7 @@
 
 #include "precompiled.h"
 #include <algorithm>
+#include <atomic>
 #include "SDL_mixer.h"
 #include "audio_config_generated.h"
 #include "audio_engine.h"
@@ -39,12 +40,45 @@ static const ChannelId kStreamChannel = -100;
 
 const ChannelId AudioEngine::kInvalidChannel = -1;
 
+static const int kChannelsPerWord = 32;
+static const int kFinishedChannelWords = kMaxChannels / kChannelsPerWord;
+
+// Set by the mixer, on the audio thread, when a channel or the stream stops
+// playing, whether it ran out, faded out or was halted. Consumed by
+// ReapFinishedSounds() on the main thread.
+static std::atomic<uint32_t> finished_channels[kFinishedChannelWords];
+static std::atomic<bool> finished_stream(false);
+
+static void ChannelFinished(int channel) {
+  if (channel >= 0 && channel < kMaxChannels) {
+    finished_channels[channel / kChannelsPerWord].fetch_or(
+        1u << (channel % kChannelsPerWord));
+  }
+}
+
+static void StreamFinished() {
+  finished_stream = true;
+}
+
+// Returns whether the mixer reported the channel finished, and clears it.
+static bool TakeFinished(ChannelId channel_id) {
+  if (channel_id == kStreamChannel) {
+    return finished_stream.exchange(false);
+  }
+  const uint32_t bit = 1u << (channel_id % kChannelsPerWord);
+  return (finished_channels[channel_id / kChannelsPerWord].fetch_and(~bit) &
+          bit) != 0;
+}
+
 AudioEngine::PlayingSound::PlayingSound(
-    SoundCollection* collection, ChannelId cid, WorldTime time)
+    SoundCollection* collection, SoundSource* sound_source, Bus* sound_bus,
+    ChannelId cid, WorldTime time)
     : sound_collection(collection),
+      source(sound_source),
+      bus(sound_bus),
       channel_id(cid),
-      start_time(time) {
-  Bus* bus = sound_collection->bus();
+      start_time(time),
+      channel_gain(-1.0f) {
   if (bus) {
     bus->IncrementSoundCounter();
   }
@@ -52,16 +86,17 @@ AudioEngine::PlayingSound::PlayingSound(
 
 AudioEngine::PlayingSound::PlayingSound(const AudioEngine::PlayingSound& other)
     : sound_collection(other.sound_collection),
+      source(other.source),
+      bus(other.bus),
       channel_id(other.channel_id),
-      start_time(other.start_time) {
-  Bus* bus = sound_collection->bus();
+      start_time(other.start_time),
+      channel_gain(other.channel_gain) {
   if (bus) {
     bus->IncrementSoundCounter();
   }
 }
 
 AudioEngine::PlayingSound::~PlayingSound() {
-  Bus* bus = sound_collection->bus();
   if (bus) {
     bus->DecrementSoundCounter();
   }
@@ -69,27 +104,43 @@ AudioEngine::PlayingSound::~PlayingSound() {
 
 AudioEngine::PlayingSound& AudioEngine::PlayingSound::operator=(
     const AudioEngine::PlayingSound& other) {
-  Bus* bus = sound_collection->bus();
   if (bus) {
     bus->DecrementSoundCounter();
   }
-  Bus* other_bus = other.sound_collection->bus();
-  if (other_bus) {
-    other_bus->IncrementSoundCounter();
+  if (other.bus) {
+    other.bus->IncrementSoundCounter();
   }
   sound_collection = other.sound_collection;
+  source = other.source;
+  bus = other.bus;
   channel_id = other.channel_id;
   start_time = other.start_time;
+  channel_gain = other.channel_gain;
   return *this;
 }
 
+AudioEngine::AudioEngine()
+    : buses_memory_(kMemoryFlatbuffers), gain_bus_count_(0),
+      master_gain_(1.0f), mute_(false), max_virtual_sounds_(0),
+      world_time_(0), loader_started_(false) {}
+
 AudioEngine::~AudioEngine() {
+  // The loader threads may still be decoding samples that are about to be
+  // freed, so let them finish first.
+  if (loader_started_) {
+    loader_.StopLoadingWhenComplete();
+    while (!loader_.TryFinalize()) {
+      SDL_Delay(1);
+    }
+  }
   for (size_t i = 0; i < collections_.size(); ++i) {
     auto& collection = collections_[i];
     if (collection) {
       collection->Unload();
     }
   }
+  Mix_ChannelFinished(nullptr);
+  Mix_HookMusicFinished(nullptr);
   Mix_CloseAudio();
 }
 
@@ -110,50 +161,53 @@ bool AudioEngine::Initialize(const AudioConfig* config) {
   }
 
   // Number of sound that can be played simutaniously.
-  Mix_AllocateChannels(config->mixer_channels());
+  int mixer_channels = static_cast<int>(config->mixer_channels());
+  if (mixer_channels > kMaxChannels) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR,
+                 "Only %d of %d mixer channels can be used\n", kMaxChannels,
+                 mixer_channels);
+    mixer_channels = kMaxChannels;
+  }
+  Mix_AllocateChannels(mixer_channels);
 
   // We do our own tracking of audio channels so that when a new sound is
   // played we can determine if one of the currently playing channels is lower
-  // priority so that we can drop it.
-  playing_sounds_.reserve(config->mixer_channels());
+  // priority so that we can drop it. The mixer tells us when sounds finish,
+  // so that we never have to poll it.
+  playing_sounds_.Reset(mixer_channels);
+  Mix_ChannelFinished(ChannelFinished);
+  Mix_HookMusicFinished(StreamFinished);
+
+  // Sounds that don't get a channel are tracked, so that they can take over
+  // one that frees up before they would have ended.
+  max_virtual_sounds_ = config->virtual_voices();
+  virtual_sounds_.reserve(max_virtual_sounds_);
+
+  sound_cache_.set_budget(config->decoded_memory_budget());
 
   // Load the audio buses.
-  if (!LoadFile("buses.bin", &buses_source_)) {
+  if (!buses_file_.Open("buses.bin")) {
     SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Can't load audio bus file.\n");
     return false;
   }
-  const BusDefList* bus_def_list = GetBusDefList();
-  buses_.reserve(bus_def_list->buses()->Length());
-  for (size_t i = 0; i < bus_def_list->buses()->Length(); ++i) {
-    buses_.push_back(Bus(bus_def_list->buses()->Get(i)));
-  }
-
-  // Set up the children and ducking pointers.
-  for (size_t i = 0; i < buses_.size(); ++i) {
-    Bus& bus = buses_[i];
-    const BusDef* def = bus.bus_def();
-    if (!PopulateBuses("child_buses", def->child_buses(), &bus.child_buses())) {
-      return false;
-    }
-    if (!PopulateBuses("duck_buses", def->duck_buses(), &bus.duck_buses())) {
-      return false;
-    }
-  }
-
-  master_bus_ = FindBus("master");
-  if (!master_bus_) {
-    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "No master bus specified.\n");
+  buses_memory_.Set(buses_file_.size());
+  if (!CompileBuses(GetBusDefList())) {
     return false;
   }
 
   // Load the list of assets.
-  std::string sound_assets_source;
-  if (!LoadFile("sound_assets.bin", &sound_assets_source)) {
+  MappedFile sound_assets_file;
+  if (!sound_assets_file.Open("sound_assets.bin")) {
     return false;
   }
 
+  // Decode samples in the background, so the game can start before they
+  // have all loaded.
+  loader_.StartLoading(static_cast<int>(config->loader_threads()));
+  loader_started_ = true;
+
   // Create a SoundCollection for each SoundCollectionDef
-  const SoundAssets* sound_assets = GetSoundAssets(sound_assets_source.c_str());
+  const SoundAssets* sound_assets = GetSoundAssets(sound_assets_file.data());
   size_t sound_count = sound_assets->sounds()->Length();
   collections_.resize(sound_count);
   bool success = true;
@@ -165,6 +219,8 @@ bool AudioEngine::Initialize(const AudioConfig* config) {
       // out and move on to the next one.
       collections_[i].reset(nullptr);
       success = false;
+    } else if (!collections_[i]->GetSoundCollectionDef()->load_on_demand()) {
+      collections_[i]->QueueSamples(&loader_, AsyncLoader::kDefaultPriority);
     }
   }
 
@@ -174,35 +230,136 @@ bool AudioEngine::Initialize(const AudioConfig* config) {
   return success;
 }
 
-Bus* AudioEngine::FindBus(const char* name) {
-  auto it = std::find_if(buses_.begin(), buses_.end(), [name](const Bus& bus) {
-    return strcmp(bus.bus_def()->name()->c_str(), name) == 0;
-  });
-  if (it != buses_.end()) {
-    return &*it;
-  } else {
-    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "No bus named \"%s\"\n", name);
-    return nullptr;
+// Only used while initializing, since buses refer to each other by index.
+static BusIndex FindBusDef(const BusDefList* bus_def_list, const char* name) {
+  for (size_t i = 0; i < bus_def_list->buses()->Length(); ++i) {
+    if (strcmp(bus_def_list->buses()->Get(i)->name()->c_str(), name) == 0) {
+      return static_cast<BusIndex>(i);
+    }
   }
+  return kInvalidBusIndex;
 }
 
-bool AudioEngine::PopulateBuses(const char* list_name,
-                                const BusNameList* child_name_list,
-                                std::vector<Bus*>* output) {
-  for (size_t i = 0; child_name_list && i < child_name_list->Length(); ++i) {
-    const char* bus_name = child_name_list->Get(i)->c_str();
-    Bus* bus = FindBus(bus_name);
-    if (bus) {
-      output->push_back(bus);
-    } else {
-      SDL_LogError(SDL_LOG_CATEGORY_ERROR,
-                   "Unknown bus \"%s\" listed in %s.\n", bus_name, list_name);
-      return false;
+bool AudioEngine::CompileBuses(const BusDefList* bus_def_list) {
+  const BusIndex def_count =
+      static_cast<BusIndex>(bus_def_list->buses()->Length());
+  const BusIndex master = FindBusDef(bus_def_list, "master");
+  if (master == kInvalidBusIndex) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "No master bus specified.\n");
+    return false;
+  }
+
+  // Order the defs breadth first from the master bus, so that parents come
+  // before their children. 'parents' holds positions in 'order'.
+  std::vector<BusIndex> order(1, master);
+  std::vector<BusIndex> parents(1, kInvalidBusIndex);
+  std::vector<BusIndex> positions(def_count, kInvalidBusIndex);
+  positions[master] = 0;
+  for (size_t i = 0; i < order.size(); ++i) {
+    const BusDef* def = bus_def_list->buses()->Get(order[i]);
+    const BusNameList* children = def->child_buses();
+    for (size_t j = 0; children && j < children->Length(); ++j) {
+      const char* child_name = children->Get(j)->c_str();
+      const BusIndex child = FindBusDef(bus_def_list, child_name);
+      if (child == kInvalidBusIndex) {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR,
+                     "Unknown bus \"%s\" listed in child_buses.\n",
+                     child_name);
+        return false;
+      }
+      if (positions[child] != kInvalidBusIndex) {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR,
+                     "Bus \"%s\" has more than one parent.\n", child_name);
+        return false;
+      }
+      positions[child] = static_cast<BusIndex>(order.size());
+      order.push_back(child);
+      parents.push_back(static_cast<BusIndex>(i));
+    }
+  }
+
+  // Buses that aren't under the master bus are never heard. Keep them at the
+  // end, so sounds can still refer to them.
+  gain_bus_count_ = order.size();
+  for (BusIndex i = 0; i < def_count; ++i) {
+    if (positions[i] == kInvalidBusIndex) {
+      positions[i] = static_cast<BusIndex>(order.size());
+      order.push_back(i);
+      parents.push_back(kInvalidBusIndex);
+    }
+  }
+
+  buses_.clear();
+  buses_.reserve(order.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    buses_.push_back(Bus(bus_def_list->buses()->Get(order[i])));
+    Bus& bus = buses_.back();
+    bus.set_parent(parents[i]);
+    const BusNameList* ducked = bus.bus_def()->duck_buses();
+    for (size_t j = 0; ducked && j < ducked->Length(); ++j) {
+      const char* ducked_name = ducked->Get(j)->c_str();
+      const BusIndex ducked_def = FindBusDef(bus_def_list, ducked_name);
+      if (ducked_def == kInvalidBusIndex) {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR,
+                     "Unknown bus \"%s\" listed in duck_buses.\n",
+                     ducked_name);
+        return false;
+      }
+      bus.duck_buses().push_back(positions[ducked_def]);
     }
   }
   return true;
 }
 
+BusIndex AudioEngine::FindBusIndex(const char* name) const {
+  for (size_t i = 0; i < buses_.size(); ++i) {
+    if (strcmp(buses_[i].bus_def()->name()->c_str(), name) == 0) {
+      return static_cast<BusIndex>(i);
+    }
+  }
+  SDL_LogError(SDL_LOG_CATEGORY_ERROR, "No bus named \"%s\"\n", name);
+  return kInvalidBusIndex;
+}
+
+Bus* AudioEngine::FindBus(const char* name) {
+  const BusIndex index = FindBusIndex(name);
+  return index == kInvalidBusIndex ? nullptr : &buses_[index];
+}
+
+Bus* AudioEngine::CollectionBus(const SoundCollection& collection) {
+  const BusIndex index = collection.bus_index();
+  return index == kInvalidBusIndex ? nullptr : &buses_[index];
+}
+
+void AudioEngine::LoadSound(SoundId sound_id) {
+  SoundCollection* collection = GetSoundCollection(sound_id);
+  if (collection) {
+    collection->QueueSamples(&loader_, AsyncLoader::kDefaultPriority);
+  }
+}
+
+void AudioEngine::LoadAllSounds() {
+  for (size_t i = 0; i < collections_.size(); ++i) {
+    if (collections_[i]) {
+      collections_[i]->QueueSamples(&loader_, AsyncLoader::kDefaultPriority);
+    }
+  }
+}
+
+bool AudioEngine::Ready(SoundId sound_id) const {
+  // Sounds that will never load have nothing to wait for.
+  if (sound_id < 0 || sound_id >= static_cast<SoundId>(collections_.size()) ||
+      !collections_[sound_id]) {
+    return true;
+  }
+  const SoundCollection& collection = *collections_[sound_id];
+  return collection.samples_requested() && collection.Ready();
+}
+
+bool AudioEngine::FinalizeLoadedSounds() {
+  return !loader_started_ || loader_.TryFinalize();
+}
+
 SoundCollection* AudioEngine::GetSoundCollection(SoundId sound_id) {
   if (sound_id >= static_cast<SoundId>(collections_.size())) {
     SDL_LogError(SDL_LOG_CATEGORY_ERROR,
@@ -212,96 +369,251 @@ SoundCollection* AudioEngine::GetSoundCollection(SoundId sound_id) {
   return collections_[sound_id].get();
 }
 
-static int AllocatedChannelCount() {
-  // Passing negative values returns the number of allocated channels.
-  return Mix_AllocateChannels(-1);
+// Since there can only be one stream playing, and that stream is independent
+// of the buffer channels, always make it highest priority.
+static bool HigherPriorityDef(const SoundCollectionDef* a,
+                              const SoundCollectionDef* b) {
+  if (a->stream() != b->stream()) {
+    return a->stream() != 0;
+  }
+  return a->priority() > b->priority();
+}
+
+// In the case of two sounds with the same priority, the newer one is higher
+// priority.
+static bool HigherPriorityStart(const SoundCollection* a, WorldTime a_start,
+                                const SoundCollection* b, WorldTime b_start) {
+  const SoundCollectionDef* a_def = a->GetSoundCollectionDef();
+  const SoundCollectionDef* b_def = b->GetSoundCollectionDef();
+  if (HigherPriorityDef(a_def, b_def)) {
+    return true;
+  }
+  if (HigherPriorityDef(b_def, a_def)) {
+    return false;
+  }
+  return a_start > b_start;
 }
 
-static int PlayingChannelCount() {
-  // Passing negative values returns the number of playing channels.
-  return Mix_Playing(-1);
+bool AudioEngine::HigherPriority(const AudioEngine::PlayingSound& a,
+                                 const AudioEngine::PlayingSound& b) {
+  return HigherPriorityStart(a.sound_collection, a.start_time,
+                             b.sound_collection, b.start_time);
 }
 
-static ChannelId FindFreeChannel(bool stream) {
-  if (stream) {
-    return kStreamChannel;
+void AudioEngine::PlayingSoundQueue::Reset(int num_channels) {
+  sounds_.clear();
+  sounds_.reserve(num_channels + 1);
+  positions_.assign(num_channels + 1, -1);
+  // Hand out the low channels first.
+  free_channels_.clear();
+  for (int i = num_channels - 1; i >= 0; --i) {
+    free_channels_.push_back(i);
   }
-  const int allocated_channels = AllocatedChannelCount();
-  if (PlayingChannelCount() < allocated_channels) {
-    for (int i = 0; i < allocated_channels; ++i) {
-      if (!Mix_Playing(i)) {
-        return i;
-      }
+}
+
+size_t AudioEngine::PlayingSoundQueue::Slot(ChannelId channel_id) const {
+  return channel_id == kStreamChannel ? positions_.size() - 1 :
+                                        static_cast<size_t>(channel_id);
+}
+
+void AudioEngine::PlayingSoundQueue::Push(const PlayingSound& playing_sound) {
+  const ChannelId channel_id = playing_sound.channel_id;
+  assert(positions_[Slot(channel_id)] < 0);
+  if (channel_id != kStreamChannel) {
+    // The channel is almost always the one FreeChannel() returned.
+    if (free_channels_.back() == channel_id) {
+      free_channels_.pop_back();
+    } else {
+      free_channels_.erase(std::find(free_channels_.begin(),
+                                     free_channels_.end(), channel_id));
     }
   }
-  return AudioEngine::kInvalidChannel;
+  positions_[Slot(channel_id)] = static_cast<int>(sounds_.size());
+  sounds_.push_back(playing_sound);
+  SiftUp(sounds_.size() - 1);
 }
 
-static int SoundCollectionDefComparitor(const SoundCollectionDef* a,
-                                        const SoundCollectionDef* b) {
-  // Since there can only be one stream playing, and that stream is independent
-  // of the buffer channels, always make it highest priority.
-  if (a->stream() || b->stream()) {
-    return b->stream() - a->stream();
-  } else {
-    return (b->priority()- a->priority()) < 0 ? -1 : 1;
+void AudioEngine::PlayingSoundQueue::Remove(ChannelId channel_id) {
+  const size_t slot = Slot(channel_id);
+  if (slot >= positions_.size() || positions_[slot] < 0) {
+    return;
+  }
+  const size_t index = static_cast<size_t>(positions_[slot]);
+  const size_t last = sounds_.size() - 1;
+  SwapEntries(index, last);
+  positions_[slot] = -1;
+  sounds_.pop_back();
+  if (channel_id != kStreamChannel) {
+    free_channels_.push_back(channel_id);
   }
+  // The sound moved into the hole may belong above or below it.
+  if (index < sounds_.size()) {
+    SiftUp(index);
+    SiftDown(index);
+  }
+}
+
+// Swap the members directly; copying PlayingSounds would churn the bus
+// sound counters.
+void AudioEngine::PlayingSoundQueue::SwapEntries(size_t a, size_t b) {
+  if (a == b) {
+    return;
+  }
+  PlayingSound& sound_a = sounds_[a];
+  PlayingSound& sound_b = sounds_[b];
+  std::swap(sound_a.sound_collection, sound_b.sound_collection);
+  std::swap(sound_a.source, sound_b.source);
+  std::swap(sound_a.bus, sound_b.bus);
+  std::swap(sound_a.channel_id, sound_b.channel_id);
+  std::swap(sound_a.start_time, sound_b.start_time);
+  std::swap(sound_a.channel_gain, sound_b.channel_gain);
+  positions_[Slot(sound_a.channel_id)] = static_cast<int>(a);
+  positions_[Slot(sound_b.channel_id)] = static_cast<int>(b);
 }
 
-// Sort by priority. In the case of two sounds with the same priority, sort
-// the newer one as being higher priority. Higher priority elements have lower
-// indicies.
-int AudioEngine::PriorityComparitor(
-    const AudioEngine::PlayingSound& a, const AudioEngine::PlayingSound& b) {
-  int result = SoundCollectionDefComparitor(
-      a.sound_collection->GetSoundCollectionDef(),
-      b.sound_collection->GetSoundCollectionDef());
-  if (result == 0) {
-    return b.start_time - a.start_time;
+// Parents are never higher priority than their children.
+void AudioEngine::PlayingSoundQueue::SiftUp(size_t index) {
+  while (index > 0) {
+    const size_t parent = (index - 1) / 2;
+    if (!HigherPriority(sounds_[parent], sounds_[index])) {
+      break;
+    }
+    SwapEntries(parent, index);
+    index = parent;
   }
-  return result;
 }
 
-// Sort channels with highest priority first.
-void AudioEngine::PrioritizeChannels(
-    std::vector<PlayingSound>* playing_sounds) {
-  std::sort(playing_sounds->begin(), playing_sounds->end(), PriorityComparitor);
+void AudioEngine::PlayingSoundQueue::SiftDown(size_t index) {
+  for (;;) {
+    const size_t left = 2 * index + 1;
+    if (left >= sounds_.size()) {
+      break;
+    }
+    const size_t right = left + 1;
+    const size_t lower = right < sounds_.size() &&
+                         HigherPriority(sounds_[left], sounds_[right]) ?
+                         right : left;
+    if (!HigherPriority(sounds_[index], sounds_[lower])) {
+      break;
+    }
+    SwapEntries(index, lower);
+    index = lower;
+  }
+}
+
+void AudioEngine::ReapFinishedSounds() {
+  if (finished_stream.exchange(false)) {
+    playing_sounds_.Remove(kStreamChannel);
+  }
+  for (int word = 0; word < kFinishedChannelWords; ++word) {
+    uint32_t bits = finished_channels[word].exchange(0);
+    for (int bit = 0; bits != 0; ++bit, bits >>= 1) {
+      if (bits & 1) {
+        playing_sounds_.Remove(word * kChannelsPerWord + bit);
+      }
+    }
+  }
 }
 
-// Remove all sounds that are no longer playing.
-void AudioEngine::EraseFinishedSounds() {
-  playing_sounds_.erase(std::remove_if(
-      playing_sounds_.begin(), playing_sounds_.end(),
-      [](const AudioEngine::PlayingSound& playing_sound) {
-        return !AudioEngine::Playing(playing_sound.channel_id);
-      }),
-      playing_sounds_.end());
+void AudioEngine::Virtualize(SoundCollection* collection,
+                             SoundSource* source, WorldTime start_time) {
+  // Looping sounds are left out: they are stopped by whoever started them,
+  // through the channel that PlaySound() returned, which a virtual sound
+  // doesn't have.
+  const SoundCollectionDef* def = collection->GetSoundCollectionDef();
+  const WorldTime duration = source->Duration();
+  if (max_virtual_sounds_ == 0 || def->loop() || def->stream() ||
+      duration <= 0 || start_time + duration <= world_time_) {
+    return;
+  }
+  VirtualSound virtual_sound = { collection, source, start_time,
+                                 start_time + duration };
+  if (virtual_sounds_.size() < max_virtual_sounds_) {
+    virtual_sounds_.push_back(virtual_sound);
+    return;
+  }
+  // Replace the lowest priority virtual sound, if this one beats it.
+  size_t lowest = 0;
+  for (size_t i = 1; i < virtual_sounds_.size(); ++i) {
+    const VirtualSound& sound = virtual_sounds_[i];
+    if (HigherPriorityStart(virtual_sounds_[lowest].sound_collection,
+                            virtual_sounds_[lowest].start_time,
+                            sound.sound_collection, sound.start_time)) {
+      lowest = i;
+    }
+  }
+  if (HigherPriorityStart(collection, start_time,
+                          virtual_sounds_[lowest].sound_collection,
+                          virtual_sounds_[lowest].start_time)) {
+    virtual_sounds_[lowest] = virtual_sound;
+  }
 }
 
-// Remove all streams.
-void AudioEngine::EraseStreams() {
-  playing_sounds_.erase(std::remove_if(
-      playing_sounds_.begin(), playing_sounds_.end(),
-      [](const AudioEngine::PlayingSound& playing_sound) {
-        return playing_sound.channel_id == kStreamChannel;
-      }),
-      playing_sounds_.end());
+void AudioEngine::ResumeVirtualSounds() {
+  // Forget the sounds that would have ended by now.
+  const WorldTime now = world_time_;
+  virtual_sounds_.erase(std::remove_if(
+      virtual_sounds_.begin(), virtual_sounds_.end(),
+      [now](const VirtualSound& sound) { return sound.end_time <= now; }),
+      virtual_sounds_.end());
+
+  while (!virtual_sounds_.empty()) {
+    const ChannelId channel_id = playing_sounds_.FreeChannel();
+    if (channel_id == kInvalidChannel) {
+      break;
+    }
+    size_t highest = 0;
+    for (size_t i = 1; i < virtual_sounds_.size(); ++i) {
+      const VirtualSound& sound = virtual_sounds_[i];
+      if (HigherPriorityStart(sound.sound_collection, sound.start_time,
+                              virtual_sounds_[highest].sound_collection,
+                              virtual_sounds_[highest].start_time)) {
+        highest = i;
+      }
+    }
+    const VirtualSound sound = virtual_sounds_[highest];
+    virtual_sounds_[highest] = virtual_sounds_.back();
+    virtual_sounds_.pop_back();
+
+    // Keep the original start time, so the sound ages as if it had played
+    // all along.
+    ReleaseChannel(channel_id);
+    if (PlaySource(sound.source, channel_id, *sound.sound_collection,
+                   now - sound.start_time)) {
+      playing_sounds_.Push(PlayingSound(
+          sound.sound_collection, sound.source,
+          CollectionBus(*sound.sound_collection), channel_id,
+          sound.start_time));
+    }
+  }
+}
+
+void AudioEngine::ReleaseChannel(ChannelId channel_id) {
+  // The channel isn't playing, so any finish the mixer reported belongs to
+  // the sound that played on it before, and must not remove the new one.
+  TakeFinished(channel_id);
+  playing_sounds_.Remove(channel_id);
 }
 
 bool AudioEngine::PlaySource(SoundSource* const source, ChannelId channel_id,
-                             const SoundCollection& collection) {
+                             const SoundCollection& collection,
+                             WorldTime offset) {
   const SoundCollectionDef& def = *collection.GetSoundCollectionDef();
+  if (!source->loaded()) {
+    return false;
+  }
   const float gain =
     source->audio_sample_set_entry().audio_sample()->gain() * def.gain();
   source->SetGain(channel_id, gain);
-  if (source->Play(channel_id, def.loop() != 0)) {
+  if (offset > 0 ? source->Resume(channel_id, offset) :
+                   source->Play(channel_id, def.loop() != 0)) {
     return true;
   }
   return false;
 }
 
 const BusDefList* AudioEngine::GetBusDefList() const {
-  return fpl::GetBusDefList(buses_source_.c_str());
+  return fpl::GetBusDefList(buses_file_.data());
 }
 
 void AudioEngine::Halt(ChannelId channel_id) {
@@ -338,47 +650,58 @@ ChannelId AudioEngine::PlaySound(SoundId sound_id) {
     return kInvalidChannel;
   }
 
+  // Drop the request until the samples have loaded. If nothing asked for
+  // them yet, they jump the queue.
+  if (!collection->Ready()) {
+    collection->QueueSamples(&loader_, AsyncLoader::kHighPriority);
+    return kInvalidChannel;
+  }
+
   // Prune sounds that have finished playing.
-  EraseFinishedSounds();
+  ReapFinishedSounds();
 
+  SoundSource* source = collection->Select(&rng_);
   bool stream = collection->GetSoundCollectionDef()->stream() != 0;
-  ChannelId new_channel = FindFreeChannel(stream);
+  ChannelId new_channel =
+      stream ? kStreamChannel : playing_sounds_.FreeChannel();
 
   // If there are no empty channels, clear out the one with the lowest
   // priority.
   if (new_channel == kInvalidChannel) {
-    PrioritizeChannels(&playing_sounds_);
     // If the lowest priority sound is lower than the new one, halt it and
     // remove it from our list. Otherwise, do nothing.
     const SoundCollectionDef* new_def = collection->GetSoundCollectionDef();
-    const SoundCollectionDef* back_def =
-        playing_sounds_.back().sound_collection->GetSoundCollectionDef();
-    if (SoundCollectionDefComparitor(new_def, back_def) < 0) {
-      // Use the channel of the sound we're replacing.
-      new_channel = playing_sounds_.back().channel_id;
-      // Dispose of the lowest priority sound.
-      Halt(new_channel);
-      playing_sounds_.pop_back();
-    } else {
-      // The sound was lower priority than all currently playing sounds; do
-      // nothing.
+    if (playing_sounds_.empty() ||
+        !HigherPriorityDef(new_def, playing_sounds_.Lowest().sound_collection
+                                        ->GetSoundCollectionDef())) {
+      // The sound was lower priority than all currently playing sounds, so
+      // it can only play if a channel frees up.
+      Virtualize(collection, source, world_time_);
       return kInvalidChannel;
     }
+    // Use the channel of the sound we're replacing.
+    const PlayingSound& lowest = playing_sounds_.Lowest();
+    new_channel = lowest.channel_id;
+    // Dispose of the lowest priority sound, and resume it later if it's
+    // worth it.
+    Virtualize(lowest.sound_collection, lowest.source, lowest.start_time);
+    Halt(new_channel);
   } else if (new_channel == kStreamChannel) {
     // Halt the sound the may currently be playing on this channel.
     if (Playing(new_channel)) {
       Halt(new_channel);
-      EraseStreams();
     }
   }
 
   // At this point we should not have an invalid channel.
   assert(new_channel != kInvalidChannel);
+  ReleaseChannel(new_channel);
 
   // Attempt to play the sound.
-  if (PlaySource(collection->Select(), new_channel, *collection)) {
-    playing_sounds_.push_back(
-        PlayingSound(collection, new_channel, world_time_));
+  if (PlaySource(source, new_channel, *collection, 0)) {
+    playing_sounds_.Push(
+        PlayingSound(collection, source, CollectionBus(*collection),
+                     new_channel, world_time_));
   }
 
   return new_channel;
@@ -417,19 +740,50 @@ void AudioEngine::Pause(bool pause) {
 void AudioEngine::AdvanceFrame(WorldTime world_time) {
   WorldTime delta_time = world_time - world_time_;
   world_time_ = world_time;
+  // Release the bus counters of finished sounds, so they stop ducking, and
+  // give their channels to the sounds that are waiting for one.
+  ReapFinishedSounds();
+  ResumeVirtualSounds();
+  // Duck gains only need recomputing while some bus is fading to or from
+  // its duck gain.
+  bool ducking_changed = false;
   for (size_t i = 0; i < buses_.size(); ++i) {
-    buses_[i].ResetDuckGain();
+    if (buses_[i].UpdateDuckTransition(delta_time)) {
+      ducking_changed = true;
+    }
   }
-  for (size_t i = 0; i < buses_.size(); ++i) {
-    buses_[i].UpdateDuckGain(delta_time);
+  if (ducking_changed) {
+    for (size_t i = 0; i < buses_.size(); ++i) {
+      buses_[i].ResetDuckGain();
+    }
+    for (size_t i = 0; i < buses_.size(); ++i) {
+      const Bus& bus = buses_[i];
+      const std::vector<BusIndex>& ducked = bus.duck_buses();
+      if (!ducked.empty()) {
+        const float duck_gain = bus.DuckGain();
+        for (size_t j = 0; j < ducked.size(); ++j) {
+          buses_[ducked[j]].Duck(duck_gain);
+        }
+      }
+    }
   }
-  if (master_bus_) {
-    master_bus_->UpdateGain(mute_ ? 0.0f : master_gain_);
+  // Parents come before their children, so one pass in order updates every
+  // gain. The master bus is first.
+  for (size_t i = 0; i < gain_bus_count_; ++i) {
+    Bus& bus = buses_[i];
+    bus.UpdateGain(bus.parent() == kInvalidBusIndex ?
+                   (mute_ ? 0.0f : master_gain_) :
+                   buses_[bus.parent()].gain());
   }
+  // Setting the volume takes the mixer's lock, so only do it for channels
+  // whose gain changed.
   for (size_t i = 0; i < playing_sounds_.size(); ++i) {
     PlayingSound& playing_sound = playing_sounds_[i];
-    SetChannelGain(playing_sound.channel_id,
-                   playing_sound.sound_collection->bus()->gain());
+    const float gain = playing_sound.bus->gain();
+    if (gain != playing_sound.channel_gain) {
+      SetChannelGain(playing_sound.channel_id, gain);
+      playing_sound.channel_gain = gain;
+    }
   }
 }
 
@@ -17,8 +17,11 @@
 
 #include "precompiled.h"
 #include <vector>
+#include "async_loader.h"
 #include "bus.h"
 #include "common.h"
+#include "mapped_file.h"
+#include "memory_tracker.h"
 #include "sound.h"
 #include "sound_collection.h"
 #include "sound_collection_def_generated.h"
@@ -42,14 +45,34 @@ class AudioEngine {
 
   static const ChannelId kInvalidChannel;
 
+  AudioEngine();
   ~AudioEngine();
 
+  // Opens the mixer and loads the sound collection defs. Their samples are
+  // decoded in the background, except for the ones marked load_on_demand,
+  // which wait for LoadSound(), LoadAllSounds() or PlaySound().
   bool Initialize(const AudioConfig* config);
 
   // Play a sound associated with the given sound_id.
-  // Returns the channel the sound is played on.
+  // Returns the channel the sound is played on. Sounds that haven't loaded
+  // yet aren't played, but are queued to load ahead of everything else.
   ChannelId PlaySound(SoundId sound_id);
 
+  // Queue the samples of the given sound_id to load, if they haven't been.
+  void LoadSound(SoundId sound_id);
+
+  // Queue every sound that hasn't been queued to load yet.
+  void LoadAllSounds();
+
+  // True once the given sound_id has loaded, or failed to, so that waiting
+  // for it is over. Always false for load_on_demand sounds that haven't been
+  // requested.
+  bool Ready(SoundId sound_id) const;
+
+  // Make the sounds that have been decoded playable. Call once per frame.
+  // Returns true once nothing is loading.
+  bool FinalizeLoadedSounds();
+
   // Immediately halts a sound.
   static void Halt(ChannelId channel_id);
 
@@ -77,63 +100,149 @@ class AudioEngine {
   void AdvanceFrame(WorldTime world_time);
 
   // Find a bus by the given name. Returns a nullptr if no bus by that name
-  // exists.
+  // exists. Buses are only looked up by name while initializing.
   Bus* FindBus(const char* name);
 
+  // Find the index of the bus with the given name, or kInvalidBusIndex if no
+  // bus by that name exists.
+  BusIndex FindBusIndex(const char* name) const;
+
+  // The decoded samples of sound collections that are kept Compressed.
+  SoundCache* sound_cache() { return &sound_cache_; }
+
  private:
 #ifdef FPL_AUDIO_ENGINE_UNIT_TESTS
+  friend class AudioEngineTests;
   FRIEND_TEST(AudioEngineTests, SamePriorityDifferentStartTimes);
   FRIEND_TEST(AudioEngineTests, IncreasingPriority);
+  FRIEND_TEST(AudioEngineTests, RemoveFromMiddle);
 #endif  // FPL_AUDIO_ENGINE_UNIT_TESTS
 
   // Represents a sample that is playing on a channel.
   struct PlayingSound {
-    PlayingSound(SoundCollection* collection, ChannelId cid, WorldTime time);
+    PlayingSound(SoundCollection* collection, SoundSource* sound_source,
+                 Bus* sound_bus, ChannelId cid, WorldTime time);
     PlayingSound(const PlayingSound& other);
     PlayingSound& operator=(const PlayingSound& other);
     ~PlayingSound();
 
     SoundCollection* sound_collection;
+    SoundSource* source;
+    Bus* bus;
     ChannelId channel_id;
     WorldTime start_time;
+
+    // The gain last given to the channel, or negative if it hasn't been set
+    // since the sound started.
+    float channel_gain;
+  };
+
+  // The playing sounds, in a binary heap with the lowest priority sound at
+  // the top, so that the sound to steal a channel from is found in constant
+  // time and playing and removing sounds take O(log n). Also tracks which
+  // channels are free.
+  class PlayingSoundQueue {
+   public:
+    // Forget all sounds and make channels [0, num_channels) free.
+    void Reset(int num_channels);
+
+    // Add a sound playing on its channel, which must be free.
+    void Push(const PlayingSound& playing_sound);
+
+    // Remove the sound playing on the given channel, if there is one.
+    void Remove(ChannelId channel_id);
+
+    // The sound that should lose its channel first. Only valid when not
+    // empty().
+    const PlayingSound& Lowest() const { return sounds_.front(); }
+
+    // Returns a channel with no sound on it, or kInvalidChannel.
+    ChannelId FreeChannel() const {
+      return free_channels_.empty() ? kInvalidChannel : free_channels_.back();
+    }
+
+    bool empty() const { return sounds_.empty(); }
+    size_t size() const { return sounds_.size(); }
+
+    // The sounds, in heap order. Changing their priority or channel isn't
+    // allowed.
+    const PlayingSound& operator[](size_t i) const { return sounds_[i]; }
+    PlayingSound& operator[](size_t i) { return sounds_[i]; }
+
+   private:
+    // Index into positions_ of the given channel. The stream has the last
+    // slot.
+    size_t Slot(ChannelId channel_id) const;
+    void SwapEntries(size_t a, size_t b);
+    void SiftUp(size_t index);
+    void SiftDown(size_t index);
+
+    std::vector<PlayingSound> sounds_;
+
+    // For each channel, its sound's index into sounds_, or -1 if it's free.
+    std::vector<int> positions_;
+
+    // Channels with no sound on them.
+    std::vector<ChannelId> free_channels_;
   };
 
+  // A sound that lost its channel, or never got one, but would still be
+  // playing. It's started part way through when a channel frees up.
+  struct VirtualSound {
+    SoundCollection* sound_collection;
+    SoundSource* source;
+    WorldTime start_time;
+    WorldTime end_time;
+  };
+
+  // True if 'a' should keep its channel in preference to 'b'.
+  static bool HigherPriority(const PlayingSound& a, const PlayingSound& b);
+
+  // Keep tracking a sound that can't play on a real channel, if it's worth
+  // resuming.
+  void Virtualize(SoundCollection* collection, SoundSource* source,
+                  WorldTime start_time);
+
+  // Start the highest priority virtual sounds on any free channels.
+  void ResumeVirtualSounds();
+
   // Get the bus definitions.
   const BusDefList* GetBusDefList() const;
 
-  // Populate a Bus's child or duck buses.
+  // Fill buses_ from the defs, with parents before their children, and
+  // resolve the names they refer to each other by into indices.
   typedef flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>>
       BusNameList;
-  bool PopulateBuses(const char* list_name, const BusNameList* child_name_list,
-                     std::vector<Bus*>* output);
+  bool CompileBuses(const BusDefList* bus_def_list);
+
+  // The bus a collection plays on, or nullptr if it has none.
+  Bus* CollectionBus(const SoundCollection& collection);
 
   // Set the volume of a channel.
   static void SetChannelGain(ChannelId channel_id, float volume);
 
-  // Remove all sounds that are no longer playing.
-  void EraseFinishedSounds();
-
-  // Remove all streams.
-  void EraseStreams();
+  // Remove the sounds that the mixer reported finished since the last call.
+  void ReapFinishedSounds();
 
-  // Compares the priority of two PlayingSounds.
-  static int PriorityComparitor(const PlayingSound& a, const PlayingSound& b);
+  // Forget whatever played on a channel that is about to be reused.
+  void ReleaseChannel(ChannelId channel_id);
 
-  // Sort all playing sounds based on the PriorityComparitor.
-  static void PrioritizeChannels(std::vector<PlayingSound>* playing_sounds);
-
-  // Play a source selected from a collection on the specified channel.
+  // Play a source selected from a collection on the specified channel,
+  // starting 'offset' milliseconds in.
   static bool PlaySource(SoundSource* const source, ChannelId channel_id,
-                         const SoundCollection& collection);
+                         const SoundCollection& collection, WorldTime offset);
 
   // Hold the audio bus list.
-  std::string buses_source_;
+  MappedFile buses_file_;
+  TrackedMemory buses_memory_;
 
-  // The state of the buses.
+  // The state of the buses, with parents before their children, starting
+  // with the master bus.
   std::vector<Bus> buses_;
 
-  // The master bus, cached to prevent needless lookups.
-  Bus* master_bus_;
+  // The number of buses that are under the master bus, and come first in
+  // buses_. The others are never heard, so their gains aren't updated.
+  size_t gain_bus_count_;
 
   // The gain applied to all buses.
   float master_gain_;
@@ -141,13 +250,29 @@ class AudioEngine {
   // If true, the master gain is ignored and all channels have a gain of 0.
   bool mute_;
 
+  // Holds the decoded samples of Compressed sounds. Declared before
+  // collections_, so that it outlives them.
+  SoundCache sound_cache_;
+
   // Hold the sounds.
   SoundCollections collections_;
 
-  // A list of the currently playing sounds.
-  std::vector<PlayingSound> playing_sounds_;
+  // The currently playing sounds.
+  PlayingSoundQueue playing_sounds_;
+
+  // Chooses between the variations of a sound.
+  Rng rng_;
+
+  // Sounds that would be playing if there were more channels, and the most
+  // there can be.
+  std::vector<VirtualSound> virtual_sounds_;
+  size_t max_virtual_sounds_;
 
   WorldTime world_time_;
+
+  // Decodes the samples of collections_ on its own threads.
+  AsyncLoader loader_;
+  bool loader_started_;
 };
 
 }  // namespace fpl
@@ -21,11 +21,17 @@ namespace fpl {
 
 Bus::Bus(const BusDef* bus_def)
     : bus_def_(bus_def),
+      parent_(kInvalidBusIndex),
       duck_gain_(1.0f),
+      gain_(0.0f),
+      // Negative, so that the first UpdateGain() always computes gain_.
+      applied_parent_gain_(-1.0f),
+      applied_duck_gain_(-1.0f),
       sound_count_(0),
       transition_percentage_(0.0f) {}
 
-void Bus::UpdateDuckGain(WorldTime delta_time) {
+bool Bus::UpdateDuckTransition(WorldTime delta_time) {
+  const float previous_percentage = transition_percentage_;
   if (sound_count_ > 0 && transition_percentage_ <= 1.0f) {
     // Fading to duck gain.
     float fade_in_time = bus_def_->duck_fade_in_time();
@@ -49,21 +55,19 @@ void Bus::UpdateDuckGain(WorldTime delta_time) {
       transition_percentage_ = 0.0f;
     }
   }
-  float duck_gain = mathfu::Lerp(1.0f, bus_def_->duck_gain(),
-                                 transition_percentage_);
-  for (size_t i = 0; i < duck_buses_.size(); ++i) {
-    Bus* bus = duck_buses_[i];
-    bus->duck_gain_ = std::min(duck_gain, bus->duck_gain_);
-  }
+  return !duck_buses_.empty() &&
+         transition_percentage_ != previous_percentage;
+}
+
+float Bus::DuckGain() const {
+  return mathfu::Lerp(1.0f, bus_def_->duck_gain(), transition_percentage_);
 }
 
 void Bus::UpdateGain(float parent_gain) {
-  gain_ = bus_def_->gain() * parent_gain * duck_gain_;
-  for (size_t i = 0; i < child_buses_.size(); ++i) {
-    Bus* child_bus = child_buses_[i];
-    if (child_bus) {
-      child_bus->UpdateGain(gain_);
-    }
+  if (parent_gain != applied_parent_gain_ || duck_gain_ != applied_duck_gain_) {
+    gain_ = bus_def_->gain() * parent_gain * duck_gain_;
+    applied_parent_gain_ = parent_gain;
+    applied_duck_gain_ = duck_gain_;
   }
 }
 
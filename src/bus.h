@@ -16,6 +16,7 @@
 #define FPL_BUSES_H_
 
 #include "precompiled.h"
+#include <algorithm>
 #include <vector>
 #include "common.h"
 
@@ -23,6 +24,13 @@ namespace fpl {
 
 struct BusDef;
 
+// Index of a bus in the AudioEngine's bus array.
+typedef int BusIndex;
+static const BusIndex kInvalidBusIndex = -1;
+
+// The AudioEngine holds its buses in an array where parents come before
+// their children, so that all gains can be updated in one pass, in order.
+// Buses refer to each other by their index in that array.
 class Bus {
  public:
   Bus(const BusDef* bus_def);
@@ -34,16 +42,22 @@ class Bus {
   // duck gain, bus gain).
   float gain() const { return gain_; }
 
-  // Resets the duck gain to 1.0f. Duck gain must be reset each frame before
-  // modifying it.
+  // Resets the duck gain to 1.0f. Duck gain must be reset before any bus that
+  // ducks this one calls Duck().
   void ResetDuckGain() { duck_gain_ = 1.0f; }
 
-  // Return the vector of child buses.
-  std::vector<Bus*>& child_buses() { return child_buses_; }
+  // Lower the duck gain to 'duck_gain', if it's higher.
+  void Duck(float duck_gain) { duck_gain_ = std::min(duck_gain_, duck_gain); }
+
+  // The bus whose gain is multiplied into this one's, or kInvalidBusIndex
+  // for the master bus.
+  BusIndex parent() const { return parent_; }
+  void set_parent(BusIndex parent) { parent_ = parent; }
 
   // Return the vector of duck buses, the buses to be ducked when a sound is
   // playing on this bus.
-  std::vector<Bus*>& duck_buses() { return duck_buses_; }
+  std::vector<BusIndex>& duck_buses() { return duck_buses_; }
+  const std::vector<BusIndex>& duck_buses() const { return duck_buses_; }
 
   // When a sound begins playing or finishes playing, the sound counter should
   // be incremented or decremented appropriately to track whether or not to
@@ -51,10 +65,16 @@ class Bus {
   void IncrementSoundCounter();
   void DecrementSoundCounter();
 
-  // Apply appropriate duck gain to all ducked buses.
-  void UpdateDuckGain(WorldTime delta_time);
+  // Advance the transition to or from the duck gain. Returns true if the
+  // duck gain this bus applies changed, in which case the duck gains of all
+  // buses must be reset and applied again.
+  bool UpdateDuckTransition(WorldTime delta_time);
 
-  // Recursively update the final gain of the bus.
+  // The gain this bus applies to its duck buses.
+  float DuckGain() const;
+
+  // Update the final gain of the bus, given its parent's final gain. The gain
+  // is only recomputed when the parent gain or duck gain changed.
   void UpdateGain(float parent_gain);
 
  private:
@@ -62,19 +82,23 @@ class Bus {
 
   // Children of a given bus have their gain multiplied against their parent's
   // gain.
-  std::vector<Bus*> child_buses_;
+  BusIndex parent_;
 
   // When a sound is played on this bus, sounds played on these buses should be
   // ducked.
-  std::vector<Bus*> duck_buses_;
+  std::vector<BusIndex> duck_buses_;
 
-  // The current duck_gain_ of this bus to be applied to all buses in
-  // duck_buses_.
+  // The current duck_gain_ of this bus, the lowest of the gains applied by
+  // the buses that duck it.
   float duck_gain_;
 
   // The final gain to be applied to all sounds on this bus.
   float gain_;
 
+  // The parent gain and duck gain that gain_ was computed from.
+  float applied_parent_gain_;
+  float applied_duck_gain_;
+
   // Keeps track of how many sounds are being played on this bus.
   int sound_count_;
 
@@ -16,6 +16,8 @@
 
 #include "precompiled.h"
 #include <math.h>
+#include <string.h>
+#include <limits>
 #include "audio_engine.h"
 #include "character.h"
 #include "character_state_machine.h"
@@ -51,6 +53,7 @@ Character::Character(
       state_machine_(character_state_machine_def),
       victory_state_(kResultUnknown),
       audio_engine_(audio_engine) {
+  OvershootInitFromFlatBuffers(*config_->face_angle_def(), &face_angle_init_);
   ResetStats();
 }
 
@@ -64,11 +67,9 @@ void Character::Reset(CharacterId target, CharacterHealth health,
   state_machine_.Reset();
   victory_state_ = kResultUnknown;
 
-  impel::OvershootImpelInit init;
-  OvershootInitFromFlatBuffers(*config_->face_angle_def(), &init);
-
-  face_angle_.Initialize(init, impel_engine);
+  face_angle_.Initialize(face_angle_init_, impel_engine);
   face_angle_.SetValue(face_angle.ToRadians());
+  prev_face_angle_ = FaceAngle();
 }
 
 void Character::SetTarget(CharacterId target, Angle angle_to_target) {
@@ -83,9 +84,15 @@ void Character::TwitchFaceAngle(impel::TwitchDirection twitch) {
   impel::Twitch(twitch, velocity, settled, &face_angle_);
 }
 
-mat4 Character::CalculateMatrix(bool facing_camera) const {
-  const Angle face_angle = FaceAngle();
-  return mat4::FromTranslationVector(position_) *
+mat4 Character::CalculateMatrix(bool facing_camera,
+                                float interpolation) const {
+  return CalculateMatrix(position_, InterpolatedFaceAngle(interpolation),
+                         facing_camera);
+}
+
+mat4 Character::CalculateMatrix(const vec3& position, Angle face_angle,
+                                bool facing_camera) {
+  return mat4::FromTranslationVector(position) *
          mat4::FromRotationMatrix(face_angle.ToXZRotationMatrix()) *
          mat4::FromScaleVector(vec3(1.0f, 1.0f, facing_camera ? 1.0f : -1.0f));
 }
@@ -98,7 +105,7 @@ uint16_t Character::RenderableId(WorldTime anim_time) const {
 
   // Grab the TimelineRenderable for 'anim_time', from the timeline.
   const int renderable_index =
-      TimelineIndexBeforeTime(timeline->renderables(), anim_time);
+      timeline_cursor_.Renderable(timeline, anim_time);
   const TimelineRenderable* renderable =
       timeline->renderables()->Get(renderable_index);
   if (!renderable)
@@ -109,7 +116,13 @@ uint16_t Character::RenderableId(WorldTime anim_time) const {
 }
 
 void Character::PlaySound(SoundId sound_id) const {
-  audio_engine_->PlaySound(sound_id);
+# ifdef PIE_NOON_HEADLESS
+  (void)sound_id;
+# else
+  if (audio_engine_) {
+    audio_engine_->PlaySound(sound_id);
+  }
+# endif
 }
 
 void Character::IncrementStat(PlayerStats stat) {
@@ -120,27 +133,292 @@ void Character::ResetStats() {
   for (int i = 0; i < kMaxStats; i++) player_stats_[i] = 0;
 }
 
+void Character::Snapshot(CharacterSnapshot* snapshot) const {
+  snapshot->target = target_;
+  snapshot->health = health_;
+  snapshot->pie_damage = pie_damage_;
+  snapshot->prev_face_angle = prev_face_angle_;
+  snapshot->position = position_;
+  snapshot->just_joined_game = just_joined_game_;
+  snapshot->state = State();
+  snapshot->state_start_time = state_machine_.current_state_start_time();
+  memcpy(snapshot->player_stats, player_stats_, sizeof(player_stats_));
+  snapshot->score = score_;
+  snapshot->victory_state = victory_state_;
+  snapshot->state_last_update = state_last_update_;
+}
+
+void Character::Restore(const CharacterSnapshot& snapshot) {
+  target_ = snapshot.target;
+  health_ = snapshot.health;
+  pie_damage_ = snapshot.pie_damage;
+  prev_face_angle_ = snapshot.prev_face_angle;
+  position_ = snapshot.position;
+  just_joined_game_ = snapshot.just_joined_game;
+  state_machine_.SetCurrentState(snapshot.state, snapshot.state_start_time);
+  timeline_cursor_ = TimelineCursor();
+  memcpy(player_stats_, snapshot.player_stats, sizeof(player_stats_));
+  score_ = snapshot.score;
+  victory_state_ = snapshot.victory_state;
+  state_last_update_ = snapshot.state_last_update;
+}
+
+void CharacterColumns::Gather(
+    const std::vector<std::unique_ptr<Character>>& characters,
+    const impel::ImpelProcessor1f* face_angles) {
+  const size_t count = characters.size();
+  position_.resize(count);
+  health_.resize(count);
+  target_.resize(count);
+  victory_state_.resize(count);
+  face_angle_id_.resize(count);
+  face_angle_.resize(count);
+  is_ai_.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    const Character& character = *characters[i];
+    position_[i] = character.position();
+    health_[i] = character.health();
+    target_[i] = character.target();
+    victory_state_[i] = character.victory_state();
+    face_angle_id_[i] = character.face_angle_id();
+    is_ai_[i] = character.controller()->controller_type() ==
+                Controller::kTypeAI;
+  }
+  if (count > 0) {
+    face_angles->Values(&face_angle_id_[0], static_cast<int>(count),
+                        &face_angle_[0]);
+  }
+  GatherStates(characters);
+}
+
+void CharacterColumns::GatherStates(
+    const std::vector<std::unique_ptr<Character>>& characters) {
+  const size_t count = characters.size();
+  assert(count == is_ai_.size());
+  state_.resize(count);
+  went_down_.resize(count);
+  num_active_ = 0;
+  num_active_humans_ = 0;
+  for (size_t i = 0; i < count; ++i) {
+    const Character& character = *characters[i];
+    state_[i] = character.State();
+    went_down_[i] = character.controller()->went_down();
+    const int active = state_[i] != StateId_KO ? 1 : 0;
+    num_active_ += active;
+    num_active_humans_ += is_ai_[i] ? 0 : active;
+  }
+
+  // Link the active characters into a ring. The ring wraps around from the
+  // last active id to the first.
+  next_active_.resize(count);
+  previous_active_.resize(count);
+  const CharacterId num_ids = static_cast<CharacterId>(count);
+  CharacterId first = -1;
+  CharacterId last = -1;
+  for (CharacterId i = 0; i < num_ids; ++i) {
+    if (state_[i] == StateId_KO)
+      continue;
+    if (first < 0) {
+      first = i;
+    }
+    last = i;
+  }
+  CharacterId next = first;
+  for (CharacterId i = num_ids - 1; i >= 0; --i) {
+    next_active_[i] = next < 0 || next == i ? i : next;
+    if (state_[i] != StateId_KO) {
+      next = i;
+    }
+  }
+  CharacterId previous = last;
+  for (CharacterId i = 0; i < num_ids; ++i) {
+    previous_active_[i] = previous < 0 || previous == i ? i : previous;
+    if (state_[i] != StateId_KO) {
+      previous = i;
+    }
+  }
+}
+
+
+const WorldTime AirbornePies::kNoArrival =
+    std::numeric_limits<WorldTime>::max();
+
+AirbornePies::AirbornePies() {
+  original_sources_.reserve(kInitialCapacity);
+  sources_.reserve(kInitialCapacity);
+  targets_.reserve(kInitialCapacity);
+  start_times_.reserve(kInitialCapacity);
+  flight_times_.reserve(kInitialCapacity);
+  damages_.reserve(kInitialCapacity);
+  heights_.reserve(kInitialCapacity);
+  rotations_.reserve(kInitialCapacity);
+  orientations_.reserve(kInitialCapacity);
+  positions_.reserve(kInitialCapacity);
+  prev_orientations_.reserve(kInitialCapacity);
+  prev_positions_.reserve(kInitialCapacity);
+}
+
+// orientations_ and positions_ are set each frame in GameState::AdvanceFrame.
+int AirbornePies::Add(CharacterId original_source, CharacterId source,
+                      CharacterId target, WorldTime start_time,
+                      WorldTime flight_time, CharacterHealth damage,
+                      float height, int rotations) {
+  const Quat identity(0.0f, 0.0f, 1.0f, 0.0f);
+  original_sources_.push_back(original_source);
+  sources_.push_back(source);
+  targets_.push_back(target);
+  start_times_.push_back(start_time);
+  flight_times_.push_back(flight_time);
+  damages_.push_back(damage);
+  heights_.push_back(height);
+  rotations_.push_back(rotations);
+  orientations_.push_back(identity);
+  positions_.push_back(mathfu::kZeros3f);
+  prev_orientations_.push_back(identity);
+  prev_positions_.push_back(mathfu::kZeros3f);
+
+  if (target >= static_cast<CharacterId>(incoming_counts_.size())) {
+    incoming_counts_.resize(target + 1, 0);
+    soonest_arrivals_.resize(target + 1, kNoArrival);
+  }
+  incoming_counts_[target]++;
+  soonest_arrivals_[target] =
+      std::min(soonest_arrivals_[target], start_time + flight_time);
+  return Count() - 1;
+}
+
+void AirbornePies::Remove(int i) {
+  assert(0 <= i && i < Count());
+  const CharacterId target = targets_[i];
+  const WorldTime arrival = start_times_[i] + flight_times_[i];
+  const int last = Count() - 1;
+  if (i != last) {
+    original_sources_[i] = original_sources_[last];
+    sources_[i] = sources_[last];
+    targets_[i] = targets_[last];
+    start_times_[i] = start_times_[last];
+    flight_times_[i] = flight_times_[last];
+    damages_[i] = damages_[last];
+    heights_[i] = heights_[last];
+    rotations_[i] = rotations_[last];
+    orientations_[i] = orientations_[last];
+    positions_[i] = positions_[last];
+    prev_orientations_[i] = prev_orientations_[last];
+    prev_positions_[i] = prev_positions_[last];
+  }
+  original_sources_.pop_back();
+  sources_.pop_back();
+  targets_.pop_back();
+  start_times_.pop_back();
+  flight_times_.pop_back();
+  damages_.pop_back();
+  heights_.pop_back();
+  rotations_.pop_back();
+  orientations_.pop_back();
+  positions_.pop_back();
+  prev_orientations_.pop_back();
+  prev_positions_.pop_back();
+
+  // Only when the soonest pie is removed do we need to look for the next
+  // soonest. That is once per landing, not once per query.
+  incoming_counts_[target]--;
+  if (arrival == soonest_arrivals_[target]) {
+    WorldTime soonest = kNoArrival;
+    for (int j = 0; incoming_counts_[target] > 0 && j < Count(); ++j) {
+      if (targets_[j] == target) {
+        soonest = std::min(soonest, start_times_[j] + flight_times_[j]);
+      }
+    }
+    soonest_arrivals_[target] = soonest;
+  }
+}
+
+void AirbornePies::Clear() {
+  original_sources_.clear();
+  sources_.clear();
+  targets_.clear();
+  start_times_.clear();
+  flight_times_.clear();
+  damages_.clear();
+  heights_.clear();
+  rotations_.clear();
+  orientations_.clear();
+  positions_.clear();
+  prev_orientations_.clear();
+  prev_positions_.clear();
+  std::fill(incoming_counts_.begin(), incoming_counts_.end(), 0);
+  std::fill(soonest_arrivals_.begin(), soonest_arrivals_.end(), kNoArrival);
+}
 
-// orientation_ and position_ are set each frame in GameState::Advance.
-AirbornePie::AirbornePie(CharacterId original_source, CharacterId source,
-                         CharacterId target, WorldTime start_time,
-                         WorldTime flight_time, CharacterHealth damage,
-                         float height, int rotations)
-    : original_source_(original_source),
-      source_(source),
-      target_(target),
-      start_time_(start_time),
-      flight_time_(flight_time),
-      damage_(damage),
-      height_(height),
-      rotations_(rotations),
-      orientation_(0.0f, 0.0f, 1.0f, 0.0f),
-      position_(0.0f) {
+void AirbornePies::UpdatePreviousTransforms() {
+  prev_positions_ = positions_;
+  prev_orientations_ = orientations_;
 }
 
-mat4 AirbornePie::CalculateMatrix() const {
-  return mat4::FromTranslationVector(position_) *
-         mat4::FromRotationMatrix(orientation_.ToMatrix());
+void AirbornePies::UpdatePreviousTransform(int i) {
+  prev_positions_[i] = positions_[i];
+  prev_orientations_[i] = orientations_[i];
+}
+
+void AirbornePies::CalculateMatrices(float interpolation,
+                                     mat4* matrices) const {
+  const int count = Count();
+  for (int i = 0; i < count; ++i) {
+    const vec3 position = vec3::Lerp(prev_positions_[i], positions_[i],
+                                     interpolation);
+    const Quat orientation = Quat::Slerp(prev_orientations_[i],
+                                         orientations_[i], interpolation);
+    matrices[i] = mat4::FromTranslationVector(position) *
+                  mat4::FromRotationMatrix(orientation.ToMatrix());
+  }
+}
+
+void TimelineCursor::Reset(const Timeline* timeline, WorldTime t) {
+  timeline_ = timeline;
+  time_ = t;
+  event_ = 0;
+  sound_ = 0;
+  renderable_ = 0;
+  accessory_begin_ = 0;
+  accessory_end_ = 0;
+}
+
+void TimelineCursor::Sync(const Timeline* timeline, WorldTime t) {
+  if (timeline != timeline_ || t < time_) {
+    Reset(timeline, t);
+  } else {
+    time_ = t;
+  }
+}
+
+void TimelineCursor::Events(const Timeline* timeline, WorldTime start,
+                            WorldTime end, int* start_index, int* end_index) {
+  Sync(timeline, start);
+  event_ = TimelineIndexAfterTime(timeline->events(), event_, start);
+  *start_index = event_;
+  *end_index = TimelineIndexAfterTime(timeline->events(), event_, end);
+}
+
+void TimelineCursor::Sounds(const Timeline* timeline, WorldTime start,
+                            WorldTime end, int* start_index, int* end_index) {
+  Sync(timeline, start);
+  sound_ = TimelineIndexAfterTime(timeline->sounds(), sound_, start);
+  *start_index = sound_;
+  *end_index = TimelineIndexAfterTime(timeline->sounds(), sound_, end);
+}
+
+int TimelineCursor::Renderable(const Timeline* timeline, WorldTime t) {
+  Sync(timeline, t);
+  const auto renderables = timeline->renderables();
+  if (!renderables)
+    return 0;
+
+  const int length = static_cast<int>(renderables->Length());
+  while (renderable_ + 1 < length &&
+         renderables->Get(renderable_ + 1)->time() <= t) {
+    renderable_++;
+  }
+  return renderable_;
 }
 
 void ApplyScoringRule(const ScoringRules* scoring_rules,
@@ -15,11 +15,14 @@
 #ifndef PIE_NOON_CHARACTER_H_
 #define PIE_NOON_CHARACTER_H_
 
+#include <memory>
+#include <vector>
 #include "angle.h"
 #include "audio_config_generated.h"
 #include "character_state_machine.h"
 #include "character_state_machine_def_generated.h"
 #include "config_generated.h"
+#include "impel_processor_overshoot.h"
 #include "impel_util.h"
 #include "impeller.h"
 #include "player_controller.h"
@@ -60,6 +63,71 @@ enum VictoryState {
   kFailure
 };
 
+// Remembers how far through a Timeline the previous query got. Timelines are
+// sorted by time, so when a query's time is no earlier than the last one's,
+// only the entries between the two times need to be looked at. A query for a
+// different timeline, or for an earlier time, starts from the beginning.
+//
+// Each query gives the same answer as the corresponding Timeline* function
+// below, but costs O(entries passed) instead of O(timeline length).
+class TimelineCursor {
+ public:
+  TimelineCursor() { Reset(nullptr, 0); }
+
+  // Set [*start_index, *end_index) to the events with start <= time < end.
+  void Events(const Timeline* timeline, WorldTime start, WorldTime end,
+              int* start_index, int* end_index);
+
+  // Set [*start_index, *end_index) to the sounds with start <= time < end.
+  void Sounds(const Timeline* timeline, WorldTime start, WorldTime end,
+              int* start_index, int* end_index);
+
+  // Same as TimelineIndexBeforeTime(timeline->renderables(), t).
+  int Renderable(const Timeline* timeline, WorldTime t);
+
+  // Same as TimelineIndicesWithTime(timeline->accessories(), t, indices).
+  template<class Indices>
+  void Accessories(const Timeline* timeline, WorldTime t, Indices* indices);
+
+ private:
+  // Start from the beginning if the last query can't be continued from.
+  void Sync(const Timeline* timeline, WorldTime t);
+  void Reset(const Timeline* timeline, WorldTime t);
+
+  // The timeline and time of the last query.
+  const Timeline* timeline_;
+  WorldTime time_;
+
+  // Everything before these indices has time < time_.
+  int event_;
+  int sound_;
+
+  // Index returned by the last Renderable() call.
+  int renderable_;
+
+  // Accessories before accessory_begin_ have ended by time_. Accessories
+  // from accessory_end_ onwards start after time_.
+  int accessory_begin_;
+  int accessory_end_;
+};
+
+// Everything about a Character that changes as the game is played, except
+// for the face angle, which is saved with the ImpelEngine.
+struct CharacterSnapshot {
+  CharacterId target;
+  CharacterHealth health;
+  CharacterHealth pie_damage;
+  Angle prev_face_angle;
+  mathfu::vec3 position;
+  bool just_joined_game;
+  int state;
+  WorldTime state_start_time;
+  uint64_t player_stats[kMaxStats];
+  int score;
+  VictoryState victory_state;
+  uint16_t state_last_update;
+};
+
 // The current state of the character. This class tracks information external
 // to the state machine, like health.
 class Character {
@@ -83,11 +151,22 @@ class Character {
   // Gets the character's current face angle.
   Angle FaceAngle() const { return Angle(face_angle_.Value()); }
 
+  // Gets the face angle 'interpolation' of the way from its value at the
+  // previous update to its current value. Used to render between updates.
+  Angle InterpolatedFaceAngle(float interpolation) const {
+    return prev_face_angle_ + (FaceAngle() - prev_face_angle_) * interpolation;
+  }
+
   // Sets the character's target and our target face angle.
   void SetTarget(CharacterId target, Angle angle_to_target);
 
-  // Convert the position and face angle into a matrix for rendering.
-  mathfu::mat4 CalculateMatrix(bool facing_camera) const;
+  // Convert the position and face angle into a matrix for rendering. The
+  // face angle is interpolated as in InterpolatedFaceAngle().
+  mathfu::mat4 CalculateMatrix(bool facing_camera, float interpolation) const;
+
+  // The matrix of a character at 'position' with 'face_angle'.
+  static mathfu::mat4 CalculateMatrix(const mathfu::vec3& position,
+                                      Angle face_angle, bool facing_camera);
 
   // Calculate the renderable id for the character at 'anim_time'.
   uint16_t RenderableId(WorldTime anim_time) const;
@@ -108,10 +187,19 @@ class Character {
 
   // Saves off whatever our current state is.  Should be called once per frame,
   // just before (potentially) modifying the state.
-  void UpdatePreviousState() {
+  void UpdatePreviousState() { UpdatePreviousState(FaceAngle()); }
+
+  // Same as above, when the caller has already read FaceAngle(). For example,
+  // along with every other character's, with CharacterColumns.
+  void UpdatePreviousState(Angle face_angle) {
     state_last_update_ = State();
+    prev_face_angle_ = face_angle;
   }
 
+  // Identifies the face angle in its processor, so that the face angles of
+  // all characters can be read at once.
+  impel::ImpelId face_angle_id() const { return face_angle_.Id(); }
+
   // Returns true if the character is still in the game.
   bool Active() const { return State() != StateId_KO; }
 
@@ -135,12 +223,21 @@ class Character {
   Controller* controller() { return controller_; }
   void set_controller(Controller* controller) { controller_ = controller; }
 
+  // Sounds are not played while the audio engine is null.
+  void set_audio_engine(AudioEngine* audio_engine) {
+    audio_engine_ = audio_engine;
+  }
+
   const CharacterStateMachine* state_machine() const {
     return &state_machine_;
   }
 
   CharacterStateMachine* state_machine() { return &state_machine_; }
 
+  // Position in CurrentTimeline(). Only a cache of where the last timeline
+  // query stopped, so it can be advanced through a const Character.
+  TimelineCursor* timeline_cursor() const { return &timeline_cursor_; }
+
   void IncrementStat(PlayerStats stat);
   uint64_t &GetStat(PlayerStats stat) { return player_stats_[stat]; }
 
@@ -153,12 +250,16 @@ class Character {
   bool just_joined_game() { return just_joined_game_; }
 
   void set_victory_state(VictoryState state) { victory_state_ = state; }
-  VictoryState victory_state() { return victory_state_; }
+  VictoryState victory_state() const { return victory_state_; }
 
   // Resets all stats we've accumulated.  Usually called when we have finished
   // sending them to the server.
   void ResetStats();
 
+  // Save or restore the character, for rolling back a networked match.
+  void Snapshot(CharacterSnapshot* snapshot) const;
+  void Restore(const CharacterSnapshot& snapshot);
+
  private:
   // Constant configuration data.
   const Config* config_;
@@ -179,6 +280,12 @@ class Character {
   // World angle. Will eventually settle on the angle towards target_.
   impel::Impeller1f face_angle_;
 
+  // Parameters of face_angle_, converted from the Config once.
+  impel::OvershootImpelInit face_angle_init_;
+
+  // Value of face_angle_ at the start of the last update.
+  Angle prev_face_angle_;
+
   // Position of the character in world space.
   mathfu::vec3 position_;
 
@@ -191,6 +298,9 @@ class Character {
   // The current state of the character.
   CharacterStateMachine state_machine_;
 
+  // Where timeline queries for the current state last stopped.
+  mutable TimelineCursor timeline_cursor_;
+
   // The stats we're collecting (see PlayerStats enum above).
   uint64_t player_stats_[kMaxStats];
 
@@ -209,38 +319,159 @@ class Character {
 
 };
 
+// The fields of every Character that the per-character passes of
+// GameState::AdvanceFrame() read, as a structure of arrays indexed by
+// CharacterId. Gather() copies them out of the Characters in one pass, and
+// the passes then read contiguous arrays instead of following a pointer per
+// character for every field. A pass that only reads the columns, and only
+// writes to its own character, can be split across threads.
+//
+// The Characters stay authoritative. The columns are a copy, valid until a
+// Character changes.
+class CharacterColumns {
+ public:
+  CharacterColumns() : num_active_(0), num_active_humans_(0) {}
+
+  // Copy every field of every character. The face angles are read from
+  // 'face_angles' all at once. It may be null when there are no characters.
+  void Gather(const std::vector<std::unique_ptr<Character>>& characters,
+              const impel::ImpelProcessor1f* face_angles);
+
+  // Copy the states and logical inputs again, after the state machines or
+  // the game have changed them.
+  void GatherStates(const std::vector<std::unique_ptr<Character>>& characters);
+
+  int size() const { return static_cast<int>(state_.size()); }
+
+  const mathfu::vec3& position(int i) const { return position_[i]; }
+  CharacterHealth health(int i) const { return health_[i]; }
+  uint16_t state(int i) const { return state_[i]; }
+  CharacterId target(int i) const { return target_[i]; }
+  VictoryState victory_state(int i) const { return victory_state_[i]; }
+  Angle face_angle(int i) const { return Angle(face_angle_[i]); }
+  uint32_t went_down(int i) const { return went_down_[i]; }
+  bool is_ai(int i) const { return is_ai_[i] != 0; }
+
+  // Number of characters that are still in the game, with any controller
+  // and with human controllers.
+  int num_active() const { return num_active_; }
+  int num_active_humans() const { return num_active_humans_; }
+
+  // The closest character after or before 'i' in id order, wrapping around,
+  // that is still in the game. 'i' itself if no other character is.
+  CharacterId next_active(int i) const { return next_active_[i]; }
+  CharacterId previous_active(int i) const { return previous_active_[i]; }
 
-class AirbornePie {
+ private:
+  std::vector<mathfu::vec3> position_;
+  std::vector<CharacterHealth> health_;
+  std::vector<uint16_t> state_;
+  std::vector<CharacterId> target_;
+  std::vector<VictoryState> victory_state_;
+  std::vector<impel::ImpelId> face_angle_id_;
+  std::vector<float> face_angle_;
+  std::vector<uint32_t> went_down_;
+  std::vector<uint8_t> is_ai_;
+  std::vector<CharacterId> next_active_;
+  std::vector<CharacterId> previous_active_;
+  int num_active_;
+  int num_active_humans_;
+};
+
+
+// Every pie in flight, stored as a structure-of-arrays so that a whole volley
+// can be moved and drawn in one pass over contiguous memory. Pies are
+// referred to by index, in [0, Count()). Remove() moves the last pie into the
+// hole, so indices are only stable until the next Remove().
+class AirbornePies {
  public:
-  AirbornePie(CharacterId original_source, CharacterId source,
-              CharacterId target, WorldTime start_time, WorldTime flight_time,
-              CharacterHealth damage, float height, int rotations);
+  // Room for this many pies is allocated up front. More can be added, at the
+  // cost of a reallocation.
+  static const int kInitialCapacity = 64;
 
-  CharacterId original_source() const { return original_source_; }
-  CharacterId source() const { return source_; }
-  CharacterId target() const { return target_; }
-  WorldTime start_time() const { return start_time_; }
-  WorldTime flight_time() const { return flight_time_; }
-  CharacterHealth damage() const { return damage_; }
-  float height() const { return height_; }
-  int rotations() const { return rotations_; }
-  Quat orientation() const { return orientation_; }
-  void set_orientation(const Quat& orientation) { orientation_ = orientation; }
-  mathfu::vec3 position() const { return position_; }
-  void set_position(const mathfu::vec3& position) { position_ = position; }
-  mathfu::mat4 CalculateMatrix() const;
+  // Returned by SoonestArrival() when no pie is incoming.
+  static const WorldTime kNoArrival;
+
+  AirbornePies();
+
+  // Append a pie and return its index. Its transform is set by the first
+  // call to set_position() and set_orientation().
+  int Add(CharacterId original_source, CharacterId source, CharacterId target,
+          WorldTime start_time, WorldTime flight_time, CharacterHealth damage,
+          float height, int rotations);
+
+  // Remove pie 'i' by moving the last pie into its slot.
+  void Remove(int i);
+
+  // Remove every pie. Keeps the memory.
+  void Clear();
+
+  int Count() const { return static_cast<int>(sources_.size()); }
+
+  // Number of pies in the air that are aimed at 'target'.
+  int IncomingCount(CharacterId target) const {
+    return target < static_cast<CharacterId>(incoming_counts_.size()) ?
+           incoming_counts_[target] : 0;
+  }
+
+  // Time at which the first pie aimed at 'target' will land, or kNoArrival
+  // if no pies are aimed at 'target'.
+  WorldTime SoonestArrival(CharacterId target) const {
+    return target < static_cast<CharacterId>(soonest_arrivals_.size()) ?
+           soonest_arrivals_[target] : kNoArrival;
+  }
+
+  CharacterId original_source(int i) const { return original_sources_[i]; }
+  CharacterId source(int i) const { return sources_[i]; }
+  CharacterId target(int i) const { return targets_[i]; }
+  WorldTime start_time(int i) const { return start_times_[i]; }
+  WorldTime flight_time(int i) const { return flight_times_[i]; }
+  CharacterHealth damage(int i) const { return damages_[i]; }
+  float height(int i) const { return heights_[i]; }
+  int rotations(int i) const { return rotations_[i]; }
+  const Quat& orientation(int i) const { return orientations_[i]; }
+  void set_orientation(int i, const Quat& orientation) {
+    orientations_[i] = orientation;
+  }
+  const mathfu::vec3& position(int i) const { return positions_[i]; }
+  void set_position(int i, const mathfu::vec3& position) {
+    positions_[i] = position;
+  }
+
+  // Remember the current position and orientation of every pie. Call once
+  // per update, before moving the pies.
+  void UpdatePreviousTransforms();
+
+  // Remember the current transform of pie 'i' only. Used when a pie is
+  // created, so that it does not appear to fly in from the origin.
+  void UpdatePreviousTransform(int i);
+
+  // Write the world matrix of every pie to 'matrices', which must have room
+  // for Count() entries. Each matrix is 'interpolation' of the way from the
+  // transform at the previous update to the current one.
+  void CalculateMatrices(float interpolation, mathfu::mat4* matrices) const;
 
  private:
-  CharacterId original_source_;
-  CharacterId source_;
-  CharacterId target_;
-  WorldTime start_time_;
-  WorldTime flight_time_;
-  CharacterHealth damage_;
-  float height_;
-  int rotations_;
-  Quat orientation_;
-  mathfu::vec3 position_;
+  // Fixed for the lifetime of the pie.
+  std::vector<CharacterId> original_sources_;
+  std::vector<CharacterId> sources_;
+  std::vector<CharacterId> targets_;
+  std::vector<WorldTime> start_times_;
+  std::vector<WorldTime> flight_times_;
+  std::vector<CharacterHealth> damages_;
+  std::vector<float> heights_;
+  std::vector<int> rotations_;
+
+  // Updated every frame in GameState::UpdatePiePositions().
+  std::vector<Quat> orientations_;
+  std::vector<mathfu::vec3> positions_;
+  std::vector<Quat> prev_orientations_;
+  std::vector<mathfu::vec3> prev_positions_;
+
+  // Indexed by target CharacterId. Kept up to date by Add(), Remove() and
+  // Clear(), so that the AI can check for danger without scanning the pies.
+  std::vector<int> incoming_counts_;
+  std::vector<WorldTime> soonest_arrivals_;
 };
 
 
@@ -273,21 +504,46 @@ inline int TimelineIndexBeforeTime(const T& arr, const WorldTime t) {
   return arr->Length() - 1;
 }
 
-// Return array of indices with time <= t < end_time.
+// Fill 'indices' with the indices of items with time <= t < end_time.
 // T is a flatbuffer::Vector; one of the Timeline members.
-template<class T>
-inline std::vector<int> TimelineIndicesWithTime(const T& arr,
-                                                const WorldTime t) {
-  std::vector<int> ret;
+// Indices is a std::vector<int>, with any allocator. Its memory is reused.
+template<class T, class Indices>
+inline void TimelineIndicesWithTime(const T& arr, const WorldTime t,
+                                    Indices* indices) {
+  indices->clear();
   if (!arr)
-    return ret;
+    return;
 
   for (int i = 0; i < static_cast<int>(arr->Length()); ++i) {
     const float end_time = arr->Get(i)->end_time();
     if (arr->Get(i)->time() <= t && (t < end_time || end_time == 0.0f))
-      ret.push_back(i);
+      indices->push_back(i);
+  }
+}
+
+template<class Indices>
+void TimelineCursor::Accessories(const Timeline* timeline, WorldTime t,
+                                 Indices* indices) {
+  indices->clear();
+  Sync(timeline, t);
+  const auto accessories = timeline->accessories();
+  if (!accessories)
+    return;
+
+  const int length = static_cast<int>(accessories->Length());
+  while (accessory_end_ < length &&
+         accessories->Get(accessory_end_)->time() <= t) {
+    accessory_end_++;
+  }
+  for (int i = accessory_begin_; i < accessory_end_; ++i) {
+    const int end_time = accessories->Get(i)->end_time();
+    const bool ended = end_time != 0 && end_time <= t;
+    if (!ended) {
+      indices->push_back(i);
+    } else if (i == accessory_begin_) {
+      accessory_begin_++;
+    }
   }
-  return ret;
 }
 
 void ApplyScoringRule(const ScoringRules* scoring_rules, ScoreEvent event,
@@ -20,21 +20,23 @@
 namespace fpl {
 namespace pie_noon {
 
+const int CompiledStateMachine::kNoTransition;
+
 CharacterStateMachine::CharacterStateMachine(
     const CharacterStateMachineDef* const state_machine_def)
-    : state_machine_def_(state_machine_def) {
+    : state_machine_def_(state_machine_def),
+      compiled_(state_machine_def) {
   Reset();
 }
 
 void CharacterStateMachine::Reset() {
-  current_state_ =
-      state_machine_def_->states()->Get(state_machine_def_->initial_state());
-  current_state_start_time_ = 0;
+  SetCurrentState(state_machine_def_->initial_state(), 0);
 }
 
 void CharacterStateMachine::SetCurrentState(int new_stateId,
                                             WorldTime state_start_time) {
   current_state_ = state_machine_def_->states()->Get(new_stateId);
+  current_state_id_ = new_stateId;
   current_state_start_time_ = state_start_time;
 }
 
@@ -53,18 +55,59 @@ bool EvaluateCondition(const Condition* condition,
 }
 
 void CharacterStateMachine::Update(const ConditionInputs& inputs) {
-  if (!current_state_->transitions()) {
-    return;
+  const int next_state = compiled_.NextState(current_state_id_, inputs);
+  if (next_state != CompiledStateMachine::kNoTransition) {
+    SetCurrentState(next_state, inputs.current_time);
   }
-  for (auto it = current_state_->transitions()->begin();
-       it != current_state_->transitions()->end(); ++it) {
-    const Condition* condition = it->condition();
-    if (condition && EvaluateCondition(condition, inputs)) {
-      current_state_ = state_machine_def_->states()->Get(it->target_state());
-      current_state_start_time_ = inputs.current_time;
-      return;
+}
+
+CompiledStateMachine::CompiledStateMachine(
+    const CharacterStateMachineDef* const state_machine_def) {
+  const auto states = state_machine_def->states();
+  first_transition_.reserve(states->Length() + 1);
+  for (flatbuffers::uoffset_t i = 0; i < states->Length(); ++i) {
+    first_transition_.push_back(NumTransitions());
+    const auto transitions = states->Get(i)->transitions();
+    if (!transitions) continue;
+
+    for (flatbuffers::uoffset_t j = 0; j < transitions->Length(); ++j) {
+      const Transition* transition = transitions->Get(j);
+      const Condition* condition = transition->condition();
+      if (!condition) continue;
+
+      CompiledTransition compiled;
+      compiled.is_down = condition->is_down();
+      compiled.is_up = condition->is_up();
+      compiled.went_down = condition->went_down();
+      compiled.went_up = condition->went_up();
+      compiled.time = condition->time();
+      compiled.end_time = condition->end_time();
+      compiled.target_state = transition->target_state();
+      transitions_.push_back(compiled);
     }
   }
+  first_transition_.push_back(NumTransitions());
+}
+
+// Same test as EvaluateCondition(), but with every comparison combined
+// without branching, so each transition costs a few instructions.
+int CompiledStateMachine::NextState(int state,
+                                    const ConditionInputs& inputs) const {
+  const uint32_t is_down = static_cast<uint32_t>(inputs.is_down);
+  const uint32_t went_down = static_cast<uint32_t>(inputs.went_down);
+  const uint32_t went_up = static_cast<uint32_t>(inputs.went_up);
+  const int32_t time = inputs.animation_time;
+  const int end = first_transition_[state + 1];
+  for (int i = first_transition_[state]; i < end; ++i) {
+    const CompiledTransition& t = transitions_[i];
+    const uint32_t missing = (t.is_down & ~is_down) | (t.is_up & is_down) |
+                             (t.went_down & ~went_down) |
+                             (t.went_up & ~went_up);
+    const bool matches = (missing == 0) & (time >= t.time) &
+                         (time < t.end_time);
+    if (matches) return t.target_state;
+  }
+  return kNoTransition;
 }
 
 bool CharacterStateMachineDef_Validate(
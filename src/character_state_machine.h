@@ -16,6 +16,7 @@
 #define CHARACTER_STATE_MACHINE_
 
 #include <cstdint>
+#include <vector>
 #include "common.h"
 
 namespace fpl {
@@ -39,6 +40,45 @@ struct ConditionInputs {
   WorldTime current_time;
 };
 
+// A Transition with its Condition unpacked into plain integers, so that it
+// can be evaluated without reading from the flatbuffer.
+struct CompiledTransition {
+  uint32_t is_down;
+  uint32_t is_up;
+  uint32_t went_down;
+  uint32_t went_up;
+  int32_t time;
+  int32_t end_time;
+  int32_t target_state;
+};
+
+// The transitions of every state in a CharacterStateMachineDef, packed into
+// one array. The transitions of each state are contiguous and in the same
+// order as in the definition. Transitions without a condition can never be
+// followed, so they are dropped.
+class CompiledStateMachine {
+ public:
+  // Returned by NextState() when no transition's condition is met.
+  static const int kNoTransition = -1;
+
+  // The definition must have passed CharacterStateMachineDef_Validate().
+  explicit CompiledStateMachine(
+      const CharacterStateMachineDef* const state_machine_def);
+
+  // Returns the target of the first transition out of 'state' whose
+  // condition matches 'inputs', or kNoTransition.
+  int NextState(int state, const ConditionInputs& inputs) const;
+
+  int NumTransitions() const { return static_cast<int>(transitions_.size()); }
+
+ private:
+  std::vector<CompiledTransition> transitions_;
+
+  // The transitions of state i are in
+  // [first_transition_[i], first_transition_[i + 1]).
+  std::vector<int> first_transition_;
+};
+
 class CharacterStateMachine {
  public:
   // Initializes a state machine with the given state machine definition.
@@ -49,7 +89,9 @@ class CharacterStateMachine {
   // Resets back to initial conditions. Assumes time is reseting to 0 too.
   void Reset();
 
-  // Updates the current state of the state machine.
+  // Updates the current state of the state machine. Uses the transitions
+  // compiled at construction, so the flatbuffer is only read when the state
+  // changes.
   //
   // inputs is a structure containing the game data that can affect whether or
   // not a state transition occurs
@@ -65,7 +107,9 @@ class CharacterStateMachine {
 
  private:
   const CharacterStateMachineDef* state_machine_def_;
+  CompiledStateMachine compiled_;
   const CharacterState* current_state_;
+  int current_state_id_;
   WorldTime current_state_start_time_;
 };
 
@@ -23,6 +23,11 @@ void Controller::ClearAllLogicalInputs() {
   went_up_ = 0;
 }
 
+void Controller::ClearEdges() {
+  went_down_ = 0;
+  went_up_ = 0;
+}
+
 void Controller::SetLogicalInputs(uint32_t bitmap, bool set) {
   if (set) {
     uint32_t already_down = bitmap & is_down_;
@@ -45,6 +45,11 @@ class Controller {
   // Update the current state of this controller.
   virtual void AdvanceFrame(WorldTime delta_time) = 0;
 
+  // Re-read the physical inputs that arrived since AdvanceFrame(), just
+  // before the logical inputs are used. Only controllers driven by devices
+  // need to do anything.
+  virtual void LatchInput() {}
+
   ControllerType controller_type() const{ return controller_type_; }
 
   // Returns the current set of active logical input bits.
@@ -61,6 +66,9 @@ class Controller {
   // Clear all the currently set logical inputs.
   void ClearAllLogicalInputs();
 
+  // Forget which logical inputs went down or up, but not which are held.
+  void ClearEdges();
+
  protected:
   // A bitfield of currently active logical input bits.
   uint32_t is_down_;
@@ -0,0 +1,41 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cassert>
+#include "fixed_step.h"
+#include "controller.h"
+
+namespace fpl {
+namespace pie_noon {
+
+int AdvanceFixedSteps(WorldTime step, WorldTime delta_time,
+                      const std::vector<Controller*>& controllers,
+                      FixedStepFn* fn, void* context, WorldTime* remainder) {
+  assert(step > 0);
+  *remainder += delta_time;
+  int num_steps = 0;
+  while (*remainder >= step) {
+    fn(step, context);
+    *remainder -= step;
+    if (num_steps++ == 0) {
+      for (size_t i = 0; i < controllers.size(); ++i) {
+        controllers[i]->ClearEdges();
+      }
+    }
+  }
+  return num_steps;
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,42 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_FIXED_STEP_H_
+#define PIE_NOON_FIXED_STEP_H_
+
+#include <vector>
+#include "common.h"
+
+namespace fpl {
+namespace pie_noon {
+
+class Controller;
+
+typedef void FixedStepFn(WorldTime step, void* context);
+
+// Advance by 'delta_time' ms of real time, calling fn(step, context) for
+// every whole step of 'step' ms. What doesn't fill a step is kept in
+// *remainder and carried into the next call. Returns the number of steps.
+//
+// The controllers' went_down() and went_up() edges belong to the frame, so
+// only the first step sees them. Later steps see the inputs held, but not
+// pressed again, so one press can't turn a character twice.
+int AdvanceFixedSteps(WorldTime step, WorldTime delta_time,
+                      const std::vector<Controller*>& controllers,
+                      FixedStepFn* fn, void* context, WorldTime* remainder);
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_FIXED_STEP_H_
@@ -0,0 +1,75 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "frame_arena.h"
+
+namespace fpl {
+
+static size_t AlignUp(size_t x, size_t alignment) {
+  return (x + alignment - 1) & ~(alignment - 1);
+}
+
+FrameArena::FrameArena(size_t size)
+    : block_(new uint8_t[size]),
+      size_(size),
+      offset_(0),
+      overflow_size_(0) {
+}
+
+FrameArena::~FrameArena() {
+  for (size_t i = 0; i < overflow_.size(); ++i) {
+    delete[] overflow_[i];
+  }
+  delete[] block_;
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment) {
+  assert((alignment & (alignment - 1)) == 0);
+
+  // Carve the allocation out of the block, if it fits. Align the address
+  // rather than the offset, since new[] only guarantees malloc alignment.
+  const size_t base = reinterpret_cast<size_t>(block_);
+  const size_t start = AlignUp(base + offset_, alignment) - base;
+  if (start + size <= size_) {
+    offset_ = start + size;
+    return block_ + start;
+  }
+
+  // Otherwise, fall back to the heap until the next Reset().
+  const size_t overflow_size = size + alignment;
+  uint8_t* overflow = new uint8_t[overflow_size];
+  overflow_.push_back(overflow);
+  overflow_size_ += overflow_size;
+  return reinterpret_cast<void*>(
+      AlignUp(reinterpret_cast<size_t>(overflow), alignment));
+}
+
+void FrameArena::Reset() {
+  // If we overflowed, grow the block so that next time everything fits.
+  if (!overflow_.empty()) {
+    for (size_t i = 0; i < overflow_.size(); ++i) {
+      delete[] overflow_[i];
+    }
+    overflow_.clear();
+    const size_t needed = offset_ + overflow_size_;
+    size_ = std::max(needed, 2 * size_);
+    delete[] block_;
+    block_ = new uint8_t[size_];
+    overflow_size_ = 0;
+  }
+  offset_ = 0;
+}
+
+}  // fpl
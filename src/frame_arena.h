@@ -0,0 +1,118 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+namespace fpl {
+
+// Linear allocator for data that only lives until the end of a frame.
+// Allocate() bumps a pointer, and Reset() frees everything at once.
+//
+// When a frame needs more than the arena holds, the extra memory comes from
+// the heap, and the next Reset() grows the arena to fit it all. So after the
+// first few frames, the arena is big enough and frames make no heap
+// allocations.
+class FrameArena {
+ public:
+  static const size_t kDefaultAlignment = 16;
+
+  explicit FrameArena(size_t size);
+  ~FrameArena();
+
+  // Return 'size' bytes aligned to 'alignment', which must be a power of two.
+  // The memory is valid until the next Reset().
+  void* Allocate(size_t size, size_t alignment = kDefaultAlignment);
+
+  // Free all allocations. Grows the arena if the last frame overflowed it.
+  void Reset();
+
+  // Bytes allocated since the last Reset(), including any overflow.
+  size_t used() const { return offset_ + overflow_size_; }
+
+  // Bytes that can be allocated without touching the heap.
+  size_t capacity() const { return size_; }
+
+ private:
+  // Disallow copies. The memory is owned.
+  FrameArena(const FrameArena&);
+  FrameArena& operator=(const FrameArena&);
+
+  uint8_t* block_;
+  size_t size_;
+  size_t offset_;
+
+  // Heap allocations made when block_ was full, and their total size.
+  std::vector<uint8_t*> overflow_;
+  size_t overflow_size_;
+};
+
+
+// std::allocator replacement that allocates from a FrameArena. Deallocation
+// does nothing; the memory is reclaimed by FrameArena::Reset(). Lets the
+// standard containers be used for per-frame scratch data.
+template<class T>
+class ArenaAllocator {
+ public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+  template<class U> struct rebind { typedef ArenaAllocator<U> other; };
+
+  explicit ArenaAllocator(FrameArena* arena) : arena_(arena) {}
+  template<class U>
+  ArenaAllocator(const ArenaAllocator<U>& rhs) : arena_(rhs.arena()) {}
+
+  T* allocate(size_t count) {
+    return static_cast<T*>(arena_->Allocate(count * sizeof(T)));
+  }
+  void deallocate(T* /*p*/, size_t /*count*/) {}
+
+  size_t max_size() const { return static_cast<size_t>(-1) / sizeof(T); }
+  void construct(T* p, const T& value) { new(p) T(value); }
+  void destroy(T* p) { p->~T(); }
+
+  FrameArena* arena() const { return arena_; }
+
+  template<class U>
+  bool operator==(const ArenaAllocator<U>& rhs) const {
+    return arena_ == rhs.arena();
+  }
+  template<class U>
+  bool operator!=(const ArenaAllocator<U>& rhs) const {
+    return arena_ != rhs.arena();
+  }
+
+ private:
+  FrameArena* arena_;
+};
+
+// A std::vector whose memory comes from a FrameArena. Construct with an
+// ArenaAllocator, for example,
+//   ArenaVector<int> indices((ArenaAllocator<int>(&arena)));
+template<class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+}  // fpl
+
+#endif  // FRAME_ARENA_H
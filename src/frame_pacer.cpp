@@ -0,0 +1,107 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "frame_pacer.h"
+
+#include <cmath>
+#include <cstdlib>
+
+namespace fpl {
+
+// Refresh rates are often reported a little off, such as 59Hz for 59.94Hz.
+static const int kRefreshRateTolerance = 2;
+
+const int FramePacer::kNumSamples;
+
+FramePacer::FramePacer()
+    : period_(0.0), swap_interval_(0), last_frame_start_(0.0),
+      next_deadline_(0.0), started_(false), num_samples_(0), next_sample_(0),
+      missed_frames_(0) {}
+
+void FramePacer::Initialize(int target_hz, int refresh_hz,
+                            double min_frame_time) {
+  if (target_hz <= 0) target_hz = refresh_hz;
+  period_ = target_hz > 0 ? 1.0 / target_hz : min_frame_time;
+  if (refresh_hz <= 0 && period_ < min_frame_time) period_ = min_frame_time;
+
+  // Let vsync pace the frames if the target is a whole number of refreshes.
+  swap_interval_ = 0;
+  if (target_hz > 0 && refresh_hz > 0) {
+    const int intervals = (refresh_hz + target_hz / 2) / target_hz;
+    if (intervals > 0 &&
+        std::abs(refresh_hz - intervals * target_hz) <=
+            kRefreshRateTolerance) {
+      swap_interval_ = intervals;
+    }
+  }
+
+  started_ = false;
+  num_samples_ = 0;
+  next_sample_ = 0;
+  missed_frames_ = 0;
+}
+
+double FramePacer::TimeToWait(double now) const {
+  if (!started_) return 0.0;
+  // With vsync, the swap blocks until it is time. Only stop the frames from
+  // running far ahead if it doesn't.
+  const double deadline = swap_interval_ > 0 ?
+                          last_frame_start_ + period_ * 0.5 : next_deadline_;
+  return deadline > now ? deadline - now : 0.0;
+}
+
+void FramePacer::BeginFrame(double now) {
+  if (started_) {
+    const double frame_time = now - last_frame_start_;
+    samples_[next_sample_] = frame_time;
+    next_sample_ = (next_sample_ + 1) % kNumSamples;
+    if (num_samples_ < kNumSamples) num_samples_++;
+    if (frame_time > period_ * 1.5) missed_frames_++;
+  }
+
+  // Keep to the schedule, unless a frame was so late that catching up would
+  // mean frames with no wait between them.
+  next_deadline_ = started_ && next_deadline_ + period_ > now ?
+                   next_deadline_ + period_ : now + period_;
+  last_frame_start_ = now;
+  started_ = true;
+}
+
+double FramePacer::LastFrameTime() const {
+  if (num_samples_ == 0) return 0.0;
+  return samples_[(next_sample_ + kNumSamples - 1) % kNumSamples];
+}
+
+double FramePacer::MeanFrameTime() const {
+  if (num_samples_ == 0) return 0.0;
+  double sum = 0.0;
+  for (int i = 0; i < num_samples_; ++i) {
+    sum += samples_[i];
+  }
+  return sum / num_samples_;
+}
+
+double FramePacer::FrameTimeDeviation() const {
+  if (num_samples_ == 0) return 0.0;
+  const double mean = MeanFrameTime();
+  double sum_squares = 0.0;
+  for (int i = 0; i < num_samples_; ++i) {
+    const double difference = samples_[i] - mean;
+    sum_squares += difference * difference;
+  }
+  return std::sqrt(sum_squares / num_samples_);
+}
+
+}  // fpl
@@ -0,0 +1,92 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+namespace fpl {
+
+// Decides when each frame should start, so that frames are evenly spaced at
+// a target rate, such as 30, 60, 90 or 120Hz.
+//
+// When the target divides the display's refresh rate, the frames are paced
+// by vsync: the renderer should use swap_interval(), and TimeToWait() only
+// guards against drivers that ignore it. Otherwise the pacer paces the
+// frames itself, against a deadline that advances by one period a frame, so
+// that late frames don't push back the ones after them.
+//
+// Times are in seconds, from any fixed origin.
+class FramePacer {
+ public:
+  // Number of frame times kept for the statistics.
+  static const int kNumSamples = 120;
+
+  FramePacer();
+
+  // Aim for 'target_hz' frames per second on a display that refreshes at
+  // 'refresh_hz'. A zero target means the refresh rate. A zero refresh rate
+  // means it isn't known, in which case frames are at least
+  // 'min_frame_time' apart, and a zero target means no faster than that.
+  void Initialize(int target_hz, int refresh_hz, double min_frame_time);
+
+  // Number of display refreshes per frame, or 0 if the pacer paces the
+  // frames itself. Call set_swap_interval(0) if the renderer can't set it.
+  int swap_interval() const { return swap_interval_; }
+  void set_swap_interval(int swap_interval) { swap_interval_ = swap_interval; }
+
+  // Seconds to wait at 'now' before starting the next frame.
+  double TimeToWait(double now) const;
+
+  // Call at the start of every frame, once TimeToWait() has passed.
+  void BeginFrame(double now);
+
+  // Forget the last frame, so the next BeginFrame() starts a new schedule
+  // and doesn't count the time since as a frame. For frames that were
+  // deliberately held back. The statistics are kept.
+  void Restart() { started_ = false; }
+
+  // Seconds between frames that the pacer aims for.
+  double period() const { return period_; }
+
+  // Mean and standard deviation of the last kNumSamples frame times, in
+  // seconds.
+  double MeanFrameTime() const;
+  double FrameTimeDeviation() const;
+
+  // Time the last frame took, in seconds, or 0 before the second frame.
+  double LastFrameTime() const;
+
+  // Frames since Initialize() that took more than one and a half periods.
+  int missed_frames() const { return missed_frames_; }
+
+ private:
+  double period_;
+  int swap_interval_;
+
+  // When the last frame started, and when the next one should.
+  double last_frame_start_;
+  double next_deadline_;
+  bool started_;
+
+  // Ring buffer of frame times.
+  double samples_[kNumSamples];
+  int num_samples_;
+  int next_sample_;
+  int missed_frames_;
+};
+
+}  // fpl
+
+#endif  // FRAME_PACER_H
@@ -0,0 +1,203 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "precompiled.h"
+#include "frame_profiler.h"
+
+#include <atomic>
+#include <mutex>
+
+namespace fpl {
+
+// A timed scope, or, when 'counter' is set, a counter whose value is kept in
+// 'end'.
+struct FrameEvent {
+  const char *name;
+  SDL_threadID thread;
+  uint64_t start;
+  uint64_t end;
+  bool counter;
+};
+
+struct ThreadName {
+  SDL_threadID thread;
+  const char *name;
+};
+
+struct FrameProfilerState {
+  FrameProfilerState()
+      : enabled(false), start_counter(SDL_GetPerformanceCounter()),
+        events(kMaxFrameProfilerEvents), num_events(0),
+        frame_starts(kMaxFrameProfilerFrames), num_frames(0) {}
+
+  std::atomic<bool> enabled;
+  uint64_t start_counter;
+
+  // Guards everything below, which every thread appends to.
+  std::mutex mutex;
+
+  // Rings of events and of frame start times. The counts are totals since
+  // the last reset, so the oldest entry still held is count - ring size.
+  std::vector<FrameEvent> events;
+  uint64_t num_events;
+  std::vector<uint64_t> frame_starts;
+  uint64_t num_frames;
+
+  std::vector<ThreadName> thread_names;
+};
+
+static FrameProfilerState &State() {
+  static FrameProfilerState state;
+  return state;
+}
+
+void EnableFrameProfiler(bool enable) {
+  State().enabled = enable;
+}
+
+bool FrameProfilerEnabled() {
+  return State().enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t FrameProfilerTime() {
+  const uint64_t ticks = SDL_GetPerformanceCounter() - State().start_counter;
+  return static_cast<uint64_t>(static_cast<double>(ticks) * 1000000.0 /
+      static_cast<double>(SDL_GetPerformanceFrequency()));
+}
+
+void RecordFrameEvent(const char *name, uint64_t start, uint64_t end) {
+  FrameProfilerState &state = State();
+  const FrameEvent event = { name, SDL_ThreadID(), start, end, false };
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (!state.enabled) return;
+  state.events[state.num_events % kMaxFrameProfilerEvents] = event;
+  state.num_events++;
+}
+
+void RecordFrameCounter(const char *name, int64_t value) {
+  FrameProfilerState &state = State();
+  const uint64_t now = FrameProfilerTime();
+  const FrameEvent event = {
+    name, SDL_ThreadID(), now, static_cast<uint64_t>(value), true
+  };
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (!state.enabled) return;
+  state.events[state.num_events % kMaxFrameProfilerEvents] = event;
+  state.num_events++;
+}
+
+void NameFrameProfilerThread(const char *name) {
+  FrameProfilerState &state = State();
+  const SDL_threadID thread = SDL_ThreadID();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  for (size_t i = 0; i < state.thread_names.size(); ++i) {
+    if (state.thread_names[i].thread == thread) return;
+  }
+  const ThreadName thread_name = { thread, name };
+  state.thread_names.push_back(thread_name);
+}
+
+void BeginProfiledFrame() {
+  if (!FrameProfilerEnabled()) return;
+  FrameProfilerState &state = State();
+  const uint64_t now = FrameProfilerTime();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (state.num_frames > 0) {
+    const uint64_t start =
+        state.frame_starts[(state.num_frames - 1) % kMaxFrameProfilerFrames];
+    const FrameEvent event = { "Frame", SDL_ThreadID(), start, now, false };
+    state.events[state.num_events % kMaxFrameProfilerEvents] = event;
+    state.num_events++;
+  }
+  state.frame_starts[state.num_frames % kMaxFrameProfilerFrames] = now;
+  state.num_frames++;
+}
+
+bool WriteFrameTrace(const char *filename, int num_frames) {
+  FrameProfilerState &state = State();
+  std::lock_guard<std::mutex> lock(state.mutex);
+
+  // The frame in progress is incomplete, so it isn't written. The oldest
+  // frame start may be overwritten by the next one, so leave it too.
+  const uint64_t complete = state.num_frames > 0 ? state.num_frames - 1 : 0;
+  const uint64_t max_frames = std::min<uint64_t>(
+      complete, kMaxFrameProfilerFrames - 1);
+  const uint64_t frames = std::min<uint64_t>(
+      max_frames, static_cast<uint64_t>(std::max(num_frames, 0)));
+  if (frames == 0) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "No frames to write to %s",
+                 filename);
+    return false;
+  }
+  const uint64_t first_frame = state.num_frames - 1 - frames;
+  const uint64_t since =
+      state.frame_starts[first_frame % kMaxFrameProfilerFrames];
+  const uint64_t until =
+      state.frame_starts[(state.num_frames - 1) % kMaxFrameProfilerFrames];
+
+  FILE *file = fopen(filename, "w");
+  if (!file) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Can't write %s", filename);
+    return false;
+  }
+  // Thread names as metadata ("M") events, then complete ("X") and counter
+  // ("C") events.
+  fprintf(file, "{\"traceEvents\":[\n");
+  for (size_t i = 0; i < state.thread_names.size(); ++i) {
+    const ThreadName &thread_name = state.thread_names[i];
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"tid\":%lu,\"args\":{\"name\":\"%s\"}},\n",
+            static_cast<unsigned long>(thread_name.thread), thread_name.name);
+  }
+  const uint64_t oldest = state.num_events > kMaxFrameProfilerEvents ?
+      state.num_events - kMaxFrameProfilerEvents : 0;
+  int written = 0;
+  for (uint64_t i = oldest; i < state.num_events; ++i) {
+    const FrameEvent &event = state.events[i % kMaxFrameProfilerEvents];
+    const uint64_t end = event.counter ? event.start : event.end;
+    if (event.start < since || end > until) continue;
+    if (event.counter) {
+      fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,"
+              "\"ts\":%llu,\"args\":{\"value\":%lld}}",
+              written > 0 ? ",\n" : "", event.name,
+              static_cast<unsigned long long>(event.start),
+              static_cast<long long>(static_cast<int64_t>(event.end)));
+    } else {
+      fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"X\","
+              "\"pid\":1,\"tid\":%lu,\"ts\":%llu,\"dur\":%llu}",
+              written > 0 ? ",\n" : "", event.name,
+              static_cast<unsigned long>(event.thread),
+              static_cast<unsigned long long>(event.start),
+              static_cast<unsigned long long>(event.end - event.start));
+    }
+    written++;
+  }
+  fprintf(file, "\n]}\n");
+  const bool ok = ferror(file) == 0;
+  fclose(file);
+  SDL_Log("frame profiler: %d frames written to %s",
+          static_cast<int>(frames), filename);
+  return ok;
+}
+
+void ResetFrameProfiler() {
+  FrameProfilerState &state = State();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.enabled = false;
+  state.num_events = 0;
+  state.num_frames = 0;
+}
+
+}  // fpl
@@ -0,0 +1,122 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef FPL_FRAME_PROFILER_H
+#define FPL_FRAME_PROFILER_H
+
+#include <cstdint>
+
+namespace fpl {
+
+// Records how long each phase of every frame takes on the CPU, on every
+// thread, and writes the last few frames as a Chrome trace. Open the file in
+// chrome://tracing or ui.perfetto.dev to see where a slow frame went. Phases
+// that run inside other phases show up nested under them.
+//
+// Events go into a fixed ring, so recording never allocates, and old frames
+// are overwritten. While disabled, a scope costs one relaxed atomic load.
+// Any thread may record.
+
+// Most events, and most frames, that the ring holds.
+static const int kMaxFrameProfilerEvents = 16384;
+static const int kMaxFrameProfilerFrames = 256;
+
+// Start or stop recording. Stopping keeps the frames already recorded.
+void EnableFrameProfiler(bool enable);
+
+// True while recording.
+bool FrameProfilerEnabled();
+
+// Microseconds since the profiler was first used.
+uint64_t FrameProfilerTime();
+
+// Record that 'name' ran on this thread from 'start' to 'end', as returned
+// by FrameProfilerTime(). 'name' must be a string literal.
+void RecordFrameEvent(const char *name, uint64_t start, uint64_t end);
+
+// Record that counter 'name' had 'value' at this point in the frame. Counters
+// are drawn as graphs above the threads. 'name' must be a string literal.
+void RecordFrameCounter(const char *name, int64_t value);
+
+// Label the calling thread in the trace. 'name' must be a string literal.
+// Naming a thread again does nothing.
+void NameFrameProfilerThread(const char *name);
+
+// End the current frame, recording it as one event, and start the next.
+// Called once per frame by the main loop.
+void BeginProfiledFrame();
+
+// Write the last 'num_frames' complete frames to 'filename'. Returns false
+// if the file can't be written. Recording carries on.
+bool WriteFrameTrace(const char *filename, int num_frames);
+
+// Discard everything recorded, and stop recording.
+void ResetFrameProfiler();
+
+// Records the lifetime of the scope as one event. Scopes that start while
+// the profiler is disabled record nothing.
+class FrameProfileScope {
+ public:
+  explicit FrameProfileScope(const char *name)
+      : name_(name), recording_(FrameProfilerEnabled()),
+        start_(recording_ ? FrameProfilerTime() : 0) {}
+  ~FrameProfileScope() {
+    if (recording_) RecordFrameEvent(name_, start_, FrameProfilerTime());
+  }
+
+ private:
+  const char *name_;
+  bool recording_;
+  uint64_t start_;
+};
+
+// Records consecutive phases of one function without a scope per phase.
+// Each Next() ends the current phase and starts another; the last phase ends
+// with the object.
+class FrameProfilePhases {
+ public:
+  explicit FrameProfilePhases(const char *name)
+      : name_(name), recording_(FrameProfilerEnabled()),
+        start_(recording_ ? FrameProfilerTime() : 0) {}
+  ~FrameProfilePhases() { Next(nullptr); }
+
+  void Next(const char *name) {
+    const bool was_recording = recording_;
+    recording_ = name != nullptr && FrameProfilerEnabled();
+    if (was_recording || recording_) {
+      const uint64_t now = FrameProfilerTime();
+      if (was_recording) RecordFrameEvent(name_, start_, now);
+      start_ = now;
+    }
+    name_ = name;
+  }
+
+ private:
+  const char *name_;
+  bool recording_;
+  uint64_t start_;
+};
+
+#define FPL_FRAME_PROFILE_CONCAT2(a, b) a##b
+#define FPL_FRAME_PROFILE_CONCAT(a, b) FPL_FRAME_PROFILE_CONCAT2(a, b)
+
+// Time the rest of the enclosing scope as 'name', a string literal.
+#define FPL_FRAME_PROFILE_SCOPE(name) \
+    ::fpl::FrameProfileScope FPL_FRAME_PROFILE_CONCAT( \
+        frame_profile_scope_, __LINE__)(name)
+
+}  // fpl
+
+#endif  // FPL_FRAME_PROFILER_H
@@ -0,0 +1,81 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include "mathfu/matrix.h"
+#include "mathfu/vector.h"
+#include "mathfu/glsl_mappings.h"
+
+namespace fpl {
+
+// The six planes of a view frustum, for culling objects that can't be seen.
+class Frustum {
+ public:
+  enum Plane {
+    kLeft,
+    kRight,
+    kBottom,
+    kTop,
+    kNear,
+    kFar,
+    kNumPlanes
+  };
+
+  Frustum() {}
+  explicit Frustum(const mathfu::mat4 &view_projection) {
+    Set(view_projection);
+  }
+
+  // Extract the planes from a matrix that maps world space to clip space,
+  // such as mat4::Perspective() * camera. Points inside the frustum have
+  // clip coordinates between -w and w, so each plane is the fourth row of
+  // the matrix plus or minus one of the others.
+  void Set(const mathfu::mat4 &m) {
+    for (int i = 0; i < 3; ++i) {
+      for (int col = 0; col < 4; ++col) {
+        planes_[2 * i][col] = m(3, col) + m(i, col);
+        planes_[2 * i + 1][col] = m(3, col) - m(i, col);
+      }
+    }
+    // Scale the planes so their normals are unit length, and the distances
+    // to them are in world units.
+    for (int i = 0; i < kNumPlanes; ++i) {
+      planes_[i] /= planes_[i].xyz().Length();
+    }
+  }
+
+  // True if any of the sphere is inside the frustum. Spheres near the
+  // corners may be reported visible when they aren't, which is harmless.
+  bool IntersectsSphere(const mathfu::vec3 &center, float radius) const {
+    for (int i = 0; i < kNumPlanes; ++i) {
+      if (mathfu::vec3::DotProduct(planes_[i].xyz(), center) +
+          planes_[i].w() < -radius)
+        return false;
+    }
+    return true;
+  }
+
+  // Plane 'i' as (normal, distance), with the normal facing inwards.
+  const mathfu::vec4 &plane(Plane i) const { return planes_[i]; }
+
+ private:
+  mathfu::vec4 planes_[kNumPlanes];
+};
+
+}  // fpl
+
+#endif  // FRUSTUM_H
@@ -62,7 +62,7 @@ bool FullScreenFader::Render(const WorldTime& time) {
   material_->Set(*renderer_);
   shader_->Set(*renderer_);
   Mesh::RenderAAQuadAlongX(
-      vec3(0.0f, static_cast<float>(extents_.y()), 0.0f),
+      *renderer_, vec3(0.0f, static_cast<float>(extents_.y()), 0.0f),
       vec3(static_cast<float>(extents_.x()), 0.0f, 0.0f),
       vec2(0.0f, 1.0f), vec2(1.0f, 0.0f));
   return opaque;
@@ -31,23 +31,20 @@ namespace fpl {
 namespace pie_noon {
 
 vec3 GameCamera::Position() const {
-  return percent_.Valid() ?
-         vec3::Lerp(start_.position, end_.position, percent_.Value()) :
-         start_.position;
+  return position_.Valid() ? position_.Value() : end_.position;
 }
 
 vec3 GameCamera::Target() const {
-  return percent_.Valid() ?
-         vec3::Lerp(start_.target, end_.target, percent_.Value()) :
-         start_.target;
+  return target_.Valid() ? target_.Value() : end_.target;
 }
 
 void GameCamera::Initialize(const GameCameraState& state,
                             impel::ImpelEngine* engine) {
   engine_ = engine;
-  start_ = state;
-  end_ = state;
-  percent_.Invalidate();
+  const impel::SmoothImpelInit3f init;
+  position_.Initialize(init, engine_);
+  target_.Initialize(init, engine_);
+  SetState(state);
   movements_ = std::queue<GameCameraMovement>();
   AdvanceFrame(0);
 }
@@ -59,53 +56,61 @@ void GameCamera::AdvanceFrame(WorldTime /*delta_time*/) {
   side_ = vec3::CrossProduct(mathfu::kAxisY3f, forward_);
 
   // If the camera has finished zooming in, transition to zoom out.
-  // Transition to next movement that's been queued.
-  if (!movements_.empty() && (!percent_.Valid() || percent_.Value() == 1.0f)) {
+  // Transition to next movement that's been queued. The smooth Impellers
+  // snap exactly onto their targets when their movement completes.
+  if (!movements_.empty() && current == end_) {
     ExecuteMovement(movements_.front());
     movements_.pop();
   }
 }
 
 void GameCamera::ExecuteMovement(const GameCameraMovement& movement) {
-  // We interpolate between start_ and end_, so start_ should be the current
-  // values.
-  start_ = CurrentState();
+  // We interpolate from the current values to movement.end. The start
+  // velocity is a fraction of the distance travelled, per unit time.
+  const GameCameraState start = CurrentState();
   end_ = movement.end;
 
-  // Initialize the Impeller.
-  percent_.Initialize(movement.init, engine_);
-  percent_.SetValue(0.0f);
-  percent_.SetVelocity(movement.start_velocity);
-  percent_.SetTargetValue(1.0f);
-  percent_.SetTargetTime(movement.time);
+  // Initialize the Impellers.
+  const impel::SmoothImpelInit3f init(movement.init);
+  position_.Initialize(init, engine_);
+  position_.SetValue(start.position);
+  position_.SetVelocity(movement.start_velocity *
+                        (end_.position - start.position));
+  position_.SetTargetValue(end_.position);
+  position_.SetTargetTime(movement.time);
+
+  target_.Initialize(init, engine_);
+  target_.SetValue(start.target);
+  target_.SetVelocity(movement.start_velocity * (end_.target - start.target));
+  target_.SetTargetValue(end_.target);
+  target_.SetTargetTime(movement.time);
 }
 
-void GameCamera::TerminateMovements() {
-  GameCameraState state = CurrentState();
-  start_ = state;
+void GameCamera::SetState(const GameCameraState& state) {
   end_ = state;
-  if (percent_.Valid()) {
-    percent_.SetValue(1.0f);
-    percent_.SetTargetValue(1.0f);
-    percent_.SetVelocity(0.0f);
-  }
+  position_.SetValue(state.position);
+  position_.SetVelocity(mathfu::kZeros3f);
+  position_.SetTargetValue(state.position);
+  target_.SetValue(state.target);
+  target_.SetVelocity(mathfu::kZeros3f);
+  target_.SetTargetValue(state.target);
+}
+
+void GameCamera::TerminateMovements() {
+  SetState(CurrentState());
   movements_ = std::queue<GameCameraMovement>();
 }
 
-// Used for debugging. Haults animation and sets the camera position.
 void GameCamera::OverridePosition(const vec3& position) {
   TerminateMovements();
-  GameCameraState current = CurrentState();
+  const GameCameraState current = CurrentState();
   const vec3 delta = position - current.position;
-  start_ = GameCameraState(position, current.target + delta);
-  end_ = start_;
+  SetState(GameCameraState(position, current.target + delta));
 }
 
-// Used for debugging. Haults animation and sets the camera target.
 void GameCamera::OverrideTarget(const vec3& target) {
   TerminateMovements();
-  start_.target = target;
-  end_.target = target;
+  SetState(GameCameraState(CurrentState().position, target));
 }
 
 } // pie_noon
@@ -45,12 +45,23 @@ struct GameCameraState {
 // Defines a camera movement. These can be queued up in the GameCamera.
 struct GameCameraMovement {
   GameCameraState end;
+
+  // Initial speed, as a fraction of the distance to 'end' per unit time.
   float start_velocity;
   float time;
   impel::SmoothImpelInit init;
 };
 
 
+// The parts of a GameCamera that are not in its Impellers, which are saved
+// with the ImpelEngine.
+struct GameCameraSnapshot {
+  GameCameraState end;
+  mathfu::vec3 forward;
+  mathfu::vec3 side;
+  std::queue<GameCameraMovement> movements;
+};
+
 // Class that encapsilates camera motion.
 class GameCamera {
  public:
@@ -101,19 +112,35 @@ class GameCamera {
   // Distance of the camera from its target.
   float Dist() const { return (Target() - Position()).Length(); }
 
+  // Save or restore the camera, for rolling back a networked match.
+  void Snapshot(GameCameraSnapshot* snapshot) const {
+    snapshot->end = end_;
+    snapshot->forward = forward_;
+    snapshot->side = side_;
+    snapshot->movements = movements_;
+  }
+  void Restore(const GameCameraSnapshot& snapshot) {
+    end_ = snapshot.end;
+    forward_ = snapshot.forward;
+    side_ = snapshot.side;
+    movements_ = snapshot.movements;
+  }
+
  private:
   void ExecuteMovement(const GameCameraMovement& movement);
 
-  // Engine that runs the percent_ Impeller.
-  impel::ImpelEngine* engine_;
+  // Stop the Impellers at 'state'.
+  void SetState(const GameCameraState& state);
 
-  // Percent we have moved from start_ to end_. Animated with a smooth Impeller.
-  impel::Impeller1f percent_;
+  // Engine that runs the position_ and target_ Impellers.
+  impel::ImpelEngine* engine_;
 
-  // The start of the current camera movement. We animate from start_ to end_.
-  GameCameraState start_;
+  // The camera position and target. Animated with smooth 3D Impellers, so
+  // each is updated, and read, as a single vector.
+  impel::Impeller3f position_;
+  impel::Impeller3f target_;
 
-  // The end of the current camera movement. We animate from start_ to end_.
+  // The end of the current camera movement.
   GameCameraState end_;
 
   // The direction the camera is facing.
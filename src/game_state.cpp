@@ -20,11 +20,13 @@
 #include "common.h"
 #include "config_generated.h"
 #include "controller.h"
+#include "frame_profiler.h"
 #include "game_state.h"
 #include "impel_flatbuffers.h"
 #include "impel_processor_overshoot.h"
 #include "impel_processor_smooth.h"
 #include "impel_util.h"
+#include "job_system.h"
 #include "scene_description.h"
 #include "pie_noon_common_generated.h"
 #include "timeline_generated.h"
@@ -53,10 +55,45 @@ struct ReceivedPie {
 };
 
 struct EventData {
-  std::vector<ReceivedPie> received_pies;
+  explicit EventData(FrameArena* arena)
+      : received_pies(ArenaAllocator<ReceivedPie>(arena)),
+        pie_damage(0) {
+  }
+  ArenaVector<ReceivedPie> received_pies;
   CharacterHealth pie_damage;
 };
 
+// Bytes of per-frame scratch memory. Grows if it's ever not enough.
+static const size_t kFrameArenaSize = 16 * 1024;
+
+// Read the ranges of 'def' once, for spawning particles from.
+static ParticleSpawnDef DecodeParticleDef(const ParticleDef* def) {
+  ParticleSpawnDef spawn_def;
+  spawn_def.min_scale = LoadVec3(def->min_scale());
+  spawn_def.max_scale = LoadVec3(def->max_scale());
+  spawn_def.preserve_aspect = def->preserve_aspect() != 0;
+  spawn_def.min_velocity = LoadVec3(def->min_velocity());
+  spawn_def.max_velocity = LoadVec3(def->max_velocity());
+  spawn_def.acceleration = LoadVec3(def->acceleration());
+  spawn_def.min_position_offset = LoadVec3(def->min_position_offset());
+  spawn_def.max_position_offset = LoadVec3(def->max_position_offset());
+  spawn_def.min_orientation_offset = LoadVec3(def->min_orientation_offset());
+  spawn_def.max_orientation_offset = LoadVec3(def->max_orientation_offset());
+  spawn_def.min_angular_velocity = LoadVec3(def->min_angular_velocity());
+  spawn_def.max_angular_velocity = LoadVec3(def->max_angular_velocity());
+  spawn_def.min_duration = def->min_duration();
+  spawn_def.max_duration = def->max_duration();
+  spawn_def.fade_duration = static_cast<TimeStep>(def->fade_duration());
+  spawn_def.shrink_duration = static_cast<TimeStep>(def->shrink_duration());
+  spawn_def.renderable_ids.assign(def->renderable()->begin(),
+                                  def->renderable()->end());
+  spawn_def.tints.clear();
+  for (auto it = def->tint()->begin(); it != def->tint()->end(); ++it) {
+    spawn_def.tints.push_back(LoadVec4(*it));
+  }
+  return spawn_def;
+}
+
 // Look up a value in a vector based upon pie damage.
 template<typename T>
 static T EnumerationValueForPieDamage(
@@ -73,7 +110,12 @@ GameState::GameState()
       characters_(),
       pies_(),
       config_(),
-      arrangement_() {
+      runtime_config_(),
+      gpu_particles_reset_(false),
+      static_scene_version_(1),
+      frame_arena_(kFrameArenaSize),
+      impel_memory_(kMemoryImpel),
+      arena_memory_(kMemoryScene) {
 }
 
 GameState::~GameState() {
@@ -86,18 +128,14 @@ GameState::~GameState() {
 
 // Calculate the direction a character is facing at the start of the game.
 // We want the characters to face their initial target.
-static Angle InitialFaceAngle(const CharacterArrangement* arrangement,
+static Angle InitialFaceAngle(const std::vector<CharacterSlot>& slots,
                               const CharacterId id,
                               const CharacterId target_id) {
-  const vec3 characterPosition =
-      LoadVec3(arrangement->character_data()->Get(id)->position());
-  const vec3 targetPosition =
-      LoadVec3(arrangement->character_data()->Get(target_id)->position());
-  return Angle::FromXZVector(targetPosition - characterPosition);
+  return Angle::FromXZVector(slots[target_id].position - slots[id].position);
 }
 
 // Find the character arrangement that has room for enough characters with the
-// least wasted space.
+// least wasted space. Returns nullptr if none of them has room.
 static const CharacterArrangement* GetBestArrangement(const Config* config,
                                                       unsigned int count) {
   unsigned int num_arrangements = config->character_arrangements()->Length();
@@ -112,10 +150,70 @@ static const CharacterArrangement* GetBestArrangement(const Config* config,
       best_character_slots = character_slots;
     }
   }
-  assert(best_arrangement);
   return best_arrangement;
 }
 
+// Spread 'count' characters along the config's arena layout, in id order.
+// Return how much the camera should be pulled back to fit them all in.
+static float ArrangeArena(const Config& config, const vec3& camera_position,
+                          const vec3& camera_target, int count,
+                          std::vector<CharacterSlot>* slots) {
+  const ArenaLayout* layout = config.arena_layout();
+  assert(layout);
+  const float arc = layout->arc() * kDegreesToRadians;
+  const vec2 base_radius = LoadVec2(layout->radius());
+  const float min_radius = std::min(base_radius.x(), base_radius.y());
+  const float scale = std::max(
+      1.0f, count * layout->min_spacing() / (arc * min_radius));
+  const vec2 radius = base_radius * scale;
+
+  // The arc opens towards the camera.
+  vec3 forward = camera_target - camera_position;
+  forward.y() = 0.0f;
+  forward.Normalize();
+  const vec3 left(forward.z(), 0.0f, -forward.x());
+  const vec3 center = LoadVec3(layout->center());
+  const float step = arc / count;
+  slots->resize(count);
+  for (int i = 0; i < count; ++i) {
+    const float angle = (i + 0.5f) * step - 0.5f * arc;
+    (*slots)[i].position = center + left * (radius.x() * std::sin(angle)) +
+                           forward * (radius.y() * std::cos(angle));
+  }
+
+  // Left turns the target towards the camera's left, the way the hand-made
+  // arrangements are set up.
+  for (int i = 0; i < count; ++i) {
+    const vec3& next = (*slots)[(i + 1) % count].position;
+    const vec3& previous = (*slots)[(i + count - 1) % count].position;
+    (*slots)[i].left_jump =
+        vec3::DotProduct(next - previous, left) >= 0.0f ? 1 : -1;
+  }
+  return scale;
+}
+
+// Fill 'slots' from the best arrangement in the config, or from its arena
+// layout when none of them has room. Return the camera pull back, as in
+// ArrangeArena().
+static float ArrangeCharacters(const Config& config,
+                               const vec3& camera_position,
+                               const vec3& camera_target, int count,
+                               std::vector<CharacterSlot>* slots) {
+  const CharacterArrangement* arrangement =
+      GetBestArrangement(&config, static_cast<unsigned int>(count));
+  if (arrangement == nullptr) {
+    return ArrangeArena(config, camera_position, camera_target, count, slots);
+  }
+
+  slots->resize(count);
+  for (int i = 0; i < count; ++i) {
+    const CharacterData* data = arrangement->character_data()->Get(i);
+    (*slots)[i].position = LoadVec3(data->position());
+    (*slots)[i].left_jump = data->left_jump();
+  }
+  return 1.0f;
+}
+
 // Given some amount of damage happening at a
 void GameState::ShakeProps(float damage_percent, const vec3& damage_position) {
   for (size_t i = 0; i < config_->props()->Length(); ++i) {
@@ -145,11 +243,23 @@ void GameState::ShakeProps(float damage_percent, const vec3& damage_position) {
   }
 }
 
+// Read the current prop shake angles with one call to their processor.
+void GameState::GatherPropShake() {
+  if (prop_shake_ids_.empty())
+    return;
+  const impel::ImpelProcessor1f* processor =
+      static_cast<const impel::ImpelProcessor1f*>(
+          impel_engine_.Processor(impel::OvershootImpelInit::kType));
+  processor->Values(&prop_shake_ids_[0],
+                    static_cast<int>(prop_shake_ids_.size()),
+                    &prop_shake_values_[0]);
+}
+
 // Returns true if the game is over.
 bool GameState::IsGameOver() const {
-  switch (config_->game_mode()) {
+  switch (runtime_config_->game_mode()) {
     case GameMode_Survival: {
-      return pies_.size() == 0 &&
+      return pies_.Count() == 0 &&
           (NumActiveCharacters(true) == 0 || NumActiveCharacters(false) <= 1);
     }
     case GameMode_HighScore: {
@@ -169,44 +279,57 @@ bool GameState::IsGameOver() const {
   return false;
 }
 
+void GameState::set_config(const Config* config,
+                           const RuntimeConfig* runtime_config) {
+  config_ = config;
+  runtime_config_ = runtime_config;
+  pie_splatter_particles_ = DecodeParticleDef(config->pie_splatter_def());
+  joining_confetti_particles_ =
+      DecodeParticleDef(config->joining_confetti_def());
+  confetti_particles_ = DecodeParticleDef(config->confetti_def());
+
+  // The layouts point into the old config.
+  accessory_layouts_.clear();
+
+  // Scenes with the old props need rebuilding.
+  static_scene_version_++;
+}
+
 // Reset the game back to initial configuration.
 void GameState::Reset() {
   time_ = 0;
   camera_base_.position = LoadVec3(config_->camera_position());
   camera_base_.target = LoadVec3(config_->camera_target());
+  const float camera_pull_back = ArrangeCharacters(
+      *config_, camera_base_.position, camera_base_.target,
+      static_cast<int>(characters_.size()), &slots_);
+  camera_base_.position = camera_base_.target +
+      (camera_base_.position - camera_base_.target) * camera_pull_back;
   camera_.Initialize(camera_base_, &impel_engine_);
-  pies_.clear();
-  arrangement_ = GetBestArrangement(config_, characters_.size());
-
-  // Load the impeller specifications. Skip over "None".
-  impel::OvershootImpelInit impeller_inits[ImpellerSpecification_Count];
-  auto impeller_specifications = config_->impeller_specifications();
-  assert(impeller_specifications->Length() == ImpellerSpecification_Count);
-  for (int i = ImpellerSpecification_None + 1; i < ImpellerSpecification_Count;
-       ++i) {
-    auto specification = impeller_specifications->Get(i);
-    impel::OvershootInitFromFlatBuffers(*specification, &impeller_inits[i]);
-  }
+  prev_camera_state_ = camera_.CurrentState();
+  pies_.Clear();
+
+  // The prop shakes and the character face angles are all overshoot
+  // Impellers. Make room for them up front, so that the processor's arrays
+  // grow once instead of once per Impeller.
+  impel_engine_.Reserve(impel::OvershootImpelInit::kType,
+                        runtime_config_->num_shaking_props() +
+                        static_cast<int>(characters_.size()));
 
   // Initialize the prop shake Impellers.
   const int num_props = config_->props()->Length();
   prop_shake_.resize(num_props);
+  prop_shake_ids_.clear();
+  prop_shake_ids_.reserve(runtime_config_->num_shaking_props());
   for (int i = 0; i < num_props; ++i) {
-    const auto prop = config_->props()->Get(i);
-    const ImpellerSpecification impeller_spec = prop->shake_impeller();
-    if (impeller_spec == ImpellerSpecification_None)
+    if (!runtime_config_->prop_shakes(i))
       continue;
-
-    // Bigger props have a smaller shake scale. We want them to shake more
-    // slowly, and with less amplitude.
-    const float shake_scale = prop->shake_scale();
-    impel::OvershootImpelInit scaled_shake_init =
-        impeller_inits[impeller_spec];
-    scaled_shake_init.min *= shake_scale;
-    scaled_shake_init.max *= shake_scale;
-    scaled_shake_init.accel_per_difference *= shake_scale;
-    prop_shake_[i].Initialize(scaled_shake_init, &impel_engine_);
+    prop_shake_[i].Initialize(runtime_config_->prop_shake_init(i),
+                              &impel_engine_);
+    prop_shake_ids_.push_back(prop_shake_[i].Id());
   }
+  prop_shake_values_.resize(prop_shake_ids_.size());
+  GatherPropShake();
 
   // Reset characters to their initial state.
   const CharacterId num_ids = static_cast<CharacterId>(characters_.size());
@@ -217,11 +340,54 @@ void GameState::Reset() {
     characters_[id]->Reset(
         target_id,
         config_->character_health(),
-        InitialFaceAngle(arrangement_, id, target_id),
-        LoadVec3(arrangement_->character_data()->Get(id)->position()),
+        InitialFaceAngle(slots_, id, target_id),
+        slots_[id].position,
         &impel_engine_);
   }
   particle_manager_.RemoveAllParticles();
+  gpu_particle_spawns_.clear();
+  gpu_particles_reset_ = true;
+}
+
+void GameState::MoveGpuParticleSpawns(std::vector<GpuParticleSpawn>* spawns,
+                                      bool* reset) {
+  spawns->insert(spawns->end(), gpu_particle_spawns_.begin(),
+                 gpu_particle_spawns_.end());
+  gpu_particle_spawns_.clear();
+  *reset = gpu_particles_reset_;
+  gpu_particles_reset_ = false;
+}
+
+void GameState::Snapshot(GameStateSnapshot* snapshot) const {
+  snapshot->time = time_;
+  snapshot->countdown_timer = countdown_timer_;
+  camera_.Snapshot(&snapshot->camera);
+  snapshot->prev_camera_state = prev_camera_state_;
+  snapshot->characters.resize(characters_.size());
+  for (size_t i = 0; i < characters_.size(); ++i) {
+    characters_[i]->Snapshot(&snapshot->characters[i]);
+  }
+  snapshot->pies = pies_;
+  snapshot->prop_shake_values = prop_shake_values_;
+  snapshot->particle_manager = particle_manager_;
+  snapshot->rng = rng_;
+  impel_engine_.Snapshot(&snapshot->impel);
+}
+
+void GameState::Restore(const GameStateSnapshot& snapshot) {
+  assert(snapshot.characters.size() == characters_.size());
+  time_ = snapshot.time;
+  countdown_timer_ = snapshot.countdown_timer;
+  camera_.Restore(snapshot.camera);
+  prev_camera_state_ = snapshot.prev_camera_state;
+  for (size_t i = 0; i < characters_.size(); ++i) {
+    characters_[i]->Restore(snapshot.characters[i]);
+  }
+  pies_ = snapshot.pies;
+  prop_shake_values_ = snapshot.prop_shake_values;
+  particle_manager_ = snapshot.particle_manager;
+  rng_ = snapshot.rng;
+  impel_engine_.Restore(snapshot.impel);
 }
 
 // Sets up the players in joining mode, where all they can do is jump up
@@ -249,9 +415,11 @@ void GameState::ProcessSounds(AudioEngine* audio_engine,
 
   const WorldTime anim_time = GetAnimationTime(character);
   const auto sounds = timeline->sounds();
-  const int start_index = TimelineIndexAfterTime(sounds, 0, anim_time);
-  const int end_index = TimelineIndexAfterTime(sounds, start_index,
-                                               anim_time + delta_time);
+  int start_index;
+  int end_index;
+  character.timeline_cursor()->Sounds(timeline, anim_time,
+                                      anim_time + delta_time, &start_index,
+                                      &end_index);
   for (int i = start_index; i < end_index; ++i) {
     const TimelineSound& timeline_sound = *sounds->Get(i);
     character.PlaySound(timeline_sound.sound());
@@ -267,18 +435,18 @@ void GameState::CreatePie(CharacterId original_source_id,
                           CharacterHealth damage) {
   float height = config_->pie_arc_height();
   height += config_->pie_arc_height_variance() *
-            (mathfu::Random<float>() * 2 - 1);
+            rng_.FloatInRange(-1.0f, 1.0f);
   int rotations = config_->pie_rotations();
   int variance = config_->pie_rotation_variance();
-  rotations += variance ? (rand() % (variance * 2)) - variance : 0;
-  pies_.push_back(std::unique_ptr<AirbornePie>(
-      new AirbornePie(original_source_id, source_id, target_id, time_,
-                      config_->pie_flight_time(), damage, height, rotations)));
-  UpdatePiePosition(pies_.back().get());
+  rotations += rng_.IntInRange(-variance, variance);
+  const int pie = pies_.Add(original_source_id, source_id, target_id, time_,
+                            config_->pie_flight_time(), damage, height,
+                            rotations);
+  UpdatePiePosition(pie);
+  pies_.UpdatePreviousTransform(pie);
 }
 
-CharacterId GameState::DetermineDeflectionTarget(
-    const ReceivedPie& pie) const {
+CharacterId GameState::DetermineDeflectionTarget(const ReceivedPie& pie) {
   switch (config_->pie_deflection_mode()) {
     case PieDeflectionMode_ToTargetOfTarget: {
       return characters_[pie.target_id]->target();
@@ -287,7 +455,7 @@ CharacterId GameState::DetermineDeflectionTarget(
       return pie.source_id;
     }
     case PieDeflectionMode_ToRandom: {
-      return rand() % characters_.size();
+      return rng_.IntInRange(0, static_cast<int>(characters_.size()));
     }
     default: {
       assert(0);
@@ -324,7 +492,7 @@ void GameState::ProcessEvent(Character* character,
         const ReceivedPie& pie = event_data.received_pies[i];
         characters_[pie.source_id]->IncrementStat(kHits);
         total_damage += pie.damage;
-        if (config_->game_mode() == GameMode_Survival) {
+        if (runtime_config_->game_mode() == GameMode_Survival) {
           character->set_health(character->health() - pie.damage);
         }
         ApplyScoringRule(config_->scoring_rules(), ScoreEvent_HitByPie,
@@ -406,9 +574,11 @@ void GameState::ProcessEvents(Character* character,
 
   const WorldTime anim_time = GetAnimationTime(*character);
   const auto events = timeline->events();
-  const int start_index = TimelineIndexAfterTime(events, 0, anim_time);
-  const int end_index = TimelineIndexAfterTime(events, start_index,
-                                               anim_time + delta_time);
+  int start_index;
+  int end_index;
+  character->timeline_cursor()->Events(timeline, anim_time,
+                                       anim_time + delta_time, &start_index,
+                                       &end_index);
 
   for (int i = start_index; i < end_index; ++i) {
     const TimelineEvent* event = events->Get(i);
@@ -483,24 +653,35 @@ static vec3 CalculatePiePosition(const Character& source,
   return result;
 }
 
-void GameState::UpdatePiePosition(AirbornePie* pie) const {
-  const auto& source = characters_[pie->source()];
-  const auto& target = characters_[pie->target()];
+void GameState::UpdatePiePosition(int pie) {
+  const CharacterId source_id = pies_.source(pie);
+  const CharacterId target_id = pies_.target(pie);
+  const auto& source = characters_[source_id];
+  const auto& target = characters_[target_id];
 
   const float time_since_launch =
-      static_cast<float>(time_ - pie->start_time());
+      static_cast<float>(time_ - pies_.start_time(pie));
   float percent = time_since_launch / config_->pie_flight_time();
   percent = mathfu::Clamp(percent, 0.0f, 1.0f);
 
-  Angle pie_angle = -AngleBetweenCharacters(pie->source(), pie->target());
+  Angle pie_angle = -AngleBetweenCharacters(source_id, target_id);
 
   const Quat pie_orientation = CalculatePieOrientation(
-      pie_angle, percent, pie->rotations(), config_);
+      pie_angle, percent, pies_.rotations(pie), config_);
   const vec3 pie_position = CalculatePiePosition(
-      *source.get(), *target.get(), percent, pie->height(), config_);
+      *source.get(), *target.get(), percent, pies_.height(pie), config_);
 
-  pie->set_orientation(pie_orientation);
-  pie->set_position(pie_position);
+  pies_.set_orientation(pie, pie_orientation);
+  pies_.set_position(pie, pie_position);
+}
+
+// Move every pie along its arc, remembering where it was for interpolation.
+void GameState::UpdatePiePositions() {
+  pies_.UpdatePreviousTransforms();
+  const int num_pies = pies_.Count();
+  for (int i = 0; i < num_pies; ++i) {
+    UpdatePiePosition(i);
+  }
 }
 
 uint16_t GameState::CharacterState(CharacterId id) const {
@@ -520,7 +701,7 @@ static bool CharacterIsVictorious(
 
 void GameState::DetermineWinnersAndLosers() {
   // This code assumes we've verified that the game is over.
-  switch (config_->game_mode()) {
+  switch (runtime_config_->game_mode()) {
     case GameMode_Survival: {
       for (size_t i = 0; i < characters_.size(); ++i) {
         const auto& character = characters_[i];
@@ -628,23 +809,23 @@ int GameState::NumActiveCharacters(bool human_only) const {
 // Determine which direction the user wants to turn.
 // Returns 0 if no turn requested. 1 if requesting we target the next character
 // id. -1 if requesting we target the previous character id.
+// Only valid in AdvanceFrame(), since it reads columns_.
 int GameState::RequestedTurn(CharacterId id) const {
-  const auto& character = characters_[id];
-  const uint32_t logical_inputs = character->controller()->went_down();
-  const int left_jump = arrangement_->character_data()->Get(id)->left_jump();
+  const uint32_t logical_inputs = columns_.went_down(id);
+  const int left_jump = slots_[id].left_jump;
   const int target_delta =
       (logical_inputs & LogicalInputs_Left) ? left_jump :
       (logical_inputs & LogicalInputs_Right) ? -left_jump : 0;
   return target_delta;
 }
 
+// Only valid in AdvanceFrame(), since it reads columns_.
 CharacterId GameState::CalculateCharacterTarget(CharacterId id) const {
-  assert(0 <= id && id < static_cast<CharacterId>(characters_.size()));
-  const auto& character = characters_[id];
-  const CharacterId current_target = character->target();
+  assert(0 <= id && id < static_cast<CharacterId>(columns_.size()));
+  const CharacterId current_target = columns_.target(id);
 
   // If you yourself are KO'd, then you can't change target.
-  const int target_state = CharacterState(id);
+  const int target_state = columns_.state(id);
   if (target_state == StateId_KO)
     return current_target;
 
@@ -653,34 +834,20 @@ CharacterId GameState::CalculateCharacterTarget(CharacterId id) const {
   if (requested_turn == 0)
     return current_target;
 
-  const CharacterId character_count =
-      static_cast<CharacterId>(characters_.size());
-  for (CharacterId target_id = current_target + requested_turn; ;
-       target_id += requested_turn) {
-    // Wrap around.
-    if (target_id >= character_count) {
-      target_id = 0;
-    } else if (target_id < 0) {
-      target_id = character_count - 1;
-    }
+  // The closest character in the requested direction that isn't KO'd.
+  // Constant time, however many characters there are.
+  const CharacterId target_id = requested_turn > 0 ?
+      columns_.next_active(current_target) :
+      columns_.previous_active(current_target);
 
-    // If we've looped around, no one else to target.
-    if (target_id == current_target)
-      return current_target;
-
-    // Avoid targeting yourself.
-    // Avoid looping around to the other side.
-    if (target_id == id)
-      return current_target;
-
-    // Don't target KO'd characters.
-    const int target_state = CharacterState(target_id);
-    if (target_state == StateId_KO)
-      continue;
+  // If we've looped around, no one else to target.
+  // Avoid targeting yourself.
+  // Avoid looping around to the other side.
+  if (target_id == current_target || target_id == id)
+    return current_target;
 
-    // All targetting criteria satisfied.
-    return target_id;
-  }
+  // All targetting criteria satisfied.
+  return target_id;
 }
 
 // The angle between two characters.
@@ -718,11 +885,14 @@ bool GameState::IsImmobile(CharacterId id) const {
 // forbids turning at this moment.
 // Returns 0 if we should not fake a turn. 1 if we should fake turn towards the
 // next character id. -1 if we should fake turn towards the previous character
-// id.
+// id. Only valid in AdvanceFrame(), since it reads columns_.
 impel::TwitchDirection GameState::FakeResponseToTurn(CharacterId id) const {
   // We only want to fake the turn response when the character is immobile.
   // If the character can move, we'll just let the move happen normally.
-  if (!IsImmobile(id)) return impel::kTwitchDirectionNone;
+  // Same as IsImmobile(), from the columns.
+  const bool immobile =
+      columns_.state(id) == StateId_KO || columns_.num_active() <= 2;
+  if (!immobile) return impel::kTwitchDirectionNone;
 
   // If the user has not requested any movement, then no need to move.
   const int requested_turn = RequestedTurn(id);
@@ -747,8 +917,8 @@ uint32_t GameState::AllLogicalInputs() const {
 // Creates a bunch of particles when a character gets hit by a pie.
 void GameState::CreatePieSplatter(const Character& character,
                                   CharacterHealth damage) {
-  const ParticleDef * def = config_->pie_splatter_def();
-  SpawnParticles(character.position(), def, static_cast<int>(damage) *
+  SpawnParticles(character.position(), pie_splatter_particles_,
+                 static_cast<int>(damage) *
                  config_->pie_noon_particles_per_damage());
   // Play a pie hit sound based upon the amount of damage applied (size of the
   // pie).
@@ -758,62 +928,35 @@ void GameState::CreatePieSplatter(const Character& character,
 
 // Creates confetti when a character presses buttons on the join screen.
 void GameState::CreateJoinConfettiBurst(const Character& character) {
-  const ParticleDef * def = config_->joining_confetti_def();
-  vec3 character_color =
-      LoadVec3(config_->character_colors()->Get(character.id()));
+  const vec3& character_color =
+      runtime_config_->character_color(character.id());
 
-  SpawnParticles(character.position(), def, config_->joining_confetti_count(),
+  SpawnParticles(character.position(), joining_confetti_particles_,
+      config_->joining_confetti_count(),
       vec4(character_color.x(), character_color.y(), character_color.z(), 1));
 }
 
-// Spawns a particle at the given position, using a particle definition.
+// Spawns particles at the given position, using a particle definition.
 void GameState::SpawnParticles(const mathfu::vec3 &position,
-                               const ParticleDef * def,
+                               const ParticleSpawnDef &def,
                                const int particle_count,
                                const mathfu::vec4 &base_tint) {
-  const vec3 min_scale = LoadVec3(def->min_scale());
-  const vec3 max_scale = LoadVec3(def->max_scale());
-  const vec3 min_velocity = LoadVec3(def->min_velocity());
-  const vec3 max_velocity = LoadVec3(def->max_velocity());
-  const vec3 min_angular_velocity = LoadVec3(def->min_angular_velocity());
-  const vec3 max_angular_velocity = LoadVec3(def->max_angular_velocity());
-  const vec3 min_position_offset = LoadVec3(def->min_position_offset());
-  const vec3 max_position_offset = LoadVec3(def->max_position_offset());
-  const vec3 min_orientation_offset = LoadVec3(def->min_orientation_offset());
-  const vec3 max_orientation_offset = LoadVec3(def->max_orientation_offset());
-
-  for (int i = 0; i<particle_count; i++) {
-    Particle * p = particle_manager_.CreateParticle();
-    // if we got back a null, it means new particles can't be spawned right now.
-    if (p == nullptr) {
-      break;
-    }
-    p->set_base_scale(def->preserve_aspect() ?
-        vec3(mathfu::RandomInRange(min_scale.x(), max_scale.x())) :
-        vec3::RandomInRange(min_scale, max_scale));
-
-    p->set_base_velocity(vec3::RandomInRange(min_velocity, max_velocity));
-    p->set_acceleration(LoadVec3(def->acceleration()));
-    p->set_renderable_id(def->renderable()->Get(
-        mathfu::RandomInRange<int>(0, def->renderable()->size())));
-    mathfu::vec4 tint = LoadVec4(def->tint()->Get(
-        mathfu::RandomInRange<int>(0, def->tint()->size())));
-    p->set_base_tint(mathfu::vec4(tint.x() * base_tint.x(),
-                                  tint.y() * base_tint.y(),
-                                  tint.z() * base_tint.z(),
-                                  tint.w() * base_tint.w()));
-    p->set_duration(static_cast<float>(mathfu::RandomInRange<int32_t>(
-        def->min_duration(), def->max_duration())));
-    p->set_base_position(position + vec3::RandomInRange(min_position_offset,
-        max_position_offset));
-    p->set_base_orientation(vec3::RandomInRange(min_orientation_offset,
-                            max_orientation_offset));
-    p->set_rotational_velocity(vec3::RandomInRange(
-                               min_angular_velocity,
-                               max_angular_velocity));
-    p->set_duration_of_shrink_out(
-        static_cast<TimeStep>(def->shrink_duration()));
-    p->set_duration_of_fade_out(static_cast<TimeStep>(def->fade_duration()));
+  if (particle_count <= 0)
+    return;
+  // One number from the game's Rng seeds the whole burst, so the game's
+  // sequence doesn't depend on how many particles fit in the pool.
+  const uint32_t seed = rng_.Next();
+
+  // GPU particles are only limited by the GPU buffers, which overwrite
+  // their oldest particles when full.
+  if (config_->gpu_particles()) {
+    const size_t first = gpu_particle_spawns_.size();
+    gpu_particle_spawns_.resize(first + particle_count);
+    GenerateGpuParticleSpawns(def, position, base_tint, seed, time_,
+                              particle_count, &gpu_particle_spawns_[first]);
+  } else {
+    particle_manager_.SpawnParticles(def, position, base_tint, seed,
+                                     particle_count, &SharedJobSystem());
   }
 }
 
@@ -823,7 +966,16 @@ void GameState::AdvanceFrame(WorldTime delta_time, AudioEngine* audio_engine) {
   // include the delta_time. For example, GetAnimationTime needs to compare
   // against the time for *this* frame, not last frame.
   time_ += delta_time;
-  if (config_->game_mode() == GameMode_HighScore) {
+  FrameProfilePhases phases("LogicalInputs");
+  prev_camera_state_ = camera_.CurrentState();
+  frame_arena_.Reset();
+
+  // The passes below read the characters from these columns.
+  columns_.Gather(characters_, static_cast<const impel::ImpelProcessor1f*>(
+                                   impel_engine_.Processor(
+                                       impel::OvershootImpelInit::kType)));
+  const int num_characters = columns_.size();
+  if (runtime_config_->game_mode() == GameMode_HighScore) {
     int countdown = (config_->game_time() - time_) / kMillisecondsPerSecond;
     if (countdown != countdown_timer_) {
       countdown_timer_ = countdown;
@@ -831,91 +983,120 @@ void GameState::AdvanceFrame(WorldTime delta_time, AudioEngine* audio_engine) {
                   "Timer remaining: %i\n", countdown_timer_);
     }
   }
-  if (NumActiveCharacters(true) == 0) {
-    SpawnParticles(mathfu::vec3(0, 10, 0), config_->confetti_def(), 1);
+  if (columns_.num_active_humans() == 0) {
+    SpawnParticles(mathfu::vec3(0, 10, 0), confetti_particles_, 1);
   }
 
   // Damage is queued up per character then applied during event processing.
-  std::vector<EventData> event_data(characters_.size());
+  ArenaVector<EventData> event_data((ArenaAllocator<EventData>(&frame_arena_)));
+  event_data.reserve(characters_.size());
+  for (size_t i = 0; i < characters_.size(); ++i) {
+    event_data.push_back(EventData(&frame_arena_));
+  }
 
   // Update controller to gather state machine inputs.
-  for (unsigned int i = 0; i < characters_.size(); ++i) {
+  for (int i = 0; i < num_characters; ++i) {
     auto& character = characters_[i];
-    character->UpdatePreviousState();
+    character->UpdatePreviousState(columns_.face_angle(i));
     Controller* controller = character->controller();
     const Timeline* timeline =
         character->state_machine()->current_state()->timeline();
     controller->SetLogicalInputs(LogicalInputs_JustHit, false);
-    controller->SetLogicalInputs(LogicalInputs_NoHealth,
-                                 config_->game_mode() == GameMode_Survival &&
-                                 character->health() <= 0);
+    controller->SetLogicalInputs(
+        LogicalInputs_NoHealth,
+        runtime_config_->game_mode() == GameMode_Survival &&
+        columns_.health(i) <= 0);
     controller->SetLogicalInputs(LogicalInputs_AnimationEnd, timeline &&
         (GetAnimationTime(*character.get()) >= timeline->end_time()));
     controller->SetLogicalInputs(LogicalInputs_Won,
-                                 character->victory_state() == kVictorious);
+                                 columns_.victory_state(i) == kVictorious);
     controller->SetLogicalInputs(LogicalInputs_Lost,
-                                 character->victory_state() == kFailure);
+                                 columns_.victory_state(i) == kFailure);
 
 
     bool just_joined = character->just_joined_game();
     controller->SetLogicalInputs(LogicalInputs_JoinedGame, just_joined);
-    if (just_joined && character->State() != StateId_Joining) {
+    if (just_joined && columns_.state(i) != StateId_Joining) {
       character->set_just_joined_game(false);
     }
   }
 
   // Update all the particles.
+  phases.Next("Particles");
   particle_manager_.AdvanceFrame(static_cast<TimeStep>(delta_time));
 
   // Update pies. Modify state machine input when character hit by pie.
-  for (auto it = pies_.begin(); it != pies_.end(); ) {
-    auto& pie = *it;
-    UpdatePiePosition(pie.get());
-
-    // Remove pies that have made contact.
-    const WorldTime time_since_launch = time_ - pie->start_time();
-    if (time_since_launch >= pie->flight_time()) {
-      auto& character = characters_[pie->target()];
+  phases.Next("Pies");
+  UpdatePiePositions();
+  for (int i = 0; i < pies_.Count(); ) {
+    // Remove pies that have made contact. The last pie is moved into slot i,
+    // so look at slot i again.
+    const WorldTime time_since_launch = time_ - pies_.start_time(i);
+    if (time_since_launch >= pies_.flight_time(i)) {
+      const CharacterId target_id = pies_.target(i);
+      auto& character = characters_[target_id];
       ReceivedPie received_pie = {
-        pie->original_source(), pie->source(), pie->target(), pie->damage()
+        pies_.original_source(i), pies_.source(i), target_id, pies_.damage(i)
       };
-      event_data[pie->target()].received_pies.push_back(received_pie);
+      event_data[target_id].received_pies.push_back(received_pie);
       character->controller()->SetLogicalInputs(LogicalInputs_JustHit, true);
-      if (character->State() != StateId_Blocking)
-        CreatePieSplatter(*character, pie->damage());
-      it = pies_.erase(it);
+      if (columns_.state(target_id) != StateId_Blocking)
+        CreatePieSplatter(*character, pies_.damage(i));
+      pies_.Remove(i);
     }
     else {
-      ++it;
+      ++i;
     }
   }
 
-  // Update the character state machines and the facing angles.
+  // Update the character state machines. All inputs are gathered first so
+  // that the state machine updates run back-to-back over the compiled
+  // transition tables.
+  phases.Next("StateMachines");
+  ArenaVector<ConditionInputs> condition_inputs(
+      characters_.size(), ConditionInputs(),
+      ArenaAllocator<ConditionInputs>(&frame_arena_));
+  for (unsigned int i = 0; i < characters_.size(); ++i) {
+    PopulateConditionInputs(&condition_inputs[i], *characters_[i].get());
+  }
   for (unsigned int i = 0; i < characters_.size(); ++i) {
+    characters_[i]->state_machine()->Update(condition_inputs[i]);
+  }
+  columns_.GatherStates(characters_);
+
+  // Update the facing angles. The targets are all chosen from the columns
+  // first, and then given to the characters.
+  phases.Next("FaceAngles");
+  ArenaVector<CharacterId> targets(
+      num_characters, 0, ArenaAllocator<CharacterId>(&frame_arena_));
+  ArenaVector<Angle> target_angles(
+      num_characters, Angle(), ArenaAllocator<Angle>(&frame_arena_));
+  for (int i = 0; i < num_characters; ++i) {
+    const CharacterId id = static_cast<CharacterId>(i);
+    targets[i] = CalculateCharacterTarget(id);
+    target_angles[i] = TiltTowardsStageFront(Angle::FromXZVector(
+        columns_.position(targets[i]) - columns_.position(i)));
+  }
+  for (int i = 0; i < num_characters; ++i) {
     auto& character = characters_[i];
-
-    // Update state machines.
-    ConditionInputs condition_inputs;
-    PopulateConditionInputs(&condition_inputs, *character.get());
-    character->state_machine()->Update(condition_inputs);
-
-    // Update character's target.
-    const CharacterId target_id = CalculateCharacterTarget(character->id());
-    const Angle target_angle =
-        AngleBetweenCharacters(character->id(), target_id);
-    const Angle tilted_angle = TiltTowardsStageFront(target_angle);
-    character->SetTarget(target_id, tilted_angle);
+    character->SetTarget(targets[i], target_angles[i]);
 
     // If we're requesting a turn but can't turn, move the face angle
     // anyway to fake a response.
-    const impel::TwitchDirection twitch = FakeResponseToTurn(character->id());
+    const impel::TwitchDirection twitch =
+        FakeResponseToTurn(static_cast<CharacterId>(i));
     character->TwitchFaceAngle(twitch);
   }
 
   // Update all Impellers. Impeller updates are done in bulk for scalability.
+  phases.Next("Impel");
   impel_engine_.AdvanceFrame(delta_time);
+  GatherPropShake();
+  impel_memory_.Set(impel_engine_.MemorySize());
+  arena_memory_.Set(frame_arena_.capacity());
 
   // Look to timeline to see what's happening. Make it happen.
+  phases.Next("Events");
   for (unsigned int i = 0; i < characters_.size(); ++i) {
     ProcessEvents(characters_[i].get(), &event_data[i], delta_time);
   }
@@ -925,27 +1106,35 @@ void GameState::AdvanceFrame(WorldTime delta_time, AudioEngine* audio_engine) {
   }
 
   // Play the sounds that need to be played at this point in time.
+  phases.Next("Sounds");
   for (unsigned int i = 0; i < characters_.size(); ++i) {
     ProcessSounds(audio_engine, *characters_[i].get(), delta_time);
   }
 
+  phases.Next("Camera");
   camera_.AdvanceFrame(delta_time);
 }
 
 // Get the camera matrix used for rendering.
-mat4 GameState::CameraMatrix() const {
-  return mat4::LookAt(camera_.Target(), camera_.Position(), mathfu::kAxisY3f);
+vec3 GameState::CameraPosition(float interpolation) const {
+  return vec3::Lerp(prev_camera_state_.position, camera_.Position(),
+                    interpolation);
+}
+
+mat4 GameState::CameraMatrix(float interpolation) const {
+  const vec3 position = CameraPosition(interpolation);
+  const vec3 target = vec3::Lerp(prev_camera_state_.target, camera_.Target(),
+                                 interpolation);
+  return mat4::LookAt(target, position, mathfu::kAxisY3f);
 }
 
+// Returns the accessory's matrix in character space.
 static const mat4 CalculateAccessoryMatrix(
-    const vec2& location, const vec2& scale, const mat4& character_matrix,
-    uint16_t renderable_id, int num_accessories, const Config& config) {
-  // Grab the offset of the base renderable. The renderable's texture is moved
-  // by this amount, so we have to move the same to match.
-  auto renderable = config.renderables()->Get(renderable_id);
-  const vec3 renderable_offset = renderable->offset() == nullptr ?
-                                 mathfu::kZeros3f :
-                                 LoadVec3(renderable->offset());
+    const vec2& location, const vec2& scale, const vec3& renderable_offset,
+    int num_accessories, const Config& config) {
+  // 'renderable_offset' is the offset of the base renderable. The
+  // renderable's texture is moved by this amount, so we have to move the
+  // same to match.
 
   // Calculate the accessory offset, in character space.
   // Ensure accessories don't z-fight by rendering them at slightly different z
@@ -958,14 +1147,62 @@ static const mat4 CalculateAccessoryMatrix(
       config.accessory_z_offset() +
           num_accessories * config.accessory_z_increment());
 
-  // Apply offset to character matrix.
   const vec3 offset = renderable_offset + accessory_offset;
   const vec3 scale3d(scale[0], scale[1], 1.0f);
   const mat4 offset_matrix = mat4::FromTranslationVector(offset);
   const mat4 scale_matrix = mat4::FromScaleVector(scale3d);
-  const mat4 accessory_matrix =
-      character_matrix * offset_matrix * scale_matrix;
-  return accessory_matrix;
+  return offset_matrix * scale_matrix;
+}
+
+// True if 'layout' was laid out for this key.
+template<class Indices>
+static bool AccessoryLayoutMatches(const AccessoryLayout& layout,
+                                   const Timeline* timeline,
+                                   uint16_t renderable_id,
+                                   const Indices& accessory_indices,
+                                   CharacterHealth damage,
+                                   CharacterHealth health) {
+  return layout.timeline == timeline &&
+         layout.renderable_id == renderable_id &&
+         layout.damage == damage && layout.health == health &&
+         layout.accessory_indices.size() == accessory_indices.size() &&
+         std::equal(accessory_indices.begin(), accessory_indices.end(),
+                    layout.accessory_indices.begin());
+}
+
+// Set 'world_matrices' to the world matrices of the accessories in 'layout',
+// on a character with 'character_matrix'.
+static void CalculateAccessoryWorldMatrices(
+    const AccessoryLayout& layout, const mat4& character_matrix,
+    std::vector<mat4>* world_matrices) {
+  world_matrices->resize(layout.matrices.size());
+  for (size_t i = 0; i < layout.matrices.size(); ++i) {
+    (*world_matrices)[i] = character_matrix * layout.matrices[i];
+  }
+}
+
+// Add the accessories in 'layout' to the scene, on top of the character,
+// with the world matrices from CalculateAccessoryWorldMatrices().
+static void AddAccessoriesToScene(const AccessoryLayout& layout,
+                                  const std::vector<mat4>& world_matrices,
+                                  SceneDescription* scene) {
+  // The character is the last renderable added.
+  if (layout.overlay_key >= 0) {
+    scene->AddOverlay(layout.overlay_key, layout.overlay_origin);
+  }
+  for (size_t i = 0; i < layout.renderables.size(); ++i) {
+    scene->AddRenderable(layout.renderables[i], world_matrices[i]);
+  }
+}
+
+// True if 'transform' was calculated for this key.
+static bool CharacterTransformMatches(const CharacterTransform& transform,
+                                      const vec3& position, Angle face_angle,
+                                      bool facing_camera) {
+  const float angle = face_angle.ToRadians();
+  return transform.valid && transform.facing_camera == facing_camera &&
+         memcmp(&transform.face_angle, &angle, sizeof(angle)) == 0 &&
+         memcmp(&transform.position[0], &position[0], 3 * sizeof(float)) == 0;
 }
 
 static mat4 CalculatePropWorldMatrix(const Prop& prop, Angle shake) {
@@ -1003,31 +1240,30 @@ static mat4 CalculateUiArrowMatrix(const vec3& position, const Angle& angle,
          kRotate90DegreesAboutXAxis;
 }
 
-// Helper class for std::sort. Sorts Characters by distance from camera.
-class CharacterDepthComparer {
-public:
-  CharacterDepthComparer(const vec3& camera_position)
-    : camera_position_(new vec3(camera_position)) {}
-
-  CharacterDepthComparer(const CharacterDepthComparer& comparer)
-    : camera_position_(new vec3(*comparer.camera_position_)) {}
-
-  bool operator()(const Character* a, const Character* b) const {
-    const float a_dist_sq = (*camera_position_ - a->position()).LengthSquared();
-    const float b_dist_sq = (*camera_position_ - b->position()).LengthSquared();
-    return a_dist_sq > b_dist_sq;
+// Set the layout's renderables and matrices from its key.
+void GameState::LayoutAccessories(AccessoryLayout* layout) const {
+  layout->renderables.clear();
+  layout->matrices.clear();
+  layout->overlay_key = -1;
+  const vec3& renderable_offset =
+      runtime_config_->renderable_offset(layout->renderable_id);
+  int num_accessories = 0;
+
+  // Timeline accessories first.
+  for (auto it = layout->accessory_indices.begin();
+       it != layout->accessory_indices.end(); ++it) {
+    const TimelineAccessory& accessory =
+        *layout->timeline->accessories()->Get(*it);
+    const vec2 location(accessory.offset().x(), accessory.offset().y());
+    layout->renderables.push_back(accessory.renderable());
+    layout->matrices.push_back(CalculateAccessoryMatrix(
+        location, mathfu::kOnes2f, renderable_offset, num_accessories,
+        *config_));
+    num_accessories++;
   }
 
-private:
-  // Pointer to force alignment, which MSVC std::sort ignores
-  std::unique_ptr<vec3> camera_position_;
-};
-
-void GameState::PopulateCharacterAccessories(
-    SceneDescription* scene, uint16_t renderable_id,
-    const mat4& character_matrix, int num_accessories, CharacterHealth damage,
-    CharacterHealth health) const {
-  auto renderable = config_->renderables()->Get(renderable_id);
+  // Then splatter and health accessories.
+  auto renderable = config_->renderables()->Get(layout->renderable_id);
 
   // Loop twice. First for damage splatters, then for health hearts.
   struct {
@@ -1039,13 +1275,13 @@ void GameState::PopulateCharacterAccessories(
         fixed_accessories;
   } accessories[] = {
     {
-      damage,
+      layout->damage,
       LoadVec2i(renderable->splatter_offset()),
       config_->splatter_map(),
       config_->splatter_accessories()
     },
     {
-      health,
+      layout->health,
       LoadVec2i(renderable->health_offset()),
       config_->health_map(),
       config_->health_accessories()
@@ -1059,6 +1295,21 @@ void GameState::PopulateCharacterAccessories(
     auto indices = accessories[j].indices->Get(key)->indices();
     const int num_fixed_accessories = static_cast<int>(indices->Length());
 
+    // Baked splatters are drawn by the character's shader, from a texture
+    // that holds this whole set.
+    if (j == 0 && config_->bake_splatters()) {
+      if (num_fixed_accessories > 0) {
+        const vec4 bounds = LoadVec4(config_->splatter_overlay_bounds());
+        layout->overlay_key = key;
+        const vec2 corner = vec2(accessories[j].offset) +
+                            vec2(bounds.x(), bounds.y());
+        layout->overlay_origin =
+            vec2(renderable_offset.x(), renderable_offset.y()) +
+            corner * config_->pixel_to_world_scale();
+      }
+      continue;
+    }
+
     // Add each accessory slightly in front of the character, with a slight
     // z-offset so that they don't z-fight when they overlap, and for a
     // nice parallax look.
@@ -1069,11 +1320,10 @@ void GameState::PopulateCharacterAccessories(
       const vec2 location(LoadVec2i(accessory->location())
                           + accessories[j].offset);
       const vec2 scale(LoadVec2(accessory->scale()));
-      scene->renderables().push_back(std::unique_ptr<Renderable>(
-          new Renderable(static_cast<uint16_t>(accessory->renderable()),
-              CalculateAccessoryMatrix(location, scale, character_matrix,
-                                       renderable_id, num_accessories,
-                                       *config_))));
+      layout->renderables.push_back(
+          static_cast<uint16_t>(accessory->renderable()));
+      layout->matrices.push_back(CalculateAccessoryMatrix(
+          location, scale, renderable_offset, num_accessories, *config_));
       num_accessories++;
     }
   }
@@ -1081,58 +1331,159 @@ void GameState::PopulateCharacterAccessories(
 
 // Add anything in the list of particles into the scene description:
 void GameState::AddParticlesToScene(SceneDescription* scene) const {
-  auto plist = particle_manager_.get_particle_list();
-  for (auto it = plist.begin(); it != plist.end(); ++it) {
-    scene->renderables().push_back(std::unique_ptr<Renderable>(
-        new Renderable((*it)->renderable_id(), (*it)->CalculateMatrix(),
-                       (*it)->CurrentTint())));
+  const int num_particles = particle_manager_.Count();
+  if (num_particles == 0)
+    return;
+
+  ArenaVector<mat4> matrices(num_particles, mat4(),
+                             ArenaAllocator<mat4>(&frame_arena_));
+  ArenaVector<vec4> tints(num_particles, vec4(),
+                          ArenaAllocator<vec4>(&frame_arena_));
+  particle_manager_.ComputeTransforms(&matrices[0], &tints[0]);
+  for (int i = 0; i < num_particles; ++i) {
+    scene->AddRenderable(particle_manager_.renderable_id(i), matrices[i],
+                         tints[i]);
   }
 }
 
 // TODO: Make this function a member of GameState, once that class has been
 // submitted to git. Then populate from the values in GameState.
-void GameState::PopulateScene(SceneDescription* scene) const {
-  scene->Clear();
+void GameState::PopulateScene(SceneDescription* scene,
+                              float interpolation) const {
+  // In a persistent scene, the props that don't shake are static, and stay
+  // in the scene until the config changes. Everything else is added again
+  // every frame.
+  const bool keep_static = config_->persistent_scene() &&
+                           scene->static_version() == static_scene_version_;
+  if (keep_static) {
+    scene->ClearDynamic();
+  } else {
+    scene->Clear();
+  }
+  frame_arena_.Reset();
 
   // Camera.
-  scene->set_camera(CameraMatrix());
+  scene->set_camera(CameraMatrix(interpolation));
+  scene->set_camera_position(CameraPosition(interpolation));
+
+  // In a persistent scene, the still props go first, since static
+  // renderables have to.
+  const bool persistent = config_->persistent_scene();
+  auto props = config_->props();
+  if (persistent && !keep_static) {
+    if (config_->draw_props()) {
+      for (size_t i = 0; i < props->Length(); ++i) {
+        const Prop& prop = *props->Get(i);
+        if (prop.shake_impeller() == ImpellerSpecification_None) {
+          scene->AddStaticRenderable(static_cast<uint16_t>(prop.renderable()),
+                                     CalculatePropWorldMatrix(prop, Angle()));
+        }
+      }
+    }
+    scene->set_static_version(static_scene_version_);
+  }
 
+  // The particles go ahead of the other props, as they always have. Scene
+  // order only orders blended draws within one depth bucket, so in a
+  // persistent scene the particles only change places with still props at
+  // the same depth.
   AddParticlesToScene(scene);
 
   // Populate scene description with environment items.
   if (config_->draw_props()) {
-    auto props = config_->props();
+    size_t shake_index = 0;
     for (size_t i = 0; i < props->Length(); ++i) {
       const Prop& prop = *props->Get(i);
-      const Angle shake(prop_shake_[i].Valid() ?
-                        prop_shake_[i].Value() : 0.0f);
-      scene->renderables().push_back(std::unique_ptr<Renderable>(
-          new Renderable(static_cast<uint16_t>(prop.renderable()),
-                         CalculatePropWorldMatrix(prop, shake))));
+      const bool shakes = prop.shake_impeller() != ImpellerSpecification_None;
+      if (persistent && !shakes) continue;
+      const Angle shake(shakes ? prop_shake_values_[shake_index++] : 0.0f);
+      scene->AddRenderable(static_cast<uint16_t>(prop.renderable()),
+                           CalculatePropWorldMatrix(prop, shake));
     }
   }
 
   // Pies.
   if (config_->draw_pies()) {
-    for (auto it = pies_.begin(); it != pies_.end(); ++it) {
-      auto& pie = *it;
-      scene->renderables().push_back(std::unique_ptr<Renderable>(
-          new Renderable(
-              EnumerationValueForPieDamage<uint16_t>(
-                  pie->damage(), *(config_->renderable_id_for_pie_damage())),
-              pie->CalculateMatrix())));
+    const int num_pies = pies_.Count();
+    ArenaVector<mat4> pie_matrices(num_pies, mat4(),
+                                   ArenaAllocator<mat4>(&frame_arena_));
+    if (num_pies > 0) {
+      pies_.CalculateMatrices(interpolation, &pie_matrices[0]);
+    }
+    for (int i = 0; i < num_pies; ++i) {
+      scene->AddRenderable(
+          EnumerationValueForPieDamage<uint16_t>(
+              pies_.damage(i), *(config_->renderable_id_for_pie_damage())),
+          pie_matrices[i]);
     }
   }
 
   // Characters and accessories.
   if (config_->draw_characters()) {
-    // Sort characters by farthest-to-closest to the camera.
-    std::vector<Character*> sorted_characters(characters_.size());
-    for (size_t i = 0; i < characters_.size(); ++i) {
-      sorted_characters[i] = characters_[i].get();
+    if (accessory_layouts_.size() != characters_.size()) {
+      accessory_layouts_.resize(characters_.size());
+    }
+    if (character_transforms_.size() != characters_.size()) {
+      character_transforms_.resize(characters_.size());
+    }
+
+    // Sort characters by farthest-to-closest to the camera. Characters move
+    // little between frames, so an insertion sort of the last frame's order
+    // is linear in the number of characters, unless many of them swap.
+    const int num_characters = static_cast<int>(characters_.size());
+    if (static_cast<int>(depth_order_.size()) != num_characters) {
+      depth_order_.resize(num_characters);
+      for (int i = 0; i < num_characters; ++i) {
+        depth_order_[i] = i;
+      }
+    }
+    ArenaVector<float> depths(num_characters, 0.0f,
+                              ArenaAllocator<float>(&frame_arena_));
+    for (int i = 0; i < num_characters; ++i) {
+      depths[i] =
+          (camera_.Position() - characters_[i]->position()).LengthSquared();
+    }
+    for (int i = 1; i < num_characters; ++i) {
+      const CharacterId id = depth_order_[i];
+      int j = i;
+      for (; j > 0 && depths[depth_order_[j - 1]] < depths[id]; --j) {
+        depth_order_[j] = depth_order_[j - 1];
+      }
+      depth_order_[j] = id;
+    }
+    ArenaVector<Character*> sorted_characters(
+        num_characters, nullptr, ArenaAllocator<Character*>(&frame_arena_));
+    for (int i = 0; i < num_characters; ++i) {
+      sorted_characters[i] = characters_[depth_order_[i]].get();
+    }
+    ArenaVector<int> accessory_indices(
+        (ArenaAllocator<int>(&frame_arena_)));
+
+    // Every character needs the angles towards the camera and towards its
+    // target. Calculate them all at once, with the fast atan2, which is
+    // plenty precise for rendering. The first half of 'directions' holds
+    // the camera angles, and the second half the target angles.
+    ArenaVector<vec3> direction_vectors(
+        2 * num_characters, vec3(), ArenaAllocator<vec3>(&frame_arena_));
+    ArenaVector<Angle> directions(
+        2 * num_characters, Angle(), ArenaAllocator<Angle>(&frame_arena_));
+    ArenaVector<Angle> face_to_camera_angles(
+        num_characters, Angle(), ArenaAllocator<Angle>(&frame_arena_));
+    for (int i = 0; i < num_characters; ++i) {
+      const Character* character = sorted_characters[i];
+      direction_vectors[i] = camera_.Position() - character->position();
+      direction_vectors[num_characters + i] =
+          characters_[character->target()]->position() -
+          character->position();
+      face_to_camera_angles[i] =
+          character->InterpolatedFaceAngle(interpolation);
+    }
+    if (num_characters > 0) {
+      AnglesFromXZVectors(&direction_vectors[0], 2 * num_characters,
+                          kAngleFast, &directions[0]);
+      SubtractAngles(&face_to_camera_angles[0], &directions[0],
+                     num_characters, &face_to_camera_angles[0]);
     }
-    const CharacterDepthComparer comparer(camera_.Position());
-    std::sort(sorted_characters.begin(), sorted_characters.end(), comparer);
 
     // Render all parts of the character. Note that order matters here. For
     // example, the arrow appears partially behind the character billboard
@@ -1141,70 +1492,72 @@ void GameState::PopulateScene(SceneDescription* scene) const {
       Character* character = sorted_characters[i];
       // UI arrow
       if (config_->draw_ui_arrows()) {
-        const Angle arrow_angle = TargetFaceAngle(character->id());
-        scene->renderables().push_back(std::unique_ptr<Renderable>(
-            new Renderable(RenderableId_UiArrow, CalculateUiArrowMatrix(
-                character->position(), arrow_angle, *config_))));
+        const Angle& arrow_angle = directions[num_characters + i];
+        scene->AddRenderable(RenderableId_UiArrow, CalculateUiArrowMatrix(
+            character->position(), arrow_angle, *config_));
       }
 
       // Render accessories and splatters on the camera-facing side
       // of the character.
-      const Angle towards_camera_angle = Angle::FromXZVector(
-          camera_.Position() - character->position());
-      const Angle face_to_camera_angle =
-          character->FaceAngle() - towards_camera_angle;
-      const bool facing_camera = face_to_camera_angle.ToRadians() < 0.0f;
+      const bool facing_camera = face_to_camera_angles[i].ToRadians() < 0.0f;
 
       // Character.
       const WorldTime anim_time = GetAnimationTime(*character);
       const uint16_t renderable_id = character->RenderableId(anim_time);
-      const mat4 character_matrix = character->CalculateMatrix(facing_camera);
-      const vec3 player_color = (character->controller()->controller_type() ==
+      const Angle face_angle = character->InterpolatedFaceAngle(interpolation);
+      CharacterTransform& transform = character_transforms_[character->id()];
+      if (!CharacterTransformMatches(transform, character->position(),
+                                     face_angle, facing_camera)) {
+        transform.position = character->position();
+        transform.face_angle = face_angle.ToRadians();
+        transform.facing_camera = facing_camera;
+        transform.valid = true;
+        transform.matrix = Character::CalculateMatrix(
+            character->position(), face_angle, facing_camera);
+        transform.accessory_matrices.clear();
+      }
+      const mat4& character_matrix = transform.matrix;
+      const vec3& player_color = (character->controller()->controller_type() ==
           Controller::kTypeAI)
-          ? LoadVec3(config_->ai_color())
-          : LoadVec3(config_->character_colors()->Get(character->id())) /
-                     config_->character_global_brightness_factor() +
-                     (1 - 1 / config_->character_global_brightness_factor());
-      scene->renderables().push_back(
-          std::unique_ptr<Renderable>( new Renderable(renderable_id,
-          character_matrix,
+          ? runtime_config_->ai_color()
+          : runtime_config_->character_tint(character->id());
+      scene->AddRenderable(renderable_id, character_matrix,
           mathfu::vec4(player_color.x(), player_color.y(), player_color.z(),
-                       1.0))));
+                       1.0));
 
-      // Accessories.
-      int num_accessories = 0;
+      // Accessories that are valid for the current time, then splatter
+      // and health accessories.
       const Timeline* const timeline = character->CurrentTimeline();
+      accessory_indices.clear();
       if (timeline) {
-        // Get accessories that are valid for the current time.
-        const std::vector<int> accessory_indices =
-            TimelineIndicesWithTime(timeline->accessories(), anim_time);
-
-        // Create a renderable for each accessory.
-        for (auto it = accessory_indices.begin();
-             it != accessory_indices.end(); ++it) {
-          const TimelineAccessory& accessory =
-              *timeline->accessories()->Get(*it);
-          const vec2 location(accessory.offset().x(), accessory.offset().y());
-          scene->renderables().push_back(std::unique_ptr<Renderable>(
-              new Renderable(
-                  accessory.renderable(),
-                  CalculateAccessoryMatrix(location, mathfu::kOnes2f,
-                                           character_matrix, renderable_id,
-                                           num_accessories, *config_))));
-          num_accessories++;
-        }
+        character->timeline_cursor()->Accessories(timeline, anim_time,
+                                                  &accessory_indices);
       }
-
-      // Splatter and health accessories.
-      // First pass through renders splatter accessories.
-      // Second pass through renders health accessories.
       const CharacterHealth health =
-          config_->game_mode() == GameMode_Survival ? character->health() : 0;
+          runtime_config_->game_mode() == GameMode_Survival ?
+          character->health() : 0;
       const CharacterHealth damage =
           config_->character_health() - character->health();
-      PopulateCharacterAccessories(scene, renderable_id, character_matrix,
-                                   num_accessories, damage, health);
 
+      // Most frames, nothing in the key changes, and the accessories only
+      // need to follow the character matrix.
+      AccessoryLayout& layout = accessory_layouts_[character->id()];
+      if (!AccessoryLayoutMatches(layout, timeline, renderable_id,
+                                  accessory_indices, damage, health)) {
+        layout.timeline = timeline;
+        layout.renderable_id = renderable_id;
+        layout.accessory_indices.assign(accessory_indices.begin(),
+                                        accessory_indices.end());
+        layout.damage = damage;
+        layout.health = health;
+        LayoutAccessories(&layout);
+        transform.accessory_matrices.clear();
+      }
+      if (transform.accessory_matrices.size() != layout.matrices.size()) {
+        CalculateAccessoryWorldMatrices(layout, character_matrix,
+                                        &transform.accessory_matrices);
+      }
+      AddAccessoriesToScene(layout, transform.accessory_matrices, scene);
     }
   }
 
@@ -1216,31 +1569,27 @@ void GameState::PopulateScene(SceneDescription* scene) const {
     for (int i = 0; i < 8; ++i) {
       const mat4 axis_dot = mat4::FromTranslationVector(
           vec3(static_cast<float>(i), 0.0f, 0.0f));
-      scene->renderables().push_back(std::unique_ptr<Renderable>(
-          new Renderable(RenderableId_PieSmall, axis_dot)));
+      scene->AddRenderable(RenderableId_PieSmall, axis_dot);
     }
     for (int i = 0; i < 4; ++i) {
       const mat4 axis_dot = mat4::FromTranslationVector(
           vec3(0.0f, 0.0f, static_cast<float>(i)));
-      scene->renderables().push_back(std::unique_ptr<Renderable>(
-          new Renderable(RenderableId_PieSmall, axis_dot)));
+      scene->AddRenderable(RenderableId_PieSmall, axis_dot);
     }
     for (int i = 0; i < 2; ++i) {
       const mat4 axis_dot = mat4::FromTranslationVector(
           vec3(0.0f, static_cast<float>(i), 0.0f));
-      scene->renderables().push_back(std::unique_ptr<Renderable>(
-          new Renderable(RenderableId_PieSmall, axis_dot)));
+      scene->AddRenderable(RenderableId_PieSmall, axis_dot);
     }
   }
 
   // Draw one renderable right in the middle of the world, for debugging.
   // Rotate about z-axis so that it faces the camera.
   if (config_->draw_fixed_renderable() != RenderableId_Invalid) {
-    scene->renderables().push_back(std::unique_ptr<Renderable>(
-        new Renderable(
-            static_cast<uint16_t>(config_->draw_fixed_renderable()),
-            mat4::FromRotationMatrix(
-                Quat::FromAngleAxis(kPi, mathfu::kAxisY3f).ToMatrix()))));
+    scene->AddRenderable(
+        static_cast<uint16_t>(config_->draw_fixed_renderable()),
+        mat4::FromRotationMatrix(
+            Quat::FromAngleAxis(kPi, mathfu::kAxisY3f).ToMatrix()));
   }
 
   if (config_->draw_character_lineup()) {
@@ -1263,13 +1612,19 @@ void GameState::PopulateScene(SceneDescription* scene) const {
       uint16_t renderable_id = static_cast<uint16_t>(i);
 
       // Draw the characters.
-      scene->renderables().push_back(std::unique_ptr<Renderable>(
-          new Renderable(renderable_id, character_matrix)));
+      scene->AddRenderable(renderable_id, character_matrix);
 
       // Draw the accessories, if requested.
       if (config_->draw_lineup_accessories()) {
-        PopulateCharacterAccessories(
-            scene, renderable_id, character_matrix, 0, 10, 10);
+        AccessoryLayout layout;
+        layout.renderable_id = renderable_id;
+        layout.damage = 10;
+        layout.health = 10;
+        LayoutAccessories(&layout);
+        std::vector<mat4> world_matrices;
+        CalculateAccessoryWorldMatrices(layout, character_matrix,
+                                        &world_matrices);
+        AddAccessoriesToScene(layout, world_matrices, scene);
       }
     }
   }
@@ -1278,7 +1633,7 @@ void GameState::PopulateScene(SceneDescription* scene) const {
   const auto lights = config_->light_positions();
   for (auto it = lights->begin(); it != lights->end(); ++it) {
     const vec3 light_position = LoadVec3(*it);
-    scene->lights().push_back(std::unique_ptr<vec3>(new vec3(light_position)));
+    scene->AddLight(light_position);
   }
 }
 
@@ -18,10 +18,15 @@
 #include <vector>
 #include <memory>
 #include "character.h"
+#include "frame_arena.h"
 #include "impel_processor.h"
+#include "impel_snapshot.h"
 #include "impel_util.h"
+#include "memory_tracker.h"
 #include "particles.h"
 #include "game_camera.h"
+#include "rng.h"
+#include "runtime_config.h"
 
 namespace fpl {
 
@@ -32,10 +37,80 @@ class SceneDescription;
 namespace pie_noon {
 
 struct Config;
-struct CharacterArrangement;
 struct EventData;
 struct ReceivedPie;
 
+// Everything that GameState::AdvanceFrame() changes, so that a networked
+// match can go back to an earlier frame. Keep one per saved frame and reuse
+// it, so that its memory is reused too.
+struct GameStateSnapshot {
+  WorldTime time;
+  int countdown_timer;
+  GameCameraSnapshot camera;
+  GameCameraState prev_camera_state;
+  std::vector<CharacterSnapshot> characters;
+  AirbornePies pies;
+  std::vector<float> prop_shake_values;
+  ParticleManager particle_manager;
+  Rng rng;
+  impel::ImpelSnapshot impel;
+};
+
+// Where a character stands, and which way its Left input turns its target:
+// 1 towards the next character id, -1 towards the previous one.
+struct CharacterSlot {
+  mathfu::vec3 position;
+  int left_jump;
+};
+
+// Where a character's accessories go, relative to the character's matrix.
+// They only move when one of the key fields changes, so PopulateScene()
+// keeps one per character and only lays it out again when the key differs.
+struct AccessoryLayout {
+  AccessoryLayout()
+      : timeline(nullptr), renderable_id(RenderableId_Invalid), damage(0),
+        health(0), overlay_key(-1) {}
+
+  // The key. 'accessory_indices' are the timeline accessories that are
+  // active.
+  const Timeline* timeline;
+  uint16_t renderable_id;
+  std::vector<int> accessory_indices;
+  CharacterHealth damage;
+  CharacterHealth health;
+
+  // The layout. Each accessory's renderable and matrix in character space.
+  std::vector<uint16_t> renderables;
+  std::vector<mathfu::mat4> matrices;
+
+  // When splatters are baked, the entry of splatter_map to draw over the
+  // character, and where it starts in the character's object space. -1 when
+  // there are no splatters to draw.
+  int overlay_key;
+  mathfu::vec2 overlay_origin;
+};
+
+// A character's world matrix, and the world matrices of its accessories,
+// with what they were calculated from. Characters mostly stand still, so
+// PopulateScene() keeps one per character, and only calculates the matrices
+// again when the character moves, turns or changes side, or when its
+// accessories are laid out again.
+struct CharacterTransform {
+  CharacterTransform() : face_angle(0.0f), facing_camera(false),
+                         valid(false) {}
+
+  // The key. Compared bit for bit, so settled characters match.
+  mathfu::vec3 position;
+  float face_angle;
+  bool facing_camera;
+  bool valid;
+
+  // The matrices. 'accessory_matrices' is empty until the accessories are
+  // added to the scene.
+  mathfu::mat4 matrix;
+  std::vector<mathfu::mat4> accessory_matrices;
+};
+
 class GameState {
  public:
   GameState();
@@ -50,8 +125,11 @@ class GameState {
   // Update controller and state machine for each character.
   void AdvanceFrame(WorldTime delta_time, AudioEngine* audio_engine);
 
-  // Fill in the position of the characters and pies.
-  void PopulateScene(SceneDescription* scene) const;
+  // Fill in the position of the characters and pies. Things that move
+  // smoothly are drawn 'interpolation' of the way from where they were at the
+  // start of the last AdvanceFrame() to where they are now. Pass 1 to draw
+  // the current state.
+  void PopulateScene(SceneDescription* scene, float interpolation) const;
 
   // Angle between two characters.
   Angle AngleBetweenCharacters(CharacterId source_id,
@@ -88,21 +166,45 @@ class GameState {
     return characters_;
   }
 
-  std::vector<std::unique_ptr<AirbornePie>>& pies() { return pies_; }
-  const std::vector<std::unique_ptr<AirbornePie>>& pies() const {
-    return pies_;
-  }
+  AirbornePies& pies() { return pies_; }
+  const AirbornePies& pies() const { return pies_; }
+
+  ParticleManager& particle_manager() { return particle_manager_; }
+  const ParticleManager& particle_manager() const { return particle_manager_; }
 
   WorldTime time() const { return time_; }
 
-  void set_config(const Config* config) { config_ = config; }
+  // 'runtime_config' must have been initialized from 'config'.
+  void set_config(const Config* config, const RuntimeConfig* runtime_config);
 
   impel::ImpelEngine& impel_engine() { return impel_engine_; }
 
+  // Every random choice the game makes is drawn from here. Seed it at the
+  // start of a match to make the match reproducible.
+  Rng& rng() { return rng_; }
+
+  // When the config enables gpu_particles, SpawnParticles() queues particles
+  // here instead of simulating them. Appends the particles spawned since the
+  // last call to 'spawns'. Sets 'reset' if the game was reset since the last
+  // call, in which case previously spawned particles should be dropped.
+  void MoveGpuParticleSpawns(std::vector<GpuParticleSpawn>* spawns,
+                             bool* reset);
+
+  // Drop the particles queued for the GPU since the last
+  // MoveGpuParticleSpawns(). Used when re-simulating frames whose particles
+  // have already been spawned.
+  void DiscardGpuParticleSpawns() { gpu_particle_spawns_.clear(); }
+
   // Sets up the players in joining mode, where all they can do is jump up
   // and down.
   void EnterJoiningMode();
 
+  // Save the state of the match, or go back to a saved state. Restore()
+  // must be given a snapshot taken since the last Reset(), so that the same
+  // characters and Impellers exist.
+  void Snapshot(GameStateSnapshot* snapshot) const;
+  void Restore(const GameStateSnapshot& snapshot);
+
 private:
   WorldTime GetAnimationTime(const Character& character) const;
   void ProcessSounds(AudioEngine* audio_engine,
@@ -110,35 +212,35 @@ private:
                      WorldTime delta_time) const;
   void CreatePie(CharacterId original_source_id, CharacterId source_id,
                  CharacterId target_id, int damage);
-  CharacterId DetermineDeflectionTarget(const ReceivedPie& pie) const;
+  CharacterId DetermineDeflectionTarget(const ReceivedPie& pie);
   void ProcessEvent(Character* character,
                     unsigned int event,
                     const EventData& event_data);
   void PopulateConditionInputs(ConditionInputs* condition_inputs,
                                const Character& character) const;
-  void PopulateCharacterAccessories(SceneDescription* scene, uint16_t renderable_id,
-                                    const mathfu::mat4& character_matrix,
-                                    int num_accessories, int damage,
-                                    int health) const;
+  void LayoutAccessories(AccessoryLayout* layout) const;
   void ProcessConditionalEvents(Character* character, EventData* event_data);
   void ProcessEvents(Character* character,
                      EventData* data,
                      WorldTime delta_time);
-  void UpdatePiePosition(AirbornePie* pie) const;
+  void UpdatePiePosition(int pie);
+  void UpdatePiePositions();
   CharacterId CalculateCharacterTarget(CharacterId id) const;
   float CalculateCharacterFacingAngleVelocity(const Character* character,
                                               WorldTime delta_time) const;
-  mathfu::mat4 CameraMatrix() const;
+  mathfu::vec3 CameraPosition(float interpolation) const;
+  mathfu::mat4 CameraMatrix(float interpolation) const;
   int RequestedTurn(CharacterId id) const;
   Angle TiltTowardsStageFront(const Angle angle) const;
   impel::TwitchDirection FakeResponseToTurn(CharacterId id) const;
   void AddParticlesToScene(SceneDescription* scene) const;
   void CreatePieSplatter(const Character& character, int damage);
   void CreateJoinConfettiBurst(const Character& character);
-  void SpawnParticles(const mathfu::vec3 &position, const ParticleDef * def,
-                      const int particle_count,
+  void SpawnParticles(const mathfu::vec3 &position,
+                      const ParticleSpawnDef &def, const int particle_count,
                       const mathfu::vec4 &base_tint = mathfu::vec4(1, 1, 1, 1));
   void ShakeProps(float percent, const mathfu::vec3& damage_position);
+  void GatherPropShake();
 
   WorldTime time_;
   // countdown_time_ is in seconds and is derived from the length of the game
@@ -147,13 +249,51 @@ private:
   int countdown_timer_;
   GameCamera camera_;
   GameCameraState camera_base_;
+  // Camera state at the start of the last AdvanceFrame().
+  GameCameraState prev_camera_state_;
   std::vector<std::unique_ptr<Character>> characters_;
-  std::vector<std::unique_ptr<AirbornePie>> pies_;
+  // The hot fields of characters_, gathered during AdvanceFrame().
+  CharacterColumns columns_;
+  AirbornePies pies_;
   impel::ImpelEngine impel_engine_;
   std::vector<impel::Impeller1f> prop_shake_;
+  // Ids of the initialized Impellers in prop_shake_, in prop order, and their
+  // values as of the last AdvanceFrame(). Read from the processor in bulk.
+  std::vector<impel::ImpelId> prop_shake_ids_;
+  std::vector<float> prop_shake_values_;
   const Config* config_;
-  const CharacterArrangement* arrangement_;
+  const RuntimeConfig* runtime_config_;
+  // Indexed by character id. From the config's character_arrangements, or
+  // from its arena_layout in a large lobby.
+  std::vector<CharacterSlot> slots_;
   ParticleManager particle_manager_;
+  // The config's ParticleDefs, decoded by set_config().
+  ParticleSpawnDef pie_splatter_particles_;
+  ParticleSpawnDef joining_confetti_particles_;
+  ParticleSpawnDef confetti_particles_;
+  Rng rng_;
+  // Particles for the GPU, spawned since the last MoveGpuParticleSpawns().
+  std::vector<GpuParticleSpawn> gpu_particle_spawns_;
+  bool gpu_particles_reset_;
+  // Changes whenever the static part of the scene would, so PopulateScene()
+  // knows to rebuild it. See SceneDescription::static_version().
+  uint32_t static_scene_version_;
+  // Scratch memory for AdvanceFrame() and PopulateScene(). Each resets it on
+  // entry, so nothing allocated from it outlives the call.
+  mutable FrameArena frame_arena_;
+  // Accessory layouts from the last PopulateScene(), indexed by character id.
+  mutable std::vector<AccessoryLayout> accessory_layouts_;
+
+  // The matrices PopulateScene() last calculated for each character.
+  mutable std::vector<CharacterTransform> character_transforms_;
+  // Character ids from farthest to closest to the camera, as of the last
+  // PopulateScene(). The order barely changes between frames, so it is
+  // fixed up in place instead of sorted from scratch.
+  mutable std::vector<CharacterId> depth_order_;
+  // Count impel_engine_'s and frame_arena_'s memory, as of the last
+  // AdvanceFrame().
+  TrackedMemory impel_memory_;
+  TrackedMemory arena_memory_;
 };
 
 }  // pie_noon
@@ -41,6 +41,14 @@ static const float kAnalogDeadZone = 0.25f;
 
 void GamepadController::AdvanceFrame(WorldTime /*delta_time*/) {
   went_down_ = went_up_ = 0;
+  ReadGamepad();
+}
+
+void GamepadController::LatchInput() {
+  ReadGamepad();
+}
+
+void GamepadController::ReadGamepad() {
   Gamepad gamepad = input_system_->GetGamepad(controller_id_);
   SetLogicalInputs(LogicalInputs_Up,
                    gamepad.GetButton(Gamepad::kUp).is_down());
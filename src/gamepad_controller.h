@@ -44,7 +44,13 @@ class GamepadController : public Controller {
   // Map the input from the physical inputs to logical game inputs.
   virtual void AdvanceFrame(WorldTime delta_time);
 
+  // Read the gamepad again, keeping the edges seen since AdvanceFrame().
+  virtual void LatchInput();
+
  private:
+  // Update the logical inputs from the gamepad's current button state.
+  void ReadGamepad();
+
   // A pointer to the object to query for the current input state.
   InputSystem* input_system_;
 
@@ -0,0 +1,124 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "gl_stats.h"
+
+#include <string.h>
+
+namespace fpl {
+
+namespace internal {
+bool gl_stats_enabled = false;
+}  // internal
+
+static GLCallStats current_stats;
+static GLCallStats last_frame_stats;
+
+// Call names, without their gl or fpl prefix, that start with each prefix.
+// The first match wins, so a prefix comes before any shorter prefix of it.
+struct CategoryPrefix {
+  const char *prefix;
+  GLCallCategory category;
+};
+
+static const CategoryPrefix kCategoryPrefixes[] = {
+  { "Draw", kGLCallDraw },
+  { "MultiDraw", kGLCallDraw },
+  { "UseProgram", kGLCallProgram },
+  { "BindTexture", kGLCallTexture },
+  { "ActiveTexture", kGLCallTexture },
+  { "Uniform", kGLCallUniform },
+  { "BindBuffer", kGLCallBuffer },
+  { "BindVertexArray", kGLCallBuffer },
+  { "VertexAttrib", kGLCallBuffer },
+  { "EnableVertexAttribArray", kGLCallBuffer },
+  { "DisableVertexAttribArray", kGLCallBuffer },
+  { "Enable", kGLCallState },
+  { "Disable", kGLCallState },
+  { "Blend", kGLCallState },
+  { "Depth", kGLCallState },
+  { "CullFace", kGLCallState },
+  { "FrontFace", kGLCallState },
+  { "ColorMask", kGLCallState },
+  { "Viewport", kGLCallState },
+  { "Scissor", kGLCallState },
+  { "BindFramebuffer", kGLCallState },
+  { "BufferData", kGLCallUpload },
+  { "BufferSubData", kGLCallUpload },
+  { "TexImage2D", kGLCallUpload },
+  { "TexSubImage2D", kGLCallUpload },
+  { "CompressedTex", kGLCallUpload },
+};
+
+static const char *kCategoryNames[kGLCallCategoryCount] = {
+  "draws", "programs", "textures", "uniforms", "buffers", "state", "uploads",
+  "other"
+};
+
+static bool StartsWith(const char *s, const char *prefix) {
+  return strncmp(s, prefix, strlen(prefix)) == 0;
+}
+
+void EnableGLStats(bool enable) {
+  internal::gl_stats_enabled = enable;
+  current_stats = GLCallStats();
+  last_frame_stats = GLCallStats();
+}
+
+GLCallCategory CategorizeGLCall(const char *call) {
+  while (*call == ' ') ++call;
+  if (StartsWith(call, "gl")) {
+    call += 2;
+  } else if (StartsWith(call, "fpl")) {
+    call += 3;
+  } else {
+    return kGLCallOther;
+  }
+  const size_t num_prefixes =
+      sizeof(kCategoryPrefixes) / sizeof(kCategoryPrefixes[0]);
+  for (size_t i = 0; i < num_prefixes; ++i) {
+    if (StartsWith(call, kCategoryPrefixes[i].prefix)) {
+      return kCategoryPrefixes[i].category;
+    }
+  }
+  return kGLCallOther;
+}
+
+const char *GLCallCategoryName(GLCallCategory category) {
+  return kCategoryNames[category];
+}
+
+void CountGLCall(GLCallCategory category) {
+  if (internal::gl_stats_enabled) current_stats.calls[category]++;
+}
+
+void CountGLBufferUpload(size_t bytes) {
+  if (internal::gl_stats_enabled) current_stats.buffer_upload_bytes += bytes;
+}
+
+void CountGLTextureUpload(size_t bytes) {
+  if (internal::gl_stats_enabled) current_stats.texture_upload_bytes += bytes;
+}
+
+void AdvanceGLStatsFrame() {
+  last_frame_stats = current_stats;
+  current_stats = GLCallStats();
+}
+
+const GLCallStats &LastFrameGLStats() {
+  return last_frame_stats;
+}
+
+}  // fpl
@@ -0,0 +1,84 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef FPL_GL_STATS_H
+#define FPL_GL_STATS_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace fpl {
+
+// Counts the GL calls made each frame, by category, so that redundant state
+// changes show up without an external GPU debugger. Every GL_CALL counts
+// itself while the stats are enabled; see glplatform.h. The bytes uploaded
+// can't be seen from the call, so the uploads report them with
+// CountGLBufferUpload() and CountGLTextureUpload().
+//
+// GL calls are only made on the thread that owns the context, so none of
+// this is thread safe.
+enum GLCallCategory {
+  kGLCallDraw,
+  kGLCallProgram,
+  kGLCallTexture,
+  kGLCallUniform,
+  kGLCallBuffer,
+  kGLCallState,
+  kGLCallUpload,
+  kGLCallOther,
+  kGLCallCategoryCount
+};
+
+struct GLCallStats {
+  GLCallStats() : buffer_upload_bytes(0), texture_upload_bytes(0) {
+    for (int i = 0; i < kGLCallCategoryCount; ++i) calls[i] = 0;
+  }
+
+  int calls[kGLCallCategoryCount];
+  uint64_t buffer_upload_bytes;
+  uint64_t texture_upload_bytes;
+};
+
+namespace internal {
+extern bool gl_stats_enabled;
+}  // internal
+
+// Start or stop counting.
+void EnableGLStats(bool enable);
+inline bool GLStatsEnabled() { return internal::gl_stats_enabled; }
+
+// The category of a GL call, from its text, such as
+// "glBindTexture(GL_TEXTURE_2D, id)". Both the gl and fpl prefixes are
+// understood. GL_CALL looks each call site up once.
+GLCallCategory CategorizeGLCall(const char *call);
+
+// Short name of 'category', such as "draws".
+const char *GLCallCategoryName(GLCallCategory category);
+
+// Add to the counts of the frame in progress. Do nothing while disabled.
+void CountGLCall(GLCallCategory category);
+void CountGLBufferUpload(size_t bytes);
+void CountGLTextureUpload(size_t bytes);
+
+// Finish the frame in progress, and start counting a new one. Called by
+// Renderer::AdvanceFrame().
+void AdvanceGLStatsFrame();
+
+// The counts of the last finished frame.
+const GLCallStats &LastFrameGLStats();
+
+}  // fpl
+
+#endif  // FPL_GL_STATS_H
@@ -45,7 +45,8 @@
         #include <GL/glext.h>
         #ifdef _WIN32
             #define GLBASEEXTS \
-                GLEXT(PFNGLACTIVETEXTUREARBPROC       , glActiveTexture           )
+                GLEXT(PFNGLACTIVETEXTUREARBPROC       , glActiveTexture           ) \
+                GLEXT(PFNGLCOMPRESSEDTEXIMAGE2DARBPROC, glCompressedTexImage2D    )
         #else
             #define GLBASEEXTS
         #endif
@@ -88,7 +89,17 @@
             GLEXT(PFNGLUNIFORMMATRIX4FVARBPROC/*type*/, glUniformMatrix3x4fv      ) \
             GLEXT(PFNGLBINDATTRIBLOCATIONARBPROC      , glBindAttribLocation      ) \
             GLEXT(PFNGLGETACTIVEUNIFORMARBPROC        , glGetActiveUniform        ) \
-            GLEXT(PFNGLGENERATEMIPMAPEXTPROC          , glGenerateMipmap          )
+            GLEXT(PFNGLGENERATEMIPMAPEXTPROC          , glGenerateMipmap          ) \
+            GLEXT(PFNGLGENFRAMEBUFFERSEXTPROC         , glGenFramebuffers         ) \
+            GLEXT(PFNGLBINDFRAMEBUFFEREXTPROC         , glBindFramebuffer         ) \
+            GLEXT(PFNGLDELETEFRAMEBUFFERSEXTPROC      , glDeleteFramebuffers      ) \
+            GLEXT(PFNGLFRAMEBUFFERTEXTURE2DEXTPROC    , glFramebufferTexture2D    ) \
+            GLEXT(PFNGLFRAMEBUFFERRENDERBUFFEREXTPROC , glFramebufferRenderbuffer ) \
+            GLEXT(PFNGLCHECKFRAMEBUFFERSTATUSEXTPROC  , glCheckFramebufferStatus  ) \
+            GLEXT(PFNGLGENRENDERBUFFERSEXTPROC        , glGenRenderbuffers        ) \
+            GLEXT(PFNGLBINDRENDERBUFFEREXTPROC        , glBindRenderbuffer        ) \
+            GLEXT(PFNGLDELETERENDERBUFFERSEXTPROC     , glDeleteRenderbuffers     ) \
+            GLEXT(PFNGLRENDERBUFFERSTORAGEEXTPROC     , glRenderbufferStorage     )
 
         #define GLEXT(type, name) extern type name;
             GLBASEEXTS
@@ -97,15 +108,131 @@
     #endif
 #endif
 
+// Instanced drawing is core in GLES3 and GL3.3, but only an extension in the
+// GLES2 and GL2.1 contexts we create, so it is looked up at runtime by
+// Renderer::Initialize(). Both pointers stay null if the driver lacks it.
+#ifdef PLATFORM_MOBILE
+    #define FPL_GL_APIENTRY GL_APIENTRY
+#else
+    #ifndef APIENTRY
+        #define APIENTRY
+    #endif
+    #define FPL_GL_APIENTRY APIENTRY
+#endif
+typedef void (FPL_GL_APIENTRY *PFNFPLVERTEXATTRIBDIVISORPROC)(
+    GLuint index, GLuint divisor);
+typedef void (FPL_GL_APIENTRY *PFNFPLDRAWELEMENTSINSTANCEDPROC)(
+    GLenum mode, GLsizei count, GLenum type, const void *indices,
+    GLsizei primcount);
+extern PFNFPLVERTEXATTRIBDIVISORPROC fplVertexAttribDivisor;
+extern PFNFPLDRAWELEMENTSINSTANCEDPROC fplDrawElementsInstanced;
+
+// Vertex array objects are looked up the same way: core in GLES3, and an
+// extension in GLES2 (OES_vertex_array_object) and GL2.1
+// (ARB_vertex_array_object or APPLE_vertex_array_object). All three pointers
+// stay null if the driver lacks them.
+typedef void (FPL_GL_APIENTRY *PFNFPLGENVERTEXARRAYSPROC)(
+    GLsizei n, GLuint *arrays);
+typedef void (FPL_GL_APIENTRY *PFNFPLBINDVERTEXARRAYPROC)(GLuint array);
+typedef void (FPL_GL_APIENTRY *PFNFPLDELETEVERTEXARRAYSPROC)(
+    GLsizei n, const GLuint *arrays);
+extern PFNFPLGENVERTEXARRAYSPROC fplGenVertexArrays;
+extern PFNFPLBINDVERTEXARRAYPROC fplBindVertexArray;
+extern PFNFPLDELETEVERTEXARRAYSPROC fplDeleteVertexArrays;
+
+// Timer queries, which measure how long the GPU takes over a range of
+// commands, are looked up the same way: EXT_disjoint_timer_query on GLES2,
+// and ARB_timer_query or EXT_timer_query on GL2.1. All the pointers stay null
+// if the driver lacks them. The enums are defined here since not every
+// header has them.
+#define FPL_GL_QUERY_RESULT 0x8866
+#define FPL_GL_QUERY_RESULT_AVAILABLE 0x8867
+#define FPL_GL_TIME_ELAPSED 0x88BF
+#define FPL_GL_GPU_DISJOINT 0x8FBB
+typedef void (FPL_GL_APIENTRY *PFNFPLGENQUERIESPROC)(GLsizei n, GLuint *ids);
+typedef void (FPL_GL_APIENTRY *PFNFPLDELETEQUERIESPROC)(
+    GLsizei n, const GLuint *ids);
+typedef void (FPL_GL_APIENTRY *PFNFPLBEGINQUERYPROC)(GLenum target, GLuint id);
+typedef void (FPL_GL_APIENTRY *PFNFPLENDQUERYPROC)(GLenum target);
+typedef void (FPL_GL_APIENTRY *PFNFPLGETQUERYOBJECTUIVPROC)(
+    GLuint id, GLenum pname, GLuint *params);
+typedef void (FPL_GL_APIENTRY *PFNFPLGETQUERYOBJECTUI64VPROC)(
+    GLuint id, GLenum pname, uint64_t *params);
+extern PFNFPLGENQUERIESPROC fplGenQueries;
+extern PFNFPLDELETEQUERIESPROC fplDeleteQueries;
+extern PFNFPLBEGINQUERYPROC fplBeginQuery;
+extern PFNFPLENDQUERYPROC fplEndQuery;
+extern PFNFPLGETQUERYOBJECTUIVPROC fplGetQueryObjectuiv;
+extern PFNFPLGETQUERYOBJECTUI64VPROC fplGetQueryObjectui64v;
+
+// Program binaries, which save and restore linked shader programs, are
+// looked up the same way: core in GLES3, and an extension in GLES2
+// (OES_get_program_binary) and GL2.1 (ARB_get_program_binary). Both pointers
+// stay null if the driver lacks them, or has no binary formats.
+// fplProgramParameteri, for the retrievable hint, is not in the GLES2
+// extension, so it may be null even when the others are not.
+#define FPL_GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define FPL_GL_PROGRAM_BINARY_LENGTH 0x8741
+#define FPL_GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+typedef void (FPL_GL_APIENTRY *PFNFPLGETPROGRAMBINARYPROC)(
+    GLuint program, GLsizei buffer_size, GLsizei *length, GLenum *format,
+    void *binary);
+typedef void (FPL_GL_APIENTRY *PFNFPLPROGRAMBINARYPROC)(
+    GLuint program, GLenum format, const void *binary, GLsizei length);
+typedef void (FPL_GL_APIENTRY *PFNFPLPROGRAMPARAMETERIPROC)(
+    GLuint program, GLenum pname, GLint value);
+extern PFNFPLGETPROGRAMBINARYPROC fplGetProgramBinary;
+extern PFNFPLPROGRAMBINARYPROC fplProgramBinary;
+extern PFNFPLPROGRAMPARAMETERIPROC fplProgramParameteri;
+
+// Pixel buffer objects, which texture uploads can read from instead of
+// client memory, are looked up the same way: core in GLES3, and
+// ARB_pixel_buffer_object with ARB_map_buffer_range and ARB_sync on GL2.1.
+// The fences tell when the driver has finished reading a buffer. All the
+// pointers stay null if the driver lacks any of them.
+#define FPL_GL_PIXEL_UNPACK_BUFFER 0x88EC
+#define FPL_GL_MAP_WRITE_BIT 0x0002
+#define FPL_GL_MAP_INVALIDATE_BUFFER_BIT 0x0008
+#define FPL_GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define FPL_GL_ALREADY_SIGNALED 0x911A
+#define FPL_GL_CONDITION_SATISFIED 0x911C
+typedef struct FplGLSync *FPLGLsync;
+typedef void *(FPL_GL_APIENTRY *PFNFPLMAPBUFFERRANGEPROC)(
+    GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef GLboolean (FPL_GL_APIENTRY *PFNFPLUNMAPBUFFERPROC)(GLenum target);
+typedef FPLGLsync (FPL_GL_APIENTRY *PFNFPLFENCESYNCPROC)(
+    GLenum condition, GLbitfield flags);
+typedef GLenum (FPL_GL_APIENTRY *PFNFPLCLIENTWAITSYNCPROC)(
+    FPLGLsync sync, GLbitfield flags, uint64_t timeout);
+typedef void (FPL_GL_APIENTRY *PFNFPLDELETESYNCPROC)(FPLGLsync sync);
+extern PFNFPLMAPBUFFERRANGEPROC fplMapBufferRange;
+extern PFNFPLUNMAPBUFFERPROC fplUnmapBuffer;
+extern PFNFPLFENCESYNCPROC fplFenceSync;
+extern PFNFPLCLIENTWAITSYNCPROC fplClientWaitSync;
+extern PFNFPLDELETESYNCPROC fplDeleteSync;
+
+#include "gl_stats.h"
+
+// Count 'call' in the GL stats, when they are enabled. Each call site works
+// out its category the first time it is counted.
+#define FPL_COUNT_GL_CALL(call) \
+    if (fpl::GLStatsEnabled()) { \
+      static const fpl::GLCallCategory fpl_gl_call_category = \
+          fpl::CategorizeGLCall(#call); \
+      fpl::CountGLCall(fpl_gl_call_category); \
+    }
+
 // Define a GL_CALL macro to wrap each (void-returning) OpenGL call.
-// This logs GL error when LOG_GL_ERRORS below is defined.
+// This logs GL error when LOG_GL_ERRORS below is defined, and counts the
+// call when GL stats are enabled.
 #if defined(_DEBUG) || DEBUG==1
     #define LOG_GL_ERRORS
 #endif
 #ifdef LOG_GL_ERRORS
-    #define GL_CALL(call) { call; LogGLError(__FILE__, __LINE__, #call); }
+    #define GL_CALL(call) { \
+      call; FPL_COUNT_GL_CALL(call) LogGLError(__FILE__, __LINE__, #call); }
 #else
-    #define GL_CALL(call) call
+    #define GL_CALL(call) { call; FPL_COUNT_GL_CALL(call) }
 #endif
 
 // The error checking function used by the GL_CALL macro above,
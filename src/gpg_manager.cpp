@@ -13,14 +13,29 @@
 // limitations under the License.
 
 #include "precompiled.h"
+#include <chrono>
 #include "gpg_manager.h"
 
 //#define NO_GPG
 
 namespace fpl {
 
+const int GPGManager::kUploadIntervalSeconds;
+
 GPGManager::GPGManager() : state_(kStart), do_ui_login_(false),
-                           delayed_login_(false) {}
+                           delayed_login_(false), flush_requested_(false),
+                           quit_(false) {}
+
+// Send whatever is still queued, while game_services_ is still around.
+GPGManager::~GPGManager() {
+  if (!upload_thread_.joinable()) return;
+  {
+    std::lock_guard<std::mutex> lock(upload_mutex_);
+    quit_ = true;
+  }
+  upload_requested_.notify_one();
+  upload_thread_.join();
+}
 
 pthread_mutex_t GPGManager::events_mutex_ = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t GPGManager::achievements_mutex_ = PTHREAD_MUTEX_INITIALIZER;
@@ -92,9 +107,68 @@ bool GPGManager::Initialize(bool ui_login) {
   }
 
   SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "GPG: created GameServices");
+  StartUploadThread();
   return true;
 }
 
+void GPGManager::StartUploadThread() {
+  if (upload_thread_.joinable()) return;
+  upload_thread_ = std::thread(&GPGManager::UploadThreadMain, this);
+}
+
+// Wait for a flush, the timer or the quit, and send everything queued. The
+// queue is swapped out so the game can keep adding to it while GPG is busy.
+void GPGManager::UploadThreadMain() {
+  std::unique_lock<std::mutex> lock(upload_mutex_);
+  bool quit = false;
+  while (!quit) {
+    upload_requested_.wait_for(
+        lock, std::chrono::seconds(kUploadIntervalSeconds),
+        [this]() { return flush_requested_ || quit_; });
+    quit = quit_;
+    flush_requested_ = false;
+    PendingUploads uploads;
+    std::swap(uploads, pending_);
+    lock.unlock();
+    Upload(uploads);
+    lock.lock();
+  }
+}
+
+void GPGManager::Upload(const PendingUploads& uploads) {
+  if (LoggedIn()) {
+    for (auto it = uploads.events.begin(); it != uploads.events.end(); ++it) {
+      game_services_->Events().Increment(it->first, it->second);
+    }
+    for (auto it = uploads.achievement_steps.begin();
+         it != uploads.achievement_steps.end(); ++it) {
+      game_services_->Achievements().Increment(it->first, it->second);
+    }
+    for (size_t i = 0; i < uploads.unlocked_achievements.size(); ++i) {
+      game_services_->Achievements().Unlock(uploads.unlocked_achievements[i]);
+    }
+    for (size_t i = 0; i < uploads.revealed_achievements.size(); ++i) {
+      game_services_->Achievements().Reveal(uploads.revealed_achievements[i]);
+    }
+  }
+  for (size_t i = 0; i < uploads.after_upload.size(); ++i) {
+    uploads.after_upload[i]();
+  }
+}
+
+void GPGManager::Flush() {
+  {
+    std::lock_guard<std::mutex> lock(upload_mutex_);
+    flush_requested_ = true;
+  }
+  upload_requested_.notify_one();
+}
+
+void GPGManager::RunAfterUpload(const std::function<void()>& fn) {
+  std::lock_guard<std::mutex> lock(upload_mutex_);
+  pending_.after_upload.push_back(fn);
+}
+
 // Called every frame from the game, to see if there's anything to be done
 // with the async progress from gpg
 void GPGManager::Update() {
@@ -178,8 +252,9 @@ void GPGManager::IncrementEvent(const char *event_id, uint64_t score) {
 # ifdef NO_GPG
   return;
 # endif
-  if (!LoggedIn()) return;
-  game_services_->Events().Increment(event_id, score);
+  if (!LoggedIn() || score == 0) return;
+  std::lock_guard<std::mutex> lock(upload_mutex_);
+  pending_.events[event_id] += score;
 }
 
 // This is still somewhat game-specific.  (Because it assumes that your
@@ -189,6 +264,11 @@ void GPGManager::ShowLeaderboards(const GPGIds *ids, size_t id_len) {
   return;
 # endif
   if (!LoggedIn()) return;
+  RunAfterUpload([id_len, ids, this]() { ShowLeaderboardsNow(ids, id_len); });
+  Flush();
+}
+
+void GPGManager::ShowLeaderboardsNow(const GPGIds *ids, size_t id_len) {
   SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "GPG: launching leaderboard UI");
   // First, get all current event counts from GPG in one callback,
   // which allows us to conveniently update and show the leaderboards without
@@ -222,29 +302,30 @@ void GPGManager::ShowLeaderboards(const GPGIds *ids, size_t id_len) {
 // Unlocks a given achievement.
 void GPGManager::UnlockAchievement(std::string achievement_id) {
   if (LoggedIn()) {
-    game_services_->Achievements().Unlock(achievement_id);
+    std::lock_guard<std::mutex> lock(upload_mutex_);
+    pending_.unlocked_achievements.push_back(achievement_id);
   }
 }
 
 // Increments an incremental achievement.
 void GPGManager::IncrementAchievement(std::string achievement_id) {
-  if (LoggedIn()) {
-    game_services_->Achievements().Increment(achievement_id);
-  }
+  IncrementAchievement(achievement_id, 1);
 }
 
 // Increments an incremental achievement by an amount.
 void GPGManager::IncrementAchievement(std::string achievement_id,
                                       uint32_t steps) {
   if (LoggedIn()) {
-    game_services_->Achievements().Increment(achievement_id, steps);
+    std::lock_guard<std::mutex> lock(upload_mutex_);
+    pending_.achievement_steps[achievement_id] += steps;
   }
 }
 
 // Reveals a given achievement.
 void GPGManager::RevealAchievement(std::string achievement_id) {
   if (LoggedIn()) {
-    game_services_->Achievements().Reveal(achievement_id);
+    std::lock_guard<std::mutex> lock(upload_mutex_);
+    pending_.revealed_achievements.push_back(achievement_id);
   }
 }
 
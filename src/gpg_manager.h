@@ -15,6 +15,10 @@
 #ifndef GPG_MANAGER_H
 #define GPG_MANAGER_H
 
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
 #include "common.h"
 #include "pthread.h"
 #include "gpg/achievement_manager.h"
@@ -34,9 +38,15 @@ struct GPGKeyValuePair {
   uint64_t value;
 };
 
+// Event increments and achievement updates are queued, added up, and sent
+// to GPG from an upload thread, so the game loop never waits on GPG or JNI.
+// The queue is sent every kUploadIntervalSeconds, or sooner on Flush().
 class GPGManager {
  public:
+  static const int kUploadIntervalSeconds = 60;
+
   GPGManager();
+  ~GPGManager();
 
   // Start of initial initialization and auth.
   bool Initialize(bool ui_login);
@@ -57,6 +67,12 @@ class GPGManager {
   // player. Does nothing if not logged in.
   void IncrementEvent(const char *event_id, uint64_t score);
 
+  // Send the queued event increments and achievement updates now, on the
+  // upload thread. Returns without waiting for them.
+  void Flush();
+
+  // Shows the leaderboards once the queued events have been sent, so they
+  // include them.
   void ShowLeaderboards(const GPGIds *ids, size_t id_len);
   void ShowAchievements();
 
@@ -103,6 +119,37 @@ class GPGManager {
 
   void UpdatePlayerStats();
 
+  // Updates waiting to be sent to GPG. Increments of the same event or
+  // achievement are added together.
+  struct PendingUploads {
+    std::map<std::string, uint64_t> events;
+    std::map<std::string, uint32_t> achievement_steps;
+    std::vector<std::string> unlocked_achievements;
+    std::vector<std::string> revealed_achievements;
+
+    // Called once the updates above have been sent.
+    std::vector<std::function<void()>> after_upload;
+  };
+
+  void StartUploadThread();
+  void UploadThreadMain();
+  void Upload(const PendingUploads& uploads);
+  void ShowLeaderboardsNow(const GPGIds *ids, size_t id_len);
+
+  // Run 'fn' on the upload thread, after the updates queued so far are sent.
+  void RunAfterUpload(const std::function<void()>& fn);
+
+  std::thread upload_thread_;
+
+  // Guards everything below, up to and including quit_.
+  std::mutex upload_mutex_;
+
+  // Signalled on Flush(), and when the upload thread should quit.
+  std::condition_variable upload_requested_;
+  PendingUploads pending_;
+  bool flush_requested_;
+  bool quit_;
+
   // The stats the stats currently stored on the server.
   // Retrieved after authentication.
   bool event_data_initialized_;
@@ -0,0 +1,243 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include <cstddef>
+#include "gpu_particles.h"
+#include "material.h"
+#include "mesh.h"
+#include "renderer.h"
+#include "shader.h"
+
+namespace fpl {
+namespace pie_noon {
+
+static const int kVerticesPerParticle = 4;
+static const int kIndicesPerParticle = 6;
+
+// Byte offset of 'member' in GpuParticles::Vertex, as glVertexAttribPointer
+// takes it.
+#define VERTEX_OFFSET(member) \
+    reinterpret_cast<const GLvoid*>(offsetof(Vertex, member))
+
+static uint8_t ColorToByte(float c) {
+  return static_cast<uint8_t>(mathfu::Clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+const int GpuParticles::kMaxCapacity;
+
+GpuParticles::Ring::Ring()
+    : material(nullptr),
+      quad_bottom_left(mathfu::kZeros3f),
+      quad_size(mathfu::kZeros2f),
+      texture_bottom_left(mathfu::kZeros2f),
+      texture_top_right(mathfu::kZeros2f),
+      vbo(0),
+      next(0),
+      used(0),
+      expiry(0),
+      staged_first(0) {
+}
+
+GpuParticles::GpuParticles() : renderer_(nullptr), capacity_(0), ibo_(0) {
+}
+
+GpuParticles::~GpuParticles() {
+  for (size_t i = 0; i < rings_.size(); ++i) {
+    if (rings_[i].vbo) renderer_->DeleteBuffer(rings_[i].vbo);
+  }
+  if (ibo_) renderer_->DeleteBuffer(ibo_);
+}
+
+void GpuParticles::Initialize(Renderer* renderer, int num_renderables,
+                              int capacity) {
+  renderer_ = renderer;
+  rings_.resize(num_renderables);
+  capacity_ = mathfu::Clamp(capacity, 1, kMaxCapacity);
+}
+
+void GpuParticles::SetQuad(int renderable_id, Material* material,
+                           const vec3& bottom_left, const vec2& size,
+                           const vec2& texture_bottom_left,
+                           const vec2& texture_top_right) {
+  Ring& ring = rings_[renderable_id];
+  ring.material = material;
+  ring.quad_bottom_left = bottom_left;
+  ring.quad_size = size;
+  ring.texture_bottom_left = texture_bottom_left;
+  ring.texture_top_right = texture_top_right;
+}
+
+void GpuParticles::Add(const GpuParticleSpawn* spawns, int count) {
+  static const float kCorners[kVerticesPerParticle][2] = {
+    { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 0.0f, 1.0f }, { 1.0f, 1.0f }
+  };
+
+  for (int i = 0; i < count; ++i) {
+    const Particle& p = spawns[i].particle;
+    Ring& ring = rings_[p.renderable_id()];
+    if (ring.material == nullptr)
+      continue;
+
+    if (ring.staged.empty()) {
+      ring.staged_first = ring.next;
+    }
+    const vec4 tint = p.base_tint();
+    Vertex v;
+    v.position_and_spawn_time =
+        vec4(p.base_position(), static_cast<float>(spawns[i].spawn_time));
+    v.velocity = p.base_velocity();
+    v.acceleration_and_duration = vec4(p.acceleration(), p.duration());
+    v.tint[0] = ColorToByte(tint.x());
+    v.tint[1] = ColorToByte(tint.y());
+    v.tint[2] = ColorToByte(tint.z());
+    v.tint[3] = ColorToByte(tint.w());
+    v.orientation_and_fade = vec4(p.base_orientation(),
+                                  p.duration_of_fade_out());
+    v.rotation_and_shrink = vec4(p.rotational_velocity(),
+                                 p.duration_of_shrink_out());
+    v.scale = p.base_scale();
+    for (int corner = 0; corner < kVerticesPerParticle; ++corner) {
+      v.corner = vec2(kCorners[corner][0], kCorners[corner][1]);
+      ring.staged.push_back(v);
+    }
+
+    ring.used = std::max(ring.used, ring.next + 1);
+    ring.expiry = std::max(ring.expiry, spawns[i].spawn_time +
+                           static_cast<WorldTime>(p.duration()));
+
+    // Wrap around, overwriting the oldest particles.
+    ring.next++;
+    if (ring.next == capacity_) {
+      Flush(&ring);
+      ring.next = 0;
+    }
+  }
+
+  for (size_t i = 0; i < rings_.size(); ++i) {
+    Flush(&rings_[i]);
+  }
+}
+
+void GpuParticles::Flush(Ring* ring) {
+  if (ring->staged.empty())
+    return;
+
+  if (!ring->vbo) {
+    GL_CALL(glGenBuffers(1, &ring->vbo));
+    renderer_->BindBuffer(GL_ARRAY_BUFFER, ring->vbo);
+    GL_CALL(glBufferData(GL_ARRAY_BUFFER,
+                         capacity_ * kVerticesPerParticle * sizeof(Vertex),
+                         nullptr, GL_DYNAMIC_DRAW));
+  }
+  renderer_->BindBuffer(GL_ARRAY_BUFFER, ring->vbo);
+  GL_CALL(glBufferSubData(GL_ARRAY_BUFFER,
+      ring->staged_first * kVerticesPerParticle * sizeof(Vertex),
+      ring->staged.size() * sizeof(Vertex), &ring->staged[0]));
+  CountGLBufferUpload(ring->staged.size() * sizeof(Vertex));
+  ring->staged.clear();
+}
+
+void GpuParticles::Clear() {
+  for (size_t i = 0; i < rings_.size(); ++i) {
+    Ring& ring = rings_[i];
+    ring.next = 0;
+    ring.used = 0;
+    ring.expiry = 0;
+    ring.staged.clear();
+  }
+}
+
+void GpuParticles::Render(Renderer& renderer, Shader* shader,
+                          const mat4& camera_transform, WorldTime time) {
+  // The index buffer is the same for every ring, so build it once.
+  if (!ibo_) {
+    std::vector<unsigned short> indices(capacity_ * kIndicesPerParticle);
+    for (int i = 0; i < capacity_; ++i) {
+      const int v = i * kVerticesPerParticle;
+      unsigned short* quad = &indices[i * kIndicesPerParticle];
+      quad[0] = static_cast<unsigned short>(v);
+      quad[1] = static_cast<unsigned short>(v + 1);
+      quad[2] = static_cast<unsigned short>(v + 2);
+      quad[3] = static_cast<unsigned short>(v + 2);
+      quad[4] = static_cast<unsigned short>(v + 1);
+      quad[5] = static_cast<unsigned short>(v + 3);
+    }
+    GL_CALL(glGenBuffers(1, &ibo_));
+    renderer.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_);
+    GL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                         indices.size() * sizeof(unsigned short), &indices[0],
+                         GL_STATIC_DRAW));
+    CountGLBufferUpload(indices.size() * sizeof(unsigned short));
+  }
+
+  static const GLuint kAttributes[] = {
+    Mesh::kAttributePosition, Mesh::kAttributeNormal, Mesh::kAttributeTangent,
+    Mesh::kAttributeTexCoord, Mesh::kAttributeColor, Mesh::kAttributeParticle0,
+    Mesh::kAttributeParticle1, Mesh::kAttributeParticle2
+  };
+  static const int kNumAttributes =
+      static_cast<int>(sizeof(kAttributes) / sizeof(kAttributes[0]));
+
+  renderer.model_view_projection() = camera_transform;
+  renderer.color() = mathfu::kOnes4f;
+  for (size_t i = 0; i < rings_.size(); ++i) {
+    const Ring& ring = rings_[i];
+    if (!ring.vbo || ring.used == 0 || time >= ring.expiry)
+      continue;
+
+    ring.material->Set(renderer);
+    shader->Set(renderer);
+    shader->SetUniform("time", static_cast<float>(time));
+    shader->SetUniform("quad_bottom_left", ring.quad_bottom_left);
+    shader->SetUniform("quad_size", ring.quad_size);
+    shader->SetUniform("texture_bottom_left", ring.texture_bottom_left);
+    shader->SetUniform("texture_top_right", ring.texture_top_right);
+
+    const GLsizei stride = sizeof(Vertex);
+    renderer.BindBuffer(GL_ARRAY_BUFFER, ring.vbo);
+    for (int a = 0; a < kNumAttributes; ++a) {
+      GL_CALL(glEnableVertexAttribArray(kAttributes[a]));
+    }
+    GL_CALL(glVertexAttribPointer(Mesh::kAttributePosition, 4, GL_FLOAT,
+        false, stride, VERTEX_OFFSET(position_and_spawn_time)));
+    GL_CALL(glVertexAttribPointer(Mesh::kAttributeNormal, 3, GL_FLOAT,
+        false, stride, VERTEX_OFFSET(velocity)));
+    GL_CALL(glVertexAttribPointer(Mesh::kAttributeTangent, 4, GL_FLOAT,
+        false, stride, VERTEX_OFFSET(acceleration_and_duration)));
+    GL_CALL(glVertexAttribPointer(Mesh::kAttributeTexCoord, 2, GL_FLOAT,
+        false, stride, VERTEX_OFFSET(corner)));
+    GL_CALL(glVertexAttribPointer(Mesh::kAttributeColor, 4, GL_UNSIGNED_BYTE,
+        true, stride, VERTEX_OFFSET(tint)));
+    GL_CALL(glVertexAttribPointer(Mesh::kAttributeParticle0, 4, GL_FLOAT,
+        false, stride, VERTEX_OFFSET(orientation_and_fade)));
+    GL_CALL(glVertexAttribPointer(Mesh::kAttributeParticle1, 4, GL_FLOAT,
+        false, stride, VERTEX_OFFSET(rotation_and_shrink)));
+    GL_CALL(glVertexAttribPointer(Mesh::kAttributeParticle2, 3, GL_FLOAT,
+        false, stride, VERTEX_OFFSET(scale)));
+
+    renderer.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_);
+    GL_CALL(glDrawElements(GL_TRIANGLES, ring.used * kIndicesPerParticle,
+                           GL_UNSIGNED_SHORT, 0));
+
+    for (int a = 0; a < kNumAttributes; ++a) {
+      GL_CALL(glDisableVertexAttribArray(kAttributes[a]));
+    }
+  }
+}
+
+#undef VERTEX_OFFSET
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,130 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef GPU_PARTICLES_H
+#define GPU_PARTICLES_H
+
+#include <vector>
+#include "particles.h"
+
+namespace fpl {
+
+class Material;
+class Renderer;
+class Shader;
+
+namespace pie_noon {
+
+// Draws particles whose motion is evaluated in the vertex shader. Each
+// particle's spawn parameters are uploaded once, when it is added, and the
+// shader computes its position, orientation, fade and shrink from a single
+// time uniform. So drawing costs no per-particle CPU time.
+//
+// Every renderable has its own ring buffer of 'capacity' particles. When a
+// ring is full, the oldest particles are overwritten. Dead particles stay in
+// the buffer and are collapsed to nothing by the shader.
+class GpuParticles {
+ public:
+  // Most particles one ring can hold, since its quads are indexed with
+  // unsigned shorts.
+  static const int kMaxCapacity = 16384;
+
+  GpuParticles();
+  ~GpuParticles();
+
+  // Allocate nothing yet, but remember the size of each ring. Must be called
+  // before any other function. Buffers are bound and deleted through
+  // 'renderer', which must outlive this.
+  void Initialize(Renderer* renderer, int num_renderables, int capacity);
+
+  // Describe the quad drawn for particles of 'renderable_id', in the
+  // renderable's object space, and the material it is drawn with. Matches
+  // the cardboard front that the CPU particles are drawn with.
+  void SetQuad(int renderable_id, Material* material,
+               const mathfu::vec3& bottom_left, const mathfu::vec2& size,
+               const mathfu::vec2& texture_bottom_left,
+               const mathfu::vec2& texture_top_right);
+
+  // Upload 'count' new particles. Must be called on the render thread.
+  void Add(const GpuParticleSpawn* spawns, int count);
+
+  // Forget every particle. Used when the game time starts over.
+  void Clear();
+
+  // Draw every ring with live particles at world time 'time'. 'shader' is
+  // the particle shader; 'camera_transform' is the view projection matrix.
+  void Render(Renderer& renderer, Shader* shader,
+              const mathfu::mat4& camera_transform, WorldTime time);
+
+ private:
+  // Disallow copies. The buffers are owned.
+  GpuParticles(const GpuParticles&);
+  GpuParticles& operator=(const GpuParticles&);
+
+  // One corner of a particle's quad. Each particle's parameters are repeated
+  // in all four of its vertices, since GLES2 has no instancing. We use the
+  // _packed types to ensure SIMD doesn't ruin the layout.
+  struct Vertex {
+    mathfu::vec4_packed position_and_spawn_time;    // aPosition
+    mathfu::vec3_packed velocity;                   // aNormal
+    mathfu::vec4_packed acceleration_and_duration;  // aTangent
+    mathfu::vec2_packed corner;                     // aTexCoord
+    uint8_t tint[4];                                // aColor
+    mathfu::vec4_packed orientation_and_fade;       // aParticle0
+    mathfu::vec4_packed rotation_and_shrink;        // aParticle1
+    mathfu::vec3_packed scale;                      // aParticle2
+  };
+
+  struct Ring {
+    Ring();
+
+    // Set by SetQuad(). Rings without a material are never drawn.
+    Material* material;
+    mathfu::vec3 quad_bottom_left;
+    mathfu::vec2 quad_size;
+    mathfu::vec2 texture_bottom_left;
+    mathfu::vec2 texture_top_right;
+
+    // Created the first time a particle is added.
+    GLuint vbo;
+
+    // Slot that the next particle is written to.
+    int next;
+
+    // Slots [0, used) have been written since the last Clear().
+    int used;
+
+    // Time at which the last particle dies. Not drawn after this.
+    WorldTime expiry;
+
+    // Vertices not yet uploaded, starting at slot 'staged_first'.
+    std::vector<Vertex> staged;
+    int staged_first;
+  };
+
+  // Upload the staged vertices of 'ring'.
+  void Flush(Ring* ring);
+
+  Renderer* renderer_;
+  std::vector<Ring> rings_;
+  int capacity_;
+
+  // Two triangles per slot, shared by all rings.
+  GLuint ibo_;
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // GPU_PARTICLES_H
@@ -0,0 +1,159 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "precompiled.h"
+#include "gpu_profiler.h"
+
+namespace fpl {
+
+// Weight of each new frame in the moving averages. About the last 20 frames
+// count.
+static const double kSmoothing = 0.05;
+
+static const double kNanosecondsPerMillisecond = 1000000.0;
+
+const int GpuProfiler::kMaxPasses;
+const int GpuProfiler::kFrameLatency;
+
+GpuProfiler::GpuProfiler()
+    : enabled_(false), in_pass_(false), current_(0), num_passes_(0),
+      dropped_frames_(0) {
+  for (int i = 0; i < kFrameLatency; ++i) {
+    frames_[i].count = 0;
+  }
+}
+
+void GpuProfiler::Enable(bool enable) {
+  if (enable == enabled_) return;
+  if (!enable) {
+    ShutDown();
+    return;
+  }
+  if (fplGenQueries == nullptr) return;
+
+  for (int i = 0; i < kFrameLatency; ++i) {
+    GL_CALL(fplGenQueries(kMaxPasses, frames_[i].queries));
+    frames_[i].count = 0;
+  }
+  current_ = 0;
+  num_passes_ = 0;
+  dropped_frames_ = 0;
+  enabled_ = true;
+}
+
+void GpuProfiler::ShutDown() {
+  if (!enabled_) return;
+  EndPass();
+  for (int i = 0; i < kFrameLatency; ++i) {
+    GL_CALL(fplDeleteQueries(kMaxPasses, frames_[i].queries));
+    frames_[i].count = 0;
+  }
+  enabled_ = false;
+}
+
+void GpuProfiler::AdvanceFrame() {
+  if (!enabled_) return;
+  EndPass();
+  current_ = (current_ + 1) % kFrameLatency;
+  Frame &frame = frames_[current_];
+  ReadBack(frame);
+  frame.count = 0;
+}
+
+void GpuProfiler::BeginPass(const char *name) {
+  if (!enabled_ || in_pass_) return;
+  Frame &frame = frames_[current_];
+  const int pass = FindPass(name);
+  if (frame.count == kMaxPasses || pass < 0) return;
+  GL_CALL(fplBeginQuery(FPL_GL_TIME_ELAPSED, frame.queries[frame.count]));
+  frame.passes[frame.count] = pass;
+  in_pass_ = true;
+}
+
+void GpuProfiler::EndPass() {
+  if (!in_pass_) return;
+  GL_CALL(fplEndQuery(FPL_GL_TIME_ELAPSED));
+  frames_[current_].count++;
+  in_pass_ = false;
+}
+
+double GpuProfiler::FrameTime() const {
+  double total = 0.0;
+  for (int i = 0; i < num_passes_; ++i) {
+    total += pass_times_[i];
+  }
+  return total;
+}
+
+void GpuProfiler::LogTimes() const {
+  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+              "GPU frame: %.2fms, %d frames dropped\n", FrameTime(),
+              dropped_frames_);
+  for (int i = 0; i < num_passes_; ++i) {
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "  %-12s %.2fms\n",
+                pass_names_[i], pass_times_[i]);
+  }
+}
+
+// Returns the index of the pass called 'name', adding it if it is new, or
+// -1 if there are already kMaxPasses.
+int GpuProfiler::FindPass(const char *name) {
+  for (int i = 0; i < num_passes_; ++i) {
+    if (pass_names_[i] == name || strcmp(pass_names_[i], name) == 0)
+      return i;
+  }
+  if (num_passes_ == kMaxPasses) return -1;
+  pass_names_[num_passes_] = name;
+  pass_times_[num_passes_] = 0.0;
+  return num_passes_++;
+}
+
+// Fold the times of 'frame' into the averages, if they are ready.
+void GpuProfiler::ReadBack(Frame &frame) {
+  if (frame.count == 0) return;
+
+#ifdef PLATFORM_MOBILE
+  // Reading the flag clears it, and it covers every query in flight.
+  GLint disjoint = 0;
+  glGetIntegerv(FPL_GL_GPU_DISJOINT, &disjoint);
+  if (disjoint) {
+    dropped_frames_++;
+    return;
+  }
+#endif
+
+  // Queries finish in order, so the frame is done when its last one is.
+  GLuint available = 0;
+  GL_CALL(fplGetQueryObjectuiv(frame.queries[frame.count - 1],
+                               FPL_GL_QUERY_RESULT_AVAILABLE, &available));
+  if (!available) {
+    dropped_frames_++;
+    return;
+  }
+
+  double times[kMaxPasses] = { 0.0 };
+  for (int i = 0; i < frame.count; ++i) {
+    uint64_t nanoseconds = 0;
+    GL_CALL(fplGetQueryObjectui64v(frame.queries[i], FPL_GL_QUERY_RESULT,
+                                   &nanoseconds));
+    times[frame.passes[i]] +=
+        static_cast<double>(nanoseconds) / kNanosecondsPerMillisecond;
+  }
+  for (int i = 0; i < num_passes_; ++i) {
+    pass_times_[i] += (times[i] - pass_times_[i]) * kSmoothing;
+  }
+}
+
+}  // fpl
@@ -0,0 +1,98 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef FPL_GPU_PROFILER_H
+#define FPL_GPU_PROFILER_H
+
+namespace fpl {
+
+// Measures how long the GPU takes over each pass of a frame, with timer
+// queries. A pass is everything drawn between BeginPass() and EndPass().
+//
+// Results arrive a few frames late: the queries of a frame are only read
+// once kFrameLatency more frames have been issued, so that reading them
+// never waits for the GPU. Frames whose results still aren't ready then,
+// or that the driver reports as disjoint (for example, because the GPU
+// changed clock speed), are dropped.
+class GpuProfiler {
+ public:
+  // Most passes that one frame can time.
+  static const int kMaxPasses = 8;
+
+  // Frames between issuing a frame's queries and reading them back.
+  static const int kFrameLatency = 4;
+
+  GpuProfiler();
+
+  // Start or stop timing. Timing only starts if the driver has timer
+  // queries; see Renderer::SupportsTimerQueries(). Needs a GL context.
+  void Enable(bool enable);
+  bool enabled() const { return enabled_; }
+
+  // Free the queries. Called by Renderer::ShutDown().
+  void ShutDown();
+
+  // Read back whichever frame is kFrameLatency frames old, and start timing
+  // a new one. Called by Renderer::AdvanceFrame().
+  void AdvanceFrame();
+
+  // Time the GPU work issued until EndPass() under 'name', which must stay
+  // valid, such as a string literal. Passes can't nest. Passes with the same
+  // name in one frame add up.
+  void BeginPass(const char *name);
+  void EndPass();
+
+  // Passes seen since Enable(), in the order they first appeared.
+  int num_passes() const { return num_passes_; }
+  const char *pass_name(int pass) const { return pass_names_[pass]; }
+
+  // Moving average of the GPU time of 'pass', in milliseconds, and of all
+  // the passes together.
+  double PassTime(int pass) const { return pass_times_[pass]; }
+  double FrameTime() const;
+
+  // Frames dropped because their results weren't ready, or were disjoint.
+  int dropped_frames() const { return dropped_frames_; }
+
+  // Print the average time of each pass to the log.
+  void LogTimes() const;
+
+ private:
+  // The queries issued during one frame.
+  struct Frame {
+    GLuint queries[kMaxPasses];
+    int passes[kMaxPasses];
+    int count;
+  };
+
+  int FindPass(const char *name);
+  void ReadBack(Frame &frame);
+
+  bool enabled_;
+  bool in_pass_;
+
+  // Ring of frames in flight. current_ is the one being issued.
+  Frame frames_[kFrameLatency];
+  int current_;
+
+  const char *pass_names_[kMaxPasses];
+  double pass_times_[kMaxPasses];
+  int num_passes_;
+  int dropped_frames_;
+};
+
+}  // fpl
+
+#endif  // FPL_GPU_PROFILER_H
@@ -21,7 +21,13 @@
 namespace fpl {
 namespace pie_noon {
 
-GuiMenu::GuiMenu() {}
+GuiMenu::GuiMenu()
+    : menu_def_(nullptr),
+      input_(nullptr),
+      current_focus_(ButtonId_Undefined),
+      layout_window_size_(mathfu::kZeros2f),
+      layout_changed_(true),
+      time_elapsed_(0) {}
 
 static const char* TextureName(const ButtonTexture& button_texture) {
   const bool touch_screen = button_texture.touch_screen() != nullptr &&
@@ -37,6 +43,11 @@ static inline size_t ArrayLength(const T* array) {
 
 void GuiMenu::Setup(const UiGroup* menu_def, MaterialManager* matman) {
   ClearRecentSelections();
+  button_indices_.clear();
+  image_indices_.clear();
+  quads_.clear();
+  layout_window_size_ = mathfu::kZeros2f;
+  time_elapsed_ = 0;
   if (menu_def == nullptr) {
     button_list_.resize(0);
     image_list_.resize(0);
@@ -86,6 +97,7 @@ void GuiMenu::Setup(const UiGroup* menu_def, MaterialManager* matman) {
     button_list_[i].set_is_highlighted(true);
     button_list_[i].SetCannonicalWindowHeight(
         menu_def_->cannonical_window_height());
+    button_indices_.insert(std::make_pair(button_list_[i].GetId(), i));
   }
 
   // Initialize image_list_.
@@ -113,11 +125,13 @@ void GuiMenu::Setup(const UiGroup* menu_def, MaterialManager* matman) {
 
     image_list_[i].Initialize(image_def, materials, shader,
                               menu_def_->cannonical_window_height());
+    image_indices_.insert(std::make_pair(image_list_[i].GetId(), i));
   }
 }
 
 // Force the material manager to load all the textures and shaders
-// used in the UI group.
+// used in the UI group. The textures are pinned, so that menus never come
+// back on screen blank.
 void GuiMenu::LoadAssets(const UiGroup* menu_def, MaterialManager* matman) {
   const size_t length_button_list = ArrayLength(menu_def->button_list());
   matman->LoadShader(menu_def->default_shader()->c_str());
@@ -127,10 +141,11 @@ void GuiMenu::LoadAssets(const UiGroup* menu_def, MaterialManager* matman) {
     const size_t length_texture_normal = ArrayLength(button->texture_normal());
     for (size_t j = 0; j < length_texture_normal; j++) {
       const char* texture_name = TextureName(*button->texture_normal()->Get(j));
-      matman->LoadMaterial(texture_name);
+      matman->PinMaterial(matman->LoadMaterial(texture_name));
     }
     if (button->texture_pressed()) {
-      matman->LoadMaterial(TextureName(*button->texture_pressed()));
+      matman->PinMaterial(
+          matman->LoadMaterial(TextureName(*button->texture_pressed())));
     }
 
     if (button->shader() != nullptr) {
@@ -146,7 +161,8 @@ void GuiMenu::LoadAssets(const UiGroup* menu_def, MaterialManager* matman) {
     const StaticImageDef& image_def = *menu_def->static_image_list()->Get(i);
     const size_t length_texture = ArrayLength(image_def.texture());
     for (size_t j = 0; j < length_texture; ++j) {
-      matman->LoadMaterial(TextureName(*image_def.texture()->Get(j)));
+      matman->PinMaterial(
+          matman->LoadMaterial(TextureName(*image_def.texture()->Get(j))));
     }
     if (image_def.shader() != nullptr) {
       matman->LoadShader(image_def.shader()->c_str());
@@ -158,6 +174,7 @@ void GuiMenu::AdvanceFrame(WorldTime delta_time, InputSystem* input,
                            const vec2& window_size) {
   // Start every frame with a clean list of events.
   ClearRecentSelections();
+  time_elapsed_ += delta_time;
   for (size_t i = 0; i < button_list_.size(); i++) {
     TouchscreenButton& current_button = button_list_[i];
     current_button.AdvanceFrame(delta_time, input, window_size);
@@ -172,22 +189,14 @@ void GuiMenu::AdvanceFrame(WorldTime delta_time, InputSystem* input,
   }
 }
 
-// Utility function for finding indexes.
 TouchscreenButton* GuiMenu::FindButtonById(ButtonId id) {
-  for (size_t i = 0; i < button_list_.size(); i++) {
-    if (button_list_[i].GetId() == id)
-      return &button_list_[i];
-  }
-  return nullptr;
+  auto it = button_indices_.find(id);
+  return it == button_indices_.end() ? nullptr : &button_list_[it->second];
 }
 
-// Utility function for finding indexes.
 StaticImage* GuiMenu::FindImageById(ButtonId id) {
-  for (size_t i = 0; i < image_list_.size(); i++) {
-    if (image_list_[i].GetId() == id)
-      return &image_list_[i];
-  }
-  return nullptr;
+  auto it = image_indices_.find(id);
+  return it == image_indices_.end() ? nullptr : &image_list_[it->second];
 }
 
 // Utility function for clearing out the queue, since the syntax is weird.
@@ -205,14 +214,54 @@ MenuSelection GuiMenu::GetRecentSelection() {
   }
 }
 
-void GuiMenu::Render(Renderer* renderer) {
-  // Render touch controls, as long as the touch-controller is active.
+bool GuiMenu::LayoutChanged(const vec2& window_size) const {
+  if (window_size.x() != layout_window_size_.x() ||
+      window_size.y() != layout_window_size_.y()) {
+    return true;
+  }
+  for (size_t i = 0; i < image_list_.size(); i++) {
+    if (image_list_[i].layout_changed()) return true;
+  }
+  for (size_t i = 0; i < button_list_.size(); i++) {
+    if (button_list_[i].layout_changed()) return true;
+  }
+  return false;
+}
+
+void GuiMenu::Layout(const vec2& window_size) {
+  quads_.clear();
+  MenuQuad quad;
   for (size_t i = 0; i < image_list_.size(); i++) {
-    image_list_[i].Render(*renderer);
+    if (image_list_[i].Layout(window_size, &quad)) {
+      quads_.push_back(quad);
+    }
+    image_list_[i].clear_layout_changed();
   }
   for (size_t i = 0; i < button_list_.size(); i++) {
-    button_list_[i].Render(*renderer);
+    if (button_list_[i].Layout(window_size, &quad)) {
+      quads_.push_back(quad);
+    }
+    button_list_[i].clear_layout_changed();
+  }
+  layout_window_size_ = window_size;
+}
+
+void GuiMenu::Render(QuadBatch* batch) {
+  const vec2 window_size = vec2(batch->renderer()->window_size());
+  layout_changed_ = LayoutChanged(window_size);
+  if (layout_changed_) {
+    Layout(window_size);
+  }
+
+  // Only the highlighted button's quad moves from frame to frame.
+  const float pulse = sinf(static_cast<float>(time_elapsed_) / 100.0f);
+  for (size_t i = 0; i < quads_.size(); i++) {
+    const MenuQuad& quad = quads_[i];
+    const vec3 half_size = (quad.size + quad.pulse_size * pulse) * 0.5f;
+    batch->Add(quad.shader, quad.material, quad.center - half_size,
+               quad.center + half_size, vec2(0, 1), vec2(1, 0));
   }
+  batch->Flush();
 }
 
 // Accepts logical inputs, and navigates based on it.
@@ -48,20 +48,30 @@ class GuiMenu {
                     const vec2& window_size);
   void Setup(const UiGroup* menudef, MaterialManager* matman);
   void LoadAssets(const UiGroup* menu_def, MaterialManager* matman);
-  void Render(Renderer* renderer);
+  // Draw the images, then the buttons, through 'batch'. Flushes it before
+  // returning. The elements are only laid out again when one of them, or
+  // the window size, has changed since the last Render().
+  void Render(QuadBatch* batch);
   void AdvanceFrame(WorldTime delta_time);
   MenuSelection GetRecentSelection();
   void HandleControllerInput(uint32_t logical_input,
                              ControllerId controller_id);
   ButtonId GetFocus() const;
   void SetFocus(ButtonId new_focus);
+  // Return the button or image with 'id', or nullptr. Constant time.
   TouchscreenButton* FindButtonById(ButtonId id);
   StaticImage* FindImageById(ButtonId id);
   const UiGroup* menu_def() const { return menu_def_; }
 
+  // True if the last Render() had to lay the menu out again, because
+  // something in it changed. The focus pulse doesn't count.
+  bool layout_changed() const { return layout_changed_; }
+
  private:
   void ClearRecentSelections();
   void UpdateFocus(const flatbuffers::Vector<uint16_t>* destination_list);
+  bool LayoutChanged(const vec2& window_size) const;
+  void Layout(const vec2& window_size);
 
   const UiGroup* menu_def_;
   InputSystem* input_;
@@ -70,6 +80,19 @@ class GuiMenu {
   std::vector<TouchscreenButton> button_list_;
   std::vector<StaticImage> image_list_;
 
+  // Index into button_list_ and image_list_ of each ButtonId, if any.
+  std::map<ButtonId, size_t> button_indices_;
+  std::map<ButtonId, size_t> image_indices_;
+
+  // The visible images and buttons, in the order they're drawn, as of the
+  // last call to Layout().
+  std::vector<MenuQuad> quads_;
+
+  // Window size the quads_ were laid out for. Zero when they need to be
+  // laid out again regardless.
+  vec2 layout_window_size_;
+  bool layout_changed_;
+
   // Total Worldtime since the menu was initialized.
   // Used for animating selections and such.
   WorldTime time_elapsed_;
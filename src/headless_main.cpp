@@ -0,0 +1,219 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Plays many AI-only matches as fast as possible, with no window or audio,
+// and prints aggregate statistics. Used to evaluate balance and scoring rule
+// changes.
+//
+// Usage: pie_noon_headless [num_matches] [num_threads]
+
+#include "precompiled.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include "asset_archive.h"
+#include "character_state_machine.h"
+#include "character_state_machine_def_generated.h"
+#include "config_generated.h"
+#include "headless_match.h"
+#include "impel_processor_overshoot.h"
+#include "impel_processor_smooth.h"
+#include "impel_processor_smooth_fixed.h"
+#include "mapped_file.h"
+#include "utilities.h"
+
+using fpl::WorldTime;
+using fpl::pie_noon::CharacterStateMachineDef;
+using fpl::pie_noon::Config;
+using fpl::pie_noon::HeadlessMatch;
+using fpl::pie_noon::MatchResult;
+
+static const char kAssetsDir[] = "assets";
+static const char kConfigFileName[] = "config.bin";
+static const char kStateMachineFileName[] = "character_state_machine_def.bin";
+
+// Holds the flatbuffers, when build_assets.py packs them with --archives.
+static const char kDataArchiveFileName[] = "data.pak";
+
+static const int kDefaultNumMatches = 1000;
+
+// Step size when the config does not specify a fixed_update_time.
+static const WorldTime kDefaultStep = 10;
+
+// Matches that are not over after this much game time are abandoned.
+static const WorldTime kMaxMatchTime = 10 * 60 * 1000;
+
+static const char* kStatNames[] = {
+  "wins", "losses", "draws", "attacks", "hits", "blocks", "misses"
+};
+static_assert(sizeof(kStatNames) / sizeof(kStatNames[0]) ==
+              fpl::pie_noon::kMaxStats, "kStatNames out of date");
+
+// Sums of MatchResults.
+struct Totals {
+  explicit Totals(int num_characters)
+      : matches(0), timed_out(0), game_time(0),
+        scores(num_characters, 0),
+        stats(num_characters * fpl::pie_noon::kMaxStats, 0) {}
+
+  void Add(const MatchResult& result) {
+    matches++;
+    timed_out += result.timed_out ? 1 : 0;
+    game_time += result.duration;
+    for (size_t i = 0; i < scores.size(); ++i) {
+      scores[i] += result.scores[i];
+    }
+    for (size_t i = 0; i < stats.size(); ++i) {
+      stats[i] += result.stats[i];
+    }
+  }
+
+  void Add(const Totals& totals) {
+    matches += totals.matches;
+    timed_out += totals.timed_out;
+    game_time += totals.game_time;
+    for (size_t i = 0; i < scores.size(); ++i) {
+      scores[i] += totals.scores[i];
+    }
+    for (size_t i = 0; i < stats.size(); ++i) {
+      stats[i] += totals.stats[i];
+    }
+  }
+
+  int matches;
+  int timed_out;
+  int64_t game_time;
+  std::vector<int64_t> scores;
+  std::vector<uint64_t> stats;
+};
+
+// Play matches until 'next_match' reaches 'num_matches'.
+static void PlayMatches(const Config* config,
+                        const CharacterStateMachineDef* state_machine_def,
+                        int num_matches, std::atomic<int>* next_match,
+                        Totals* totals) {
+  const WorldTime step = config->fixed_update_time() > 0 ?
+                         config->fixed_update_time() : kDefaultStep;
+  HeadlessMatch match(*config, state_machine_def);
+  MatchResult result;
+  for (;;) {
+    const int match_index = next_match->fetch_add(1);
+    if (match_index >= num_matches)
+      break;
+    // Seeding with the index makes the totals independent of the number
+    // of threads.
+    match.Play(step, kMaxMatchTime, static_cast<uint32_t>(match_index),
+               &result);
+    totals->Add(result);
+  }
+}
+
+static void PrintTotals(const Totals& totals, double seconds) {
+  const double matches = static_cast<double>(totals.matches);
+  printf("matches: %d\n", totals.matches);
+  printf("timed out: %d\n", totals.timed_out);
+  printf("average match length: %.1fs\n",
+         static_cast<double>(totals.game_time) / matches / 1000.0);
+  printf("wall time: %.2fs\n", seconds);
+  printf("matches per second: %.1f\n", matches / seconds);
+  printf("\n");
+
+  printf("player,average_score");
+  for (int stat = 0; stat < fpl::pie_noon::kMaxStats; ++stat) {
+    printf(",%s", kStatNames[stat]);
+  }
+  printf("\n");
+  for (size_t i = 0; i < totals.scores.size(); ++i) {
+    printf("%d,%.2f", static_cast<int>(i) + 1,
+           static_cast<double>(totals.scores[i]) / matches);
+    for (int stat = 0; stat < fpl::pie_noon::kMaxStats; ++stat) {
+      printf(",%llu", static_cast<unsigned long long>(
+          totals.stats[i * fpl::pie_noon::kMaxStats + stat]));
+    }
+    printf("\n");
+  }
+}
+
+int main(int argc, char *argv[]) {
+  const char* binary_directory = argc > 0 ? argv[0] : "";
+  const int num_matches = argc > 1 ? atoi(argv[1]) : kDefaultNumMatches;
+  const int hardware_threads =
+      static_cast<int>(std::thread::hardware_concurrency());
+  const int num_threads = argc > 2 ? atoi(argv[2]) :
+                          hardware_threads > 0 ? hardware_threads : 1;
+  if (num_matches <= 0 || num_threads <= 0) {
+    fprintf(stderr, "usage: %s [num_matches] [num_threads]\n",
+            binary_directory);
+    return 1;
+  }
+
+  // Every match logs its winners. Only show problems.
+  SDL_LogSetAllPriority(SDL_LOG_PRIORITY_WARN);
+
+  if (!fpl::ChangeToUpstreamDir(binary_directory, kAssetsDir))
+    return 1;
+  fpl::MountAssetArchive(kDataArchiveFileName);
+
+  fpl::MappedFile config_file;
+  if (!config_file.Open(kConfigFileName)) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "can't load %s\n", kConfigFileName);
+    return 1;
+  }
+  const Config* config = fpl::pie_noon::GetConfig(config_file.data());
+
+  fpl::MappedFile state_machine_file;
+  if (!state_machine_file.Open(kStateMachineFileName)) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR,
+                 "Error loading character state machine.\n");
+    return 1;
+  }
+  const CharacterStateMachineDef* state_machine_def =
+      fpl::pie_noon::GetCharacterStateMachineDef(state_machine_file.data());
+  if (!fpl::pie_noon::CharacterStateMachineDef_Validate(state_machine_def)) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "State machine is invalid.\n");
+    return 1;
+  }
+
+  // Registration is global, so it must happen before the threads start.
+  impel::OvershootImpelProcessor::Register();
+  impel::SmoothImpelProcessor::Register();
+  impel::SmoothImpelProcessor3f::Register();
+  impel::SmoothFixedImpelProcessor::Register();
+
+  // Each thread plays whole matches and keeps its own totals, so the only
+  // shared state is the match counter.
+  const int num_characters = static_cast<int>(config->character_count());
+  std::vector<Totals> thread_totals(num_threads, Totals(num_characters));
+  std::vector<std::thread> threads;
+  std::atomic<int> next_match(0);
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < num_threads; ++i) {
+    threads.push_back(std::thread(PlayMatches, config, state_machine_def,
+                                  num_matches, &next_match,
+                                  &thread_totals[i]));
+  }
+  Totals totals(num_characters);
+  for (int i = 0; i < num_threads; ++i) {
+    threads[i].join();
+    totals.Add(thread_totals[i]);
+  }
+  const double seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+
+  PrintTotals(totals, seconds);
+  return 0;
+}
+
+MATHFU_DEFINE_GLOBAL_SIMD_AWARE_NEW_DELETE
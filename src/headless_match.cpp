@@ -0,0 +1,91 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "headless_match.h"
+
+namespace fpl {
+namespace pie_noon {
+
+HeadlessMatch::HeadlessMatch(
+    const Config& config, const CharacterStateMachineDef* state_machine_def)
+    : config_(config) {
+  runtime_config_.Initialize(config);
+  game_state_.set_config(&config, &runtime_config_);
+  for (unsigned int i = 0; i < config.character_count(); ++i) {
+    AiController* controller = new AiController();
+    controllers_.push_back(std::unique_ptr<AiController>(controller));
+    game_state_.characters().push_back(std::unique_ptr<Character>(
+        new Character(i, controller, config, state_machine_def, nullptr)));
+    controller->Initialize(&game_state_, &config, i);
+  }
+}
+
+// GameState::IsGameOver() ends a survival match as soon as no humans are
+// left standing, which is immediately when every player is an AI. Play until
+// one AI is left instead.
+bool HeadlessMatch::Finished() const {
+  if (config_.game_mode() == GameMode_Survival) {
+    return game_state_.pies().Count() == 0 &&
+           game_state_.NumActiveCharacters() <= 1;
+  }
+  return game_state_.IsGameOver();
+}
+
+void HeadlessMatch::Play(WorldTime step, WorldTime max_time, uint32_t seed,
+                         MatchResult* result) {
+  auto& characters = game_state_.characters();
+  game_state_.Reset();
+  game_state_.rng().Seed(seed);
+  for (size_t i = 0; i < characters.size(); ++i) {
+    characters[i]->set_score(0);
+    characters[i]->ResetStats();
+    controllers_[i]->Seed((static_cast<uint64_t>(seed) << 32) | i);
+  }
+
+  // Same order as PieNoonGame::Run(): the controllers decide, then the game
+  // reacts. Particles queued for the GPU are never drawn, so throw them away
+  // instead of letting the queue grow.
+  std::vector<GpuParticleSpawn> gpu_particle_spawns;
+  bool gpu_particles_reset = false;
+  while (!Finished() && game_state_.time() < max_time) {
+    for (size_t i = 0; i < controllers_.size(); ++i) {
+      controllers_[i]->AdvanceFrame(step);
+    }
+    game_state_.AdvanceFrame(step, nullptr);
+    gpu_particle_spawns.clear();
+    game_state_.MoveGpuParticleSpawns(&gpu_particle_spawns,
+                                      &gpu_particles_reset);
+  }
+
+  result->duration = game_state_.time();
+  result->timed_out = !Finished();
+  if (!result->timed_out) {
+    game_state_.DetermineWinnersAndLosers();
+  }
+
+  result->scores.resize(characters.size());
+  result->stats.resize(characters.size() * kMaxStats);
+  for (size_t i = 0; i < characters.size(); ++i) {
+    Character* character = characters[i].get();
+    result->scores[i] = character->score();
+    for (int stat = 0; stat < kMaxStats; ++stat) {
+      result->stats[i * kMaxStats + stat] =
+          character->GetStat(static_cast<PlayerStats>(stat));
+    }
+  }
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,75 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HEADLESS_MATCH_H_
+#define HEADLESS_MATCH_H_
+
+#include <memory>
+#include <vector>
+#include "ai_controller.h"
+#include "game_state.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Outcome of one HeadlessMatch::Play().
+struct MatchResult {
+  // Game time the match lasted.
+  WorldTime duration;
+
+  // True if the match hit the time limit before anyone won. Stats are still
+  // recorded, but there are no wins, losses, or draws.
+  bool timed_out;
+
+  // Score of each character at the end of the match.
+  std::vector<int> scores;
+
+  // PlayerStats of each character, character_count * kMaxStats entries.
+  // The stats for character i start at i * kMaxStats.
+  std::vector<uint64_t> stats;
+};
+
+// An AI-only match, simulated without rendering or audio. Used to evaluate
+// balance and scoring changes by playing many matches quickly.
+//
+// A HeadlessMatch is not thread safe, but independent matches share nothing
+// except the read-only Config and CharacterStateMachineDef, so many can be
+// played in parallel, one per thread.
+class HeadlessMatch {
+ public:
+  HeadlessMatch(const Config& config,
+                const CharacterStateMachineDef* state_machine_def);
+
+  // Play a fresh match until it is over, or until 'max_time' of game time has
+  // passed. The game is advanced in steps of 'step'. Matches played with the
+  // same 'seed' are identical.
+  void Play(WorldTime step, WorldTime max_time, uint32_t seed,
+            MatchResult* result);
+
+ private:
+  bool Finished() const;
+
+  const Config& config_;
+  RuntimeConfig runtime_config_;
+
+  // Declared before game_state_, since the characters refer to them.
+  std::vector<std::unique_ptr<AiController>> controllers_;
+
+  GameState game_state_;
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // HEADLESS_MATCH_H_
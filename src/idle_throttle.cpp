@@ -0,0 +1,41 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "idle_throttle.h"
+
+namespace fpl {
+
+IdleThrottle::IdleThrottle()
+    : idle_delay_(0.0), idle_period_(0.0), quiet_(false), quiet_start_(0.0) {}
+
+void IdleThrottle::Initialize(double idle_delay, double idle_period) {
+  idle_delay_ = idle_delay;
+  idle_period_ = idle_period;
+  quiet_ = false;
+}
+
+void IdleThrottle::Update(double now, bool quiet) {
+  if (!quiet) {
+    quiet_ = false;
+  } else if (!quiet_) {
+    quiet_ = true;
+    quiet_start_ = now;
+  }
+}
+
+bool IdleThrottle::Idle(double now) const {
+  return idle_period_ > 0.0 && quiet_ && now - quiet_start_ >= idle_delay_;
+}
+
+}  // fpl
@@ -0,0 +1,58 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IDLE_THROTTLE_H
+#define IDLE_THROTTLE_H
+
+namespace fpl {
+
+// Decides when the game may drop to a low frame rate to save power. Each
+// frame reports whether it was quiet: nothing on screen changed and there
+// was no input. Once the frames have been quiet for a while, the game is
+// idle, and should run a frame only every idle_period() seconds, or as soon
+// as input arrives. The first frame that isn't quiet ends the idle.
+//
+// Times are in seconds, from any fixed origin, like the FramePacer's.
+class IdleThrottle {
+ public:
+  IdleThrottle();
+
+  // Go idle after 'idle_delay' seconds of quiet frames, and then run one
+  // frame every 'idle_period' seconds. A zero 'idle_period' never idles.
+  void Initialize(double idle_delay, double idle_period);
+
+  // Call once a frame, when it is known whether it was quiet.
+  void Update(double now, bool quiet);
+
+  // End the idle immediately, for example on input.
+  void Wake() { quiet_ = false; }
+
+  // True if the game may run at the low rate at 'now'.
+  bool Idle(double now) const;
+
+  // Seconds between frames while idle.
+  double idle_period() const { return idle_period_; }
+
+ private:
+  double idle_delay_;
+  double idle_period_;
+
+  // Whether the frames have been quiet since 'quiet_start_'.
+  bool quiet_;
+  double quiet_start_;
+};
+
+}  // fpl
+
+#endif  // IDLE_THROTTLE_H
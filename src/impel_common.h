@@ -15,9 +15,11 @@
 #ifndef IMPEL_COMMON_H_
 #define IMPEL_COMMON_H_
 
+#include <cstddef>
 #include <cstdint>
 
 #include "mathfu/glsl_mappings.h"
+#include "memory_tracker.h"
 
 
 namespace impel {
@@ -25,17 +27,52 @@ namespace impel {
 
 class ImpelProcessorBase;
 
+// Run-time type information for an Impeller type. There is one of these per
+// derivation of ImpelInit. See IMPEL_INIT_REGISTER.
+struct ImpellerTypeInfo {
+  // Name of the ImpelInit derivation.
+  const char* name;
+
+  // Dense index of this type, assigned when the processor factory is
+  // registered with ImpelEngine. Lets the ImpelEngine keep its processors in
+  // a flat table. -1 until registered.
+  int index;
+};
+
 // Impeller type is used for run-time type information. It's implemented as a
-// pointer to a string, in each derivation of ImpelInit.
-typedef const char** ImpellerType;
+// pointer to the ImpellerTypeInfo in each derivation of ImpelInit.
+typedef ImpellerTypeInfo* ImpellerType;
 static const ImpellerType kImpelTypeInvalid = nullptr;
 
 // The ImpelId identifies an Impeller inside an ImpelProcessor. The
 // ImpelProcessor holds all Impellers of its type. Calls to Impellers are
 // proxied to the ImpelProcessor.
-typedef int16_t ImpelId;
+//
+// The low bits of an ImpelId are a slot in the processor's id table, and the
+// high bits are a generation count that changes every time the slot is
+// reused. Stale ids can therefore be detected. See IdMap.
+typedef int32_t ImpelId;
 static const ImpelId kImpelIdInvalid = -1;
 
+// Layout of the bits in an ImpelId. The sign bit is left clear so that no
+// valid id collides with kImpelIdInvalid. Allows for about one million live
+// Impellers per processor.
+static const int kImpelIdSlotBits = 20;
+static const int kImpelIdSlotMask = (1 << kImpelIdSlotBits) - 1;
+static const int kImpelIdGenerationMask =
+    (1 << (31 - kImpelIdSlotBits)) - 1;
+
+inline int ImpelIdSlot(ImpelId id) { return id & kImpelIdSlotMask; }
+inline int ImpelIdGeneration(ImpelId id) {
+  return (id >> kImpelIdSlotBits) & kImpelIdGenerationMask;
+}
+inline ImpelId ImpelIdFromSlot(int slot, int generation) {
+  return static_cast<ImpelId>((generation << kImpelIdSlotBits) | slot);
+}
+
+// Processors count their buffers the same way as the rest of the game.
+using fpl::VectorMemory;
+
 // Time units are defined by the user. We use integer instead of floating
 // point to avoid a loss of precision as time accumulates.
 typedef int ImpelTime;
@@ -54,30 +91,36 @@ struct ImpelInit {
 // a unique identifier for this type as kType. Your derivation's constructor
 // should construct base class with ImpelInit(kType).
 #define IMPEL_INIT_REGISTER() \
-    static const char* kName; \
+    static ImpellerTypeInfo kTypeInfo; \
     static const ImpellerType kType
 
 // Add this to your derivation's source file. It instantiates the static
 // variables declared in IMPEL_INIT_REGISTER. Example usage,
 //    IMPEL_INIT_INSTANTIATE(AwesomeImpelInit, "Awesome");
 #define IMPEL_INIT_INSTANTIATE(Type) \
-    const char* Type::kName = #Type; \
-    const ImpellerType Type::kType = &Type::kName
+    ImpellerTypeInfo Type::kTypeInfo = { #Type, -1 }; \
+    const ImpellerType Type::kType = &Type::kTypeInfo
 
 
+// Dimensions of the value types, and access to their components.
 template<class C> struct ValueDetails {};
 template<> struct ValueDetails<float> {
   static const int kDimensions = 1;
+  static float Component(float x, int /*i*/) { return x; }
+  static void SetComponent(int /*i*/, float c, float* x) { *x = c; }
 };
-template<> struct ValueDetails<mathfu::vec2> {
-  static const int kDimensions = 2;
-};
-template<> struct ValueDetails<mathfu::vec3> {
-  static const int kDimensions = 3;
-};
-template<> struct ValueDetails<mathfu::vec4> {
-  static const int kDimensions = 4;
+template<int d> struct VectorValueDetails {
+  static const int kDimensions = d;
+  static float Component(const mathfu::Vector<float, d>& x, int i) {
+    return x[i];
+  }
+  static void SetComponent(int i, float c, mathfu::Vector<float, d>* x) {
+    (*x)[i] = c;
+  }
 };
+template<> struct ValueDetails<mathfu::vec2> : public VectorValueDetails<2> {};
+template<> struct ValueDetails<mathfu::vec3> : public VectorValueDetails<3> {};
+template<> struct ValueDetails<mathfu::vec4> : public VectorValueDetails<4> {};
 template<> struct ValueDetails<mathfu::mat4> {
   static const int kDimensions = 16;
 };
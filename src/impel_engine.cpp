@@ -12,54 +12,111 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+
 #include "impel_engine.h"
 #include "impel_processor.h"
+#include "impel_simd.h"
+#include "impel_snapshot.h"
+#include "impel_worker_pool.h"
 
 namespace impel {
 
 // static
-ImpelEngine::FunctionMap ImpelEngine::function_map_;
+ImpelEngine::FunctionTable ImpelEngine::function_table_;
+
+// Processors with more lanes than this are split into several jobs when
+// running in parallel. Must be a multiple of kSimdWidth so that every chunk
+// starts on a SIMD boundary.
+static const int kLanesPerJob = 256;
+static_assert(kLanesPerJob % kSimdWidth == 0,
+              "Jobs must start on a SIMD boundary");
+
+ImpelEngine::ImpelEngine() : job_delta_time_(0) {
+}
+
+ImpelEngine::~ImpelEngine() {
+}
 
 // static
 void ImpelEngine::RegisterProcessorFactory(ImpellerType type,
                                            const ImpelProcessorFunctions& fns) {
-  function_map_.insert(FunctionPair(type, fns));
+  // Registering the same type twice keeps the original factory.
+  if (type->index >= 0)
+    return;
+
+  // Give the type the next dense index.
+  type->index = static_cast<int>(function_table_.size());
+  function_table_.push_back(fns);
 }
 
 void ImpelEngine::Reset() {
-  for (Map::iterator it = processors_.begin(); it != processors_.end(); ++it) {
+  for (size_t i = 0; i < processors_.size(); ++i) {
+    if (processors_[i] == nullptr)
+      continue;
+
     // Get the factory for each processor. Factory must exist since it is what
     // created the processor in the first place.
-    const ImpelProcessorFunctions& fns = function_map_.find(it->first)->second;
+    const ImpelProcessorFunctions& fns = function_table_[i];
 
     // Destroy each processor in turn.
-    fns.destroy(it->second);
-    it->second = nullptr;
+    fns.destroy(processors_[i]);
+    processors_[i] = nullptr;
   }
 
-  // Remove all elements from the map. Their processors have all been destroyed.
+  // Remove all elements from the table. Their processors have all been
+  // destroyed.
   processors_.clear();
 }
 
 ImpelProcessorBase* ImpelEngine::Processor(ImpellerType type) {
-  // If processor already exists, return it.
-  Map::iterator it = processors_.find(type);
-  if (it != processors_.end())
-    return it->second;
-
-  // Look up the processor-creation-function in the registry.
-  const auto function_pair = function_map_.find(type);
-  if (function_pair == function_map_.end())
+  // Types without a registered factory have no index.
+  if (type == kImpelTypeInvalid || type->index < 0)
     return nullptr;
-  const ImpelProcessorFunctions& fns = function_pair->second;
+  return ProcessorAtIndex(type->index);
+}
+
+ImpelProcessorBase* ImpelEngine::ProcessorAtIndex(int index) {
+  // If processor already exists, return it.
+  if (index < static_cast<int>(processors_.size()) &&
+      processors_[index] != nullptr)
+    return processors_[index];
 
   // Remember processor for next time. We only want at most one processor per
   // type in an engine.
+  const ImpelProcessorFunctions& fns = function_table_[index];
   ImpelProcessorBase* processor = fns.create();
-  processors_.insert(Pair(type, processor));
+  if (index >= static_cast<int>(processors_.size())) {
+    processors_.resize(index + 1, nullptr);
+  }
+  processors_[index] = processor;
+  return processor;
+}
+
+ImpelProcessorBase* ImpelEngine::InitializeMany(const ImpelInit& init,
+                                                int count, ImpelId* ids) {
+  ImpelProcessorBase* processor = Processor(init.type);
+  processor->InitializeImpellers(init, count, this, ids);
   return processor;
 }
 
+void ImpelEngine::Reserve(ImpellerType type, int count) {
+  ImpelProcessorBase* processor = Processor(type);
+  if (processor != nullptr) {
+    processor->Reserve(count);
+  }
+}
+
+size_t ImpelEngine::MemorySize() const {
+  size_t bytes = VectorMemory(processors_) + VectorMemory(jobs_);
+  for (auto it = processors_.begin(); it != processors_.end(); ++it) {
+    if (*it != nullptr) {
+      bytes += (*it)->MemorySize();
+    }
+  }
+  return bytes;
+}
+
 void ImpelEngine::AdvanceFrame(ImpelTime delta_time) {
   // Advance the simulation in each processor.
   // TODO: At some point, we'll want to do several passes. An item in
@@ -67,9 +124,99 @@ void ImpelEngine::AdvanceFrame(ImpelTime delta_time) {
   // which might in turn depend on the output of a *different* item in
   // processor A. In this case, we have to do two passes. For now, just
   // assume that one pass is sufficient.
-  for (Map::iterator it = processors_.begin(); it != processors_.end(); ++it) {
-    it->second->AdvanceFrame(delta_time);
+  if (!workers_) {
+    for (size_t i = 0; i < processors_.size(); ++i) {
+      if (processors_[i] != nullptr) {
+        processors_[i]->AdvanceFrame(delta_time);
+      }
+    }
+    EndFrame();
+    return;
   }
+
+  // Processors share no data, and neither do distinct lanes of one
+  // processor, so any split is safe.
+  jobs_.clear();
+  for (size_t i = 0; i < processors_.size(); ++i) {
+    ImpelProcessorBase* processor = processors_[i];
+    if (processor == nullptr)
+      continue;
+    const int num_lanes = processor->NumLanes();
+    if (num_lanes <= kLanesPerJob) {
+      const Job job = { processor, 0, -1 };
+      jobs_.push_back(job);
+      continue;
+    }
+    for (int begin = 0; begin < num_lanes; begin += kLanesPerJob) {
+      const Job job = { processor, begin,
+                        std::min(begin + kLanesPerJob, num_lanes) };
+      jobs_.push_back(job);
+    }
+  }
+
+  job_delta_time_ = delta_time;
+  workers_->Run(RunJob, this, static_cast<int>(jobs_.size()));
+  EndFrame();
+}
+
+void ImpelEngine::EndFrame() {
+  for (size_t i = 0; i < processors_.size(); ++i) {
+    if (processors_[i] != nullptr) {
+      processors_[i]->EndFrame();
+    }
+  }
+}
+
+void ImpelEngine::Snapshot(ImpelSnapshot* snapshot) const {
+  // Each processor's state is preceded by its dense type index, and the list
+  // is terminated by -1.
+  snapshot->Clear();
+  for (size_t i = 0; i < processors_.size(); ++i) {
+    if (processors_[i] == nullptr)
+      continue;
+    snapshot->WriteValue(static_cast<int32_t>(i));
+    processors_[i]->Snapshot(snapshot);
+  }
+  snapshot->WriteValue(static_cast<int32_t>(-1));
+}
+
+void ImpelEngine::Restore(const ImpelSnapshot& snapshot) {
+  ImpelSnapshotReader reader(snapshot);
+  for (;;) {
+    int32_t index = -1;
+    reader.ReadValue(&index);
+    if (index < 0)
+      break;
+    assert(index < static_cast<int32_t>(function_table_.size()));
+    ProcessorAtIndex(index)->Restore(&reader);
+  }
+  assert(reader.Done());
+}
+
+// static
+void ImpelEngine::RunJob(void* engine, int job_index) {
+  ImpelEngine* e = static_cast<ImpelEngine*>(engine);
+  const Job& job = e->jobs_[job_index];
+  if (job.end < 0) {
+    job.processor->AdvanceFrame(e->job_delta_time_);
+  } else {
+    job.processor->AdvanceLanes(e->job_delta_time_, job.begin, job.end);
+  }
+}
+
+void ImpelEngine::SetNumWorkerThreads(int num_threads) {
+  if (num_threads <= 0) {
+    workers_.reset();
+    return;
+  }
+  if (!workers_) {
+    workers_.reset(new ImpelWorkerPool());
+  }
+  workers_->SetNumThreads(num_threads);
+}
+
+int ImpelEngine::NumWorkerThreads() const {
+  return workers_ ? workers_->NumThreads() : 0;
 }
 
 } // namespace impel
@@ -15,7 +15,8 @@
 #ifndef IMPEL_ENGINE_H_
 #define IMPEL_ENGINE_H_
 
-#include <map>
+#include <memory>
+#include <vector>
 
 #include "impel_common.h"
 
@@ -23,6 +24,8 @@ namespace impel {
 
 
 class ImpelProcessorBase;
+class ImpelSnapshot;
+class ImpelWorkerPool;
 struct ImpelProcessorFunctions;
 
 // The engine holds all of the processors, and updates them all when
@@ -30,27 +33,88 @@ struct ImpelProcessorFunctions;
 // for scalability. The engine is not a singleton, but you should try to
 // minimize the number of engines in your game. As more Impellers are added to
 // the processors, you start to get economies of scale.
+//
+// By default, AdvanceFrame() steps the processors one after another on the
+// calling thread. Call SetNumWorkerThreads() to step them in parallel. Each
+// processor becomes one job, and processors with many lanes are split into
+// several jobs. AdvanceFrame() still returns only once every job is done.
 class ImpelEngine {
-  typedef std::map<ImpellerType, ImpelProcessorBase*> Map;
-  typedef std::pair<ImpellerType, ImpelProcessorBase*> Pair;
-  typedef std::map<ImpellerType, ImpelProcessorFunctions> FunctionMap;
-  typedef std::pair<ImpellerType, ImpelProcessorFunctions> FunctionPair;
+  typedef std::vector<ImpelProcessorBase*> ProcessorTable;
+  typedef std::vector<ImpelProcessorFunctions> FunctionTable;
  public:
+  ImpelEngine();
+  ~ImpelEngine();
+
   void Reset();
   ImpelProcessorBase* Processor(ImpellerType type);
   void AdvanceFrame(ImpelTime delta_time);
 
+  // Create 'count' Impellers from the same 'init', and write their ids to
+  // 'ids'. The processor's arrays grow once, instead of once per Impeller.
+  // Returns the processor, whose bulk accessors take the ids. Each id must
+  // be given back to its RemoveImpeller() when done.
+  ImpelProcessorBase* InitializeMany(const ImpelInit& init, int count,
+                                     ImpelId* ids);
+
+  // Make room for 'count' more Impellers of 'type', before initializing
+  // them one at a time.
+  void Reserve(ImpellerType type, int count);
+
+  // Bytes allocated by the processors for their Impellers.
+  size_t MemorySize() const;
+
+  // Use 'num_threads' threads, in addition to the calling thread, in
+  // AdvanceFrame(). Zero (the default) disables the parallel path.
+  void SetNumWorkerThreads(int num_threads);
+  int NumWorkerThreads() const;
+
+  // Save the state of every processor into 'snapshot', and put it back. Used
+  // to roll the simulation back and resimulate. Both are a memcpy of each
+  // processor's flat arrays, with no per-Impeller work.
+  //
+  // Restore() brings back exactly the Impellers that existed when the
+  // snapshot was taken, so the Impellers alive at Restore() should be the
+  // same ones. Processors created after the snapshot was taken are left as
+  // they are.
+  void Snapshot(ImpelSnapshot* snapshot) const;
+  void Restore(const ImpelSnapshot& snapshot);
+
   static void RegisterProcessorFactory(ImpellerType type,
                                        const ImpelProcessorFunctions& fns);
 
  private:
-  // Map from the ImpellerType to the ImpelProcessor. Only one ImpelProcessor
-  // per type per engine. This is to maximize centralization of data.
-  Map processors_;
+  // A contiguous range of lanes in one processor, to be advanced by one
+  // thread. 'end' < 0 means the whole processor, via AdvanceFrame().
+  struct Job {
+    ImpelProcessorBase* processor;
+    int begin;
+    int end;
+  };
+
+  ImpelProcessorBase* ProcessorAtIndex(int index);
+  static void RunJob(void* engine, int job);
+  void EndFrame();
+
+  // Disallow copies. The worker pool is owned.
+  ImpelEngine(const ImpelEngine&);
+  ImpelEngine& operator=(const ImpelEngine&);
+
+  // Table from the ImpellerType's dense index to the ImpelProcessor. Only
+  // one ImpelProcessor per type per engine. This is to maximize
+  // centralization of data. Entries are nullptr for types that have not been
+  // used in this engine.
+  ProcessorTable processors_;
+
+  // Threads used by AdvanceFrame(). nullptr when running serially.
+  std::unique_ptr<ImpelWorkerPool> workers_;
+
+  // Work for the current AdvanceFrame(). Kept around to avoid reallocating.
+  std::vector<Job> jobs_;
+  ImpelTime job_delta_time_;
 
-  // Map from the ImpellerType to the factory that creates the ImpelProcessor.
-  // We only create an ImpelProcessor when one is needed.
-  static FunctionMap function_map_;
+  // Table from the ImpellerType's dense index to the factory that creates the
+  // ImpelProcessor. We only create an ImpelProcessor when one is needed.
+  static FunctionTable function_table_;
 };
 
 
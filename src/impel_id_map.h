@@ -16,20 +16,29 @@
 #define IMPEL_ID_MAP_H_
 
 #include <assert.h>
+#include <algorithm>
 #include <vector>
 
 #include "impel_common.h"
+#include "impel_snapshot.h"
 
 namespace impel {
 
 // Maps a unique 'id' to a data element. Keeps the data elements contiguous
 // in memory, even when 'ids' are deleted. Only reallocates memory when a new
 // highwater number of elements is reached.
+//
+// Each id is a slot in id_to_index_ plus a generation count. The generation
+// of a slot is bumped when its id is freed, so a stale copy of a Free'd id
+// can be detected cheaply with Valid(), even after the slot has been recycled.
 template<class ImpelData>
 class IdMap {
+ public:
+  typedef uint32_t DataIndex;
+
+ private:
   // Invalid array index.
-  typedef uint16_t DataIndex;
-  static const DataIndex kInvalidIndex = 0xFFFF;
+  static const DataIndex kInvalidIndex = 0xFFFFFFFF;
 
  public:
   // Accessors.
@@ -40,90 +49,160 @@ class IdMap {
   const ImpelData* End() const { return data_.data() + data_.size(); }
   int Count() const { return static_cast<int>(data_.size()); }
 
-  // Allocate data and associate a unique id to it. Note that the id may have
-  // been an id that was previously used and then Free'd.
+  // Bytes allocated by the map, including room reserved for more ids.
+  size_t MemorySize() const {
+    return VectorMemory(id_to_index_) + VectorMemory(generations_) +
+           VectorMemory(index_to_id_) + VectorMemory(slots_to_recycle_) +
+           VectorMemory(data_);
+  }
+
+  // Make room for 'count' ids in total, so that Allocate() does not
+  // reallocate until there are more.
+  void Reserve(int count) {
+    data_.reserve(count);
+    index_to_id_.reserve(count);
+    id_to_index_.reserve(count);
+    generations_.reserve(count);
+  }
+
+  // Allocate data and associate a unique id to it. Note that the id's slot
+  // may have been used previously and then Free'd, but the id itself will
+  // differ because the generation has moved on.
   ImpelId Allocate() {
     // Allocate a spot at the end of data_.
     const DataIndex index = static_cast<DataIndex>(data_.size());
     data_.resize(index + 1);
 
-    // Allocate an id. We try to recycle ids first to avoid growing
+    // Allocate a slot. We try to recycle slots first to avoid growing
     // id_to_index_.
-    ImpelId id = 0;
-    if (ids_to_recycle_.empty()) {
-      // Allocate a new id from the end of id_to_index_.
-      id = static_cast<ImpelId>(id_to_index_.size());
-      id_to_index_.resize(id + 1);
+    int slot = 0;
+    if (slots_to_recycle_.empty()) {
+      // Allocate a new slot from the end of id_to_index_.
+      slot = static_cast<int>(id_to_index_.size());
+      assert(slot <= kImpelIdSlotMask);
+      id_to_index_.push_back(static_cast<DataIndex>(kInvalidIndex));
+      generations_.push_back(0);
 
     } else {
-      // Grab id from the recycle list.
-      id = ids_to_recycle_.back();
-      ids_to_recycle_.pop_back();
+      // Grab slot from the recycle list.
+      slot = slots_to_recycle_.back();
+      slots_to_recycle_.pop_back();
     }
 
-    //　Map id to that spot.
-    id_to_index_[id] = index;
+    //　Map id to that spot, and that spot back to the id.
+    const ImpelId id = ImpelIdFromSlot(slot, generations_[slot]);
+    id_to_index_[slot] = index;
+    index_to_id_.push_back(id);
     return id;
   }
 
   // Free the data associated with 'id' by compacting the data_ array on top
-  // of it. Return 'id' to the list of eligable ids to allocate.
+  // of it. Return the id's slot to the list of eligable slots to allocate.
   void Free(ImpelId id) {
     // Plug hole in data_.
     const DataIndex index = Index(id);
     const DataIndex last_index = static_cast<DataIndex>(data_.size() - 1);
     if (index != last_index) {
-      const DataIndex last_id = Id(last_index);
-      assert(last_id != static_cast<DataIndex>(kImpelIdInvalid));
+      const ImpelId last_id = index_to_id_[last_index];
 
       // Move last item in data_ to the index being deleted.
       data_[index] = data_[last_index];
+      index_to_id_[index] = last_id;
 
       // Remap id onto the index we just moved to.
-      id_to_index_[last_id] = index;
+      id_to_index_[ImpelIdSlot(last_id)] = index;
     }
 
     // Remove the last item from data_. It's no longer being used.
     data_.pop_back();
+    index_to_id_.pop_back();
 
-    // Mark the current id invalid.
-    id_to_index_[id] = kInvalidIndex;
+    // Mark the current slot invalid, and invalidate any stale copies of 'id'.
+    const int slot = ImpelIdSlot(id);
+    id_to_index_[slot] = kInvalidIndex;
+    generations_[slot] = (generations_[slot] + 1) & kImpelIdGenerationMask;
 
-    // Reuse this id so that the id_to_index_ map doesn't keep growing.
-    ids_to_recycle_.push_back(id);
+    // Reuse this slot so that the id_to_index_ map doesn't keep growing.
+    slots_to_recycle_.push_back(slot);
   }
 
- private:
-  // Returns the index corresponding to an id. Fast.
+  // Exchange the data at indices 'a' and 'b', and remap their ids. Lets
+  // processors reorder their data, for example to group the elements that
+  // need processing together.
+  void Swap(DataIndex a, DataIndex b) {
+    assert(a < data_.size() && b < data_.size());
+    std::swap(data_[a], data_[b]);
+    std::swap(index_to_id_[a], index_to_id_[b]);
+    id_to_index_[ImpelIdSlot(index_to_id_[a])] = a;
+    id_to_index_[ImpelIdSlot(index_to_id_[b])] = b;
+  }
+
+  // Returns true if 'id' was returned by Allocate() and has not been Free'd.
+  // Fast.
+  bool Valid(ImpelId id) const {
+    if (id < 0)
+      return false;
+    const int slot = ImpelIdSlot(id);
+    return slot < static_cast<int>(id_to_index_.size()) &&
+           generations_[slot] == ImpelIdGeneration(id) &&
+           id_to_index_[slot] != kInvalidIndex;
+  }
+
+  // Returns the index corresponding to an id. Fast. Processors that keep
+  // structure-of-arrays data in parallel with data_ use this to address it.
+  // Note that Free() moves the last element into the freed index, and Swap()
+  // exchanges indices.
   DataIndex Index(ImpelId id) const {
-    assert(0 <= id && id < static_cast<ImpelId>(id_to_index_.size()));
-    const DataIndex index = id_to_index_[id];
-    assert(index != kInvalidIndex);
-    return index;
+    assert(Valid(id));
+    return id_to_index_[ImpelIdSlot(id)];
   }
 
-  // Returns an id corresponding to an index. Slow. Should be called
-  // infrequently.
+  // Returns the id corresponding to an index. Fast.
   ImpelId Id(DataIndex index) const {
-    // Get id for the last index in data.
-    for (DataIndex id = 0; id < static_cast<DataIndex>(id_to_index_.size());
-         ++id) {
-      if (id_to_index_[id] == index)
-        return static_cast<ImpelId>(id);
-    }
-    return kImpelIdInvalid;
+    assert(index < index_to_id_.size());
+    return index_to_id_[index];
+  }
+
+  // Append the map, including the data, to 'snapshot'. ImpelData must be
+  // safe to copy with memcpy.
+  void Snapshot(ImpelSnapshot* snapshot) const {
+    snapshot->WriteArray(id_to_index_);
+    snapshot->WriteArray(generations_);
+    snapshot->WriteArray(index_to_id_);
+    snapshot->WriteArray(slots_to_recycle_);
+    snapshot->WriteArray(data_);
   }
 
-  // Map ImpelIds into the data_ array. Each id gets a unique index into data_.
-  // This map may have holes. That is id_to_index_[id] may be kInvalidIndex.
-  // When the map has a hole, that 'id' will be in ids_to_recycle_.
+  // Replace the map with the one saved by Snapshot(). Ids that were valid when
+  // the snapshot was taken become valid again.
+  void Restore(ImpelSnapshotReader* reader) {
+    reader->ReadArray(&id_to_index_);
+    reader->ReadArray(&generations_);
+    reader->ReadArray(&index_to_id_);
+    reader->ReadArray(&slots_to_recycle_);
+    reader->ReadArray(&data_);
+  }
+
+ private:
+  // Map id slots into the data_ array. Each allocated slot gets a unique
+  // index into data_. This map may have holes. That is id_to_index_[slot] may
+  // be kInvalidIndex. When the map has a hole, that slot will be in
+  // slots_to_recycle_.
   // Note that this is a vector (not a map) because it requires very quick
   // access.
   std::vector<DataIndex> id_to_index_;
 
-  // An unordered collection of 'id's that can be reused. We try to reuse ids
-  // so that the id_to_index_ map doesn't grow without bound.
-  std::vector<ImpelId> ids_to_recycle_;
+  // Current generation of each slot in id_to_index_. Only ids with the
+  // current generation are valid.
+  std::vector<int> generations_;
+
+  // The inverse of id_to_index_. index_to_id_[i] is the id of data_[i]. Lets
+  // Free() patch up the moved element in constant time.
+  std::vector<ImpelId> index_to_id_;
+
+  // An unordered collection of slots that can be reused. We try to reuse
+  // slots so that the id_to_index_ map doesn't grow without bound.
+  std::vector<int> slots_to_recycle_;
 
   // A packed array of (template defined) data. There are no holes in this
   // data. No holes allows for good memory cohesion and possible optimizations.
@@ -17,6 +17,7 @@
 
 #include "impel_common.h"
 #include "impel_engine.h"
+#include "impel_snapshot.h"
 
 namespace impel {
 
@@ -33,16 +34,60 @@ class ImpelProcessorBase {
   // ImpelEngine.
   virtual void AdvanceFrame(ImpelTime delta_time) = 0;
 
+  // Processors whose Impellers are independent of one another can let
+  // ImpelEngine split AdvanceFrame() across threads. Such processors return
+  // the number of Impellers that need advancing from NumLanes(), and advance
+  // lanes [begin, end) in AdvanceLanes(). 'begin' is always a multiple of
+  // kSimdWidth. Processors that return 0 are always advanced whole, by
+  // AdvanceFrame().
+  virtual int NumLanes() const { return 0; }
+  virtual void AdvanceLanes(ImpelTime /*delta_time*/, int /*begin*/,
+                            int /*end*/) {}
+
+  // Called by ImpelEngine, on the calling thread, once every processor has
+  // been advanced. Processors may reorganize their data here.
+  virtual void EndFrame() {}
+
+  // Append the complete state of every Impeller to 'snapshot', and read it
+  // back, in the same order, in Restore(). Called by ImpelEngine::Snapshot()
+  // and ImpelEngine::Restore(). Processors that hold no state, or that cannot
+  // be restored, can leave these empty.
+  virtual void Snapshot(ImpelSnapshot* /*snapshot*/) const {}
+  virtual void Restore(ImpelSnapshotReader* /*reader*/) {}
+
   // Creation an impeller and return a unique id representing it.
   // The 'engine' is required if the ImpelProcessor itself creates child
   // Impellers. This function should only be called by Impeller::Initialize().
   virtual ImpelId InitializeImpeller(const ImpelInit& init,
                                      ImpelEngine* engine) = 0;
 
+  // Create 'count' impellers from the same 'init', and write their ids to
+  // 'ids'. The same as calling InitializeImpeller() 'count' times, except
+  // that processors can make room for them all at once.
+  virtual void InitializeImpellers(const ImpelInit& init, int count,
+                                   ImpelEngine* engine, ImpelId* ids) {
+    Reserve(count);
+    for (int i = 0; i < count; ++i) {
+      ids[i] = InitializeImpeller(init, engine);
+    }
+  }
+
+  // Make room for 'count' more impellers, so that adding them grows each
+  // array at most once.
+  virtual void Reserve(int /*count*/) {}
+
+  // Bytes allocated for the impellers' data, for memory accounting.
+  virtual size_t MemorySize() const { return 0; }
+
   // Remove an impeller and return it's unique id to the pile of allocatable
   // ids.
   virtual void RemoveImpeller(ImpelId id) = 0;
 
+  // Return true if 'id' refers to an impeller currently in this processor.
+  // Returns false for stale ids, whose impeller has already been removed,
+  // even if the underlying slot has since been reused.
+  virtual bool ValidImpeller(ImpelId /*id*/) const { return true; }
+
   // Return GUID representing the Impeller's type. Must be implemented by
   // derived class.
   virtual ImpellerType Type() const = 0;
@@ -104,6 +149,44 @@ class ImpelProcessor : public ImpelProcessorBase {
   virtual void SetVelocity(ImpelId /*id*/, const T& /*velocity*/) {}
   virtual void SetTargetValue(ImpelId /*id*/, const T& /*target_value*/) {}
   virtual T Difference(ImpelId id) const { return TargetValue(id) - Value(id); }
+
+  // Bulk versions of the accessors above. Equivalent to calling the
+  // single-id function once for each of the 'count' ids, but with only one
+  // virtual call. Derived classes can override these to read and write their
+  // data directly.
+  virtual void Values(const ImpelId* ids, int count, T* values) const {
+    for (int i = 0; i < count; ++i) {
+      values[i] = Value(ids[i]);
+    }
+  }
+  virtual void Velocities(const ImpelId* ids, int count, T* velocities) const {
+    for (int i = 0; i < count; ++i) {
+      velocities[i] = Velocity(ids[i]);
+    }
+  }
+  virtual void TargetValues(const ImpelId* ids, int count,
+                            T* target_values) const {
+    for (int i = 0; i < count; ++i) {
+      target_values[i] = TargetValue(ids[i]);
+    }
+  }
+  virtual void SetValues(const ImpelId* ids, int count, const T* values) {
+    for (int i = 0; i < count; ++i) {
+      SetValue(ids[i], values[i]);
+    }
+  }
+  virtual void SetVelocities(const ImpelId* ids, int count,
+                             const T* velocities) {
+    for (int i = 0; i < count; ++i) {
+      SetVelocity(ids[i], velocities[i]);
+    }
+  }
+  virtual void SetTargetValues(const ImpelId* ids, int count,
+                               const T* target_values) {
+    for (int i = 0; i < count; ++i) {
+      SetTargetValue(ids[i], target_values[i]);
+    }
+  }
 };
 
 // ImpelProcessors of various dimensions. All ImpelProcessors operate with
@@ -15,7 +15,11 @@
 #ifndef IMPEL_PROCESSOR_BASE_CLASSES_H_
 #define IMPEL_PROCESSOR_BASE_CLASSES_H_
 
+#include <algorithm>
+#include <limits>
+
 #include "impel_id_map.h"
+#include "impel_simd.h"
 #include "impel_util.h"
 #include "impeller.h"
 
@@ -103,32 +107,36 @@ struct ImpelInitWithVelocity : public ImpelInit {
 };
 
 
-// For impeller types that derive from ImpelInitWithVelocity, each Impeller
-// gets a copy of this data. The data is held centrally, in the ImpelProcessor.
-struct ImpelDataWithVelocity {
-  // What we are animating. Returned when Impeller::Value() called.
-  float value;
-
-  // The rate of change of value. Returned when Impeller::Velocity() called.
-  float velocity;
-
-  // What we are striving to hit. Returned when Impeller::TargetValue() called.
-  float target_value;
-
-  virtual void Initialize(const ImpelInit& /*init_param*/) {
-    value = 0.0f;
-    velocity = 0.0f;
-    target_value = 0.0f;
-  }
-};
-
-
 // InitType must derive from ImpelInitWithVelocity.
-// ImpelData must derive from ImpelDataWithVelocity. It should have a member
-// called 'init' of type InitType.
-template<class ImpelData, class InitType>
-class ImpelProcessorWithVelocity : public ImpelProcessor<float> {
+// ImpelData holds the per-Impeller data that is not touched every frame. It
+// should have a member called 'init' of type InitType, and a function
+// Initialize(const InitType&).
+// T is the value type: float, or a mathfu vector. Each component of a vector
+// is animated independently, with the same parameters.
+//
+// The values that are updated every frame are stored as a structure-of-arrays
+// in the processor (values_, velocities_, target_values_, ...), in the same
+// order as the packed data in map_. Each Impeller gets kDimensions adjacent
+// 'lanes' in each array, one per component, and AdvanceFrame() can walk the
+// lanes linearly (and several at a time with SIMD). So a 4D Impeller is
+// stepped with one SIMD operation. Derived classes with additional per-lane
+// arrays should override ResizeLanes() and SwapLanes() to keep them in sync.
+//
+// Lanes are independent, so derived classes implement AdvanceLanes() rather
+// than AdvanceFrame(), and ImpelEngine is free to advance disjoint lane ranges
+// on different threads.
+//
+// Most Impellers spend most of their time at rest. The Impellers are
+// partitioned so that awake Impellers come first, and only their lanes are
+// advanced. At the end of each frame, Impellers that are AtRest() are moved to
+// the sleeping tail. Setting any simulation value wakes the Impeller up again.
+template<class ImpelData, class InitType, class T = float>
+class ImpelProcessorWithVelocity : public ImpelProcessor<T> {
  public:
+  typedef ValueDetails<T> Details;
+  static const int kDimensions = ValueDetails<T>::kDimensions;
+
+  ImpelProcessorWithVelocity() : num_awake_(0) {}
   virtual ~ImpelProcessorWithVelocity() {
     assert(map_.Count() == 0);
   }
@@ -136,44 +144,284 @@ class ImpelProcessorWithVelocity : public ImpelProcessor<float> {
   virtual ImpelId InitializeImpeller(const ImpelInit& init,
                                      ImpelEngine* /*engine*/) {
     assert(init.type == InitType::kType);
+    const InitType& typed_init = static_cast<const InitType&>(init);
 
-    // Allocate an external id, and map it to an index into data_.
+    // Allocate an external id, and map it to an index into data_. New data
+    // is always allocated at the end of the packed arrays.
     ImpelId id = map_.Allocate();
-
-    // Initialize the newly allocated item in data_.
-    Data(id).Initialize(static_cast<const InitType&>(init));
+    const int index = map_.Count() - 1;
+    ResizeLanes(map_.Count() * kDimensions);
+
+    // Initialize the newly allocated item in data_, and its lanes.
+    Data(id).Initialize(typed_init);
+    for (int lane = FirstLane(index); lane < FirstLane(index + 1); ++lane) {
+      values_[lane] = 0.0f;
+      velocities_[lane] = 0.0f;
+      target_values_[lane] = 0.0f;
+
+      // For non-modular values, Normalize() does nothing. Set the bounds so
+      // that the branch-free normalization in the kernels also does nothing.
+      modular_min_[lane] = typed_init.modular ?
+          typed_init.min : -std::numeric_limits<float>::infinity();
+      modular_max_[lane] = typed_init.modular ?
+          typed_init.max : std::numeric_limits<float>::infinity();
+      modular_width_[lane] = typed_init.modular ?
+          typed_init.max - typed_init.min : 0.0f;
+      InitializeLane(lane, typed_init);
+    }
+
+    // New Impellers start awake. EndFrame() puts them to sleep if they
+    // have nothing to do.
+    Wake(index);
     return id;
   }
 
-  virtual void RemoveImpeller(ImpelId id) { map_.Free(id); }
+  virtual void Reserve(int count) {
+    const int total = map_.Count() + count;
+    map_.Reserve(total);
+
+    // Growing the lanes and shrinking them back keeps the capacity, for the
+    // derived classes' lanes too.
+    ResizeLanes(total * kDimensions);
+    ResizeLanes(map_.Count() * kDimensions);
+  }
+
+  virtual void RemoveImpeller(ImpelId id) {
+    // Move the Impeller to the end of the awake Impellers, and then to the
+    // very end, so that both partitions stay contiguous. IdMap::Free then has
+    // no hole to plug.
+    int index = map_.Index(id);
+    if (index < num_awake_) {
+      num_awake_--;
+      SwapImpellers(index, num_awake_);
+      index = num_awake_;
+    }
+    SwapImpellers(index, map_.Count() - 1);
+    map_.Free(id);
+    ResizeLanes(map_.Count() * kDimensions);
+  }
+
+  virtual void AdvanceFrame(ImpelTime delta_time) {
+    this->AdvanceLanes(delta_time, 0, NumLanes());
+  }
+  virtual int NumLanes() const { return FirstLane(num_awake_); }
+
+  // Put the Impellers that have reached their target to sleep.
+  virtual void EndFrame() {
+    // Walk backwards so that the Impeller swapped into 'i' has already been
+    // checked.
+    for (int i = num_awake_ - 1; i >= 0; --i) {
+      if (AtRest(i)) {
+        num_awake_--;
+        SwapImpellers(i, num_awake_);
+      }
+    }
+  }
+
+  virtual bool ValidImpeller(ImpelId id) const { return map_.Valid(id); }
   virtual ImpellerType Type() const { return InitType::kType; }
 
+  // Derived classes with additional per-lane arrays should extend these, and
+  // call the base class first.
+  virtual void Snapshot(ImpelSnapshot* snapshot) const {
+    map_.Snapshot(snapshot);
+    snapshot->WriteValue(num_awake_);
+    snapshot->WriteArray(values_);
+    snapshot->WriteArray(velocities_);
+    snapshot->WriteArray(target_values_);
+    snapshot->WriteArray(modular_min_);
+    snapshot->WriteArray(modular_max_);
+    snapshot->WriteArray(modular_width_);
+  }
+  virtual void Restore(ImpelSnapshotReader* reader) {
+    map_.Restore(reader);
+    reader->ReadValue(&num_awake_);
+    reader->ReadArray(&values_);
+    reader->ReadArray(&velocities_);
+    reader->ReadArray(&target_values_);
+    reader->ReadArray(&modular_min_);
+    reader->ReadArray(&modular_max_);
+    reader->ReadArray(&modular_width_);
+  }
+  virtual size_t MemorySize() const {
+    return map_.MemorySize() + VectorMemory(values_) +
+           VectorMemory(velocities_) + VectorMemory(target_values_) +
+           VectorMemory(modular_min_) + VectorMemory(modular_max_) +
+           VectorMemory(modular_width_);
+  }
+
   // Accessors to allow the user to get and set simluation values.
-  virtual float Value(ImpelId id) const { return Data(id).value; }
-  virtual float Velocity(ImpelId id) const { return Data(id).velocity; }
-  virtual float TargetValue(ImpelId id) const { return Data(id).target_value; }
-  virtual void SetValue(ImpelId id, const float& value) {
-    Data(id).value = value;
+  virtual T Value(ImpelId id) const { return Gather(values_, id); }
+  virtual T Velocity(ImpelId id) const { return Gather(velocities_, id); }
+  virtual T TargetValue(ImpelId id) const {
+    return Gather(target_values_, id);
+  }
+  virtual void SetValue(ImpelId id, const T& value) {
+    Scatter(value, id, &values_);
   }
-  virtual void SetVelocity(ImpelId id, const float& velocity) {
-    Data(id).velocity = velocity;
+  virtual void SetVelocity(ImpelId id, const T& velocity) {
+    Scatter(velocity, id, &velocities_);
   }
-  virtual void SetTargetValue(ImpelId id, const float& target_value) {
-    Data(id).target_value = target_value;
+  virtual void SetTargetValue(ImpelId id, const T& target_value) {
+    Scatter(target_value, id, &target_values_);
   }
   virtual void SetTargetTime(ImpelId /*id*/, float /*target_time*/) {}
-  virtual float Difference(ImpelId id) const {
-    const ImpelData& d = Data(id);
-    return d.init.Normalize(d.target_value - d.value);
+
+  // Bulk accessors. Read and write the lanes directly, without a virtual call
+  // per id.
+  virtual void Values(const ImpelId* ids, int count, T* values) const {
+    for (int i = 0; i < count; ++i) {
+      values[i] = Gather(values_, ids[i]);
+    }
+  }
+  virtual void Velocities(const ImpelId* ids, int count, T* velocities) const {
+    for (int i = 0; i < count; ++i) {
+      velocities[i] = Gather(velocities_, ids[i]);
+    }
+  }
+  virtual void TargetValues(const ImpelId* ids, int count,
+                            T* target_values) const {
+    for (int i = 0; i < count; ++i) {
+      target_values[i] = Gather(target_values_, ids[i]);
+    }
+  }
+  virtual void SetValues(const ImpelId* ids, int count, const T* values) {
+    for (int i = 0; i < count; ++i) {
+      Scatter(values[i], ids[i], &values_);
+    }
+  }
+  virtual void SetVelocities(const ImpelId* ids, int count,
+                             const T* velocities) {
+    for (int i = 0; i < count; ++i) {
+      Scatter(velocities[i], ids[i], &velocities_);
+    }
+  }
+  virtual void SetTargetValues(const ImpelId* ids, int count,
+                               const T* target_values) {
+    for (int i = 0; i < count; ++i) {
+      Scatter(target_values[i], ids[i], &target_values_);
+    }
+  }
+
+  virtual T Difference(ImpelId id) const {
+    const int lane = FirstLane(map_.Index(id));
+    const ImpelInitWithVelocity& init = Data(id).init;
+    T difference;
+    for (int i = 0; i < kDimensions; ++i) {
+      Details::SetComponent(i, init.Normalize(target_values_[lane + i] -
+                                              values_[lane + i]),
+                            &difference);
+    }
+    return difference;
   }
 
  protected:
+  // Index of the first lane of the Impeller at 'index' in map_.
+  static int FirstLane(int index) { return index * kDimensions; }
+
+  // Initialize the derived class's 'lane'. The base lanes have already been
+  // initialized when this is called.
+  virtual void InitializeLane(int /*lane*/, const InitType& /*init*/) {}
+
+  // Grow or shrink every per-lane array to hold 'count' lanes.
+  virtual void ResizeLanes(int count) {
+    values_.resize(count);
+    velocities_.resize(count);
+    target_values_.resize(count);
+    modular_min_.resize(count);
+    modular_max_.resize(count);
+    modular_width_.resize(count);
+  }
+
+  // Exchange lanes 'a' and 'b'.
+  virtual void SwapLanes(int a, int b) {
+    std::swap(values_[a], values_[b]);
+    std::swap(velocities_[a], velocities_[b]);
+    std::swap(target_values_[a], target_values_[b]);
+    std::swap(modular_min_[a], modular_min_[b]);
+    std::swap(modular_max_[a], modular_max_[b]);
+    std::swap(modular_width_[a], modular_width_[b]);
+  }
+
+  // Return true if advancing the Impeller at 'index' would not change it.
+  // Sleeping Impellers are not advanced. The default is true once every lane
+  // has stopped on its target.
+  virtual bool AtRest(int index) const {
+    for (int lane = FirstLane(index); lane < FirstLane(index + 1); ++lane) {
+      if (velocities_[lane] != 0.0f || values_[lane] != target_values_[lane])
+        return false;
+    }
+    return true;
+  }
+
+  // Move the Impeller at 'index' into the awake partition, if it's not
+  // already there. Return the Impeller's new index.
+  int Wake(int index) {
+    if (index >= num_awake_) {
+      SwapImpellers(index, num_awake_);
+      index = num_awake_++;
+    }
+    return index;
+  }
+
+  // Exchange both the packed data and the lanes of the Impellers at indices
+  // 'a' and 'b'.
+  void SwapImpellers(int a, int b) {
+    if (a == b)
+      return;
+    map_.Swap(a, b);
+    for (int i = 0; i < kDimensions; ++i) {
+      SwapLanes(FirstLane(a) + i, FirstLane(b) + i);
+    }
+  }
+
+  // Read the lanes of 'id' from 'lanes'.
+  T Gather(const AlignedFloats& lanes, ImpelId id) const {
+    const int lane = FirstLane(map_.Index(id));
+    T value;
+    for (int i = 0; i < kDimensions; ++i) {
+      Details::SetComponent(i, lanes[lane + i], &value);
+    }
+    return value;
+  }
+
+  // Wake 'id' and write 'value' to its lanes in 'lanes'.
+  void Scatter(const T& value, ImpelId id, AlignedFloats* lanes) {
+    const int lane = FirstLane(Wake(map_.Index(id)));
+    for (int i = 0; i < kDimensions; ++i) {
+      (*lanes)[lane + i] = Details::Component(value, i);
+    }
+  }
+
   ImpelData& Data(ImpelId id) { return map_.Data(id); }
   const ImpelData& Data(ImpelId id) const { return map_.Data(id); }
 
   IdMap<ImpelData> map_;
+
+  // Impellers [0, num_awake_) are advanced every frame. Impellers
+  // [num_awake_, map_.Count()) are asleep.
+  int num_awake_;
+
+  // What we are animating. Returned when Impeller::Value() called.
+  AlignedFloats values_;
+
+  // The rate of change of value. Returned when Impeller::Velocity() called.
+  AlignedFloats velocities_;
+
+  // What we are striving to hit. Returned when Impeller::TargetValue() called.
+  AlignedFloats target_values_;
+
+  // Range used to normalize modular values, as in
+  // ImpelInitWithVelocity::Normalize(). For non-modular values, min and max
+  // are infinite and width is zero, so normalization is a no-op.
+  AlignedFloats modular_min_;
+  AlignedFloats modular_max_;
+  AlignedFloats modular_width_;
 };
 
+template<class ImpelData, class InitType, class T>
+const int ImpelProcessorWithVelocity<ImpelData, InitType, T>::kDimensions;
+
 
 } // namespace impel
 
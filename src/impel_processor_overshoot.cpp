@@ -18,62 +18,268 @@
 namespace impel {
 
 IMPEL_INIT_INSTANTIATE(OvershootImpelInit);
+IMPEL_INIT_INSTANTIATE(OvershootImpelInit2f);
+IMPEL_INIT_INSTANTIATE(OvershootImpelInit3f);
+IMPEL_INIT_INSTANTIATE(OvershootImpelInit4f);
 
 
-void OvershootImpelProcessor::AdvanceFrame(ImpelTime delta_time) {
-  // Loop through every impeller one at a time.
-  // TODO OPT: reorder data and then optimize with SIMD to process in groups
-  // of 4 floating-point or 8 fixed-point values.
-  for (OvershootImpelData* d = map_.Begin(); d < map_.End(); ++d) {
-    for (ImpelTime time_remaining = delta_time; time_remaining > 0;) {
-      ImpelTime dt = std::min(time_remaining, d->init.max_delta_time);
+// Return the iteration step for 'time_remaining'.
+static inline ImpelTime StepTime(ImpelTime time_remaining,
+                                 ImpelTime max_delta_time) {
+  return max_delta_time > 0 ? std::min(time_remaining, max_delta_time) :
+                              time_remaining;
+}
+
+template<class T, class InitType>
+void OvershootImpelProcessorT<T, InitType>::AdvanceLanes(
+    ImpelTime delta_time, int begin, int end) {
+  const OvershootImpelData* d = map_.Begin();
+  int i = begin;
+
+  // Process kSimdWidth lanes at a time, then the remainder one at a time.
+#if defined(IMPEL_SIMD)
+  const float dt = static_cast<float>(delta_time);
+  for (; i + kSimdWidth <= end; i += kSimdWidth) {
+    AdvanceLanesSimd(i, dt);
+  }
+#endif // defined(IMPEL_SIMD)
+  for (; i < end; ++i) {
+    AdvanceLane(i, delta_time, d[i / kDimensions].init);
+  }
+}
 
-      d->velocity = CalculateVelocity(dt, *d);
-      d->value = CalculateValue(dt, *d);
+template<class T, class InitType>
+void OvershootImpelProcessorT<T, InitType>::AdvanceLane(
+    int i, ImpelTime delta_time, const OvershootImpelInit& init) {
+  for (ImpelTime time_remaining = delta_time; time_remaining > 0;) {
+    const ImpelTime dt = StepTime(time_remaining, init.max_delta_time);
 
-      time_remaining -= dt;
-    }
+    velocities_[i] = CalculateVelocity(dt, init, values_[i], velocities_[i],
+                                       target_values_[i]);
+    values_[i] = CalculateValue(dt, init, values_[i], velocities_[i],
+                                target_values_[i]);
+
+    time_remaining -= dt;
   }
 }
 
-float OvershootImpelProcessor::CalculateVelocity(ImpelTime delta_time,
-                                                 const OvershootImpelData& d) const {
+#if defined(IMPEL_SIMD)
+template<class T, class InitType>
+void OvershootImpelProcessorT<T, InitType>::AdvanceLanesSimd(
+    int i, float delta_time) {
+  const Float4 zero = Splat4(0.0f);
+  const Float4 one = Splat4(1.0f);
+
+  Float4 value = Load4(&values_[i]);
+  Float4 velocity = Load4(&velocities_[i]);
+  const Float4 target_value = Load4(&target_values_[i]);
+  const Float4 modular_min = Load4(&modular_min_[i]);
+  const Float4 modular_max = Load4(&modular_max_[i]);
+  const Float4 modular_width = Load4(&modular_width_[i]);
+  const Float4 max_delta_time = Load4(&max_delta_time_[i]);
+
+  // Each lane may need a different number of iterations, because
+  // max_delta_time differs. Keep iterating until every lane is done, and
+  // mask off the lanes that have finished.
+  Float4 time_remaining = Splat4(delta_time);
+  for (;;) {
+    const Float4 active = Greater4(time_remaining, zero);
+    if (!AnyTrue4(active))
+      break;
+    const Float4 dt = Min4(max_delta_time, time_remaining);
+
+    // Same as CalculateVelocity().
+    const Float4 diff_unnormalized = Sub4(target_value, value);
+    const Float4 diff_above_min = Select4(
+        LessEqual4(diff_unnormalized, modular_min),
+        Add4(diff_unnormalized, modular_width), diff_unnormalized);
+    const Float4 diff = Select4(
+        Greater4(diff_above_min, modular_max),
+        Sub4(diff_above_min, modular_width), diff_above_min);
+    const Float4 wrong_direction = Greater4(zero, Mul4(velocity, diff));
+    const Float4 wrong_direction_multiplier = Select4(
+        wrong_direction, Load4(&wrong_direction_multiplier_[i]), one);
+    const Float4 acceleration = Mul4(
+        Mul4(diff, Load4(&accel_per_difference_[i])),
+        wrong_direction_multiplier);
+    const Float4 velocity_unclamped = Add4(velocity, Mul4(dt, acceleration));
+    const Float4 velocity_clamped = Clamp4(velocity_unclamped,
+                                           Load4(&velocity_min_[i]),
+                                           Load4(&velocity_max_[i]));
+    const Float4 should_snap = And4(
+        LessEqual4(Abs4(diff), Load4(&settled_max_difference_[i])),
+        LessEqual4(Abs4(velocity_clamped), Load4(&settled_max_velocity_[i])));
+    const Float4 new_velocity = Select4(should_snap, zero, velocity_clamped);
+
+    // Same as CalculateValue().
+    const Float4 delta = Clamp4(Mul4(dt, new_velocity), Load4(&delta_min_[i]),
+                                Load4(&delta_max_[i]));
+    const Float4 value_unnormalized = Add4(value, delta);
+    const Float4 value_above_min = Select4(
+        LessEqual4(value_unnormalized, modular_min),
+        Add4(value_unnormalized, modular_width), value_unnormalized);
+    const Float4 value_normalized = Select4(
+        Greater4(value_above_min, modular_max),
+        Sub4(value_above_min, modular_width), value_above_min);
+    const Float4 value_clamped = Clamp4(value_normalized,
+                                        Load4(&value_min_[i]),
+                                        Load4(&value_max_[i]));
+    const Float4 new_value = Select4(Equal4(new_velocity, zero), target_value,
+                                     value_clamped);
+
+    // Only commit the results for lanes with time remaining.
+    velocity = Select4(active, new_velocity, velocity);
+    value = Select4(active, new_value, value);
+    time_remaining = Sub4(time_remaining, dt);
+  }
+
+  Store4(&values_[i], value);
+  Store4(&velocities_[i], velocity);
+}
+#endif // defined(IMPEL_SIMD)
+
+template<class T, class InitType>
+float OvershootImpelProcessorT<T, InitType>::CalculateVelocity(
+    ImpelTime delta_time, const OvershootImpelInit& init, float value,
+    float velocity, float target_value) const {
   // Increment our current face angle velocity.
   // If we're moving in the wrong direction (i.e. away from the target),
   // increase the acceleration. This results in us moving towards the target
   // for longer time than we move away from the target, or equivalently,
   // aggressively initiating our movement towards the target, which feels good.
-  const float diff = d.init.Normalize(d.target_value - d.value);
-  const bool wrong_direction = d.velocity * diff < 0.0f;
+  const float diff = init.Normalize(target_value - value);
+  const bool wrong_direction = velocity * diff < 0.0f;
   const float wrong_direction_multiplier = wrong_direction ?
-      d.init.wrong_direction_multiplier : 1.0f;
-  const float acceleration = diff * d.init.accel_per_difference *
+      init.wrong_direction_multiplier : 1.0f;
+  const float acceleration = diff * init.accel_per_difference *
                              wrong_direction_multiplier;
-  const float velocity_unclamped = d.velocity + delta_time * acceleration;
+  const float velocity_unclamped = velocity + delta_time * acceleration;
 
   // Always ensure the velocity remains within the valid limits.
-  const float velocity = d.init.ClampVelocity(velocity_unclamped);
+  const float new_velocity = init.ClampVelocity(velocity_unclamped);
 
   // If we're far from facing the target, use the velocity calculated above.
-  const bool should_snap = d.init.AtTarget(diff, velocity);
+  const bool should_snap = init.AtTarget(diff, new_velocity);
   if (should_snap)
     return 0.0f;
 
-  return velocity;
+  return new_velocity;
 }
 
 // Step the simulation, with the current velocity.
-float OvershootImpelProcessor::CalculateValue(ImpelTime delta_time,
-                                              const OvershootImpelData& d) const {
+template<class T, class InitType>
+float OvershootImpelProcessorT<T, InitType>::CalculateValue(
+    ImpelTime delta_time, const OvershootImpelInit& init, float value,
+    float velocity, float target_value) const {
   // Snap to the target value when we've stopped moving.
-  if (d.velocity == 0.0f)
-    return d.target_value;
+  if (velocity == 0.0f)
+    return target_value;
+
+  const float delta = init.ClampDelta(delta_time * velocity);
+  const float value_unclamped = init.Normalize(value + delta);
+  return init.ClampValue(value_unclamped);
+}
+
+template<class T, class InitType>
+void OvershootImpelProcessorT<T, InitType>::InitializeLane(
+    int i, const InitType& init) {
+  value_min_[i] = init.min;
+  value_max_[i] = init.max;
+  velocity_min_[i] = -init.max_velocity;
+  velocity_max_[i] = init.max_velocity;
+  delta_min_[i] = -init.max_delta;
+  delta_max_[i] = init.max_delta;
+  settled_max_difference_[i] = init.at_target.max_difference;
+  settled_max_velocity_[i] = init.at_target.max_velocity;
+  accel_per_difference_[i] = init.accel_per_difference;
+  wrong_direction_multiplier_[i] = init.wrong_direction_multiplier;
+  max_delta_time_[i] = init.max_delta_time > 0 ?
+      static_cast<float>(init.max_delta_time) :
+      std::numeric_limits<float>::infinity();
+}
+
+template<class T, class InitType>
+void OvershootImpelProcessorT<T, InitType>::ResizeLanes(int count) {
+  Base::ResizeLanes(count);
+  value_min_.resize(count);
+  value_max_.resize(count);
+  velocity_min_.resize(count);
+  velocity_max_.resize(count);
+  delta_min_.resize(count);
+  delta_max_.resize(count);
+  settled_max_difference_.resize(count);
+  settled_max_velocity_.resize(count);
+  accel_per_difference_.resize(count);
+  wrong_direction_multiplier_.resize(count);
+  max_delta_time_.resize(count);
+}
 
-  const float delta = d.init.ClampDelta(delta_time * d.velocity);
-  const float value_unclamped = d.init.Normalize(d.value + delta);
-  const float value = d.init.ClampValue(value_unclamped);
-  return value;
+template<class T, class InitType>
+size_t OvershootImpelProcessorT<T, InitType>::MemorySize() const {
+  return Base::MemorySize() + VectorMemory(value_min_) +
+         VectorMemory(value_max_) + VectorMemory(velocity_min_) +
+         VectorMemory(velocity_max_) + VectorMemory(delta_min_) +
+         VectorMemory(delta_max_) + VectorMemory(settled_max_difference_) +
+         VectorMemory(settled_max_velocity_) +
+         VectorMemory(accel_per_difference_) +
+         VectorMemory(wrong_direction_multiplier_) +
+         VectorMemory(max_delta_time_);
 }
 
+template<class T, class InitType>
+void OvershootImpelProcessorT<T, InitType>::SwapLanes(int a, int b) {
+  Base::SwapLanes(a, b);
+  std::swap(value_min_[a], value_min_[b]);
+  std::swap(value_max_[a], value_max_[b]);
+  std::swap(velocity_min_[a], velocity_min_[b]);
+  std::swap(velocity_max_[a], velocity_max_[b]);
+  std::swap(delta_min_[a], delta_min_[b]);
+  std::swap(delta_max_[a], delta_max_[b]);
+  std::swap(settled_max_difference_[a], settled_max_difference_[b]);
+  std::swap(settled_max_velocity_[a], settled_max_velocity_[b]);
+  std::swap(accel_per_difference_[a], accel_per_difference_[b]);
+  std::swap(wrong_direction_multiplier_[a], wrong_direction_multiplier_[b]);
+  std::swap(max_delta_time_[a], max_delta_time_[b]);
+}
+
+template<class T, class InitType>
+void OvershootImpelProcessorT<T, InitType>::Snapshot(
+    ImpelSnapshot* snapshot) const {
+  Base::Snapshot(snapshot);
+  snapshot->WriteArray(value_min_);
+  snapshot->WriteArray(value_max_);
+  snapshot->WriteArray(velocity_min_);
+  snapshot->WriteArray(velocity_max_);
+  snapshot->WriteArray(delta_min_);
+  snapshot->WriteArray(delta_max_);
+  snapshot->WriteArray(settled_max_difference_);
+  snapshot->WriteArray(settled_max_velocity_);
+  snapshot->WriteArray(accel_per_difference_);
+  snapshot->WriteArray(wrong_direction_multiplier_);
+  snapshot->WriteArray(max_delta_time_);
+}
+
+template<class T, class InitType>
+void OvershootImpelProcessorT<T, InitType>::Restore(
+    ImpelSnapshotReader* reader) {
+  Base::Restore(reader);
+  reader->ReadArray(&value_min_);
+  reader->ReadArray(&value_max_);
+  reader->ReadArray(&velocity_min_);
+  reader->ReadArray(&velocity_max_);
+  reader->ReadArray(&delta_min_);
+  reader->ReadArray(&delta_max_);
+  reader->ReadArray(&settled_max_difference_);
+  reader->ReadArray(&settled_max_velocity_);
+  reader->ReadArray(&accel_per_difference_);
+  reader->ReadArray(&wrong_direction_multiplier_);
+  reader->ReadArray(&max_delta_time_);
+}
+
+template class OvershootImpelProcessorT<float, OvershootImpelInit>;
+template class OvershootImpelProcessorT<mathfu::vec2, OvershootImpelInit2f>;
+template class OvershootImpelProcessorT<mathfu::vec3, OvershootImpelInit3f>;
+template class OvershootImpelProcessorT<mathfu::vec4, OvershootImpelInit4f>;
+
 } // namespace impel
 
@@ -41,32 +41,125 @@ struct OvershootImpelInit : public ImpelInitWithVelocity {
 
   // The algorithm is iterative. When the iteration step gets too big, the
   // behavior becomes erratic. This value clamps the iteration step.
+  // Values <= 0 do not clamp the iteration step.
   ImpelTime max_delta_time;
 };
 
-struct OvershootImpelData : public ImpelDataWithVelocity {
-  OvershootImpelInit init;
+// OvershootImpelInits for the multi-dimensional processors. Every component is
+// driven with the same parameters.
+struct OvershootImpelInit2f : public OvershootImpelInit {
+  IMPEL_INIT_REGISTER();
+  OvershootImpelInit2f() { type = kType; }
+  explicit OvershootImpelInit2f(const OvershootImpelInit& init)
+      : OvershootImpelInit(init) {
+    type = kType;
+  }
+};
+
+struct OvershootImpelInit3f : public OvershootImpelInit {
+  IMPEL_INIT_REGISTER();
+  OvershootImpelInit3f() { type = kType; }
+  explicit OvershootImpelInit3f(const OvershootImpelInit& init)
+      : OvershootImpelInit(init) {
+    type = kType;
+  }
+};
 
-  virtual void Initialize(const ImpelInit& init_param) {
-    ImpelDataWithVelocity::Initialize(init_param);
-    init = static_cast<const OvershootImpelInit&>(init_param);
+struct OvershootImpelInit4f : public OvershootImpelInit {
+  IMPEL_INIT_REGISTER();
+  OvershootImpelInit4f() { type = kType; }
+  explicit OvershootImpelInit4f(const OvershootImpelInit& init)
+      : OvershootImpelInit(init) {
+    type = kType;
   }
 };
 
+// Per-Impeller data that is not touched every frame. The simulation state
+// lives in the processor's per-lane arrays.
+struct OvershootImpelData {
+  OvershootImpelInit init;
+
+  void Initialize(const OvershootImpelInit& init_param) { init = init_param; }
+};
+
 
-class OvershootImpelProcessor :
-    public ImpelProcessorWithVelocity<OvershootImpelData, OvershootImpelInit> {
+// Accelerates each Impeller towards its target, overshooting and oscillating
+// before it settles. Each component of a vector value settles independently.
+//
+// The per-lane state and parameters are stored as a structure-of-arrays.
+// AdvanceLanes() steps kSimdWidth lanes at a time on SSE and NEON, with the
+// clamping and normalization done branch-free by masked selects. The scalar
+// CalculateVelocity() and CalculateValue() handle the remaining lanes and
+// other platforms, and give bit-identical results.
+//
+// Use the typedefs below. T is the value type, and InitType is the matching
+// OvershootImpelInit.
+template<class T, class InitType>
+class OvershootImpelProcessorT :
+    public ImpelProcessorWithVelocity<OvershootImpelData, InitType, T> {
+  typedef ImpelProcessorWithVelocity<OvershootImpelData, InitType, T> Base;
 
  public:
-  IMPEL_PROCESSOR_REGISTER(OvershootImpelProcessor, OvershootImpelInit);
-  virtual ~OvershootImpelProcessor() {}
-  virtual void AdvanceFrame(ImpelTime delta_time);
+  IMPEL_PROCESSOR_REGISTER(OvershootImpelProcessorT, InitType);
+  virtual ~OvershootImpelProcessorT() {}
+  virtual void AdvanceLanes(ImpelTime delta_time, int begin, int end);
 
  protected:
-  float CalculateVelocity(ImpelTime delta_time, const OvershootImpelData& d) const;
-  float CalculateValue(ImpelTime delta_time, const OvershootImpelData& d) const;
+  using Base::kDimensions;
+  using Base::map_;
+  using Base::values_;
+  using Base::velocities_;
+  using Base::target_values_;
+  using Base::modular_min_;
+  using Base::modular_max_;
+  using Base::modular_width_;
+
+  virtual void InitializeLane(int lane, const InitType& init);
+  virtual void ResizeLanes(int count);
+  virtual void SwapLanes(int a, int b);
+  virtual void Snapshot(ImpelSnapshot* snapshot) const;
+  virtual void Restore(ImpelSnapshotReader* reader);
+  virtual size_t MemorySize() const;
+
+  void AdvanceLane(int lane, ImpelTime delta_time,
+                   const OvershootImpelInit& init);
+#if defined(IMPEL_SIMD)
+  void AdvanceLanesSimd(int lane, float delta_time);
+#endif
+  float CalculateVelocity(ImpelTime delta_time, const OvershootImpelInit& init,
+                          float value, float velocity,
+                          float target_value) const;
+  float CalculateValue(ImpelTime delta_time, const OvershootImpelInit& init,
+                       float value, float velocity, float target_value) const;
+
+  // Copies of the OvershootImpelInit parameters, one lane per Impeller, for
+  // the SIMD kernel. Negated bounds are stored rather than computed so that
+  // the clamps match the scalar code exactly.
+  AlignedFloats value_min_;
+  AlignedFloats value_max_;
+  AlignedFloats velocity_min_;
+  AlignedFloats velocity_max_;
+  AlignedFloats delta_min_;
+  AlignedFloats delta_max_;
+  AlignedFloats settled_max_difference_;
+  AlignedFloats settled_max_velocity_;
+  AlignedFloats accel_per_difference_;
+  AlignedFloats wrong_direction_multiplier_;
+
+  // Largest iteration step, in ImpelTime units. Infinite when the init's
+  // max_delta_time does not limit the step.
+  AlignedFloats max_delta_time_;
 };
 
+typedef OvershootImpelProcessorT<float, OvershootImpelInit>
+    OvershootImpelProcessor;
+typedef OvershootImpelProcessorT<mathfu::vec2, OvershootImpelInit2f>
+    OvershootImpelProcessor2f;
+typedef OvershootImpelProcessorT<mathfu::vec3, OvershootImpelInit3f>
+    OvershootImpelProcessor3f;
+typedef OvershootImpelProcessorT<mathfu::vec4, OvershootImpelInit4f>
+    OvershootImpelProcessor4f;
+
 } // namespace impel
 
 #endif // IMPEL_PROCESSOR_OVERSHOOT_H_
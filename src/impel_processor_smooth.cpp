@@ -19,48 +19,248 @@
 namespace impel {
 
 IMPEL_INIT_INSTANTIATE(SmoothImpelInit);
+IMPEL_INIT_INSTANTIATE(SmoothImpelInit2f);
+IMPEL_INIT_INSTANTIATE(SmoothImpelInit3f);
+IMPEL_INIT_INSTANTIATE(SmoothImpelInit4f);
 
-void SmoothImpelProcessor::AdvanceFrame(ImpelTime delta_time) {
-  // Loop through every impeller one at a time.
-  // TODO OPT: reorder data and then optimize with SIMD to process in groups
-  // of 4 floating-point or 8 fixed-point values.
-  for (SmoothImpelData* d = map_.Begin(); d < map_.End(); ++d) {
-    // If the current or target parameters have changed, we need to recalculate
-    // the curve that we're following. We do this lazily to avoid recalculating
-    // more than once when both the current value and target value are set.
-    if (!d->curve_valid) {
-      CalculateCurve(d);
+template<class T, class InitType>
+void SmoothImpelProcessorT<T, InitType>::AdvanceLanes(ImpelTime delta_time,
+                                                     int begin, int end) {
+  // If the current or target parameters have changed, we need to recalculate
+  // the curve that we're following. We do this lazily to avoid recalculating
+  // more than once when both the current value and target value are set.
+  for (int i = begin; i < end; ++i) {
+    if (!curve_valid_[i]) {
+      CalculateCurve(i);
     }
+  }
 
-    // Update the current simulation time. A time of 0 is the start of the
-    // curve, and a time of end_time is the end of the curve.
-    d->time += delta_time;
-
-    // We've we're at the end of the curve then we're already at the target.
-    const bool at_target = d->time >= d->end_time;
-    if (at_target) {
-      // Optimize the case when we're already at the target.
-      d->value = d->target_value;
-      d->velocity = 0.0f;
-    } else {
-      // Evaluate the polynomial at the current time.
-      d->value = d->init.Normalize(d->curve.Evaluate(d->time));
-      d->velocity = d->curve.Derivative(d->time);
-    }
+  // Evaluate the curves kSimdWidth at a time, then finish off the remainder
+  // one at a time. Both paths produce identical results.
+  const float dt = static_cast<float>(delta_time);
+  int i = begin;
+#if defined(IMPEL_SIMD)
+  const Float4 dt4 = Splat4(dt);
+  for (; i + kSimdWidth <= end; i += kSimdWidth) {
+    AdvanceLanesSimd(i, dt4);
+  }
+#endif // defined(IMPEL_SIMD)
+  for (; i < end; ++i) {
+    AdvanceLane(i, dt);
+  }
+}
+
+template<class T, class InitType>
+void SmoothImpelProcessorT<T, InitType>::AdvanceLane(int i, float delta_time) {
+  // Update the current simulation time. A time of 0 is the start of the
+  // curve, and a time of end_time is the end of the curve.
+  time_[i] += delta_time;
+
+  // We've we're at the end of the curve then we're already at the target.
+  const bool at_target = time_[i] >= end_time_[i];
+  if (at_target) {
+    // Optimize the case when we're already at the target.
+    values_[i] = target_values_[i];
+    velocities_[i] = 0.0f;
+    return;
   }
+
+  // Evaluate the polynomial at the current time. Same math as
+  // fpl::BezierCurve::Evaluate() and Derivative(), with start_x = 0.
+  const float a = curve_a_[i];
+  const float b = curve_b_[i];
+  const float c = curve_c_[i];
+  const float d = curve_d_[i];
+  const float x = mathfu::Clamp(time_[i] * curve_one_over_width_[i],
+                                0.0f, 1.0f);
+  const float one_minus_x = 1.0f - x;
+  const float one_minus_x_squared = one_minus_x * one_minus_x;
+  const float one_minus_x_cubed = one_minus_x_squared * one_minus_x;
+  const float x_squared = x * x;
+  const float x_cubed = x_squared * x;
+  const float value = a * x_cubed +
+                      b * x_squared * one_minus_x +
+                      c * x * one_minus_x_squared +
+                      d * one_minus_x_cubed;
+  const float velocity = (3.0f * a - b) * x * x  +
+                         2.0f * (b - c) * x * one_minus_x  +
+                         (c - 3.0f * d) * one_minus_x * one_minus_x;
+
+  // Same as ImpelInitWithVelocity::Normalize(), expressed with the lane's
+  // modular range.
+  const float above_min = value <= modular_min_[i] ?
+                          value + modular_width_[i] : value;
+  values_[i] = above_min > modular_max_[i] ?
+               above_min - modular_width_[i] : above_min;
+  velocities_[i] = velocity;
+}
+
+#if defined(IMPEL_SIMD)
+template<class T, class InitType>
+void SmoothImpelProcessorT<T, InitType>::AdvanceLanesSimd(int i,
+                                                         Float4 delta_time) {
+  const Float4 zero = Splat4(0.0f);
+  const Float4 one = Splat4(1.0f);
+  const Float4 two = Splat4(2.0f);
+  const Float4 three = Splat4(3.0f);
+
+  const Float4 time = Add4(Load4(&time_[i]), delta_time);
+  Store4(&time_[i], time);
+  const Float4 at_target = GreaterEqual4(time, Load4(&end_time_[i]));
+
+  // Evaluate all four polynomials. Operations are ordered exactly as in
+  // AdvanceLane() so that results are bit-identical.
+  const Float4 a = Load4(&curve_a_[i]);
+  const Float4 b = Load4(&curve_b_[i]);
+  const Float4 c = Load4(&curve_c_[i]);
+  const Float4 d = Load4(&curve_d_[i]);
+  const Float4 x = Clamp4(Mul4(time, Load4(&curve_one_over_width_[i])),
+                          zero, one);
+  const Float4 one_minus_x = Sub4(one, x);
+  const Float4 one_minus_x_squared = Mul4(one_minus_x, one_minus_x);
+  const Float4 one_minus_x_cubed = Mul4(one_minus_x_squared, one_minus_x);
+  const Float4 x_squared = Mul4(x, x);
+  const Float4 x_cubed = Mul4(x_squared, x);
+  const Float4 value =
+      Add4(Add4(Add4(Mul4(a, x_cubed),
+                     Mul4(Mul4(b, x_squared), one_minus_x)),
+                Mul4(Mul4(c, x), one_minus_x_squared)),
+           Mul4(d, one_minus_x_cubed));
+  const Float4 velocity =
+      Add4(Add4(Mul4(Mul4(Sub4(Mul4(three, a), b), x), x),
+                Mul4(Mul4(Mul4(two, Sub4(b, c)), x), one_minus_x)),
+           Mul4(Mul4(Sub4(c, Mul4(three, d)), one_minus_x), one_minus_x));
+
+  // Normalize modular values, branch-free.
+  const Float4 width = Load4(&modular_width_[i]);
+  const Float4 above_min = Select4(LessEqual4(value, Load4(&modular_min_[i])),
+                                   Add4(value, width), value);
+  const Float4 normalized = Select4(Greater4(above_min,
+                                             Load4(&modular_max_[i])),
+                                    Sub4(above_min, width), above_min);
+
+  // Snap to the target for lanes at the end of their curve.
+  Store4(&values_[i], Select4(at_target, Load4(&target_values_[i]),
+                              normalized));
+  Store4(&velocities_[i], Select4(at_target, zero, velocity));
 }
+#endif // defined(IMPEL_SIMD)
 
-void SmoothImpelProcessor::CalculateCurve(SmoothImpelData* d) const {
-  if (d->end_time > 0.0f) {
-    d->curve.Initialize(d->value, d->velocity, d->target_value, 0.0f, 0.0f,
-                        d->end_time);
+template<class T, class InitType>
+void SmoothImpelProcessorT<T, InitType>::CalculateCurve(int i) {
+  if (end_time_[i] > 0.0f) {
+    // Same coefficients as fpl::BezierCurve::Initialize() with a start
+    // time of zero and an end derivative of zero.
+    const float start_value = values_[i];
+    const float start_derivative = velocities_[i];
+    const float end_value = target_values_[i];
+    const float end_derivative = 0.0f;
+    curve_a_[i] = end_value;
+    curve_b_[i] = 3.0f * end_value - end_derivative;
+    curve_c_[i] = 3.0f * start_value + start_derivative;
+    curve_d_[i] = start_value;
+    curve_one_over_width_[i] = 1.0f / end_time_[i];
+    assert(curve_one_over_width_[i] < std::numeric_limits<float>::infinity());
   } else {
-    d->curve = BezierCurve1f();
+    curve_a_[i] = 0.0f;
+    curve_b_[i] = 0.0f;
+    curve_c_[i] = 0.0f;
+    curve_d_[i] = 0.0f;
+    curve_one_over_width_[i] = 0.0f;
   }
-  d->time = 0.0f;
-  d->curve_valid = true;
+  time_[i] = 0.0f;
+  curve_valid_[i] = true;
 }
 
+template<class T, class InitType>
+void SmoothImpelProcessorT<T, InitType>::InitializeLane(
+    int i, const InitType& /*init*/) {
+  curve_valid_[i] = false;
+  time_[i] = 0.0f;
+  end_time_[i] = 0.0f;
+  curve_a_[i] = 0.0f;
+  curve_b_[i] = 0.0f;
+  curve_c_[i] = 0.0f;
+  curve_d_[i] = 0.0f;
+  curve_one_over_width_[i] = 0.0f;
+}
+
+template<class T, class InitType>
+void SmoothImpelProcessorT<T, InitType>::ResizeLanes(int count) {
+  Base::ResizeLanes(count);
+  curve_valid_.resize(count);
+  time_.resize(count);
+  end_time_.resize(count);
+  curve_a_.resize(count);
+  curve_b_.resize(count);
+  curve_c_.resize(count);
+  curve_d_.resize(count);
+  curve_one_over_width_.resize(count);
+}
+
+template<class T, class InitType>
+size_t SmoothImpelProcessorT<T, InitType>::MemorySize() const {
+  return Base::MemorySize() + VectorMemory(curve_valid_) + VectorMemory(time_) +
+         VectorMemory(end_time_) + VectorMemory(curve_a_) +
+         VectorMemory(curve_b_) + VectorMemory(curve_c_) +
+         VectorMemory(curve_d_) + VectorMemory(curve_one_over_width_);
+}
+
+template<class T, class InitType>
+void SmoothImpelProcessorT<T, InitType>::SwapLanes(int a, int b) {
+  Base::SwapLanes(a, b);
+  std::swap(curve_valid_[a], curve_valid_[b]);
+  std::swap(time_[a], time_[b]);
+  std::swap(end_time_[a], end_time_[b]);
+  std::swap(curve_a_[a], curve_a_[b]);
+  std::swap(curve_b_[a], curve_b_[b]);
+  std::swap(curve_c_[a], curve_c_[b]);
+  std::swap(curve_d_[a], curve_d_[b]);
+  std::swap(curve_one_over_width_[a], curve_one_over_width_[b]);
+}
+
+template<class T, class InitType>
+bool SmoothImpelProcessorT<T, InitType>::AtRest(int index) const {
+  // Lanes at the end of a valid curve are snapped to the target every frame.
+  for (int lane = FirstLane(index); lane < FirstLane(index + 1); ++lane) {
+    if (!curve_valid_[lane] || time_[lane] < end_time_[lane])
+      return false;
+  }
+  return true;
+}
+
+template<class T, class InitType>
+void SmoothImpelProcessorT<T, InitType>::Snapshot(
+    ImpelSnapshot* snapshot) const {
+  Base::Snapshot(snapshot);
+  snapshot->WriteArray(curve_valid_);
+  snapshot->WriteArray(time_);
+  snapshot->WriteArray(end_time_);
+  snapshot->WriteArray(curve_a_);
+  snapshot->WriteArray(curve_b_);
+  snapshot->WriteArray(curve_c_);
+  snapshot->WriteArray(curve_d_);
+  snapshot->WriteArray(curve_one_over_width_);
+}
+
+template<class T, class InitType>
+void SmoothImpelProcessorT<T, InitType>::Restore(ImpelSnapshotReader* reader) {
+  Base::Restore(reader);
+  reader->ReadArray(&curve_valid_);
+  reader->ReadArray(&time_);
+  reader->ReadArray(&end_time_);
+  reader->ReadArray(&curve_a_);
+  reader->ReadArray(&curve_b_);
+  reader->ReadArray(&curve_c_);
+  reader->ReadArray(&curve_d_);
+  reader->ReadArray(&curve_one_over_width_);
+}
+
+template class SmoothImpelProcessorT<float, SmoothImpelInit>;
+template class SmoothImpelProcessorT<mathfu::vec2, SmoothImpelInit2f>;
+template class SmoothImpelProcessorT<mathfu::vec3, SmoothImpelInit3f>;
+template class SmoothImpelProcessorT<mathfu::vec4, SmoothImpelInit4f>;
+
 } // namespace impel
 
 
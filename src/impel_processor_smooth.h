@@ -34,60 +34,156 @@ struct SmoothImpelInit : public ImpelInitWithVelocity {
 };
 
 
-struct SmoothImpelData : public ImpelDataWithVelocity {
-  // When the current or target state is overridden, the polynomial should be
-  // re-calculated. We only want to calculate once per frame, though, so we do
-  // it lazily.
-  bool curve_valid;
+// SmoothImpelInits for the multi-dimensional processors. Every component is
+// driven with the same parameters.
+struct SmoothImpelInit2f : public SmoothImpelInit {
+  IMPEL_INIT_REGISTER();
+  SmoothImpelInit2f() { type = kType; }
+  explicit SmoothImpelInit2f(const SmoothImpelInit& init)
+      : SmoothImpelInit(init) {
+    type = kType;
+  }
+};
 
-  // Current time into 'curve'.
-  float time;
+struct SmoothImpelInit3f : public SmoothImpelInit {
+  IMPEL_INIT_REGISTER();
+  SmoothImpelInit3f() { type = kType; }
+  explicit SmoothImpelInit3f(const SmoothImpelInit& init)
+      : SmoothImpelInit(init) {
+    type = kType;
+  }
+};
 
-  // Time at which 'curve' has reached the target.
-  float end_time;
+struct SmoothImpelInit4f : public SmoothImpelInit {
+  IMPEL_INIT_REGISTER();
+  SmoothImpelInit4f() { type = kType; }
+  explicit SmoothImpelInit4f(const SmoothImpelInit& init)
+      : SmoothImpelInit(init) {
+    type = kType;
+  }
+};
 
-  // Polynomial with the curve of our motion over time.
-  BezierCurve1f curve;
 
+// Per-Impeller data that is not touched by AdvanceFrame(). The simulation
+// state lives in the processor's per-lane arrays.
+struct SmoothImpelData {
   // Keep a local copy of the init params.
   SmoothImpelInit init;
 
-  virtual void Initialize(const ImpelInit& init_param) {
-    ImpelDataWithVelocity::Initialize(init_param);
-    curve_valid = false;
-    time = 0.0f;
-    curve = BezierCurve1f();
-    init = static_cast<const SmoothImpelInit&>(init_param);
-  }
+  void Initialize(const SmoothImpelInit& init_param) { init = init_param; }
 };
 
 
-class SmoothImpelProcessor :
-    public ImpelProcessorWithVelocity<SmoothImpelData, SmoothImpelInit> {
+// Drives each Impeller along a cubic Bezier curve from its current value and
+// velocity to its target value, arriving at the target time. Vector values
+// follow one curve per component.
+//
+// The curves are stored as a structure-of-arrays, alongside the values,
+// velocities, and targets in the base class. AdvanceLanes() evaluates
+// kSimdWidth curves at a time on SSE and NEON, and falls back to evaluating
+// one curve at a time on other platforms, and for the last few lanes.
+//
+// Use the typedefs below. T is the value type, and InitType is the matching
+// SmoothImpelInit.
+template<class T, class InitType>
+class SmoothImpelProcessorT :
+    public ImpelProcessorWithVelocity<SmoothImpelData, InitType, T> {
+  typedef ImpelProcessorWithVelocity<SmoothImpelData, InitType, T> Base;
 
  public:
-  IMPEL_PROCESSOR_REGISTER(SmoothImpelProcessor, SmoothImpelInit);
-  virtual ~SmoothImpelProcessor() {}
+  IMPEL_PROCESSOR_REGISTER(SmoothImpelProcessorT, InitType);
+  virtual ~SmoothImpelProcessorT() {}
 
-  virtual void AdvanceFrame(ImpelTime delta_time);
-  virtual void SetVelocity(ImpelId id, const float& velocity) {
-    ImpelProcessorWithVelocity::SetVelocity(id, velocity);
-    Data(id).curve_valid = false;
+  virtual void AdvanceLanes(ImpelTime delta_time, int begin, int end);
+  virtual void SetVelocity(ImpelId id, const T& velocity) {
+    Base::SetVelocity(id, velocity);
+    InvalidateCurve(map_.Index(id));
   }
-  virtual void SetTargetValue(ImpelId id, const float& target_value) {
-    ImpelProcessorWithVelocity::SetTargetValue(id, target_value);
-    Data(id).curve_valid = false;
+  virtual void SetTargetValue(ImpelId id, const T& target_value) {
+    Base::SetTargetValue(id, target_value);
+    InvalidateCurve(map_.Index(id));
+  }
+  virtual void SetVelocities(const ImpelId* ids, int count,
+                             const T* velocities) {
+    for (int i = 0; i < count; ++i) {
+      SmoothImpelProcessorT::SetVelocity(ids[i], velocities[i]);
+    }
+  }
+  virtual void SetTargetValues(const ImpelId* ids, int count,
+                               const T* target_values) {
+    for (int i = 0; i < count; ++i) {
+      SmoothImpelProcessorT::SetTargetValue(ids[i], target_values[i]);
+    }
   }
   virtual void SetTargetTime(ImpelId id, float target_time) {
-    SmoothImpelData& data = Data(id);
-    data.curve_valid = false;
-    data.end_time = target_time;
+    const int index = Wake(map_.Index(id));
+    InvalidateCurve(index);
+    for (int lane = FirstLane(index); lane < FirstLane(index + 1); ++lane) {
+      end_time_[lane] = target_time;
+    }
   }
 
  protected:
-  void CalculateCurve(SmoothImpelData* d) const;
+  using Base::kDimensions;
+  using Base::FirstLane;
+  using Base::Wake;
+  using Base::map_;
+  using Base::values_;
+  using Base::velocities_;
+  using Base::target_values_;
+  using Base::modular_min_;
+  using Base::modular_max_;
+  using Base::modular_width_;
+
+  virtual void InitializeLane(int lane, const InitType& init);
+  virtual void ResizeLanes(int count);
+  virtual void SwapLanes(int a, int b);
+  virtual bool AtRest(int index) const;
+  virtual void Snapshot(ImpelSnapshot* snapshot) const;
+  virtual void Restore(ImpelSnapshotReader* reader);
+  virtual size_t MemorySize() const;
+
+  void InvalidateCurve(int index) {
+    for (int lane = FirstLane(index); lane < FirstLane(index + 1); ++lane) {
+      curve_valid_[lane] = false;
+    }
+  }
+  void CalculateCurve(int lane);
+  void AdvanceLane(int lane, float delta_time);
+#if defined(IMPEL_SIMD)
+  void AdvanceLanesSimd(int lane, Float4 delta_time);
+#endif
+
+  // When the current or target state is overridden, the polynomial should be
+  // re-calculated. We only want to calculate once per frame, though, so we do
+  // it lazily.
+  AlignedBytes curve_valid_;
+
+  // Current time into the curve.
+  AlignedFloats time_;
+
+  // Time at which the curve has reached the target.
+  AlignedFloats end_time_;
+
+  // Coefficients of the polynomial with the curve of our motion over time.
+  // Same layout as fpl::BezierCurve. That is,
+  //   B(x) = ax^3  +  bx^2(1 - x)  +  cx(1 - x)^2  +  d(1 - x)^3
+  // where x = time / end_time, clamped to [0, 1].
+  AlignedFloats curve_a_;
+  AlignedFloats curve_b_;
+  AlignedFloats curve_c_;
+  AlignedFloats curve_d_;
+  AlignedFloats curve_one_over_width_;
 };
 
+typedef SmoothImpelProcessorT<float, SmoothImpelInit> SmoothImpelProcessor;
+typedef SmoothImpelProcessorT<mathfu::vec2, SmoothImpelInit2f>
+    SmoothImpelProcessor2f;
+typedef SmoothImpelProcessorT<mathfu::vec3, SmoothImpelInit3f>
+    SmoothImpelProcessor3f;
+typedef SmoothImpelProcessorT<mathfu::vec4, SmoothImpelInit4f>
+    SmoothImpelProcessor4f;
+
 } // namespace impel
 
 #endif // IMPEL_PROCESSOR_SMOOTH_H_
@@ -0,0 +1,296 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "impel_engine.h"
+#include "impel_processor_smooth_fixed.h"
+
+namespace impel {
+
+IMPEL_INIT_INSTANTIATE(SmoothFixedImpelInit);
+
+ImpelId SmoothFixedImpelProcessor::InitializeImpeller(
+    const ImpelInit& init, ImpelEngine* /*engine*/) {
+  assert(init.type == SmoothFixedImpelInit::kType);
+  const SmoothImpelInit& smooth_init = static_cast<const SmoothImpelInit&>(init);
+
+  // New data is always allocated at the end of the packed arrays.
+  const ImpelId id = map_.Allocate();
+  const int i = map_.Count() - 1;
+  ResizeLanes(map_.Count());
+  map_.Data(id).Initialize(smooth_init);
+
+  curve_valid_[i] = false;
+  time_[i] = 0;
+  end_time_[i] = 0;
+  values_[i] = 0;
+  velocities_[i] = 0;
+  target_values_[i] = 0;
+  curve_one_over_width_[i] = 0;
+  curve_a_[i] = 0;
+  curve_b_[i] = 0;
+  curve_c_[i] = 0;
+  curve_d_[i] = 0;
+  derivative_a_[i] = 0;
+  derivative_b_[i] = 0;
+  derivative_c_[i] = 0;
+  modular_min_[i] = smooth_init.modular ?
+      FloatToFixed(smooth_init.min) : std::numeric_limits<Fixed>::min();
+  modular_max_[i] = smooth_init.modular ?
+      FloatToFixed(smooth_init.max) : std::numeric_limits<Fixed>::max();
+  modular_width_[i] = smooth_init.modular ?
+      FloatToFixed(smooth_init.max) - FloatToFixed(smooth_init.min) : 0;
+  return id;
+}
+
+void SmoothFixedImpelProcessor::RemoveImpeller(ImpelId id) {
+  // IdMap::Free() plugs the hole with the last element, so do the same with
+  // the lanes.
+  const int index = map_.Index(id);
+  const int last = map_.Count() - 1;
+  if (index != last) {
+    MoveLane(last, index);
+  }
+  map_.Free(id);
+  ResizeLanes(map_.Count());
+}
+
+void SmoothFixedImpelProcessor::SetTargetTime(ImpelId id, float target_time) {
+  const int i = map_.Index(id);
+  end_time_[i] = std::max(static_cast<int32_t>(target_time + 0.5f), 0);
+  curve_valid_[i] = false;
+}
+
+void SmoothFixedImpelProcessor::AdvanceLanes(ImpelTime delta_time, int begin,
+                                             int end) {
+  // Recalculate invalidated curves lazily, as in SmoothImpelProcessorT.
+  for (int i = begin; i < end; ++i) {
+    if (!curve_valid_[i]) {
+      CalculateCurve(i);
+    }
+  }
+
+  const int32_t dt = static_cast<int32_t>(delta_time);
+  int i = begin;
+#if defined(IMPEL_SIMD_NEON)
+  const int32x4_t dt4 = vdupq_n_s32(dt);
+  for (; i + kSimdWidth <= end; i += kSimdWidth) {
+    AdvanceLanesNeon(i, dt4);
+  }
+#endif // defined(IMPEL_SIMD_NEON)
+  for (; i < end; ++i) {
+    AdvanceLane(i, dt);
+  }
+}
+
+void SmoothFixedImpelProcessor::AdvanceLane(int i, int32_t delta_time) {
+  // Time stops at the end of the curve, so it can never overflow, and
+  // time * one_over_width always fits in a Q0.31.
+  const int32_t time = std::min(time_[i] + delta_time, end_time_[i]);
+  time_[i] = time;
+  if (time >= end_time_[i]) {
+    values_[i] = target_values_[i];
+    velocities_[i] = 0;
+    return;
+  }
+
+  const int32_t x = time * curve_one_over_width_[i];
+  const int32_t one_minus_x = kFractionOne - x;
+  const int32_t x_squared = MulFraction(x, x);
+  const int32_t x_cubed = MulFraction(x_squared, x);
+  const int32_t one_minus_x_squared = MulFraction(one_minus_x, one_minus_x);
+  const int32_t one_minus_x_cubed = MulFraction(one_minus_x_squared,
+                                                one_minus_x);
+  const int32_t x_one_minus_x = MulFraction(x, one_minus_x);
+  const int32_t x_squared_one_minus_x = MulFraction(x_squared, one_minus_x);
+  const int32_t x_one_minus_x_squared = MulFraction(x, one_minus_x_squared);
+  const Fixed value = MulFraction(curve_a_[i], x_cubed) +
+                      MulFraction(curve_b_[i], x_squared_one_minus_x) +
+                      MulFraction(curve_c_[i], x_one_minus_x_squared) +
+                      MulFraction(curve_d_[i], one_minus_x_cubed);
+  const Fixed velocity = MulFraction(derivative_a_[i], x_squared) +
+                         MulFraction(derivative_b_[i], x_one_minus_x) +
+                         MulFraction(derivative_c_[i], one_minus_x_squared);
+
+  const Fixed above_min = value <= modular_min_[i] ?
+                          value + modular_width_[i] : value;
+  values_[i] = above_min > modular_max_[i] ?
+               above_min - modular_width_[i] : above_min;
+  velocities_[i] = velocity;
+}
+
+#if defined(IMPEL_SIMD_NEON)
+void SmoothFixedImpelProcessor::AdvanceLanesNeon(int i, int32x4_t delta_time) {
+  const int32x4_t end_time = vld1q_s32(&end_time_[i]);
+  const int32x4_t time = vminq_s32(vaddq_s32(vld1q_s32(&time_[i]), delta_time),
+                                   end_time);
+  vst1q_s32(&time_[i], time);
+  const uint32x4_t at_target = vcgeq_s32(time, end_time);
+
+  // Same operations as AdvanceLane(). vqrdmulhq_s32 is MulFraction().
+  const int32x4_t x = vmulq_s32(time, vld1q_s32(&curve_one_over_width_[i]));
+  const int32x4_t one_minus_x = vsubq_s32(vdupq_n_s32(kFractionOne), x);
+  const int32x4_t x_squared = vqrdmulhq_s32(x, x);
+  const int32x4_t x_cubed = vqrdmulhq_s32(x_squared, x);
+  const int32x4_t one_minus_x_squared = vqrdmulhq_s32(one_minus_x,
+                                                      one_minus_x);
+  const int32x4_t one_minus_x_cubed = vqrdmulhq_s32(one_minus_x_squared,
+                                                    one_minus_x);
+  const int32x4_t x_one_minus_x = vqrdmulhq_s32(x, one_minus_x);
+  const int32x4_t x_squared_one_minus_x = vqrdmulhq_s32(x_squared, one_minus_x);
+  const int32x4_t x_one_minus_x_squared = vqrdmulhq_s32(x, one_minus_x_squared);
+  const int32x4_t value = vaddq_s32(
+      vaddq_s32(vaddq_s32(vqrdmulhq_s32(vld1q_s32(&curve_a_[i]), x_cubed),
+                          vqrdmulhq_s32(vld1q_s32(&curve_b_[i]),
+                                        x_squared_one_minus_x)),
+                vqrdmulhq_s32(vld1q_s32(&curve_c_[i]), x_one_minus_x_squared)),
+      vqrdmulhq_s32(vld1q_s32(&curve_d_[i]), one_minus_x_cubed));
+  const int32x4_t velocity = vaddq_s32(
+      vaddq_s32(vqrdmulhq_s32(vld1q_s32(&derivative_a_[i]), x_squared),
+                vqrdmulhq_s32(vld1q_s32(&derivative_b_[i]), x_one_minus_x)),
+      vqrdmulhq_s32(vld1q_s32(&derivative_c_[i]), one_minus_x_squared));
+
+  const int32x4_t width = vld1q_s32(&modular_width_[i]);
+  const int32x4_t above_min = vbslq_s32(
+      vcleq_s32(value, vld1q_s32(&modular_min_[i])),
+      vaddq_s32(value, width), value);
+  const int32x4_t normalized = vbslq_s32(
+      vcgtq_s32(above_min, vld1q_s32(&modular_max_[i])),
+      vsubq_s32(above_min, width), above_min);
+
+  vst1q_s32(&values_[i], vbslq_s32(at_target, vld1q_s32(&target_values_[i]),
+                                   normalized));
+  vst1q_s32(&velocities_[i], vbslq_s32(at_target, vdupq_n_s32(0), velocity));
+}
+#endif // defined(IMPEL_SIMD_NEON)
+
+void SmoothFixedImpelProcessor::CalculateCurve(int i) {
+  if (end_time_[i] > 0) {
+    const Fixed start_value = values_[i];
+    const Fixed start_derivative = velocities_[i];
+    const Fixed end_value = target_values_[i];
+    curve_a_[i] = end_value;
+    curve_b_[i] = 3 * end_value;
+    curve_c_[i] = 3 * start_value + start_derivative;
+    curve_d_[i] = start_value;
+    curve_one_over_width_[i] = kFractionOne / end_time_[i];
+  } else {
+    curve_a_[i] = 0;
+    curve_b_[i] = 0;
+    curve_c_[i] = 0;
+    curve_d_[i] = 0;
+    curve_one_over_width_[i] = 0;
+  }
+  derivative_a_[i] = 3 * curve_a_[i] - curve_b_[i];
+  derivative_b_[i] = 2 * (curve_b_[i] - curve_c_[i]);
+  derivative_c_[i] = curve_c_[i] - 3 * curve_d_[i];
+  time_[i] = 0;
+  curve_valid_[i] = true;
+}
+
+void SmoothFixedImpelProcessor::Snapshot(ImpelSnapshot* snapshot) const {
+  map_.Snapshot(snapshot);
+  snapshot->WriteArray(curve_valid_);
+  snapshot->WriteArray(time_);
+  snapshot->WriteArray(end_time_);
+  snapshot->WriteArray(values_);
+  snapshot->WriteArray(velocities_);
+  snapshot->WriteArray(target_values_);
+  snapshot->WriteArray(curve_one_over_width_);
+  snapshot->WriteArray(curve_a_);
+  snapshot->WriteArray(curve_b_);
+  snapshot->WriteArray(curve_c_);
+  snapshot->WriteArray(curve_d_);
+  snapshot->WriteArray(derivative_a_);
+  snapshot->WriteArray(derivative_b_);
+  snapshot->WriteArray(derivative_c_);
+  snapshot->WriteArray(modular_min_);
+  snapshot->WriteArray(modular_max_);
+  snapshot->WriteArray(modular_width_);
+}
+
+void SmoothFixedImpelProcessor::Restore(ImpelSnapshotReader* reader) {
+  map_.Restore(reader);
+  reader->ReadArray(&curve_valid_);
+  reader->ReadArray(&time_);
+  reader->ReadArray(&end_time_);
+  reader->ReadArray(&values_);
+  reader->ReadArray(&velocities_);
+  reader->ReadArray(&target_values_);
+  reader->ReadArray(&curve_one_over_width_);
+  reader->ReadArray(&curve_a_);
+  reader->ReadArray(&curve_b_);
+  reader->ReadArray(&curve_c_);
+  reader->ReadArray(&curve_d_);
+  reader->ReadArray(&derivative_a_);
+  reader->ReadArray(&derivative_b_);
+  reader->ReadArray(&derivative_c_);
+  reader->ReadArray(&modular_min_);
+  reader->ReadArray(&modular_max_);
+  reader->ReadArray(&modular_width_);
+}
+
+void SmoothFixedImpelProcessor::ResizeLanes(int count) {
+  curve_valid_.resize(count);
+  time_.resize(count);
+  end_time_.resize(count);
+  values_.resize(count);
+  velocities_.resize(count);
+  target_values_.resize(count);
+  curve_one_over_width_.resize(count);
+  curve_a_.resize(count);
+  curve_b_.resize(count);
+  curve_c_.resize(count);
+  curve_d_.resize(count);
+  derivative_a_.resize(count);
+  derivative_b_.resize(count);
+  derivative_c_.resize(count);
+  modular_min_.resize(count);
+  modular_max_.resize(count);
+  modular_width_.resize(count);
+}
+
+size_t SmoothFixedImpelProcessor::MemorySize() const {
+  return map_.MemorySize() + VectorMemory(curve_valid_) + VectorMemory(time_) +
+         VectorMemory(end_time_) + VectorMemory(values_) +
+         VectorMemory(velocities_) + VectorMemory(target_values_) +
+         VectorMemory(curve_one_over_width_) + VectorMemory(curve_a_) +
+         VectorMemory(curve_b_) + VectorMemory(curve_c_) +
+         VectorMemory(curve_d_) + VectorMemory(derivative_a_) +
+         VectorMemory(derivative_b_) + VectorMemory(derivative_c_) +
+         VectorMemory(modular_min_) + VectorMemory(modular_max_) +
+         VectorMemory(modular_width_);
+}
+
+void SmoothFixedImpelProcessor::MoveLane(int from, int to) {
+  curve_valid_[to] = curve_valid_[from];
+  time_[to] = time_[from];
+  end_time_[to] = end_time_[from];
+  values_[to] = values_[from];
+  velocities_[to] = velocities_[from];
+  target_values_[to] = target_values_[from];
+  curve_one_over_width_[to] = curve_one_over_width_[from];
+  curve_a_[to] = curve_a_[from];
+  curve_b_[to] = curve_b_[from];
+  curve_c_[to] = curve_c_[from];
+  curve_d_[to] = curve_d_[from];
+  derivative_a_[to] = derivative_a_[from];
+  derivative_b_[to] = derivative_b_[from];
+  derivative_c_[to] = derivative_c_[from];
+  modular_min_[to] = modular_min_[from];
+  modular_max_[to] = modular_max_[from];
+  modular_width_[to] = modular_width_[from];
+}
+
+} // namespace impel
@@ -0,0 +1,169 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPEL_PROCESSOR_SMOOTH_FIXED_H_
+#define IMPEL_PROCESSOR_SMOOTH_FIXED_H_
+
+#include "impel_processor_smooth.h"
+
+namespace impel {
+
+
+// Fixed-point numbers used by SmoothFixedImpelProcessor.
+//
+// Values, velocities, and curve coefficients are Q16.16: 16 integer bits and
+// 16 fractional bits, so the representable range is about +-32768 with a
+// resolution of 1/65536.
+//
+// The normalized curve time, x in [0, 1], and the powers of x are Q0.31
+// fractions. Multiplying a Q16.16 by a Q0.31 with MulFraction() gives a
+// Q16.16, which is exactly what vqrdmulhq_s32 computes on NEON.
+typedef int32_t Fixed;
+
+static const float kFixedOne = 65536.0f;
+static const int32_t kFractionOne = 0x7FFFFFFF;
+
+inline Fixed FloatToFixed(float x) {
+  return static_cast<Fixed>(floor(x * kFixedOne + 0.5f));
+}
+
+inline float FixedToFloat(Fixed x) {
+  return static_cast<float>(x) * (1.0f / kFixedOne);
+}
+
+// Multiply 'a' by the fraction 'f', rounding to nearest. f must be in
+// [0, kFractionOne]. Matches vqrdmulhq_s32 bit-for-bit.
+inline Fixed MulFraction(Fixed a, int32_t f) {
+  return static_cast<Fixed>((static_cast<int64_t>(a) * f * 2 +
+                             (static_cast<int64_t>(1) << 31)) >> 32);
+}
+
+
+// Use this init to drive an Impeller1f along the same curve as
+// SmoothImpelInit, but evaluated with integer arithmetic. The derivative's
+// coefficients are up to 12x the magnitude of the values, so values and
+// velocities should stay within +-2000 or so. Any SmoothImpelInit can be
+// converted.
+struct SmoothFixedImpelInit : public SmoothImpelInit {
+  IMPEL_INIT_REGISTER();
+  SmoothFixedImpelInit() { type = kType; }
+  explicit SmoothFixedImpelInit(const SmoothImpelInit& init)
+      : SmoothImpelInit(init) {
+    type = kType;
+  }
+};
+
+
+// Fixed-point version of SmoothImpelProcessor. Follows the same cubic curve,
+// to within the fixed-point resolution, but never touches the FPU in
+// AdvanceLanes(). The float API converts at the boundary, so the processor is
+// a drop-in replacement for a one-dimensional SmoothImpelProcessor.
+//
+// All state is kept as a structure-of-arrays of 32-bit integers, one lane per
+// Impeller, in the same order as map_. AdvanceLanes() evaluates four curves
+// per NEON instruction, and is scalar elsewhere. Both paths produce identical
+// results.
+class SmoothFixedImpelProcessor : public ImpelProcessor<float> {
+ public:
+  IMPEL_PROCESSOR_REGISTER(SmoothFixedImpelProcessor, SmoothFixedImpelInit);
+  virtual ~SmoothFixedImpelProcessor() { assert(map_.Count() == 0); }
+
+  virtual ImpelId InitializeImpeller(const ImpelInit& init,
+                                     ImpelEngine* engine);
+  virtual void RemoveImpeller(ImpelId id);
+  virtual void AdvanceFrame(ImpelTime delta_time) {
+    AdvanceLanes(delta_time, 0, NumLanes());
+  }
+  virtual int NumLanes() const { return map_.Count(); }
+  virtual void AdvanceLanes(ImpelTime delta_time, int begin, int end);
+  virtual bool ValidImpeller(ImpelId id) const { return map_.Valid(id); }
+  virtual ImpellerType Type() const { return SmoothFixedImpelInit::kType; }
+
+  virtual float Value(ImpelId id) const {
+    return FixedToFloat(values_[map_.Index(id)]);
+  }
+  virtual float Velocity(ImpelId id) const {
+    return FixedToFloat(velocities_[map_.Index(id)]);
+  }
+  virtual float TargetValue(ImpelId id) const {
+    return FixedToFloat(target_values_[map_.Index(id)]);
+  }
+  virtual void SetValue(ImpelId id, const float& value) {
+    const int i = map_.Index(id);
+    values_[i] = FloatToFixed(value);
+    curve_valid_[i] = false;
+  }
+  virtual void SetVelocity(ImpelId id, const float& velocity) {
+    const int i = map_.Index(id);
+    velocities_[i] = FloatToFixed(velocity);
+    curve_valid_[i] = false;
+  }
+  virtual void SetTargetValue(ImpelId id, const float& target_value) {
+    const int i = map_.Index(id);
+    target_values_[i] = FloatToFixed(target_value);
+    curve_valid_[i] = false;
+  }
+  virtual void SetTargetTime(ImpelId id, float target_time);
+  virtual float Difference(ImpelId id) const {
+    return map_.Data(id).init.Normalize(TargetValue(id) - Value(id));
+  }
+  virtual void Snapshot(ImpelSnapshot* snapshot) const;
+  virtual void Restore(ImpelSnapshotReader* reader);
+  virtual size_t MemorySize() const;
+
+ protected:
+  void CalculateCurve(int i);
+  void AdvanceLane(int i, int32_t delta_time);
+#if defined(IMPEL_SIMD_NEON)
+  void AdvanceLanesNeon(int i, int32x4_t delta_time);
+#endif
+  void ResizeLanes(int count);
+  void MoveLane(int from, int to);
+
+  IdMap<SmoothImpelData> map_;
+
+  // Per-lane state. Same meaning as in SmoothImpelProcessorT, but values are
+  // Q16.16 and times are whole ImpelTime units.
+  AlignedBytes curve_valid_;
+  AlignedInts time_;
+  AlignedInts end_time_;
+  AlignedInts values_;
+  AlignedInts velocities_;
+  AlignedInts target_values_;
+
+  // Q0.31 reciprocal of end_time_. time * one_over_width is x in Q0.31.
+  AlignedInts curve_one_over_width_;
+
+  // Coefficients of the curve's value, as in SmoothImpelProcessorT,
+  //   B(x) = ax^3  +  bx^2(1 - x)  +  cx(1 - x)^2  +  d(1 - x)^3
+  // and of its derivative,
+  //   B'(x) = (3a - b)x^2  +  2(b - c)x(1 - x)  +  (c - 3d)(1 - x)^2
+  AlignedInts curve_a_;
+  AlignedInts curve_b_;
+  AlignedInts curve_c_;
+  AlignedInts curve_d_;
+  AlignedInts derivative_a_;
+  AlignedInts derivative_b_;
+  AlignedInts derivative_c_;
+
+  // Modular range in Q16.16. For non-modular values, min and max are the
+  // extremes of the range and width is zero.
+  AlignedInts modular_min_;
+  AlignedInts modular_max_;
+  AlignedInts modular_width_;
+};
+
+} // namespace impel
+
+#endif // IMPEL_PROCESSOR_SMOOTH_FIXED_H_
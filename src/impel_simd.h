@@ -0,0 +1,194 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPEL_SIMD_H_
+#define IMPEL_SIMD_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// Pick a 4-wide floating point instruction set. Define IMPEL_SIMD_DISABLE to
+// force the scalar code paths, e.g. when verifying that SIMD and scalar
+// results match.
+#if !defined(IMPEL_SIMD_DISABLE) && \
+    (defined(__SSE__) || defined(_M_X64) || \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+  #define IMPEL_SIMD_SSE 1
+  #include <xmmintrin.h>
+#elif !defined(IMPEL_SIMD_DISABLE) && \
+    (defined(__ARM_NEON__) || defined(__ARM_NEON))
+  #define IMPEL_SIMD_NEON 1
+  #include <arm_neon.h>
+#endif
+
+#if defined(IMPEL_SIMD_SSE) || defined(IMPEL_SIMD_NEON)
+  #define IMPEL_SIMD 1
+#endif
+
+namespace impel {
+
+// Number of floats processed by one SIMD operation.
+static const int kSimdWidth = 4;
+
+// Alignment required by the SIMD loads and stores below.
+static const size_t kSimdAlignment = 16;
+
+// std::allocator replacement that returns memory aligned to kSimdAlignment.
+// Lets us keep structure-of-arrays data in std::vectors and still load it
+// with aligned SIMD instructions.
+template<class T>
+class AlignedAllocator {
+ public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+  template<class U> struct rebind { typedef AlignedAllocator<U> other; };
+
+  AlignedAllocator() {}
+  template<class U> AlignedAllocator(const AlignedAllocator<U>&) {}
+
+  T* allocate(size_t count) {
+    // Over-allocate, then stash the original pointer just before the aligned
+    // block so that deallocate() can find it.
+    const size_t bytes = count * sizeof(T) + kSimdAlignment + sizeof(void*);
+    void* raw = malloc(bytes);
+    if (raw == nullptr)
+      throw std::bad_alloc();
+    const size_t start = reinterpret_cast<size_t>(raw) + sizeof(void*);
+    const size_t aligned = (start + kSimdAlignment - 1) & ~(kSimdAlignment - 1);
+    reinterpret_cast<void**>(aligned)[-1] = raw;
+    return reinterpret_cast<T*>(aligned);
+  }
+
+  void deallocate(T* p, size_t /*count*/) {
+    if (p != nullptr) {
+      free(reinterpret_cast<void**>(p)[-1]);
+    }
+  }
+
+  size_t max_size() const { return static_cast<size_t>(-1) / sizeof(T); }
+  void construct(T* p, const T& value) { new(p) T(value); }
+  void destroy(T* p) { p->~T(); }
+
+  bool operator==(const AlignedAllocator&) const { return true; }
+  bool operator!=(const AlignedAllocator&) const { return false; }
+};
+
+// Contiguous, SIMD-aligned arrays. Used for structure-of-arrays storage in
+// the ImpelProcessors.
+typedef std::vector<float, AlignedAllocator<float>> AlignedFloats;
+typedef std::vector<uint8_t, AlignedAllocator<uint8_t>> AlignedBytes;
+typedef std::vector<int32_t, AlignedAllocator<int32_t>> AlignedInts;
+
+
+// Thin wrappers around the 4-wide float intrinsics, so that each processor's
+// kernel can be written once for both SSE and NEON.
+#if defined(IMPEL_SIMD_SSE)
+
+typedef __m128 Float4;
+
+inline Float4 Load4(const float* p) { return _mm_load_ps(p); }
+inline void Store4(float* p, Float4 a) { _mm_store_ps(p, a); }
+inline Float4 LoadUnaligned4(const float* p) { return _mm_loadu_ps(p); }
+inline void StoreUnaligned4(float* p, Float4 a) { _mm_storeu_ps(p, a); }
+inline Float4 Splat4(float a) { return _mm_set1_ps(a); }
+inline Float4 Add4(Float4 a, Float4 b) { return _mm_add_ps(a, b); }
+inline Float4 Sub4(Float4 a, Float4 b) { return _mm_sub_ps(a, b); }
+inline Float4 Mul4(Float4 a, Float4 b) { return _mm_mul_ps(a, b); }
+inline Float4 Div4(Float4 a, Float4 b) { return _mm_div_ps(a, b); }
+inline Float4 Min4(Float4 a, Float4 b) { return _mm_min_ps(a, b); }
+inline Float4 Max4(Float4 a, Float4 b) { return _mm_max_ps(a, b); }
+inline Float4 LessEqual4(Float4 a, Float4 b) { return _mm_cmple_ps(a, b); }
+inline Float4 Greater4(Float4 a, Float4 b) { return _mm_cmpgt_ps(a, b); }
+inline Float4 GreaterEqual4(Float4 a, Float4 b) { return _mm_cmpge_ps(a, b); }
+inline Float4 Equal4(Float4 a, Float4 b) { return _mm_cmpeq_ps(a, b); }
+inline Float4 And4(Float4 a, Float4 b) { return _mm_and_ps(a, b); }
+inline Float4 Abs4(Float4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+// Return true if any lane of 'mask' is set.
+inline bool AnyTrue4(Float4 mask) { return _mm_movemask_ps(mask) != 0; }
+// Return 'a' where 'mask' is set, 'b' elsewhere.
+inline Float4 Select4(Float4 mask, Float4 a, Float4 b) {
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+#elif defined(IMPEL_SIMD_NEON)
+
+typedef float32x4_t Float4;
+
+inline Float4 Load4(const float* p) { return vld1q_f32(p); }
+inline void Store4(float* p, Float4 a) { vst1q_f32(p, a); }
+inline Float4 LoadUnaligned4(const float* p) { return vld1q_f32(p); }
+inline void StoreUnaligned4(float* p, Float4 a) { vst1q_f32(p, a); }
+inline Float4 Splat4(float a) { return vdupq_n_f32(a); }
+inline Float4 Add4(Float4 a, Float4 b) { return vaddq_f32(a, b); }
+inline Float4 Sub4(Float4 a, Float4 b) { return vsubq_f32(a, b); }
+inline Float4 Mul4(Float4 a, Float4 b) { return vmulq_f32(a, b); }
+// ARMv7 NEON has no divide. Refine the reciprocal estimate twice, which is
+// accurate to about one ulp.
+inline Float4 Div4(Float4 a, Float4 b) {
+  Float4 reciprocal = vrecpeq_f32(b);
+  reciprocal = vmulq_f32(vrecpsq_f32(b, reciprocal), reciprocal);
+  reciprocal = vmulq_f32(vrecpsq_f32(b, reciprocal), reciprocal);
+  return vmulq_f32(a, reciprocal);
+}
+inline Float4 Min4(Float4 a, Float4 b) { return vminq_f32(a, b); }
+inline Float4 Max4(Float4 a, Float4 b) { return vmaxq_f32(a, b); }
+inline Float4 LessEqual4(Float4 a, Float4 b) {
+  return vreinterpretq_f32_u32(vcleq_f32(a, b));
+}
+inline Float4 Greater4(Float4 a, Float4 b) {
+  return vreinterpretq_f32_u32(vcgtq_f32(a, b));
+}
+inline Float4 GreaterEqual4(Float4 a, Float4 b) {
+  return vreinterpretq_f32_u32(vcgeq_f32(a, b));
+}
+inline Float4 Equal4(Float4 a, Float4 b) {
+  return vreinterpretq_f32_u32(vceqq_f32(a, b));
+}
+inline Float4 And4(Float4 a, Float4 b) {
+  return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a),
+                                         vreinterpretq_u32_f32(b)));
+}
+inline Float4 Abs4(Float4 a) { return vabsq_f32(a); }
+// Return true if any lane of 'mask' is set.
+inline bool AnyTrue4(Float4 mask) {
+  const uint32x4_t m = vreinterpretq_u32_f32(mask);
+  const uint32x2_t half = vorr_u32(vget_low_u32(m), vget_high_u32(m));
+  return vget_lane_u32(vpmax_u32(half, half), 0) != 0;
+}
+// Return 'a' where 'mask' is set, 'b' elsewhere.
+inline Float4 Select4(Float4 mask, Float4 a, Float4 b) {
+  return vbslq_f32(vreinterpretq_u32_f32(mask), a, b);
+}
+
+#endif // defined(IMPEL_SIMD_NEON)
+
+#if defined(IMPEL_SIMD)
+// Same result as mathfu::Clamp(x, lo, hi), including the choice of operand
+// when values compare equal, so SIMD and scalar paths match bit-for-bit.
+inline Float4 Clamp4(Float4 x, Float4 lo, Float4 hi) {
+  return Max4(Min4(hi, x), lo);
+}
+#endif // defined(IMPEL_SIMD)
+
+} // namespace impel
+
+#endif // IMPEL_SIMD_H_
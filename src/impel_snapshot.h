@@ -0,0 +1,110 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPEL_SNAPSHOT_H_
+#define IMPEL_SNAPSHOT_H_
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace impel {
+
+
+// A raw copy of the state of an ImpelEngine. Filled by ImpelEngine::Snapshot()
+// and consumed by ImpelEngine::Restore().
+//
+// Processors append their flat arrays with memcpy, so taking and restoring a
+// snapshot costs about as much as copying the simulation data once. The
+// buffer keeps its capacity between snapshots, so once it has grown to fit,
+// taking a snapshot does not allocate. Keep one ImpelSnapshot per saved frame
+// and reuse them.
+//
+// Snapshots hold pointers to the ImpellerTypeInfos, and are only meaningful
+// within the process that took them.
+class ImpelSnapshot {
+ public:
+  ImpelSnapshot() {}
+
+  // Discard the contents, but keep the memory.
+  void Clear() { bytes_.clear(); }
+  void Reserve(size_t num_bytes) { bytes_.reserve(num_bytes); }
+  size_t Size() const { return bytes_.size(); }
+  const uint8_t* Bytes() const { return bytes_.data(); }
+
+  // Append 'num_bytes' from 'data'.
+  void Write(const void* data, size_t num_bytes) {
+    const size_t offset = bytes_.size();
+    bytes_.resize(offset + num_bytes);
+    if (num_bytes > 0) {
+      memcpy(&bytes_[offset], data, num_bytes);
+    }
+  }
+
+  // Append a plain-old-data value.
+  template<class T>
+  void WriteValue(const T& value) { Write(&value, sizeof(value)); }
+
+  // Append the length and contents of 'array'. The elements must be safe to
+  // copy with memcpy.
+  template<class T, class Allocator>
+  void WriteArray(const std::vector<T, Allocator>& array) {
+    WriteValue(static_cast<uint32_t>(array.size()));
+    Write(array.data(), array.size() * sizeof(T));
+  }
+
+ private:
+  std::vector<uint8_t> bytes_;
+};
+
+
+// Reads an ImpelSnapshot back, in the order it was written.
+class ImpelSnapshotReader {
+ public:
+  explicit ImpelSnapshotReader(const ImpelSnapshot& snapshot)
+      : snapshot_(snapshot), offset_(0) {}
+
+  bool Done() const { return offset_ >= snapshot_.Size(); }
+
+  void Read(void* data, size_t num_bytes) {
+    assert(offset_ + num_bytes <= snapshot_.Size());
+    if (num_bytes > 0) {
+      memcpy(data, snapshot_.Bytes() + offset_, num_bytes);
+    }
+    offset_ += num_bytes;
+  }
+
+  template<class T>
+  void ReadValue(T* value) { Read(value, sizeof(*value)); }
+
+  // Resize 'array' to the saved length, and copy the saved contents over it.
+  // Does not allocate when 'array' is already the saved length.
+  template<class T, class Allocator>
+  void ReadArray(std::vector<T, Allocator>* array) {
+    uint32_t count = 0;
+    ReadValue(&count);
+    array->resize(count);
+    Read(array->data(), count * sizeof(T));
+  }
+
+ private:
+  const ImpelSnapshot& snapshot_;
+  size_t offset_;
+};
+
+
+} // namespace impel
+
+#endif // IMPEL_SNAPSHOT_H_
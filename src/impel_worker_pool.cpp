@@ -0,0 +1,134 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "impel_worker_pool.h"
+
+namespace impel {
+
+ImpelWorkerPool::ImpelWorkerPool()
+    : fn_(nullptr),
+      context_(nullptr),
+      num_jobs_(0),
+      next_job_(0),
+      jobs_remaining_(0),
+      busy_workers_(0),
+      batch_(0),
+      quit_(false) {
+}
+
+ImpelWorkerPool::~ImpelWorkerPool() {
+  StopThreads();
+}
+
+void ImpelWorkerPool::SetNumThreads(int num_threads) {
+  StopThreads();
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.push_back(std::thread(&ImpelWorkerPool::WorkerMain, this));
+  }
+}
+
+void ImpelWorkerPool::StopThreads() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  batch_started_.notify_all();
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    threads_[i].join();
+  }
+  threads_.clear();
+  quit_ = false;
+}
+
+void ImpelWorkerPool::Run(JobFn* fn, void* context, int num_jobs) {
+  if (num_jobs <= 0)
+    return;
+
+  // Without threads, or with only one job, skip the synchronization.
+  if (threads_.empty() || num_jobs == 1) {
+    for (int i = 0; i < num_jobs; ++i) {
+      fn(context, i);
+    }
+    return;
+  }
+
+  // Publish the batch and wake the workers. A worker that woke up late for
+  // the previous batch may still be looking at it, so wait for it to leave.
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (busy_workers_ > 0) {
+      batch_finished_.wait(lock);
+    }
+    fn_ = fn;
+    context_ = context;
+    num_jobs_ = num_jobs;
+    jobs_remaining_ = num_jobs;
+    next_job_.store(0);
+    batch_++;
+  }
+  batch_started_.notify_all();
+
+  // Help out, then wait for the stragglers.
+  const int completed = RunJobs();
+  std::unique_lock<std::mutex> lock(mutex_);
+  jobs_remaining_ -= completed;
+  while (jobs_remaining_ > 0) {
+    batch_finished_.wait(lock);
+  }
+}
+
+int ImpelWorkerPool::RunJobs() {
+  int completed = 0;
+  for (;;) {
+    const int job = next_job_.fetch_add(1);
+    if (job >= num_jobs_)
+      break;
+    fn_(context_, job);
+    completed++;
+  }
+  return completed;
+}
+
+void ImpelWorkerPool::WorkerMain() {
+  unsigned int batch_seen = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    batch_seen = batch_;
+  }
+
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (!quit_ && batch_ == batch_seen) {
+        batch_started_.wait(lock);
+      }
+      if (quit_)
+        return;
+      batch_seen = batch_;
+      busy_workers_++;
+    }
+
+    const int completed = RunJobs();
+
+    // The last job of the batch wakes up Run().
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_remaining_ -= completed;
+    busy_workers_--;
+    if (jobs_remaining_ == 0 || busy_workers_ == 0) {
+      batch_finished_.notify_all();
+    }
+  }
+}
+
+} // namespace impel
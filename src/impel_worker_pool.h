@@ -0,0 +1,93 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPEL_WORKER_POOL_H_
+#define IMPEL_WORKER_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace impel {
+
+// A small fixed-size pool of threads that runs a batch of independent jobs
+// and waits for them all to finish. The calling thread also runs jobs, so a
+// pool with N threads uses N + 1 cores.
+//
+// Used by ImpelEngine to step processors, or chunks of processors, in
+// parallel. Only one batch may be in flight at a time.
+class ImpelWorkerPool {
+ public:
+  // Called once for every job in [0, num_jobs), from an arbitrary thread.
+  typedef void JobFn(void* context, int job);
+
+  ImpelWorkerPool();
+  ~ImpelWorkerPool();
+
+  // Stop the current threads and start 'num_threads' new ones. With zero
+  // threads, Run() executes every job on the calling thread.
+  void SetNumThreads(int num_threads);
+  int NumThreads() const { return static_cast<int>(threads_.size()); }
+
+  // Call fn(context, i) for every i in [0, num_jobs), and return once all of
+  // the calls have completed.
+  void Run(JobFn* fn, void* context, int num_jobs);
+
+ private:
+  void StopThreads();
+  void WorkerMain();
+
+  // Claim and execute jobs from the current batch until none remain. Return
+  // the number of jobs executed.
+  int RunJobs();
+
+  std::vector<std::thread> threads_;
+
+  // Guards everything below except next_job_.
+  std::mutex mutex_;
+
+  // Signalled when a new batch is started, or when the threads should quit.
+  std::condition_variable batch_started_;
+
+  // Signalled when the last job of a batch completes.
+  std::condition_variable batch_finished_;
+
+  // The current batch.
+  JobFn* fn_;
+  void* context_;
+  int num_jobs_;
+
+  // Index of the next job to be claimed. Jobs are claimed lock-free.
+  std::atomic<int> next_job_;
+
+  // Number of jobs in the current batch that have not yet completed.
+  int jobs_remaining_;
+
+  // Number of workers currently inside RunJobs(). A new batch cannot be
+  // published until this reaches zero.
+  int busy_workers_;
+
+  // Incremented every batch, so that workers can tell a new batch from a
+  // spurious wakeup.
+  unsigned int batch_;
+
+  // Set when the threads should exit.
+  bool quit_;
+};
+
+} // namespace impel
+
+#endif // IMPEL_WORKER_POOL_H_
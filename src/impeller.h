@@ -27,7 +27,8 @@ namespace impel {
 class ImpellerBase {
  public:
   ImpellerBase() : processor_(nullptr), id_(kImpelIdInvalid) {}
-  ImpellerBase(const ImpelInit& init, ImpelEngine* engine) {
+  ImpellerBase(const ImpelInit& init, ImpelEngine* engine)
+      : processor_(nullptr), id_(kImpelIdInvalid) {
     Initialize(init, engine);
   }
   ~ImpellerBase() { Invalidate(); }
@@ -50,14 +51,23 @@ class ImpellerBase {
   void Invalidate() {
     if (Valid()) {
       processor_->RemoveImpeller(id_);
-      processor_ = nullptr;
-      id_ = kImpelIdInvalid;
     }
+    processor_ = nullptr;
+    id_ = kImpelIdInvalid;
   }
 
   // Return true if this Impeller is currently being driven by an
-  // ImpelProcessor. That is, it has been successfully initialized.
-  bool Valid() const { return processor_ != nullptr; }
+  // ImpelProcessor. That is, it has been successfully initialized, and its
+  // id has not been removed from the processor through another copy of this
+  // Impeller.
+  bool Valid() const {
+    return processor_ != nullptr && processor_->ValidImpeller(id_);
+  }
+
+  // Return the id that identifies this Impeller to its ImpelProcessor. Lets
+  // callers gather several Impellers' ids and use the processor's bulk
+  // accessors.
+  ImpelId Id() const { return id_; }
 
   // Return the GUID representing the type Impeller we've been initilized to.
   // An Impeller can take on any type, provided the dimensions match.
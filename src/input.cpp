@@ -26,11 +26,6 @@
 
 namespace fpl {
 
-// ANDROID_GAMEPAD is defined in input.h, if we're running on an android device.
-#ifdef ANDROID_GAMEPAD
-const int kMaxAndroidEventsPerFrame = 100;
-#endif // ANDROID_GAMEPAD
-
 // Maximum range (+/-) generated by joystick axis events
 static const float kJoystickAxisRange = 32767.0;
 
@@ -89,6 +84,7 @@ void InputSystem::AdvanceFrame(vec2i *window_size) {
   frame_time_ = millis - last_millis_;
   last_millis_ = millis;
   frames_++;
+  events_this_frame_ = 0;
 
 # ifdef LOG_FRAMERATE
   // Simplistic frame delta output.
@@ -113,30 +109,38 @@ void InputSystem::AdvanceFrame(vec2i *window_size) {
   for (auto it = gamepad_map_.begin(); it != gamepad_map_.end(); ++it) {
     it->second.AdvanceFrame();
   }
+#endif // ANDROID_GAMEPAD
+  PollEvents(window_size);
+}
+
+void InputSystem::PollEvents(vec2i *window_size) {
+#ifdef ANDROID_GAMEPAD
   HandleGamepadEvents();
 #endif // ANDROID_GAMEPAD
   // Poll events until Q is empty.
   SDL_Event event;
   while (SDL_PollEvent(&event)) {
+    events_this_frame_++;
     switch(event.type) {
       case SDL_QUIT:
         exit_requested_ = true;
         break;
       case SDL_KEYDOWN:
       case SDL_KEYUP: {
-        GetButton(event.key.keysym.sym).Update(event.key.state == SDL_PRESSED);
+        GetButton(event.key.keysym.sym).Update(event.key.state == SDL_PRESSED,
+                                               event.key.timestamp);
         break;
       }
 #     ifdef PLATFORM_MOBILE
       case SDL_FINGERDOWN: {
         int i = UpdateDragPosition(event.tfinger, event.type, *window_size);
-        GetPointerButton(i).Update(true);
+        GetPointerButton(i).Update(true, event.tfinger.timestamp);
         break;
       }
       case SDL_FINGERUP: {
         int i = FindPointer(event.tfinger.fingerId);
         RemovePointer(i);
-        GetPointerButton(i).Update(false);
+        GetPointerButton(i).Update(false, event.tfinger.timestamp);
         break;
       }
       case SDL_FINGERMOTION: {
@@ -147,14 +151,16 @@ void InputSystem::AdvanceFrame(vec2i *window_size) {
       case SDL_MOUSEBUTTONDOWN:
       case SDL_MOUSEBUTTONUP: {
         GetPointerButton(event.button.button - 1).Update(
-            event.button.state == SDL_PRESSED);
+            event.button.state == SDL_PRESSED, event.button.timestamp);
         pointers_[0].mousepos = vec2i(event.button.x, event.button.y);
         pointers_[0].used = true;
+        pointers_[0].time = event.button.timestamp;
         break;
       }
       case SDL_MOUSEMOTION: {
         pointers_[0].mousedelta += vec2i(event.motion.xrel, event.motion.yrel);
         pointers_[0].mousepos = vec2i(event.button.x, event.button.y);
+        pointers_[0].time = event.motion.timestamp;
         break;
       }
       case SDL_WINDOWEVENT: {
@@ -197,7 +203,7 @@ void InputSystem::HandleJoystickEvent(SDL_Event event) {
     case SDL_JOYBUTTONDOWN:
     case SDL_JOYBUTTONUP:
       GetJoystick(event.jbutton.which).GetButton(event.jbutton.button).Update(
-          event.jbutton.state == SDL_PRESSED);
+          event.jbutton.state == SDL_PRESSED, event.jbutton.timestamp);
       break;
     case SDL_JOYHATMOTION:
       GetJoystick(event.jhat.which).GetHat(event.jhat.hat).Update(
@@ -309,6 +315,7 @@ size_t InputSystem::UpdateDragPosition(const SDL_TouchFingerEvent &e,
       auto event_delta = vec2(e.dx, e.dy);
       p.mousepos = vec2i(event_position * vec2(window_size));
       p.mousedelta += vec2i(event_delta * vec2(window_size));
+      p.time = e.timestamp;
       return j;
     }
   }
@@ -351,11 +358,13 @@ void InputSystem::CloseOpenJoysticks(){
   }
 }
 
-void Button::Update(bool down) {
+void Button::Update(bool down, uint32_t time) {
   if (!is_down_ && down) {
     went_down_ = true;
+    down_time_ = time;
   } else if (is_down_ && !down) {
     went_up_ = true;
+    up_time_ = time;
   }
   is_down_ = down;
 }
@@ -411,27 +420,21 @@ int Joystick::GetNumHats() const {
 }
 
 #ifdef ANDROID_GAMEPAD
-std::queue<AndroidInputEvent> InputSystem::unhandled_java_input_events_;
+AndroidInputEventRing InputSystem::unhandled_java_input_events_;
 
 void InputSystem::ReceiveGamepadEvent(AndroidInputDeviceId device_id,
                                       int event_code, int control_code,
                                       float x, float y) {
-  if (unhandled_java_input_events_.size() < kMaxAndroidEventsPerFrame) {
-    pthread_mutex_lock(&android_event_mutex);
-    unhandled_java_input_events_.push(
-        AndroidInputEvent(device_id, event_code, control_code, x, y));
-    pthread_mutex_unlock(&android_event_mutex);
-  }
+  unhandled_java_input_events_.Push(
+      AndroidInputEvent(device_id, event_code, control_code, x, y,
+                        SDL_GetTicks()));
 }
 
 // Process and handle the events we have received from Java.
 void InputSystem::HandleGamepadEvents() {
   AndroidInputEvent event;
-  pthread_mutex_lock(&android_event_mutex);
-  while (unhandled_java_input_events_.size() > 0) {
-    event = unhandled_java_input_events_.front();
-    unhandled_java_input_events_.pop();
-
+  while (unhandled_java_input_events_.Pop(&event)) {
+    events_this_frame_++;
     Gamepad &gamepad = GetGamepad(event.device_id);
     int button_index;
 
@@ -440,14 +443,14 @@ void InputSystem::HandleGamepadEvents() {
         button_index =
             Gamepad::GetGamepadCodeFromJavaKeyCode(event.control_code);
         if (button_index != Gamepad::kInvalid) {
-          gamepad.GetButton(button_index).Update(true);
+          gamepad.GetButton(button_index).Update(true, event.time);
         }
         break;
       case AKEY_EVENT_ACTION_UP:
         button_index =
             Gamepad::GetGamepadCodeFromJavaKeyCode(event.control_code);
         if (button_index != Gamepad::kInvalid) {
-          gamepad.GetButton(button_index).Update(false);
+          gamepad.GetButton(button_index).Update(false, event.time);
         }
         break;
       case AMOTION_EVENT_ACTION_MOVE:
@@ -456,16 +459,13 @@ void InputSystem::HandleGamepadEvents() {
         const bool up = event.y < -kGamepadHatThreshold;
         const bool down = event.y > kGamepadHatThreshold;
 
-        gamepad.GetButton(Gamepad::kLeft).Update(left);
-        gamepad.GetButton(Gamepad::kRight).Update(right);
-        gamepad.GetButton(Gamepad::kUp).Update(up);
-        gamepad.GetButton(Gamepad::kDown).Update(down);
+        gamepad.GetButton(Gamepad::kLeft).Update(left, event.time);
+        gamepad.GetButton(Gamepad::kRight).Update(right, event.time);
+        gamepad.GetButton(Gamepad::kUp).Update(up, event.time);
+        gamepad.GetButton(Gamepad::kDown).Update(down, event.time);
         break;
     }
   }
-  // Clear the queue
-  std::queue<AndroidInputEvent>().swap(unhandled_java_input_events_);
-  pthread_mutex_unlock(&android_event_mutex);
 }
 
 // Reset the per-frame input on all our sub-elements
@@ -486,8 +486,6 @@ struct JavaToGamepadMapping {
   int gamepad_code;
 };
 
-pthread_mutex_t InputSystem::android_event_mutex = PTHREAD_MUTEX_INITIALIZER;
-
 int Gamepad::GetGamepadCodeFromJavaKeyCode(int java_keycode) {
   // Note that DpadCenter maps onto ButtonA.  They have the same functional
   // purpose, and anyone dealing with a gamepad isn't going to want to deal with
@@ -12,17 +12,16 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include <queue>
-
 #ifndef INPUT_SYSTEM_H
 #define INPUT_SYSTEM_H
 
+#include "spsc_ring.h"
+
 #ifdef __ANDROID__
 // Enable the android gamepad code.  It receives input events from java, via
 // JNI, and creates a local representation of the state of any connected
 // gamepads.  Also enables the gamepad_controller controller class.
 #define ANDROID_GAMEPAD
-#include "pthread.h"
 #endif
 
 namespace fpl {
@@ -35,21 +34,34 @@ typedef int AndroidInputDeviceId;
 #endif
 
 // Used to record state for fingers, mousebuttons, keys and gamepad buttons.
-// Allows you to know if a button went up/down this frame.
+// Allows you to know if a button went up/down this frame, and when.
 class Button {
  public:
-  Button() : is_down_(false) { AdvanceFrame(); }
+  Button() : is_down_(false), down_time_(0), up_time_(0) { AdvanceFrame(); }
   void AdvanceFrame() { went_down_ = went_up_ = false; }
-  void Update(bool down);
+
+  // 'time' is when the button changed, in SDL_GetTicks() milliseconds, like
+  // the timestamps of SDL events.
+  void Update(bool down, uint32_t time);
+
+  // For changes that aren't timestamped, which are taken to happen now.
+  void Update(bool down) { Update(down, SDL_GetTicks()); }
 
   bool is_down() const { return is_down_; }
   bool went_down() const { return went_down_; }
   bool went_up() const { return went_up_; }
 
+  // When the button last went down, and up, in SDL_GetTicks() milliseconds.
+  // More precise than the frame in which went_down() or went_up() is set.
+  uint32_t down_time() const { return down_time_; }
+  uint32_t up_time() const { return up_time_; }
+
  private:
   bool is_down_;
   bool went_down_;
   bool went_up_;
+  uint32_t down_time_;
+  uint32_t up_time_;
 };
 
 // This enum extends the SDL_Keycode (an int) which represent all keyboard
@@ -83,7 +95,10 @@ struct Pointer {
     vec2i mousedelta;
     bool used;
 
-    Pointer() : id(0), mousepos(-1), mousedelta(0), used(false) {};
+    // When mousepos last changed, in SDL_GetTicks() milliseconds.
+    uint32_t time;
+
+    Pointer() : id(0), mousepos(-1), mousedelta(0), used(false), time(0) {};
 };
 
 // Used to record state for axes
@@ -182,24 +197,33 @@ const float kGamepadHatThreshold = 0.5f;
 struct AndroidInputEvent {
   AndroidInputEvent() {}
   AndroidInputEvent(AndroidInputDeviceId device_id_, int event_code_,
-                    int control_code_, float x_, float y_)
+                    int control_code_, float x_, float y_, uint32_t time_)
     : device_id(device_id_),
       event_code(event_code_),
       control_code(control_code_),
       x(x_),
-      y(y_){}
+      y(y_),
+      time(time_){}
   AndroidInputDeviceId device_id;
   int event_code;
   int control_code;
   float x, y;
+
+  // When the event was received, in SDL_GetTicks() milliseconds.
+  uint32_t time;
 };
+
+// Events received from java but not yet handled. Written by the java UI
+// thread and read by the game thread, without either waiting on the other.
+// Must hold a frame's worth of analog events from a busy gamepad.
+typedef SpscRing<AndroidInputEvent, 128> AndroidInputEventRing;
 #endif // ANDROID_GAMEPAD
 
 class InputSystem {
  public:
   InputSystem() : exit_requested_(false), minimized_(false),
       frame_time_(0), last_millis_(0), start_time_(0), frames_(0),
-      minimized_frame_(0) {
+      minimized_frame_(0), events_this_frame_(0) {
     const int kMaxSimultanuousPointers = 10;  // All current touch screens.
     pointers_.assign(kMaxSimultanuousPointers, Pointer());
   }
@@ -213,6 +237,11 @@ class InputSystem {
   // resizes.
   void AdvanceFrame(vec2i *window_size);
 
+  // Process the events that arrived since AdvanceFrame(), without starting a
+  // new frame, so that went_down() and went_up() cover the whole frame. Lets
+  // input be sampled again right before it's used.
+  void PollEvents(vec2i *window_size);
+
   // Get time in second since the start of the game, or since the last frame.
   float Time() const;
   float DeltaTime() const;
@@ -238,7 +267,8 @@ class InputSystem {
     return gamepad_map_;
   }
 
-  // Receives events from java, and stuffs them into a vector until we're ready.
+  // Receives events from java, and stuffs them into a ring until we're ready.
+  // Drops the event if the ring is full.
   static void ReceiveGamepadEvent(int controller_id,
                                   int event_code,
                                   int control_code,
@@ -246,6 +276,12 @@ class InputSystem {
 
   // Runs through all the received events and processes them.
   void HandleGamepadEvents();
+
+  // Number of events from java that were dropped because the game thread
+  // didn't keep up.
+  static uint32_t DroppedGamepadEvents() {
+    return unhandled_java_input_events_.overflows();
+  }
 #endif // ANDROID_GAMEPAD
 
   // Get a Button object for a pointer index.
@@ -267,6 +303,10 @@ class InputSystem {
   int minimized_frame() const { return minimized_frame_; }
   int frames() const { return frames_; }
 
+  // Number of events handled since the last AdvanceFrame() started, of any
+  // kind, including the android gamepad's.
+  int events_this_frame() const { return events_this_frame_; }
+
  private:
   std::vector<SDL_Joystick*> open_joystick_list;
   static int HandleAppEvents(void *userdata, SDL_Event *event);
@@ -288,8 +328,7 @@ class InputSystem {
 
 #ifdef ANDROID_GAMEPAD
   std::map<AndroidInputDeviceId, Gamepad> gamepad_map_;
-  static pthread_mutex_t android_event_mutex;
-  static std::queue<AndroidInputEvent> unhandled_java_input_events_;
+  static AndroidInputEventRing unhandled_java_input_events_;
 #endif // ANDROID_GAMEPAD
 
   // Most recent frame delta, in milliseconds.
@@ -308,6 +347,9 @@ class InputSystem {
   // Most recent frame at which we were minimized or maximized.
   int minimized_frame_;
 
+  // Events handled since the start of AdvanceFrame().
+  int events_this_frame_;
+
  public:
   static const int kMillisecondsPerSecond = 1000;
 };
@@ -0,0 +1,111 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "character.h"
+#include "input_recording.h"
+#include "input_recording_generated.h"
+#include "mapped_file.h"
+#include "utilities.h"
+
+namespace fpl {
+namespace pie_noon {
+
+void InputRecording::Start(
+    uint32_t seed, const std::vector<std::unique_ptr<Character>>& characters) {
+  seed_ = seed;
+  controller_types_.resize(characters.size());
+  for (size_t i = 0; i < characters.size(); ++i) {
+    controller_types_[i] =
+        static_cast<uint8_t>(characters[i]->controller()->controller_type());
+  }
+  delta_times_.clear();
+  inputs_.clear();
+}
+
+void InputRecording::RecordFrame(
+    WorldTime delta_time,
+    const std::vector<std::unique_ptr<Character>>& characters) {
+  assert(static_cast<int>(characters.size()) == NumCharacters());
+  delta_times_.push_back(delta_time);
+  for (size_t i = 0; i < characters.size(); ++i) {
+    const Controller* controller = characters[i]->controller();
+    const Inputs inputs = {
+      controller->is_down(), controller->went_down(), controller->went_up()
+    };
+    inputs_.push_back(inputs);
+  }
+}
+
+bool InputRecording::Save(const char* filename) const {
+  flatbuffers::FlatBufferBuilder builder;
+  auto controller_types = builder.CreateVector(controller_types_);
+  auto delta_times = builder.CreateVector(delta_times_);
+  std::vector<RecordedInputs> recorded_inputs;
+  recorded_inputs.reserve(inputs_.size());
+  for (size_t i = 0; i < inputs_.size(); ++i) {
+    recorded_inputs.push_back(RecordedInputs(inputs_[i].is_down,
+                                             inputs_[i].went_down,
+                                             inputs_[i].went_up));
+  }
+  auto inputs = builder.CreateVectorOfStructs(recorded_inputs.data(),
+                                              recorded_inputs.size());
+  builder.Finish(CreateInputRecordingDef(builder, seed_, controller_types,
+                                         delta_times, inputs));
+  return SaveFile(filename, builder.GetBufferPointer(), builder.GetSize());
+}
+
+bool InputRecording::Load(const char* filename) {
+  MappedFile source;
+  if (!source.Open(filename))
+    return false;
+
+  flatbuffers::Verifier verifier(source.data(), source.size());
+  if (!VerifyInputRecordingDefBuffer(verifier)) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "%s is not an input recording\n",
+                 filename);
+    return false;
+  }
+
+  const InputRecordingDef* def = GetInputRecordingDef(source.data());
+  const auto controller_types = def->controller_types();
+  const auto delta_times = def->delta_times();
+  const auto inputs = def->inputs();
+  if (!controller_types || !delta_times || !inputs ||
+      inputs->size() != controller_types->size() * delta_times->size()) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "%s is incomplete\n", filename);
+    return false;
+  }
+
+  seed_ = def->seed();
+  controller_types_.resize(controller_types->size());
+  for (size_t i = 0; i < controller_types->size(); ++i) {
+    controller_types_[i] = controller_types->Get(i);
+  }
+  delta_times_.resize(delta_times->size());
+  for (size_t i = 0; i < delta_times->size(); ++i) {
+    delta_times_[i] = delta_times->Get(i);
+  }
+  inputs_.resize(inputs->size());
+  for (size_t i = 0; i < inputs->size(); ++i) {
+    const RecordedInputs* recorded = inputs->Get(i);
+    inputs_[i].is_down = recorded->is_down();
+    inputs_[i].went_down = recorded->went_down();
+    inputs_[i].went_up = recorded->went_up();
+  }
+  return true;
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,92 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef INPUT_RECORDING_H_
+#define INPUT_RECORDING_H_
+
+#include <memory>
+#include <vector>
+#include "common.h"
+#include "controller.h"
+
+namespace fpl {
+namespace pie_noon {
+
+class Character;
+
+// The per-frame logical inputs of every character in a match, plus the
+// random seed, which together are enough to replay the match exactly.
+//
+// The game reads its inputs through each character's controller, so inputs
+// are recorded per CharacterId, after the controllers have been updated and
+// before the game advances. Controllers can change hands mid-match, when
+// players join, but the character's recorded inputs stay correct.
+//
+// Randomness is made reproducible by re-seeding the GameState's Rng with
+// FrameSeed() at the start of every frame. The AIs draw from their own Rngs,
+// and their choices are already captured in their inputs, so replaying
+// without them does not change the game's numbers.
+class InputRecording {
+ public:
+  // The logical input bits of one character's controller for one frame.
+  struct Inputs {
+    uint32_t is_down;
+    uint32_t went_down;
+    uint32_t went_up;
+  };
+
+  InputRecording() : seed_(0) {}
+
+  // Discard any recorded frames and start recording a match played by
+  // 'characters'.
+  void Start(uint32_t seed,
+             const std::vector<std::unique_ptr<Character>>& characters);
+
+  // Append the current logical inputs of every character's controller.
+  void RecordFrame(WorldTime delta_time,
+                   const std::vector<std::unique_ptr<Character>>& characters);
+
+  // Seed the game's Rng with this at the start of 'frame', before the game
+  // advances.
+  unsigned int FrameSeed(int frame) const {
+    return seed_ + static_cast<unsigned int>(frame) * 2654435761u;
+  }
+
+  bool Save(const char* filename) const;
+  bool Load(const char* filename);
+
+  uint32_t seed() const { return seed_; }
+  int NumFrames() const { return static_cast<int>(delta_times_.size()); }
+  int NumCharacters() const {
+    return static_cast<int>(controller_types_.size());
+  }
+  Controller::ControllerType controller_type(CharacterId id) const {
+    return static_cast<Controller::ControllerType>(controller_types_[id]);
+  }
+  WorldTime delta_time(int frame) const { return delta_times_[frame]; }
+  const Inputs& inputs(int frame, CharacterId id) const {
+    return inputs_[frame * NumCharacters() + id];
+  }
+
+ private:
+  uint32_t seed_;
+  std::vector<uint8_t> controller_types_;
+  std::vector<WorldTime> delta_times_;
+  std::vector<Inputs> inputs_;
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // INPUT_RECORDING_H_
@@ -0,0 +1,233 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "job_system.h"
+#include "frame_profiler.h"
+
+#include <algorithm>
+
+namespace fpl {
+
+struct JobSystem::Worker {
+  // Guards jobs.
+  std::mutex mutex;
+
+  // The worker pushes and pops at the back. Thieves take from the front.
+  std::deque<Job> jobs;
+
+  std::thread thread;
+};
+
+JobSystem::JobSystem(int num_workers)
+    : num_foreground_(0), next_worker_(0), quit_(false) {
+  const int count = std::max(num_workers, 1);
+  // Every Worker must exist before the first thread starts stealing.
+  for (int i = 0; i < count; ++i) {
+    workers_.push_back(std::unique_ptr<Worker>(new Worker()));
+  }
+  for (int i = 0; i < count; ++i) {
+    workers_[i]->thread = std::thread(&JobSystem::WorkerMain, this, i);
+    worker_ids_.push_back(workers_[i]->thread.get_id());
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  wake_.notify_all();
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    workers_[i]->thread.join();
+  }
+}
+
+int JobSystem::DefaultNumWorkers() {
+  const int cores = static_cast<int>(std::thread::hardware_concurrency());
+  return cores > 1 ? cores - 1 : 1;
+}
+
+void JobSystem::Submit(const char* name, JobFn* fn, void* context,
+                       JobCounter* done, Priority priority) {
+  if (done) done->count_.fetch_add(1, std::memory_order_relaxed);
+  const Job job = { name, fn, nullptr, context, 0, 0, done, priority };
+  Enqueue(job);
+}
+
+void JobSystem::SubmitAfter(JobCounter* after, const char* name, JobFn* fn,
+                            void* context, JobCounter* done) {
+  if (done) done->count_.fetch_add(1, std::memory_order_relaxed);
+  const Job job = { name, fn, nullptr, context, 0, 0, done, kForeground };
+  {
+    // Counters only reach zero with mutex_ held, so either 'after' is
+    // already done, or the job that finishes it will queue this one.
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!after->Done()) {
+      after->dependents_.push_back(job);
+      return;
+    }
+  }
+  Enqueue(job);
+}
+
+void JobSystem::ParallelFor(const char* name, int begin, int end, int grain,
+                            RangeFn* fn, void* context) {
+  grain = std::max(grain, 1);
+  if (end - begin <= grain) {
+    if (begin < end) fn(context, begin, end);
+    return;
+  }
+  JobCounter done;
+  for (int b = begin + grain; b < end; b += grain) {
+    done.count_.fetch_add(1, std::memory_order_relaxed);
+    const Job job = { name, nullptr, fn, context, b, std::min(b + grain, end),
+                      &done, kForeground };
+    Enqueue(job);
+  }
+  const Job first = { name, nullptr, fn, context, begin, begin + grain,
+                      nullptr, kForeground };
+  Run(first);
+  Wait(&done);
+}
+
+void JobSystem::Wait(JobCounter* counter) {
+  const int worker = CurrentWorker();
+  for (;;) {
+    {
+      // Check under the lock, so that the job that finished the counter is
+      // done with it once this returns.
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (counter->Done()) return;
+    }
+    Job job;
+    if (TakeJob(worker, false, &job)) {
+      Run(job);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    wake_.wait(lock, [this, counter]() {
+      return counter->Done() || num_foreground_.load() > 0;
+    });
+  }
+}
+
+void JobSystem::WorkerMain(int worker) {
+  NameFrameProfilerThread("Job Worker");
+  for (;;) {
+    Job job;
+    if (TakeJob(worker, true, &job)) {
+      Run(job);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    wake_.wait(lock, [this]() {
+      return quit_ || num_foreground_.load() > 0 || !background_.empty();
+    });
+    if (quit_) return;
+  }
+}
+
+int JobSystem::CurrentWorker() const {
+  const std::thread::id id = std::this_thread::get_id();
+  for (size_t i = 0; i < worker_ids_.size(); ++i) {
+    if (worker_ids_[i] == id) return static_cast<int>(i);
+  }
+  return -1;
+}
+
+void JobSystem::Enqueue(const Job& job) {
+  if (job.priority == kBackground) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    background_.push_back(job);
+  } else {
+    int worker = CurrentWorker();
+    if (worker < 0) {
+      worker = static_cast<int>(next_worker_.fetch_add(1) % workers_.size());
+    }
+    {
+      std::lock_guard<std::mutex> lock(workers_[worker]->mutex);
+      workers_[worker]->jobs.push_back(job);
+    }
+    num_foreground_.fetch_add(1);
+    // Sleeping threads check num_foreground_ with mutex_ held, so taking it
+    // here ensures they either see the job or get the notification.
+    std::lock_guard<std::mutex> lock(mutex_);
+  }
+  wake_.notify_all();
+}
+
+bool JobSystem::TakeJob(int worker, bool background, Job* job) {
+  if (num_foreground_.load() > 0) {
+    const int num_workers = static_cast<int>(workers_.size());
+    // Start with our own deque, newest first, then steal the oldest jobs
+    // from the others.
+    const int first = worker >= 0 ? worker : 0;
+    for (int i = 0; i < num_workers; ++i) {
+      Worker& victim = *workers_[(first + i) % num_workers];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (victim.jobs.empty())
+        continue;
+      if (i == 0 && worker >= 0) {
+        *job = victim.jobs.back();
+        victim.jobs.pop_back();
+      } else {
+        *job = victim.jobs.front();
+        victim.jobs.pop_front();
+      }
+      num_foreground_.fetch_sub(1);
+      return true;
+    }
+  }
+  if (background) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!background_.empty()) {
+      *job = background_.front();
+      background_.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void JobSystem::Run(const Job& job) {
+  const bool profile = FrameProfilerEnabled();
+  const uint64_t start = profile ? FrameProfilerTime() : 0;
+  if (job.range_fn) {
+    job.range_fn(job.context, job.begin, job.end);
+  } else {
+    job.fn(job.context);
+  }
+  if (profile) RecordFrameEvent(job.name, start, FrameProfilerTime());
+
+  if (!job.done) return;
+  std::vector<Job> dependents;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (job.done->count_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+      return;
+    dependents.swap(job.done->dependents_);
+  }
+  for (size_t i = 0; i < dependents.size(); ++i) {
+    Enqueue(dependents[i]);
+  }
+  wake_.notify_all();
+}
+
+JobSystem& SharedJobSystem() {
+  static JobSystem jobs(JobSystem::DefaultNumWorkers());
+  return jobs;
+}
+
+}  // fpl
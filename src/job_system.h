@@ -0,0 +1,172 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FPL_JOB_SYSTEM_H
+#define FPL_JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fpl {
+
+class JobCounter;
+
+// A fixed pool of worker threads, shared by every subsystem that has work to
+// spread over the cores.
+//
+// Each worker has its own deque of jobs. A worker pushes the jobs it submits
+// onto its own deque and runs them newest first, while idle workers steal
+// the oldest jobs from the others, so work spreads without one shared queue.
+// Other threads hand their jobs to the workers in turn.
+//
+// Completion is tracked with JobCounters. A thread that waits for a counter
+// runs queued jobs while it waits, so waiting never wastes a core, and jobs
+// may themselves submit and wait for more jobs.
+class JobSystem {
+ public:
+  typedef void JobFn(void* context);
+  // Called with a subrange [begin, end) of a ParallelFor().
+  typedef void RangeFn(void* context, int begin, int end);
+
+  enum Priority {
+    // Run by the workers, and by threads waiting in Wait(). For short jobs
+    // that something is waiting for.
+    kForeground,
+    // Run only by the workers, when they have no foreground jobs. For long
+    // jobs, like loading files, that a waiting main thread must not pick up.
+    kBackground
+  };
+
+  // Start 'num_workers' threads, at least one.
+  explicit JobSystem(int num_workers);
+
+  // Stops the workers. Jobs that haven't started are dropped, so Wait() for
+  // everything that matters first.
+  ~JobSystem();
+
+  // One worker per core, less one for the main thread.
+  static int DefaultNumWorkers();
+
+  int NumWorkers() const { return static_cast<int>(workers_.size()); }
+
+  // Run fn(context) on some thread. 'done', if not null, counts the job
+  // until it has finished. 'name' must be a string literal; it labels the
+  // job in the frame profiler.
+  void Submit(const char* name, JobFn* fn, void* context, JobCounter* done,
+              Priority priority = kForeground);
+
+  // Like Submit(), but the job isn't queued until 'after' reaches zero.
+  void SubmitAfter(JobCounter* after, const char* name, JobFn* fn,
+                   void* context, JobCounter* done);
+
+  // Call fn(context, b, e) for subranges [b, e) of [begin, end), of at most
+  // 'grain' indices each, in parallel, and return once they all have. The
+  // calling thread runs the first subrange itself.
+  void ParallelFor(const char* name, int begin, int end, int grain,
+                   RangeFn* fn, void* context);
+
+  // Return once 'counter' reaches zero, running foreground jobs meanwhile.
+  void Wait(JobCounter* counter);
+
+ private:
+  friend class JobCounter;
+
+  struct Job {
+    const char* name;
+    JobFn* fn;
+    RangeFn* range_fn;  // Called instead of fn, when set.
+    void* context;
+    int begin;
+    int end;
+    JobCounter* done;
+    Priority priority;
+  };
+  struct Worker;
+
+  // Disallow copies. The threads are owned.
+  JobSystem(const JobSystem&);
+  JobSystem& operator=(const JobSystem&);
+
+  void WorkerMain(int worker);
+
+  // Index of the calling thread in workers_, or -1 if it isn't a worker.
+  int CurrentWorker() const;
+
+  void Enqueue(const Job& job);
+
+  // Take a job from 'worker's own deque, else steal one from another
+  // worker, else, if 'background', take a background job. 'worker' is -1
+  // for threads that aren't workers.
+  bool TakeJob(int worker, bool background, Job* job);
+
+  void Run(const Job& job);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread::id> worker_ids_;
+
+  // Foreground jobs in the workers' deques, so idle threads can tell when
+  // there is something to steal without locking every deque.
+  std::atomic<int> num_foreground_;
+
+  // The worker that the next job from a non-worker thread goes to.
+  std::atomic<unsigned int> next_worker_;
+
+  // Guards background_, quit_, every JobCounter's dependents and every
+  // JobCounter reaching zero.
+  std::mutex mutex_;
+
+  // Signalled when a job is queued, when a counter reaches zero, and when
+  // the workers should quit.
+  std::condition_variable wake_;
+
+  std::deque<Job> background_;
+  bool quit_;
+};
+
+// The number of jobs that have been submitted with this counter and haven't
+// finished yet. Jobs can also wait for a counter to reach zero before they
+// start, with JobSystem::SubmitAfter(), which is how dependencies between
+// jobs are expressed. Call JobSystem::Wait() before destroying a counter
+// that jobs still refer to.
+class JobCounter {
+ public:
+  JobCounter() : count_(0) {}
+
+  bool Done() const { return count_.load(std::memory_order_acquire) == 0; }
+
+ private:
+  friend class JobSystem;
+
+  // Disallow copies. Jobs hold pointers to counters.
+  JobCounter(const JobCounter&);
+  JobCounter& operator=(const JobCounter&);
+
+  std::atomic<int> count_;
+
+  // Jobs to queue when count_ reaches zero.
+  std::vector<JobSystem::Job> dependents_;
+};
+
+// The job system that the game's subsystems share, created with
+// DefaultNumWorkers() the first time it's used.
+JobSystem& SharedJobSystem();
+
+}  // fpl
+
+#endif  // FPL_JOB_SYSTEM_H
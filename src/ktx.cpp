@@ -0,0 +1,122 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "ktx.h"
+
+#include <cstring>
+
+namespace fpl {
+
+static const uint8_t kKtxIdentifier[12] = {
+  0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+};
+static const uint32_t kKtxEndianness = 0x04030201;
+static const uint32_t kKtxEndiannessSwapped = 0x01020304;
+
+// Fields of the header, after the identifier, in file order.
+enum KtxHeaderField {
+  kKtxEndiannessField,
+  kKtxGlType,
+  kKtxGlTypeSize,
+  kKtxGlFormat,
+  kKtxGlInternalFormat,
+  kKtxGlBaseInternalFormat,
+  kKtxPixelWidth,
+  kKtxPixelHeight,
+  kKtxPixelDepth,
+  kKtxNumberOfArrayElements,
+  kKtxNumberOfFaces,
+  kKtxNumberOfMipmapLevels,
+  kKtxBytesOfKeyValueData,
+  kKtxNumHeaderFields
+};
+
+static const size_t kKtxHeaderSize =
+    sizeof(kKtxIdentifier) + kKtxNumHeaderFields * sizeof(uint32_t);
+
+static uint32_t ReadUint32(const uint8_t *data, bool swap) {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  if (swap) {
+    value = (value >> 24) | ((value >> 8) & 0xFF00) |
+            ((value << 8) & 0xFF0000) | (value << 24);
+  }
+  return value;
+}
+
+bool ParseKtx(const uint8_t *data, size_t size, KtxImage *image) {
+  if (size < kKtxHeaderSize ||
+      memcmp(data, kKtxIdentifier, sizeof(kKtxIdentifier)) != 0)
+    return false;
+
+  const uint8_t *fields = data + sizeof(kKtxIdentifier);
+  const uint32_t endianness = ReadUint32(fields, false);
+  if (endianness != kKtxEndianness && endianness != kKtxEndiannessSwapped)
+    return false;
+  const bool swap = endianness == kKtxEndiannessSwapped;
+  uint32_t header[kKtxNumHeaderFields];
+  for (int i = 0; i < kKtxNumHeaderFields; ++i) {
+    header[i] = ReadUint32(fields + i * sizeof(uint32_t), swap);
+  }
+
+  // Compressed formats have a glType and glFormat of zero. Only plain 2D
+  // textures are supported.
+  const uint32_t width = header[kKtxPixelWidth];
+  const uint32_t height = header[kKtxPixelHeight];
+  if (header[kKtxGlType] != 0 || header[kKtxGlFormat] != 0 ||
+      width == 0 || height == 0 || header[kKtxPixelDepth] > 1 ||
+      header[kKtxNumberOfArrayElements] != 0 ||
+      header[kKtxNumberOfFaces] != 1)
+    return false;
+
+  // Zero levels means the loader should generate the mips, which can't be
+  // done for compressed data, so it is the same as one level.
+  const uint32_t num_levels = header[kKtxNumberOfMipmapLevels] > 0 ?
+                              header[kKtxNumberOfMipmapLevels] : 1;
+  if (num_levels > 32)
+    return false;
+
+  image->internal_format = header[kKtxGlInternalFormat];
+  image->width = static_cast<int>(width);
+  image->height = static_cast<int>(height);
+  image->levels.clear();
+
+  // Each level is its size, then its data padded to a multiple of four.
+  size_t offset = kKtxHeaderSize;
+  if (header[kKtxBytesOfKeyValueData] > size - offset)
+    return false;
+  offset += header[kKtxBytesOfKeyValueData];
+  for (uint32_t level = 0; level < num_levels; ++level) {
+    if (size - offset < sizeof(uint32_t))
+      return false;
+    const uint32_t level_size = ReadUint32(data + offset, swap);
+    offset += sizeof(uint32_t);
+    if (level_size > size - offset)
+      return false;
+
+    KtxImage::Level l;
+    l.offset = offset;
+    l.size = level_size;
+    l.width = static_cast<int>(width >> level > 0 ? width >> level : 1);
+    l.height = static_cast<int>(height >> level > 0 ? height >> level : 1);
+    image->levels.push_back(l);
+
+    offset += (level_size + 3) & ~3u;
+    if (offset > size) offset = size;
+  }
+  return true;
+}
+
+}  // fpl
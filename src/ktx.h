@@ -0,0 +1,69 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KTX_H
+#define KTX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace fpl {
+
+// glInternalFormat values of the compressed formats that the game loads.
+// Defined here since not every platform's GL headers have them.
+enum KtxFormat {
+  kKtxFormatEtc1Rgb8 = 0x8D64,       // GL_ETC1_RGB8_OES
+  kKtxFormatEtc2Rgb8 = 0x9274,       // GL_COMPRESSED_RGB8_ETC2
+  kKtxFormatEtc2Rgba8 = 0x9278,      // GL_COMPRESSED_RGBA8_ETC2_EAC
+  kKtxFormatAstc4x4 = 0x93B0,        // GL_COMPRESSED_RGBA_ASTC_4x4_KHR
+  kKtxFormatAstc6x6 = 0x93B4,        // GL_COMPRESSED_RGBA_ASTC_6x6_KHR
+  kKtxFormatAstc8x8 = 0x93B7,        // GL_COMPRESSED_RGBA_ASTC_8x8_KHR
+};
+
+// Where the mip levels of a compressed KTX file are, and their size. Only
+// 2D textures are described: no arrays, cube maps or 3D textures.
+struct KtxImage {
+  struct Level {
+    size_t offset;  // Byte offset of the level's data in the file.
+    size_t size;    // Bytes of data.
+    int width;
+    int height;
+  };
+
+  KtxImage() : internal_format(0), width(0), height(0) {}
+
+  // True if the format has an alpha channel.
+  bool HasAlpha() const {
+    return internal_format != kKtxFormatEtc1Rgb8 &&
+           internal_format != kKtxFormatEtc2Rgb8;
+  }
+
+  uint32_t internal_format;
+  int width;
+  int height;
+
+  // Largest first. A file without a precomputed mip chain has one level.
+  std::vector<Level> levels;
+};
+
+// Read the header and level table of a KTX (version 1.1) file holding a
+// compressed 2D texture. Files of either endianness are accepted. Returns
+// false if 'data' is not such a file, or is truncated.
+bool ParseKtx(const uint8_t *data, size_t size, KtxImage *image);
+
+}  // fpl
+
+#endif  // KTX_H
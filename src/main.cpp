@@ -15,19 +15,71 @@
 #include "precompiled.h"
 
 #include "pie_noon_game.h"
+#include "replay_benchmark.h"
 
+// Usage: pie_noon [--record file] [--replay file] [--benchmark file]
+//                 [--baseline file] [--offscreen]
+//   --record     Save the inputs of every match to 'file'.
+//   --replay     Play back the match recorded in 'file', then exit.
+//   --benchmark  Play the replay as fast as possible and write the frame
+//                times, allocations and draw calls to 'file'.
+//   --baseline   Exit with an error if the benchmark is slower than the
+//                results in 'file', by more than their tolerances.
+//   --offscreen  Hide the window while benchmarking.
+// Relative paths are relative to the assets directory.
 int main(int argc, char *argv[]) {
   fpl::pie_noon::PieNoonGame game;
   const char* binary_directory = argc > 0 ? argv[0] : "";
+  const char* replay_file_name = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    const bool has_value = i + 1 < argc;
+    if (strcmp(argv[i], "--offscreen") == 0) {
+      game.set_benchmark_offscreen(true);
+    } else if (!has_value) {
+      break;
+    } else if (strcmp(argv[i], "--record") == 0) {
+      game.set_record_file_name(argv[++i]);
+    } else if (strcmp(argv[i], "--replay") == 0) {
+      replay_file_name = argv[++i];
+    } else if (strcmp(argv[i], "--benchmark") == 0) {
+      game.set_benchmark_file_name(argv[++i]);
+    } else if (strcmp(argv[i], "--baseline") == 0) {
+      game.set_baseline_file_name(argv[++i]);
+    }
+  }
+  if (game.benchmarking() && replay_file_name == nullptr) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR,
+                 "PieNoon: --benchmark needs a --replay, exiting!");
+    return 1;
+  }
+
   if (!game.Initialize(binary_directory)) {
     SDL_LogError(SDL_LOG_CATEGORY_ERROR, "PieNoon: init failed, exiting!");
     return 1;
   }
 
+  if (replay_file_name != nullptr && !game.LoadReplay(replay_file_name)) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "PieNoon: can't replay %s, exiting!",
+                 replay_file_name);
+    return 1;
+  }
+
   game.Run();
 
+  if (game.benchmarking())
+    return game.FinishBenchmark() ? 0 : 1;
   return 0;
 }
 
-MATHFU_DEFINE_GLOBAL_SIMD_AWARE_NEW_DELETE
-
+// The same as MATHFU_DEFINE_GLOBAL_SIMD_AWARE_NEW_DELETE, but counts the
+// allocations for the benchmark.
+void* operator new(std::size_t n) {
+  fpl::CountAllocation();
+  return mathfu::AllocateAligned(n);
+}
+void* operator new[](std::size_t n) {
+  fpl::CountAllocation();
+  return mathfu::AllocateAligned(n);
+}
+void operator delete(void* p) { mathfu::FreeAligned(p); }
+void operator delete[](void* p) { mathfu::FreeAligned(p); }
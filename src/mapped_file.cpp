@@ -0,0 +1,161 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "precompiled.h"
+#include "mapped_file.h"
+#include "asset_archive.h"
+
+#if defined(__ANDROID__)
+#include <android/asset_manager.h>
+#include <android/asset_manager_jni.h>
+#include <jni.h>
+#endif
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fpl {
+
+#ifdef __ANDROID__
+// The native side of the activity's AssetManager. The Java object is kept
+// alive with a global reference, so the pointer stays valid after the JNI
+// call returns.
+static AAssetManager *CreateAssetManager() {
+  JNIEnv *env = reinterpret_cast<JNIEnv *>(SDL_AndroidGetJNIEnv());
+  jobject activity = reinterpret_cast<jobject>(SDL_AndroidGetActivity());
+  jclass activity_class = env->GetObjectClass(activity);
+  jmethodID get_assets = env->GetMethodID(
+      activity_class, "getAssets", "()Landroid/content/res/AssetManager;");
+  jobject assets = env->CallObjectMethod(activity, get_assets);
+  jobject global_assets = env->NewGlobalRef(assets);
+  env->DeleteLocalRef(assets);
+  env->DeleteLocalRef(activity_class);
+  env->DeleteLocalRef(activity);
+  return AAssetManager_fromJava(env, global_assets);
+}
+
+// Created on first use, which may be on any thread.
+static AAssetManager *GetAssetManager() {
+  static AAssetManager *manager = CreateAssetManager();
+  return manager;
+}
+#endif  // __ANDROID__
+
+MappedFile::MappedFile()
+    : data_(nullptr), size_(0), mapping_(nullptr)
+#ifdef __ANDROID__
+      , asset_(nullptr)
+#endif
+{}
+
+MappedFile::~MappedFile() {
+  Close();
+}
+
+bool MappedFile::Open(const char *filename) {
+  if (OpenOptional(filename)) return true;
+  SDL_LogError(SDL_LOG_CATEGORY_ERROR, "MappedFile fail on %s", filename);
+  return false;
+}
+
+bool MappedFile::OpenOptional(const char *filename) {
+  Close();
+  // Files in a mounted archive are already mapped, and the archive owns
+  // them.
+  return FindInAssetArchives(filename, &data_, &size_) || Map(filename) ||
+         Read(filename);
+}
+
+void MappedFile::Close() {
+#if !defined(_WIN32)
+  if (mapping_) munmap(mapping_, size_);
+#endif
+#ifdef __ANDROID__
+  if (asset_) AAsset_close(asset_);
+  asset_ = nullptr;
+#endif
+  mapping_ = nullptr;
+  buffer_.clear();
+  buffer_.shrink_to_fit();
+  data_ = nullptr;
+  size_ = 0;
+}
+
+bool MappedFile::Map(const char *filename) {
+#ifdef __ANDROID__
+  // Relative paths are in the apk. Uncompressed assets are mapped straight
+  // out of it, and compressed ones are inflated into a buffer the AAsset
+  // owns, which is still one copy fewer than reading them.
+  if (filename[0] != '/') {
+    AAssetManager *manager = GetAssetManager();
+    AAsset *asset = manager ?
+        AAssetManager_open(manager, filename, AASSET_MODE_BUFFER) : nullptr;
+    if (!asset) return false;
+    const void *buffer = AAsset_getBuffer(asset);
+    const off_t length = AAsset_getLength(asset);
+    if (!buffer || length <= 0) {
+      AAsset_close(asset);
+      return false;
+    }
+    asset_ = asset;
+    data_ = static_cast<const uint8_t *>(buffer);
+    size_ = static_cast<size_t>(length);
+    return true;
+  }
+#endif  // __ANDROID__
+#if !defined(_WIN32)
+  const int fd = open(filename, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat info;
+  void *mapping = MAP_FAILED;
+  if (fstat(fd, &info) == 0 && info.st_size > 0) {
+    mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ,
+                   MAP_PRIVATE, fd, 0);
+  }
+  // The mapping holds its own reference to the file.
+  close(fd);
+  if (mapping == MAP_FAILED) return false;
+  mapping_ = mapping;
+  data_ = static_cast<const uint8_t *>(mapping);
+  size_ = static_cast<size_t>(info.st_size);
+  return true;
+#else
+  (void)filename;
+  return false;
+#endif  // !defined(_WIN32)
+}
+
+bool MappedFile::Read(const char *filename) {
+  auto handle = SDL_RWFromFile(filename, "rb");
+  if (!handle) return false;
+  auto len = static_cast<size_t>(SDL_RWseek(handle, 0, RW_SEEK_END));
+  SDL_RWseek(handle, 0, RW_SEEK_SET);
+  buffer_.assign(len, 0);
+  size_t rlen = len ? static_cast<size_t>(
+      SDL_RWread(handle, &buffer_[0], 1, len)) : 0;
+  SDL_RWclose(handle);
+  if (len != rlen || len == 0) {
+    buffer_.clear();
+    return false;
+  }
+  data_ = reinterpret_cast<const uint8_t *>(buffer_.data());
+  size_ = len;
+  return true;
+}
+
+}  // fpl
@@ -0,0 +1,82 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef FPL_MAPPED_FILE_H
+#define FPL_MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef __ANDROID__
+struct AAsset;
+#endif
+
+namespace fpl {
+
+// Read-only view of a whole file. Files in a mounted AssetArchive are used
+// where they are in the archive. Otherwise, where the platform allows, it is
+// mapped into memory instead of being copied: with mmap on desktop, and
+// with AAsset_getBuffer for assets in the Android apk. Otherwise, it is read
+// into a buffer owned by this object. Either way, data() stays valid until
+// the file is closed.
+//
+// Unlike LoadFile(), the data is not null terminated. Flatbuffers and the
+// image decoders don't need it to be.
+class MappedFile {
+ public:
+  MappedFile();
+  ~MappedFile();
+
+  // Map 'filename', closing any file already open. Logs and returns false if
+  // it can't be read, or is empty.
+  bool Open(const char *filename);
+
+  // Same as Open(), but a missing file is not an error, so nothing is logged.
+  bool OpenOptional(const char *filename);
+
+  // Release the mapping, or the buffer.
+  void Close();
+
+  const uint8_t *data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+ private:
+  // Disallow copies. The mapping is owned.
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+
+  bool Map(const char *filename);
+  bool Read(const char *filename);
+
+  const uint8_t *data_;
+  size_t size_;
+
+  // Set when the file is mmapped, for munmap.
+  void *mapping_;
+
+#ifdef __ANDROID__
+  // Set when the file is an asset in the apk, which owns the buffer.
+  AAsset *asset_;
+#endif
+
+  // The copy of the file, when it couldn't be mapped.
+  std::string buffer_;
+};
+
+}  // fpl
+
+#endif  // FPL_MAPPED_FILE_H
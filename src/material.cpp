@@ -14,38 +14,183 @@
 
 #include "precompiled.h"
 #include "material.h"
+#include "pixel_conversion.h"
 #include "renderer.h"
 
 namespace fpl {
 
+// Return 'pixels', 8 bits per channel, packed into a new buffer of 16 bit
+// texels in 'format'. Frees 'pixels'.
+static uint8_t *ConvertTo16Bits(uint8_t *pixels, const vec2i &size,
+                                TextureFormat format) {
+  const size_t count = static_cast<size_t>(size.x()) *
+                       static_cast<size_t>(size.y());
+  uint16_t *texels = static_cast<uint16_t *>(malloc(count * sizeof(uint16_t)));
+  if (format == kFormat5551) {
+    ConvertRgbaTo5551(pixels, texels, count);
+  } else {
+    ConvertRgbTo565(pixels, texels, count);
+  }
+  free(pixels);
+  return reinterpret_cast<uint8_t *>(texels);
+}
+
 void Texture::Load() {
+  if (renderer_->LoadCompressedTexture(filename_.c_str(), &compressed_file_,
+                                       &compressed_image_)) {
+    size_ = vec2i(compressed_image_.width, compressed_image_.height);
+    has_alpha_ = compressed_image_.HasAlpha();
+    return;
+  }
   data_ = renderer_->LoadAndUnpackTexture(filename_.c_str(), &size_,
                                           &has_alpha_);
   if (!data_) {
     SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "texture load: %s: %s",
                 filename_.c_str(), renderer_->last_error().c_str());
+    return;
+  }
+  renderer_->LoadAndUnpackMips(filename_.c_str(), size_, has_alpha_, &mips_);
+
+  // Convert to the uploaded format here, so that Finalize() on the main
+  // thread only has to upload.
+  format_ = renderer_->UploadFormat(desired_, has_alpha_, !mips_.empty());
+  if (format_ == kFormat5551 || format_ == kFormat565) {
+    data_ = ConvertTo16Bits(data_, size_, format_);
+    vec2i level_size = size_;
+    for (size_t i = 0; i < mips_.size(); ++i) {
+      level_size = vec2i(std::max(level_size.x() / 2, 1),
+                         std::max(level_size.y() / 2, 1));
+      mips_[i] = ConvertTo16Bits(mips_[i], level_size, format_);
+    }
   }
 }
 
+// Bytes per texel of each TextureFormat, as uploaded. kFormatAuto picks a
+// 16 bit format.
+static size_t BytesPerTexel(TextureFormat format) {
+  switch (format) {
+    case kFormat8888: return 4;
+    case kFormat888: return 3;
+    default: return 2;
+  }
+}
+
+// Bytes of level 'level' of a 'size' texture in 'format'.
+static size_t LevelBytes(const vec2i &size, int level, TextureFormat format) {
+  const size_t width = static_cast<size_t>(std::max(size.x() >> level, 1));
+  const size_t height = static_cast<size_t>(std::max(size.y() >> level, 1));
+  return width * height * BytesPerTexel(format);
+}
+
+bool Texture::Stage() {
+  if (!data_ || !renderer_->SupportsPixelBuffers()) return false;
+  // Keep every level 4 byte aligned, the default GL_UNPACK_ALIGNMENT.
+  const int num_levels = 1 + static_cast<int>(mips_.size());
+  upload_offsets_.resize(num_levels);
+  size_t bytes = 0;
+  for (int level = 0; level < num_levels; ++level) {
+    upload_offsets_[level] = bytes;
+    bytes += (LevelBytes(size_, level, format_) + 3) & ~static_cast<size_t>(3);
+  }
+  upload_data_ = renderer_->MapUploadBuffer(bytes, &upload_buffer_);
+  return upload_data_ != nullptr;
+}
+
+void Texture::Copy() {
+  memcpy(upload_data_ + upload_offsets_[0], data_,
+         LevelBytes(size_, 0, format_));
+  free(data_);
+  data_ = nullptr;
+  for (size_t i = 0; i < mips_.size(); ++i) {
+    const int level = static_cast<int>(i) + 1;
+    memcpy(upload_data_ + upload_offsets_[level], mips_[i],
+           LevelBytes(size_, level, format_));
+    free(mips_[i]);
+  }
+  mips_.clear();
+}
+
 void Texture::Finalize() {
-  if (data_) {
-    id_ = renderer_->CreateTexture(data_, size_, has_alpha_, desired_);
+  if (upload_buffer_) {
+    const size_t bytes = LevelBytes(size_, 0, format_);
+    gpu_size_ = bytes + bytes / 3;
+    memory_.Set(gpu_size_);
+    id_ = renderer_->CreateTextureFromUploadBuffer(
+        upload_buffer_, &upload_offsets_[0],
+        static_cast<int>(upload_offsets_.size()), size_, format_);
+    upload_buffer_ = 0;
+    upload_data_ = nullptr;
+    upload_offsets_.clear();
+    return;
+  }
+  if (!compressed_file_.empty()) {
+    id_ = renderer_->CreateCompressedTexture(compressed_file_.data(),
+                                             compressed_image_);
+    gpu_size_ = 0;
+    for (size_t i = 0; i < compressed_image_.levels.size(); ++i) {
+      gpu_size_ += compressed_image_.levels[i].size;
+    }
+    memory_.Set(gpu_size_);
+    compressed_file_.Close();
+    return;
+  }
+  if (!data_) return;
+  const size_t bytes = static_cast<size_t>(size_.x()) *
+                       static_cast<size_t>(size_.y()) *
+                       BytesPerTexel(format_);
+  // The mip chain adds a third, whether it was loaded or generated.
+  gpu_size_ = bytes + bytes / 3;
+  memory_.Set(gpu_size_);
+  if (!mips_.empty()) {
+    mips_.insert(mips_.begin(), data_);
+    id_ = renderer_->CreateTexture(&mips_[0], static_cast<int>(mips_.size()),
+                                   size_, format_);
+    for (size_t i = 0; i < mips_.size(); ++i) free(mips_[i]);
+    mips_.clear();
+  } else {
+    id_ = renderer_->CreateTexture(data_, size_, format_);
     free(data_);
-    data_ = nullptr;
   }
+  data_ = nullptr;
+}
+
+void Texture::Evict(unsigned int frame) {
+  renderer_->DeleteTexture(id_);
+  id_ = 0;
+  gpu_size_ = 0;
+  memory_.Set(0);
+  evicted_frame_ = frame;
+  evicted_ = true;
+}
+
+void Texture::Delete() {
+  renderer_->DeleteTexture(id_);
+  id_ = 0;
+  gpu_size_ = 0;
+  memory_.Set(0);
+}
+
+size_t Texture::FinalizeSize() const {
+  if (!compressed_file_.empty()) return compressed_file_.size();
+  if (!data_ && !upload_buffer_) return 0;
+  const size_t bytes = static_cast<size_t>(size_.x()) *
+                       static_cast<size_t>(size_.y()) * BytesPerTexel(format_);
+  // A full mip chain adds a third, whether it was loaded or is generated.
+  return bytes + bytes / 3;
 }
 
 void Material::Set(Renderer &renderer) {
   renderer.SetBlendMode(blend_mode_);
   for (size_t i = 0; i < textures_.size(); i++) {
-    GL_CALL(glActiveTexture(GL_TEXTURE0 + i));
-    GL_CALL(glBindTexture(GL_TEXTURE_2D, textures_[i]->id()));
+    // Tells MaterialManager::UpdateResidency() which textures are in use.
+    textures_[i]->set_last_used_frame(renderer.frame_count());
+    renderer.BindTexture(static_cast<int>(i), textures_[i]->id());
   }
 }
 
 void Material::DeleteTextures() {
   for (size_t i = 0; i < textures_.size(); i++) {
-    GL_CALL(glDeleteTextures(1, &textures_[i]->id()));
+    textures_[i]->Delete();
   }
 }
 
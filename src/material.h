@@ -17,6 +17,9 @@
 
 #include "shader.h"
 #include "async_loader.h"
+#include "ktx.h"
+#include "mapped_file.h"
+#include "memory_tracker.h"
 
 namespace fpl {
 
@@ -42,10 +45,44 @@ class Texture : public AsyncResource {
  public:
   Texture(Renderer &renderer, const std::string &filename)
     : AsyncResource(filename), renderer_(&renderer), id_(0),
-      size_(mathfu::kZeros2i), has_alpha_(false), desired_(kFormatAuto) {}
+      size_(mathfu::kZeros2i), has_alpha_(false), desired_(kFormatAuto),
+      format_(kFormatAuto), gpu_size_(0), last_used_frame_(0),
+      evicted_frame_(0), evicted_(false), pinned_(false),
+      memory_(kMemoryTextures),
+      upload_buffer_(0), upload_data_(nullptr) {}
 
   virtual void Load();
+  // Where the driver has pixel buffers, the texels are copied into one on a
+  // worker, and Finalize() only starts the upload from it.
+  virtual bool Stage();
+  virtual void Copy();
   virtual void Finalize();
+  virtual size_t FinalizeSize() const;
+
+  // Delete the OpenGL texture to save memory. The texture keeps its size,
+  // and can be loaded again.
+  void Evict(unsigned int frame);
+  // Delete the OpenGL texture for good.
+  void Delete();
+  // Call when the texture is queued to be loaded again.
+  void set_reloading() { evicted_ = false; }
+  // True once evicted, until queued again.
+  bool evicted() const { return evicted_; }
+  // True if a material has bound the texture since it was evicted.
+  bool used_since_eviction() const {
+    return evicted_ && last_used_frame_ > evicted_frame_;
+  }
+  // Pinned textures are never evicted.
+  bool pinned() const { return pinned_; }
+  void set_pinned(bool pinned) { pinned_ = pinned; }
+
+  // Bytes of GPU memory the texture uses, or 0 if it's not resident. The
+  // driver may pad some formats, so this is an estimate.
+  size_t gpu_size() const { return gpu_size_; }
+
+  // The Renderer::frame_count() when a material last bound the texture.
+  unsigned int last_used_frame() const { return last_used_frame_; }
+  void set_last_used_frame(unsigned int frame) { last_used_frame_ = frame; }
 
   const GLuint &id() const { return id_; }
   vec2i size() { return size_; }
@@ -59,17 +96,80 @@ class Texture : public AsyncResource {
   vec2i size_;
   bool has_alpha_;
   TextureFormat desired_;
+
+  // The format data_ and mips_ are in, and are uploaded in, chosen by
+  // Load().
+  TextureFormat format_;
+
+  size_t gpu_size_;
+  unsigned int last_used_frame_;
+  unsigned int evicted_frame_;
+  bool evicted_;
+  bool pinned_;
+
+  // Counts gpu_size_.
+  TrackedMemory memory_;
+
+  // The GPU-compressed variant of the texture, if the device decodes one
+  // that was built. Empty when the texture was loaded from filename_.
+  MappedFile compressed_file_;
+  KtxImage compressed_image_;
+
+  // Levels after the first of the precomputed mip chain, if it was built.
+  // Empty when the driver generates the mips.
+  std::vector<uint8_t *> mips_;
+
+  // The pixel buffer the texels are copied into, from Stage() until
+  // Finalize(), its mapped memory, and the offset of each level in it.
+  GLuint upload_buffer_;
+  uint8_t *upload_data_;
+  std::vector<size_t> upload_offsets_;
 };
 
 class Material {
  public:
-  Material() : blend_mode_(kBlendModeOff) {}
+  Material() : blend_mode_(kBlendModeOff),
+               texture_rect_(0.0f, 0.0f, 1.0f, 1.0f) {}
 
   void Set(Renderer &renderer);
 
+  // True if Set() on both materials makes the same state changes, as it
+  // does for materials that share an atlas.
+  bool SameState(const Material &other) const {
+    return blend_mode_ == other.blend_mode_ && textures_ == other.textures_;
+  }
+
+  // The part of the textures this material uses, as (min_u, min_v, max_u,
+  // max_v). All of them unless the textures are an atlas.
+  const vec4 &texture_rect() const { return texture_rect_; }
+  void set_texture_rect(const vec4 &texture_rect) {
+    texture_rect_ = texture_rect;
+  }
+
+  // Convert a texture coordinate in [0, 1] to the matching coordinate in
+  // texture_rect().
+  vec2 MapTextureCoord(const vec2 &coord) const {
+    return vec2(texture_rect_.x() +
+                    coord.x() * (texture_rect_.z() - texture_rect_.x()),
+                texture_rect_.y() +
+                    coord.y() * (texture_rect_.w() - texture_rect_.y()));
+  }
+
+  // Size in texels of texture_rect() in the first texture. Zero until that
+  // texture has loaded.
+  vec2 ImageSize() const {
+    return vec2(textures_[0]->size()) *
+           vec2(texture_rect_.z() - texture_rect_.x(),
+                texture_rect_.w() - texture_rect_.y());
+  }
+
   std::vector<Texture *> &textures() { return textures_; }
   const std::vector<Texture *> &textures() const { return textures_; }
   int blend_mode() const { return blend_mode_; }
+  // The ShaderFeatures that shaders need to draw this material.
+  int shader_features() const {
+    return blend_mode_ == kBlendModeOff ? 0 : kShaderFeatureAlphaTest;
+  }
   void set_blend_mode(BlendMode blend_mode) {
     assert(0 <= blend_mode && blend_mode < kBlendModeCount);
     blend_mode_ = blend_mode;
@@ -80,6 +180,7 @@ class Material {
  private:
   std::vector<Texture *> textures_;
   BlendMode blend_mode_;
+  vec4 texture_rect_;
 };
 
 }  // namespace fpl
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "precompiled.h"
+#include "mapped_file.h"
 #include "material_manager.h"
 #include "materials_generated.h"
 #include "utilities.h"
@@ -26,28 +27,52 @@ static_assert(kBlendModeOff == static_cast<BlendMode>(matdef::BlendMode_OFF) &&
 static_assert(kBlendModeCount == kBlendModeAlpha + 1,
               "Please update static_assert above with new enum values.");
 
-template<typename T> T FindInMap(const std::map<std::string, T> &map,
-                                  const char *name) {
-  auto it = map.find(name);
-  return it != map.end() ? it->second : 0;
+const unsigned int MaterialManager::kResidentFrames;
+
+// The name that the 'features' variant of 'basename' is kept under. The
+// default variant is kept under the basename alone.
+static std::string ShaderVariantName(const char *basename, int features) {
+  if (features == kShaderFeaturesDefault) return basename;
+  char suffix[16];
+  snprintf(suffix, sizeof(suffix), "#%x", features);
+  return std::string(basename) + suffix;
+}
+
+// The #defines that compile 'features' into a shader stage's source.
+static std::string ShaderFeatureDefines(int features, GLenum stage) {
+  std::string defines;
+  if (features & kShaderFeatureAlphaTest) defines += "#define ALPHA_TEST\n";
+  if (features & kShaderFeatureOverlay) defines += "#define OVERLAY\n";
+  // Overrides the default precision that the renderer puts first.
+  if ((features & kShaderFeatureMediumPrecision) &&
+      stage == GL_FRAGMENT_SHADER) {
+    defines += "#ifdef GL_ES\nprecision mediump float;\n#endif\n";
+  }
+  return defines;
 }
 
-Shader *MaterialManager::FindShader(const char *basename) {
-  return FindInMap(shader_map_, basename);
+Shader *MaterialManager::FindShader(const char *basename, int features) {
+  return shaders_.Get(ShaderVariantName(basename, features).c_str());
 }
 
-Shader *MaterialManager::LoadShader(const char *basename) {
-  auto shader = FindShader(basename);
+Shader *MaterialManager::LoadShader(const char *basename, int features) {
+  auto shader = FindShader(basename, features);
   if (shader) return shader;
-  std::string vs_file, ps_file;
+  std::string vs_file = ShaderFeatureDefines(features, GL_VERTEX_SHADER);
+  std::string ps_file = ShaderFeatureDefines(features, GL_FRAGMENT_SHADER);
+  std::string source;
   std::string filename = std::string(basename) + ".glslv";
-  if (LoadFile(filename.c_str(), &vs_file)) {
+  if (LoadFile(filename.c_str(), &source)) {
+    vs_file += source;
     filename = std::string(basename) + ".glslf";
-    if (LoadFile(filename.c_str(), &ps_file)) {
+    if (LoadFile(filename.c_str(), &source)) {
+      ps_file += source;
       shader = renderer_.CompileAndLinkShader(vs_file.c_str(),
                                               ps_file.c_str());
       if (shader) {
-        shader_map_[basename] = shader;
+        shaders_.Set(shaders_.Intern(
+            ShaderVariantName(basename, features).c_str()), shader);
+        UpdateMemory();
       } else {
         SDL_LogError(SDL_LOG_CATEGORY_ERROR,
                      "Shader Error:\n%s\n", renderer_.last_error().c_str());
@@ -62,68 +87,197 @@ Shader *MaterialManager::LoadShader(const char *basename) {
 }
 
 Texture *MaterialManager::FindTexture(const char *filename) {
-  return FindInMap(texture_map_, filename);
+  return textures_.Get(filename);
 }
 
 Texture *MaterialManager::LoadTexture(const char *filename,
-                                      TextureFormat format) {
+                                      TextureFormat format, int priority) {
   auto tex = FindTexture(filename);
   if (tex) return tex;
   tex = new Texture(renderer_, filename);
   tex->set_desired_format(format);
-  loader_.QueueJob(tex);
-  texture_map_[filename] = tex;
+  loader_.QueueJob(tex, priority);
+  textures_.Set(textures_.Intern(filename), tex);
+  UpdateMemory();
   return tex;
 }
 
-void MaterialManager::StartLoadingTextures() {
-  loader_.StartLoading();
+void MaterialManager::StartLoadingTextures(int num_threads) {
+  loader_.StartLoading(num_threads);
 }
 
 bool MaterialManager::TryFinalize() {
   return loader_.TryFinalize();
 }
 
+bool MaterialManager::TryFinalize(double max_seconds, size_t max_bytes) {
+  return loader_.TryFinalize(max_seconds, max_bytes);
+}
+
 Material *MaterialManager::FindMaterial(const char *filename) {
-  return FindInMap(material_map_, filename);
+  auto mat = materials_.Get(filename);
+  PrefetchMaterial(mat);
+  return mat;
+}
+
+AssetHandle MaterialManager::MaterialHandle(const char *filename) {
+  const AssetHandle handle = materials_.Intern(filename);
+  UpdateMemory();
+  return handle;
+}
+
+Material *MaterialManager::FindMaterial(AssetHandle handle) {
+  auto mat = materials_.Get(handle);
+  PrefetchMaterial(mat);
+  return mat;
+}
+
+Material *MaterialManager::LoadMaterial(const char *filename, int priority) {
+  return LoadMaterial(MaterialHandle(filename), priority);
+}
+
+Material *MaterialManager::LoadMaterial(AssetHandle handle, int priority) {
+  auto mat = FindMaterial(handle);
+  if (mat) return mat;
+  mat = CreateMaterial(materials_.Name(handle).c_str(), 0, priority);
+  if (mat) materials_.Set(handle, mat);
+  return mat;
 }
 
-Material *MaterialManager::LoadMaterial(const char *filename) {
-  auto mat = FindMaterial(filename);
+Material *MaterialManager::LoadPreviewMaterial(AssetHandle handle, int level,
+                                               int priority) {
+  auto mat = FindPreviewMaterial(handle);
   if (mat) return mat;
-  std::string flatbuf;
-  if (LoadFile(filename, &flatbuf)) {
-    flatbuffers::Verifier verifier(
-        reinterpret_cast<const uint8_t *>(flatbuf.c_str()), flatbuf.length());
-    assert(matdef::VerifyMaterialBuffer(verifier));
-    auto matdef = matdef::GetMaterial(flatbuf.c_str());
-    mat = new Material();
-    mat->set_blend_mode(static_cast<BlendMode>(matdef->blendmode()));
-    for (size_t i = 0; i < matdef->texture_filenames()->size(); i++) {
-      auto format = matdef->desired_format() &&
-                    i < matdef->desired_format()->size()
-          ? static_cast<TextureFormat>(matdef->desired_format()->Get(i))
-          : kFormatAuto;
-      auto tex = LoadTexture(matdef->texture_filenames()->Get(i)->c_str(),
-                             format);
-      mat->textures().push_back(tex);
+  mat = CreateMaterial(materials_.Name(handle).c_str(), level, priority);
+  if (mat) {
+    if (handle >= previews_.size()) {
+      previews_.resize(handle + 1, nullptr);
+      UpdateMemory();
     }
-    material_map_[filename] = mat;
-    return mat;
+    previews_[handle] = mat;
   }
-  renderer_.last_error() = std::string("Couldn\'t load: ") + filename;
-  return nullptr;
+  return mat;
+}
+
+Material *MaterialManager::CreateMaterial(const char *filename,
+                                          int preview_level, int priority) {
+  MappedFile flatbuf;
+  if (!flatbuf.Open(filename)) {
+    renderer_.last_error() = std::string("Couldn\'t load: ") + filename;
+    return nullptr;
+  }
+  flatbuffers::Verifier verifier(flatbuf.data(), flatbuf.size());
+  assert(matdef::VerifyMaterialBuffer(verifier));
+  auto matdef = matdef::GetMaterial(flatbuf.data());
+  auto texture_filenames = matdef->texture_filenames();
+  std::vector<std::string> names(texture_filenames->size());
+  for (size_t i = 0; i < names.size(); i++) {
+    names[i] = texture_filenames->Get(i)->c_str();
+    if (preview_level == 0) continue;
+    names[i] = Renderer::MipFileName(names[i].c_str(), preview_level);
+    // Levels are only there if build_assets.py could make them.
+    MappedFile level;
+    if (!level.OpenOptional(names[i].c_str())) return nullptr;
+  }
+  auto mat = new Material();
+  mat->set_blend_mode(static_cast<BlendMode>(matdef->blendmode()));
+  for (size_t i = 0; i < names.size(); i++) {
+    auto format = matdef->desired_format() &&
+                  i < matdef->desired_format()->size()
+        ? static_cast<TextureFormat>(matdef->desired_format()->Get(i))
+        : kFormatAuto;
+    auto tex = LoadTexture(names[i].c_str(), format, priority);
+    mat->textures().push_back(tex);
+  }
+  auto rect = matdef->texture_rect();
+  if (rect) {
+    mat->set_texture_rect(vec4(rect->min_u(), rect->min_v(),
+                               rect->max_u(), rect->max_v()));
+    // An atlas is shared by many materials, so one of them is nearly always
+    // about to be drawn.
+    PinMaterial(mat);
+  }
+  return mat;
 }
 
 void MaterialManager::UnloadMaterial(const char *filename) {
-  auto mat = FindMaterial(filename);
+  const AssetHandle handle = materials_.Find(filename);
+  auto preview = FindPreviewMaterial(handle);
+  if (preview) {
+    RemoveTextures(preview);
+    previews_[handle] = nullptr;
+  }
+  auto mat = materials_.Get(handle);
   if (!mat) return;
+  RemoveTextures(mat);
+  materials_.Set(handle, nullptr);
+}
+
+void MaterialManager::RemoveTextures(Material *mat) {
   mat->DeleteTextures();
-  material_map_.erase(filename);
   for (auto it = mat->textures().begin(); it != mat->textures().end(); ++it) {
-    texture_map_.erase((*it)->filename());
+    textures_.Set(textures_.Find((*it)->filename().c_str()), nullptr);
   }
 }
 
+void MaterialManager::PinMaterial(Material *mat) {
+  if (!mat) return;
+  for (size_t i = 0; i < mat->textures().size(); ++i) {
+    mat->textures()[i]->set_pinned(true);
+  }
+  PrefetchMaterial(mat);
+}
+
+void MaterialManager::PrefetchMaterial(Material *mat) {
+  if (!mat) return;
+  for (size_t i = 0; i < mat->textures().size(); ++i) {
+    Texture *tex = mat->textures()[i];
+    if (tex->evicted()) {
+      tex->set_reloading();
+      loader_.QueueJob(tex, AsyncLoader::kHighPriority);
+    }
+  }
+}
+
+void MaterialManager::UpdateResidency(size_t budget) {
+  const unsigned int frame = renderer_.frame_count();
+  std::vector<Texture *> idle;
+  size_t resident = 0;
+  for (AssetHandle handle = 0; handle < textures_.size(); ++handle) {
+    Texture *tex = textures_.Get(handle);
+    if (!tex) continue;
+    if (tex->used_since_eviction()) {
+      // Drawn blank this frame, so load it before anything else.
+      tex->set_reloading();
+      loader_.QueueJob(tex, AsyncLoader::kHighPriority);
+    } else if (tex->id()) {
+      resident += tex->gpu_size();
+      if (!tex->pinned() &&
+          frame - tex->last_used_frame() >= kResidentFrames) {
+        idle.push_back(tex);
+      }
+    }
+  }
+  if (budget && resident > budget) {
+    std::sort(idle.begin(), idle.end(), [](const Texture *a,
+                                           const Texture *b) {
+      return a->last_used_frame() < b->last_used_frame();
+    });
+    for (size_t i = 0; i < idle.size() && resident > budget; ++i) {
+      SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "evict: %s",
+                   idle[i]->filename().c_str());
+      resident -= idle[i]->gpu_size();
+      idle[i]->Evict(frame);
+    }
+  }
+  resident_bytes_ = resident;
+}
+
+void MaterialManager::UpdateMemory() {
+  memory_.Set(shaders_.MemorySize() + textures_.MemorySize() +
+              materials_.MemorySize() +
+              previews_.capacity() * sizeof(Material *));
+}
+
 }  // namespace fpl
 
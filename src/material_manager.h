@@ -17,50 +17,118 @@
 
 #include "renderer.h"
 #include "common.h"
+#include "asset_table.h"
 #include "async_loader.h"
+#include "memory_tracker.h"
 
 namespace fpl {
 
 
 class MaterialManager {
  public:
-  MaterialManager(Renderer &renderer) : renderer_(renderer) {}
+  // Textures bound this recently are in use, so evicting them would only
+  // make them load again.
+  static const unsigned int kResidentFrames = 4;
+
+  MaterialManager(Renderer &renderer)
+      : renderer_(renderer), resident_bytes_(0), memory_(kMemoryMaterials) {}
 
   // Returns a previously loaded shader object, or nullptr.
-  Shader *FindShader(const char *basename);
+  Shader *FindShader(const char *basename,
+                     int features = kShaderFeaturesDefault);
   // Loads a shader if it hasn't been loaded already, by appending .glslv
-  // and .glslf to the basename, compiling and linking them.
+  // and .glslf to the basename, compiling and linking them. 'features' is a
+  // mask of ShaderFeatures to compile in, and each mask is a variant of its
+  // own, loaded once.
   // If this returns nullptr, the error can be found in Renderer::last_error().
-  Shader *LoadShader(const char *basename);
+  Shader *LoadShader(const char *basename,
+                     int features = kShaderFeaturesDefault);
 
   // Returns a previously created texture, or nullptr.
   Texture *FindTexture(const char *filename);
   // Queue's a texture for loading if it hasn't been loaded already.
   // Currently only supports TGA/WebP format files.
   // Returned texture isn't usable until TryFinalize() succeeds and the id
-  // is non-zero.
+  // is non-zero. Textures with a higher 'priority' are loaded first; see
+  // AsyncLoader.
   Texture *LoadTexture(const char *filename,
-                       TextureFormat format = kFormatAuto);
+                       TextureFormat format = kFormatAuto,
+                       int priority = AsyncLoader::kDefaultPriority);
   // LoadTextures doesn't actually load anything, this will start the async
-  // loading of all files, and decompression.
-  void StartLoadingTextures();
+  // loading of all files, and decompression, on up to 'num_threads' job
+  // system workers.
+  void StartLoadingTextures(int num_threads = 1);
   // Call this repeatedly until it returns true, which signals all textures
   // will have loaded, and turned into OpenGL textures.
   // Textures with a 0 id will have failed to load.
   bool TryFinalize();
+  // Like TryFinalize, but spreads the uploads over several frames; see
+  // AsyncLoader::TryFinalize.
+  bool TryFinalize(double max_seconds, size_t max_bytes);
+  // Fraction of the queued textures that are usable, from 0 to 1.
+  float LoadingProgress() const { return loader_.Progress(); }
+  // True when the last TryFinalize returned true.
+  bool FinishedLoading() const { return loader_.Finished(); }
 
-  // Returns a previously loaded material, or nullptr.
+  // Returns a previously loaded material, or nullptr. Finding a material
+  // queues any of its evicted textures to load again, ahead of their use.
   Material *FindMaterial(const char *filename);
+  // Returns the handle of a material filename, whether or not it has been
+  // loaded yet. Finding a material by handle is an array lookup, so resolve
+  // the handles of materials used every frame once, up front.
+  AssetHandle MaterialHandle(const char *filename);
+  // Returns a previously loaded material, or nullptr, like
+  // FindMaterial(filename).
+  Material *FindMaterial(AssetHandle handle);
   // Loads a material, which is a compiled FlatBuffer file with
   // root Material. This loads all resources contained there-in.
   // If this returns nullptr, the error can be found in Renderer::last_error().
-  Material *LoadMaterial(const char *filename);
+  // Its textures are queued with 'priority'.
+  Material *LoadMaterial(const char *filename,
+                         int priority = AsyncLoader::kDefaultPriority);
+  // Like LoadMaterial(filename), for the filename 'handle' was made from.
+  Material *LoadMaterial(AssetHandle handle,
+                         int priority = AsyncLoader::kDefaultPriority);
+
+  // Like LoadMaterial(), but each texture is replaced by mip 'level' of its
+  // precomputed mip chain, which loads much faster, for showing until the
+  // material itself is usable. Returns nullptr if the chain wasn't built.
+  Material *LoadPreviewMaterial(AssetHandle handle, int level,
+                                int priority = AsyncLoader::kPreviewPriority);
+  // Returns a previously loaded preview, or nullptr.
+  Material *FindPreviewMaterial(AssetHandle handle) const {
+    return handle < previews_.size() ? previews_[handle] : nullptr;
+  }
 
   // Deletes all OpenGL textures contained in this material, and removes the
-  // textures and the material from material manager. Any subsequent requests
-  // for these textures through Load*() will cause them to be loaded anew.
+  // textures and the material from material manager, along with its preview.
+  // Any subsequent requests for these textures through Load*() will cause
+  // them to be loaded anew.
+  // Materials that share an atlas also share its texture, so they can't be
+  // unloaded one at a time.
   void UnloadMaterial(const char *filename);
 
+  // Never evict the textures of 'mat', such as those of the UI, which must
+  // not draw blank when they come back on screen. Atlas textures, which many
+  // materials share, are pinned when loaded. 'mat' may be nullptr.
+  void PinMaterial(Material *mat);
+
+  // Queue the evicted textures of 'mat' to load again, for a material that
+  // is about to be drawn. 'mat' may be nullptr.
+  void PrefetchMaterial(Material *mat);
+
+  // Keep the GPU memory used by textures under 'budget' bytes, by deleting
+  // the OpenGL textures that materials bound least recently. Textures bound
+  // in the last kResidentFrames frames, and pinned textures, are never
+  // evicted. An evicted texture loads again when its material is looked up
+  // or prefetched, or failing that, as soon as a material binds it. It draws
+  // blank until it has been finalized, so keep calling TryFinalize(). Call
+  // once per frame, after rendering. A budget of 0 means no limit.
+  void UpdateResidency(size_t budget);
+
+  // Bytes of GPU memory that textures used, as of UpdateResidency().
+  size_t resident_bytes() const { return resident_bytes_; }
+
   // Handy accessors, so you don't have to pass the renderer around too.
   Renderer &renderer() { return renderer_; }
   const Renderer &renderer() const { return renderer_; }
@@ -68,11 +136,26 @@ class MaterialManager {
  private:
   DISALLOW_COPY_AND_ASSIGN(MaterialManager);
 
+  // Count the tables' memory, after they grow.
+  void UpdateMemory();
+
+  // Load the material in 'filename'. With a 'preview_level', its textures
+  // are that mip instead, and it fails unless they all exist.
+  Material *CreateMaterial(const char *filename, int preview_level,
+                           int priority);
+
+  // Delete the textures of 'mat', and remove them from textures_.
+  void RemoveTextures(Material *mat);
+
   Renderer &renderer_;
-  std::map<std::string, Shader *> shader_map_;
-  std::map<std::string, Texture *> texture_map_;
-  std::map<std::string, Material *> material_map_;
+  AssetTable<Shader> shaders_;
+  AssetTable<Texture> textures_;
+  AssetTable<Material> materials_;
+  // Indexed by the handle of the material each one stands in for.
+  std::vector<Material *> previews_;
   AsyncLoader loader_;
+  size_t resident_bytes_;
+  TrackedMemory memory_;
 };
 
 }  // namespace fpl
@@ -0,0 +1,73 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "memory_tracker.h"
+
+#include <atomic>
+
+namespace fpl {
+
+// Indexed by MemoryCategory, with the sum of them all at the end.
+static const int kTotal = kMemoryCategoryCount;
+static std::atomic<int64_t> current_bytes[kMemoryCategoryCount + 1];
+static std::atomic<int64_t> peak_bytes[kMemoryCategoryCount + 1];
+
+static const char *kCategoryNames[] = {
+  "textures", "meshes", "sounds", "flatbuffers", "materials", "particles",
+  "impel", "scene"
+};
+static_assert(sizeof(kCategoryNames) / sizeof(kCategoryNames[0]) ==
+              kMemoryCategoryCount, "kCategoryNames out of date");
+
+const char *MemoryCategoryName(MemoryCategory category) {
+  return kCategoryNames[category];
+}
+
+// Add 'bytes' to the total at 'index', and raise its peak to match.
+static void Add(int index, int64_t bytes) {
+  const int64_t now = current_bytes[index].fetch_add(bytes) + bytes;
+  int64_t peak = peak_bytes[index].load();
+  while (now > peak && !peak_bytes[index].compare_exchange_weak(peak, now)) {
+  }
+}
+
+void TrackMemory(MemoryCategory category, int64_t bytes) {
+  Add(category, bytes);
+  Add(kTotal, bytes);
+}
+
+static size_t Bytes(const std::atomic<int64_t> &bytes) {
+  const int64_t value = bytes.load();
+  return value > 0 ? static_cast<size_t>(value) : 0;
+}
+
+size_t CurrentMemory(MemoryCategory category) {
+  return Bytes(current_bytes[category]);
+}
+
+size_t PeakMemory(MemoryCategory category) {
+  return Bytes(peak_bytes[category]);
+}
+
+size_t CurrentMemoryTotal() { return Bytes(current_bytes[kTotal]); }
+
+size_t PeakMemoryTotal() { return Bytes(peak_bytes[kTotal]); }
+
+void ResetMemoryPeaks() {
+  for (int i = 0; i <= kTotal; ++i) {
+    peak_bytes[i].store(current_bytes[i].load());
+  }
+}
+
+}  // fpl
@@ -0,0 +1,102 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FPL_MEMORY_TRACKER_H
+#define FPL_MEMORY_TRACKER_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace fpl {
+
+// Totals of the memory used by each subsystem, current and peak, so that
+// budgets can be set against real numbers. Subsystems register what they
+// allocate, usually through a TrackedMemory member that they keep in step
+// with their buffers. GPU memory is an estimate from the sizes uploaded.
+//
+// Allocations are tracked from the loader and update threads too, so the
+// totals are atomic.
+enum MemoryCategory {
+  kMemoryTextures,
+  kMemoryMeshes,
+  kMemorySounds,
+  kMemoryFlatbuffers,
+  kMemoryMaterials,
+  kMemoryParticles,
+  kMemoryImpel,
+  kMemoryScene,
+  kMemoryCategoryCount
+};
+
+// Short name of 'category', such as "textures".
+const char *MemoryCategoryName(MemoryCategory category);
+
+// Add 'bytes' to the current total of 'category'. Negative to free them.
+void TrackMemory(MemoryCategory category, int64_t bytes);
+
+// Bytes in use now, and the most that have been in use at once, in
+// 'category' or in all of them.
+size_t CurrentMemory(MemoryCategory category);
+size_t PeakMemory(MemoryCategory category);
+size_t CurrentMemoryTotal();
+size_t PeakMemoryTotal();
+
+// Start the peaks again from the current totals, for example once loading
+// has finished.
+void ResetMemoryPeaks();
+
+// Bytes allocated by a std::vector, whether or not they are in use.
+template<class Vector>
+size_t VectorMemory(const Vector &vector) {
+  return vector.capacity() * sizeof(typename Vector::value_type);
+}
+
+// A number of bytes counted in a MemoryCategory for as long as this lives.
+// Set() it whenever the owner's buffers change size. Copies count their
+// bytes again, as copying the owner copies its buffers.
+class TrackedMemory {
+ public:
+  explicit TrackedMemory(MemoryCategory category)
+      : category_(category), bytes_(0) {}
+  TrackedMemory(const TrackedMemory &rhs)
+      : category_(rhs.category_), bytes_(0) {
+    Set(rhs.bytes_);
+  }
+  TrackedMemory &operator=(const TrackedMemory &rhs) {
+    if (this != &rhs) {
+      Set(0);
+      category_ = rhs.category_;
+      Set(rhs.bytes_);
+    }
+    return *this;
+  }
+  ~TrackedMemory() { Set(0); }
+
+  void Set(size_t bytes) {
+    if (bytes != bytes_) {
+      TrackMemory(category_, static_cast<int64_t>(bytes) -
+                             static_cast<int64_t>(bytes_));
+      bytes_ = bytes;
+    }
+  }
+  size_t bytes() const { return bytes_; }
+
+ private:
+  MemoryCategory category_;
+  size_t bytes_;
+};
+
+}  // fpl
+
+#endif  // FPL_MEMORY_TRACKER_H
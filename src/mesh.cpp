@@ -14,12 +14,14 @@
 
 #include "precompiled.h"
 #include "mesh.h"
+#include "renderer.h"
 
 namespace fpl {
 
-void Mesh::SetAttributes(GLuint vbo, const Attribute *attributes, int stride,
+void Mesh::SetAttributes(Renderer &renderer, GLuint vbo,
+                         const Attribute *attributes, int stride,
                          const char *buffer) {
-  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbo));
+  renderer.BindBuffer(GL_ARRAY_BUFFER, vbo);
   size_t offset = 0;
   for (;;) {
     switch (*attributes++) {
@@ -83,19 +85,41 @@ void Mesh::UnSetAttributes(const Attribute *attributes) {
   }
 }
 
-Mesh::Mesh(const void *vertex_data, int count, int vertex_size,
-           const Attribute *format)
-    : vertex_size_(vertex_size), format_(format) {
+Mesh::Mesh(Renderer &renderer, const void *vertex_data, int count,
+           int vertex_size, const Attribute *format)
+    : renderer_(&renderer), pool_(nullptr), base_vertex_(0),
+      vertex_size_(vertex_size), format_(format), vao_(0),
+      memory_(kMemoryMeshes) {
   GL_CALL(glGenBuffers(1, &vbo_));
-  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
+  renderer_->BindBuffer(GL_ARRAY_BUFFER, vbo_);
   GL_CALL(glBufferData(GL_ARRAY_BUFFER, count * vertex_size, vertex_data,
                        GL_STATIC_DRAW));
+  CountGLBufferUpload(count * vertex_size);
+  memory_.Set(count * vertex_size);
+
+  // Record the attribute bindings once, so that Render() only has to bind
+  // the vertex array.
+  if (renderer_->SupportsVertexArrays()) {
+    GL_CALL(fplGenVertexArrays(1, &vao_));
+    renderer_->BindVertexArray(vao_);
+    SetAttributes(*renderer_, vbo_, format_, vertex_size_, nullptr);
+    renderer_->BindVertexArray(0);
+  }
 }
 
+Mesh::Mesh(MeshPool *pool, const void *vertex_data, int count)
+    : renderer_(&pool->renderer()), pool_(pool),
+      base_vertex_(pool->AddVertices(vertex_data, count)),
+      vertex_size_(pool->vertex_size()), format_(pool->format()), vbo_(0),
+      vao_(0), memory_(kMemoryMeshes) {}
+
 Mesh::~Mesh() {
-  GL_CALL(glDeleteBuffers(1, &vbo_));
+  // A pooled Mesh owns no buffers.
+  if (pool_) return;
+  if (vao_) renderer_->DeleteVertexArray(vao_);
+  renderer_->DeleteBuffer(vbo_);
   for (auto it = indices_.begin(); it != indices_.end(); ++it) {
-    GL_CALL(glDeleteBuffers(1, &it->ibo));
+    renderer_->DeleteBuffer(it->ibo);
   }
 }
 
@@ -103,33 +127,127 @@ void Mesh::AddIndices(const unsigned short *index_data, int count, Material *mat
   indices_.push_back(Indices());
   auto &idxs = indices_.back();
   idxs.count = count;
+  idxs.mat = mat;
+  if (pool_) {
+    idxs.ibo = 0;
+    idxs.offset = pool_->AddIndices(index_data, count, base_vertex_);
+    return;
+  }
+  idxs.offset = 0;
   GL_CALL(glGenBuffers(1, &idxs.ibo));
-  GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idxs.ibo));
-  GL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(int), index_data,
+  renderer_->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, idxs.ibo);
+  GL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                       count * sizeof(unsigned short), index_data,
                        GL_STATIC_DRAW));
-  idxs.mat = mat;
+  CountGLBufferUpload(count * sizeof(unsigned short));
+  memory_.Set(memory_.bytes() + count * sizeof(unsigned short));
+}
+
+GLuint Mesh::vbo() const {
+  return pool_ ? pool_->vbo_ : vbo_;
+}
+
+GLuint Mesh::ibo(const Indices &indices) const {
+  return pool_ ? pool_->ibo_ : indices.ibo;
+}
+
+GLuint Mesh::vao() const {
+  return pool_ ? pool_->vao_ : vao_;
+}
+
+void Mesh::BindAttributes(Renderer &renderer) {
+  assert(pool_ == nullptr || pool_->finalized());
+  const GLuint array = vao();
+  if (array) {
+    renderer.BindVertexArray(array);
+  } else {
+    SetAttributes(renderer, vbo(), format_, vertex_size_, nullptr);
+  }
+}
+
+// Code outside of Mesh sets attributes without a vertex array, and would
+// change ours if it were still bound.
+void Mesh::UnbindAttributes(Renderer &renderer) {
+  if (vao()) {
+    renderer.BindVertexArray(0);
+  } else {
+    UnSetAttributes(format_);
+  }
 }
 
 void Mesh::Render(Renderer &renderer, bool ignore_material) {
-  SetAttributes(vbo_, format_, vertex_size_, nullptr);
+  BindAttributes(renderer);
   for (auto it = indices_.begin(); it != indices_.end(); ++it) {
     if (!ignore_material) it->mat->Set(renderer);
-    GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, it->ibo));
-    GL_CALL(glDrawElements(GL_TRIANGLES, it->count, GL_UNSIGNED_SHORT, 0));
+    renderer.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo(*it));
+    GL_CALL(glDrawElements(GL_TRIANGLES, it->count, GL_UNSIGNED_SHORT,
+                           reinterpret_cast<const void *>(it->offset)));
   }
-  UnSetAttributes(format_);
+  UnbindAttributes(renderer);
 }
 
-void Mesh::RenderArray(GLenum primitive, int index_count,
+void Mesh::RenderInstanced(Renderer &renderer, GLuint instance_vbo,
+                           size_t offset, int count) {
+  BindAttributes(renderer);
+
+  // The instance attributes advance once per instance instead of once per
+  // vertex.
+  static const GLuint kInstanceAttributes[] = {
+    kAttributeWorld0, kAttributeWorld1, kAttributeWorld2, kAttributeWorld3,
+    kAttributeColor
+  };
+  const int kNumInstanceAttributes =
+      sizeof(kInstanceAttributes) / sizeof(kInstanceAttributes[0]);
+  renderer.BindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+  const char *base = reinterpret_cast<const char *>(offset);
+  for (int i = 0; i < kNumInstanceAttributes; ++i) {
+    const GLuint attribute = kInstanceAttributes[i];
+    GL_CALL(glEnableVertexAttribArray(attribute));
+    GL_CALL(glVertexAttribPointer(attribute, 4, GL_FLOAT, false,
+                                  sizeof(MeshInstance),
+                                  base + i * sizeof(vec4_packed)));
+    GL_CALL(fplVertexAttribDivisor(attribute, 1));
+  }
+
+  for (auto it = indices_.begin(); it != indices_.end(); ++it) {
+    it->mat->Set(renderer);
+    renderer.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo(*it));
+    GL_CALL(fplDrawElementsInstanced(
+        GL_TRIANGLES, it->count, GL_UNSIGNED_SHORT,
+        reinterpret_cast<const void *>(it->offset), count));
+  }
+
+  // Other meshes read aColor per vertex, so the divisors must be reset. With
+  // a vertex array, this also leaves it as the constructor recorded it.
+  for (int i = 0; i < kNumInstanceAttributes; ++i) {
+    GL_CALL(fplVertexAttribDivisor(kInstanceAttributes[i], 0));
+    GL_CALL(glDisableVertexAttribArray(kInstanceAttributes[i]));
+  }
+  UnbindAttributes(renderer);
+}
+
+void Mesh::RenderArray(Renderer &renderer, GLenum primitive, int index_count,
                        const Attribute *format, int vertex_size,
                        const char *vertices, const unsigned short *indices) {
-  SetAttributes(0, format, vertex_size, vertices);
-  GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+  SetAttributes(renderer, 0, format, vertex_size, vertices);
+  renderer.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
   GL_CALL(glDrawElements(primitive, index_count, GL_UNSIGNED_SHORT, indices));
   UnSetAttributes(format);
 }
 
-void Mesh::RenderAAQuadAlongX(const vec3 &bottom_left, const vec3 &top_right,
+void Mesh::RenderBufferRange(Renderer &renderer, GLenum primitive,
+                             int index_count, const Attribute *format,
+                             int vertex_size, GLuint vbo,
+                             size_t vertex_offset, GLuint ibo) {
+  SetAttributes(renderer, vbo, format, vertex_size,
+                reinterpret_cast<const char *>(vertex_offset));
+  renderer.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+  GL_CALL(glDrawElements(primitive, index_count, GL_UNSIGNED_SHORT, 0));
+  UnSetAttributes(format);
+}
+
+void Mesh::RenderAAQuadAlongX(Renderer &renderer, const vec3 &bottom_left,
+                              const vec3 &top_right,
                               const vec2 &tex_bottom_left,
                               const vec2 &tex_top_right) {
   static Attribute format[] = { kPosition3f, kTexCoord2f, kEND };
@@ -145,10 +263,78 @@ void Mesh::RenderAAQuadAlongX(const vec3 &bottom_left, const vec3 &top_right,
     top_right.x(),   top_right.y(),   top_right.z(),
     tex_top_right.x(), tex_top_right.y()
   };
-  Mesh::RenderArray(GL_TRIANGLES, 6, format, sizeof(float) * 5,
+  Mesh::RenderArray(renderer, GL_TRIANGLES, 6, format, sizeof(float) * 5,
                     reinterpret_cast<const char *>(vertices), indices);
 }
 
+const int MeshPool::kMaxVertices;
+
+MeshPool::MeshPool(Renderer &renderer, int vertex_size,
+                   const Attribute *format)
+    : renderer_(&renderer), vertex_size_(vertex_size), format_(format),
+      num_vertices_(0), vbo_(0), ibo_(0), vao_(0), memory_(kMemoryMeshes) {}
+
+MeshPool::~MeshPool() {
+  if (!finalized()) return;
+  if (vao_) renderer_->DeleteVertexArray(vao_);
+  renderer_->DeleteBuffer(vbo_);
+  renderer_->DeleteBuffer(ibo_);
+}
+
+int MeshPool::AddVertices(const void *vertex_data, int count) {
+  assert(!finalized());
+  assert(num_vertices_ + count <= kMaxVertices);
+  const char *bytes = static_cast<const char *>(vertex_data);
+  vertex_data_.insert(vertex_data_.end(), bytes,
+                      bytes + count * vertex_size_);
+  const int base_vertex = num_vertices_;
+  num_vertices_ += count;
+  memory_.Set(VectorMemory(vertex_data_) + VectorMemory(index_data_));
+  return base_vertex;
+}
+
+size_t MeshPool::AddIndices(const unsigned short *indices, int count,
+                            int base_vertex) {
+  assert(!finalized());
+  const size_t offset = index_data_.size() * sizeof(unsigned short);
+  for (int i = 0; i < count; ++i) {
+    index_data_.push_back(static_cast<unsigned short>(indices[i] +
+                                                      base_vertex));
+  }
+  memory_.Set(VectorMemory(vertex_data_) + VectorMemory(index_data_));
+  return offset;
+}
+
+void MeshPool::Finalize() {
+  assert(!finalized());
+  assert(!vertex_data_.empty() && !index_data_.empty());
+  GL_CALL(glGenBuffers(1, &vbo_));
+  renderer_->BindBuffer(GL_ARRAY_BUFFER, vbo_);
+  GL_CALL(glBufferData(GL_ARRAY_BUFFER, vertex_data_.size(), &vertex_data_[0],
+                       GL_STATIC_DRAW));
+  CountGLBufferUpload(vertex_data_.size());
+  GL_CALL(glGenBuffers(1, &ibo_));
+  renderer_->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_);
+  GL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                       index_data_.size() * sizeof(unsigned short),
+                       &index_data_[0], GL_STATIC_DRAW));
+  CountGLBufferUpload(index_data_.size() * sizeof(unsigned short));
+
+  // The indices already point at each Mesh's vertices, so one set of
+  // attribute bindings serves every Mesh in the pool.
+  if (renderer_->SupportsVertexArrays()) {
+    GL_CALL(fplGenVertexArrays(1, &vao_));
+    renderer_->BindVertexArray(vao_);
+    Mesh::SetAttributes(*renderer_, vbo_, format_, vertex_size_, nullptr);
+    renderer_->BindVertexArray(0);
+  }
+
+  memory_.Set(vertex_data_.size() +
+              index_data_.size() * sizeof(unsigned short));
+  std::vector<char>().swap(vertex_data_);
+  std::vector<unsigned short>().swap(index_data_);
+}
+
 // Compute normals and tangents for a mesh based on positions and texcoords.
 void Mesh::ComputeNormalsTangents(NormalMappedVertex *vertices,
                                    const unsigned short *indices,
@@ -16,6 +16,7 @@
 #define FPL_MESH_H
 
 #include "material.h"
+#include "memory_tracker.h"
 
 namespace fpl {
 
@@ -46,34 +47,68 @@ struct NormalMappedVertex {
   vec4_packed tangent;
 };
 
-// A mesh instance contains a VBO and one or more IBO's.
+// Per-instance data for Mesh::RenderInstanced(). The world matrix columns
+// are read as the aWorld0..3 attributes, and the color as aColor.
+struct MeshInstance {
+  vec4_packed world[4];
+  vec4_packed color;
+};
+
+class MeshPool;
+
+// A mesh instance contains a VBO and one or more IBO's, or a range of the
+// VBO and IBO of a MeshPool.
 class Mesh {
  public:
-  // Initialize a Mesh by creating one VBO, and no IBO's.
-  Mesh(const void *vertex_data, int count, int vertex_size,
-      const Attribute *format);
+  // Initialize a Mesh by creating one VBO, and no IBO's. The buffers are
+  // bound and deleted through 'renderer', which must outlive the Mesh. When
+  // the renderer SupportsVertexArrays(), the attribute bindings are recorded
+  // in a vertex array here, so Render() doesn't have to set each one.
+  Mesh(Renderer &renderer, const void *vertex_data, int count,
+       int vertex_size, const Attribute *format);
+  // Initialize a Mesh whose vertices are appended to 'pool', in the pool's
+  // vertex format. The Mesh can't be rendered until pool->Finalize() has
+  // been called, and the pool must outlive it.
+  Mesh(MeshPool *pool, const void *vertex_data, int count);
   ~Mesh();
 
   // Create one IBO to be part of this mesh. May be called more than once.
+  // For a pooled Mesh, the indices are appended to the pool's IBO instead.
   void AddIndices(const unsigned short *indices, int count, Material *mat);
 
   // Render itself. Uniforms must have been set before calling this.
   void Render(Renderer &renderer, bool ignore_material = false);
 
+  // Render 'count' copies of itself in one draw call per IBO, one for each
+  // MeshInstance in 'instance_vbo', starting at byte 'offset'. Requires
+  // Renderer::SupportsInstancing().
+  void RenderInstanced(Renderer &renderer, GLuint instance_vbo, size_t offset,
+                       int count);
+
   // Get the material associated with the Nth IBO.
   Material *GetMaterial(int i) { return indices_[i].mat; }
 
   // Renders primatives using vertex and index data directly in local memory.
   // This is a convenient alternative to creating a Mesh instance for small
   // amounts of data, or dynamic data.
-  static void RenderArray(GLenum primitive, int index_count,
+  static void RenderArray(Renderer &renderer, GLenum primitive,
+                          int index_count,
                           const Attribute *format,
                           int vertex_size, const char *vertices,
                           const unsigned short *indices);
 
+  // Renders primitives from buffer objects. 'vertex_offset' is the byte
+  // offset in 'vbo' of the vertex that index 0 refers to, and the indices
+  // are read from the start of 'ibo'.
+  static void RenderBufferRange(Renderer &renderer, GLenum primitive,
+                                int index_count, const Attribute *format,
+                                int vertex_size, GLuint vbo,
+                                size_t vertex_offset, GLuint ibo);
+
   // Convenience method for rendering a Quad. bottom_left and top_right must
   // have their X coordinate be different, but either Y or Z can be the same.
-  static void RenderAAQuadAlongX(const vec3 &bottom_left,
+  static void RenderAAQuadAlongX(Renderer &renderer,
+                                 const vec3 &bottom_left,
                                  const vec3 &top_right,
                                  const vec2 &tex_bottom_left = vec2(0, 0),
                                  const vec2 &tex_top_right = vec2(1, 1));
@@ -89,22 +124,111 @@ class Mesh {
     kAttributeNormal,
     kAttributeTangent,
     kAttributeTexCoord,
-    kAttributeColor
+    kAttributeColor,
+    // Extra attributes for shaders whose vertices aren't described by an
+    // Attribute format, such as the GPU particles.
+    kAttributeParticle0,
+    kAttributeParticle1,
+    kAttributeParticle2,
+    // Per-instance world matrix columns, for RenderInstanced().
+    kAttributeWorld0,
+    kAttributeWorld1,
+    kAttributeWorld2,
+    kAttributeWorld3
   };
 
  private:
-  static void SetAttributes(GLuint vbo, const Attribute *attributes,
-                            int vertex_size, const char *buffer);
+  static void SetAttributes(Renderer &renderer, GLuint vbo,
+                            const Attribute *attributes, int vertex_size,
+                            const char *buffer);
   static void UnSetAttributes(const Attribute *attributes);
+  // Enable this mesh's attributes, from vao() when there is one.
+  void BindAttributes(Renderer &renderer);
+  void UnbindAttributes(Renderer &renderer);
   struct Indices {
     int count;
     GLuint ibo;
+    size_t offset;  // Byte offset of the first index in the IBO.
     Material *mat;
   };
+  // The buffers to draw from. A pooled Mesh reads them from the pool, since
+  // they don't exist until the pool is finalized.
+  GLuint vbo() const;
+  GLuint ibo(const Indices &indices) const;
+  GLuint vao() const;
   std::vector<Indices> indices_;
+  Renderer *renderer_;
+  MeshPool *pool_;
+  int base_vertex_;  // Index of the first vertex in the pool.
   size_t vertex_size_;
   const Attribute *format_;
   GLuint vbo_;
+  // Vertex array holding the attribute bindings of vbo_, or 0 when the
+  // driver has no vertex array objects.
+  GLuint vao_;
+
+  // Bytes in vbo_ and the IBOs. A pooled Mesh's are counted by its pool.
+  TrackedMemory memory_;
+
+  friend class MeshPool;
+};
+
+// Holds the vertices and indices of many Meshes that share a vertex format
+// in one VBO and one IBO. The indices of each Mesh are offset by the Mesh's
+// first vertex, so every Mesh draws with the same attribute bindings, and
+// drawing a run of them doesn't rebind any buffers.
+//
+// Meshes are added first, then Finalize() uploads everything at once. The
+// indices are 16-bit, so a pool holds at most kMaxVertices vertices.
+class MeshPool {
+ public:
+  static const int kMaxVertices = 65536;
+
+  // 'renderer' must outlive the MeshPool. No GL calls are made until
+  // Finalize().
+  MeshPool(Renderer &renderer, int vertex_size, const Attribute *format);
+  ~MeshPool();
+
+  // Create the VBO and IBO from the Meshes added so far. Call once, after
+  // the last Mesh has been added.
+  void Finalize();
+
+  bool finalized() const { return vbo_ != 0; }
+  int num_vertices() const { return num_vertices_; }
+  int vertex_size() const { return vertex_size_; }
+  const Attribute *format() const { return format_; }
+  Renderer &renderer() const { return *renderer_; }
+
+ private:
+  // Disallow copies. The buffers are owned.
+  MeshPool(const MeshPool &);
+  MeshPool &operator=(const MeshPool &);
+
+  // Append 'count' vertices. Returns the index of the first one.
+  int AddVertices(const void *vertex_data, int count);
+
+  // Append 'count' indices, offset by 'base_vertex'. Returns the byte offset
+  // of the first one in the IBO.
+  size_t AddIndices(const unsigned short *indices, int count,
+                    int base_vertex);
+
+  Renderer *renderer_;
+  int vertex_size_;
+  const Attribute *format_;
+  int num_vertices_;
+
+  // Data waiting for Finalize(). Freed once it is uploaded.
+  std::vector<char> vertex_data_;
+  std::vector<unsigned short> index_data_;
+
+  GLuint vbo_;
+  GLuint ibo_;
+  GLuint vao_;
+
+  // Bytes waiting for Finalize(), then bytes in vbo_ and ibo_.
+  TrackedMemory memory_;
+
+  friend class Mesh;
 };
 
 }  // namespace fpl
@@ -1,10 +1,14 @@
 #include "particles.h"
+#include "job_system.h"
+#include "rng.h"
+
+#include <algorithm>
 
 
 namespace fpl {
 namespace pie_noon {
 
-const int kMaxParticles = 1000;
+const int ParticleManager::kMaxParticles;
 
 void Particle::reset() {
   base_position_ = mathfu::vec3(0, 0, 0);
@@ -15,96 +19,413 @@ void Particle::reset() {
   base_scale_ = mathfu::vec3(1, 1, 1);
   base_tint_ = mathfu::vec4(1, 1, 1, 1);
   duration_= 0;
-  age_ = 0;
   duration_of_fade_out_ = 0;
   duration_of_shrink_out_ = 0;
+  renderable_id_ = 0;
 }
 
-mathfu::mat4 Particle::CalculateMatrix() const {
-  return mathfu::mat4::FromTranslationVector(CurrentPosition()) *
-         mathfu::mat4::FromRotationMatrix(CurrentOrientation().ToMatrix()) *
-         mathfu::mat4::FromScaleVector(CurrentScale());
+ParticleSpawnDef::ParticleSpawnDef()
+    : min_scale(1.0f), max_scale(1.0f), preserve_aspect(false),
+      min_velocity(0.0f), max_velocity(0.0f), acceleration(0.0f),
+      min_position_offset(0.0f), max_position_offset(0.0f),
+      min_orientation_offset(0.0f), max_orientation_offset(0.0f),
+      min_angular_velocity(0.0f), max_angular_velocity(0.0f),
+      min_duration(0), max_duration(0), fade_duration(0.0f),
+      shrink_duration(0.0f),
+      renderable_ids(1, 0),
+      tints(1, mathfu::vec4(1.0f, 1.0f, 1.0f, 1.0f)) {
 }
 
-mathfu::vec3 Particle::CurrentPosition() const {
-  return base_position_ + (base_velocity_ * age_) +
-      (acceleration_ / 2.0) * age_ * age_;
+// Each component uniform in [start, end).
+static mathfu::vec3 RandomInRange(Rng* rng, const mathfu::vec3& start,
+                                  const mathfu::vec3& end) {
+  return mathfu::vec3(rng->FloatInRange(start.x(), end.x()),
+                      rng->FloatInRange(start.y(), end.y()),
+                      rng->FloatInRange(start.z(), end.z()));
 }
 
-mathfu::vec3 Particle::CurrentVelocity() const {
-  return base_velocity_ + acceleration_ * age_;
+static mathfu::vec3 RandomScale(Rng* rng, const ParticleSpawnDef& def) {
+  return def.preserve_aspect ?
+      mathfu::vec3(rng->FloatInRange(def.min_scale.x(), def.max_scale.x())) :
+      RandomInRange(rng, def.min_scale, def.max_scale);
 }
 
-Quat Particle::CurrentOrientation() const {
-  return Quat::FromEulerAngles(base_orientation_ +
-                               rotational_velocity_ * age_);
+static mathfu::vec4 RandomTint(Rng* rng, const ParticleSpawnDef& def,
+                               const mathfu::vec4& tint) {
+  const mathfu::vec4& def_tint = def.tints[rng->IntInRange(
+      0, static_cast<int>(def.tints.size()))];
+  return mathfu::vec4(def_tint.x() * tint.x(), def_tint.y() * tint.y(),
+                      def_tint.z() * tint.z(), def_tint.w() * tint.w());
 }
 
-TimeStep Particle::DurationRemaining() const {
-  return duration_ - age_;
+static uint16_t RandomRenderableId(Rng* rng, const ParticleSpawnDef& def) {
+  return def.renderable_ids[rng->IntInRange(
+      0, static_cast<int>(def.renderable_ids.size()))];
 }
 
-void Particle::SetDurationRemaining(TimeStep duration) {
-  duration_ = age_ + duration;
+// Fill 'values' with 'count' floats uniform in [start, start + range). The
+// random numbers are drawn first, so that the second loop vectorizes.
+static void FillUniform(Rng* rng, float start, float range, float* values,
+                        int count) {
+  for (int i = 0; i < count; ++i) {
+    values[i] = rng->Float();
+  }
+  for (int i = 0; i < count; ++i) {
+    values[i] = start + range * values[i];
+  }
 }
 
-// Returns the current tint, after taking particle effects into account.
-mathfu::vec4 Particle::CurrentTint() const {
-  return base_tint_ *
-      (((duration_ - age_) < duration_of_fade_out_) ?
-      (float)(duration_ - age_) / (float)duration_of_fade_out_ :
-      1.0f);
+void GenerateGpuParticleSpawns(const ParticleSpawnDef& def,
+                               const mathfu::vec3& position,
+                               const mathfu::vec4& tint, uint32_t seed,
+                               WorldTime spawn_time, int count,
+                               GpuParticleSpawn* spawns) {
+  Rng rng(seed);
+  for (int i = 0; i < count; ++i) {
+    Particle& particle = spawns[i].particle;
+    particle.set_base_scale(RandomScale(&rng, def));
+    particle.set_base_velocity(RandomInRange(&rng, def.min_velocity,
+                                             def.max_velocity));
+    particle.set_acceleration(def.acceleration);
+    particle.set_renderable_id(RandomRenderableId(&rng, def));
+    particle.set_base_tint(RandomTint(&rng, def, tint));
+    particle.set_duration(static_cast<TimeStep>(
+        rng.IntInRange(def.min_duration, def.max_duration)));
+    particle.set_base_position(position + RandomInRange(
+        &rng, def.min_position_offset, def.max_position_offset));
+    particle.set_base_orientation(RandomInRange(
+        &rng, def.min_orientation_offset, def.max_orientation_offset));
+    particle.set_rotational_velocity(RandomInRange(
+        &rng, def.min_angular_velocity, def.max_angular_velocity));
+    particle.set_duration_of_shrink_out(def.shrink_duration);
+    particle.set_duration_of_fade_out(def.fade_duration);
+    spawns[i].spawn_time = spawn_time;
+  }
+}
+
+ParticleManager::ParticleManager() : memory_(kMemoryParticles) {
+  size_t bytes = 0;
+  for (int c = 0; c < kNumChannels; ++c) {
+    channels_[c].reserve(kMaxParticles);
+    bytes += VectorMemory(channels_[c]);
+  }
+  base_orientations_.reserve(kMaxParticles);
+  rotational_velocities_.reserve(kMaxParticles);
+  base_scales_.reserve(kMaxParticles);
+  base_tints_.reserve(kMaxParticles);
+  renderable_ids_.reserve(kMaxParticles);
+  memory_.Set(bytes + VectorMemory(base_orientations_) +
+              VectorMemory(rotational_velocities_) +
+              VectorMemory(base_scales_) + VectorMemory(base_tints_) +
+              VectorMemory(renderable_ids_));
+}
+
+mathfu::mat4 ParticleManager::CalculateMatrix(int i) const {
+  const mathfu::vec3 position = CurrentPosition(i);
+  return MatrixFromPosition(i, position.x(), position.y(), position.z(),
+                            FadeFactor(i, kDurationOfShrinkOut,
+                                       kShrinkOutRate));
+}
+
+// Same as FromTranslationVector(position) * FromRotationMatrix(orientation) *
+// FromScaleVector(scale), without the matrix multiplies.
+mathfu::mat4 ParticleManager::MatrixFromPosition(int i, float x, float y,
+                                                 float z, float shrink) const {
+  const mathfu::mat3 r = CurrentOrientation(i).ToMatrix();
+  const mathfu::vec3 scale = base_scales_[i] * shrink;
+  const float sx = scale.x();
+  const float sy = scale.y();
+  const float sz = scale.z();
+  return mathfu::mat4(r(0, 0) * sx, r(1, 0) * sx, r(2, 0) * sx, 0.0f,
+                      r(0, 1) * sy, r(1, 1) * sy, r(2, 1) * sy, 0.0f,
+                      r(0, 2) * sz, r(1, 2) * sz, r(2, 2) * sz, 0.0f,
+                      x, y, z, 1.0f);
+}
+
+mathfu::vec3 ParticleManager::CurrentPosition(int i) const {
+  const float age = channels_[kAge][i];
+  const float half_age_squared = 0.5f * age * age;
+  return mathfu::vec3(
+      channels_[kBasePositionX][i] + channels_[kBaseVelocityX][i] * age +
+          channels_[kAccelerationX][i] * half_age_squared,
+      channels_[kBasePositionY][i] + channels_[kBaseVelocityY][i] * age +
+          channels_[kAccelerationY][i] * half_age_squared,
+      channels_[kBasePositionZ][i] + channels_[kBaseVelocityZ][i] * age +
+          channels_[kAccelerationZ][i] * half_age_squared);
 }
 
-void Particle::AdvanceFrame(TimeStep delta_time) {
-  age_ += delta_time;
+mathfu::vec3 ParticleManager::CurrentVelocity(int i) const {
+  const float age = channels_[kAge][i];
+  return mathfu::vec3(
+      channels_[kBaseVelocityX][i] + channels_[kAccelerationX][i] * age,
+      channels_[kBaseVelocityY][i] + channels_[kAccelerationY][i] * age,
+      channels_[kBaseVelocityZ][i] + channels_[kAccelerationZ][i] * age);
 }
 
-bool Particle::IsFinished() const {
-  return age_ >= duration_;
+Quat ParticleManager::CurrentOrientation(int i) const {
+  return Quat::FromEulerAngles(base_orientations_[i] +
+                               rotational_velocities_[i] *
+                               channels_[kAge][i]);
+}
+
+float ParticleManager::FadeFactor(int i, Channel duration,
+                                  Channel rate) const {
+  const TimeStep remaining = DurationRemaining(i);
+  return remaining < channels_[duration][i] ?
+         remaining * channels_[rate][i] : 1.0f;
 }
 
 // Returns the current tint, after taking particle effects into account.
-mathfu::vec3 Particle::CurrentScale() const {
-  return base_scale_ *
-      (((duration_ - age_) < duration_of_shrink_out_) ?
-      (float)(duration_ - age_) / (float)duration_of_shrink_out_ :
-      1.0f);
+mathfu::vec4 ParticleManager::CurrentTint(int i) const {
+  return base_tints_[i] * FadeFactor(i, kDurationOfFadeOut, kFadeOutRate);
+}
+
+// Returns the current scale, after taking particle effects into account.
+mathfu::vec3 ParticleManager::CurrentScale(int i) const {
+  return base_scales_[i] * FadeFactor(i, kDurationOfShrinkOut,
+                                      kShrinkOutRate);
+}
+
+void ParticleManager::ComputeTransforms(mathfu::mat4* matrices,
+                                        mathfu::vec4* tints) const {
+  const int count = Count();
+  int i = 0;
+
+  // Evaluate kSimdWidth particles at a time, then the remainder one at a
+  // time. Only the orientation, which needs trigonometry, is per particle.
+#if defined(IMPEL_SIMD)
+  using namespace impel;
+  union Lanes {
+    Float4 v;
+    float f[kSimdWidth];
+  };
+  const Float4 half = Splat4(0.5f);
+  const Float4 one = Splat4(1.0f);
+  for (; i + kSimdWidth <= count; i += kSimdWidth) {
+    const Float4 age = Load4(&channels_[kAge][i]);
+    const Float4 half_age_squared = Mul4(half, Mul4(age, age));
+    Lanes position[3];
+    for (int axis = 0; axis < 3; ++axis) {
+      const Float4 base = Load4(&channels_[kBasePositionX + axis][i]);
+      const Float4 velocity = Load4(&channels_[kBaseVelocityX + axis][i]);
+      const Float4 acceleration =
+          Load4(&channels_[kAccelerationX + axis][i]);
+      position[axis].v = Add4(Add4(base, Mul4(velocity, age)),
+                              Mul4(acceleration, half_age_squared));
+    }
+
+    const Float4 remaining = Sub4(Load4(&channels_[kDuration][i]), age);
+    Lanes fade;
+    fade.v = Select4(Greater4(Load4(&channels_[kDurationOfFadeOut][i]),
+                              remaining),
+                     Mul4(remaining, Load4(&channels_[kFadeOutRate][i])),
+                     one);
+    Lanes shrink;
+    shrink.v = Select4(Greater4(Load4(&channels_[kDurationOfShrinkOut][i]),
+                                remaining),
+                       Mul4(remaining, Load4(&channels_[kShrinkOutRate][i])),
+                       one);
+
+    for (int lane = 0; lane < kSimdWidth; ++lane) {
+      matrices[i + lane] = MatrixFromPosition(
+          i + lane, position[0].f[lane], position[1].f[lane],
+          position[2].f[lane], shrink.f[lane]);
+      tints[i + lane] = base_tints_[i + lane] * fade.f[lane];
+    }
+  }
+#endif // defined(IMPEL_SIMD)
+  for (; i < count; ++i) {
+    matrices[i] = CalculateMatrix(i);
+    tints[i] = CurrentTint(i);
+  }
 }
 
 void ParticleManager::AdvanceFrame(TimeStep delta_time) {
-  for (auto it = particle_list_.begin(); it != particle_list_.end(); ) {
-    (*it)->AdvanceFrame(delta_time);
-    if ((*it)->IsFinished()) {
-      inactive_particle_list_.push_back(*it);
-      it = particle_list_.erase(it);
+  impel::AlignedFloats& ages = channels_[kAge];
+  const int count = Count();
+  for (int i = 0; i < count; ++i) {
+    ages[i] += delta_time;
+  }
+
+  // Removing a particle moves the last one into slot i, so look at slot i
+  // again.
+  const impel::AlignedFloats& durations = channels_[kDuration];
+  for (int i = 0; i < Count(); ) {
+    if (ages[i] >= durations[i]) {
+      Remove(i);
     } else {
-      ++it;
+      ++i;
     }
   }
 }
 
-Particle* ParticleManager::CreateParticle() {
-  Particle* result;
-  if (inactive_particle_list_.size() > 0) {
-    result = inactive_particle_list_.back();
-    inactive_particle_list_.pop_back();
+bool ParticleManager::AddParticle(const Particle& particle) {
+  if (Full())
+    return false;
+
+  const mathfu::vec3 position = particle.base_position();
+  const mathfu::vec3 velocity = particle.base_velocity();
+  const mathfu::vec3 acceleration = particle.acceleration();
+  const TimeStep fade = particle.duration_of_fade_out();
+  const TimeStep shrink = particle.duration_of_shrink_out();
+  channels_[kBasePositionX].push_back(position.x());
+  channels_[kBasePositionY].push_back(position.y());
+  channels_[kBasePositionZ].push_back(position.z());
+  channels_[kBaseVelocityX].push_back(velocity.x());
+  channels_[kBaseVelocityY].push_back(velocity.y());
+  channels_[kBaseVelocityZ].push_back(velocity.z());
+  channels_[kAccelerationX].push_back(acceleration.x());
+  channels_[kAccelerationY].push_back(acceleration.y());
+  channels_[kAccelerationZ].push_back(acceleration.z());
+  channels_[kAge].push_back(0.0f);
+  channels_[kDuration].push_back(particle.duration());
+  channels_[kDurationOfFadeOut].push_back(fade);
+  channels_[kDurationOfShrinkOut].push_back(shrink);
+  // A zero duration never fades, so its rate is never used.
+  channels_[kFadeOutRate].push_back(fade > 0.0f ? 1.0f / fade : 0.0f);
+  channels_[kShrinkOutRate].push_back(shrink > 0.0f ? 1.0f / shrink : 0.0f);
+  base_orientations_.push_back(particle.base_orientation());
+  rotational_velocities_.push_back(particle.rotational_velocity());
+  base_scales_.push_back(particle.base_scale());
+  base_tints_.push_back(particle.base_tint());
+  renderable_ids_.push_back(particle.renderable_id());
+  return true;
+}
+
+// A burst being spawned, shared by the jobs that fill it in.
+struct ParticleManager::SpawnRange {
+  ParticleManager* manager;
+  const ParticleSpawnDef* def;
+  mathfu::vec3 position;
+  mathfu::vec4 tint;
+  uint32_t seed;
+  int first;
+};
+
+int ParticleManager::SpawnParticles(const ParticleSpawnDef& def,
+                                    const mathfu::vec3& position,
+                                    const mathfu::vec4& tint, uint32_t seed,
+                                    int count, JobSystem* jobs) {
+  const int first = Count();
+  const int spawned = std::min(count, kMaxParticles - first);
+  if (spawned <= 0)
+    return 0;
+
+  // Reserve every slot up front. The arrays have room for kMaxParticles, so
+  // they don't move while the jobs fill them in.
+  const size_t size = static_cast<size_t>(first + spawned);
+  for (int c = 0; c < kNumChannels; ++c) {
+    channels_[c].resize(size);
+  }
+  base_orientations_.resize(size);
+  rotational_velocities_.resize(size);
+  base_scales_.resize(size);
+  base_tints_.resize(size);
+  renderable_ids_.resize(size);
+
+  SpawnRange range = { this, &def, position, tint, seed, first };
+  if (jobs != nullptr && spawned > kSpawnGrain) {
+    jobs->ParallelFor("SpawnParticles", 0, spawned, kSpawnGrain,
+                      FillSpawnRange, &range);
   } else {
-    if (particle_list_.size() >= kMaxParticles) {
-      return nullptr;
+    for (int begin = 0; begin < spawned; begin += kSpawnGrain) {
+      FillSpawned(range, begin, std::min(begin + kSpawnGrain, spawned));
     }
-    result = new Particle();
   }
-  result->set_age(0);
-  particle_list_.push_back(result);
-  return result;
+  return spawned;
+}
+
+void ParticleManager::FillSpawnRange(void* context, int begin, int end) {
+  const SpawnRange& range = *static_cast<const SpawnRange*>(context);
+  range.manager->FillSpawned(range, begin, end);
+}
+
+void ParticleManager::FillSpawned(const SpawnRange& range, int begin,
+                                  int end) {
+  const ParticleSpawnDef& def = *range.def;
+  Rng rng((static_cast<uint64_t>(range.seed) << 32) |
+          static_cast<uint64_t>(begin / kSpawnGrain));
+  const int start = range.first + begin;
+  const int count = end - begin;
+
+  // The channels, one property at a time.
+  for (int axis = 0; axis < 3; ++axis) {
+    FillUniform(&rng, range.position[axis] + def.min_position_offset[axis],
+                def.max_position_offset[axis] - def.min_position_offset[axis],
+                &channels_[kBasePositionX + axis][start], count);
+    FillUniform(&rng, def.min_velocity[axis],
+                def.max_velocity[axis] - def.min_velocity[axis],
+                &channels_[kBaseVelocityX + axis][start], count);
+    std::fill_n(&channels_[kAccelerationX + axis][start], count,
+                def.acceleration[axis]);
+  }
+  std::fill_n(&channels_[kAge][start], count, 0.0f);
+  float* durations = &channels_[kDuration][start];
+  for (int i = 0; i < count; ++i) {
+    durations[i] = static_cast<TimeStep>(
+        rng.IntInRange(def.min_duration, def.max_duration));
+  }
+  std::fill_n(&channels_[kDurationOfFadeOut][start], count,
+              def.fade_duration);
+  std::fill_n(&channels_[kDurationOfShrinkOut][start], count,
+              def.shrink_duration);
+  // A zero duration never fades, so its rate is never used.
+  std::fill_n(&channels_[kFadeOutRate][start], count,
+              def.fade_duration > 0.0f ? 1.0f / def.fade_duration : 0.0f);
+  std::fill_n(&channels_[kShrinkOutRate][start], count,
+              def.shrink_duration > 0.0f ? 1.0f / def.shrink_duration : 0.0f);
+
+  // The per-particle vectors.
+  for (int i = start; i < start + count; ++i) {
+    base_scales_[i] = RandomScale(&rng, def);
+  }
+  for (int i = start; i < start + count; ++i) {
+    base_orientations_[i] = RandomInRange(&rng, def.min_orientation_offset,
+                                          def.max_orientation_offset);
+  }
+  for (int i = start; i < start + count; ++i) {
+    rotational_velocities_[i] = RandomInRange(&rng, def.min_angular_velocity,
+                                              def.max_angular_velocity);
+  }
+  for (int i = start; i < start + count; ++i) {
+    base_tints_[i] = RandomTint(&rng, def, range.tint);
+  }
+  for (int i = start; i < start + count; ++i) {
+    renderable_ids_[i] = RandomRenderableId(&rng, def);
+  }
+}
+
+void ParticleManager::Remove(int i) {
+  const int last = Count() - 1;
+  if (i != last) {
+    for (int c = 0; c < kNumChannels; ++c) {
+      channels_[c][i] = channels_[c][last];
+    }
+    base_orientations_[i] = base_orientations_[last];
+    rotational_velocities_[i] = rotational_velocities_[last];
+    base_scales_[i] = base_scales_[last];
+    base_tints_[i] = base_tints_[last];
+    renderable_ids_[i] = renderable_ids_[last];
+  }
+  for (int c = 0; c < kNumChannels; ++c) {
+    channels_[c].pop_back();
+  }
+  base_orientations_.pop_back();
+  rotational_velocities_.pop_back();
+  base_scales_.pop_back();
+  base_tints_.pop_back();
+  renderable_ids_.pop_back();
 }
 
 void ParticleManager::RemoveAllParticles() {
-  for (auto it = particle_list_.begin(); it != particle_list_.end(); ) {
-      inactive_particle_list_.push_back(*it);
-      it = particle_list_.erase(it);
+  for (int c = 0; c < kNumChannels; ++c) {
+    channels_[c].clear();
   }
+  base_orientations_.clear();
+  rotational_velocities_.clear();
+  base_scales_.clear();
+  base_tints_.clear();
+  renderable_ids_.clear();
 }
 
 
@@ -17,29 +17,26 @@
 #define PARTICLES_H
 
 #include "common.h"
+#include "impel_simd.h"
+#include "memory_tracker.h"
 #include "scene_description.h"
-#include <list>
+#include <vector>
 
 namespace fpl {
+
+class JobSystem;
 namespace pie_noon {
 
 typedef float TimeStep;
 
+// The initial state of a particle. Filled in by the caller and handed to
+// ParticleManager::AddParticle(), which copies it into the pool.
 class Particle {
  public:
   Particle() { reset(); }
 
   void reset();
 
-  mathfu::vec3 CurrentPosition() const;
-  mathfu::vec3 CurrentVelocity() const;
-  Quat CurrentOrientation() const;
-  mathfu::vec4 CurrentTint() const;
-  mathfu::vec3 CurrentScale() const;
-  TimeStep DurationRemaining() const;
-
-  void SetDurationRemaining(TimeStep duration);
-
   mathfu::vec3 base_position() const { return base_position_; }
 
   void set_base_position(const mathfu::vec3& base_position) {
@@ -94,17 +91,6 @@ class Particle {
     duration_ = duration;
   }
 
-  TimeStep age() const { return age_; }
-  void set_age(TimeStep age) {
-    age_ = age;
-  }
-
-  // Generate the matrix we'll need to draw it:
-  mathfu::mat4 CalculateMatrix() const;
-
-  void AdvanceFrame(TimeStep delta_time);
-  bool IsFinished() const;
-
  private:
   mathfu::vec3 base_position_;
   mathfu::vec3 base_velocity_;
@@ -120,9 +106,6 @@ class Particle {
   // How long the particle will last, in milliseconds.
   TimeStep duration_;
 
-  // How long the particle has been alive so far, in milliseconds
-  TimeStep age_;
-
   // How long it will take the particle to fade or shrink away, when it reaches
   // the end of its life span.  (In milliseconds)
   TimeStep duration_of_fade_out_;
@@ -132,28 +115,167 @@ class Particle {
   uint16_t renderable_id_;
 };
 
+// The ranges that the particles of a burst are drawn from. Decoded once from
+// a ParticleDef, so that spawning doesn't read flatbuffers per particle.
+struct ParticleSpawnDef {
+  ParticleSpawnDef();
+
+  mathfu::vec3 min_scale;
+  mathfu::vec3 max_scale;
+  // Scale every axis by the same random amount, from the x range.
+  bool preserve_aspect;
+  mathfu::vec3 min_velocity;
+  mathfu::vec3 max_velocity;
+  mathfu::vec3 acceleration;
+  mathfu::vec3 min_position_offset;
+  mathfu::vec3 max_position_offset;
+  mathfu::vec3 min_orientation_offset;
+  mathfu::vec3 max_orientation_offset;
+  mathfu::vec3 min_angular_velocity;
+  mathfu::vec3 max_angular_velocity;
+  // Durations are uniform in [min_duration, max_duration).
+  int min_duration;
+  int max_duration;
+  TimeStep fade_duration;
+  TimeStep shrink_duration;
+  // Each particle picks one of each at random. Neither may be empty.
+  std::vector<uint16_t> renderable_ids;
+  std::vector<mathfu::vec4> tints;
+};
+
+// A particle whose motion is evaluated entirely on the GPU, from the time it
+// was spawned. See GpuParticles.
+struct GpuParticleSpawn {
+  Particle particle;
+  WorldTime spawn_time;
+};
+
+// Fill in 'count' particles at 'position', spawned at 'spawn_time', drawn
+// from 'def' with an Rng seeded with 'seed', and with the def's tints
+// multiplied by 'tint'.
+void GenerateGpuParticleSpawns(const ParticleSpawnDef& def,
+                               const mathfu::vec3& position,
+                               const mathfu::vec4& tint, uint32_t seed,
+                               WorldTime spawn_time, int count,
+                               GpuParticleSpawn* spawns);
+
+// A fixed-size pool of live particles. Each property is stored in its own
+// array, so updates touch only the data they need. Particles are addressed
+// by index, from 0 to Count() - 1. When a particle dies, the last particle
+// is moved into its slot, so indices are only valid until the next
+// AdvanceFrame() or RemoveAllParticles().
 class ParticleManager {
  public:
+  // No more than this many particles can be alive at once.
+  static const int kMaxParticles = 1000;
+
+  ParticleManager();
+
+  // Age every particle, and remove those that have reached their duration.
   void AdvanceFrame(TimeStep delta_time);
 
-  const std::list<Particle*>& get_particle_list() const {
-    return particle_list_;
-  }
+  // Bursts of more particles than this are spread over the JobSystem.
+  static const int kSpawnGrain = 128;
 
-  // Returns a pointer to a new particle, ready to be populated.
-  // Note that this pointer is not guaranteed to be valid indefinitely!
-  // Also note that the initial state of the particle is undetermined, so
-  // users should either populate every field explicitly, or call
-  // Particle::reset().
-  Particle *CreateParticle();
+  // Copy 'particle' into the pool, with an age of 0. Returns false if the
+  // pool is full, in which case the particle is dropped.
+  bool AddParticle(const Particle& particle);
+
+  // Spawn up to 'count' particles at 'position', from the same ranges as
+  // GenerateGpuParticleSpawns(), but straight into the pool. The slots are
+  // all reserved at once, then each property is filled for the whole burst
+  // in its own loop. Each kSpawnGrain particles draw from their own Rng,
+  // seeded from 'seed' and their index, so the grains can be filled in
+  // parallel on 'jobs' and the results don't depend on the number of
+  // workers. 'jobs' may be null. Returns the number spawned, which is less
+  // than 'count' if the pool fills up.
+  int SpawnParticles(const ParticleSpawnDef& def,
+                     const mathfu::vec3& position, const mathfu::vec4& tint,
+                     uint32_t seed, int count, JobSystem* jobs);
+
+  // True when AddParticle() would fail.
+  bool Full() const { return Count() >= kMaxParticles; }
 
   // Removes all active particles.
   void RemoveAllParticles();
 
- private:
+  int Count() const { return static_cast<int>(renderable_ids_.size()); }
 
-  std::list<Particle*> particle_list_;
-  std::list<Particle*> inactive_particle_list_;
+  uint16_t renderable_id(int i) const { return renderable_ids_[i]; }
+  TimeStep age(int i) const { return channels_[kAge][i]; }
+  TimeStep duration(int i) const { return channels_[kDuration][i]; }
+
+  mathfu::vec3 CurrentPosition(int i) const;
+  mathfu::vec3 CurrentVelocity(int i) const;
+  Quat CurrentOrientation(int i) const;
+  mathfu::vec4 CurrentTint(int i) const;
+  mathfu::vec3 CurrentScale(int i) const;
+  TimeStep DurationRemaining(int i) const {
+    return channels_[kDuration][i] - channels_[kAge][i];
+  }
+
+  // Generate the matrix we'll need to draw particle 'i'.
+  mathfu::mat4 CalculateMatrix(int i) const;
+
+  // Write the world matrix and tint of every particle to 'matrices' and
+  // 'tints', which must have room for Count() entries. Same results as
+  // CalculateMatrix() and CurrentTint(), but the motion, fade-out and
+  // shrink-out are evaluated for several particles per SIMD operation.
+  void ComputeTransforms(mathfu::mat4* matrices, mathfu::vec4* tints) const;
+
+ private:
+  // The per-particle floats, each in its own SIMD-aligned array.
+  enum Channel {
+    kBasePositionX,
+    kBasePositionY,
+    kBasePositionZ,
+    kBaseVelocityX,
+    kBaseVelocityY,
+    kBaseVelocityZ,
+    kAccelerationX,
+    kAccelerationY,
+    kAccelerationZ,
+    kAge,
+    kDuration,
+    kDurationOfFadeOut,
+    kDurationOfShrinkOut,
+    // 1 / kDurationOfFadeOut and 1 / kDurationOfShrinkOut, so that the fade
+    // and shrink factors are a multiply.
+    kFadeOutRate,
+    kShrinkOutRate,
+    kNumChannels
+  };
+
+  // Remove particle 'i' by moving the last particle into its slot.
+  void Remove(int i);
+
+  // Fill particles [first + begin, first + end) of a burst started by
+  // SpawnParticles(), where 'first' was the first slot of the burst.
+  struct SpawnRange;
+  static void FillSpawnRange(void* context, int begin, int end);
+  void FillSpawned(const SpawnRange& range, int begin, int end);
+
+  // Fraction of the base tint or scale remaining, given the time remaining
+  // and one of the fade or shrink-out channels.
+  float FadeFactor(int i, Channel duration, Channel rate) const;
+
+  // Assemble the matrix of particle 'i' from its current position and
+  // shrink factor.
+  mathfu::mat4 MatrixFromPosition(int i, float x, float y, float z,
+                                  float shrink) const;
+
+  impel::AlignedFloats channels_[kNumChannels];
+
+  // Orientation and appearance are only needed per particle, when the
+  // matrix and tint are built, so they are kept as vectors.
+  std::vector<mathfu::vec3> base_orientations_;
+  std::vector<mathfu::vec3> rotational_velocities_;
+  std::vector<mathfu::vec3> base_scales_;
+  std::vector<mathfu::vec4> base_tints_;
+  std::vector<uint16_t> renderable_ids_;
+
+  // Counts the arrays above, which are allocated up front.
+  TrackedMemory memory_;
 };
 
 }  // pie_noon
@@ -13,17 +13,27 @@
 // limitations under the License.
 
 #include "precompiled.h"
+#include "affine_transform.h"
 #include "angle.h"
+#include "asset_archive.h"
 #include "audio_config_generated.h"
 #include "audio_engine.h"
+#include "cardboard_meshes_generated.h"
 #include "character_state_machine.h"
 #include "character_state_machine_def_generated.h"
 #include "config_generated.h"
-#include "impel_flatbuffers.h"
+#include "fixed_step.h"
+#include "frame_profiler.h"
+#include "frustum.h"
+#include "gl_stats.h"
 #include "impel_processor_overshoot.h"
 #include "impel_processor_smooth.h"
+#include "impel_processor_smooth_fixed.h"
+#include "memory_tracker.h"
 #include "pie_noon_common_generated.h"
 #include "pie_noon_game.h"
+#include "replay_benchmark.h"
+#include "startup_trace.h"
 #include "timeline_generated.h"
 #include "touchscreen_controller.h"
 #include "utilities.h"
@@ -47,10 +57,54 @@ static const unsigned short kQuadIndices[] = { 0, 1, 2, 2, 1, 3 };
 static const Attribute kQuadMeshFormat[] =
     { kPosition3f, kTexCoord2f, kNormal3f, kTangent4f, kEND };
 
+// Room in the streamed quad buffer. The HUD has a few dozen quads, and the
+// buffer is reused from the start when it fills.
+static const int kMaxBatchedQuads = 512;
+
 static const char kAssetsDir[] = "assets";
 
 static const char kConfigFileName[] = "config.bin";
 
+// The cardboard quads, baked by build_assets.py. Optional; without it the
+// quads are built at startup.
+static const char kCardboardMeshesFileName[] = "cardboard_meshes.bin";
+
+// Format of kCardboardMeshesFileName. Must match CARDBOARD_MESHES_VERSION in
+// build_assets.py.
+static const uint32_t kCardboardMeshesVersion = 1;
+
+// 64-bit FNV-1a, as build_assets.py hashes config.bin.
+static uint64_t HashBytes(const uint8_t* data, size_t size) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ data[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+// The archives that build_assets.py packs with --archives. Each is optional;
+// files not in one are loaded from the assets directory.
+static const char* kAssetArchives[] = {
+  "data.pak", "textures.pak", "sounds.pak"
+};
+
+// Identify the writable directory that SDL_GetPrefPath() returns, where
+// caches are kept.
+static const char kPreferencesOrganization[] = "Google";
+static const char kPreferencesApplication[] = "PieNoon";
+
+// Written to the SDL_GetPrefPath() directory when config.startup_trace is
+// set.
+static const char kStartupTraceFileName[] = "startup_trace.json";
+
+// Written to the SDL_GetPrefPath() directory when the frame profiler is
+// asked for a trace.
+static const char kFrameTraceFileName[] = "frame_trace.json";
+
+// Written to the SDL_GetPrefPath() directory when the config names a replay
+// to benchmark.
+static const char kBenchmarkResultsFileName[] = "benchmark_results.txt";
+
 #ifdef __ANDROID__
 static const int kAndroidMaxScreenWidth = 1920;
 static const int kAndroidMaxScreenHeight = 1080;
@@ -63,6 +117,26 @@ static inline WorldTime CurrentWorldTime() {
   return SDL_GetTicks();
 }
 
+// Seconds since an arbitrary point, with the best precision available.
+static double HighResolutionSeconds() {
+  return static_cast<double>(SDL_GetPerformanceCounter()) /
+         static_cast<double>(SDL_GetPerformanceFrequency());
+}
+
+// Sleep for 'seconds', more precisely than SDL_Delay() alone. SDL_Delay()
+// sleeps for whole milliseconds and may oversleep, so sleep until shortly
+// before the time, and yield the rest away.
+static void SleepPrecisely(double seconds) {
+  static const double kSpinTime = 0.0015;
+  const double end = HighResolutionSeconds() + seconds;
+  if (seconds > kSpinTime) {
+    SDL_Delay(static_cast<Uint32>((seconds - kSpinTime) * 1000.0));
+  }
+  while (HighResolutionSeconds() < end) {
+    SDL_Delay(0);
+  }
+}
+
 static inline const UiGroup* TitleScreenButtons(const Config& config) {
 #ifdef __ANDROID__
   return config.title_screen_buttons_android();
@@ -87,21 +161,48 @@ PieNoonGame::PieNoonGame()
       matman_(renderer_),
       cardboard_fronts_(RenderableId_Count, nullptr),
       cardboard_backs_(RenderableId_Count, nullptr),
+      cardboard_front_quads_(RenderableId_Count),
+      cardboard_bounds_(RenderableId_Count, mathfu::kZeros4f),
       stick_front_(nullptr),
       stick_back_(nullptr),
+      cardboard_mesh_pool_(renderer_, sizeof(NormalMappedVertex),
+                           kQuadMeshFormat),
       shader_lit_textured_normal_(nullptr),
       shader_simple_shadow_(nullptr),
       shader_textured_(nullptr),
       shader_grayscale_(nullptr),
+      shader_particle_(nullptr),
+      shader_color_(nullptr),
+      shader_cardboard_instanced_(nullptr),
+      shader_textured_instanced_(nullptr),
+      shader_textured_opaque_(nullptr),
+      shader_cardboard_overlay_(nullptr),
+      overlay_transform_uniform_(-1),
       shadow_mat_(nullptr),
+      ground_material_(kInvalidAssetHandle),
+      loading_material_(kInvalidAssetHandle),
+      loading_logo_(kInvalidAssetHandle),
+      cardboard_instance_vbo_(0),
+      scene_to_draw_(0),
+      simulate_delta_time_(0),
       prev_world_time_(0),
+      fixed_update_remainder_(0),
+      render_interpolation_(1.0f),
+      replaying_(false),
+      benchmark_offscreen_(false),
+      match_frame_(0),
       debug_previous_states_(),
       full_screen_fader_(&renderer_),
       fade_exit_state_(kUninitialized),
       ambience_channel_(AudioEngine::kInvalidChannel),
       stinger_channel_(AudioEngine::kInvalidChannel),
-      next_achievement_index_(0) {
+      next_achievement_index_(0),
+      flatbuffer_memory_(kMemoryFlatbuffers),
+      scene_memory_(kMemoryScene) {
   version_ = kVersion;
+# ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+  logged_in_preference_ = -1;
+# endif
 }
 
 PieNoonGame::~PieNoonGame() {
@@ -118,13 +219,23 @@ PieNoonGame::~PieNoonGame() {
 
   delete stick_back_;
   stick_back_ = nullptr;
+
+  if (cardboard_instance_vbo_ != 0) {
+    renderer_.DeleteBuffer(cardboard_instance_vbo_);
+  }
+  renderer_.DeleteRenderTarget(&scene_target_);
+  for (size_t i = 0; i < splatter_overlays_.size(); ++i) {
+    renderer_.DeleteRenderTarget(&splatter_overlays_[i]);
+  }
 }
 
 bool PieNoonGame::InitializeConfig() {
-  if (!LoadFile(kConfigFileName, &config_source_)) {
+  if (!config_file_.Open(kConfigFileName)) {
     SDL_LogError(SDL_LOG_CATEGORY_ERROR, "can't load config.bin\n");
     return false;
   }
+  runtime_config_.Initialize(GetConfig());
+  flatbuffer_memory_.Set(config_file_.size());
   return true;
 }
 
@@ -146,6 +257,26 @@ bool PieNoonGame::InitializeRenderer() {
             renderer_.last_error().c_str());
     return false;
   }
+  if (benchmark_offscreen_) {
+    renderer_.HideWindow();
+  }
+
+  if (config.shader_cache() && renderer_.SupportsProgramBinaries()) {
+    char* pref_path = SDL_GetPrefPath(kPreferencesOrganization,
+                                      kPreferencesApplication);
+    if (pref_path) {
+      renderer_.set_shader_cache_dir(pref_path);
+      SDL_free(pref_path);
+    }
+  }
+
+  renderer_.gpu_profiler().Enable(config.gpu_profiler());
+  if (config.gpu_profiler() && !renderer_.gpu_profiler().enabled()) {
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "GPU profiler unavailable: no timer queries\n");
+  }
+  // Benchmarks report the draw calls.
+  EnableGLStats(config.gl_stats() || benchmarking());
 
   renderer_.color() = mathfu::kOnes4f;
   // Initialize the first frame as black.
@@ -157,6 +288,7 @@ bool PieNoonGame::InitializeRenderer() {
 // 'vertices' must be an array of length kQuadNumVertices.
 static void CreateVerticalQuad(const vec3& offset, const vec2& geo_size,
                                const vec2& texture_coord_size,
+                               const Material& material,
                                NormalMappedVertex* vertices) {
   const float half_width = geo_size[0] * 0.5f;
   const vec3 bottom_left = offset + vec3(-half_width, 0.0f, 0.0f);
@@ -172,10 +304,13 @@ static void CreateVerticalQuad(const vec3& offset, const vec2& geo_size,
   const vec2 coord_top_right(0.5f + coord_half_width,
                              1.0f - texture_coord_size[1]);
 
-  vertices[0].tc = coord_bottom_left;
-  vertices[1].tc = vec2(coord_top_right[0], coord_bottom_left[1]);
-  vertices[2].tc = vec2(coord_bottom_left[0], coord_top_right[1]);
-  vertices[3].tc = coord_top_right;
+  // When the material is part of an atlas, use only its part.
+  vertices[0].tc = material.MapTextureCoord(coord_bottom_left);
+  vertices[1].tc = material.MapTextureCoord(
+      vec2(coord_top_right[0], coord_bottom_left[1]));
+  vertices[2].tc = material.MapTextureCoord(
+      vec2(coord_bottom_left[0], coord_top_right[1]));
+  vertices[3].tc = material.MapTextureCoord(coord_top_right);
 
   Mesh::ComputeNormalsTangents(vertices, &kQuadIndices[0], kQuadNumVertices,
                                kQuadNumIndices);
@@ -184,10 +319,13 @@ static void CreateVerticalQuad(const vec3& offset, const vec2& geo_size,
 // Creates a mesh of a single quad (two triangles) vertically upright.
 // The quad's has x and y size determined by the size of the texture.
 // The quad is offset in (x,y,z) space by the 'offset' variable.
+// The mesh is added to cardboard_mesh_pool_, which must not be finalized.
+// If 'quad' isn't null, a copy of the quad is written to it.
 // Returns a mesh with the quad and texture, or nullptr if anything went wrong.
 Mesh* PieNoonGame::CreateVerticalQuadMesh(
     const flatbuffers::String* material_name, const vec3& offset,
-    const vec2& pixel_bounds, float pixel_to_world_scale) {
+    const vec2& pixel_bounds, float pixel_to_world_scale,
+    CardboardQuad* quad) {
 
   // Don't try to load obviously invalid materials. Suppresses error logs from
   // the material manager.
@@ -211,15 +349,94 @@ Mesh* PieNoonGame::CreateVerticalQuadMesh(
 
   // Initialize a vertex array in the requested position.
   NormalMappedVertex vertices[kQuadNumVertices];
-  CreateVerticalQuad(offset, geo_size, texture_coord_size, vertices);
+  CreateVerticalQuad(offset, geo_size, texture_coord_size, *material,
+                     vertices);
+  if (quad != nullptr) {
+    for (int i = 0; i < kQuadNumVertices; ++i) {
+      quad->corners[i] = vec3(vertices[i].pos);
+      quad->tex_coords[i] = vec2(vertices[i].tc);
+    }
+  }
 
   // Create mesh and add in quad indices.
-  Mesh* mesh = new Mesh(vertices, kQuadNumVertices, sizeof(NormalMappedVertex),
-                        kQuadMeshFormat);
+  Mesh* mesh = new Mesh(&cardboard_mesh_pool_, vertices, kQuadNumVertices);
   mesh->AddIndices(kQuadIndices, kQuadNumIndices, material);
   return mesh;
 }
 
+static_assert(sizeof(BakedVertex) == sizeof(NormalMappedVertex),
+              "BakedVertex must match NormalMappedVertex");
+
+// Same as CreateVerticalQuadMesh(), but with the quad that build_assets.py
+// baked. The vertices are uploaded as they are in the file.
+Mesh* PieNoonGame::CreateBakedQuadMesh(const BakedQuad* baked,
+                                       CardboardQuad* quad) {
+  if (baked == nullptr || baked->vertices() == nullptr ||
+      baked->vertices()->Length() != kQuadNumVertices ||
+      baked->indices() == nullptr || baked->material() == nullptr)
+    return nullptr;
+
+  Material* material = matman_.LoadMaterial(baked->material()->c_str());
+  bool material_valid = material != nullptr && material->textures().size() > 0;
+  if (!material_valid)
+    return nullptr;
+
+  const NormalMappedVertex* vertices =
+      reinterpret_cast<const NormalMappedVertex*>(baked->vertices()->Data());
+  if (quad != nullptr) {
+    for (int i = 0; i < kQuadNumVertices; ++i) {
+      quad->corners[i] = vec3(vertices[i].pos);
+      quad->tex_coords[i] = vec2(vertices[i].tc);
+    }
+  }
+
+  Mesh* mesh = new Mesh(&cardboard_mesh_pool_, vertices, kQuadNumVertices);
+  mesh->AddIndices(baked->indices()->Data(),
+                   static_cast<int>(baked->indices()->Length()), material);
+  return mesh;
+}
+
+// Map the baked cardboard meshes into 'file'. Returns nullptr if there are
+// none, or they don't match the config.
+const CardboardMeshes* PieNoonGame::LoadBakedCardboardMeshes(
+    MappedFile* file) const {
+  if (!file->OpenOptional(kCardboardMeshesFileName))
+    return nullptr;
+
+  flatbuffers::Verifier verifier(file->data(), file->size());
+  if (!VerifyCardboardMeshesBuffer(verifier)) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "%s is invalid.\n",
+                 kCardboardMeshesFileName);
+    return nullptr;
+  }
+  const CardboardMeshes* meshes = GetCardboardMeshes(file->data());
+  if (meshes->version() != kCardboardMeshesVersion ||
+      meshes->config_hash() !=
+          HashBytes(config_file_.data(), config_file_.size()) ||
+      meshes->fronts() == nullptr || meshes->backs() == nullptr ||
+      meshes->fronts()->Length() != RenderableId_Count ||
+      meshes->backs()->Length() != RenderableId_Count) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR,
+                 "%s is out of date. Run build_assets.py.\n",
+                 kCardboardMeshesFileName);
+    return nullptr;
+  }
+  return meshes;
+}
+
+// Sphere around the box that holds the 'num_points' 'points'.
+// Returns (center, radius).
+static vec4 BoundingSphere(const vec3* points, int num_points) {
+  vec3 min = points[0];
+  vec3 max = points[0];
+  for (int i = 1; i < num_points; ++i) {
+    min = vec3::Min(min, points[i]);
+    max = vec3::Max(max, points[i]);
+  }
+  const vec3 center = (min + max) * 0.5f;
+  return vec4(center, (max - center).Length());
+}
+
 // Load textures for cardboard into 'materials_'. The 'renderer_' and 'matman_'
 // members have been initialized at this point.
 bool PieNoonGame::InitializeRenderingAssets() {
@@ -234,13 +451,54 @@ bool PieNoonGame::InitializeRenderingAssets() {
     return false;
   }
 
-  // Force these textures to be queued up first, since we want to use them for
+  // Load these textures ahead of the rest, since we want to use them for
   // the loading screen.
-  matman_.LoadMaterial(config.loading_material()->c_str());
-  matman_.LoadMaterial(config.loading_logo()->c_str());
-  matman_.LoadMaterial(config.fade_material()->c_str());
+  loading_material_ =
+      matman_.MaterialHandle(config.loading_material()->c_str());
+  loading_logo_ = matman_.MaterialHandle(config.loading_logo()->c_str());
+  // These are drawn whenever anything is loading, so keep them resident.
+  matman_.PinMaterial(
+      matman_.LoadMaterial(loading_material_, AsyncLoader::kHighPriority));
+  matman_.PinMaterial(
+      matman_.LoadMaterial(loading_logo_, AsyncLoader::kHighPriority));
+  matman_.PinMaterial(matman_.LoadMaterial(config.fade_material()->c_str(),
+                                           AsyncLoader::kHighPriority));
+
+  gpu_particles_.Initialize(&renderer_, RenderableId_Count,
+                            config.gpu_particle_capacity());
+  quad_batch_.Initialize(&renderer_, kMaxBatchedQuads);
+
+  // Create a mesh for the front and back of each cardboard cutout. Use the
+  // baked meshes, if there are any. Otherwise build them.
+  MappedFile baked_file;
+  const CardboardMeshes* baked = LoadBakedCardboardMeshes(&baked_file);
+
+  // Create stick front and back meshes. They go in every renderable's
+  // bounds, since which renderables have a stick can change at run time.
+  CardboardQuad stick_front_quad;
+  CardboardQuad stick_back_quad;
+  const vec3 stick_front_offset(0.0f, config.stick_y_offset(),
+                                config.stick_front_z_offset());
+  const vec3 stick_back_offset(0.0f, config.stick_y_offset(),
+                               config.stick_back_z_offset());
+  if (baked != nullptr) {
+    stick_front_ = CreateBakedQuadMesh(baked->stick_front(),
+                                       &stick_front_quad);
+    stick_back_ = CreateBakedQuadMesh(baked->stick_back(), &stick_back_quad);
+  } else {
+    stick_front_ = CreateVerticalQuadMesh(config.stick_front(),
+                                          stick_front_offset,
+                                          LoadVec2(config.stick_bounds()),
+                                          config.pixel_to_world_scale(),
+                                          &stick_front_quad);
+    stick_back_ = CreateVerticalQuadMesh(config.stick_back(),
+                                         stick_back_offset,
+                                         LoadVec2(config.stick_bounds()),
+                                         config.pixel_to_world_scale(),
+                                         &stick_back_quad);
+  }
 
-  // Create a mesh for the front and back of each cardboard cutout.
+  const bool has_stick = stick_front_ != nullptr && stick_back_ != nullptr;
   const vec3 front_z_offset(0.0f, 0.0f, config.cardboard_front_z_offset());
   const vec3 back_z_offset(0.0f, 0.0f, config.cardboard_back_z_offset());
   for (int id = 0; id < RenderableId_Count; ++id) {
@@ -255,13 +513,51 @@ bool PieNoonGame::InitializeRenderingAssets() {
     const float pixel_to_world_scale = renderable->geometry_scale() *
                                        config.pixel_to_world_scale();
 
-    cardboard_fronts_[id] = CreateVerticalQuadMesh(
-        renderable->cardboard_front(), front_offset, pixel_bounds,
-        pixel_to_world_scale);
+    CardboardQuad back_quad;
+    if (baked != nullptr) {
+      cardboard_fronts_[id] = CreateBakedQuadMesh(
+          baked->fronts()->Get(id), &cardboard_front_quads_[id]);
+      cardboard_backs_[id] = CreateBakedQuadMesh(
+          baked->backs()->Get(id), &back_quad);
+    } else {
+      cardboard_fronts_[id] = CreateVerticalQuadMesh(
+          renderable->cardboard_front(), front_offset, pixel_bounds,
+          pixel_to_world_scale, &cardboard_front_quads_[id]);
+      cardboard_backs_[id] = CreateVerticalQuadMesh(
+          renderable->cardboard_back(), back_offset, pixel_bounds,
+          pixel_to_world_scale, &back_quad);
+    }
+
+    // Bound the front, back and stick, for culling.
+    if (cardboard_fronts_[id] != nullptr) {
+      const CardboardQuad* quads[] = {
+        &cardboard_front_quads_[id],
+        cardboard_backs_[id] != nullptr ? &back_quad : nullptr,
+        has_stick ? &stick_front_quad : nullptr,
+        has_stick ? &stick_back_quad : nullptr,
+      };
+      vec3 points[kQuadNumVertices * 4];
+      int num_points = 0;
+      for (size_t q = 0; q < sizeof(quads) / sizeof(quads[0]); ++q) {
+        if (quads[q] == nullptr) continue;
+        for (int j = 0; j < kQuadNumVertices; ++j) {
+          points[num_points++] = quads[q]->corners[j];
+        }
+      }
+      cardboard_bounds_[id] = BoundingSphere(points, num_points);
+    }
 
-    cardboard_backs_[id] = CreateVerticalQuadMesh(
-        renderable->cardboard_back(), back_offset, pixel_bounds,
-        pixel_to_world_scale);
+    // GPU particles are drawn with the same quad as the cardboard front.
+    // Its first corner is the bottom left, and its last the top right.
+    if (config.gpu_particles() && cardboard_fronts_[id] != nullptr) {
+      const CardboardQuad& front_quad = cardboard_front_quads_[id];
+      const vec3 geo_size =
+          front_quad.corners[kQuadNumVertices - 1] - front_quad.corners[0];
+      gpu_particles_.SetQuad(
+          id, cardboard_fronts_[id]->GetMaterial(0), front_quad.corners[0],
+          vec2(geo_size.x(), geo_size.y()), front_quad.tex_coords[0],
+          front_quad.tex_coords[kQuadNumVertices - 1]);
+    }
   }
 
   // We default to the invalid texture, so it has to exist.
@@ -270,36 +566,73 @@ bool PieNoonGame::InitializeRenderingAssets() {
     return false;
   }
 
-  // Create stick front and back meshes.
-  const vec3 stick_front_offset(0.0f, config.stick_y_offset(),
-                                config.stick_front_z_offset());
-  const vec3 stick_back_offset(0.0f, config.stick_y_offset(),
-                               config.stick_back_z_offset());
-  stick_front_ = CreateVerticalQuadMesh(config.stick_front(),
-                                        stick_front_offset,
-                                        LoadVec2(config.stick_bounds()),
-                                        config.pixel_to_world_scale());
-  stick_back_ = CreateVerticalQuadMesh(config.stick_back(), stick_back_offset,
-                                       LoadVec2(config.stick_bounds()),
-                                       config.pixel_to_world_scale());
-
-  // Load all shaders we use:
+  // All of the cardboard geometry is in the pool now.
+  cardboard_mesh_pool_.Finalize();
+
+  // Load all shaders we use. With 16 bit textures, medium precision
+  // shading looks the same. Only what draws opaque materials can skip the
+  // alpha test.
+  const int features = renderer_.use_16bpp() ?
+                       kShaderFeatureMediumPrecision : 0;
+  const int alpha_test = features | kShaderFeatureAlphaTest;
   shader_lit_textured_normal_ =
-      matman_.LoadShader("shaders/lit_textured_normal");
-  shader_cardboard = matman_.LoadShader("shaders/cardboard");
-  shader_simple_shadow_ = matman_.LoadShader("shaders/simple_shadow");
-  shader_textured_ = matman_.LoadShader("shaders/textured");
-  shader_grayscale_ = matman_.LoadShader("shaders/grayscale");
+      matman_.LoadShader("shaders/lit_textured_normal", alpha_test);
+  shader_cardboard = matman_.LoadShader("shaders/cardboard", alpha_test);
+  shader_simple_shadow_ =
+      matman_.LoadShader("shaders/simple_shadow", features);
+  shader_textured_ = matman_.LoadShader("shaders/textured", alpha_test);
+  shader_textured_opaque_ = matman_.LoadShader("shaders/textured", features);
+  shader_grayscale_ = matman_.LoadShader("shaders/grayscale", alpha_test);
+  if (config.gpu_particles()) {
+    shader_particle_ = matman_.LoadShader("shaders/particle", alpha_test);
+    if (!shader_particle_) return false;
+  }
+  if (renderer_.gpu_profiler().enabled() || GLStatsEnabled() ||
+      config.memory_stats()) {
+    shader_color_ = matman_.LoadShader("shaders/color", features);
+    if (!shader_color_) return false;
+  }
+  if (config.bake_splatters()) {
+    shader_cardboard_overlay_ = matman_.LoadShader(
+        "shaders/cardboard", alpha_test | kShaderFeatureOverlay);
+    if (!shader_cardboard_overlay_) return false;
+    overlay_transform_uniform_ =
+        shader_cardboard_overlay_->FindUniform("overlay_transform");
+    splatter_overlays_.resize(config.splatter_map()->Length());
+  }
+  // The instanced shaders have no overlay, so baked splatters need the
+  // regular path.
+  if (config.instanced_cardboard() && !config.bake_splatters() &&
+      renderer_.SupportsInstancing()) {
+    shader_cardboard_instanced_ =
+        matman_.LoadShader("shaders/cardboard_instanced", alpha_test);
+    shader_textured_instanced_ =
+        matman_.LoadShader("shaders/textured_instanced", alpha_test);
+    if (!(shader_cardboard_instanced_ && shader_textured_instanced_))
+      return false;
+  }
   if (!(shader_lit_textured_normal_ &&
         shader_cardboard &&
         shader_simple_shadow_ &&
         shader_textured_ &&
+        shader_textured_opaque_ &&
         shader_grayscale_)) return false;
 
   // Load shadow material:
   shadow_mat_ = matman_.LoadMaterial("materials/floor_shadows.bin");
   if (!shadow_mat_) return false;
 
+  ground_material_ = matman_.MaterialHandle("materials/floor.bin");
+  if (!matman_.LoadMaterial(ground_material_)) return false;
+
+  // The slides are loaded as the tutorial reaches them.
+  const auto slides = config.tutorial_slides();
+  tutorial_slide_materials_.resize(slides->Length());
+  for (size_t i = 0; i < tutorial_slide_materials_.size(); ++i) {
+    tutorial_slide_materials_[i] =
+        matman_.MaterialHandle(slides->Get(i)->c_str());
+  }
+
   // Load all the menu textures.
   gui_menu_.LoadAssets(TitleScreenButtons(config), &matman_);
   gui_menu_.LoadAssets(config.touchscreen_zones(), &matman_);
@@ -312,8 +645,11 @@ bool PieNoonGame::InitializeRenderingAssets() {
       config.fade_material()->c_str()));
   full_screen_fader_.set_shader(shader_textured_);
 
-  // Start the thread that actually loads all assets we requested above.
-  matman_.StartLoadingTextures();
+  // Start the threads that actually load all assets we requested above. By
+  // default, use every core but the one the main thread runs on.
+  const int loader_threads = config.loader_threads() > 0 ?
+                             config.loader_threads() : SDL_GetCPUCount() - 1;
+  matman_.StartLoadingTextures(loader_threads);
 
   return true;
 }
@@ -323,18 +659,22 @@ bool PieNoonGame::InitializeRenderingAssets() {
 bool PieNoonGame::InitializeGameState() {
   const Config& config = GetConfig();
 
-  game_state_.set_config(&config);
+  game_state_.set_config(&config, &runtime_config_);
 
   // Register the impeller types with the ImpelEngine.
   impel::OvershootImpelProcessor::Register();
   impel::SmoothImpelProcessor::Register();
+  impel::SmoothImpelProcessor3f::Register();
+  impel::SmoothFixedImpelProcessor::Register();
+  game_state_.impel_engine().SetNumWorkerThreads(config.impel_worker_threads());
 
   // Load flatbuffer into buffer.
-  if (!LoadFile("character_state_machine_def.bin", &state_machine_source_)) {
+  if (!state_machine_file_.Open("character_state_machine_def.bin")) {
     SDL_LogError(SDL_LOG_CATEGORY_ERROR,
                  "Error loading character state machine.\n");
     return false;
   }
+  flatbuffer_memory_.Set(config_file_.size() + state_machine_file_.size());
 
   // Grab the state machine from the buffer.
   auto state_machine_def = GetStateMachine();
@@ -400,38 +740,103 @@ class AudioEngineVolumeControl {
 bool PieNoonGame::Initialize(const char* const binary_directory) {
   SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "PieNoon initializing...\n");
 
+  // Record until the first frame, then keep the trace only if the config
+  // asks for it.
+  StartStartupTrace();
+
   if (!ChangeToUpstreamDir(binary_directory, kAssetsDir))
     return false;
 
-  if (!InitializeConfig())
-    return false;
+  // Before anything is loaded, so that every file can come from them.
+  {
+    StartupTraceScope trace("phase", "MountAssetArchives");
+    for (size_t i = 0; i < sizeof(kAssetArchives) / sizeof(kAssetArchives[0]);
+         ++i) {
+      MountAssetArchive(kAssetArchives[i]);
+    }
+  }
 
-  if (!InitializeRenderer())
-    return false;
+  {
+    StartupTraceScope trace("phase", "InitializeConfig");
+    if (!InitializeConfig())
+      return false;
+  }
+  if (!GetConfig().startup_trace())
+    CancelStartupTrace();
+
+  // Builds without a command line, such as on Android, can name the replay
+  // to benchmark in the config instead. It's loaded once the game state is.
+  const char* configured_replay = nullptr;
+  if (!benchmarking() && GetConfig().benchmark_replay()) {
+    configured_replay = GetConfig().benchmark_replay()->c_str();
+    char* pref_path = SDL_GetPrefPath(kPreferencesOrganization,
+                                      kPreferencesApplication);
+    if (pref_path) {
+      benchmark_file_name_ = std::string(pref_path) +
+                             kBenchmarkResultsFileName;
+      SDL_free(pref_path);
+    } else {
+      benchmark_file_name_ = kBenchmarkResultsFileName;
+    }
+    if (GetConfig().benchmark_baseline()) {
+      baseline_file_name_ = GetConfig().benchmark_baseline()->c_str();
+    }
+  }
 
-  if (!InitializeRenderingAssets())
-    return false;
+  {
+    StartupTraceScope trace("phase", "InitializeRenderer");
+    if (!InitializeRenderer())
+      return false;
+  }
+
+  {
+    StartupTraceScope trace("phase", "InitializeRenderingAssets");
+    if (!InitializeRenderingAssets())
+      return false;
+  }
 
   input_.Initialize();
 
   // Some people are having trouble loading the audio engine, and it's not
   // strictly necessary for gameplay, so don't die if the audio engine fails to
   // initialize.
-  audio_engine_.Initialize(GetConfig().audio());
+  {
+    StartupTraceScope trace("phase", "InitializeAudio");
+    audio_engine_.Initialize(GetConfig().audio());
+  }
   input_.AddAppEventCallback(AudioEngineVolumeControl(&audio_engine_));
 
-  if (!InitializeGameState())
-    return false;
+  {
+    StartupTraceScope trace("phase", "InitializeGameState");
+    if (!InitializeGameState())
+      return false;
+  }
 
 # ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
-  if (!gpg_manager.Initialize(ReadPreference("logged_in", 1, 1) != 0))
-    return false;
+  {
+    StartupTraceScope trace("phase", "InitializeGooglePlayGames");
+    logged_in_preference_ = ReadPreference("logged_in", 1, 1);
+    if (!gpg_manager.Initialize(logged_in_preference_ != 0))
+      return false;
+  }
 # endif
 
+  if (configured_replay != nullptr && !LoadReplay(configured_replay)) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "can't replay %s\n",
+                 configured_replay);
+    return false;
+  }
+
   SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "PieNoon initialization complete\n");
   return true;
 }
 
+// The cheapest variant of the textured shader that can draw 'material'.
+Shader* PieNoonGame::TexturedShader(const Material& material) const {
+  return (material.shader_features() & kShaderFeatureAlphaTest) ?
+         shader_textured_ : shader_textured_opaque_;
+}
+
 // Returns the mesh for renderable_id, if we have one, or the pajama mesh
 // (a mesh with a texture that's obviously wrong), if we don't.
 Mesh* PieNoonGame::GetCardboardFront(int renderable_id) {
@@ -442,67 +847,437 @@ Mesh* PieNoonGame::GetCardboardFront(int renderable_id) {
                      : cardboard_fronts_[RenderableId_Invalid];
 }
 
+// Set the lighting properties of the cardboard material. Call after
+// shader->Set().
+static void SetCardboardUniforms(const Config& config,
+                                 const RuntimeConfig& runtime_config,
+                                 Shader* shader) {
+  shader->SetUniform("ambient_material",
+                     runtime_config.cardboard_ambient_material());
+  shader->SetUniform("diffuse_material",
+                     runtime_config.cardboard_diffuse_material());
+  shader->SetUniform("specular_material",
+                     runtime_config.cardboard_specular_material());
+  shader->SetUniform("shininess", config.cardboard_shininess());
+  shader->SetUniform("normalmap_scale", config.cardboard_normalmap_scale());
+}
+
+// Shader ids in the RenderQueue keys of RenderCardboard().
+enum CardboardShaderKey {
+  kCardboardShaderKey,
+  kCardboardOverlayShaderKey,
+  kTexturedShaderKey,
+  kTexturedOpaqueShaderKey
+};
+
+// Pieces of a renderable, in the order they must be drawn when blended.
+// Note: Draw order is back-to-front, so draw the cardboard back, then
+// popsicle stick, then cardboard front--in that order. Each piece has its
+// own layer, so the queue keeps them in order.
+enum CardboardLayer {
+  kCardboardBackLayer,
+  kCardboardStickFrontLayer,
+  kCardboardStickBackLayer,
+  kCardboardFrontLayer
+};
+
+// Queue one piece of a renderable. Blended materials go in the translucent
+// pass, so they stay back to front. Material ids are texture names, since
+// binding textures is most of what Material::Set() does.
+static void QueueCardboardDraw(int item, CardboardLayer layer, int mesh_key,
+                               Mesh* mesh, int shader_key, Shader* shader,
+                               int depth_bucket, RenderQueue* queue) {
+  Material* material = mesh->GetMaterial(0);
+  const int material_key = material->textures().empty() ? 0 :
+      static_cast<int>(material->textures()[0]->id() %
+                       RenderQueue::kNumMaterials);
+  const uint64_t key = material->blend_mode() == kBlendModeAlpha ?
+      RenderQueue::TranslucentKey(depth_bucket, item, layer) :
+      RenderQueue::OpaqueKey(shader_key, material_key, mesh_key,
+                             depth_bucket);
+  queue->Add(key, item, mesh, shader, material);
+}
+
 void PieNoonGame::RenderCardboard(const SceneDescription& scene,
                                 const mat4& camera_transform) {
   const Config& config = GetConfig();
-
-  for (size_t i = 0; i < scene.renderables().size(); ++i) {
-    const auto& renderable = scene.renderables()[i];
-    const int id = renderable->id();
+  const auto& renderables = scene.renderables();
+
+  // Mesh ids in the queue keys. Fronts use their renderable id.
+  const int back_mesh_key = RenderableId_Count;
+  const int stick_front_mesh_key = 2 * RenderableId_Count;
+  const int stick_back_mesh_key = 2 * RenderableId_Count + 1;
+  const bool has_stick = stick_front_ != nullptr && stick_back_ != nullptr;
+  Shader* stick_shader = has_stick ?
+      TexturedShader(*stick_front_->GetMaterial(0)) : shader_textured_;
+  const int stick_shader_key = stick_shader == shader_textured_ ?
+      kTexturedShaderKey : kTexturedOpaqueShaderKey;
+
+  // Compute the uniforms of every renderable in one pass, before any
+  // drawing, so the math runs back to back over contiguous data.
+  cardboard_uniforms_.resize(renderables.size());
+  cardboard_inverses_.resize(renderables.size());
+  const vec3& camera_position = scene.camera_position();
+  const vec3& light_position = scene.lights()[0];  // TODO: check # of lights.
+  for (size_t v = 0; v < visible_renderables_.size(); ++v) {
+    const size_t i = visible_renderables_[v];
+    const mat4& world_matrix = renderables[i].world_matrix();
+    CardboardUniforms& uniforms = cardboard_uniforms_[i];
 
     // Set up vertex transformation into projection space.
-    const mat4 mvp = camera_transform * renderable->world_matrix();
-    renderer_.model_view_projection() = mvp;
+    uniforms.mvp = camera_transform * world_matrix;
+
+    // Set the camera and light positions in object space. World matrices are
+    // all rotations, translations and scales, so don't need a full inverse.
+    CachedInverse& cached = cardboard_inverses_[i];
+    if (memcmp(&cached.world[0], &world_matrix[0], 16 * sizeof(float)) != 0) {
+      cached.world = world_matrix;
+      cached.inverse = OrthogonalAffineInverse(world_matrix);
+    }
+    const mat4& world_matrix_inverse = cached.inverse;
+    uniforms.camera_pos = world_matrix_inverse * camera_position;
+    uniforms.light_pos = world_matrix_inverse * light_position;
+    uniforms.color = renderables[i].color();
+    uniforms.overlay_texture = 0;
+  }
+
+  // Point the fronts with baked splatters at their textures.
+  const auto& overlays = scene.overlays();
+  if (!overlays.empty()) {
+    const float scale = config.pixel_to_world_scale();
+    const vec4 bounds = LoadVec4(config.splatter_overlay_bounds());
+    const vec2 extent = (vec2(bounds.z(), bounds.w()) -
+                         vec2(bounds.x(), bounds.y())) * scale;
+    for (size_t i = 0; i < overlays.size(); ++i) {
+      const RenderableOverlay& overlay = overlays[i];
+      CardboardUniforms& uniforms = cardboard_uniforms_[overlay.renderable];
+      uniforms.overlay_texture = splatter_overlays_[overlay.key].texture;
+      uniforms.overlay_transform = vec4(
+          1.0f / extent.x(), 1.0f / extent.y(),
+          -overlay.origin.x() / extent.x(), -overlay.origin.y() / extent.y());
+    }
+  }
 
-    // Set the camera and light positions in object space.
-    const mat4 world_matrix_inverse = renderable->world_matrix().Inverse();
-    renderer_.camera_pos() = world_matrix_inverse *
-                             game_state_.camera().Position();
+  // Queue the pieces of each renderable.
+  render_queue_.Clear();
+  for (size_t v = 0; v < visible_renderables_.size(); ++v) {
+    const int item = visible_renderables_[v];
+    const auto& renderable = renderables[item];
+    const int id = renderable.id();
 
-    // TODO: check amount of lights.
-    renderer_.light_pos() = world_matrix_inverse * (*scene.lights()[0]);
+    const mat4& world_matrix = renderable.world_matrix();
+    const vec3 position(world_matrix(0, 3), world_matrix(1, 3),
+                        world_matrix(2, 3));
+    const int depth_bucket = RenderQueue::DepthBucket(
+        (position - scene.camera_position()).Length(),
+        config.viewport_near_plane(), config.viewport_far_plane());
 
-    // Note: Draw order is back-to-front, so draw the cardboard back, then
-    // popsicle stick, then cardboard front--in that order.
-    //
     // If we have a back, draw the back too, slightly offset.
     // The back is the *inside* of the cardboard, representing corrugation.
     if (cardboard_backs_[id]) {
-      shader_cardboard->Set(renderer_);
-      cardboard_backs_[id]->Render(renderer_);
+      QueueCardboardDraw(item, kCardboardBackLayer, back_mesh_key + id,
+                         cardboard_backs_[id], kCardboardShaderKey,
+                         shader_cardboard, depth_bucket, &render_queue_);
     }
 
     // Draw the popsicle stick that props up the cardboard.
-    if (config.renderables()->Get(id)->stick() && stick_front_ != nullptr &&
-        stick_back_ != nullptr) {
-      shader_textured_->Set(renderer_);
-      stick_front_->Render(renderer_);
-      stick_back_->Render(renderer_);
-    }
-
-    renderer_.color() = renderable->color();
-
-    if (config.renderables()->Get(id)->cardboard()) {
-      shader_cardboard->Set(renderer_);
-      shader_cardboard->SetUniform("ambient_material",
-          LoadVec3(config.cardboard_ambient_material()));
-      shader_cardboard->SetUniform("diffuse_material",
-          LoadVec3(config.cardboard_diffuse_material()));
-      shader_cardboard->SetUniform("specular_material",
-          LoadVec3(config.cardboard_specular_material()));
-      shader_cardboard->SetUniform("shininess",
-          config.cardboard_shininess());
-      shader_cardboard->SetUniform("normalmap_scale",
-          config.cardboard_normalmap_scale());
+    if (runtime_config_.stick(id) && has_stick) {
+      QueueCardboardDraw(item, kCardboardStickFrontLayer, stick_front_mesh_key,
+                         stick_front_, stick_shader_key, stick_shader,
+                         depth_bucket, &render_queue_);
+      QueueCardboardDraw(item, kCardboardStickBackLayer, stick_back_mesh_key,
+                         stick_back_, stick_shader_key, stick_shader,
+                         depth_bucket, &render_queue_);
+    }
+
+    // Only fronts with baked splatters pay for the overlay.
+    Mesh* front = GetCardboardFront(id);
+    const int front_mesh_key = front == cardboard_fronts_[id] ? id :
+                               RenderableId_Invalid;
+    if (runtime_config_.cardboard(id) &&
+        cardboard_uniforms_[item].overlay_texture != 0) {
+      QueueCardboardDraw(item, kCardboardFrontLayer, front_mesh_key, front,
+                         kCardboardOverlayShaderKey, shader_cardboard_overlay_,
+                         depth_bucket, &render_queue_);
+    } else if (runtime_config_.cardboard(id)) {
+      QueueCardboardDraw(item, kCardboardFrontLayer, front_mesh_key, front,
+                         kCardboardShaderKey, shader_cardboard, depth_bucket,
+                         &render_queue_);
+    } else {
+      Shader* shader = TexturedShader(*front->GetMaterial(0));
+      QueueCardboardDraw(item, kCardboardFrontLayer, front_mesh_key, front,
+                         shader == shader_textured_ ? kTexturedShaderKey :
+                                                      kTexturedOpaqueShaderKey,
+                         shader, depth_bucket, &render_queue_);
+    }
+  }
+  render_queue_.Sort();
+
+  // The cardboard lighting is the same for every draw, and uniforms are kept
+  // per program, so it only needs setting once for each variant.
+  if (shader_cardboard_overlay_ != nullptr) {
+    shader_cardboard_overlay_->Set(renderer_);
+    SetCardboardUniforms(config, runtime_config_, shader_cardboard_overlay_);
+  }
+  shader_cardboard->Set(renderer_);
+  SetCardboardUniforms(config, runtime_config_, shader_cardboard);
+  const Shader* current_shader = shader_cardboard;
+  const Material* current_material = nullptr;
+
+  // Submit the draws, skipping shader and material changes where the
+  // previous draw already made them.
+  const auto& draws = render_queue_.draws();
+  for (size_t i = 0; i < draws.size(); ++i) {
+    const RenderQueue::Draw& draw = draws[i];
+    const CardboardUniforms& uniforms = cardboard_uniforms_[draw.item];
+    renderer_.model_view_projection() = uniforms.mvp;
+    renderer_.camera_pos() = uniforms.camera_pos;
+    renderer_.light_pos() = uniforms.light_pos;
+    renderer_.color() = uniforms.color;
+    if (draw.shader != current_shader) {
+      draw.shader->Set(renderer_);
+      current_shader = draw.shader;
     } else {
-      shader_textured_->Set(renderer_);
+      draw.shader->SetStandardUniforms(renderer_);
+    }
+    // Materials that share an atlas set the same state.
+    if (current_material == nullptr ||
+        !draw.material->SameState(*current_material)) {
+      draw.material->Set(renderer_);
+      current_material = draw.material;
+    }
+    if (draw.shader == shader_cardboard_overlay_) {
+      renderer_.BindTexture(2, uniforms.overlay_texture);
+      shader_cardboard_overlay_->SetUniform(overlay_transform_uniform_,
+                                            uniforms.overlay_transform);
+    }
+    draw.mesh->Render(renderer_, true);
+  }
+}
+
+// Make 'shader' current, unless it already is.
+static void UseShader(const Shader* shader, const Renderer& renderer,
+                      const Shader** current_shader) {
+  if (shader != *current_shader) {
+    shader->Set(renderer);
+    *current_shader = shader;
+  }
+}
+
+// Draw the same cardboard as RenderCardboard(), but with one draw call per
+// mesh for every run of adjacent renderables that share a renderable id.
+// Only adjacent renderables are merged, since the scene is sorted back to
+// front for alpha blending. The world matrix and color of each renderable
+// are read from a per-instance buffer instead of uniforms.
+void PieNoonGame::RenderCardboardInstanced(const SceneDescription& scene,
+                                           const mat4& camera_transform) {
+  const Config& config = GetConfig();
+  const auto& renderables = scene.renderables();
+
+  // Gather the instances of all batches, so they can be uploaded at once.
+  cardboard_batches_.clear();
+  cardboard_instances_.resize(visible_renderables_.size());
+  for (size_t i = 0; i < visible_renderables_.size(); ++i) {
+    const auto& renderable = renderables[visible_renderables_[i]];
+    const int id = renderable.id();
+    if (cardboard_batches_.empty() || cardboard_batches_.back().id != id) {
+      CardboardBatch batch;
+      batch.id = id;
+      batch.first_instance = static_cast<int>(i);
+      batch.num_instances = 0;
+      cardboard_batches_.push_back(batch);
+    }
+    cardboard_batches_.back().num_instances++;
+
+    // Same column-major layout that Shader::Set() uploads.
+    MeshInstance& instance = cardboard_instances_[i];
+    memcpy(instance.world, &renderable.world_matrix()[0],
+           sizeof(instance.world));
+    instance.color = renderable.color();
+  }
+  if (cardboard_instances_.empty())
+    return;
+
+  if (cardboard_instance_vbo_ == 0) {
+    GL_CALL(glGenBuffers(1, &cardboard_instance_vbo_));
+  }
+  renderer_.BindBuffer(GL_ARRAY_BUFFER, cardboard_instance_vbo_);
+  GL_CALL(glBufferData(GL_ARRAY_BUFFER,
+                       cardboard_instances_.size() * sizeof(MeshInstance),
+                       &cardboard_instances_[0], GL_STREAM_DRAW));
+  CountGLBufferUpload(cardboard_instances_.size() * sizeof(MeshInstance));
+
+  // The shaders move the camera and light into object space themselves.
+  renderer_.model_view_projection() = camera_transform;
+  renderer_.camera_pos() = scene.camera_position();
+  renderer_.light_pos() = scene.lights()[0];  // TODO: check amount of lights.
+
+  // Uniforms are kept per program, so each shader only needs setting up once,
+  // and then only when switching to it.
+  shader_cardboard_instanced_->Set(renderer_);
+  SetCardboardUniforms(config, runtime_config_, shader_cardboard_instanced_);
+  shader_textured_instanced_->Set(renderer_);
+  const Shader* current_shader = shader_textured_instanced_;
+
+  for (size_t i = 0; i < cardboard_batches_.size(); ++i) {
+    const CardboardBatch& batch = cardboard_batches_[i];
+    const int id = batch.id;
+    const size_t offset = batch.first_instance * sizeof(MeshInstance);
+
+    // Same order as RenderCardboard(): back, stick, then front.
+    if (cardboard_backs_[id]) {
+      UseShader(shader_cardboard_instanced_, renderer_, &current_shader);
+      cardboard_backs_[id]->RenderInstanced(renderer_, cardboard_instance_vbo_,
+                                            offset, batch.num_instances);
+    }
+
+    if (runtime_config_.stick(id) && stick_front_ != nullptr &&
+        stick_back_ != nullptr) {
+      UseShader(shader_textured_instanced_, renderer_, &current_shader);
+      stick_front_->RenderInstanced(renderer_, cardboard_instance_vbo_, offset,
+                                    batch.num_instances);
+      stick_back_->RenderInstanced(renderer_, cardboard_instance_vbo_, offset,
+                                   batch.num_instances);
+    }
+
+    UseShader(runtime_config_.cardboard(id) ?
+                  shader_cardboard_instanced_ : shader_textured_instanced_,
+              renderer_, &current_shader);
+    GetCardboardFront(id)->RenderInstanced(renderer_, cardboard_instance_vbo_,
+                                           offset, batch.num_instances);
+  }
+}
+
+// Find the renderables whose cardboard is inside the view of
+// 'camera_transform', and put their indices in visible_renderables_. Also
+// prefetches the textures of every renderable in the scene.
+void PieNoonGame::CullRenderables(const SceneDescription& scene,
+                                  const mat4& camera_transform) {
+  const Frustum frustum(camera_transform);
+  const auto& renderables = scene.renderables();
+  visible_renderables_.clear();
+  for (size_t i = 0; i < renderables.size(); ++i) {
+    const int id = renderables[i].id();
+    const bool is_valid_id = 0 <= id && id < RenderableId_Count &&
+                             cardboard_fronts_[id] != nullptr;
+    const vec4& bounds = cardboard_bounds_[is_valid_id ? id :
+                                           RenderableId_Invalid];
+
+    // Whether or not it's in view now, everything in the scene may be soon,
+    // so bring back any of its textures that were evicted.
+    if (is_valid_id) {
+      matman_.PrefetchMaterial(cardboard_fronts_[id]->GetMaterial(0));
+      if (cardboard_backs_[id])
+        matman_.PrefetchMaterial(cardboard_backs_[id]->GetMaterial(0));
+    }
+
+    // Scale the radius by the largest scale of the world matrix.
+    const mat4& world_matrix = renderables[i].world_matrix();
+    float scale_squared = 0.0f;
+    for (int col = 0; col < 3; ++col) {
+      const vec3 column(world_matrix(0, col), world_matrix(1, col),
+                        world_matrix(2, col));
+      scale_squared = std::max(scale_squared, column.LengthSquared());
+    }
+    const vec3 center = world_matrix * bounds.xyz();
+    const float radius = bounds.w() * std::sqrt(scale_squared);
+    if (frustum.IntersectsSphere(center, radius)) {
+      visible_renderables_.push_back(static_cast<int>(i));
     }
+  }
+  last_cull_counts_.visible = static_cast<int>(visible_renderables_.size());
+  last_cull_counts_.culled =
+      static_cast<int>(renderables.size()) - last_cull_counts_.visible;
+}
+
+// Where the shadow of 'point' lands on the ground, as simple_shadow.glslv
+// projects it from 'light'.
+static vec3 ProjectOntoGround(const vec3& point, const vec3& light) {
+  const vec3 to_point = point - light;
+  return point + to_point * (point.y() / -to_point.y());
+}
+
+// Draw the shadow of every renderable that has one, through quad_batch_.
+// The cardboard quads are moved into world space here, so the shadows of
+// all of them can be drawn together. Shadows all have the same color, so
+// blending them gives the same result in any order. With the cardboard in
+// an atlas, they are all drawn in one call.
+//
+// A shadow can be in view when its caster isn't, so shadows are culled by
+// where they land on the ground, not by visible_renderables_.
+void PieNoonGame::RenderShadows(const SceneDescription& scene,
+                                const mat4& camera_transform) {
+  const Frustum frustum(camera_transform);
+  const vec3 light = renderer_.light_pos();
+  const auto& renderables = scene.renderables();
+  renderer_.DepthTest(false);
+  renderer_.model() = mat4::Identity();
+  vec3 corners[kQuadNumVertices];
+  vec3 footprint[kQuadNumVertices];
+  for (size_t i = 0; i < renderables.size(); ++i) {
+    const auto& renderable = renderables[i];
+    const int id = renderable.id();
+    if (!runtime_config_.shadow(id))
+      continue;
+
+    // Same quad as GetCardboardFront().
     Mesh* front = GetCardboardFront(id);
-    front->Render(renderer_);
+    const CardboardQuad& quad = cardboard_front_quads_[
+        front == cardboard_fronts_[id] ? id : RenderableId_Invalid];
+    const mat4& world_matrix = renderable.world_matrix();
+    bool above_light = false;
+    for (int j = 0; j < kQuadNumVertices; ++j) {
+      corners[j] = world_matrix * quad.corners[j];
+      above_light |= corners[j].y() >= light.y();
+      footprint[j] = ProjectOntoGround(corners[j], light);
+    }
+
+    // A corner level with the light or above it throws its shadow to
+    // infinity, so only cull shadows that all land on the ground.
+    if (!above_light) {
+      const vec4 bounds = BoundingSphere(footprint, kQuadNumVertices);
+      if (!frustum.IntersectsSphere(bounds.xyz(), bounds.w()))
+        continue;
+    }
+
+    // The first texture of the shadow shader has to be that of the
+    // billboard.
+    Material* material = front->GetMaterial(0);
+    if (shadow_mat_->textures()[0] != material->textures()[0]) {
+      quad_batch_.Flush();
+      shadow_mat_->textures()[0] = material->textures()[0];
+    }
+    quad_batch_.Add(shader_simple_shadow_, shadow_mat_, corners,
+                    quad.tex_coords);
+  }
+  quad_batch_.Flush();
+  renderer_.DepthTest(true);
+}
+
+// Upload the particles spawned in 'frame' and draw every live GPU particle.
+void PieNoonGame::RenderGpuParticles(GpuParticleFrame* frame,
+                                     const mat4& camera_transform) {
+  if (frame->reset) {
+    gpu_particles_.Clear();
+    frame->reset = false;
+  }
+  if (!frame->spawns.empty()) {
+    gpu_particles_.Add(&frame->spawns[0],
+                       static_cast<int>(frame->spawns.size()));
+    frame->spawns.clear();
   }
+  gpu_particles_.Render(renderer_, shader_particle_, camera_transform,
+                        frame->time);
 }
 
-void PieNoonGame::Render(const SceneDescription& scene) {
+void PieNoonGame::Render(const SceneDescription& scene,
+                         GpuParticleFrame* particles) {
+  FPL_FRAME_PROFILE_SCOPE("Render");
+
+  // The first pipelined frame has no scene yet.
+  if (scene.lights().empty())
+    return;
+
   const Config& config = GetConfig();
 
   // Final matrix that applies the view frustum to bring into screen space.
@@ -512,50 +1287,184 @@ void PieNoonGame::Render(const SceneDescription& scene) {
       config.viewport_near_plane(), config.viewport_far_plane(), -1.0f);
   const mat4 camera_transform = perspective_matrix_ * scene.camera();
 
+  // Bake before anything is drawn, since baking changes the render target.
+  if (config.bake_splatters())
+    BakeSplatterOverlays(scene);
+
+  // Draw the 3D scene at a lower resolution if the GPU is falling behind.
+  const bool offscreen = config.dynamic_resolution() && BeginSceneTarget();
+
+  // Time each pass on the GPU, if the profiler is enabled.
+  GpuProfiler& profiler = renderer_.gpu_profiler();
+
   // Render a ground plane.
   // TODO: Replace with a regular environment prop. Calculate scale_bias from
   // environment prop size.
+  profiler.BeginPass("ground");
   renderer_.model_view_projection() = camera_transform;
   renderer_.color() = mathfu::kOnes4f;
-  shader_textured_->Set(renderer_);
-  auto ground_mat = matman_.LoadMaterial("materials/floor.bin");
+  auto ground_mat = matman_.FindMaterial(ground_material_);
   assert(ground_mat);
+  TexturedShader(*ground_mat)->Set(renderer_);
   ground_mat->Set(renderer_);
   const float ground_width = 16.4f;
   const float ground_depth = 8.0f;
-  Mesh::RenderAAQuadAlongX(vec3(-ground_width, 0, 0),
+  Mesh::RenderAAQuadAlongX(renderer_, vec3(-ground_width, 0, 0),
                            vec3(ground_width, 0, ground_depth),
                            vec2(0, 0), vec2(1.0f, 1.0f));
   const vec4 world_scale_bias(1.0f / (2.0f * ground_width), 1.0f / ground_depth,
                               0.5f, 0.0f);
+  profiler.EndPass();
 
   // Render shadows for all Renderables first, with depth testing off so
   // they blend properly.
-  renderer_.DepthTest(false);
   renderer_.model_view_projection() = camera_transform;
-  renderer_.light_pos() = *scene.lights()[0];  // TODO: check amount of lights.
+  renderer_.light_pos() = scene.lights()[0];  // TODO: check amount of lights.
   shader_simple_shadow_->SetUniform("world_scale_bias", world_scale_bias);
-  for (size_t i = 0; i < scene.renderables().size(); ++i) {
-    const auto& renderable = scene.renderables()[i];
-    const int id = renderable->id();
-    Mesh* front = GetCardboardFront(id);
-    if (config.renderables()->Get(id)->shadow()) {
-      renderer_.model() = renderable->world_matrix();
-      shader_simple_shadow_->Set(renderer_);
-      // The first texture of the shadow shader has to be that of the
-      // billboard.
-      shadow_mat_->textures()[0] = front->GetMaterial(0)->textures()[0];
-      shadow_mat_->Set(renderer_);
-      front->Render(renderer_, true);
+  // Skip the renderables outside the view when drawing the cardboard.
+  CullRenderables(scene, camera_transform);
+  profiler.BeginPass("shadows");
+  RenderShadows(scene, camera_transform);
+  profiler.EndPass();
+
+  // Now render the Renderables normally, on top of the shadows.
+  profiler.BeginPass("cardboard");
+  if (shader_cardboard_instanced_ != nullptr) {
+    RenderCardboardInstanced(scene, camera_transform);
+  } else {
+    RenderCardboard(scene, camera_transform);
+  }
+  profiler.EndPass();
+
+  if (config.gpu_particles()) {
+    profiler.BeginPass("particles");
+    RenderGpuParticles(particles, camera_transform);
+    profiler.EndPass();
+  }
+
+  if (offscreen) {
+    profiler.BeginPass("upscale");
+    EndSceneTarget();
+    profiler.EndPass();
+  }
+}
+
+// Draw the splatters of each splatter_map entry that 'scene' shows, and that
+// aren't baked yet, into splatter_overlays_.
+void PieNoonGame::BakeSplatterOverlays(const SceneDescription& scene) {
+  const auto& overlays = scene.overlays();
+  bool baked = false;
+  for (size_t i = 0; i < overlays.size(); ++i) {
+    const int key = overlays[i].key;
+    if (splatter_overlays_[key].texture == 0)
+      baked |= BakeSplatterOverlay(key);
+  }
+  if (baked)
+    renderer_.SetRenderTarget(nullptr);
+}
+
+// Draw the splatters of splatter_map entry 'key' into its overlay, laid out
+// as LayoutAccessories() would put them on a character, but relative to the
+// renderable's splatter_offset. Returns false, leaving the render target
+// alone, if their textures are still loading.
+bool PieNoonGame::BakeSplatterOverlay(int key) {
+  const Config& config = GetConfig();
+  auto indices = config.splatter_map()->Get(key)->indices();
+  const int num_splatters = static_cast<int>(indices->Length());
+  for (int i = 0; i < num_splatters; ++i) {
+    const FixedAccessory* accessory =
+        config.splatter_accessories()->Get(indices->Get(i));
+    Material* material =
+        GetCardboardFront(accessory->renderable())->GetMaterial(0);
+    if (material->textures().empty() || material->textures()[0]->id() == 0) {
+      // Nothing else draws the splatters, so nothing else would bring them
+      // back if they were evicted.
+      matman_.PrefetchMaterial(material);
+      return false;
     }
   }
+
+  RenderTarget& target = splatter_overlays_[key];
+  const int resolution = config.splatter_overlay_resolution();
+  // The splatters are drawn without depth testing, so there's no depth
+  // buffer.
+  if (!renderer_.CreateRenderTarget(vec2i(resolution, resolution), &target,
+                                    true, false)) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "%s\n",
+                 renderer_.last_error().c_str());
+    return false;
+  }
+  renderer_.SetRenderTarget(&target);
+  renderer_.ClearFrameBuffer(mathfu::kZeros4f);
+
+  // Splatters overwrite each other, in the order they are listed, rather
+  // than blend. The cardboard shader alpha tests the result, as it does the
+  // splatters when they are accessories.
+  const float scale = config.pixel_to_world_scale();
+  const vec4 bounds = LoadVec4(config.splatter_overlay_bounds()) * scale;
+  const mat4 ortho = mathfu::OrthoHelper<float>(
+      bounds.x(), bounds.z(), bounds.y(), bounds.w(), -1.0f, 1.0f);
+  renderer_.color() = mathfu::kOnes4f;
+  renderer_.DepthTest(false);
+  shader_textured_->Set(renderer_);
+  for (int i = 0; i < num_splatters; ++i) {
+    const FixedAccessory* accessory =
+        config.splatter_accessories()->Get(indices->Get(i));
+    const vec2 location(LoadVec2i(accessory->location()));
+    const vec2 accessory_scale(LoadVec2(accessory->scale()));
+    renderer_.model_view_projection() =
+        ortho *
+        mat4::FromTranslationVector(
+            vec3(location.x() * scale, location.y() * scale, 0.0f)) *
+        mat4::FromScaleVector(
+            vec3(accessory_scale.x(), accessory_scale.y(), 1.0f));
+    shader_textured_->SetStandardUniforms(renderer_);
+    Mesh* mesh = GetCardboardFront(accessory->renderable());
+    mesh->GetMaterial(0)->Set(renderer_);
+    renderer_.SetBlendMode(kBlendModeOff);
+    mesh->Render(renderer_, true);
+  }
   renderer_.DepthTest(true);
+  return true;
+}
 
-  // Now render the Renderables normally, on top of the shadows.
-  RenderCardboard(scene, camera_transform);
+// Redirect drawing into scene_target_, resized to the resolution_scaler_'s
+// fraction of the window. Returns false, leaving drawing in the window, if
+// the scene should be drawn at full resolution.
+bool PieNoonGame::BeginSceneTarget() {
+  if (resolution_scaler_.scale() >= 1.0f)
+    return false;
+
+  const vec2i size = resolution_scaler_.ScaledSize(renderer_.window_size());
+  const bool resized = scene_target_.size.x() != size.x() ||
+                       scene_target_.size.y() != size.y();
+  if (resized && !renderer_.CreateRenderTarget(size, &scene_target_)) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "%s\n",
+                 renderer_.last_error().c_str());
+    return false;
+  }
+  renderer_.SetRenderTarget(&scene_target_);
+  renderer_.ClearFrameBuffer(mathfu::kZeros4f);
+  return true;
+}
+
+// Return drawing to the window, and stretch scene_target_ over all of it.
+void PieNoonGame::EndSceneTarget() {
+  renderer_.SetRenderTarget(nullptr);
+  renderer_.model_view_projection() = mat4::Identity();
+  renderer_.color() = mathfu::kOnes4f;
+  renderer_.SetBlendMode(kBlendModeOff);
+  renderer_.DepthTest(false);
+  shader_textured_opaque_->Set(renderer_);
+  renderer_.BindTexture(0, scene_target_.texture);
+  Mesh::RenderAAQuadAlongX(renderer_, vec3(-1.0f, -1.0f, 0.0f),
+                           vec3(1.0f, 1.0f, 0.0f));
+  renderer_.DepthTest(true);
 }
 
 void PieNoonGame::Render2DElements() {
+  FPL_FRAME_PROFILE_SCOPE("Render2DElements");
+
   // Set up an ortho camera for all 2D elements, with (0, 0) in the top left,
   // and the bottom right the windows size in pixels.
   auto res = renderer_.window_size();
@@ -589,7 +1498,206 @@ void PieNoonGame::Render2DElements() {
 
   // Loop through the 2D elements. Draw each subsequent one slightly closer
   // to the camera so that they appear on top of the previous ones.
-  gui_menu_.Render(&renderer_);
+  GpuProfiler& profiler = renderer_.gpu_profiler();
+  profiler.BeginPass("2d");
+  gui_menu_.Render(&quad_batch_);
+  profiler.EndPass();
+
+  if (profiler.enabled()) {
+    RenderGpuProfile();
+  }
+  if (GLStatsEnabled()) {
+    RenderGLStats();
+  }
+  if (GetConfig().memory_stats()) {
+    RenderMemoryStats();
+  }
+}
+
+// Draw a bar for each pass the GpuProfiler times, top to bottom in the order
+// that LogTimes() lists them. The line on the right marks the frame's budget,
+// half way across the window.
+void PieNoonGame::RenderGpuProfile() {
+  static const vec4 kPassColors[GpuProfiler::kMaxPasses] = {
+    vec4(0.9f, 0.3f, 0.3f, 1.0f), vec4(0.3f, 0.9f, 0.3f, 1.0f),
+    vec4(0.3f, 0.5f, 1.0f, 1.0f), vec4(0.9f, 0.9f, 0.3f, 1.0f),
+    vec4(0.9f, 0.3f, 0.9f, 1.0f), vec4(0.3f, 0.9f, 0.9f, 1.0f),
+    vec4(1.0f, 0.6f, 0.2f, 1.0f), vec4(0.6f, 0.6f, 0.6f, 1.0f),
+  };
+  static const float kBarHeight = 8.0f;
+  static const float kBarSpacing = 12.0f;
+  static const float kMargin = 8.0f;
+
+  const GpuProfiler& profiler = renderer_.gpu_profiler();
+  const vec2i res = renderer_.window_size();
+  renderer_.model_view_projection() = mathfu::OrthoHelper<float>(
+      0.0f, static_cast<float>(res.x()), static_cast<float>(res.y()), 0.0f,
+      -1.0f, 1.0f);
+  const float budget_width = res.x() * 0.5f;
+  const float budget_ms = static_cast<float>(frame_pacer_.period()) * 1000.0f;
+  const float pixels_per_ms = budget_ms > 0.0f ? budget_width / budget_ms :
+                              0.0f;
+
+  renderer_.DepthTest(false);
+  renderer_.SetBlendMode(kBlendModeOff);
+  for (int i = 0; i < profiler.num_passes(); ++i) {
+    const float top = kMargin + i * kBarSpacing;
+    const float width = static_cast<float>(profiler.PassTime(i)) *
+                        pixels_per_ms;
+    renderer_.color() = kPassColors[i];
+    shader_color_->Set(renderer_);
+    Mesh::RenderAAQuadAlongX(renderer_, vec3(kMargin, top + kBarHeight, 0.0f),
+                             vec3(kMargin + width, top, 0.0f));
+  }
+  const float bottom = kMargin + profiler.num_passes() * kBarSpacing;
+  renderer_.color() = mathfu::kOnes4f;
+  shader_color_->Set(renderer_);
+  Mesh::RenderAAQuadAlongX(renderer_,
+                           vec3(kMargin + budget_width, bottom, 0.0f),
+                           vec3(kMargin + budget_width + 1.0f, 0.0f, 0.0f));
+  renderer_.DepthTest(true);
+}
+
+// Draw a bar for each GLCallCategory of the last frame, then one for the
+// buffer bytes and one for the texture bytes uploaded, top to bottom, right
+// aligned. A full bar is half the window wide.
+void PieNoonGame::RenderGLStats() {
+  static const vec4 kCallColor(0.3f, 0.9f, 0.9f, 1.0f);
+  static const vec4 kUploadColor(1.0f, 0.6f, 0.2f, 1.0f);
+  static const float kBarHeight = 8.0f;
+  static const float kBarSpacing = 12.0f;
+  static const float kMargin = 8.0f;
+
+  const Config& config = GetConfig();
+  const GLCallStats& stats = LastFrameGLStats();
+  const vec2i res = renderer_.window_size();
+  renderer_.model_view_projection() = mathfu::OrthoHelper<float>(
+      0.0f, static_cast<float>(res.x()), static_cast<float>(res.y()), 0.0f,
+      -1.0f, 1.0f);
+  const float full_width = res.x() * 0.5f;
+  const float right = res.x() - kMargin;
+  const float bar_calls =
+      static_cast<float>(std::max(config.gl_stats_bar_calls(), 1));
+  const float bar_bytes =
+      static_cast<float>(std::max(config.gl_stats_bar_kb(), 1)) * 1024.0f;
+
+  float bars[kGLCallCategoryCount + 2];
+  for (int i = 0; i < kGLCallCategoryCount; ++i) {
+    bars[i] = stats.calls[i] / bar_calls;
+  }
+  bars[kGLCallCategoryCount] = stats.buffer_upload_bytes / bar_bytes;
+  bars[kGLCallCategoryCount + 1] = stats.texture_upload_bytes / bar_bytes;
+
+  renderer_.DepthTest(false);
+  renderer_.SetBlendMode(kBlendModeOff);
+  for (int i = 0; i < kGLCallCategoryCount + 2; ++i) {
+    const float top = kMargin + i * kBarSpacing;
+    const float width = std::min(bars[i], 1.0f) * full_width;
+    renderer_.color() = i < kGLCallCategoryCount ? kCallColor : kUploadColor;
+    shader_color_->Set(renderer_);
+    Mesh::RenderAAQuadAlongX(renderer_, vec3(right - width, top + kBarHeight,
+                                             0.0f),
+                             vec3(right, top, 0.0f));
+  }
+  renderer_.DepthTest(true);
+}
+
+// Draw a pair of bars for each MemoryCategory, and one for the total, bottom
+// to top from the bottom left corner. The dim bar is the peak, and the
+// bright one in front of it is the current total. A full bar is half the
+// window wide.
+void PieNoonGame::RenderMemoryStats() {
+  static const vec4 kPeakColor(0.4f, 0.2f, 0.6f, 1.0f);
+  static const vec4 kCurrentColor(0.8f, 0.5f, 1.0f, 1.0f);
+  static const float kBarHeight = 8.0f;
+  static const float kBarSpacing = 12.0f;
+  static const float kMargin = 8.0f;
+
+  const vec2i res = renderer_.window_size();
+  renderer_.model_view_projection() = mathfu::OrthoHelper<float>(
+      0.0f, static_cast<float>(res.x()), static_cast<float>(res.y()), 0.0f,
+      -1.0f, 1.0f);
+  const float full_width = res.x() * 0.5f;
+  const float bar_bytes = static_cast<float>(
+      std::max(GetConfig().memory_stats_bar_mb(), 1)) * 1024.0f * 1024.0f;
+
+  renderer_.DepthTest(false);
+  renderer_.SetBlendMode(kBlendModeOff);
+  for (int i = 0; i <= kMemoryCategoryCount; ++i) {
+    const bool total = i == kMemoryCategoryCount;
+    const MemoryCategory category = static_cast<MemoryCategory>(i);
+    const size_t bytes[] = {
+      total ? PeakMemoryTotal() : PeakMemory(category),
+      total ? CurrentMemoryTotal() : CurrentMemory(category)
+    };
+    const vec4* colors[] = { &kPeakColor, &kCurrentColor };
+    const float bottom = res.y() - kMargin - i * kBarSpacing;
+    for (int j = 0; j < 2; ++j) {
+      const float width = std::min(bytes[j] / bar_bytes, 1.0f) * full_width;
+      renderer_.color() = *colors[j];
+      shader_color_->Set(renderer_);
+      Mesh::RenderAAQuadAlongX(renderer_, vec3(kMargin, bottom, 0.0f),
+                               vec3(kMargin + width, bottom - kBarHeight,
+                                    0.0f));
+    }
+  }
+  renderer_.DepthTest(true);
+}
+
+// Add up the buffers that hold the scenes and the draws made from them.
+void PieNoonGame::UpdateSceneMemory() {
+  size_t bytes = VectorMemory(render_queue_.draws()) +
+                 VectorMemory(cardboard_uniforms_) +
+                 VectorMemory(cardboard_batches_) +
+                 VectorMemory(cardboard_instances_);
+  for (int i = 0; i < 2; ++i) {
+    bytes += VectorMemory(scenes_[i].renderables()) +
+             VectorMemory(scenes_[i].lights()) +
+             VectorMemory(gpu_particle_frames_[i].spawns);
+  }
+  scene_memory_.Set(bytes);
+}
+
+// Print the current and peak memory of each category to the log.
+static void LogMemoryStats() {
+  for (int i = 0; i < kMemoryCategoryCount; ++i) {
+    const MemoryCategory category = static_cast<MemoryCategory>(i);
+    SDL_Log("memory: %s %.2fMB, peak %.2fMB", MemoryCategoryName(category),
+            CurrentMemory(category) / (1024.0 * 1024.0),
+            PeakMemory(category) / (1024.0 * 1024.0));
+  }
+  SDL_Log("memory: total %.2fMB, peak %.2fMB",
+          CurrentMemoryTotal() / (1024.0 * 1024.0),
+          PeakMemoryTotal() / (1024.0 * 1024.0));
+}
+
+// Print the GL stats of the last frame to the log.
+static void LogGLStats() {
+  const GLCallStats& stats = LastFrameGLStats();
+  for (int i = 0; i < kGLCallCategoryCount; ++i) {
+    SDL_Log("gl stats: %s %d",
+            GLCallCategoryName(static_cast<GLCallCategory>(i)),
+            stats.calls[i]);
+  }
+  SDL_Log("gl stats: buffer uploads %llu bytes, texture uploads %llu bytes",
+          static_cast<unsigned long long>(stats.buffer_upload_bytes),
+          static_cast<unsigned long long>(stats.texture_upload_bytes));
+}
+
+// Add the GL stats of the last frame to the frame profiler's trace.
+static void RecordGLStatsCounters() {
+  static const char* kCounterNames[kGLCallCategoryCount] = {
+    "gl draws", "gl programs", "gl textures", "gl uniforms", "gl buffers",
+    "gl state", "gl uploads", "gl other"
+  };
+  const GLCallStats& stats = LastFrameGLStats();
+  for (int i = 0; i < kGLCallCategoryCount; ++i) {
+    RecordFrameCounter(kCounterNames[i], stats.calls[i]);
+  }
+  RecordFrameCounter("gl buffer upload bytes",
+                     static_cast<int64_t>(stats.buffer_upload_bytes));
+  RecordFrameCounter("gl texture upload bytes",
+                     static_cast<int64_t>(stats.texture_upload_bytes));
 }
 
 
@@ -608,24 +1716,25 @@ void PieNoonGame::DebugPrintCharacterStates() {
   }
 }
 
-// Debug function to print out the state of each AirbornePie.
+// Debug function to print out the state of each airborne pie.
 void PieNoonGame::DebugPrintPieStates() {
-  for (unsigned int i = 0; i < game_state_.pies().size(); ++i) {
-    auto& pie = game_state_.pies()[i];
+  const AirbornePies& pies = game_state_.pies();
+  for (int i = 0; i < pies.Count(); ++i) {
+    const vec3& position = pies.position(i);
     SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
                 "Pie from [%i]->[%i] w/ %i dmg at pos[%.2f, %.2f, %.2f]\n",
-                pie->source(), pie->target(), pie->damage(),
-                pie->position().x(), pie->position().y(), pie->position().z());
+                pies.source(i), pies.target(i), pies.damage(i),
+                position.x(), position.y(), position.z());
   }
 }
 
 const Config& PieNoonGame::GetConfig() const {
-  return *fpl::pie_noon::GetConfig(config_source_.c_str());
+  return *fpl::pie_noon::GetConfig(config_file_.data());
 }
 
 const CharacterStateMachineDef* PieNoonGame::GetStateMachine() const {
   return fpl::pie_noon::GetCharacterStateMachineDef(
-    state_machine_source_.c_str());
+    state_machine_file_.data());
 }
 
 struct ButtonToTranslation {
@@ -739,10 +1848,8 @@ PieNoonState PieNoonGame::UpdatePieNoonState() {
   switch (state_) {
     case kLoadingInitialMaterials: {
       const Config& config = GetConfig();
-      if (matman_.FindMaterial(
-            config.loading_material()->c_str())->textures()[0]->id() &&
-          matman_.FindMaterial(
-            config.loading_logo()->c_str())->textures()[0]->id() &&
+      if (matman_.FindMaterial(loading_material_)->textures()[0]->id() &&
+          matman_.FindMaterial(loading_logo_)->textures()[0]->id() &&
           full_screen_fader_.material()->textures()[0]->id()) {
         // Fade in the loading screen.
         FadeToPieNoonState(kLoading, config.full_screen_fade_time(),
@@ -753,15 +1860,20 @@ PieNoonState PieNoonGame::UpdatePieNoonState() {
     case kLoading: {
       const Config& config = GetConfig();
       // When we initialized assets, we kicked off a thread to load all
-      // textures. Here we check if those have finished loading.
-      // We also leave the loading screen up for a minimum amount of time.
-      if (!Fading() && matman_.TryFinalize() &&
+      // textures. Here we check if those have finished loading; Run()
+      // finalizes them a little each frame.
+      // We also leave the loading screen up for a minimum amount of time,
+      // and wait for the menu music. The other sounds keep loading.
+      if (!Fading() && matman_.FinishedLoading() &&
+          audio_engine_.Ready(SoundId_MusicMenu) &&
           (time - state_entry_time_) > config.min_loading_time()) {
         // If we've already displayed the tutorial before, jump straight to
         // the game. If we don't have the capability to record our previous
         // tutorial views, also jump straight to the game.
         int displayed_tutorial = ReadPreference("displayed_tutorial", 0, 1);
+        // When replaying, go straight into the recorded match.
         const PieNoonState first_state =
+            replaying_ ? kPlaying :
             displayed_tutorial ? kFinished : kTutorial;
 
         // Fade out the loading screen and fade in the scene or tutorial.
@@ -788,9 +1900,8 @@ PieNoonState PieNoonGame::UpdatePieNoonState() {
         }
 
         // Reset the impeller animation, if we've moved to a new image.
-        impel::OvershootImpelInit init;
-        impel::OvershootInitFromFlatBuffers(*config.join_impeller_def(), &init);
-        join_impeller_.Initialize(init, &game_state_.impel_engine());
+        join_impeller_.Initialize(runtime_config_.join_impeller_init(),
+                                  &game_state_.impel_engine());
         join_impeller_.SetValue(config.join_impeller_start_value());
         join_impeller_.SetTargetValue(config.join_impeller_target_value());
         join_impeller_.SetVelocity(config.join_impeller_start_velocity());
@@ -873,6 +1984,9 @@ void PieNoonGame::TransitionToPieNoonState(PieNoonState next_state) {
   assert(state_ != next_state);  // Must actually transition.
   const Config& config = GetConfig();
 
+  // The new state starts at full rate.
+  idle_throttle_.Wake();
+
   switch (next_state) {
     case kLoadingInitialMaterials: {
       break;
@@ -896,6 +2010,7 @@ void PieNoonGame::TransitionToPieNoonState(PieNoonState next_state) {
         audio_engine_.PlaySound(SoundId_MusicAction);
         ambience_channel_ = audio_engine_.PlaySound(SoundId_Ambience);
         game_state_.Reset();
+        StartRecordingOrReplay();
       } else {
         audio_engine_.Pause(false);
       }
@@ -913,6 +2028,8 @@ void PieNoonGame::TransitionToPieNoonState(PieNoonState next_state) {
       }
       stinger_channel_ = AudioEngine::kInvalidChannel;
       audio_engine_.PlaySound(SoundId_MusicMenu);
+      // Load the match sounds while the menu is up.
+      audio_engine_.LoadAllSounds();
       for (size_t i = 0; i < game_state_.characters().size(); ++i) {
         auto& character = game_state_.characters()[i];
         if (character->controller()->controller_type() !=
@@ -939,6 +2056,11 @@ void PieNoonGame::TransitionToPieNoonState(PieNoonState next_state) {
       // This should only happen if we just finished a game, not if we
       // end up in this state after loading.
       if (state_ == kPlaying) {
+        if (!record_file_name_.empty() &&
+            !recording_.Save(record_file_name_.c_str())) {
+          SDL_LogError(SDL_LOG_CATEGORY_ERROR, "can't save %s\n",
+                       record_file_name_.c_str());
+        }
         UploadEvents();
         // For now, we always show leaderboards when a round ends:
         UploadAndShowLeaderboards();
@@ -1004,6 +2126,7 @@ void PieNoonGame::UploadEvents() {
       character->GetStat(static_cast<PlayerStats>(ps)));
   }
   character->ResetStats();
+  gpg_manager.Flush();
 # endif
 }
 
@@ -1285,6 +2408,30 @@ void PieNoonGame::UpdateControllers(WorldTime delta_time) {
   }
 }
 
+// Pick up the input events that arrived since the top of the frame, so the
+// simulation sees the freshest input we can give it. Only the simulation
+// and later consumers in this frame see those presses; see
+// late_latch_input in config.fbs.
+void PieNoonGame::LatchInput() {
+  input_.PollEvents(&renderer_.window_size());
+  for (size_t i = 0; i < active_controllers_.size(); i++) {
+    if (active_controllers_[i].get() != nullptr) {
+      active_controllers_[i]->LatchInput();
+    }
+  }
+}
+
+// True if the frame just drawn looked exactly like the one before it and
+// nobody touched anything, so drawing it again at a low rate loses nothing.
+// Only the menus and lobby qualify; matches always run at full rate.
+bool PieNoonGame::FrameWasQuiet() const {
+  return (state_ == kJoining || state_ == kPaused || state_ == kFinished) &&
+         !Fading() && input_.events_this_frame() == 0 &&
+         !gui_menu_.layout_changed() &&
+         game_state_.particle_manager().Count() == 0 &&
+         scenes_[0].Matches(scenes_[1]);
+}
+
 void PieNoonGame::UpdateTouchButtons(WorldTime delta_time) {
   gui_menu_.AdvanceFrame(delta_time, &input_, vec2(renderer_.window_size()));
 
@@ -1356,15 +2503,63 @@ bool PieNoonGame::AnyControllerPresses() {
 }
 
 // Load into memory the tutorial slide at slide_index, if slide_index is valid.
-// We preload some tutorial slides so that we can transition to them.
+// We preload some tutorial slides so that we can transition to them. Slides
+// more than tutorial_max_full_resolution_slides ahead only get their preview,
+// and are loaded in full once the tutorial is close enough to them.
 void PieNoonGame::LoadTutorialSlide(int slide_index) {
   const Config& config = GetConfig();
   const int num_slides = static_cast<int>(config.tutorial_slides()->Length());
   if (slide_index < 0 || slide_index >= num_slides)
     return;
 
-  const char* slide_name = TutorialSlideName(slide_index);
-  matman_.LoadMaterial(slide_name);
+  // The preview is small, so it's usable long before the slide is.
+  const AssetHandle handle = tutorial_slide_materials_[slide_index];
+  if (config.tutorial_preview_mip_level() > 0) {
+    matman_.LoadPreviewMaterial(handle, config.tutorial_preview_mip_level());
+  }
+
+  // The slide is about to be shown, so load it ahead of anything else.
+  const int max_full_resolution =
+      std::max(config.tutorial_max_full_resolution_slides(), 1);
+  if (slide_index < tutorial_slide_index_ + max_full_resolution) {
+    matman_.LoadMaterial(handle, AsyncLoader::kHighPriority);
+  }
+}
+
+// Turn loaded textures into OpenGL textures, a frame's worth at a time, so
+// that the loading screen and tutorial keep animating. Returns true once
+// everything queued is usable.
+bool PieNoonGame::FinalizeLoadedMaterials() {
+  const Config& config = GetConfig();
+  return matman_.TryFinalize(
+      static_cast<double>(config.finalize_budget_microseconds()) / 1000000.0,
+      static_cast<size_t>(config.finalize_budget_bytes()));
+}
+
+// Draw a bar under the logo that fills up as the textures are finalized.
+void PieNoonGame::RenderLoadingProgress(const mathfu::mat4& ortho_mat) {
+  const Config& config = GetConfig();
+  if (!config.loading_progress_bar_size()) return;
+  const vec2 res(renderer_.window_size());
+  const vec2 extend =
+      LoadVec2(config.loading_progress_bar_size()) * res / 2.0f;
+  if (extend.x() <= 0.0f) return;
+  Material* mat = full_screen_fader_.material();
+  renderer_.model_view_projection() = ortho_mat *
+      mat4::FromTranslationVector(vec3(res.x() / 2.0f, res.y() * 0.85f, 0.0f));
+
+  // The empty bar, then the part that has loaded on top of it.
+  renderer_.color() = vec4(1.0f, 1.0f, 1.0f, 0.25f);
+  quad_batch_.Add(shader_textured_, mat,
+                  vec3(-extend.x(),  extend.y(), 0),
+                  vec3( extend.x(), -extend.y(), 0),
+                  vec2(0, 1), vec2(1, 0));
+  const float right = extend.x() * (2.0f * matman_.LoadingProgress() - 1.0f);
+  renderer_.color() = mathfu::kOnes4f;
+  quad_batch_.Add(shader_textured_, mat,
+                  vec3(-extend.x(),  extend.y(), 0),
+                  vec3(right, -extend.y(), 0),
+                  vec2(0, 1), vec2(1, 0));
 }
 
 // Preload the initial few tutorial slides to prime the slide load-unload
@@ -1401,8 +2596,163 @@ void PieNoonGame::RenderInMiddleOfScreen(
   renderer_.model_view_projection() = ortho_mat;
   renderer_.color() = mathfu::kOnes4f;
   material->Set(renderer_);
-  shader_textured_->Set(renderer_);
-  Mesh::RenderAAQuadAlongX(bottom_left, top_right, vec2(0, 1), vec2(1, 0));
+  TexturedShader(*material)->Set(renderer_);
+  Mesh::RenderAAQuadAlongX(renderer_, bottom_left, top_right, vec2(0, 1),
+                           vec2(1, 0));
+}
+
+// Update game logic for 'delta_time' ms of real time. Return how far
+// rendering should interpolate between the last two simulation states.
+float PieNoonGame::AdvanceGameState(WorldTime delta_time) {
+  const WorldTime step = GetConfig().fixed_update_time();
+  if (step <= 0) {
+    // Update game logic by a variable number of milliseconds.
+    game_state_.AdvanceFrame(delta_time, &audio_engine_);
+    return 1.0f;
+  }
+
+  // Update game logic in fixed steps. delta_time is already clamped to
+  // max_update_time, which bounds the number of steps per frame.
+  step_controllers_.clear();
+  for (size_t i = 0; i < game_state_.characters().size(); ++i) {
+    step_controllers_.push_back(game_state_.characters()[i]->controller());
+  }
+  AdvanceFixedSteps(step, delta_time, step_controllers_,
+                    AdvanceGameStateStep, this, &fixed_update_remainder_);
+  return static_cast<float>(fixed_update_remainder_) /
+         static_cast<float>(step);
+}
+
+// Advance the game by simulate_delta_time_ and populate the scene that is not
+// being drawn. Must not touch the renderer, since it may run on
+// update_thread_.
+void PieNoonGame::SimulateFrame() {
+  FrameProfilePhases phases("AdvanceGameState");
+
+  // While paused, keep drawing the same in-between state.
+  if (state_ != kPaused) {
+    render_interpolation_ = AdvanceGameState(simulate_delta_time_);
+  }
+
+  // Populate 'scene' from the game state--all the positions, orientations,
+  // and renderable-ids (which specify materials) of the characters and
+  // props. Also specify the camera matrix.
+  phases.Next("PopulateScene");
+  game_state_.PopulateScene(&scenes_[1 - scene_to_draw_],
+                            render_interpolation_);
+
+  // Hand the particles spawned this frame to the renderer. They are uploaded
+  // when this scene is drawn.
+  GpuParticleFrame& particles = gpu_particle_frames_[1 - scene_to_draw_];
+  particles.spawns.clear();
+  game_state_.MoveGpuParticleSpawns(&particles.spawns, &particles.reset);
+  particles.time = game_state_.time();
+}
+
+void PieNoonGame::AdvanceGameStateStep(WorldTime step, void* context) {
+  PieNoonGame* game = static_cast<PieNoonGame*>(context);
+  game->game_state_.AdvanceFrame(step, &game->audio_engine_);
+}
+
+void PieNoonGame::SimulateFrameJob(void* context) {
+  NameFrameProfilerThread("Update");
+  static_cast<PieNoonGame*>(context)->SimulateFrame();
+}
+
+bool PieNoonGame::LoadReplay(const char* filename) {
+  if (!recording_.Load(filename))
+    return false;
+  if (recording_.NumCharacters() !=
+      static_cast<int>(game_state_.characters().size())) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR,
+                 "%s has %d characters, but the game has %d\n", filename,
+                 recording_.NumCharacters(),
+                 static_cast<int>(game_state_.characters().size()));
+    return false;
+  }
+  replaying_ = true;
+  return true;
+}
+
+// Called when a match starts, after the game has been reset.
+void PieNoonGame::StartRecordingOrReplay() {
+  // The fixed-step remainder carries over between frames, so it must start
+  // from the same value for a replay to take the same steps.
+  fixed_update_remainder_ = 0;
+  match_frame_ = 0;
+
+  auto& characters = game_state_.characters();
+  if (replaying_) {
+    replay_controllers_.resize(characters.size());
+    for (size_t i = 0; i < characters.size(); ++i) {
+      if (!replay_controllers_[i]) {
+        replay_controllers_[i].reset(new ReplayController());
+      }
+      replay_controllers_[i]->Initialize(&recording_,
+                                         static_cast<CharacterId>(i));
+      characters[i]->controller()->set_character_id(kNoCharacter);
+      characters[i]->set_controller(replay_controllers_[i].get());
+    }
+  } else if (!record_file_name_.empty()) {
+    recording_.Start(SDL_GetTicks(), characters);
+  }
+}
+
+// Called every frame of a match, after the controllers have been updated and
+// before the game advances. Returns the time to advance the game by.
+WorldTime PieNoonGame::RecordOrReplayFrame(WorldTime delta_time) {
+  WorldTime frame_time = delta_time;
+  if (replaying_) {
+    if (match_frame_ >= recording_.NumFrames()) {
+      input_.exit_requested_ = true;
+      return 0;
+    }
+    for (size_t i = 0; i < replay_controllers_.size(); ++i) {
+      replay_controllers_[i]->AdvanceFrame(delta_time);
+    }
+    frame_time = recording_.delta_time(match_frame_);
+  } else if (!record_file_name_.empty()) {
+    recording_.RecordFrame(delta_time, game_state_.characters());
+  } else {
+    return delta_time;
+  }
+
+  // Start each frame from a known point, so that a replay does not depend
+  // on how many numbers the frames before it drew.
+  game_state_.rng().Seed(recording_.FrameSeed(match_frame_));
+  match_frame_++;
+  return frame_time;
+}
+
+// Stop recording startup, and write the trace next to the shader cache.
+static void WriteStartupTrace() {
+  char* pref_path = SDL_GetPrefPath(kPreferencesOrganization,
+                                    kPreferencesApplication);
+  if (!pref_path) {
+    CancelStartupTrace();
+    return;
+  }
+  const std::string filename =
+      std::string(pref_path) + kStartupTraceFileName;
+  SDL_free(pref_path);
+  FinishStartupTrace(filename.c_str());
+}
+
+// Start the frame profiler, or, if it has started, write the last
+// 'num_frames' frames it recorded next to the shader cache.
+static void ToggleFrameProfiler(int num_frames) {
+  if (!FrameProfilerEnabled()) {
+    EnableFrameProfiler(true);
+    SDL_Log("frame profiler: recording");
+    return;
+  }
+  char* pref_path = SDL_GetPrefPath(kPreferencesOrganization,
+                                    kPreferencesApplication);
+  if (!pref_path)
+    return;
+  const std::string filename = std::string(pref_path) + kFrameTraceFileName;
+  SDL_free(pref_path);
+  WriteFrameTrace(filename.c_str(), num_frames);
 }
 
 void PieNoonGame::Run() {
@@ -1414,30 +2764,105 @@ void PieNoonGame::Run() {
   TransitionToPieNoonState(kLoadingInitialMaterials);
   game_state_.Reset();
 
+  // Pace the frames with vsync if the target rate allows, or by sleeping.
+  frame_pacer_.Initialize(config.target_frame_rate(),
+                          renderer_.refresh_rate(),
+                          min_update_time / 1000.0);
+  if (benchmarking()) {
+    // Measure how long the frames take, not how long vsync makes them.
+    renderer_.SetSwapInterval(0);
+  } else if (frame_pacer_.swap_interval() > 0 &&
+             !renderer_.SetSwapInterval(frame_pacer_.swap_interval())) {
+    frame_pacer_.set_swap_interval(0);
+  }
+  idle_throttle_.Initialize(config.idle_delay() / 1000.0,
+                            config.idle_frame_rate() > 0 ?
+                            1.0 / config.idle_frame_rate() : 0.0);
+  resolution_scaler_.Initialize(config.dynamic_resolution_min_scale(),
+                                config.dynamic_resolution_step());
+  const int profiler_log_interval = config.gpu_profiler_log_interval();
+  NameFrameProfilerThread("Main");
+  EnableFrameProfiler(config.frame_profiler());
+  const size_t texture_budget =
+      static_cast<size_t>(config.texture_memory_budget_mb()) * 1024 * 1024;
+  int frames_since_profiler_log = 0;
+
   while (!input_.exit_requested_ &&
          !input_.GetButton(SDLK_ESCAPE).went_down()) {
-    // Milliseconds elapsed since last update. To avoid burning through the
-    // CPU, enforce a minimum time between updates. For example, if
-    // min_update_time is 1, we will not exceed 1000Hz update time.
+    // To avoid burning through the CPU, and to space frames evenly, wait
+    // until the pacer says the next frame should start. When idle, wait for
+    // much longer, but wake up as soon as an event arrives. The idle frames
+    // are not the pacer's, so keep them out of its statistics. Benchmarks
+    // don't wait at all.
+    if (benchmarking()) {
+      frame_pacer_.Restart();
+    } else if (idle_throttle_.Idle(HighResolutionSeconds())) {
+      const int wait_ms = static_cast<int>(idle_throttle_.idle_period() *
+                                           1000.0);
+      if (SDL_WaitEventTimeout(nullptr, wait_ms)) {
+        idle_throttle_.Wake();
+      }
+      frame_pacer_.Restart();
+    } else {
+      SleepPrecisely(frame_pacer_.TimeToWait(HighResolutionSeconds()));
+    }
+    frame_pacer_.BeginFrame(HighResolutionSeconds());
+    BeginProfiledFrame();
+    const double frame_start = HighResolutionSeconds();
+    const uint64_t allocations_at_frame_start = AllocationCount();
+    const bool measure_frame = benchmarking() && state_ == kPlaying;
+
+    // Milliseconds elapsed since last update.
     const WorldTime world_time = CurrentWorldTime();
     const WorldTime delta_time = std::min(world_time - prev_world_time_,
                                           max_update_time);
-    if (delta_time < min_update_time) {
-      SDL_Delay(min_update_time - delta_time);
-      continue;
-    }
 
     // TODO: Can we move these to 'Render'?
-    renderer_.AdvanceFrame(input_.minimized_);
+    {
+      FPL_FRAME_PROFILE_SCOPE("Swap");
+      renderer_.AdvanceFrame(input_.minimized_);
+    }
+    if (GLStatsEnabled() && FrameProfilerEnabled()) {
+      RecordGLStatsCounters();
+    }
     renderer_.ClearFrameBuffer(mathfu::kZeros4f);
 
+    if ((renderer_.gpu_profiler().enabled() || GLStatsEnabled() ||
+         config.memory_stats()) &&
+        profiler_log_interval > 0 &&
+        ++frames_since_profiler_log >= profiler_log_interval) {
+      if (renderer_.gpu_profiler().enabled()) {
+        renderer_.gpu_profiler().LogTimes();
+      }
+      if (GLStatsEnabled()) {
+        LogGLStats();
+      }
+      if (config.memory_stats()) {
+        LogMemoryStats();
+      }
+      frames_since_profiler_log = 0;
+    }
+
     // Process input device messages since the last game loop.
     // Update render window size.
-    input_.AdvanceFrame(&renderer_.window_size());
+    {
+      FPL_FRAME_PROFILE_SCOPE("Input");
+      input_.AdvanceFrame(&renderer_.window_size());
+    }
+    if (input_.GetButton(SDLK_F10).went_down() ||
+        input_.GetButton(SDLK_POINTER5).went_down()) {
+      ToggleFrameProfiler(config.frame_profiler_frames());
+    }
+
+    // Sounds load in the background in every state.
+    audio_engine_.FinalizeLoadedSounds();
 
-    UpdateGamepadControllers();
-    UpdateControllers(delta_time);
-    UpdateTouchButtons(delta_time);
+    {
+      FPL_FRAME_PROFILE_SCOPE("Controllers");
+      UpdateGamepadControllers();
+      UpdateControllers(delta_time);
+      UpdateTouchButtons(delta_time);
+    }
 
     // Update the full screen fader dimensions.
     const auto res = renderer_.window_size();
@@ -1453,10 +2878,58 @@ void PieNoonGame::Run() {
       case kPlaying:
       case kPaused:
       case kFinished: {
-        if (state_ != kPaused) {
-          // Update game logic by a variable number of milliseconds.
-          game_state_.AdvanceFrame(delta_time, &audio_engine_);
+        // Late frames while the scene is drawn mean the GPU can't keep up
+        // with it, so trade some of its resolution for time. Go by the
+        // GPU's own time when the profiler measures it, so that frames held
+        // up by the CPU don't cost resolution. Without the profiler, or
+        // before its first results, fall back to the pacer's frame time,
+        // which counts both.
+        if (config.dynamic_resolution()) {
+          const GpuProfiler& profiler = renderer_.gpu_profiler();
+          const double gpu_time =
+              profiler.enabled() ? profiler.FrameTime() / 1000.0 : 0.0;
+          resolution_scaler_.Update(
+              gpu_time > 0.0 ? gpu_time : frame_pacer_.LastFrameTime(),
+              frame_pacer_.period());
+        }
+
+        // Advance the game and build the next scene. When pipelined, this
+        // happens on the update thread while the previous frame's scene is
+        // drawn, so nothing below may touch game_state_ or audio_engine_
+        // until the update thread has been waited on.
+        if (config.late_latch_input()) {
+          LatchInput();
         }
+        simulate_delta_time_ = state_ == kPlaying ?
+                               RecordOrReplayFrame(delta_time) : delta_time;
+        const bool pipelined = config.simulate_while_rendering();
+        if (pipelined) {
+          update_thread_.Start(SimulateFrameJob, this);
+        } else {
+          SimulateFrame();
+          scene_to_draw_ = 1 - scene_to_draw_;
+        }
+
+        // Issue draw calls for the 'scene'.
+        Render(scenes_[scene_to_draw_],
+               &gpu_particle_frames_[scene_to_draw_]);
+
+        // Render any UI/HUD/Splash on top.
+        Render2DElements();
+
+        // Keep texture memory within its budget, and bring back the evicted
+        // textures that were just drawn.
+        matman_.UpdateResidency(texture_budget);
+        FinalizeLoadedMaterials();
+
+        // The scene just built is drawn next frame.
+        if (pipelined) {
+          FPL_FRAME_PROFILE_SCOPE("WaitForUpdate");
+          update_thread_.Wait();
+          scene_to_draw_ = 1 - scene_to_draw_;
+        }
+        UpdateSceneMemory();
+        idle_throttle_.Update(HighResolutionSeconds(), FrameWasQuiet());
 
         if (state_ == kPlaying &&
             stinger_channel_ == AudioEngine::kInvalidChannel &&
@@ -1466,18 +2939,10 @@ void PieNoonGame::Run() {
         }
 
         // Update audio engine state.
-        audio_engine_.AdvanceFrame(world_time);
-
-        // Populate 'scene' from the game state--all the positions, orientations,
-        // and renderable-ids (which specify materials) of the characters and
-        // props. Also specify the camera matrix.
-        game_state_.PopulateScene(&scene_);
-
-        // Issue draw calls for the 'scene'.
-        Render(scene_);
-
-        // Render any UI/HUD/Splash on top.
-        Render2DElements();
+        {
+          FPL_FRAME_PROFILE_SCOPE("Audio");
+          audio_engine_.AdvanceFrame(world_time);
+        }
 
         // Output debug information.
         if (config.print_character_states()) {
@@ -1506,7 +2971,11 @@ void PieNoonGame::Run() {
         }
   #     ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
         gpg_manager.Update();
-        WritePreference("logged_in", static_cast<int>(gpg_manager.LoggedIn()));
+        const int logged_in = static_cast<int>(gpg_manager.LoggedIn());
+        if (logged_in != logged_in_preference_) {
+          WritePreference("logged_in", logged_in);
+          logged_in_preference_ = logged_in;
+        }
         CheckForNewAchievements();
   #     endif
         break;
@@ -1517,9 +2986,8 @@ void PieNoonGame::Run() {
         // screen, otherwise render the loading texture spinning and the
         // logo below.
         // Textures are still loading. Display a loading screen.
-        auto spinmat = matman_.FindMaterial(
-            config.loading_material()->c_str());
-        auto logomat = matman_.FindMaterial(config.loading_logo()->c_str());
+        auto spinmat = matman_.FindMaterial(loading_material_);
+        auto logomat = matman_.FindMaterial(loading_logo_);
         assert(spinmat && logomat);
         assert(spinmat->textures()[0]->id() && logomat->textures()[0]->id());
         const auto mid = res / 2;
@@ -1533,12 +3001,10 @@ void PieNoonGame::Run() {
             mat4::FromRotationMatrix(rot_mat);
         auto extend = vec2(spinmat->textures()[0]->size());
         renderer_.color() = mathfu::kOnes4f;
-        spinmat->Set(renderer_);
-        shader_textured_->Set(renderer_);
-        Mesh::RenderAAQuadAlongX(
-              vec3(-extend.x(),  extend.y(), 0),
-              vec3( extend.x(), -extend.y(), 0),
-              vec2(0, 1), vec2(1, 0));
+        quad_batch_.Add(shader_textured_, spinmat,
+                        vec3(-extend.x(),  extend.y(), 0),
+                        vec3( extend.x(), -extend.y(), 0),
+                        vec2(0, 1), vec2(1, 0));
 
         extend = vec2(logomat->textures()[0]->size()) / 10;
         renderer_.model_view_projection() = ortho_mat *
@@ -1546,17 +3012,17 @@ void PieNoonGame::Run() {
                 vec3(static_cast<float>(mid.x()),
                      static_cast<float>(res.y()) * 0.7f, 0.0f));
         renderer_.color() = mathfu::kOnes4f;
-        logomat->Set(renderer_);
-        shader_textured_->Set(renderer_);
-        Mesh::RenderAAQuadAlongX(
-              vec3(-extend.x(),  extend.y(), 0),
-              vec3( extend.x(), -extend.y(), 0),
-              vec2(0, 1), vec2(1, 0));
+        quad_batch_.Add(shader_textured_, logomat,
+                        vec3(-extend.x(),  extend.y(), 0),
+                        vec3( extend.x(), -extend.y(), 0),
+                        vec2(0, 1), vec2(1, 0));
+        RenderLoadingProgress(ortho_mat);
+        quad_batch_.Flush();
       } // Fallthrough
 
       case kLoadingInitialMaterials:
         // Finalize the materials that have been loaded thus far.
-        matman_.TryFinalize();
+        FinalizeLoadedMaterials();
 
         if (UpdatePieNoonStateAndTransition() == kFinished) {
           game_state_.Reset();
@@ -1564,7 +3030,7 @@ void PieNoonGame::Run() {
         break;
 
       case kTutorial: {
-        matman_.TryFinalize();
+        FinalizeLoadedMaterials();
 
         const bool should_transition =
             full_screen_fader_.Finished(world_time) && AnyControllerPresses();
@@ -1581,13 +3047,20 @@ void PieNoonGame::Run() {
           LoadTutorialSlide(future_slide_index);
         }
 
-        // Draw the slide covering the entire screen.
+        // Draw the slide covering the entire screen, or its preview until
+        // the slide is usable.
         const char* slide_name = TutorialSlideName(tutorial_slide_index_);
         if (slide_name != nullptr) {
-          Material* slide = matman_.FindMaterial(slide_name);
-          if (slide->textures()[0]->id()) {
+          const AssetHandle handle =
+              tutorial_slide_materials_[tutorial_slide_index_];
+          Material* slide = matman_.FindMaterial(handle);
+          Material* preview = matman_.FindPreviewMaterial(handle);
+          if (slide != nullptr && slide->textures()[0]->id()) {
             RenderInMiddleOfScreen(ortho_mat, config.tutorial_aspect_ratio(),
                                    slide);
+          } else if (preview != nullptr && preview->textures()[0]->id()) {
+            RenderInMiddleOfScreen(ortho_mat, config.tutorial_aspect_ratio(),
+                                   preview);
           }
         }
 
@@ -1598,8 +3071,12 @@ void PieNoonGame::Run() {
             // Unload current slide to save memory.
             matman_.UnloadMaterial(slide_name);
 
-            // When completely dark, transition to the next slide.
+            // When completely dark, transition to the next slide. That
+            // brings another slide within the full resolution limit.
             tutorial_slide_index_++;
+            const int max_full_resolution =
+                std::max(config.tutorial_max_full_resolution_slides(), 1);
+            LoadTutorialSlide(tutorial_slide_index_ + max_full_resolution - 1);
           }
         }
 
@@ -1610,7 +3087,50 @@ void PieNoonGame::Run() {
       default:
         assert(false);
     }
+
+    // The first frame that isn't a loading screen ends startup.
+    if (StartupTraceEnabled() && state_ != kLoadingInitialMaterials &&
+        state_ != kLoading) {
+      WriteStartupTrace();
+    }
+
+    // The draw calls are the last frame's, since this one's are counted
+    // until the next swap.
+    if (measure_frame) {
+      benchmark_.AddFrame(HighResolutionSeconds() - frame_start,
+                          AllocationCount() - allocations_at_frame_start,
+                          LastFrameGLStats().calls[kGLCallDraw]);
+    }
+  }
+}
+
+bool PieNoonGame::FinishBenchmark() {
+  const std::vector<BenchmarkMetric> metrics = benchmark_.Results();
+  const std::string results = FormatBenchmarkMetrics(metrics);
+  SDL_Log("benchmark results:\n%s", results.c_str());
+  if (!SaveFile(benchmark_file_name_.c_str(), results.c_str(),
+                results.size())) {
+    return false;
+  }
+  if (baseline_file_name_.empty())
+    return true;
+
+  std::string baseline_text;
+  std::vector<BenchmarkBaseline> baselines;
+  if (!LoadFile(baseline_file_name_.c_str(), &baseline_text) ||
+      !ParseBenchmarkBaseline(baseline_text, &baselines)) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "can't read the baseline %s\n",
+                 baseline_file_name_.c_str());
+    return false;
+  }
+  std::vector<std::string> regressions;
+  if (CompareToBaseline(metrics, baselines, &regressions))
+    return true;
+  for (size_t i = 0; i < regressions.size(); ++i) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "benchmark regression: %s\n",
+                 regressions[i].c_str());
   }
+  return false;
 }
 
 }  // pie_noon
@@ -21,16 +21,29 @@
 
 #include "ai_controller.h"
 #include "audio_engine.h"
+#include "frame_pacer.h"
 #include "full_screen_fader.h"
 #include "game_state.h"
+#include "gpu_particles.h"
 #include "gui_menu.h"
+#include "idle_throttle.h"
 #include "input.h"
+#include "input_recording.h"
+#include "mapped_file.h"
 #include "material_manager.h"
+#include "memory_tracker.h"
 #include "player_controller.h"
+#include "quad_batch.h"
+#include "render_queue.h"
 #include "renderer.h"
+#include "replay_benchmark.h"
+#include "replay_controller.h"
+#include "resolution_scaler.h"
+#include "runtime_config.h"
 #include "scene_description.h"
 #include "touchscreen_button.h"
 #include "touchscreen_controller.h"
+#include "update_thread.h"
 #ifdef ANDROID_GAMEPAD
 #include "gamepad_controller.h"
 #endif // ANDROID_GAMEPAD
@@ -41,8 +54,10 @@
 namespace fpl {
 namespace pie_noon {
 
+struct BakedQuad;
 struct Config;
 class CharacterStateMachine;
+struct CardboardMeshes;
 struct RenderingAssets;
 
 enum PieNoonState {
@@ -63,24 +78,107 @@ class PieNoonGame {
   bool Initialize(const char* const binary_directory);
   void Run();
 
+  // Record the inputs of every match to 'filename', overwriting the previous
+  // match. Relative paths are relative to the assets directory.
+  void set_record_file_name(const char* filename) {
+    record_file_name_ = filename;
+  }
+
+  // Skip the menus and play back the match recorded in 'filename' instead of
+  // reading the controllers, then exit. Call after Initialize().
+  bool LoadReplay(const char* filename);
+
+  // Measure the frames of the replay, running them as fast as possible, and
+  // write the results to 'filename' in FinishBenchmark(). Relative paths are
+  // relative to the assets directory. Call before Initialize().
+  void set_benchmark_file_name(const char* filename) {
+    benchmark_file_name_ = filename;
+  }
+  bool benchmarking() const { return !benchmark_file_name_.empty(); }
+
+  // Compare the benchmark results with the baseline in 'filename', in the
+  // format read by ParseBenchmarkBaseline(). Call before Initialize().
+  void set_baseline_file_name(const char* filename) {
+    baseline_file_name_ = filename;
+  }
+
+  // Hide the window while benchmarking. Call before Initialize().
+  void set_benchmark_offscreen(bool offscreen) {
+    benchmark_offscreen_ = offscreen;
+  }
+
+  // Write the results of the benchmark, after Run() returns. Returns false
+  // if they can't be written, or if they regressed from the baseline.
+  bool FinishBenchmark();
+
+  // Number of renderables that were drawn, and that were skipped because
+  // they were outside the view, in the last frame.
+  struct CullCounts {
+    CullCounts() : visible(0), culled(0) {}
+    int visible;
+    int culled;
+  };
+  const CullCounts& last_cull_counts() const { return last_cull_counts_; }
+
  private:
+  // Particles spawned by one SimulateFrame(), for the GPU particle system.
+  struct GpuParticleFrame {
+    GpuParticleFrame() : reset(false), time(0) {}
+
+    std::vector<GpuParticleSpawn> spawns;
+
+    // The game was reset, so every earlier particle should be cleared.
+    bool reset;
+
+    // Game time of the scene.
+    WorldTime time;
+  };
+
+  // Corners and texture coordinates of a cardboard quad, in the vertex order
+  // of QuadBatch::Add().
+  struct CardboardQuad {
+    vec3 corners[4];
+    vec2 tex_coords[4];
+  };
+
   bool InitializeConfig();
   bool InitializeRenderer();
   Mesh* CreateVerticalQuadMesh(const flatbuffers::String* material_name,
                                const vec3& offset, const vec2& pixel_bounds,
-                               float pixel_to_world_scale);
+                               float pixel_to_world_scale,
+                               CardboardQuad* quad = nullptr);
+  Mesh* CreateBakedQuadMesh(const BakedQuad* baked,
+                            CardboardQuad* quad = nullptr);
+  const CardboardMeshes* LoadBakedCardboardMeshes(MappedFile* file) const;
   bool InitializeRenderingAssets();
   bool InitializeGameState();
   void RenderCardboard(const SceneDescription& scene,
                        const mat4& camera_transform);
-  void Render(const SceneDescription& scene);
+  void RenderCardboardInstanced(const SceneDescription& scene,
+                                const mat4& camera_transform);
+  void CullRenderables(const SceneDescription& scene,
+                       const mat4& camera_transform);
+  void RenderShadows(const SceneDescription& scene,
+                     const mat4& camera_transform);
+  bool BakeSplatterOverlay(int key);
+  void BakeSplatterOverlays(const SceneDescription& scene);
+  bool BeginSceneTarget();
+  void EndSceneTarget();
+  void RenderGpuParticles(GpuParticleFrame* frame,
+                          const mat4& camera_transform);
+  void Render(const SceneDescription& scene, GpuParticleFrame* particles);
   void Render2DElements();
+  void RenderGpuProfile();
+  void RenderGLStats();
+  void RenderMemoryStats();
+  void UpdateSceneMemory();
   void DebugPrintCharacterStates();
   void DebugPrintPieStates();
   void DebugCamera();
   const Config& GetConfig() const;
   const CharacterStateMachineDef* GetStateMachine() const;
   Mesh* GetCardboardFront(int renderable_id);
+  Shader* TexturedShader(const Material& material) const;
   PieNoonState UpdatePieNoonState();
   void TransitionToPieNoonState(PieNoonState next_state);
   PieNoonState UpdatePieNoonStateAndTransition();
@@ -99,6 +197,14 @@ class PieNoonGame {
   PieNoonState HandleMenuButtons();
   //void HandleMenuButton(Controller* controller, TouchscreenButton* button);
   void UpdateControllers(WorldTime delta_time);
+  void LatchInput();
+  bool FrameWasQuiet() const;
+  float AdvanceGameState(WorldTime delta_time);
+  static void AdvanceGameStateStep(WorldTime step, void* context);
+  void SimulateFrame();
+  void StartRecordingOrReplay();
+  WorldTime RecordOrReplayFrame(WorldTime delta_time);
+  static void SimulateFrameJob(void* context);
   void UpdateTouchButtons(WorldTime delta_time);
   ChannelId PlayStinger();
   ButtonId CurrentlyAnimatingJoinImage(WorldTime time) const;
@@ -106,6 +212,8 @@ class PieNoonGame {
   bool AnyControllerPresses();
   void LoadTutorialSlide(int slide_index);
   void LoadInitialTutorialSlides();
+  bool FinalizeLoadedMaterials();
+  void RenderLoadingProgress(const mathfu::mat4& ortho_mat);
   void RenderInMiddleOfScreen(const mathfu::mat4& ortho_mat, float x_scale,
                               Material* material);
 
@@ -122,7 +230,10 @@ class PieNoonGame {
   WorldTime state_entry_time_;
 
   // Hold configuration binary data.
-  std::string config_source_;
+  MappedFile config_file_;
+
+  // The values of the config that are read every frame.
+  RuntimeConfig runtime_config_;
 
   // Report touches, button presses, keyboard presses.
   InputSystem input_;
@@ -140,22 +251,105 @@ class PieNoonGame {
   std::vector<Mesh*> cardboard_fronts_;
   std::vector<Mesh*> cardboard_backs_;
 
+  // Copies of the quads in cardboard_fronts_, which RenderShadows() moves
+  // into world space to draw every shadow in one batch.
+  std::vector<CardboardQuad> cardboard_front_quads_;
+
+  // Object space bounding sphere of each renderable's cardboard and stick,
+  // as (center, radius).
+  std::vector<vec4> cardboard_bounds_;
+
+  // Indices of the renderables in the scene that CullRenderables() found
+  // inside the view, in scene order. The cardboard passes only draw these.
+  std::vector<int> visible_renderables_;
+  CullCounts last_cull_counts_;
+
   // Rendering mesh for front and back of the stick that props cardboard.
   Mesh* stick_front_;
   Mesh* stick_back_;
 
+  // Holds the vertices and indices of all of the cardboard and stick meshes,
+  // so that drawing them never rebinds buffers.
+  MeshPool cardboard_mesh_pool_;
+
   // Shaders we use.
   Shader* shader_cardboard;
   Shader* shader_lit_textured_normal_;
   Shader* shader_simple_shadow_;
   Shader* shader_textured_;
   Shader* shader_grayscale_;
+  Shader* shader_particle_;
+  Shader* shader_color_;
+  Shader* shader_cardboard_instanced_;
+  Shader* shader_textured_instanced_;
+
+  // Variants of the shaders above, with fewer or more ShaderFeatures. The
+  // overlay variant is only loaded when the config's bake_splatters is set.
+  Shader* shader_textured_opaque_;
+  Shader* shader_cardboard_overlay_;
+
+  // Handle of shader_cardboard_overlay_'s overlay_transform, or -1.
+  int overlay_transform_uniform_;
 
   // Shadow material.
   Material* shadow_mat_;
 
+  // Materials found every frame, resolved by InitializeRenderingAssets().
+  AssetHandle ground_material_;
+  AssetHandle loading_material_;
+  AssetHandle loading_logo_;
+
+  // The material of each tutorial slide, in order.
+  std::vector<AssetHandle> tutorial_slide_materials_;
+
+  // Uniforms of one renderable, shared by the draws of its pieces in
+  // RenderCardboard().
+  struct CardboardUniforms {
+    mat4 mvp;
+    vec3 camera_pos;
+    vec3 light_pos;
+    vec4 color;
+
+    // The front's baked splatters, when there are any, or 0. The transform
+    // takes object space xy to the texture's uv, as (scale, bias).
+    GLuint overlay_texture;
+    vec4 overlay_transform;
+  };
+
+  // Scratch space for RenderCardboard(), kept between frames to avoid
+  // allocating.
+  RenderQueue render_queue_;
+  std::vector<CardboardUniforms> cardboard_uniforms_;
+
+  // The inverse of a renderable's world matrix, and that world matrix.
+  struct CachedInverse {
+    CachedInverse() : world(0.0f), inverse(0.0f) {}
+    mat4 world;
+    mat4 inverse;
+  };
+
+  // By renderable index. Renderables that keep their index and world matrix
+  // from one frame to the next, such as props and idle characters, reuse
+  // the last inverse.
+  std::vector<CachedInverse> cardboard_inverses_;
+
+  // Adjacent renderables with the same id, drawn by one instanced call.
+  struct CardboardBatch {
+    int id;
+    int first_instance;
+    int num_instances;
+  };
+
+  // Scratch space for RenderCardboardInstanced(), kept between frames to
+  // avoid allocating.
+  std::vector<CardboardBatch> cardboard_batches_;
+  std::vector<MeshInstance> cardboard_instances_;
+
+  // Holds cardboard_instances_ on the GPU. Created on first use.
+  GLuint cardboard_instance_vbo_;
+
   // Hold state machine binary data.
-  std::string state_machine_source_;
+  MappedFile state_machine_file_;
 
   // Hold characters, pies, camera state.
   GameState game_state_;
@@ -164,9 +358,29 @@ class PieNoonGame {
   // unchanging ID.
   std::vector<std::unique_ptr<Controller>> active_controllers_;
 
-  // Description of the scene to be rendered. Isolates gameplay and rendering
+  // Descriptions of the scene to be rendered. Isolates gameplay and rendering
   // code with a type-light structure. Recreated every frame.
-  SceneDescription scene_;
+  // scenes_[scene_to_draw_] is drawn while the other one is filled by
+  // SimulateFrame(), possibly on update_thread_.
+  SceneDescription scenes_[2];
+  int scene_to_draw_;
+
+  // Particles spawned while building the corresponding scenes_ entry, when
+  // the config's gpu_particles is set.
+  GpuParticleFrame gpu_particle_frames_[2];
+
+  // Draws the particles in gpu_particle_frames_.
+  GpuParticles gpu_particles_;
+
+  // Draws the HUD and loading screen quads, a run of quads at a time.
+  QuadBatch quad_batch_;
+
+  // Runs SimulateFrame() while the main thread renders, when the config's
+  // simulate_while_rendering is set.
+  UpdateThread update_thread_;
+
+  // Real-world time to simulate in the next SimulateFrame().
+  WorldTime simulate_delta_time_;
 
   // World time of previous update. We use this to calculate the delta_time
   // of the current update. This value is tied to the real-world clock.
@@ -175,6 +389,53 @@ class PieNoonGame {
   // prev_world_time_ will keep chugging.
   WorldTime prev_world_time_;
 
+  // Decides when each iteration of Run() starts.
+  FramePacer frame_pacer_;
+
+  // Decides when nothing is happening, so Run() can slow down to save power.
+  IdleThrottle idle_throttle_;
+
+  // When the config's dynamic_resolution is set, the 3D scene is drawn into
+  // scene_target_, at the resolution_scaler_'s fraction of the window size,
+  // whenever that is less than all of it.
+  ResolutionScaler resolution_scaler_;
+  RenderTarget scene_target_;
+
+  // When the config's bake_splatters is set, each entry of splatter_map
+  // drawn into its own texture. Baked the first time a scene needs them, so
+  // texture is 0 until then.
+  std::vector<RenderTarget> splatter_overlays_;
+
+  // Elapsed time not yet simulated when running with a fixed_update_time.
+  // Always less than one step.
+  WorldTime fixed_update_remainder_;
+
+  // The characters' controllers, whose edges only the first fixed step
+  // sees. Kept so that gathering them doesn't allocate every frame.
+  std::vector<Controller*> step_controllers_;
+
+  // Fraction of the way from the previous simulation state to the current
+  // one that is drawn. See GameState::PopulateScene().
+  float render_interpolation_;
+
+  // The inputs of the current match, when recording, or of the match being
+  // replayed.
+  InputRecording recording_;
+  std::string record_file_name_;
+  bool replaying_;
+
+  // The results of benchmarking the replay, and where they go.
+  ReplayBenchmark benchmark_;
+  std::string benchmark_file_name_;
+  std::string baseline_file_name_;
+  bool benchmark_offscreen_;
+
+  // Number of frames of the current match recorded or replayed so far.
+  int match_frame_;
+
+  // Drive the characters while replaying, one per character.
+  std::vector<std::unique_ptr<ReplayController>> replay_controllers_;
+
   // Debug data. For displaying when a character's state has changed.
   std::vector<int> debug_previous_states_;
   std::vector<Angle> debug_previous_angles_;
@@ -204,11 +465,20 @@ class PieNoonGame {
 
   int next_achievement_index_;
 
+  // Count config_file_ and state_machine_file_, and the scene buffers, as
+  // of the last frame.
+  TrackedMemory flatbuffer_memory_;
+  TrackedMemory scene_memory_;
+
   // String version number of the game.
   const char *version_;
 
 # ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
   GPGManager gpg_manager;
+
+  // Last value of the "logged_in" preference, so it's only written when it
+  // changes.
+  int logged_in_preference_;
 # endif
 };
 
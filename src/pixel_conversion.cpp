@@ -0,0 +1,271 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "pixel_conversion.h"
+
+#include <string.h>
+
+#if !defined(PIXEL_CONVERSION_SIMD_DISABLE) && \
+    (defined(__SSE2__) || defined(_M_X64) || \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+  #define PIXEL_CONVERSION_SSE2 1
+  #include <emmintrin.h>
+  #if defined(__SSSE3__)
+    #define PIXEL_CONVERSION_SSSE3 1
+    #include <tmmintrin.h>
+  #endif
+#elif !defined(PIXEL_CONVERSION_SIMD_DISABLE) && \
+    (defined(__ARM_NEON__) || defined(__ARM_NEON))
+  #define PIXEL_CONVERSION_NEON 1
+  #include <arm_neon.h>
+#endif
+
+namespace fpl {
+
+// The SIMD loops below convert as many pixels as they can, and return how
+// many. The scalar code finishes the rest.
+
+#if defined(PIXEL_CONVERSION_SSE2)
+
+static size_t BgrToRgbSimd(const uint8_t *src, uint8_t *dest, size_t count) {
+#if defined(PIXEL_CONVERSION_SSSE3)
+  // Swizzle four pixels at a time. Each store writes a pixel and a third
+  // past them, which the next iteration overwrites, so stop 16 bytes from
+  // the end.
+  const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9,
+                                        12, 13, 14, 15);
+  size_t i = 0;
+  for (; 3 * i + 16 <= 3 * count; i += 4) {
+    const __m128i pixels =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 3 * i));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + 3 * i),
+                     _mm_shuffle_epi8(pixels, shuffle));
+  }
+  return i;
+#else
+  // SSE2 can't shuffle bytes, and three byte pixels don't line up with its
+  // lanes.
+  (void)src;
+  (void)dest;
+  (void)count;
+  return 0;
+#endif
+}
+
+static size_t BgraToRgbaSimd(const uint8_t *src, uint8_t *dest,
+                             size_t count) {
+  const __m128i green_alpha = _mm_set1_epi32(static_cast<int>(0xFF00FF00));
+  const __m128i low_byte = _mm_set1_epi32(0xFF);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m128i p =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 4 * i));
+    const __m128i swapped = _mm_or_si128(
+        _mm_and_si128(p, green_alpha),
+        _mm_or_si128(_mm_slli_epi32(_mm_and_si128(p, low_byte), 16),
+                     _mm_and_si128(_mm_srli_epi32(p, 16), low_byte)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + 4 * i), swapped);
+  }
+  return i;
+}
+
+// Narrow two vectors of 32 bit lanes, each holding a 16 bit value, to one
+// vector of 16 bit lanes. _mm_packs_epi32 saturates signed values, so sign
+// extend the low halves first.
+static __m128i Pack16(__m128i a, __m128i b) {
+  return _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16),
+                         _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+}
+
+// Pixels are 0xAABBGGRR in each 32 bit lane.
+static __m128i PixelsTo5551(__m128i p) {
+  const __m128i r = _mm_slli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xF8)), 8);
+  const __m128i g =
+      _mm_srli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xF800)), 5);
+  const __m128i b =
+      _mm_srli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xF80000)), 18);
+  const __m128i a = _mm_srli_epi32(p, 31);
+  return _mm_or_si128(_mm_or_si128(r, g), _mm_or_si128(b, a));
+}
+
+// Pixels are 0x..BBGGRR in each 32 bit lane. The top byte is ignored.
+static __m128i PixelsTo565(__m128i p) {
+  const __m128i r = _mm_slli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xF8)), 8);
+  const __m128i g =
+      _mm_srli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xFC00)), 5);
+  const __m128i b =
+      _mm_srli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xF80000)), 19);
+  return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+static size_t RgbaTo5551Simd(const uint8_t *src, uint16_t *dest,
+                             size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m128i *in = reinterpret_cast<const __m128i *>(src + 4 * i);
+    const __m128i texels = Pack16(PixelsTo5551(_mm_loadu_si128(in)),
+                                  PixelsTo5551(_mm_loadu_si128(in + 1)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i), texels);
+  }
+  return i;
+}
+
+// Read the three byte pixel at 'p', and the byte after it.
+static int32_t LoadPixel(const uint8_t *p) {
+  int32_t pixel;
+  memcpy(&pixel, p, sizeof(pixel));
+  return pixel;
+}
+
+static size_t RgbTo565Simd(const uint8_t *src, uint16_t *dest, size_t count) {
+  // Each pixel is read with the byte after it, so stop before the last one.
+  size_t i = 0;
+  for (; i + 8 < count; i += 8) {
+    const uint8_t *p = src + 3 * i;
+    const __m128i low = _mm_set_epi32(LoadPixel(p + 9), LoadPixel(p + 6),
+                                      LoadPixel(p + 3), LoadPixel(p));
+    const __m128i high = _mm_set_epi32(LoadPixel(p + 21), LoadPixel(p + 18),
+                                       LoadPixel(p + 15), LoadPixel(p + 12));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i),
+                     Pack16(PixelsTo565(low), PixelsTo565(high)));
+  }
+  return i;
+}
+
+#elif defined(PIXEL_CONVERSION_NEON)
+
+// NEON loads and stores interleaved channels directly, sixteen pixels at a
+// time.
+static size_t BgrToRgbSimd(const uint8_t *src, uint8_t *dest, size_t count) {
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    uint8x16x3_t p = vld3q_u8(src + 3 * i);
+    const uint8x16_t blue = p.val[0];
+    p.val[0] = p.val[2];
+    p.val[2] = blue;
+    vst3q_u8(dest + 3 * i, p);
+  }
+  return i;
+}
+
+static size_t BgraToRgbaSimd(const uint8_t *src, uint8_t *dest,
+                             size_t count) {
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    uint8x16x4_t p = vld4q_u8(src + 4 * i);
+    const uint8x16_t blue = p.val[0];
+    p.val[0] = p.val[2];
+    p.val[2] = blue;
+    vst4q_u8(dest + 4 * i, p);
+  }
+  return i;
+}
+
+// Widen each channel to the top byte of a 16 bit lane, then shift the
+// channels into place, each keeping the bits above it.
+static uint16x8_t To5551(uint8x8_t r, uint8x8_t g, uint8x8_t b,
+                         uint8x8_t a) {
+  uint16x8_t texel = vsriq_n_u16(vshll_n_u8(r, 8), vshll_n_u8(g, 8), 5);
+  texel = vsriq_n_u16(texel, vshll_n_u8(b, 8), 10);
+  return vsriq_n_u16(texel, vshll_n_u8(a, 8), 15);
+}
+
+static uint16x8_t To565(uint8x8_t r, uint8x8_t g, uint8x8_t b) {
+  const uint16x8_t texel =
+      vsriq_n_u16(vshll_n_u8(r, 8), vshll_n_u8(g, 8), 5);
+  return vsriq_n_u16(texel, vshll_n_u8(b, 8), 11);
+}
+
+static size_t RgbaTo5551Simd(const uint8_t *src, uint16_t *dest,
+                             size_t count) {
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const uint8x16x4_t p = vld4q_u8(src + 4 * i);
+    vst1q_u16(dest + i, To5551(vget_low_u8(p.val[0]), vget_low_u8(p.val[1]),
+                               vget_low_u8(p.val[2]), vget_low_u8(p.val[3])));
+    vst1q_u16(dest + i + 8,
+              To5551(vget_high_u8(p.val[0]), vget_high_u8(p.val[1]),
+                     vget_high_u8(p.val[2]), vget_high_u8(p.val[3])));
+  }
+  return i;
+}
+
+static size_t RgbTo565Simd(const uint8_t *src, uint16_t *dest, size_t count) {
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const uint8x16x3_t p = vld3q_u8(src + 3 * i);
+    vst1q_u16(dest + i, To565(vget_low_u8(p.val[0]), vget_low_u8(p.val[1]),
+                              vget_low_u8(p.val[2])));
+    vst1q_u16(dest + i + 8, To565(vget_high_u8(p.val[0]),
+                                  vget_high_u8(p.val[1]),
+                                  vget_high_u8(p.val[2])));
+  }
+  return i;
+}
+
+#else
+
+static size_t BgrToRgbSimd(const uint8_t *, uint8_t *, size_t) { return 0; }
+static size_t BgraToRgbaSimd(const uint8_t *, uint8_t *, size_t) {
+  return 0;
+}
+static size_t RgbaTo5551Simd(const uint8_t *, uint16_t *, size_t) {
+  return 0;
+}
+static size_t RgbTo565Simd(const uint8_t *, uint16_t *, size_t) { return 0; }
+
+#endif
+
+void ConvertBgrToRgb(const uint8_t *src, uint8_t *dest, size_t count) {
+  for (size_t i = BgrToRgbSimd(src, dest, count); i < count; ++i) {
+    const uint8_t *c = &src[i * 3];
+    uint8_t *p = &dest[i * 3];
+    p[0] = c[2];
+    p[1] = c[1];
+    p[2] = c[0];
+  }
+}
+
+void ConvertBgraToRgba(const uint8_t *src, uint8_t *dest, size_t count) {
+  for (size_t i = BgraToRgbaSimd(src, dest, count); i < count; ++i) {
+    const uint8_t *c = &src[i * 4];
+    uint8_t *p = &dest[i * 4];
+    p[0] = c[2];
+    p[1] = c[1];
+    p[2] = c[0];
+    p[3] = c[3];
+  }
+}
+
+void ConvertRgbaTo5551(const uint8_t *src, uint16_t *dest, size_t count) {
+  for (size_t i = RgbaTo5551Simd(src, dest, count); i < count; ++i) {
+    const uint8_t *c = &src[i * 4];
+    dest[i] = static_cast<uint16_t>(((c[0] >> 3) << 11) |
+                                    ((c[1] >> 3) << 6) |
+                                    ((c[2] >> 3) << 1) |
+                                    ((c[3] >> 7) << 0));
+  }
+}
+
+void ConvertRgbTo565(const uint8_t *src, uint16_t *dest, size_t count) {
+  for (size_t i = RgbTo565Simd(src, dest, count); i < count; ++i) {
+    const uint8_t *c = &src[i * 3];
+    dest[i] = static_cast<uint16_t>(((c[0] >> 3) << 11) |
+                                    ((c[1] >> 2) << 5) |
+                                    ((c[2] >> 3) << 0));
+  }
+}
+
+}  // fpl
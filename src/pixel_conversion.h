@@ -0,0 +1,41 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef FPL_PIXEL_CONVERSION_H
+#define FPL_PIXEL_CONVERSION_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace fpl {
+
+// Conversions between the pixel layouts of texture files and of OpenGL
+// textures. Each converts 'count' pixels from 'src' to 'dest', which must
+// not overlap. They use SSE2, SSSE3 or NEON where the compiler targets it,
+// unless PIXEL_CONVERSION_SIMD_DISABLE is defined, and give the same results
+// as the scalar code either way.
+
+// Reverse the order of the color channels, as TGA files store BGR.
+void ConvertBgrToRgb(const uint8_t *src, uint8_t *dest, size_t count);
+void ConvertBgraToRgba(const uint8_t *src, uint8_t *dest, size_t count);
+
+// Pack 8 bits per channel into 16 bit texels, for GL_UNSIGNED_SHORT_5_5_5_1
+// and GL_UNSIGNED_SHORT_5_6_5, by dropping the low bits of each channel.
+void ConvertRgbaTo5551(const uint8_t *src, uint16_t *dest, size_t count);
+void ConvertRgbTo565(const uint8_t *src, uint16_t *dest, size_t count);
+
+}  // fpl
+
+#endif  // FPL_PIXEL_CONVERSION_H
@@ -64,6 +64,10 @@ class PlayerController : public Controller {
   // Map the input from the physical inputs to logical game inputs.
   virtual void AdvanceFrame(WorldTime delta_time);
 
+  // The InputSystem's buttons accumulate over the frame, so reading them
+  // again picks up anything that arrived since AdvanceFrame().
+  virtual void LatchInput() { AdvanceFrame(0); }
+
  private:
   // A pointer to the object to query for the current input state.
   InputSystem* input_system_;
@@ -0,0 +1,102 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "program_binary.h"
+
+#include <cstring>
+
+namespace fpl {
+
+// "FPLB", then a version that changes whenever the layout does, or what
+// goes into the key.
+static const uint32_t kProgramBinaryMagic = 0x424C5046;
+static const uint32_t kProgramBinaryVersion = 2;
+
+// Starts every cache file. Written in the device's own byte order, since a
+// binary never moves between devices.
+struct ProgramBinaryHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  uint32_t format;
+  uint32_t size;
+};
+
+// 64-bit FNV-1a.
+static const uint64_t kFnvOffsetBasis = 14695981039346656037ULL;
+static const uint64_t kFnvPrime = 1099511628211ULL;
+
+static uint64_t HashString(uint64_t hash, const char *s) {
+  // Include the terminator, so that moving text from one string to the next
+  // changes the hash.
+  do {
+    hash = (hash ^ static_cast<uint8_t>(*s)) * kFnvPrime;
+  } while (*s++);
+  return hash;
+}
+
+uint64_t ProgramBinaryKey(const char *driver, const char *attributes,
+                          const char *vs_source, const char *ps_source) {
+  uint64_t hash = kFnvOffsetBasis;
+  for (int shift = 0; shift < 32; shift += 8) {
+    hash = (hash ^ ((kProgramBinaryVersion >> shift) & 0xFF)) * kFnvPrime;
+  }
+  hash = HashString(hash, driver);
+  hash = HashString(hash, attributes);
+  hash = HashString(hash, vs_source);
+  return HashString(hash, ps_source);
+}
+
+std::string ProgramBinaryFileName(uint64_t key) {
+  static const char kHexDigits[] = "0123456789abcdef";
+  std::string name("shader_");
+  for (int shift = 60; shift >= 0; shift -= 4) {
+    name += kHexDigits[(key >> shift) & 0xF];
+  }
+  return name + ".bin";
+}
+
+void PackProgramBinary(uint64_t key, uint32_t format, const void *binary,
+                       size_t size, std::string *file) {
+  ProgramBinaryHeader header;
+  header.magic = kProgramBinaryMagic;
+  header.version = kProgramBinaryVersion;
+  header.key = key;
+  header.format = format;
+  header.size = static_cast<uint32_t>(size);
+  file->assign(reinterpret_cast<const char *>(&header), sizeof(header));
+  file->append(static_cast<const char *>(binary), size);
+}
+
+bool UnpackProgramBinary(const std::string &file, uint64_t key,
+                         uint32_t *format, const uint8_t **binary,
+                         size_t *size) {
+  ProgramBinaryHeader header;
+  if (file.size() < sizeof(header)) return false;
+  memcpy(&header, file.data(), sizeof(header));
+  // LoadFile() appends a terminator, so the file may be longer than the
+  // binary, but never shorter.
+  if (header.magic != kProgramBinaryMagic ||
+      header.version != kProgramBinaryVersion || header.key != key ||
+      header.size == 0 || file.size() - sizeof(header) < header.size) {
+    return false;
+  }
+  *format = header.format;
+  *binary = reinterpret_cast<const uint8_t *>(file.data()) + sizeof(header);
+  *size = header.size;
+  return true;
+}
+
+}  // fpl
@@ -0,0 +1,59 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef PROGRAM_BINARY_H
+#define PROGRAM_BINARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace fpl {
+
+// Files that cache a linked shader program, in whatever form the driver
+// returns from glGetProgramBinary(), so that later launches can skip
+// compiling it.
+//
+// A binary is only good for the driver that made it, and keeps the
+// attribute locations it was linked with, so each file starts with a key
+// made from the shader source, the attribute bindings and the driver's
+// version. A file whose key doesn't match is out of date, and the program is
+// compiled from source again.
+
+// Hash of the shader source, the cache format version, 'attributes', a
+// string that lists the attribute locations bound before linking, and
+// 'driver', a string that changes whenever the driver does, such as
+// GL_VENDOR, GL_RENDERER and GL_VERSION together.
+uint64_t ProgramBinaryKey(const char *driver, const char *attributes,
+                          const char *vs_source, const char *ps_source);
+
+// Name of the cache file for 'key', such as "shader_0123456789abcdef.bin".
+std::string ProgramBinaryFileName(uint64_t key);
+
+// Make the contents of a cache file, from the 'size' bytes of 'binary' in
+// the driver's 'format'.
+void PackProgramBinary(uint64_t key, uint32_t format, const void *binary,
+                       size_t size, std::string *file);
+
+// Find the program binary in a cache file. Returns false if the file is
+// damaged, from another version of this code, or doesn't match 'key'.
+// 'binary' points into 'file'.
+bool UnpackProgramBinary(const std::string &file, uint64_t key,
+                         uint32_t *format, const uint8_t **binary,
+                         size_t *size);
+
+}  // fpl
+
+#endif  // PROGRAM_BINARY_H
@@ -0,0 +1,179 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "precompiled.h"
+#include "quad_batch.h"
+#include "material.h"
+#include "renderer.h"
+#include "shader.h"
+
+namespace fpl {
+
+static const int kVerticesPerQuad = 4;
+static const int kIndicesPerQuad = 6;
+
+const int QuadBatch::kMaxQuadsPerDraw;
+
+QuadBatch::QuadBatch()
+    : renderer_(nullptr), vbo_(0), ibo_(0), max_quads_(0), vbo_position_(0),
+      shader_(nullptr), material_(nullptr),
+      model_view_projection_(mat4::Identity()), color_(mathfu::kOnes4f),
+      num_quads_(0), num_draws_(0) {}
+
+QuadBatch::~QuadBatch() {
+  if (renderer_ == nullptr) return;
+  renderer_->DeleteBuffer(vbo_);
+  renderer_->DeleteBuffer(ibo_);
+}
+
+void QuadBatch::Initialize(Renderer *renderer, int max_quads) {
+  assert(renderer_ == nullptr);
+  assert(0 < max_quads && max_quads <= kMaxQuadsPerDraw);
+  renderer_ = renderer;
+  max_quads_ = max_quads;
+  vertices_.reserve(max_quads * kVerticesPerQuad);
+
+  GL_CALL(glGenBuffers(1, &vbo_));
+  renderer_->BindBuffer(GL_ARRAY_BUFFER, vbo_);
+  GL_CALL(glBufferData(GL_ARRAY_BUFFER,
+                       max_quads * kVerticesPerQuad * sizeof(Vertex),
+                       nullptr, GL_STREAM_DRAW));
+
+  // Every draw starts at the first quad of its vertices, so one index buffer
+  // serves them all. Same winding as Mesh::RenderAAQuadAlongX().
+  std::vector<unsigned short> indices(max_quads * kIndicesPerQuad);
+  for (int i = 0; i < max_quads; ++i) {
+    const unsigned short v = static_cast<unsigned short>(i * kVerticesPerQuad);
+    unsigned short *quad = &indices[i * kIndicesPerQuad];
+    quad[0] = v;
+    quad[1] = v + 1;
+    quad[2] = v + 2;
+    quad[3] = v + 1;
+    quad[4] = v + 2;
+    quad[5] = v + 3;
+  }
+  GL_CALL(glGenBuffers(1, &ibo_));
+  renderer_->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_);
+  GL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                       indices.size() * sizeof(indices[0]), &indices[0],
+                       GL_STATIC_DRAW));
+  CountGLBufferUpload(indices.size() * sizeof(indices[0]));
+}
+
+bool QuadBatch::MatchesQueued(const Shader *shader,
+                              const Material *material) const {
+  if (shader != shader_ || !material->SameState(*material_)) return false;
+  const mat4 &mvp = renderer_->model_view_projection();
+  for (int i = 0; i < 16; ++i) {
+    if (mvp[i] != model_view_projection_[i]) return false;
+  }
+  const vec4 &color = renderer_->color();
+  for (int i = 0; i < 4; ++i) {
+    if (color[i] != color_[i]) return false;
+  }
+  return true;
+}
+
+void QuadBatch::PrepareToAdd(Shader *shader, Material *material) {
+  assert(renderer_ != nullptr);
+  const int num_queued =
+      static_cast<int>(vertices_.size()) / kVerticesPerQuad;
+  if (num_queued == max_quads_ ||
+      (num_queued > 0 && !MatchesQueued(shader, material))) {
+    Flush();
+  }
+  if (vertices_.empty()) {
+    shader_ = shader;
+    material_ = material;
+    model_view_projection_ = renderer_->model_view_projection();
+    color_ = renderer_->color();
+  }
+}
+
+void QuadBatch::Add(Shader *shader, Material *material,
+                    const vec3 &bottom_left, const vec3 &top_right,
+                    const vec2 &tex_bottom_left, const vec2 &tex_top_right) {
+  PrepareToAdd(shader, material);
+
+  // Same corners as Mesh::RenderAAQuadAlongX(). The texture coordinates are
+  // moved into the material's part of its atlas, if it has one.
+  Vertex v;
+  v.pos = vec3(bottom_left.x(), bottom_left.y(), bottom_left.z());
+  v.tc = material->MapTextureCoord(tex_bottom_left);
+  vertices_.push_back(v);
+  v.pos = vec3(top_right.x(), bottom_left.y(), bottom_left.z());
+  v.tc = material->MapTextureCoord(
+      vec2(tex_top_right.x(), tex_bottom_left.y()));
+  vertices_.push_back(v);
+  v.pos = vec3(bottom_left.x(), top_right.y(), top_right.z());
+  v.tc = material->MapTextureCoord(
+      vec2(tex_bottom_left.x(), tex_top_right.y()));
+  vertices_.push_back(v);
+  v.pos = vec3(top_right.x(), top_right.y(), top_right.z());
+  v.tc = material->MapTextureCoord(tex_top_right);
+  vertices_.push_back(v);
+}
+
+void QuadBatch::Add(Shader *shader, Material *material, const vec3 *corners,
+                    const vec2 *tex_coords) {
+  PrepareToAdd(shader, material);
+  Vertex v;
+  for (int i = 0; i < kVerticesPerQuad; ++i) {
+    v.pos = corners[i];
+    v.tc = tex_coords[i];
+    vertices_.push_back(v);
+  }
+}
+
+void QuadBatch::Flush() {
+  if (vertices_.empty()) return;
+  const int num_quads = static_cast<int>(vertices_.size()) / kVerticesPerQuad;
+
+  // The shader reads its uniforms from the renderer, so restore the ones
+  // the quads were added with.
+  const mat4 mvp = renderer_->model_view_projection();
+  const vec4 color = renderer_->color();
+  renderer_->model_view_projection() = model_view_projection_;
+  renderer_->color() = color_;
+  shader_->Set(*renderer_);
+  material_->Set(*renderer_);
+
+  // Write after the previous draw's vertices. When they don't fit, give the
+  // driver a fresh buffer rather than overwriting one it may still read.
+  renderer_->BindBuffer(GL_ARRAY_BUFFER, vbo_);
+  if (vbo_position_ + num_quads > max_quads_) {
+    GL_CALL(glBufferData(GL_ARRAY_BUFFER,
+                         max_quads_ * kVerticesPerQuad * sizeof(Vertex),
+                         nullptr, GL_STREAM_DRAW));
+    vbo_position_ = 0;
+  }
+  const size_t offset = vbo_position_ * kVerticesPerQuad * sizeof(Vertex);
+  GL_CALL(glBufferSubData(GL_ARRAY_BUFFER, offset,
+                          vertices_.size() * sizeof(Vertex), &vertices_[0]));
+  CountGLBufferUpload(vertices_.size() * sizeof(Vertex));
+  static const Attribute kFormat[] = { kPosition3f, kTexCoord2f, kEND };
+  Mesh::RenderBufferRange(*renderer_, GL_TRIANGLES,
+                          num_quads * kIndicesPerQuad, kFormat,
+                          sizeof(Vertex), vbo_, offset, ibo_);
+  vbo_position_ += num_quads;
+
+  renderer_->model_view_projection() = mvp;
+  renderer_->color() = color;
+  vertices_.clear();
+  num_quads_ += num_quads;
+  num_draws_++;
+}
+
+}  // fpl
@@ -0,0 +1,115 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef QUAD_BATCH_H
+#define QUAD_BATCH_H
+
+#include <vector>
+#include "mesh.h"
+
+namespace fpl {
+
+class Material;
+class Renderer;
+class Shader;
+
+// Collects quads, such as the axis-aligned ones Mesh::RenderAAQuadAlongX()
+// draws, and draws runs of them that share a shader, material state, mvp and
+// color in one call. Materials that share an atlas share their state, so
+// their quads can be drawn together.
+//
+// The vertices are streamed into a ring buffer: each Flush() writes after
+// the previous one, and the buffer is orphaned when it wraps, so the driver
+// never has to wait for a draw that is still reading it.
+//
+// Quads are only drawn by Flush(), so call it before drawing anything that
+// doesn't go through the batch, or the quads will end up behind it.
+class QuadBatch {
+ public:
+  // The indices are 16-bit, which limits how many quads one draw can have.
+  static const int kMaxQuadsPerDraw = 65536 / 4;
+
+  QuadBatch();
+  ~QuadBatch();
+
+  // Create the buffers, with room for 'max_quads' quads, which must be at
+  // most kMaxQuadsPerDraw. 'renderer' must outlive the QuadBatch.
+  void Initialize(Renderer *renderer, int max_quads);
+
+  // Queue a quad, with the same arguments as Mesh::RenderAAQuadAlongX(). It
+  // is drawn with the renderer's model_view_projection() and color() as they
+  // are now. Flushes the queued quads first if any of those, the shader or
+  // the material have changed.
+  void Add(Shader *shader, Material *material, const vec3 &bottom_left,
+           const vec3 &top_right, const vec2 &tex_bottom_left = vec2(0, 0),
+           const vec2 &tex_top_right = vec2(1, 1));
+
+  // Queue a quad with any four corners, in the order bottom left, bottom
+  // right, top left, top right. The texture coordinates are used as they
+  // are, so must already be in the material's part of its atlas.
+  void Add(Shader *shader, Material *material, const vec3 *corners,
+           const vec2 *tex_coords);
+
+  // Draw the queued quads. Uniforms other than the mvp and color, such as
+  // the model() matrix, are read from the renderer now.
+  void Flush();
+
+  Renderer *renderer() const { return renderer_; }
+
+  // Number of quads and draw calls since the last ResetCounters().
+  int num_quads() const { return num_quads_; }
+  int num_draws() const { return num_draws_; }
+  void ResetCounters() { num_quads_ = num_draws_ = 0; }
+
+ private:
+  // Disallow copies. The buffers are owned.
+  QuadBatch(const QuadBatch &);
+  QuadBatch &operator=(const QuadBatch &);
+
+  // Same layout as the vertices of Mesh::RenderAAQuadAlongX().
+  struct Vertex {
+    vec3_packed pos;
+    vec2_packed tc;
+  };
+
+  // True if quads added now could be drawn with the queued ones.
+  bool MatchesQueued(const Shader *shader, const Material *material) const;
+
+  // Flush if the quad can't be queued after the queued ones, and take the
+  // state to draw with if the queue is empty.
+  void PrepareToAdd(Shader *shader, Material *material);
+
+  Renderer *renderer_;
+  GLuint vbo_;
+  GLuint ibo_;
+  int max_quads_;
+
+  // Quad in vbo_ that the next Flush() writes to.
+  int vbo_position_;
+
+  // Queued quads, and the state they are drawn with.
+  std::vector<Vertex> vertices_;
+  Shader *shader_;
+  Material *material_;
+  mat4 model_view_projection_;
+  vec4 color_;
+
+  int num_quads_;
+  int num_draws_;
+};
+
+}  // fpl
+
+#endif  // QUAD_BATCH_H
@@ -0,0 +1,72 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "render_queue.h"
+
+namespace fpl {
+
+// Bit positions of the key fields. Bit 63 is always the pass.
+//   opaque:      [pass:1][shader:7][material:16][mesh:16][depth:16][0:8]
+//   translucent: [pass:1][far depth:16][item:16][layer:2][0:29]
+static uint64_t Field(int value, int count, int shift) {
+  assert(0 <= value && value < count);
+  (void)count;
+  return static_cast<uint64_t>(value) << shift;
+}
+
+uint64_t RenderQueue::OpaqueKey(int shader, int material, int mesh,
+                                int depth_bucket) {
+  return Field(kPassOpaque, 2, 63) |
+         Field(shader, kNumShaders, 56) |
+         Field(material, kNumMaterials, 40) |
+         Field(mesh, kNumMeshes, 24) |
+         Field(depth_bucket, kNumDepthBuckets, 8);
+}
+
+uint64_t RenderQueue::TranslucentKey(int depth_bucket, int item, int layer) {
+  const int far_first = kNumDepthBuckets - 1 - depth_bucket;
+  return Field(kPassTranslucent, 2, 63) |
+         Field(far_first, kNumDepthBuckets, 47) |
+         Field(item, kNumItems, 31) |
+         Field(layer, kNumLayers, 29);
+}
+
+int RenderQueue::DepthBucket(float depth, float near_depth,
+                             float far_depth) {
+  const float t = mathfu::Clamp((depth - near_depth) /
+                                (far_depth - near_depth), 0.0f, 1.0f);
+  return static_cast<int>(t * static_cast<float>(kNumDepthBuckets - 1));
+}
+
+void RenderQueue::Add(uint64_t key, int item, Mesh* mesh, Shader* shader,
+                      Material* material) {
+  Draw draw;
+  draw.key = key;
+  draw.item = item;
+  draw.mesh = mesh;
+  draw.shader = shader;
+  draw.material = material;
+  draws_.push_back(draw);
+}
+
+static bool DrawLess(const RenderQueue::Draw& a, const RenderQueue::Draw& b) {
+  return a.key != b.key ? a.key < b.key : a.item < b.item;
+}
+
+void RenderQueue::Sort() {
+  std::stable_sort(draws_.begin(), draws_.end(), DrawLess);
+}
+
+}  // fpl
@@ -0,0 +1,107 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <cstdint>
+#include <vector>
+
+namespace fpl {
+
+class Material;
+class Mesh;
+class Shader;
+
+// Collects draw calls and sorts them by a 64-bit key, so that draws sharing
+// a shader, material or mesh are submitted together and redundant GL state
+// changes can be skipped.
+//
+// Opaque draws are depth tested, so their order doesn't matter. Their keys
+// sort by shader, then material, then mesh, then front to back.
+//
+// Translucent draws are blended, so they must stay back to front. Their
+// keys sort by depth bucket, far first. Within a bucket, the draws are at
+// nearly the same depth, so they keep the order of their items, which
+// draws an object before those in the scene after it, such as its
+// accessories. Then they sort by layer, which orders the pieces of one
+// object. State doesn't go into the key, since each piece of an object has
+// its own layer. Draws with the same item and layer stay in the order they
+// were added.
+//
+// The shader, material and mesh ids in a key are chosen by the caller. Draws
+// with equal ids are assumed to share their state.
+class RenderQueue {
+ public:
+  enum Pass {
+    kPassOpaque,
+    kPassTranslucent
+  };
+
+  // Ranges of the ids packed into a key.
+  static const int kNumDepthBuckets = 1 << 16;
+  static const int kNumItems = 1 << 16;
+  static const int kNumLayers = 1 << 2;
+  static const int kNumShaders = 1 << 7;
+  static const int kNumMaterials = 1 << 16;
+  static const int kNumMeshes = 1 << 16;
+
+  struct Draw {
+    uint64_t key;
+
+    // Caller-defined index of the object being drawn, for example into an
+    // array of per-object uniforms.
+    int item;
+
+    Mesh* mesh;
+    Shader* shader;
+    Material* material;
+  };
+
+  // Sort key for a depth tested draw. 'depth_bucket' comes from
+  // DepthBucket().
+  static uint64_t OpaqueKey(int shader, int material, int mesh,
+                            int depth_bucket);
+
+  // Sort key for a blended draw. 'item' is the draw's item, which orders
+  // draws in the same depth bucket, then 'layer' orders the draws of one
+  // item, lowest first.
+  static uint64_t TranslucentKey(int depth_bucket, int item, int layer);
+
+  // Quantize a distance from the camera into [0, kNumDepthBuckets), with
+  // 'near_depth' mapping to 0 and 'far_depth' to the last bucket.
+  static int DepthBucket(float depth, float near_depth, float far_depth);
+
+  // Extract the pass from a key.
+  static Pass KeyPass(uint64_t key) {
+    return static_cast<Pass>(key >> 63);
+  }
+
+  void Clear() { draws_.clear(); }
+  void Add(uint64_t key, int item, Mesh* mesh, Shader* shader,
+           Material* material);
+
+  // Put the draws in key order. Draws with equal keys are ordered by item,
+  // and then keep the order they were added in.
+  void Sort();
+
+  const std::vector<Draw>& draws() const { return draws_; }
+
+ private:
+  std::vector<Draw> draws_;
+};
+
+}  // fpl
+
+#endif  // RENDER_QUEUE_H
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "precompiled.h"
+#include "pixel_conversion.h"
 #include "renderer.h"
 #include "utilities.h"
 
@@ -96,6 +97,12 @@ bool Renderer::Initialize(const vec2i &window_size, const char *window_title) {
     SDL_GL_SetSwapInterval(1);
   #endif
 
+  SDL_DisplayMode mode;
+  const int display = SDL_GetWindowDisplayIndex(window_);
+  refresh_rate_ =
+      display >= 0 && SDL_GetCurrentDisplayMode(display, &mode) == 0 ?
+      mode.refresh_rate : 0;
+
   #ifndef PLATFORM_MOBILE
   auto exts = (char *)glGetString(GL_EXTENSIONS);
 
@@ -125,10 +132,350 @@ bool Renderer::Initialize(const vec2i &window_size, const char *window_title) {
   #undef GLEXT
   #endif
 
+  InitializeInstancing();
+  InitializeVertexArrays();
+  InitializeCompressedTextures();
+  InitializeTimerQueries();
+  InitializeProgramBinaries();
+  InitializePixelBuffers();
+
+  GL_CALL(glGetIntegerv(GL_FRAMEBUFFER_BINDING, &default_framebuffer_));
+
   blend_mode_ = kBlendModeOff;
   return true;
 }
 
+// Look up the instanced drawing entry points, under the name of whichever
+// GL version or extension provides them. Leaves them null if none does.
+void Renderer::InitializeInstancing() {
+  struct Source {
+    const char *extension;  // nullptr when core in GLES3.
+    const char *divisor;
+    const char *draw;
+  };
+  static const Source kSources[] = {
+    #ifdef PLATFORM_MOBILE
+      { nullptr, "glVertexAttribDivisor", "glDrawElementsInstanced" },
+      { "GL_EXT_instanced_arrays", "glVertexAttribDivisorEXT",
+        "glDrawElementsInstancedEXT" },
+      { "GL_NV_instanced_arrays", "glVertexAttribDivisorNV",
+        "glDrawElementsInstancedNV" },
+      { "GL_ANGLE_instanced_arrays", "glVertexAttribDivisorANGLE",
+        "glDrawElementsInstancedANGLE" },
+    #else
+      { "GL_ARB_instanced_arrays", "glVertexAttribDivisorARB",
+        "glDrawElementsInstancedARB" },
+    #endif
+  };
+
+  fplVertexAttribDivisor = nullptr;
+  fplDrawElementsInstanced = nullptr;
+
+  // Instances read their world matrix from attributes up to
+  // kAttributeWorld3, which GLES2 devices may not have.
+  GLint max_attributes = 0;
+  GL_CALL(glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &max_attributes));
+  if (max_attributes <= Mesh::kAttributeWorld3) return;
+
+  const char *exts = reinterpret_cast<const char *>(
+      glGetString(GL_EXTENSIONS));
+  const char *version = reinterpret_cast<const char *>(
+      glGetString(GL_VERSION));
+  for (size_t i = 0; i < sizeof(kSources) / sizeof(kSources[0]); ++i) {
+    const Source &source = kSources[i];
+    const bool supported = source.extension == nullptr ?
+        version != nullptr && strstr(version, "OpenGL ES 3") != nullptr :
+        exts != nullptr && strstr(exts, source.extension) != nullptr;
+    if (!supported) continue;
+
+    union {
+      void *data;
+      PFNFPLVERTEXATTRIBDIVISORPROC function;
+    } divisor;
+    union {
+      void *data;
+      PFNFPLDRAWELEMENTSINSTANCEDPROC function;
+    } draw;
+    divisor.data = SDL_GL_GetProcAddress(source.divisor);
+    draw.data = SDL_GL_GetProcAddress(source.draw);
+    if (divisor.data && draw.data) {
+      fplVertexAttribDivisor = divisor.function;
+      fplDrawElementsInstanced = draw.function;
+      return;
+    }
+  }
+}
+
+// Look up the vertex array object entry points, the same way as
+// InitializeInstancing(). Leaves them null if no source provides them.
+void Renderer::InitializeVertexArrays() {
+  struct Source {
+    const char *extension;  // nullptr when core in GLES3.
+    const char *gen;
+    const char *bind;
+    const char *del;
+  };
+  static const Source kSources[] = {
+    #ifdef PLATFORM_MOBILE
+      { nullptr, "glGenVertexArrays", "glBindVertexArray",
+        "glDeleteVertexArrays" },
+      { "GL_OES_vertex_array_object", "glGenVertexArraysOES",
+        "glBindVertexArrayOES", "glDeleteVertexArraysOES" },
+    #else
+      { "GL_ARB_vertex_array_object", "glGenVertexArrays",
+        "glBindVertexArray", "glDeleteVertexArrays" },
+      { "GL_APPLE_vertex_array_object", "glGenVertexArraysAPPLE",
+        "glBindVertexArrayAPPLE", "glDeleteVertexArraysAPPLE" },
+    #endif
+  };
+
+  fplGenVertexArrays = nullptr;
+  fplBindVertexArray = nullptr;
+  fplDeleteVertexArrays = nullptr;
+  const char *exts = reinterpret_cast<const char *>(
+      glGetString(GL_EXTENSIONS));
+  const char *version = reinterpret_cast<const char *>(
+      glGetString(GL_VERSION));
+  for (size_t i = 0; i < sizeof(kSources) / sizeof(kSources[0]); ++i) {
+    const Source &source = kSources[i];
+    const bool supported = source.extension == nullptr ?
+        version != nullptr && strstr(version, "OpenGL ES 3") != nullptr :
+        exts != nullptr && strstr(exts, source.extension) != nullptr;
+    if (!supported) continue;
+
+    union {
+      void *data;
+      PFNFPLGENVERTEXARRAYSPROC function;
+    } gen;
+    union {
+      void *data;
+      PFNFPLBINDVERTEXARRAYPROC function;
+    } bind;
+    union {
+      void *data;
+      PFNFPLDELETEVERTEXARRAYSPROC function;
+    } del;
+    gen.data = SDL_GL_GetProcAddress(source.gen);
+    bind.data = SDL_GL_GetProcAddress(source.bind);
+    del.data = SDL_GL_GetProcAddress(source.del);
+    if (gen.data && bind.data && del.data) {
+      fplGenVertexArrays = gen.function;
+      fplBindVertexArray = bind.function;
+      fplDeleteVertexArrays = del.function;
+      return;
+    }
+  }
+}
+
+// Look up 'name', converting its address to a function pointer through a
+// union, since -pedantic rejects the cast. Returns false if it isn't found.
+template<typename T>
+static bool GetGLFunction(const char *name, T *function) {
+  union {
+    void *data;
+    T function;
+  } lookup;
+  lookup.data = SDL_GL_GetProcAddress(name);
+  *function = lookup.function;
+  return lookup.data != nullptr;
+}
+
+// Look up the timer query entry points, the same way as
+// InitializeInstancing(). Leaves them null if no source provides them.
+void Renderer::InitializeTimerQueries() {
+  struct Source {
+    const char *extension;
+    const char *gen;
+    const char *del;
+    const char *begin;
+    const char *end;
+    const char *get_uiv;
+    const char *get_ui64v;
+  };
+  static const Source kSources[] = {
+    #ifdef PLATFORM_MOBILE
+      { "GL_EXT_disjoint_timer_query", "glGenQueriesEXT", "glDeleteQueriesEXT",
+        "glBeginQueryEXT", "glEndQueryEXT", "glGetQueryObjectuivEXT",
+        "glGetQueryObjectui64vEXT" },
+    #else
+      { "GL_ARB_timer_query", "glGenQueries", "glDeleteQueries",
+        "glBeginQuery", "glEndQuery", "glGetQueryObjectuiv",
+        "glGetQueryObjectui64v" },
+      { "GL_EXT_timer_query", "glGenQueries", "glDeleteQueries",
+        "glBeginQuery", "glEndQuery", "glGetQueryObjectuiv",
+        "glGetQueryObjectui64vEXT" },
+    #endif
+  };
+
+  const char *exts = reinterpret_cast<const char *>(
+      glGetString(GL_EXTENSIONS));
+  for (size_t i = 0; i < sizeof(kSources) / sizeof(kSources[0]); ++i) {
+    const Source &source = kSources[i];
+    if (exts == nullptr || strstr(exts, source.extension) == nullptr)
+      continue;
+    if (GetGLFunction(source.gen, &fplGenQueries) &&
+        GetGLFunction(source.del, &fplDeleteQueries) &&
+        GetGLFunction(source.begin, &fplBeginQuery) &&
+        GetGLFunction(source.end, &fplEndQuery) &&
+        GetGLFunction(source.get_uiv, &fplGetQueryObjectuiv) &&
+        GetGLFunction(source.get_ui64v, &fplGetQueryObjectui64v)) {
+      return;
+    }
+  }
+  fplGenQueries = nullptr;
+  fplDeleteQueries = nullptr;
+  fplBeginQuery = nullptr;
+  fplEndQuery = nullptr;
+  fplGetQueryObjectuiv = nullptr;
+  fplGetQueryObjectui64v = nullptr;
+}
+
+// Look up the program binary entry points, the same way as
+// InitializeInstancing(). Leaves them null if no source provides them, or
+// if the driver can't save programs in any format.
+void Renderer::InitializeProgramBinaries() {
+  struct Source {
+    const char *extension;  // nullptr when core in GLES3.
+    const char *get;
+    const char *set;
+    const char *parameter;  // nullptr when the source has no hint.
+  };
+  static const Source kSources[] = {
+    #ifdef PLATFORM_MOBILE
+      { nullptr, "glGetProgramBinary", "glProgramBinary",
+        "glProgramParameteri" },
+      { "GL_OES_get_program_binary", "glGetProgramBinaryOES",
+        "glProgramBinaryOES", nullptr },
+    #else
+      { "GL_ARB_get_program_binary", "glGetProgramBinary",
+        "glProgramBinary", "glProgramParameteri" },
+    #endif
+  };
+
+  fplGetProgramBinary = nullptr;
+  fplProgramBinary = nullptr;
+  fplProgramParameteri = nullptr;
+  GLint num_formats = 0;
+  glGetIntegerv(FPL_GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+  // Drivers without the feature raise an error for the query.
+  glGetError();
+  if (num_formats <= 0) return;
+
+  const char *exts = reinterpret_cast<const char *>(
+      glGetString(GL_EXTENSIONS));
+  const char *version = reinterpret_cast<const char *>(
+      glGetString(GL_VERSION));
+  for (size_t i = 0; i < sizeof(kSources) / sizeof(kSources[0]); ++i) {
+    const Source &source = kSources[i];
+    const bool supported = source.extension == nullptr ?
+        version != nullptr && strstr(version, "OpenGL ES 3") != nullptr :
+        exts != nullptr && strstr(exts, source.extension) != nullptr;
+    if (!supported) continue;
+    if (GetGLFunction(source.get, &fplGetProgramBinary) &&
+        GetGLFunction(source.set, &fplProgramBinary)) {
+      if (source.parameter) {
+        GetGLFunction(source.parameter, &fplProgramParameteri);
+      }
+      break;
+    }
+    fplGetProgramBinary = nullptr;
+    fplProgramBinary = nullptr;
+  }
+
+  // The driver's identity goes into every cache key, so that binaries made
+  // by another driver, or another version of it, are never loaded.
+  const char *strings[] = {
+    reinterpret_cast<const char *>(glGetString(GL_VENDOR)),
+    reinterpret_cast<const char *>(glGetString(GL_RENDERER)),
+    version,
+  };
+  driver_id_.clear();
+  for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); ++i) {
+    if (strings[i]) driver_id_ += strings[i];
+    driver_id_ += '\n';
+  }
+}
+
+// Look up the pixel buffer entry points, the same way as
+// InitializeInstancing(). Leaves them null unless all of them are found.
+void Renderer::InitializePixelBuffers() {
+  #ifdef PLATFORM_MOBILE
+    const char *version = reinterpret_cast<const char *>(
+        glGetString(GL_VERSION));
+    const bool supported =
+        version != nullptr && strstr(version, "OpenGL ES 3") != nullptr;
+  #else
+    const char *exts = reinterpret_cast<const char *>(
+        glGetString(GL_EXTENSIONS));
+    const bool supported =
+        exts != nullptr &&
+        strstr(exts, "GL_ARB_pixel_buffer_object") != nullptr &&
+        strstr(exts, "GL_ARB_map_buffer_range") != nullptr &&
+        strstr(exts, "GL_ARB_sync") != nullptr;
+  #endif
+  if (supported &&
+      GetGLFunction("glMapBufferRange", &fplMapBufferRange) &&
+      GetGLFunction("glUnmapBuffer", &fplUnmapBuffer) &&
+      GetGLFunction("glFenceSync", &fplFenceSync) &&
+      GetGLFunction("glClientWaitSync", &fplClientWaitSync) &&
+      GetGLFunction("glDeleteSync", &fplDeleteSync)) {
+    return;
+  }
+  fplMapBufferRange = nullptr;
+  fplUnmapBuffer = nullptr;
+  fplFenceSync = nullptr;
+  fplClientWaitSync = nullptr;
+  fplDeleteSync = nullptr;
+}
+
+// Find out which of the compressed formats that build_assets.py emits the
+// driver can decode. Only ETC1 is guaranteed, and only on GLES.
+void Renderer::InitializeCompressedTextures() {
+  struct Variant {
+    const char *suffix;
+    uint32_t formats[2];  // Every format the variant's files may hold.
+  };
+  static const Variant kVariants[] = {
+    { "astc", { kKtxFormatAstc6x6, kKtxFormatAstc6x6 } },
+    { "etc2", { kKtxFormatEtc2Rgb8, kKtxFormatEtc2Rgba8 } },
+    { "etc1", { kKtxFormatEtc1Rgb8, kKtxFormatEtc1Rgb8 } },
+  };
+
+  compressed_formats_.clear();
+  compressed_suffixes_.clear();
+  GLint num_formats = 0;
+  glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &num_formats);
+  if (num_formats <= 0) return;
+  std::vector<GLint> formats(num_formats);
+  glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, &formats[0]);
+  for (size_t i = 0; i < formats.size(); ++i) {
+    compressed_formats_.push_back(static_cast<uint32_t>(formats[i]));
+  }
+
+  for (size_t i = 0; i < sizeof(kVariants) / sizeof(kVariants[0]); ++i) {
+    const Variant &variant = kVariants[i];
+    if (SupportsCompressedFormat(variant.formats[0]) &&
+        SupportsCompressedFormat(variant.formats[1])) {
+      compressed_suffixes_.push_back(variant.suffix);
+    }
+  }
+}
+
+bool Renderer::SupportsCompressedFormat(uint32_t format) const {
+  for (size_t i = 0; i < compressed_formats_.size(); ++i) {
+    if (compressed_formats_[i] == format) return true;
+  }
+  return false;
+}
+
+bool Renderer::SetSwapInterval(int interval) {
+  return SDL_GL_SetSwapInterval(interval) == 0;
+}
+
+void Renderer::HideWindow() {
+  SDL_HideWindow(window_);
+}
+
 void Renderer::AdvanceFrame(bool minimized) {
   if (minimized) {
     // Save some cpu / battery:
@@ -138,6 +485,18 @@ void Renderer::AdvanceFrame(bool minimized) {
   }
   // Get window size again, just in case it has changed.
   SDL_GetWindowSize(window_, &window_size_.x(), &window_size_.y());
+
+  last_frame_state_counters_ = state_counters_;
+  state_counters_ = StateCounters();
+  frame_count_++;
+  RecycleUploadBuffers();
+  gpu_profiler_.AdvanceFrame();
+  AdvanceGLStatsFrame();
+  SetWindowViewport();
+  DepthTest(true);
+}
+
+void Renderer::SetWindowViewport() {
 #ifdef __ANDROID__
   // Check HW scaler setting and change a viewport size if they are set
   vec2i size = AndroidGetScalerResolution();
@@ -146,11 +505,12 @@ void Renderer::AdvanceFrame(bool minimized) {
 #else
   GL_CALL(glViewport(0, 0, window_size_.x(), window_size_.y()));
 #endif
-  GL_CALL(glEnable(GL_DEPTH_TEST));
 }
 
 void Renderer::ShutDown() {
+  gpu_profiler_.ShutDown();
   if (context_) {
+    DeleteUploadBuffers();
     SDL_GL_DeleteContext(context_);
     context_ = nullptr;
   }
@@ -165,6 +525,74 @@ void Renderer::ClearFrameBuffer(const vec4 &color) {
     GL_CALL(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
 }
 
+bool Renderer::CreateRenderTarget(const vec2i &size, RenderTarget *target,
+                                  bool alpha, bool depth) {
+  DeleteRenderTarget(target);
+  target->size = size;
+
+  // 16 bits are enough for the scene, and are always renderable on GLES2.
+  GL_CALL(glGenTextures(1, &target->texture));
+  BindTexture(0, target->texture);
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+  if (alpha) {
+    GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size.x(), size.y(), 0,
+                         GL_RGBA, use_16bpp_ ? GL_UNSIGNED_SHORT_4_4_4_4 :
+                                               GL_UNSIGNED_BYTE, nullptr));
+  } else {
+    GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, size.x(), size.y(), 0,
+                         GL_RGB, use_16bpp_ ? GL_UNSIGNED_SHORT_5_6_5 :
+                                              GL_UNSIGNED_BYTE, nullptr));
+  }
+
+  if (depth) {
+    GL_CALL(glGenRenderbuffers(1, &target->depth_buffer));
+    GL_CALL(glBindRenderbuffer(GL_RENDERBUFFER, target->depth_buffer));
+    GL_CALL(glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16,
+                                  size.x(), size.y()));
+  }
+
+  GL_CALL(glGenFramebuffers(1, &target->framebuffer));
+  GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer));
+  GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                 GL_TEXTURE_2D, target->texture, 0));
+  if (depth) {
+    GL_CALL(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                      GL_RENDERBUFFER, target->depth_buffer));
+  }
+  const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, default_framebuffer_));
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    last_error_ = "render target incomplete";
+    DeleteRenderTarget(target);
+    return false;
+  }
+  return true;
+}
+
+void Renderer::DeleteRenderTarget(RenderTarget *target) {
+  if (target->framebuffer) {
+    GL_CALL(glDeleteFramebuffers(1, &target->framebuffer));
+  }
+  if (target->depth_buffer) {
+    GL_CALL(glDeleteRenderbuffers(1, &target->depth_buffer));
+  }
+  if (target->texture) DeleteTexture(target->texture);
+  *target = RenderTarget();
+}
+
+void Renderer::SetRenderTarget(const RenderTarget *target) {
+  if (target) {
+    GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer));
+    GL_CALL(glViewport(0, 0, target->size.x(), target->size.y()));
+  } else {
+    GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, default_framebuffer_));
+    SetWindowViewport();
+  }
+}
+
 GLuint Renderer::CompileShader(GLenum stage, GLuint program,
                                const GLchar *source) {
   std::string platform_source =
@@ -193,30 +621,90 @@ GLuint Renderer::CompileShader(GLenum stage, GLuint program,
   }
 }
 
+// Every attribute a shader may read, and the location it is bound to. The
+// instanced world matrix columns come last.
+struct AttributeBinding {
+  int location;
+  const char *name;
+};
+static const AttributeBinding kAttributeBindings[] = {
+  { Mesh::kAttributePosition, "aPosition" },
+  { Mesh::kAttributeNormal, "aNormal" },
+  { Mesh::kAttributeTangent, "aTangent" },
+  { Mesh::kAttributeTexCoord, "aTexCoord" },
+  { Mesh::kAttributeColor, "aColor" },
+  { Mesh::kAttributeParticle0, "aParticle0" },
+  { Mesh::kAttributeParticle1, "aParticle1" },
+  { Mesh::kAttributeParticle2, "aParticle2" },
+  { Mesh::kAttributeWorld0, "aWorld0" },
+  { Mesh::kAttributeWorld1, "aWorld1" },
+  { Mesh::kAttributeWorld2, "aWorld2" },
+  { Mesh::kAttributeWorld3, "aWorld3" },
+};
+static const size_t kNumAttributeBindings =
+    sizeof(kAttributeBindings) / sizeof(kAttributeBindings[0]);
+static const size_t kNumInstancingAttributeBindings = 4;
+
+// The first 'num_bindings' entries of kAttributeBindings, as text for the
+// program binary cache key.
+static std::string AttributeBindingsText(size_t num_bindings) {
+  std::string text;
+  for (size_t i = 0; i < num_bindings; ++i) {
+    char location[16];
+    snprintf(location, sizeof(location), "%d ",
+             kAttributeBindings[i].location);
+    text += location;
+    text += kAttributeBindings[i].name;
+    text += '\n';
+  }
+  return text;
+}
+
 Shader *Renderer::CompileAndLinkShader(const char *vs_source,
                                        const char *ps_source) {
+  // The world matrix columns are past the 8 attributes GLES2 guarantees,
+  // so only bind them where instancing can use them.
+  const size_t num_bindings = SupportsInstancing() ?
+      kNumAttributeBindings :
+      kNumAttributeBindings - kNumInstancingAttributeBindings;
+
+  // Skip compiling if an earlier launch left the linked program behind.
+  std::string cache_file;
+  uint64_t cache_key = 0;
+  if (SupportsProgramBinaries() && !shader_cache_dir_.empty()) {
+    cache_key = ProgramBinaryKey(driver_id_.c_str(),
+                                 AttributeBindingsText(num_bindings).c_str(),
+                                 vs_source, ps_source);
+    cache_file = shader_cache_dir_ + ProgramBinaryFileName(cache_key);
+    auto shader = LoadProgramBinary(cache_file.c_str(), cache_key);
+    if (shader) return shader;
+  }
+
   auto program = glCreateProgram();
   auto vs = CompileShader(GL_VERTEX_SHADER, program, vs_source);
   if (vs) {
     auto ps = CompileShader(GL_FRAGMENT_SHADER, program, ps_source);
     if (ps) {
-      GL_CALL(glBindAttribLocation(program, Mesh::kAttributePosition,
-                                   "aPosition"));
-      GL_CALL(glBindAttribLocation(program, Mesh::kAttributeNormal,
-                                   "aNormal"));
-      GL_CALL(glBindAttribLocation(program, Mesh::kAttributeTangent,
-                                   "aTangent"));
-      GL_CALL(glBindAttribLocation(program, Mesh::kAttributeTexCoord,
-                                   "aTexCoord"));
-      GL_CALL(glBindAttribLocation(program, Mesh::kAttributeColor,
-                                   "aColor"));
+      for (size_t i = 0; i < num_bindings; ++i) {
+        GL_CALL(glBindAttribLocation(program, kAttributeBindings[i].location,
+                                     kAttributeBindings[i].name));
+      }
+      // Some drivers only keep a binary to hand back if asked before
+      // linking.
+      if (!cache_file.empty() && fplProgramParameteri) {
+        GL_CALL(fplProgramParameteri(
+            program, FPL_GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+      }
       GL_CALL(glLinkProgram(program));
       GLint status;
       GL_CALL(glGetProgramiv(program, GL_LINK_STATUS, &status));
       if (status == GL_TRUE) {
-        auto shader = new Shader(program, vs, ps);
-        GL_CALL(glUseProgram(program));
+        auto shader = new Shader(*this, program, vs, ps);
+        UseProgram(program);
         shader->InitializeUniforms();
+        if (!cache_file.empty()) {
+          SaveProgramBinary(program, cache_file.c_str(), cache_key);
+        }
         return shader;
       }
       GLint length = 0;
@@ -231,32 +719,205 @@ Shader *Renderer::CompileAndLinkShader(const char *vs_source,
   return nullptr;
 }
 
-uint16_t *Renderer::Convert8888To5551(const uint8_t *buffer,
-                                      const vec2i &size) {
-  auto buffer16 = new uint16_t[size.x() * size.y()];
-  for (int i = 0; i < size.x() * size.y(); i++) {
-    auto c = &buffer[i * 4];
-    buffer16[i] = ((c[0] >> 3) << 11) |
-                  ((c[1] >> 3) << 6) |
-                  ((c[2] >> 3) << 1) |
-                  ((c[3] >> 7) << 0);
+// Link a program from the cache file 'filename', if it is there and was made
+// by this driver from the same source. Returns nullptr otherwise, or if the
+// driver rejects the binary, which it may do after an update.
+Shader *Renderer::LoadProgramBinary(const char *filename, uint64_t key) {
+  std::string file;
+  uint32_t format = 0;
+  const uint8_t *binary = nullptr;
+  size_t size = 0;
+  if (!LoadOptionalFile(filename, &file) ||
+      !UnpackProgramBinary(file, key, &format, &binary, &size)) {
+    return nullptr;
   }
-  return buffer16;
+  auto program = glCreateProgram();
+  GL_CALL(fplProgramBinary(program, format, binary,
+                           static_cast<GLsizei>(size)));
+  GLint status = GL_FALSE;
+  GL_CALL(glGetProgramiv(program, GL_LINK_STATUS, &status));
+  if (status != GL_TRUE) {
+    GL_CALL(glDeleteProgram(program));
+    return nullptr;
+  }
+  // The binary holds the linked program, so there are no shader objects.
+  auto shader = new Shader(*this, program, 0, 0);
+  UseProgram(program);
+  shader->InitializeUniforms();
+  return shader;
+}
+
+// Write the linked 'program' to the cache file 'filename'. Failing to is
+// not an error: the program is compiled from source again next launch.
+void Renderer::SaveProgramBinary(GLuint program, const char *filename,
+                                 uint64_t key) {
+  GLint length = 0;
+  GL_CALL(glGetProgramiv(program, FPL_GL_PROGRAM_BINARY_LENGTH, &length));
+  if (length <= 0) return;
+  std::vector<uint8_t> binary(length);
+  GLsizei written = 0;
+  GLenum format = 0;
+  GL_CALL(fplGetProgramBinary(program, length, &written, &format,
+                              &binary[0]));
+  if (written <= 0) return;
+  std::string file;
+  PackProgramBinary(key, format, &binary[0], written, &file);
+  SaveFile(filename, file.data(), file.size());
 }
 
-uint16_t *Renderer::Convert888To565(const uint8_t *buffer, const vec2i &size) {
-  auto buffer16 = new uint16_t[size.x() * size.y()];
-  for (int i = 0; i < size.x() * size.y(); i++) {
-    auto c = &buffer[i * 3];
-    buffer16[i] = ((c[0] >> 3) << 11) |
-                  ((c[1] >> 2) << 5) |
-                  ((c[2] >> 3) << 0);
+TextureFormat Renderer::UploadFormat(TextureFormat desired, bool has_alpha,
+                                    bool has_mips) const {
+  if (desired == kFormatAuto) desired = has_alpha ? kFormat5551 : kFormat565;
+  // The 16bpp fallback works around glGenerateMipmap(), which isn't called
+  // when the mips are precomputed.
+  if (use_16bpp_ || has_mips) return desired;
+  switch (desired) {
+    case kFormat5551: return kFormat8888;
+    case kFormat565: return kFormat888;
+    default: return desired;
   }
-  return buffer16;
 }
 
 GLuint Renderer::CreateTexture(const uint8_t *buffer, const vec2i &size,
-                               bool has_alpha, TextureFormat desired) {
+                               TextureFormat format) {
+  const GLuint texture_id = GenTexture(size);
+  if (!texture_id) return 0;
+  UploadTextureLevel(0, buffer, size, format);
+  GL_CALL(glGenerateMipmap(GL_TEXTURE_2D));
+  return texture_id;
+}
+
+GLuint Renderer::CreateTexture(const uint8_t *const *levels, int num_levels,
+                               const vec2i &size, TextureFormat format) {
+  assert(num_levels == NumMipLevels(size));
+  const GLuint texture_id = GenTexture(size);
+  if (!texture_id) return 0;
+  vec2i level_size = size;
+  for (int level = 0; level < num_levels; ++level) {
+    UploadTextureLevel(level, levels[level], level_size, format);
+    level_size = vec2i(std::max(level_size.x() / 2, 1),
+                       std::max(level_size.y() / 2, 1));
+  }
+  return texture_id;
+}
+
+uint8_t *Renderer::MapUploadBuffer(size_t size, GLuint *buffer) {
+  assert(SupportsPixelBuffers());
+  // Reuse the smallest free buffer that is big enough.
+  UploadBuffer *upload = nullptr;
+  for (size_t i = 0; i < upload_buffers_.size(); ++i) {
+    UploadBuffer &candidate = upload_buffers_[i];
+    if (!candidate.mapped && candidate.fence == nullptr &&
+        candidate.size >= size &&
+        (upload == nullptr || candidate.size < upload->size)) {
+      upload = &candidate;
+    }
+  }
+  if (upload) {
+    GL_CALL(glBindBuffer(FPL_GL_PIXEL_UNPACK_BUFFER, upload->buffer));
+  } else {
+    UploadBuffer created = { 0, size, false, nullptr, frame_count_ };
+    GL_CALL(glGenBuffers(1, &created.buffer));
+    upload_buffers_.push_back(created);
+    upload = &upload_buffers_.back();
+    GL_CALL(glBindBuffer(FPL_GL_PIXEL_UNPACK_BUFFER, upload->buffer));
+    GL_CALL(glBufferData(FPL_GL_PIXEL_UNPACK_BUFFER,
+                         static_cast<GLsizeiptr>(size), nullptr,
+                         GL_STREAM_DRAW));
+  }
+  // Invalidating tells the driver the old contents aren't needed, so
+  // mapping never waits for the GPU.
+  void *data = fplMapBufferRange(
+      FPL_GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(size),
+      FPL_GL_MAP_WRITE_BIT | FPL_GL_MAP_INVALIDATE_BUFFER_BIT);
+  GL_CALL(glBindBuffer(FPL_GL_PIXEL_UNPACK_BUFFER, 0));
+  if (!data) {
+    *buffer = 0;
+    return nullptr;
+  }
+  upload->mapped = true;
+  *buffer = upload->buffer;
+  return static_cast<uint8_t *>(data);
+}
+
+GLuint Renderer::CreateTextureFromUploadBuffer(GLuint buffer,
+                                               const size_t *offsets,
+                                               int num_levels,
+                                               const vec2i &size,
+                                               TextureFormat format) {
+  UploadBuffer *upload = nullptr;
+  for (size_t i = 0; i < upload_buffers_.size(); ++i) {
+    if (upload_buffers_[i].buffer == buffer) upload = &upload_buffers_[i];
+  }
+  assert(upload && upload->mapped);
+  GL_CALL(glBindBuffer(FPL_GL_PIXEL_UNPACK_BUFFER, buffer));
+  GLuint texture_id = 0;
+  // The driver may lose the contents of a mapped buffer, in which case
+  // unmapping it fails.
+  if (fplUnmapBuffer(FPL_GL_PIXEL_UNPACK_BUFFER)) {
+    // While a pixel unpack buffer is bound, GL takes texel pointers as
+    // offsets into it.
+    std::vector<const uint8_t *> levels(num_levels);
+    for (int i = 0; i < num_levels; ++i) {
+      levels[i] = reinterpret_cast<const uint8_t *>(offsets[i]);
+    }
+    texture_id = num_levels == 1 ?
+                 CreateTexture(levels[0], size, format) :
+                 CreateTexture(&levels[0], num_levels, size, format);
+  } else {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR,
+                 "CreateTextureFromUploadBuffer: contents lost");
+  }
+  GL_CALL(glBindBuffer(FPL_GL_PIXEL_UNPACK_BUFFER, 0));
+  upload->mapped = false;
+  upload->fence = fplFenceSync(FPL_GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  return texture_id;
+}
+
+// Upload buffers that nothing has needed for this many frames are deleted.
+static const unsigned int kUploadBufferIdleFrames = 120;
+
+void Renderer::RecycleUploadBuffers() {
+  for (size_t i = 0; i < upload_buffers_.size();) {
+    UploadBuffer &upload = upload_buffers_[i];
+    if (upload.fence) {
+      // A timeout of 0 only polls the fence.
+      const GLenum status = fplClientWaitSync(upload.fence, 0, 0);
+      if (status == FPL_GL_ALREADY_SIGNALED ||
+          status == FPL_GL_CONDITION_SATISFIED) {
+        fplDeleteSync(upload.fence);
+        upload.fence = nullptr;
+        upload.free_frame = frame_count_;
+      }
+    } else if (!upload.mapped &&
+               frame_count_ - upload.free_frame > kUploadBufferIdleFrames) {
+      DeleteBuffer(upload.buffer);
+      upload_buffers_.erase(upload_buffers_.begin() + i);
+      continue;
+    }
+    ++i;
+  }
+}
+
+void Renderer::DeleteUploadBuffers() {
+  for (size_t i = 0; i < upload_buffers_.size(); ++i) {
+    if (upload_buffers_[i].fence) fplDeleteSync(upload_buffers_[i].fence);
+    DeleteBuffer(upload_buffers_[i].buffer);
+  }
+  upload_buffers_.clear();
+}
+
+int Renderer::NumMipLevels(const vec2i &size) {
+  int max_dimension = std::max(size.x(), size.y());
+  int num_levels = 1;
+  while (max_dimension > 1) {
+    max_dimension >>= 1;
+    num_levels++;
+  }
+  return num_levels;
+}
+
+GLuint Renderer::GenTexture(const vec2i &size) {
   int area = size.x() * size.y();
   if (area & (area - 1)) {
     SDL_LogError(SDL_LOG_CATEGORY_ERROR,
@@ -267,61 +928,101 @@ GLuint Renderer::CreateTexture(const uint8_t *buffer, const vec2i &size,
   // TODO: support default args for mipmap/wrap/trilinear
   GLuint texture_id;
   GL_CALL(glGenTextures(1, &texture_id));
-  GL_CALL(glActiveTexture(GL_TEXTURE0));
-  GL_CALL(glBindTexture(GL_TEXTURE_2D, texture_id));
+  BindTexture(0, texture_id);
   GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
   GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT));
   GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
   GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
                           GL_LINEAR_MIPMAP_NEAREST/*GL_LINEAR_MIPMAP_LINEAR*/));
-  if (desired == kFormatAuto) desired = has_alpha ? kFormat5551 : kFormat565;
-  switch (desired) {
+  return texture_id;
+}
+
+void Renderer::UploadTextureLevel(int level, const uint8_t *buffer,
+                                  const vec2i &size, TextureFormat format) {
+  const size_t pixels = static_cast<size_t>(size.x()) * size.y();
+  switch (format) {
     case kFormat5551: {
-      assert(has_alpha);
-      if (use_16bpp_) {
-        auto buffer16 = Convert8888To5551(buffer, size);
-        GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size.x(), size.y(), 0,
-                             GL_RGBA, GL_UNSIGNED_SHORT_5_5_5_1, buffer16));
-        delete[] buffer16;
-      } else {
-        // Fallback to 8888
-        GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size.x(), size.y(), 0,
-                             GL_RGBA, GL_UNSIGNED_BYTE, buffer));
-      }
+      GL_CALL(glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, size.x(), size.y(),
+                           0, GL_RGBA, GL_UNSIGNED_SHORT_5_5_5_1, buffer));
+      CountGLTextureUpload(pixels * 2);
       break;
     }
     case kFormat565: {
-      assert(!has_alpha);
-      if (use_16bpp_) {
-        auto buffer16 = Convert888To565(buffer, size);
-        GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, size.x(), size.y(), 0,
-                             GL_RGB, GL_UNSIGNED_SHORT_5_6_5, buffer16));
-        delete[] buffer16;
-      } else {
-        // Fallback to 888
-        GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, size.x(), size.y(), 0,
-                             GL_RGB, GL_UNSIGNED_BYTE, buffer));
-      }
+      GL_CALL(glTexImage2D(GL_TEXTURE_2D, level, GL_RGB, size.x(), size.y(),
+                           0, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, buffer));
+      CountGLTextureUpload(pixels * 2);
       break;
     }
     case kFormat8888: {
-      assert(has_alpha);
-      GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size.x(), size.y(), 0,
-                           GL_RGBA, GL_UNSIGNED_BYTE, buffer));
+      GL_CALL(glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, size.x(), size.y(),
+                           0, GL_RGBA, GL_UNSIGNED_BYTE, buffer));
+      CountGLTextureUpload(pixels * 4);
       break;
     }
     case kFormat888: {
-      assert(!has_alpha);
-      GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, size.x(), size.y(), 0,
-                           GL_RGB, GL_UNSIGNED_BYTE, buffer));
+      GL_CALL(glTexImage2D(GL_TEXTURE_2D, level, GL_RGB, size.x(), size.y(),
+                           0, GL_RGB, GL_UNSIGNED_BYTE, buffer));
+      CountGLTextureUpload(pixels * 3);
       break;
     }
     default: assert(0);
   }
-  GL_CALL(glGenerateMipmap(GL_TEXTURE_2D));
+}
+
+GLuint Renderer::CreateCompressedTexture(const uint8_t *file,
+                                         const KtxImage &image) {
+  if (!SupportsCompressedFormat(image.internal_format) ||
+      image.levels.empty()) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR,
+                 "CreateCompressedTexture: unsupported format 0x%x",
+                 image.internal_format);
+    return 0;
+  }
+  // Compressed data can't be mipmapped by glGenerateMipmap(), so only filter
+  // between mips if the file has all of them.
+  const size_t full_chain = static_cast<size_t>(
+      NumMipLevels(vec2i(image.width, image.height)));
+  const bool has_mips = image.levels.size() >= full_chain;
+
+  GLuint texture_id;
+  GL_CALL(glGenTextures(1, &texture_id));
+  BindTexture(0, texture_id);
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT));
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                          has_mips ? GL_LINEAR_MIPMAP_NEAREST : GL_LINEAR));
+  const size_t num_levels = has_mips ? full_chain : 1;
+  for (size_t i = 0; i < num_levels; ++i) {
+    const KtxImage::Level &level = image.levels[i];
+    GL_CALL(glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i),
+                                   image.internal_format, level.width,
+                                   level.height, 0,
+                                   static_cast<GLsizei>(level.size),
+                                   file + level.offset));
+    CountGLTextureUpload(level.size);
+  }
   return texture_id;
 }
 
+bool Renderer::LoadCompressedTexture(const char *filename, MappedFile *file,
+                                     KtxImage *image) const {
+  std::string base = filename;
+  const size_t ext_pos = base.find_last_of(".");
+  if (ext_pos != std::string::npos) base.erase(ext_pos);
+  for (size_t i = 0; i < compressed_suffixes_.size(); ++i) {
+    const std::string name = base + "." + compressed_suffixes_[i] + ".ktx";
+    if (!file->OpenOptional(name.c_str())) continue;
+    if (ParseKtx(file->data(), file->size(), image) &&
+        SupportsCompressedFormat(image->internal_format))
+      return true;
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Bad compressed texture: %s",
+                 name.c_str());
+  }
+  file->Close();
+  return false;
+}
+
 uint8_t *Renderer::UnpackTGA(const void *tga_buf, vec2i *dimensions,
                              bool *has_alpha) {
   struct TGA {
@@ -355,14 +1056,16 @@ uint8_t *Renderer::UnpackTGA(const void *tga_buf, vec2i *dimensions,
     end_y = -1;
     y_direction = -1;
   }
+  const int row_bytes = header->width * header->bpp / 8;
   for (int y = start_y; y != end_y; y += y_direction) {
-    for (int x = 0; x < header->width; x++) {
-      auto p = dest + (y * header->width + x) * header->bpp / 8;
-      p[2] = *pixels++;    // BGR -> RGB
-      p[1] = *pixels++;
-      p[0] = *pixels++;
-      if (header->bpp == 32) p[3] = *pixels++;
+    // BGR -> RGB
+    auto p = dest + y * row_bytes;
+    if (header->bpp == 32) {
+      ConvertBgraToRgba(pixels, p, header->width);
+    } else {
+      ConvertBgrToRgb(pixels, p, header->width);
     }
+    pixels += row_bytes;
   }
   *has_alpha = header->bpp == 32;
   *dimensions = vec2i(header->width, header->height);
@@ -388,40 +1091,181 @@ uint8_t *Renderer::UnpackWebP(const void *webp_buf, size_t size,
 uint8_t *Renderer::LoadAndUnpackTexture(const char *filename,
                                         vec2i *dimensions,
                                         bool *has_alpha) {
-  std::string file;
-  if (LoadFile(filename, &file)) {
-    std::string ext = filename;
-    size_t ext_pos = ext.find_last_of(".");
-    if (ext_pos != std::string::npos) ext = ext.substr(ext_pos + 1);
-    if (ext == "tga") {
-      auto buf = UnpackTGA(file.c_str(), dimensions, has_alpha);
-      if (!buf) last_error() = std::string("TGA format problem: ") + filename;
-      return buf;
-    } else if (ext == "webp") {
-      auto buf = UnpackWebP(file.c_str(), file.length(), dimensions, has_alpha);
-      if (!buf) last_error() = std::string("WebP format problem: ") + filename;
-      return buf;
-    } else {
-      last_error() =
-        std::string("Can\'t figure out file type from extension: ") + filename;
-      return nullptr;
-    }
+  MappedFile file;
+  if (file.Open(filename)) {
+    return UnpackTexture(filename, file, dimensions, has_alpha);
   }
   last_error() = std::string("Couldn\'t load: ") + filename;
   return nullptr;
 }
 
+uint8_t *Renderer::UnpackTexture(const char *filename, const MappedFile &file,
+                                 vec2i *dimensions, bool *has_alpha) {
+  std::string ext = filename;
+  size_t ext_pos = ext.find_last_of(".");
+  if (ext_pos != std::string::npos) ext = ext.substr(ext_pos + 1);
+  if (ext == "tga") {
+    auto buf = UnpackTGA(file.data(), dimensions, has_alpha);
+    if (!buf) last_error() = std::string("TGA format problem: ") + filename;
+    return buf;
+  } else if (ext == "webp") {
+    auto buf = UnpackWebP(file.data(), file.size(), dimensions, has_alpha);
+    if (!buf) last_error() = std::string("WebP format problem: ") + filename;
+    return buf;
+  } else {
+    last_error() =
+      std::string("Can\'t figure out file type from extension: ") + filename;
+    return nullptr;
+  }
+}
+
+bool Renderer::LoadAndUnpackMips(const char *filename, const vec2i &size,
+                                 bool has_alpha,
+                                 std::vector<uint8_t *> *mips) {
+  const int num_levels = NumMipLevels(size);
+  vec2i level_size = size;
+  MappedFile file;
+  for (int level = 1; level < num_levels; ++level) {
+    level_size = vec2i(std::max(level_size.x() / 2, 1),
+                       std::max(level_size.y() / 2, 1));
+    const std::string name = MipFileName(filename, level);
+    vec2i dimensions;
+    bool level_has_alpha = false;
+    uint8_t *mip = file.OpenOptional(name.c_str()) ?
+        UnpackTexture(name.c_str(), file, &dimensions, &level_has_alpha) :
+        nullptr;
+    if (mip && (!(dimensions == level_size) || level_has_alpha != has_alpha)) {
+      SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Mip doesn't match: %s",
+                   name.c_str());
+      free(mip);
+      mip = nullptr;
+    }
+    if (!mip) {
+      for (size_t i = 0; i < mips->size(); ++i) free((*mips)[i]);
+      mips->clear();
+      return false;
+    }
+    mips->push_back(mip);
+  }
+  return true;
+}
+
+std::string Renderer::MipFileName(const char *filename, int level) {
+  std::string base = filename;
+  std::string ext;
+  const size_t ext_pos = base.find_last_of(".");
+  if (ext_pos != std::string::npos) {
+    ext = base.substr(ext_pos);
+    base.erase(ext_pos);
+  }
+  // Levels are at most two digits, since sizes are ints.
+  std::string name = base + ".";
+  if (level >= 10) name += static_cast<char>('0' + level / 10);
+  name += static_cast<char>('0' + level % 10);
+  return name + ext;
+}
 
 void Renderer::DepthTest(bool on) {
+  const int depth_test = on ? 1 : 0;
+  if (!CountStateChange(state_.depth_test != depth_test))
+    return;
   if (on) {
     GL_CALL(glEnable(GL_DEPTH_TEST));
   } else {
     GL_CALL(glDisable(GL_DEPTH_TEST));
   }
+  state_.depth_test = depth_test;
+}
+
+const GLuint Renderer::kUnknownObject;
+const int Renderer::kUnknownTextureUnit;
+const int Renderer::kUnknownDepthTest;
+
+bool Renderer::CountStateChange(bool changed) const {
+  if (changed) {
+    state_counters_.issued++;
+  } else {
+    state_counters_.skipped++;
+  }
+  return changed;
+}
+
+void Renderer::UseProgram(GLuint program) const {
+  if (!CountStateChange(state_.program != program))
+    return;
+  GL_CALL(glUseProgram(program));
+  state_.program = program;
+}
+
+void Renderer::BindTexture(int unit, GLuint texture) const {
+  assert(0 <= unit && unit < kMaxTexturesPerShader);
+  if (!CountStateChange(state_.textures[unit] != texture))
+    return;
+  if (CountStateChange(state_.active_texture_unit != unit)) {
+    GL_CALL(glActiveTexture(GL_TEXTURE0 + unit));
+    state_.active_texture_unit = unit;
+  }
+  GL_CALL(glBindTexture(GL_TEXTURE_2D, texture));
+  state_.textures[unit] = texture;
+}
+
+void Renderer::BindBuffer(GLenum target, GLuint buffer) const {
+  assert(target == GL_ARRAY_BUFFER || target == GL_ELEMENT_ARRAY_BUFFER);
+  GLuint &bound = target == GL_ARRAY_BUFFER ? state_.array_buffer :
+                                              state_.element_array_buffer;
+  if (!CountStateChange(bound != buffer))
+    return;
+  GL_CALL(glBindBuffer(target, buffer));
+  bound = buffer;
+}
+
+void Renderer::BindVertexArray(GLuint array) const {
+  if (!CountStateChange(state_.vertex_array != array))
+    return;
+  GL_CALL(fplBindVertexArray(array));
+  state_.vertex_array = array;
+  // The element array buffer binding belongs to the vertex array, so it
+  // changes with it.
+  state_.element_array_buffer = kUnknownObject;
+}
+
+// GL unbinds objects that are deleted while bound, and may give their names
+// to new objects, so the copy must forget them too.
+void Renderer::DeleteBuffer(GLuint buffer) const {
+  GL_CALL(glDeleteBuffers(1, &buffer));
+  if (state_.array_buffer == buffer) state_.array_buffer = 0;
+  if (state_.element_array_buffer == buffer) state_.element_array_buffer = 0;
+}
+
+void Renderer::DeleteVertexArray(GLuint array) const {
+  GL_CALL(fplDeleteVertexArrays(1, &array));
+  if (state_.vertex_array == array) {
+    state_.vertex_array = 0;
+    state_.element_array_buffer = kUnknownObject;
+  }
+}
+
+void Renderer::DeleteTexture(GLuint texture) const {
+  GL_CALL(glDeleteTextures(1, &texture));
+  for (int i = 0; i < kMaxTexturesPerShader; i++) {
+    if (state_.textures[i] == texture) state_.textures[i] = 0;
+  }
+}
+
+void Renderer::InvalidateStateCache() const {
+  state_.program = kUnknownObject;
+  state_.active_texture_unit = kUnknownTextureUnit;
+  for (int i = 0; i < kMaxTexturesPerShader; i++) {
+    state_.textures[i] = kUnknownObject;
+  }
+  state_.array_buffer = kUnknownObject;
+  state_.element_array_buffer = kUnknownObject;
+  state_.vertex_array = kUnknownObject;
+  state_.depth_test = kUnknownDepthTest;
 }
 
 void Renderer::SetBlendMode(BlendMode blend_mode, float amount) {
-  if (blend_mode == blend_mode_)
+  if (!CountStateChange(blend_mode != blend_mode_))
     return;
 
   // Disable current blend mode.
@@ -493,3 +1337,23 @@ void LogGLError(const char *file, int line, const char *call) {
   #undef GLEXT
 #endif
 
+PFNFPLVERTEXATTRIBDIVISORPROC fplVertexAttribDivisor = nullptr;
+PFNFPLDRAWELEMENTSINSTANCEDPROC fplDrawElementsInstanced = nullptr;
+PFNFPLGENVERTEXARRAYSPROC fplGenVertexArrays = nullptr;
+PFNFPLBINDVERTEXARRAYPROC fplBindVertexArray = nullptr;
+PFNFPLDELETEVERTEXARRAYSPROC fplDeleteVertexArrays = nullptr;
+PFNFPLGENQUERIESPROC fplGenQueries = nullptr;
+PFNFPLDELETEQUERIESPROC fplDeleteQueries = nullptr;
+PFNFPLBEGINQUERYPROC fplBeginQuery = nullptr;
+PFNFPLENDQUERYPROC fplEndQuery = nullptr;
+PFNFPLGETQUERYOBJECTUIVPROC fplGetQueryObjectuiv = nullptr;
+PFNFPLGETQUERYOBJECTUI64VPROC fplGetQueryObjectui64v = nullptr;
+PFNFPLGETPROGRAMBINARYPROC fplGetProgramBinary = nullptr;
+PFNFPLPROGRAMBINARYPROC fplProgramBinary = nullptr;
+PFNFPLPROGRAMPARAMETERIPROC fplProgramParameteri = nullptr;
+PFNFPLMAPBUFFERRANGEPROC fplMapBufferRange = nullptr;
+PFNFPLUNMAPBUFFERPROC fplUnmapBuffer = nullptr;
+PFNFPLFENCESYNCPROC fplFenceSync = nullptr;
+PFNFPLCLIENTWAITSYNCPROC fplClientWaitSync = nullptr;
+PFNFPLDELETESYNCPROC fplDeleteSync = nullptr;
+
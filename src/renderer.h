@@ -17,7 +17,11 @@
 
 #include "shader.h"
 #include "material.h"
+#include "gpu_profiler.h"
+#include "ktx.h"
+#include "mapped_file.h"
 #include "mesh.h"
+#include "program_binary.h"
 
 #ifdef __ANDROID__
 #include "renderer_android.h"
@@ -25,6 +29,18 @@
 
 namespace fpl {
 
+// An offscreen color buffer, and usually a depth buffer, that can be drawn
+// into instead of the window, and then drawn with as a texture. Created by
+// Renderer::CreateRenderTarget().
+struct RenderTarget {
+  RenderTarget() : framebuffer(0), texture(0), depth_buffer(0),
+                   size(mathfu::kZeros2i) {}
+  GLuint framebuffer;
+  GLuint texture;
+  GLuint depth_buffer;
+  vec2i size;
+};
+
 // The core of the rendering system. Deals with setting up and shutting down
 // the window + OpenGL context (based on SDL), and creating/using resources
 // such as shaders, textures, and geometry.
@@ -38,22 +54,110 @@ class Renderer {
   // Swaps frames. Call this once per frame inside your main loop.
   void AdvanceFrame(bool minimized);
 
+  // Wait for 'interval' display refreshes per swap, or none if 0. Returns
+  // false if the driver doesn't allow it.
+  bool SetSwapInterval(int interval);
+
+  // Hide the window. Rendering carries on as usual, just not on screen.
+  void HideWindow();
+
+  // True if textures are uploaded with 16 bits per texel when they can be.
+  bool use_16bpp() const { return use_16bpp_; }
+
+  // Refresh rate of the window's display in Hz, or 0 if it isn't known.
+  int refresh_rate() const { return refresh_rate_; }
+
   // Cleans up whatever Initialize creates.
   void ShutDown();
 
   // Clears the framebuffer. Call this after AdvanceFrame if desired.
   void ClearFrameBuffer(const vec4 &color);
 
+  // Make 'target' a 'size' render target, replacing whatever it held. Its
+  // texture is linearly filtered, clamped and has no mips, so it can be any
+  // size. With 'alpha', the texture keeps an alpha channel, so that what is
+  // drawn into it can be blended over something else later. Without
+  // 'depth', it has no depth buffer, for drawing that doesn't depth test.
+  // Returns false, with a descriptive error in last_error(), if the driver
+  // can't render into it.
+  bool CreateRenderTarget(const vec2i &size, RenderTarget *target,
+                          bool alpha = false, bool depth = true);
+
+  // Free whatever CreateRenderTarget() made for 'target'.
+  void DeleteRenderTarget(RenderTarget *target);
+
+  // Draw into 'target' from now on, or into the window if nullptr. Also
+  // sets the viewport to cover all of it.
+  void SetRenderTarget(const RenderTarget *target);
+
   // Create a shader object from two strings containing glsl code.
   // Returns nullptr upon error, with a descriptive message in glsl_error().
   // Attribute names in the vertex shader should be aPosition, aNormal,
   // aTexCoord and aColor to match whatever attributes your vertex data has.
+  // Linked programs are cached in shader_cache_dir(), when it is set and the
+  // driver supports program binaries, and reused instead of compiling.
   Shader *CompileAndLinkShader(const char *vs_source, const char *ps_source);
 
-  // Create a texture from a memory buffer containing xsize * ysize RGBA pixels.
+  // Directory, ending in a path separator, where CompileAndLinkShader()
+  // caches linked programs. Empty, the default, disables the cache.
+  const std::string &shader_cache_dir() const { return shader_cache_dir_; }
+  void set_shader_cache_dir(const std::string &dir) {
+    shader_cache_dir_ = dir;
+  }
+
+  // The format a texture with the 'desired' format is uploaded in. Resolves
+  // kFormatAuto, and falls back from the 16 bit formats to 8 bits per
+  // channel on drivers that can't generate their mipmaps, unless the mip
+  // chain is precomputed ('has_mips'). Safe to call from loader threads.
+  TextureFormat UploadFormat(TextureFormat desired, bool has_alpha,
+                             bool has_mips) const;
+
+  // Create a texture from a memory buffer containing xsize * ysize pixels in
+  // 'format', as returned by UploadFormat(): 16 bit texels for kFormat5551
+  // and kFormat565, and RGBA or RGB bytes otherwise.
   // Return 0 if not a power of two in size.
-  GLuint CreateTexture(const uint8_t *buffer, const vec2i &size, bool has_alpha,
-                       TextureFormat desired = kFormatAuto);
+  // The mipmaps are generated by the driver.
+  GLuint CreateTexture(const uint8_t *buffer, const vec2i &size,
+                       TextureFormat format);
+
+  // Same as above, from a precomputed mip chain. 'levels' holds a buffer
+  // for each of the NumMipLevels(size) levels, largest first. Avoids
+  // glGenerateMipmap(), which stalls some drivers on large textures.
+  GLuint CreateTexture(const uint8_t *const *levels, int num_levels,
+                       const vec2i &size, TextureFormat format);
+
+  // Number of levels in a full mip chain of a 'size' texture, down to 1x1.
+  static int NumMipLevels(const vec2i &size);
+
+  // Map a pixel buffer object of at least 'size' bytes for writing, and
+  // return its memory, which any thread may write to until the buffer is
+  // passed to CreateTextureFromUploadBuffer(). Returns nullptr, with
+  // 'buffer' set to 0, if the driver can't map one.
+  // Requires SupportsPixelBuffers().
+  uint8_t *MapUploadBuffer(size_t size, GLuint *buffer);
+
+  // Same as CreateTexture(), from the texels written to a buffer that
+  // MapUploadBuffer() returned. 'offsets' holds the offset of each level in
+  // the buffer. With a single level, the driver generates the mips. The
+  // driver reads the buffer after this returns, instead of copying from
+  // client memory before, and the buffer is reused once a fence shows it is
+  // done.
+  GLuint CreateTextureFromUploadBuffer(GLuint buffer, const size_t *offsets,
+                                       int num_levels, const vec2i &size,
+                                       TextureFormat format);
+
+  // Create a texture from a KTX file holding GPU-compressed data, parsed by
+  // ParseKtx(). Every level in the file is uploaded. Returns 0 if the driver
+  // can't decode the format.
+  GLuint CreateCompressedTexture(const uint8_t *file, const KtxImage &image);
+
+  // Look for a GPU-compressed variant of the texture in 'filename', in a
+  // format this device decodes, and load and parse it. For "a/b.webp" the
+  // variants are "a/b.astc.ktx", "a/b.etc2.ktx" and "a/b.etc1.ktx", tried in
+  // that order. Returns false if there isn't one, and the texture should be
+  // loaded from 'filename' instead.
+  bool LoadCompressedTexture(const char *filename, MappedFile *file,
+                             KtxImage *image) const;
 
   // Unpacks a memory buffer containing a TGA format file.
   // May only be uncompressed RGB or RGBA data, Y-flipped or not.
@@ -76,10 +180,16 @@ class Renderer {
   uint8_t *LoadAndUnpackTexture(const char *filename, vec2i *dimensions,
                                 bool *has_alpha);
 
-  // Utility functions to convert 32bit RGBA to 16bit.
-  // You must delete[] the return value afterwards.
-  uint16_t *Convert8888To5551(const uint8_t *buffer, const vec2i &size);
-  uint16_t *Convert888To565(const uint8_t *buffer, const vec2i &size);
+  // Loads the precomputed mip levels of the 'size' texture in filename,
+  // which build_assets.py writes beside it: "a/b.1.webp", "a/b.2.webp" and
+  // so on, down to 1x1. Returns false, with no levels, if any is missing or
+  // doesn't match; the driver must generate the mips instead. Otherwise the
+  // levels are appended to 'mips', and you must free() them when done.
+  bool LoadAndUnpackMips(const char *filename, const vec2i &size,
+                         bool has_alpha, std::vector<uint8_t *> *mips);
+
+  // The file LoadAndUnpackMips() reads mip 'level' of filename from.
+  static std::string MipFileName(const char *filename, int level);
 
   // Set alpha test (cull pixels with alpha below amount) vs alpha blend
   // (blend with framebuffer pixel regardedless).
@@ -89,11 +199,81 @@ class Renderer {
   // Set to compare fragment against Z-buffer before writing, or not.
   void DepthTest(bool on);
 
+  // Changes to GL state go through these, so that the Renderer can skip the
+  // ones that would set state that is already current. The Renderer keeps a
+  // copy of the state it last set, so these objects must always be bound
+  // and deleted through it, or the copy goes stale.
+  void UseProgram(GLuint program) const;
+  void BindTexture(int unit, GLuint texture) const;
+  // 'target' is GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER.
+  void BindBuffer(GLenum target, GLuint buffer) const;
+  void DeleteBuffer(GLuint buffer) const;
+  // Requires SupportsVertexArrays().
+  void BindVertexArray(GLuint array) const;
+  void DeleteVertexArray(GLuint array) const;
+  void DeleteTexture(GLuint texture) const;
+
+  // Forget the copy of the GL state, so every following change reaches GL.
+  // Call after code outside the Renderer has changed GL state.
+  void InvalidateStateCache() const;
+
+  // Number of state changes that reached GL, and that were skipped because
+  // the state was already set.
+  struct StateCounters {
+    StateCounters() : issued(0), skipped(0) {}
+    int issued;
+    int skipped;
+  };
+
+  // The counts of the last frame, up to the last AdvanceFrame().
+  const StateCounters &last_frame_state_counters() const {
+    return last_frame_state_counters_;
+  }
+
+  // Number of AdvanceFrame() calls so far.
+  unsigned int frame_count() const { return frame_count_; }
+
+  // True if the driver can draw many instances of a mesh in one call, and
+  // has the vertex attributes for their world matrices. See
+  // Mesh::RenderInstanced().
+  bool SupportsInstancing() const {
+    return fplVertexAttribDivisor != nullptr &&
+           fplDrawElementsInstanced != nullptr;
+  }
+
+  // True if the driver has vertex array objects, so a Mesh can record its
+  // attribute bindings once and restore them in one call.
+  bool SupportsVertexArrays() const {
+    return fplGenVertexArrays != nullptr && fplBindVertexArray != nullptr &&
+           fplDeleteVertexArrays != nullptr;
+  }
+
+  // True if the driver can save linked shader programs, and load them again.
+  bool SupportsProgramBinaries() const {
+    return fplGetProgramBinary != nullptr && fplProgramBinary != nullptr;
+  }
+
+  // True if the driver can time GPU work. See GpuProfiler.
+  bool SupportsTimerQueries() const { return fplGenQueries != nullptr; }
+
+  // True if textures can be uploaded from pixel buffer objects. See
+  // MapUploadBuffer().
+  bool SupportsPixelBuffers() const { return fplMapBufferRange != nullptr; }
+
+  // Times the passes of each frame on the GPU, when enabled. Advanced by
+  // AdvanceFrame().
+  GpuProfiler &gpu_profiler() { return gpu_profiler_; }
+  const GpuProfiler &gpu_profiler() const { return gpu_profiler_; }
+
   Renderer() : model_view_projection_(mat4::Identity()),
                model_(mat4::Identity()), color_(mathfu::kOnes4f),
                light_pos_(mathfu::kZeros3f), camera_pos_(mathfu::kZeros3f),
-               window_size_(mathfu::kZeros2i), window_(nullptr),
-               context_(nullptr) {}
+               window_size_(mathfu::kZeros2i), refresh_rate_(0),
+               default_framebuffer_(0), frame_count_(0),
+               window_(nullptr),
+               context_(nullptr) {
+    InvalidateStateCache();
+  }
   ~Renderer() { ShutDown(); }
 
   // Shader uniform: model_view_projection
@@ -128,6 +308,29 @@ class Renderer {
 
  private:
   GLuint CompileShader(GLenum stage, GLuint program, const GLchar *source);
+  void SetWindowViewport();
+  GLuint GenTexture(const vec2i &size);
+  void UploadTextureLevel(int level, const uint8_t *buffer, const vec2i &size,
+                          TextureFormat format);
+  uint8_t *UnpackTexture(const char *filename, const MappedFile &file,
+                         vec2i *dimensions, bool *has_alpha);
+  void InitializeInstancing();
+  void InitializeVertexArrays();
+  void InitializeCompressedTextures();
+  void InitializeTimerQueries();
+  void InitializeProgramBinaries();
+  void InitializePixelBuffers();
+  // Make the upload buffers whose fences have signalled free for reuse, and
+  // delete the ones that have been free for a while.
+  void RecycleUploadBuffers();
+  void DeleteUploadBuffers();
+  Shader *LoadProgramBinary(const char *filename, uint64_t key);
+  void SaveProgramBinary(GLuint program, const char *filename, uint64_t key);
+  bool SupportsCompressedFormat(uint32_t format) const;
+
+  // Count a state change that reached GL if 'changed', or was skipped.
+  // Returns 'changed'.
+  bool CountStateChange(bool changed) const;
 
   // The mvp. Use the Ortho() and Perspective() methods in mathfu::Matrix
   // to conveniently change the camera.
@@ -138,6 +341,11 @@ class Renderer {
   vec3 camera_pos_;
 
   vec2i window_size_;
+  int refresh_rate_;
+
+  // The window's framebuffer, which isn't 0 on every platform.
+  GLint default_framebuffer_;
+  unsigned int frame_count_;
 
   std::string last_error_;
 
@@ -147,6 +355,50 @@ class Renderer {
   BlendMode blend_mode_;
 
   bool use_16bpp_;
+
+  // Compressed texture formats the driver decodes, from
+  // GL_COMPRESSED_TEXTURE_FORMATS, and the file suffixes of the variants
+  // LoadCompressedTexture() looks for, best first.
+  std::vector<uint32_t> compressed_formats_;
+  std::vector<const char *> compressed_suffixes_;
+
+  GpuProfiler gpu_profiler_;
+
+  // See shader_cache_dir(). Cached programs are keyed by their source and
+  // driver_id_, which names the driver and its version.
+  std::string shader_cache_dir_;
+  std::string driver_id_;
+
+  // Pixel buffer objects made by MapUploadBuffer(). Each is mapped, being
+  // read by the driver until 'fence' signals, or free since 'free_frame'.
+  struct UploadBuffer {
+    GLuint buffer;
+    size_t size;
+    bool mapped;
+    FPLGLsync fence;
+    unsigned int free_frame;
+  };
+  std::vector<UploadBuffer> upload_buffers_;
+
+  // The GL state that the Renderer last set. Mutable, since binding through
+  // a const Renderer still changes GL state. kUnknown* values never match,
+  // so the next change always reaches GL.
+  struct GLState {
+    GLuint program;
+    int active_texture_unit;
+    GLuint textures[kMaxTexturesPerShader];
+    GLuint array_buffer;
+    GLuint element_array_buffer;
+    GLuint vertex_array;
+    int depth_test;  // 0, 1 or kUnknownDepthTest.
+  };
+  static const GLuint kUnknownObject = ~0u;
+  static const int kUnknownTextureUnit = -1;
+  static const int kUnknownDepthTest = -1;
+  mutable GLState state_;
+
+  mutable StateCounters state_counters_;
+  StateCounters last_frame_state_counters_;
 };
 
 }  // namespace fpl
@@ -0,0 +1,122 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "replay_benchmark.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <sstream>
+
+namespace fpl {
+
+static std::atomic<uint64_t> allocation_count(0);
+
+void ReplayBenchmark::AddFrame(double seconds, uint64_t allocations,
+                               int draw_calls) {
+  frame_ms_.push_back(seconds * 1000.0);
+  allocations_ += allocations;
+  draw_calls_ += static_cast<uint64_t>(draw_calls);
+}
+
+std::vector<BenchmarkMetric> ReplayBenchmark::Results() const {
+  const double frames = static_cast<double>(std::max(NumFrames(), 1));
+  std::vector<BenchmarkMetric> metrics;
+  metrics.push_back(BenchmarkMetric("frames", NumFrames()));
+  metrics.push_back(BenchmarkMetric("frame_ms_p50",
+                                    Percentile(frame_ms_, 0.5)));
+  metrics.push_back(BenchmarkMetric("frame_ms_p95",
+                                    Percentile(frame_ms_, 0.95)));
+  metrics.push_back(BenchmarkMetric("frame_ms_p99",
+                                    Percentile(frame_ms_, 0.99)));
+  metrics.push_back(BenchmarkMetric("frame_ms_max",
+                                    Percentile(frame_ms_, 1.0)));
+  metrics.push_back(BenchmarkMetric(
+      "allocations_per_frame", static_cast<double>(allocations_) / frames));
+  metrics.push_back(BenchmarkMetric(
+      "draw_calls_per_frame", static_cast<double>(draw_calls_) / frames));
+  return metrics;
+}
+
+double Percentile(std::vector<double> samples, double fraction) {
+  if (samples.empty())
+    return 0.0;
+  const size_t count = samples.size();
+  const size_t rank = static_cast<size_t>(
+      std::ceil(fraction * static_cast<double>(count)));
+  const size_t index = rank > 0 ? std::min(rank, count) - 1 : 0;
+  std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+  return samples[index];
+}
+
+std::string FormatBenchmarkMetrics(
+    const std::vector<BenchmarkMetric> &metrics) {
+  std::ostringstream text;
+  for (size_t i = 0; i < metrics.size(); ++i) {
+    text << metrics[i].name << " " << metrics[i].value << "\n";
+  }
+  return text.str();
+}
+
+bool ParseBenchmarkBaseline(const std::string &text,
+                            std::vector<BenchmarkBaseline> *baselines) {
+  std::istringstream lines(text);
+  std::string line;
+  while (std::getline(lines, line)) {
+    std::istringstream fields(line);
+    BenchmarkBaseline baseline;
+    if (!(fields >> baseline.name) || baseline.name[0] == '#')
+      continue;
+    if (!(fields >> baseline.value))
+      return false;
+    if (!(fields >> baseline.tolerance)) {
+      baseline.tolerance = kDefaultBenchmarkTolerance;
+    }
+    baselines->push_back(baseline);
+  }
+  return true;
+}
+
+bool CompareToBaseline(const std::vector<BenchmarkMetric> &metrics,
+                       const std::vector<BenchmarkBaseline> &baselines,
+                       std::vector<std::string> *regressions) {
+  bool passed = true;
+  for (size_t i = 0; i < metrics.size(); ++i) {
+    for (size_t j = 0; j < baselines.size(); ++j) {
+      const BenchmarkBaseline &baseline = baselines[j];
+      if (baseline.name != metrics[i].name)
+        continue;
+      const double limit = baseline.value * (1.0 + baseline.tolerance);
+      if (metrics[i].value > limit) {
+        std::ostringstream regression;
+        regression << metrics[i].name << " is " << metrics[i].value
+                   << ", over the baseline's " << baseline.value << " by more"
+                   << " than " << baseline.tolerance * 100.0 << "%";
+        regressions->push_back(regression.str());
+        passed = false;
+      }
+    }
+  }
+  return passed;
+}
+
+void CountAllocation() {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t AllocationCount() {
+  return allocation_count.load(std::memory_order_relaxed);
+}
+
+}  // fpl
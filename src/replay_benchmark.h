@@ -0,0 +1,96 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FPL_REPLAY_BENCHMARK_H
+#define FPL_REPLAY_BENCHMARK_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace fpl {
+
+// A named result of a benchmark run, such as "frame_ms_p95". Smaller is
+// better for every metric but "frames", which only confirms that the whole
+// replay was measured.
+struct BenchmarkMetric {
+  BenchmarkMetric(const std::string &name, double value)
+      : name(name), value(value) {}
+
+  std::string name;
+  double value;
+};
+
+// The value of a metric in a reference run, and the fraction it may grow
+// by before the metric counts as regressed.
+struct BenchmarkBaseline {
+  std::string name;
+  double value;
+  double tolerance;
+};
+
+// Used by baselines that don't give a tolerance of their own.
+static const double kDefaultBenchmarkTolerance = 0.1;
+
+// Collects the cost of every frame of a replayed match, so that builds and
+// devices can be compared on exactly the same work.
+class ReplayBenchmark {
+ public:
+  ReplayBenchmark() : allocations_(0), draw_calls_(0) {}
+
+  // Add a frame that took 'seconds', made 'allocations' heap allocations
+  // and issued 'draw_calls' draw calls.
+  void AddFrame(double seconds, uint64_t allocations, int draw_calls);
+
+  int NumFrames() const { return static_cast<int>(frame_ms_.size()); }
+
+  // "frames", "frame_ms_p50", "frame_ms_p95", "frame_ms_p99",
+  // "frame_ms_max", "allocations_per_frame" and "draw_calls_per_frame".
+  std::vector<BenchmarkMetric> Results() const;
+
+ private:
+  std::vector<double> frame_ms_;
+  uint64_t allocations_;
+  uint64_t draw_calls_;
+};
+
+// The sample at 'fraction', from 0 to 1, of the way through the sorted
+// 'samples', by nearest rank. 0 if there are none.
+double Percentile(std::vector<double> samples, double fraction);
+
+// One "name value" line per metric.
+std::string FormatBenchmarkMetrics(const std::vector<BenchmarkMetric> &metrics);
+
+// Read "name value [tolerance]" lines, as written by
+// FormatBenchmarkMetrics() with an optional tolerance added. Blank lines and
+// lines starting with # are skipped. Returns false if a line can't be read.
+bool ParseBenchmarkBaseline(const std::string &text,
+                            std::vector<BenchmarkBaseline> *baselines);
+
+// Add a description of each metric that grew past its baseline's tolerance
+// to 'regressions'. Metrics without a baseline are not checked. Returns true
+// if nothing regressed.
+bool CompareToBaseline(const std::vector<BenchmarkMetric> &metrics,
+                       const std::vector<BenchmarkBaseline> &baselines,
+                       std::vector<std::string> *regressions);
+
+// Count a heap allocation. Called by the global operator new of the game.
+void CountAllocation();
+
+// Heap allocations made so far, on any thread.
+uint64_t AllocationCount();
+
+}  // fpl
+
+#endif  // FPL_REPLAY_BENCHMARK_H
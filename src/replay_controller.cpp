@@ -0,0 +1,50 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "input_recording.h"
+#include "replay_controller.h"
+
+namespace fpl {
+namespace pie_noon {
+
+ReplayController::ReplayController()
+    : recording_(nullptr),
+      frame_(0) {
+}
+
+void ReplayController::Initialize(const InputRecording* recording,
+                                  CharacterId character_id) {
+  recording_ = recording;
+  frame_ = 0;
+  character_id_ = character_id;
+  controller_type_ = recording->controller_type(character_id);
+  ClearAllLogicalInputs();
+}
+
+void ReplayController::AdvanceFrame(WorldTime /*delta_time*/) {
+  if (frame_ >= recording_->NumFrames()) {
+    ClearAllLogicalInputs();
+    return;
+  }
+  const InputRecording::Inputs& inputs =
+      recording_->inputs(frame_, character_id_);
+  is_down_ = inputs.is_down;
+  went_down_ = inputs.went_down;
+  went_up_ = inputs.went_up;
+  frame_++;
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,48 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REPLAY_CONTROLLER_H_
+#define REPLAY_CONTROLLER_H_
+
+#include "controller.h"
+
+namespace fpl {
+namespace pie_noon {
+
+class InputRecording;
+
+// Plays back one character's inputs from an InputRecording, one frame per
+// AdvanceFrame(). Reports the controller type that was recorded, so that
+// the game treats recorded humans as humans and recorded AIs as AIs.
+class ReplayController : public Controller {
+ public:
+  ReplayController();
+
+  // Play back the inputs of 'character_id' from the first frame of
+  // 'recording'.
+  void Initialize(const InputRecording* recording, CharacterId character_id);
+
+  // Load the inputs of the next recorded frame. After the last frame, all
+  // inputs are released.
+  virtual void AdvanceFrame(WorldTime delta_time);
+
+ private:
+  const InputRecording* recording_;
+  int frame_;
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // REPLAY_CONTROLLER_H_
@@ -0,0 +1,70 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "resolution_scaler.h"
+
+#include <algorithm>
+
+namespace fpl {
+
+// Frames up to this many periods long are on time. Leaves room for the
+// jitter of sleeping or vsync.
+static const double kLateFrameTolerance = 1.2;
+
+const int ResolutionScaler::kLateFramesToLower;
+const int ResolutionScaler::kInitialRaiseDelay;
+const int ResolutionScaler::kMaxRaiseDelay;
+
+ResolutionScaler::ResolutionScaler()
+    : min_scale_(1.0f), step_(0.0f), scale_(1.0f), late_frames_(0),
+      on_time_frames_(0), raise_delay_(kInitialRaiseDelay), raised_(false) {}
+
+void ResolutionScaler::Initialize(float min_scale, float step) {
+  min_scale_ = std::min(std::max(min_scale, step), 1.0f);
+  step_ = step;
+  scale_ = 1.0f;
+  late_frames_ = 0;
+  on_time_frames_ = 0;
+  raise_delay_ = kInitialRaiseDelay;
+  raised_ = false;
+}
+
+bool ResolutionScaler::Update(double frame_time, double period) {
+  if (frame_time > period * kLateFrameTolerance) {
+    on_time_frames_ = 0;
+    if (++late_frames_ < kLateFramesToLower || scale_ <= min_scale_)
+      return false;
+    late_frames_ = 0;
+    if (raised_) {
+      raise_delay_ = std::min(raise_delay_ * 2, kMaxRaiseDelay);
+    }
+    raised_ = false;
+    scale_ = std::max(scale_ - step_, min_scale_);
+    return true;
+  }
+
+  late_frames_ = 0;
+  if (++on_time_frames_ < raise_delay_ || scale_ >= 1.0f) return false;
+  on_time_frames_ = 0;
+  raised_ = true;
+  scale_ = std::min(scale_ + step_, 1.0f);
+  return true;
+}
+
+int ResolutionScaler::Scale(int length) const {
+  return std::max(static_cast<int>(length * scale_ + 0.5f), 1);
+}
+
+}  // fpl
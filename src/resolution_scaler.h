@@ -0,0 +1,77 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef RESOLUTION_SCALER_H
+#define RESOLUTION_SCALER_H
+
+namespace fpl {
+
+// Chooses the fraction of the window's resolution to draw the 3D scene at,
+// from how long frames take. Lowers it when frames run late, so that the
+// GPU has less to fill, and raises it again once frames have been on time
+// for a while.
+//
+// A drop soon after a raise means the raise was too much, so each one
+// doubles the wait before the next raise. That keeps the scale from
+// oscillating around the largest one the GPU can sustain.
+class ResolutionScaler {
+ public:
+  // Consecutive late frames that lower the scale. A single long frame, such
+  // as one that loads a texture, doesn't.
+  static const int kLateFramesToLower = 3;
+
+  // Consecutive on-time frames before the first raise, and the most that
+  // the wait can back off to.
+  static const int kInitialRaiseDelay = 120;
+  static const int kMaxRaiseDelay = 1920;
+
+  ResolutionScaler();
+
+  // Start at full resolution. The scale moves by 'step', and never goes
+  // below 'min_scale'.
+  void Initialize(float min_scale, float step);
+
+  // Call once a frame with how long the frame took and how long it should
+  // have taken, in seconds. Returns true if scale() changed.
+  bool Update(double frame_time, double period);
+
+  // Fraction of the window's width and height to draw at, in
+  // [min_scale, 1].
+  float scale() const { return scale_; }
+
+  // Returns 'size' scaled by scale(), at least one pixel.
+  template<class Vec2i>
+  Vec2i ScaledSize(const Vec2i& size) const {
+    return Vec2i(Scale(size.x()), Scale(size.y()));
+  }
+
+ private:
+  int Scale(int length) const;
+
+  float min_scale_;
+  float step_;
+  float scale_;
+
+  int late_frames_;
+  int on_time_frames_;
+  int raise_delay_;
+
+  // True if the last change was a raise.
+  bool raised_;
+};
+
+}  // fpl
+
+#endif  // RESOLUTION_SCALER_H
@@ -0,0 +1,78 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+
+namespace fpl {
+
+// A small, fast pseudo-random number generator (PCG32: a 64-bit linear
+// congruential generator with a permuted 32-bit output).
+//
+// Each system that needs random numbers owns its own Rng, instead of sharing
+// rand(). Their sequences are then independent of each other, reproducible
+// from a seed, and safe to draw from on different threads. The state is a
+// single integer, so an Rng can be saved and restored by copying it.
+class Rng {
+ public:
+  explicit Rng(uint64_t seed = 0) { Seed(seed); }
+
+  // Restart the sequence. Equal seeds give equal sequences.
+  void Seed(uint64_t seed) {
+    state_ = 0;
+    Next();
+    state_ += seed;
+    Next();
+  }
+
+  // Uniform over all 32-bit values.
+  uint32_t Next() {
+    const uint64_t state = state_;
+    state_ = state * kMultiplier + kIncrement;
+    const uint32_t xorshifted =
+        static_cast<uint32_t>(((state >> 18) ^ state) >> 27);
+    const uint32_t rotation = static_cast<uint32_t>(state >> 59);
+    return (xorshifted >> rotation) | (xorshifted << ((32 - rotation) & 31));
+  }
+
+  // Uniform in [0, 1).
+  float Float() {
+    return static_cast<float>(Next() >> 8) * (1.0f / 16777216.0f);
+  }
+
+  // Uniform in [start, end).
+  float FloatInRange(float start, float end) {
+    return start + (end - start) * Float();
+  }
+
+  // Uniform in [start, end). Returns 'start' if the range is empty.
+  int IntInRange(int start, int end) {
+    if (end <= start)
+      return start;
+    const uint32_t range = static_cast<uint32_t>(end - start);
+    return start + static_cast<int>(Next() % range);
+  }
+
+ private:
+  static const uint64_t kMultiplier = 6364136223846793005ULL;
+  static const uint64_t kIncrement = 1442695040888963407ULL;
+
+  uint64_t state_;
+};
+
+}  // fpl
+
+#endif  // RNG_H
@@ -0,0 +1,108 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "rollback_match.h"
+
+namespace fpl {
+namespace pie_noon {
+
+void RollbackController::Initialize(CharacterId character_id,
+                                    ControllerType controller_type) {
+  character_id_ = character_id;
+  controller_type_ = controller_type;
+  ClearAllLogicalInputs();
+}
+
+RollbackMatch::RollbackMatch()
+    : game_state_(nullptr),
+      step_(0),
+      audio_engine_(nullptr) {
+}
+
+void RollbackMatch::Initialize(GameState* game_state,
+                               const std::vector<Controller*>& controllers,
+                               uint32_t local_players, unsigned int seed,
+                               WorldTime step, int max_rollback_frames) {
+  auto& characters = game_state->characters();
+  assert(controllers.size() == characters.size());
+  game_state_ = game_state;
+  controllers_ = controllers;
+  step_ = step;
+
+  // The Rng is part of the snapshots, so seeding it once is enough.
+  game_state->rng().Seed(seed);
+
+  rollback_controllers_.clear();
+  for (size_t i = 0; i < characters.size(); ++i) {
+    RollbackController* controller = new RollbackController();
+    controller->Initialize(static_cast<CharacterId>(i),
+                           controllers[i]->controller_type());
+    rollback_controllers_.push_back(
+        std::unique_ptr<RollbackController>(controller));
+    characters[i]->set_controller(controller);
+  }
+  snapshots_.resize(max_rollback_frames + 1);
+  session_.Initialize(this, static_cast<int>(characters.size()),
+                      local_players, max_rollback_frames);
+}
+
+void RollbackMatch::Shutdown() {
+  auto& characters = game_state_->characters();
+  for (size_t i = 0; i < characters.size(); ++i) {
+    characters[i]->set_controller(controllers_[i]);
+  }
+  rollback_controllers_.clear();
+}
+
+bool RollbackMatch::AdvanceFrame(AudioEngine* audio_engine) {
+  audio_engine_ = audio_engine;
+  for (int i = 0; i < session_.num_players(); ++i) {
+    if (!session_.IsLocal(i))
+      continue;
+    Controller* controller = controllers_[i];
+    controller->AdvanceFrame(step_);
+    session_.SetLocalInput(i, RollbackInputs(controller->is_down(),
+                                             controller->went_down(),
+                                             controller->went_up()));
+  }
+  return session_.AdvanceFrame();
+}
+
+void RollbackMatch::SaveState(int slot) {
+  game_state_->Snapshot(&snapshots_[slot]);
+}
+
+void RollbackMatch::LoadState(int slot) {
+  game_state_->Restore(snapshots_[slot]);
+}
+
+// Frames that are re-simulated have already been heard and seen, so their
+// sounds and GPU particles are dropped.
+void RollbackMatch::SimulateFrame(int /*frame*/, const RollbackInputs* inputs,
+                                  bool resimulating) {
+  AudioEngine* audio_engine = resimulating ? nullptr : audio_engine_;
+  auto& characters = game_state_->characters();
+  for (size_t i = 0; i < characters.size(); ++i) {
+    rollback_controllers_[i]->SetInputs(inputs[i]);
+    characters[i]->set_audio_engine(audio_engine);
+  }
+  game_state_->AdvanceFrame(step_, audio_engine);
+  if (resimulating) {
+    game_state_->DiscardGpuParticleSpawns();
+  }
+}
+
+}  // pie_noon
+}  // fpl
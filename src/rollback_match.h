@@ -0,0 +1,108 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ROLLBACK_MATCH_H_
+#define ROLLBACK_MATCH_H_
+
+#include <memory>
+#include <vector>
+#include "controller.h"
+#include "game_state.h"
+#include "rollback_session.h"
+
+namespace fpl {
+
+class AudioEngine;
+
+namespace pie_noon {
+
+// Drives a character with the inputs chosen by a RollbackSession. Those are
+// the inputs of the player on this device, or the remote player's inputs,
+// which may only be predicted.
+class RollbackController : public Controller {
+ public:
+  RollbackController() {}
+
+  // Play as 'controller_type', so the game treats AIs and humans as it
+  // would locally.
+  void Initialize(CharacterId character_id, ControllerType controller_type);
+
+  // The inputs are set by SetInputs() instead.
+  virtual void AdvanceFrame(WorldTime /*delta_time*/) {}
+
+  void SetInputs(const RollbackInputs& inputs) {
+    is_down_ = inputs.is_down;
+    went_down_ = inputs.went_down;
+    went_up_ = inputs.went_up;
+  }
+};
+
+// A match with players on other devices. Every peer simulates the whole
+// match, and a RollbackSession hides the network latency (see there).
+//
+// Each character is driven by a RollbackController. The controllers of the
+// characters on this device are read every AdvanceFrame(), and their inputs
+// passed to the session. AIs are played by one peer only, and sent like any
+// other input, so that their random choices don't have to be reproduced.
+class RollbackMatch : public RollbackSimulation {
+ public:
+  RollbackMatch();
+
+  // 'controllers' has the controller of every character in 'game_state'.
+  // Those of remote characters are never advanced, but give the type of
+  // controller to play as. 'seed' and 'step' must be the same on all peers.
+  void Initialize(GameState* game_state,
+                  const std::vector<Controller*>& controllers,
+                  uint32_t local_players, unsigned int seed, WorldTime step,
+                  int max_rollback_frames);
+
+  // Put back the controllers given to Initialize().
+  void Shutdown();
+
+  // Read the local controllers and advance the session by one frame of
+  // 'step'. Returns false if the session is waiting for remote inputs.
+  bool AdvanceFrame(AudioEngine* audio_engine);
+
+  RollbackSession& session() { return session_; }
+  const RollbackSession& session() const { return session_; }
+
+  // RollbackSimulation, called by the session.
+  virtual void SaveState(int slot);
+  virtual void LoadState(int slot);
+  virtual void SimulateFrame(int frame, const RollbackInputs* inputs,
+                             bool resimulating);
+
+ private:
+  GameState* game_state_;
+
+  // The controllers passed to Initialize(), one per character.
+  std::vector<Controller*> controllers_;
+
+  // Installed on the characters in place of controllers_.
+  std::vector<std::unique_ptr<RollbackController>> rollback_controllers_;
+
+  // The state at the start of each frame that can still be rolled back to.
+  std::vector<GameStateSnapshot> snapshots_;
+
+  RollbackSession session_;
+  WorldTime step_;
+
+  // Where sounds go for frames that are simulated for the first time.
+  AudioEngine* audio_engine_;
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // ROLLBACK_MATCH_H_
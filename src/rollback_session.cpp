@@ -0,0 +1,176 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cassert>
+#include "rollback_session.h"
+
+namespace fpl {
+
+RollbackSession::RollbackSession()
+    : simulation_(nullptr),
+      num_players_(0),
+      local_players_(0),
+      max_rollback_frames_(0),
+      input_ring_size_(0),
+      frame_(0),
+      rollback_frame_(0),
+      rollbacks_(0),
+      resimulated_frames_(0),
+      stalls_(0),
+      dropped_inputs_(0) {
+}
+
+void RollbackSession::Initialize(RollbackSimulation* simulation,
+                                 int num_players, uint32_t local_players,
+                                 int max_rollback_frames) {
+  assert(num_players > 0 && num_players <= 32);
+  assert(max_rollback_frames >= 0);
+  simulation_ = simulation;
+  num_players_ = num_players;
+  local_players_ = local_players;
+  max_rollback_frames_ = max_rollback_frames;
+
+  // Remote players can be up to max_rollback_frames ahead of us, as well as
+  // that far behind.
+  input_ring_size_ = 2 * (max_rollback_frames + 1);
+  input_slots_.assign(num_players * input_ring_size_, InputSlot());
+  confirmed_.assign(num_players, 0);
+  frame_inputs_.assign(num_players, RollbackInputs());
+  frame_ = 0;
+  rollback_frame_ = 0;
+  rollbacks_ = 0;
+  resimulated_frames_ = 0;
+  stalls_ = 0;
+  dropped_inputs_ = 0;
+}
+
+RollbackSession::InputSlot& RollbackSession::Slot(int player, int frame) {
+  InputSlot& slot =
+      input_slots_[player * input_ring_size_ + frame % input_ring_size_];
+  if (slot.frame != frame) {
+    slot = InputSlot();
+    slot.frame = frame;
+  }
+  return slot;
+}
+
+void RollbackSession::Confirm(int player, int frame,
+                              const RollbackInputs& inputs) {
+  InputSlot& slot = Slot(player, frame);
+  if (slot.confirmed)
+    return;
+  slot.inputs = inputs;
+  slot.confirmed = true;
+
+  // A frame that has been simulated with the wrong input must be redone.
+  if (frame < frame_ && slot.used != inputs) {
+    rollback_frame_ = std::min(rollback_frame_, frame);
+  }
+
+  int& confirmed = confirmed_[player];
+  while (Slot(player, confirmed).confirmed) {
+    confirmed++;
+  }
+}
+
+// Held buttons stay held, and nothing new is pressed or released.
+RollbackInputs RollbackSession::Predict(int player) const {
+  const int last = confirmed_[player] - 1;
+  if (last < 0)
+    return RollbackInputs();
+  const InputSlot& slot =
+      input_slots_[player * input_ring_size_ + last % input_ring_size_];
+  return RollbackInputs(slot.inputs.is_down, 0, 0);
+}
+
+void RollbackSession::GatherInputs(int frame) {
+  for (int i = 0; i < num_players_; ++i) {
+    InputSlot& slot = Slot(i, frame);
+    slot.used = slot.confirmed ? slot.inputs : Predict(i);
+    frame_inputs_[i] = slot.used;
+  }
+}
+
+void RollbackSession::SetLocalInput(int player, const RollbackInputs& inputs) {
+  assert(IsLocal(player));
+  InputSlot& slot = Slot(player, frame_);
+  if (slot.confirmed) {
+    // Set again because the last AdvanceFrame() stalled. Keep the presses
+    // and releases of both.
+    slot.inputs.is_down = inputs.is_down;
+    slot.inputs.went_down |= inputs.went_down;
+    slot.inputs.went_up |= inputs.went_up;
+    return;
+  }
+  Confirm(player, frame_, inputs);
+}
+
+bool RollbackSession::AddRemoteInput(int player, int frame,
+                                     const RollbackInputs& inputs) {
+  assert(0 <= player && player < num_players_ && !IsLocal(player));
+  if (frame < confirmed_[player])
+    return true;
+  if (frame >= confirmed_[player] + input_ring_size_) {
+    dropped_inputs_++;
+    return false;
+  }
+  Confirm(player, frame, inputs);
+  return true;
+}
+
+int RollbackSession::confirmed_frame() const {
+  return *std::min_element(confirmed_.begin(), confirmed_.end());
+}
+
+bool RollbackSession::AdvanceFrame() {
+  // Go back to the first mispredicted frame, and replay every frame after it
+  // with the inputs as they are now known. The state at the start of each
+  // replayed frame replaces the one saved when it was first simulated.
+  if (rollback_frame_ < frame_) {
+    simulation_->LoadState(StateSlot(rollback_frame_));
+    rollbacks_++;
+    for (int frame = rollback_frame_; frame < frame_; ++frame) {
+      if (frame != rollback_frame_) {
+        simulation_->SaveState(StateSlot(frame));
+      }
+      GatherInputs(frame);
+      simulation_->SimulateFrame(frame, &frame_inputs_[0], true);
+      resimulated_frames_++;
+    }
+  }
+  rollback_frame_ = frame_;
+
+  for (int i = 0; i < num_players_; ++i) {
+    if (IsLocal(i)) {
+      if (confirmed_[i] <= frame_) {
+        Confirm(i, frame_, Predict(i));
+      }
+    } else if (frame_ >= confirmed_[i] + max_rollback_frames_) {
+      // Simulating another frame would overwrite the state that this
+      // player's next input may need to roll back to.
+      stalls_++;
+      return false;
+    }
+  }
+
+  simulation_->SaveState(StateSlot(frame_));
+  GatherInputs(frame_);
+  simulation_->SimulateFrame(frame_, &frame_inputs_[0], false);
+  frame_++;
+  rollback_frame_ = frame_;
+  return true;
+}
+
+}  // fpl
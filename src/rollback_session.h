@@ -0,0 +1,171 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ROLLBACK_SESSION_H
+#define ROLLBACK_SESSION_H
+
+#include <cstdint>
+#include <vector>
+
+namespace fpl {
+
+// One player's logical inputs for one frame. The same bits as a Controller's
+// is_down(), went_down() and went_up(); this is what peers send each other.
+struct RollbackInputs {
+  RollbackInputs() : is_down(0), went_down(0), went_up(0) {}
+  RollbackInputs(uint32_t is_down, uint32_t went_down, uint32_t went_up)
+      : is_down(is_down), went_down(went_down), went_up(went_up) {}
+
+  bool operator==(const RollbackInputs& rhs) const {
+    return is_down == rhs.is_down && went_down == rhs.went_down &&
+           went_up == rhs.went_up;
+  }
+  bool operator!=(const RollbackInputs& rhs) const { return !operator==(rhs); }
+
+  uint32_t is_down;
+  uint32_t went_down;
+  uint32_t went_up;
+};
+
+// A deterministic simulation driven by a RollbackSession. Simulating the
+// same frames with the same inputs from the same saved state must give the
+// same result, bit for bit.
+class RollbackSimulation {
+ public:
+  virtual ~RollbackSimulation() {}
+
+  // Save the current state in 'slot', overwriting what was there. Slots are
+  // in [0, max_rollback_frames]; keep storage for each and reuse it.
+  virtual void SaveState(int slot) = 0;
+
+  // Return to the state last saved in 'slot'.
+  virtual void LoadState(int slot) = 0;
+
+  // Advance by one frame. 'inputs' has an entry for every player. Frames
+  // are re-simulated, with 'resimulating' set, when a remote input turns out
+  // to differ from its prediction. Sounds and other effects the player has
+  // already seen should not be repeated in that case.
+  virtual void SimulateFrame(int frame, const RollbackInputs* inputs,
+                             bool resimulating) = 0;
+};
+
+// Keeps a networked match responsive by not waiting for remote inputs.
+//
+// Each frame is simulated straight away. Remote players whose inputs have
+// not arrived yet are assumed to keep holding the buttons they held in the
+// last input that did arrive. When a late input differs from its prediction,
+// the simulation is rolled back to the start of that frame and re-simulated
+// up to the present, inside the next AdvanceFrame().
+//
+// The state at the start of each of the last max_rollback_frames frames
+// is saved. If a remote player falls further behind than that, the session
+// stalls until their inputs catch up. With max_rollback_frames of 0, the
+// session is in lockstep.
+//
+// The session only orders inputs; sending them is up to the caller. Send
+// each local input given to SetLocalInput(), tagged with frame(), and pass
+// what is received to AddRemoteInput().
+class RollbackSession {
+ public:
+  RollbackSession();
+
+  // 'local_players' has bit i set if player i is on this device. Every
+  // player's inputs start out released.
+  void Initialize(RollbackSimulation* simulation, int num_players,
+                  uint32_t local_players, int max_rollback_frames);
+
+  // Set the inputs of a local player for frame(). If a local player's input
+  // is not set, they keep holding what they held in the previous frame. If
+  // it is set more than once, because AdvanceFrame() stalled, the presses
+  // and releases are combined.
+  void SetLocalInput(int player, const RollbackInputs& inputs);
+
+  // Record the input of a remote player for 'frame'. Inputs for frames that
+  // are already confirmed are ignored, so a transport may send duplicates.
+  // Returns false, and drops the input, if 'frame' is too far ahead of the
+  // last confirmed input to be held.
+  bool AddRemoteInput(int player, int frame, const RollbackInputs& inputs);
+
+  // Roll back and re-simulate if a prediction was wrong, then simulate
+  // frame(). Returns false, without simulating frame(), if a remote player's
+  // inputs are too far behind.
+  bool AdvanceFrame();
+
+  // The next frame to be simulated.
+  int frame() const { return frame_; }
+
+  // Every player's inputs are known for the frames before this one, so they
+  // will not be re-simulated.
+  int confirmed_frame() const;
+
+  bool IsLocal(int player) const { return (local_players_ >> player) & 1; }
+  int num_players() const { return num_players_; }
+  int max_rollback_frames() const { return max_rollback_frames_; }
+
+  // Statistics, for tuning max_rollback_frames.
+  int rollbacks() const { return rollbacks_; }
+  int resimulated_frames() const { return resimulated_frames_; }
+  int stalls() const { return stalls_; }
+  int dropped_inputs() const { return dropped_inputs_; }
+
+ private:
+  // The input of one player for one frame.
+  struct InputSlot {
+    InputSlot() : frame(-1), confirmed(false) {}
+    // Frame the slot holds, or -1 if unused.
+    int frame;
+    // The real input, if 'confirmed'.
+    RollbackInputs inputs;
+    bool confirmed;
+    // The input the frame was last simulated with.
+    RollbackInputs used;
+  };
+
+  InputSlot& Slot(int player, int frame);
+  void Confirm(int player, int frame, const RollbackInputs& inputs);
+  RollbackInputs Predict(int player) const;
+  void GatherInputs(int frame);
+  int StateSlot(int frame) const { return frame % (max_rollback_frames_ + 1); }
+
+  RollbackSimulation* simulation_;
+  int num_players_;
+  uint32_t local_players_;
+  int max_rollback_frames_;
+
+  // Rings of 2 * (max_rollback_frames + 1) inputs per player, player by
+  // player.
+  std::vector<InputSlot> input_slots_;
+  int input_ring_size_;
+
+  // Player i's inputs are confirmed for every frame before confirmed_[i].
+  std::vector<int> confirmed_;
+
+  // Inputs of the frame being simulated, one per player.
+  std::vector<RollbackInputs> frame_inputs_;
+
+  int frame_;
+
+  // Earliest simulated frame whose inputs turned out to be wrong, or
+  // frame_ when there is nothing to roll back.
+  int rollback_frame_;
+
+  int rollbacks_;
+  int resimulated_frames_;
+  int stalls_;
+  int dropped_inputs_;
+};
+
+}  // fpl
+
+#endif  // ROLLBACK_SESSION_H
@@ -0,0 +1,96 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "impel_flatbuffers.h"
+#include "runtime_config.h"
+#include "utilities.h"
+
+namespace fpl {
+namespace pie_noon {
+
+void RuntimeConfig::Initialize(const Config& config) {
+  game_mode_ = config.game_mode();
+
+  const auto renderables = config.renderables();
+  const int num_renderables = static_cast<int>(renderables->Length());
+  renderable_flags_.resize(num_renderables);
+  renderable_offsets_.resize(num_renderables);
+  for (int i = 0; i < num_renderables; ++i) {
+    const CardboardFigure* renderable = renderables->Get(i);
+    renderable_flags_[i] = static_cast<uint8_t>(
+        (renderable->stick() ? kRenderableStick : 0) |
+        (renderable->cardboard() ? kRenderableCardboard : 0) |
+        (renderable->shadow() ? kRenderableShadow : 0));
+    renderable_offsets_[i] = renderable->offset() == nullptr ?
+                             mathfu::kZeros3f : LoadVec3(renderable->offset());
+  }
+
+  // Same tint as the characters have always been drawn with.
+  const float brightness = config.character_global_brightness_factor();
+  const auto colors = config.character_colors();
+  const int num_colors = static_cast<int>(colors->Length());
+  character_colors_.resize(num_colors);
+  character_tints_.resize(num_colors);
+  for (int i = 0; i < num_colors; ++i) {
+    character_colors_[i] = LoadVec3(colors->Get(i));
+    character_tints_[i] = character_colors_[i] / brightness +
+                          (1 - 1 / brightness);
+  }
+  ai_color_ = LoadVec3(config.ai_color());
+
+  cardboard_ambient_material_ = LoadVec3(config.cardboard_ambient_material());
+  cardboard_diffuse_material_ = LoadVec3(config.cardboard_diffuse_material());
+  cardboard_specular_material_ =
+      LoadVec3(config.cardboard_specular_material());
+
+  // Convert each impeller specification once. Skip over "None".
+  impel::OvershootImpelInit impeller_inits[ImpellerSpecification_Count];
+  const auto impeller_specifications = config.impeller_specifications();
+  assert(impeller_specifications->Length() == ImpellerSpecification_Count);
+  for (int i = ImpellerSpecification_None + 1; i < ImpellerSpecification_Count;
+       ++i) {
+    impel::OvershootInitFromFlatBuffers(*impeller_specifications->Get(i),
+                                        &impeller_inits[i]);
+  }
+
+  const auto props = config.props();
+  const int num_props = static_cast<int>(props->Length());
+  prop_shakes_.resize(num_props);
+  prop_shake_inits_.resize(num_props);
+  num_shaking_props_ = 0;
+  for (int i = 0; i < num_props; ++i) {
+    const auto prop = props->Get(i);
+    const ImpellerSpecification impeller_spec = prop->shake_impeller();
+    prop_shakes_[i] = impeller_spec != ImpellerSpecification_None;
+    if (!prop_shakes_[i])
+      continue;
+    num_shaking_props_++;
+
+    // Bigger props have a smaller shake scale. We want them to shake more
+    // slowly, and with less amplitude.
+    const float shake_scale = prop->shake_scale();
+    impel::OvershootImpelInit& init = prop_shake_inits_[i];
+    init = impeller_inits[impeller_spec];
+    init.min *= shake_scale;
+    init.max *= shake_scale;
+    init.accel_per_difference *= shake_scale;
+  }
+
+  impel::OvershootInitFromFlatBuffers(*config.join_impeller_def(),
+                                      &join_impeller_init_);
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,120 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RUNTIME_CONFIG_H_
+#define RUNTIME_CONFIG_H_
+
+#include <cstdint>
+#include <vector>
+#include "mathfu/glsl_mappings.h"
+#include "config_generated.h"
+#include "impel_processor_overshoot.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// The Config values that are read every frame, copied out of the flatbuffer
+// once at startup. Reading a flatbuffer field means following offsets and,
+// for vectors, converting each component, so hot loops read these instead.
+//
+// Everything here is derived from the Config and never changes afterwards.
+class RuntimeConfig {
+ public:
+  // Bits of renderable_flags().
+  enum RenderableFlag {
+    kRenderableStick = 1 << 0,
+    kRenderableCardboard = 1 << 1,
+    kRenderableShadow = 1 << 2
+  };
+
+  RuntimeConfig() : game_mode_(GameMode_Survival), num_shaking_props_(0) {}
+
+  // Copy the values out of 'config'. The Config may be freed afterwards.
+  void Initialize(const Config& config);
+
+  GameMode game_mode() const { return game_mode_; }
+
+  // Indexed by RenderableId. Each renderable's RenderableFlag bits, and the
+  // offset of its texture from its origin.
+  uint8_t renderable_flags(int id) const { return renderable_flags_[id]; }
+  bool stick(int id) const {
+    return (renderable_flags_[id] & kRenderableStick) != 0;
+  }
+  bool cardboard(int id) const {
+    return (renderable_flags_[id] & kRenderableCardboard) != 0;
+  }
+  bool shadow(int id) const {
+    return (renderable_flags_[id] & kRenderableShadow) != 0;
+  }
+  const mathfu::vec3& renderable_offset(int id) const {
+    return renderable_offsets_[id];
+  }
+
+  // Indexed by CharacterId. character_color() is the color from the
+  // config, and character_tint() the color a human player's character is
+  // drawn with, after the global brightness factor has been applied. The
+  // colors repeat when there are more characters than colors, as in a large
+  // lobby.
+  const mathfu::vec3& character_color(int id) const {
+    return character_colors_[id % character_colors_.size()];
+  }
+  const mathfu::vec3& character_tint(int id) const {
+    return character_tints_[id % character_tints_.size()];
+  }
+  const mathfu::vec3& ai_color() const { return ai_color_; }
+
+  // Lighting of the cardboard material.
+  const mathfu::vec3& cardboard_ambient_material() const {
+    return cardboard_ambient_material_;
+  }
+  const mathfu::vec3& cardboard_diffuse_material() const {
+    return cardboard_diffuse_material_;
+  }
+  const mathfu::vec3& cardboard_specular_material() const {
+    return cardboard_specular_material_;
+  }
+
+  // Indexed by prop. The shake Impeller of each prop, already scaled by the
+  // prop's shake_scale. Props whose shake_impeller is None do not shake.
+  bool prop_shakes(int prop) const { return prop_shakes_[prop] != 0; }
+  const impel::OvershootImpelInit& prop_shake_init(int prop) const {
+    return prop_shake_inits_[prop];
+  }
+  int num_shaking_props() const { return num_shaking_props_; }
+
+  // The Impeller that animates the pies on the join screen.
+  const impel::OvershootImpelInit& join_impeller_init() const {
+    return join_impeller_init_;
+  }
+
+ private:
+  GameMode game_mode_;
+  std::vector<uint8_t> renderable_flags_;
+  std::vector<mathfu::vec3> renderable_offsets_;
+  std::vector<mathfu::vec3> character_colors_;
+  std::vector<mathfu::vec3> character_tints_;
+  mathfu::vec3 ai_color_;
+  mathfu::vec3 cardboard_ambient_material_;
+  mathfu::vec3 cardboard_diffuse_material_;
+  mathfu::vec3 cardboard_specular_material_;
+  std::vector<uint8_t> prop_shakes_;
+  std::vector<impel::OvershootImpelInit> prop_shake_inits_;
+  int num_shaking_props_;
+  impel::OvershootImpelInit join_impeller_init_;
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // RUNTIME_CONFIG_H_
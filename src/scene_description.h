@@ -16,7 +16,9 @@
 #define PIE_NOON_SCENE_DESCRIPTION_H
 
 #include "mathfu/glsl_mappings.h"
-#include <memory>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
 #include <vector>
 
 namespace fpl {
@@ -39,6 +41,14 @@ class Renderable {
   const mathfu::vec4& color() const { return color_; }
   void set_color(const mathfu::vec4& c) { color_ = c; }
 
+  // True if both draw the same thing, in the same place.
+  bool Matches(const Renderable& rhs) const {
+    return id_ == rhs.id_ &&
+           memcmp(&world_matrix_[0], &rhs.world_matrix_[0],
+                  16 * sizeof(float)) == 0 &&
+           memcmp(&color_[0], &rhs.color_[0], 4 * sizeof(float)) == 0;
+  }
+
  private:
   // Unique identifier for item to be rendered.
   // See renderable_id in timeline_generated.h.
@@ -51,40 +61,151 @@ class Renderable {
 
 };
 
+// Marks a renderable as drawing a baked texture over itself, in place of
+// accessories. 'key' picks the texture, and 'origin' is where the texture's
+// minimum corner lies in the renderable's object space.
+struct RenderableOverlay {
+  size_t renderable;
+  int key;
+  mathfu::vec2 origin;
+};
+
+// The renderables and lights are stored by value, contiguously. Clear() keeps
+// the memory, so once the arrays have grown to fit a typical frame, building
+// the scene makes no allocations.
+//
+// Renderables that don't move can be added as static renderables. They come
+// before all the others, and stay in their slots when ClearDynamic() removes
+// the rest, so a scene that is rebuilt every frame only has to add them
+// once.
 class SceneDescription {
  public:
+  // Typical number of renderables in a frame. Enough for the characters,
+  // props, pies, and a few confetti bursts.
+  static const size_t kInitialRenderableCapacity = 512;
+
+  SceneDescription() : num_static_renderables_(0), static_version_(0) {
+    renderables_.reserve(kInitialRenderableCapacity);
+  }
+
   const mathfu::mat4& camera() const { return camera_; }
   void set_camera(const mathfu::mat4& camera) { camera_ = camera; }
 
-  std::vector<std::unique_ptr<Renderable>>& renderables() {
-    return renderables_;
+  const mathfu::vec3& camera_position() const { return camera_position_; }
+  void set_camera_position(const mathfu::vec3& position) {
+    camera_position_ = position;
   }
-  const std::vector<std::unique_ptr<Renderable>>& renderables() const {
-    return renderables_;
+
+  // Append a renderable, constructed in place.
+  void AddRenderable(uint16_t id, const mathfu::mat4& world_matrix,
+                     const mathfu::vec4& color = mathfu::vec4(1, 1, 1, 1)) {
+    renderables_.emplace_back(id, world_matrix, color);
   }
 
-  std::vector<std::unique_ptr<mathfu::vec3>>& lights() {
-    return lights_;
+  // Append a renderable that ClearDynamic() keeps. Must be called before
+  // AddRenderable(). Returns its slot in renderables().
+  size_t AddStaticRenderable(uint16_t id, const mathfu::mat4& world_matrix,
+                             const mathfu::vec4& color =
+                                 mathfu::vec4(1, 1, 1, 1)) {
+    assert(renderables_.size() == num_static_renderables_);
+    renderables_.emplace_back(id, world_matrix, color);
+    return num_static_renderables_++;
   }
-  const std::vector<std::unique_ptr<mathfu::vec3>>& lights() const {
-    return lights_;
+
+  size_t num_static_renderables() const { return num_static_renderables_; }
+
+  // Give the last renderable added an overlay.
+  void AddOverlay(int key, const mathfu::vec2& origin) {
+    assert(renderables_.size() > num_static_renderables_);
+    RenderableOverlay overlay = { renderables_.size() - 1, key, origin };
+    overlays_.push_back(overlay);
   }
 
-  // Clear out the render list. Should be called once per frame.
+  // In the order they were added, so in order of renderable.
+  const std::vector<RenderableOverlay>& overlays() const { return overlays_; }
+
+  // Identifies what the static renderables were built from. Zero when there
+  // are none. Set by whoever adds them, so that they can tell when the scene
+  // needs rebuilding.
+  uint32_t static_version() const { return static_version_; }
+  void set_static_version(uint32_t version) { static_version_ = version; }
+
+  void AddLight(const mathfu::vec3& position) {
+    lights_.push_back(position);
+  }
+
+  std::vector<Renderable>& renderables() { return renderables_; }
+  const std::vector<Renderable>& renderables() const { return renderables_; }
+
+  std::vector<mathfu::vec3>& lights() { return lights_; }
+  const std::vector<mathfu::vec3>& lights() const { return lights_; }
+
+  // True if both scenes would draw exactly the same image. Compares the
+  // values bit for bit, so it's cheap, and settled animations match.
+  bool Matches(const SceneDescription& rhs) const {
+    if (renderables_.size() != rhs.renderables_.size() ||
+        lights_.size() != rhs.lights_.size() ||
+        overlays_.size() != rhs.overlays_.size() ||
+        memcmp(&camera_[0], &rhs.camera_[0], 16 * sizeof(float)) != 0) {
+      return false;
+    }
+    for (size_t i = 0; i < renderables_.size(); ++i) {
+      if (!renderables_[i].Matches(rhs.renderables_[i])) return false;
+    }
+    for (size_t i = 0; i < lights_.size(); ++i) {
+      if (memcmp(&lights_[i][0], &rhs.lights_[i][0],
+                 3 * sizeof(float)) != 0) {
+        return false;
+      }
+    }
+    for (size_t i = 0; i < overlays_.size(); ++i) {
+      const RenderableOverlay& a = overlays_[i];
+      const RenderableOverlay& b = rhs.overlays_[i];
+      if (a.renderable != b.renderable || a.key != b.key ||
+          memcmp(&a.origin[0], &b.origin[0], 2 * sizeof(float)) != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Clear out the render list, including the static renderables.
   void Clear() {
     renderables_.clear();
     lights_.clear();
+    overlays_.clear();
+    num_static_renderables_ = 0;
+    static_version_ = 0;
+  }
+
+  // Clear out everything but the static renderables. Should be called once
+  // per frame, when they are unchanged.
+  void ClearDynamic() {
+    renderables_.erase(renderables_.begin() + num_static_renderables_,
+                       renderables_.end());
+    lights_.clear();
+    overlays_.clear();
   }
 
  private:
   // The camera position, orientation, fov.
   mathfu::mat4 camera_;
 
+  // The camera position in world space. Used for lighting.
+  mathfu::vec3 camera_position_;
+
   // Array of items to be rendered and their positions.
-  std::vector<std::unique_ptr<Renderable>> renderables_;
+  std::vector<Renderable> renderables_;
 
   // Array of positions for where to place point lights.
-  std::vector<std::unique_ptr<mathfu::vec3>> lights_;
+  std::vector<mathfu::vec3> lights_;
+
+  // Overlays of the dynamic renderables.
+  std::vector<RenderableOverlay> overlays_;
+
+  // The first num_static_renderables_ of renderables_ are static.
+  size_t num_static_renderables_;
+  uint32_t static_version_;
 };
 
 } // namespace fpl
@@ -23,42 +23,117 @@
 
 namespace fpl {
 
+// Upload 'count' floats to 'location' in the current program.
+static void UploadUniform(GLint location, const float *value, int count) {
+  switch (count) {
+    case 1: GL_CALL(glUniform1fv(location, 1, value)); break;
+    case 2: GL_CALL(glUniform2fv(location, 1, value)); break;
+    case 3: GL_CALL(glUniform3fv(location, 1, value)); break;
+    case 4: GL_CALL(glUniform4fv(location, 1, value)); break;
+    case 16: GL_CALL(glUniformMatrix4fv(location, 1, false, value)); break;
+    default: assert(0);
+  }
+}
+
 void Shader::InitializeUniforms() {
+  // Look up every active uniform once, so that FindUniform() doesn't need to
+  // ask GL.
+  uniforms_.clear();
+  GLint num_uniforms = 0;
+  GL_CALL(glGetProgramiv(program_, GL_ACTIVE_UNIFORMS, &num_uniforms));
+  GLint max_name_length = 0;
+  GL_CALL(glGetProgramiv(program_, GL_ACTIVE_UNIFORM_MAX_LENGTH,
+                         &max_name_length));
+  std::vector<GLchar> name(max_name_length + 1, '\0');
+  for (GLint i = 0; i < num_uniforms; i++) {
+    GLsizei length = 0;
+    GLint array_size = 0;
+    GLenum type = 0;
+    GL_CALL(glGetActiveUniform(program_, i, static_cast<GLsizei>(name.size()),
+                               &length, &array_size, &type, &name[0]));
+    Uniform uniform;
+    uniform.name.assign(&name[0], length);
+    // Arrays are reported as "name[0]", but looked up as "name".
+    const size_t bracket = uniform.name.find('[');
+    if (bracket != std::string::npos) uniform.name.resize(bracket);
+    uniform.location = glGetUniformLocation(program_, uniform.name.c_str());
+    uniform.size = 0;
+    if (uniform.location >= 0) uniforms_.push_back(uniform);
+  }
+
   // Look up variables that are standard, but still optionally present in a
   // shader.
-  uniform_model_view_projection_ = glGetUniformLocation(
-                                        program_, "model_view_projection");
-  uniform_model_ = glGetUniformLocation(program_, "model");
+  uniform_model_view_projection_ = FindUniform("model_view_projection");
+  uniform_model_ = FindUniform("model");
 
-  uniform_color_ = glGetUniformLocation(program_, "color");
+  uniform_color_ = FindUniform("color");
 
-  uniform_light_pos_ = glGetUniformLocation(program_, "light_pos");
-  uniform_camera_pos_ = glGetUniformLocation(program_, "camera_pos");
+  uniform_light_pos_ = FindUniform("light_pos");
+  uniform_camera_pos_ = FindUniform("camera_pos");
 
   // Set up the uniforms the shader uses for texture access.
   char texture_unit_name[] = "texture_unit_#####";
   for (int i = 0; i < kMaxTexturesPerShader; i++) {
     snprintf(texture_unit_name, sizeof(texture_unit_name),
         "texture_unit_%d", i);
-    auto loc = glGetUniformLocation(program_, texture_unit_name);
-    if (loc >= 0) GL_CALL(glUniform1i(loc, i));
+    auto handle = FindUniform(texture_unit_name);
+    if (handle >= 0) GL_CALL(glUniform1i(uniforms_[handle].location, i));
+  }
+}
+
+int Shader::FindUniform(const char *uniform_name) const {
+  for (size_t i = 0; i < uniforms_.size(); i++) {
+    if (uniforms_[i].name == uniform_name) return static_cast<int>(i);
   }
+  return -1;
+}
+
+bool Shader::UpdateShadow(int handle, const float *value, int count) const {
+  Uniform &uniform = uniforms_[handle];
+  if (uniform.size == count &&
+      memcmp(uniform.value, value, count * sizeof(float)) == 0)
+    return false;
+  memcpy(uniform.value, value, count * sizeof(float));
+  uniform.size = count;
+  return true;
+}
+
+void Shader::SetUniformValue(int handle, const float *value, int count) {
+  assert(0 <= handle && handle < static_cast<int>(uniforms_.size()));
+  if (!UpdateShadow(handle, value, count)) return;
+  renderer_->UseProgram(program_);
+  UploadUniform(uniforms_[handle].location, value, count);
 }
 
 void Shader::Set(const Renderer &renderer) const {
-  GL_CALL(glUseProgram(program_));
+  renderer.UseProgram(program_);
+  SetStandardUniforms(renderer);
+}
 
-  if (uniform_model_view_projection_ >= 0)
-    GL_CALL(glUniformMatrix4fv(uniform_model_view_projection_, 1, false,
-                               &renderer.model_view_projection()[0]));
-  if (uniform_model_ >= 0)
-    GL_CALL(glUniformMatrix4fv(uniform_model_, 1, false, &renderer.model()[0]));
-  if (uniform_color_ >= 0)
-    GL_CALL(glUniform4fv(uniform_color_, 1, &renderer.color()[0]));
-  if (uniform_light_pos_ >= 0)
-    GL_CALL(glUniform3fv(uniform_light_pos_, 1, &renderer.light_pos()[0]));
-  if (uniform_camera_pos_ >= 0)
-    GL_CALL(glUniform3fv(uniform_camera_pos_, 1, &renderer.camera_pos()[0]));
+void Shader::SetStandardUniforms(const Renderer &renderer) const {
+  // Upload 'count' floats to the standard uniform 'handle' if it exists and
+  // has changed.
+  struct Standard {
+    int handle;
+    const float *value;
+    int count;
+  };
+  const Standard standards[] = {
+    { uniform_model_view_projection_, &renderer.model_view_projection()[0],
+      16 },
+    { uniform_model_, &renderer.model()[0], 16 },
+    { uniform_color_, &renderer.color()[0], 4 },
+    { uniform_light_pos_, &renderer.light_pos()[0], 3 },
+    { uniform_camera_pos_, &renderer.camera_pos()[0], 3 },
+  };
+  for (size_t i = 0; i < sizeof(standards) / sizeof(standards[0]); i++) {
+    const Standard &standard = standards[i];
+    if (standard.handle >= 0 &&
+        UpdateShadow(standard.handle, standard.value, standard.count)) {
+      UploadUniform(uniforms_[standard.handle].location, standard.value,
+                    standard.count);
+    }
+  }
 }
 
 }  // namespace fpl
@@ -27,13 +27,35 @@ class Renderer;
 
 static const int kMaxTexturesPerShader = 8;
 
+// Optional parts of a shader, for MaterialManager::LoadShader(). Each is
+// compiled in or out of every shader, so a variant only does the work that
+// its draws need. Shaders ignore the features they don't have.
+enum ShaderFeature {
+  // Discard transparent fragments, so that they don't write depth. Opaque
+  // materials don't need it, and skipping it is faster on tiled GPUs.
+  // Defines ALPHA_TEST.
+  kShaderFeatureAlphaTest = 1 << 0,
+  // Paint a baked texture over the cardboard. Defines OVERLAY.
+  kShaderFeatureOverlay = 1 << 1,
+  // Shade fragments at medium precision, which is plenty for 16 bit
+  // textures. Uniforms that both stages declare must give their precision.
+  kShaderFeatureMediumPrecision = 1 << 2,
+
+  // What shaders did before they had features.
+  kShaderFeaturesDefault = kShaderFeatureAlphaTest
+};
+
 // Represents a shader consisting of a vertex and pixel shader. Also stores
 // ids of standard uniforms. Use the Renderer class below to create these.
+//
+// Every active uniform is looked up once, when the shader is created, and
+// the last value uploaded to each is remembered. Uniform values belong to
+// the program, so uploads of unchanged values are skipped.
 class Shader {
  public:
 
-  Shader(GLuint program, GLuint vs, GLuint ps)
-    : program_(program), vs_(vs), ps_(ps),
+  Shader(const Renderer &renderer, GLuint program, GLuint vs, GLuint ps)
+    : renderer_(&renderer), program_(program), vs_(vs), ps_(ps),
       uniform_model_view_projection_(-1),
       uniform_model_(-1),
       uniform_color_(-1),
@@ -52,63 +74,74 @@ class Shader {
   // Renderer, if this shader refers to them.
   void Set(const Renderer &renderer) const;
 
-  // Find a non-standard uniform by name, -1 means not found.
-  GLint FindUniform(const char *uniform_name) {
-    GL_CALL(glUseProgram(program_));
-    return glGetUniformLocation(program_, uniform_name);
-  }
+  // Like Set(), but for a shader that is already active. Only uploads the
+  // standard uniforms, for when they change between draw calls.
+  void SetStandardUniforms(const Renderer &renderer) const;
+
+  // Find a non-standard uniform by name, -1 means not found. The handle can
+  // be passed to SetUniform(), and stays valid for the life of the shader.
+  // Does not call GL.
+  int FindUniform(const char *uniform_name) const;
 
-# ifdef _MSC_VER
-# pragma warning(push)
-# pragma warning(disable:4127) // conditional expression is constant
-# endif  // _MSC_VER
-  // Set an non-standard uniform to a vec2/3/4 value.
-  // Call this after Set() or FindUniform().
-  template<int N> void SetUniform(GLint uniform_loc,
+  // Set an non-standard uniform to a vec2/3/4 value. Makes this shader
+  // active if the value changed.
+  template<int N> void SetUniform(int handle,
                                   const mathfu::Vector<float, N> &value) {
-    // This should amount to a compile-time if-then.
-    if (N == 2) {
-      GL_CALL(glUniform2fv(uniform_loc, 1, &value[0]));
-    } else if(N == 3) {
-      GL_CALL(glUniform3fv(uniform_loc, 1, &value[0]));
-    } else if(N == 4) {
-      GL_CALL(glUniform4fv(uniform_loc, 1, &value[0]));
-    } else {
-      assert(0);
-    }
+    SetUniformValue(handle, &value[0], N);
+  }
+
+  void SetUniform(int handle, float value) {
+    SetUniformValue(handle, &value, 1);
   }
-# ifdef _MSC_VER
-# pragma warning(pop)
-# endif  // _MSC_VER
 
   // Convenience call that does a Lookup and a Set if found.
-  // Call this after Set().
   template<int N> bool SetUniform(const char *uniform_name,
                                   const mathfu::Vector<float, N> &value) {
-    auto loc = FindUniform(uniform_name);
-    if (loc < 0) return false;
-    SetUniform(loc, value);
+    auto handle = FindUniform(uniform_name);
+    if (handle < 0) return false;
+    SetUniform(handle, value);
     return true;
   }
 
   bool SetUniform(const char *uniform_name, const float &value) {
-    auto loc = FindUniform(uniform_name);
-    if (loc < 0) return false;
-    GL_CALL(glUniform1f(loc, value));
+    auto handle = FindUniform(uniform_name);
+    if (handle < 0) return false;
+    SetUniform(handle, value);
     return true;
   }
 
   void InitializeUniforms();
 
  private:
+  // An active uniform of the program, and the value it was last set to.
+  struct Uniform {
+    std::string name;
+    GLint location;
+    // Big enough for a mat4. Only the first 'size' floats are used.
+    float value[16];
+    int size;
+  };
+
+  // Record 'count' floats as the value of the uniform 'handle'. Returns
+  // false if that was its value already.
+  bool UpdateShadow(int handle, const float *value, int count) const;
+
+  void SetUniformValue(int handle, const float *value, int count);
+
+  // Binds the program, so that redundant binds are skipped.
+  const Renderer *renderer_;
 
   GLuint program_, vs_, ps_;
 
-  GLint uniform_model_view_projection_;
-  GLint uniform_model_;
-  GLint uniform_color_;
-  GLint uniform_light_pos_;
-  GLint uniform_camera_pos_;
+  // Mutable, since Set() skips unchanged standard uniforms.
+  mutable std::vector<Uniform> uniforms_;
+
+  // Handles of the standard uniforms, or -1 if the shader doesn't use them.
+  int uniform_model_view_projection_;
+  int uniform_model_;
+  int uniform_color_;
+  int uniform_light_pos_;
+  int uniform_camera_pos_;
 };
 
 }  // namespace fpl
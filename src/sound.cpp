@@ -15,7 +15,10 @@
 #include "precompiled.h"
 #include "sound.h"
 #include "SDL_mixer.h"
+#include "asset_archive.h"
 #include "audio_engine.h"
+#include "sound_collection_def_generated.h"
+#include "utilities.h"
 
 namespace fpl {
 
@@ -23,20 +26,178 @@ const int kPlayStreamError = -1;
 const int kLoopForever = -1;
 const int kPlayOnce = 0;
 
+// The tails of samples, for sounds resumed part way through. A channel plays
+// one chunk at a time, so each needs one. They're only written on the main
+// thread, for channels that aren't playing.
+static Mix_Chunk partial_chunks[kMaxChannels];
+
+// Bytes in one sample frame of the mixer's output, and frames per second.
+// Returns false if the mixer isn't open.
+static bool OutputFormat(int* frame_bytes, int* frequency) {
+  Uint16 format = 0;
+  int channels = 0;
+  if (!Mix_QuerySpec(frequency, &format, &channels) || *frequency <= 0) {
+    return false;
+  }
+  *frame_bytes = channels * SDL_AUDIO_BITSIZE(format) / 8;
+  return *frame_bytes > 0;
+}
+
+SoundSource::SoundSource(const AudioSampleSetEntry* entry)
+    : AsyncResource(entry->audio_sample()->filename()->c_str()),
+      audio_sample_set_entry_(entry), state_(kUnloaded),
+      load_succeeded_(false) {}
+
+bool SoundSource::LoadSample() {
+  assert(state_ == kUnloaded);
+  state_ = LoadFile(filename_.c_str()) ? kLoaded : kFailed;
+  return state_ == kLoaded;
+}
+
+void SoundSource::QueueSample(AsyncLoader* loader, int priority) {
+  assert(state_ == kUnloaded);
+  state_ = kLoading;
+  loader->QueueJob(this, priority);
+}
+
+void SoundSource::Load() {
+  load_succeeded_ = LoadFile(filename_.c_str());
+}
+
+void SoundSource::Finalize() {
+  if (!load_succeeded_) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Can't load sound %s\n",
+                 filename_.c_str());
+  }
+  state_ = load_succeeded_ ? kLoaded : kFailed;
+}
+
+void SoundCache::Touch(SoundBuffer* buffer) {
+  if (buffer->cached_) {
+    buffers_.splice(buffers_.begin(), buffers_, buffer->cache_position_);
+  } else {
+    buffers_.push_front(buffer);
+    buffer->cache_position_ = buffers_.begin();
+    buffer->cached_ = true;
+    size_ += buffer->chunk_->alen;
+  }
+  // Free the least recently played, skipping the ones still playing, and
+  // never the one that is about to play.
+  auto it = buffers_.end();
+  while (size_ > budget_ && it != buffers_.begin()) {
+    --it;
+    SoundBuffer* oldest = *it;
+    if (oldest != buffer && !oldest->ChunkPlaying()) {
+      it = buffers_.erase(it);
+      size_ -= oldest->chunk_->alen;
+      oldest->cached_ = false;
+      oldest->Evict();
+    }
+  }
+}
+
+void SoundCache::Remove(SoundBuffer* buffer) {
+  if (buffer->cached_) {
+    size_ -= buffer->chunk_->alen;
+    buffers_.erase(buffer->cache_position_);
+    buffer->cached_ = false;
+  }
+}
+
 SoundBuffer::~SoundBuffer() {
-  if (data_) {
-    Mix_FreeChunk(data_);
+  if (cache_) {
+    cache_->Remove(this);
+  }
+  if (chunk_) {
+    Mix_FreeChunk(chunk_);
   }
 }
 
+// Open 'filename' for SDL_mixer, from the mounted archives if it's in one.
+static SDL_RWops* OpenSoundFile(const char* filename) {
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+  if (FindInAssetArchives(filename, &data, &size)) {
+    return SDL_RWFromConstMem(data, static_cast<int>(size));
+  }
+  return SDL_RWFromFile(filename, "rb");
+}
+
 bool SoundBuffer::LoadFile(const char* filename) {
-  data_ = Mix_LoadWAV(filename);
-  return data_ != nullptr;
+  if (cache_) {
+    // Keep the file as it is, to be decoded when it plays.
+    if (FindInAssetArchives(filename, &compressed_data_, &compressed_size_)) {
+      return true;
+    }
+    if (!fpl::LoadFile(filename, &compressed_file_)) {
+      return false;
+    }
+    compressed_data_ = reinterpret_cast<const uint8_t*>(
+        compressed_file_.data());
+    compressed_size_ = compressed_file_.size();
+    UpdateMemory();
+    return true;
+  }
+  // Mix_LoadWAV_RW only reads the mixer's output format, so samples can be
+  // decoded on several threads at once.
+  SDL_RWops* file = OpenSoundFile(filename);
+  chunk_ = file ? Mix_LoadWAV_RW(file, 1) : nullptr;
+  UpdateMemory();
+  return chunk_ != nullptr;
+}
+
+bool SoundBuffer::Decode() {
+  if (!cache_) {
+    return chunk_ != nullptr;
+  }
+  if (!chunk_) {
+    SDL_RWops* file = SDL_RWFromConstMem(compressed_data_,
+                                         static_cast<int>(compressed_size_));
+    chunk_ = file ? Mix_LoadWAV_RW(file, 1) : nullptr;
+    if (!chunk_) {
+      SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Can't decode sound %s: %s\n",
+                   filename_.c_str(), Mix_GetError());
+      return false;
+    }
+    UpdateMemory();
+  }
+  cache_->Touch(this);
+  return true;
+}
+
+void SoundBuffer::Evict() {
+  assert(cache_ && !cached_);
+  Mix_FreeChunk(chunk_);
+  chunk_ = nullptr;
+  UpdateMemory();
+}
+
+void SoundBuffer::UpdateMemory() {
+  memory_.Set(compressed_file_.capacity() + (chunk_ ? chunk_->alen : 0));
+}
+
+bool SoundBuffer::ChunkPlaying() const {
+  // Channels resumed part way through play partial chunks, so look for any
+  // chunk that points into this one.
+  const Uint8* begin = chunk_->abuf;
+  const Uint8* end = begin + chunk_->alen;
+  const int channels = Mix_AllocateChannels(-1);
+  for (int i = 0; i < channels; ++i) {
+    const Mix_Chunk* playing = Mix_GetChunk(i);
+    if (playing && playing->abuf >= begin && playing->abuf < end &&
+        Mix_Playing(i)) {
+      return true;
+    }
+  }
+  return false;
 }
 
 bool SoundBuffer::Play(ChannelId channel_id, bool loop) {
+  if (!Decode()) {
+    return false;
+  }
   int loops = loop ? kLoopForever : kPlayOnce;
-  if (Mix_PlayChannel(channel_id, data_, loops) ==
+  if (Mix_PlayChannel(channel_id, chunk_, loops) ==
       AudioEngine::kInvalidChannel) {
     SDL_LogError(SDL_LOG_CATEGORY_ERROR,
                  "Can't play sound: %s\n", Mix_GetError());
@@ -45,6 +206,43 @@ bool SoundBuffer::Play(ChannelId channel_id, bool loop) {
   return true;
 }
 
+bool SoundBuffer::Resume(ChannelId channel_id, WorldTime offset) {
+  int frame_bytes = 0;
+  int frequency = 0;
+  if (channel_id < 0 || channel_id >= kMaxChannels ||
+      !OutputFormat(&frame_bytes, &frequency) || !Decode()) {
+    return false;
+  }
+  // Chunks are in the mixer's output format, so whole frames can be skipped.
+  const int64_t frames = static_cast<int64_t>(offset) * frequency /
+                         kMillisecondsPerSecond;
+  const int64_t skip = frames * frame_bytes;
+  if (skip >= static_cast<int64_t>(chunk_->alen)) {
+    return false;
+  }
+  Mix_Chunk* partial = &partial_chunks[channel_id];
+  partial->allocated = 0;
+  partial->abuf = chunk_->abuf + skip;
+  partial->alen = chunk_->alen - static_cast<Uint32>(skip);
+  partial->volume = chunk_->volume;
+  if (Mix_PlayChannel(channel_id, partial, kPlayOnce) ==
+      AudioEngine::kInvalidChannel) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR,
+                 "Can't resume sound: %s\n", Mix_GetError());
+    return false;
+  }
+  return true;
+}
+
+WorldTime SoundBuffer::Duration() const {
+  int frame_bytes = 0;
+  int frequency = 0;
+  if (!chunk_ || !OutputFormat(&frame_bytes, &frequency)) {
+    return 0;
+  }
+  const int64_t frames = chunk_->alen / frame_bytes;
+  return static_cast<WorldTime>(frames * kMillisecondsPerSecond / frequency);
+}
 
 void SoundBuffer::SetGain(ChannelId channel_id, float gain) {
   Mix_Volume(channel_id,
@@ -52,21 +250,23 @@ void SoundBuffer::SetGain(ChannelId channel_id, float gain) {
 }
 
 SoundStream::~SoundStream() {
-  if (data_) {
-    Mix_FreeMusic(data_);
+  if (music_) {
+    Mix_FreeMusic(music_);
   }
 }
 
 bool SoundStream::LoadFile(const char* filename) {
-  data_ = Mix_LoadMUS(filename);
-  return data_ != nullptr;
+  // The music is decoded as it plays, so the archive must stay mounted.
+  SDL_RWops* file = OpenSoundFile(filename);
+  music_ = file ? Mix_LoadMUS_RW(file, 1) : nullptr;
+  return music_ != nullptr;
 }
 
 bool SoundStream::Play(ChannelId channel_id, bool loop) {
   (void)channel_id;  // SDL_mixer does not currently support
                      // more than one channel of streaming audio.
   int loops = loop ? kLoopForever : kPlayOnce;
-  if (Mix_PlayMusic(data_, loops) == kPlayStreamError) {
+  if (Mix_PlayMusic(music_, loops) == kPlayStreamError) {
     SDL_LogError(SDL_LOG_CATEGORY_ERROR,
                  "Can't play music: %s\n", Mix_GetError());
     return false;
@@ -74,6 +274,16 @@ bool SoundStream::Play(ChannelId channel_id, bool loop) {
   return true;
 }
 
+bool SoundStream::Resume(ChannelId channel_id, WorldTime offset) {
+  if (!Play(channel_id, false)) {
+    return false;
+  }
+  // Seeking isn't supported by every music format, in which case the
+  // stream plays from the start.
+  Mix_SetMusicPosition(static_cast<double>(offset) / kMillisecondsPerSecond);
+  return true;
+}
+
 void SoundStream::SetGain(ChannelId channel_id, float gain) {
   (void)channel_id;
   Mix_VolumeMusic(static_cast<int>(gain * static_cast<float>(MIX_MAX_VOLUME)));
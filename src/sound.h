@@ -15,28 +15,60 @@
 #ifndef PIE_NOON_SOUND_H_
 #define PIE_NOON_SOUND_H_
 
+#include <list>
+#include <string>
+#include "async_loader.h"
+#include "common.h"
+#include "memory_tracker.h"
+
 struct Mix_Chunk;
 typedef struct _Mix_Music Mix_Music;
 
 namespace fpl {
 
 struct AudioSampleSetEntry;
+class SoundBuffer;
 
 typedef int ChannelId;
 
+// The most mixer channels that can be used.
+static const int kMaxChannels = 256;
+
 // SoundSource is a base class for both SoundStreams and SoundBuffers.
-class SoundSource {
+// It can be loaded on the calling thread with LoadFile(), or queued on an
+// AsyncLoader, where Load() decodes it on a loader thread and Finalize()
+// makes it playable.
+class SoundSource : public AsyncResource {
  public:
-  SoundSource(const AudioSampleSetEntry* entry)
-      : audio_sample_set_entry_(entry) {}
+  SoundSource(const AudioSampleSetEntry* entry);
   virtual ~SoundSource() {}
 
-  // Load the sound from the given filename.
+  // Load the sound from the given filename. Must be MT-safe, since Load()
+  // calls it on a loader thread.
   virtual bool LoadFile(const char* filename) = 0;
 
+  // Call LoadFile() on the sample's file. Call at most once, and not after
+  // QueueSample().
+  bool LoadSample();
+
+  // Queue the sample's file to load on 'loader', with 'priority'. It can be
+  // played once the loader has finalized it.
+  void QueueSample(AsyncLoader* loader, int priority);
+
+  // AsyncResource interface.
+  virtual void Load();
+  virtual void Finalize();
+
   // Play this sound on the given channel, and loop if necessary.
   virtual bool Play(ChannelId channel_id, bool loop) = 0;
 
+  // Play this sound once on the given channel, starting 'offset'
+  // milliseconds in.
+  virtual bool Resume(ChannelId channel_id, WorldTime offset) = 0;
+
+  // Length of the sound in milliseconds, or 0 if it isn't known.
+  virtual WorldTime Duration() const = 0;
+
   // Set the gain of the given channel.
   virtual void SetGain(ChannelId channel_id, float gain) = 0;
 
@@ -44,42 +76,128 @@ class SoundSource {
     return *audio_sample_set_entry_;
   }
 
+  // True once the sample has been loaded, or has failed to load.
+  bool finished() const { return state_ >= kLoaded; }
+
+  // True once the sample can be played.
+  bool loaded() const { return state_ == kLoaded; }
+
  private:
+  enum State { kUnloaded, kLoading, kLoaded, kFailed };
+
   const AudioSampleSetEntry* audio_sample_set_entry_;
+
+  // Only changed on the main thread. While kLoading, the loader thread
+  // writes load_succeeded_ for Finalize() to read.
+  State state_;
+  bool load_succeeded_;
+};
+
+// Holds the decoded samples of SoundBuffers that keep their files
+// compressed. When they take more than the budget, the least recently played
+// samples that aren't playing are freed, to be decoded again when they next
+// play. Only used on the main thread.
+class SoundCache {
+ public:
+  SoundCache() : budget_(0), size_(0) {}
+
+  // Bytes of decoded samples to keep.
+  void set_budget(size_t budget) { budget_ = budget; }
+  size_t budget() const { return budget_; }
+
+  // Bytes of decoded samples held.
+  size_t size() const { return size_; }
+
+ private:
+  friend class SoundBuffer;
+
+  // Add a buffer that was just decoded, or mark it as the most recently
+  // played, and free other buffers if over budget.
+  void Touch(SoundBuffer* buffer);
+
+  // Forget a buffer that is being freed.
+  void Remove(SoundBuffer* buffer);
+
+  // Most recently played first.
+  std::list<SoundBuffer*> buffers_;
+  size_t budget_;
+  size_t size_;
 };
 
 // A SoundBuffer is a piece of buffered audio that is completely loaded into
-// memory.
+// memory. Given a SoundCache, it keeps its file compressed in memory, and
+// decodes it into the cache when it plays.
 class SoundBuffer : public SoundSource {
  public:
-  SoundBuffer(const AudioSampleSetEntry* entry) : SoundSource(entry) {}
+  SoundBuffer(const AudioSampleSetEntry* entry, SoundCache* cache)
+      : SoundSource(entry), chunk_(nullptr), cache_(cache),
+        compressed_data_(nullptr), compressed_size_(0), cached_(false),
+        memory_(kMemorySounds) {}
   virtual ~SoundBuffer();
 
   virtual bool LoadFile(const char* filename);
 
   virtual bool Play(ChannelId channel_id, bool loop);
 
+  virtual bool Resume(ChannelId channel_id, WorldTime offset);
+
+  virtual WorldTime Duration() const;
+
   virtual void SetGain(ChannelId channel_id, float gain);
 
  private:
-  Mix_Chunk* data_;
+  friend class SoundCache;
+
+  // Make sure chunk_ is decoded, and mark it as recently played.
+  bool Decode();
+
+  // Free chunk_, if it can be decoded again.
+  void Evict();
+
+  // True if any channel is playing part of chunk_.
+  bool ChunkPlaying() const;
+
+  // Count the decoded samples and the copy of the compressed file.
+  void UpdateMemory();
+
+  Mix_Chunk* chunk_;
+
+  // When not null, the file is kept compressed and decoded into the cache.
+  SoundCache* cache_;
+
+  // The compressed file, in a mounted archive or else in compressed_file_.
+  const uint8_t* compressed_data_;
+  size_t compressed_size_;
+  std::string compressed_file_;
+
+  // Whether chunk_ is in cache_, and where.
+  bool cached_;
+  std::list<SoundBuffer*>::iterator cache_position_;
+
+  TrackedMemory memory_;
 };
 
 // A SoundStream is audio that is streamed from disk rather than loaded into
 // memory.
 class SoundStream : public SoundSource {
  public:
-  SoundStream(const AudioSampleSetEntry* entry) : SoundSource(entry) {}
+  SoundStream(const AudioSampleSetEntry* entry)
+      : SoundSource(entry), music_(nullptr) {}
   virtual ~SoundStream();
 
   virtual bool LoadFile(const char* filename);
 
   virtual bool Play(ChannelId channel_id, bool loop);
 
+  virtual bool Resume(ChannelId channel_id, WorldTime offset);
+
+  // Streams are decoded as they play, so their length isn't known.
+  virtual WorldTime Duration() const { return 0; }
+
   virtual void SetGain(ChannelId channel_id, float gain);
 
  private:
-  Mix_Music* data_;
+  Mix_Music* music_;
 };
 
 }  // namespace fpl
@@ -19,29 +19,40 @@
 #include "sound.h"
 #include "sound_collection.h"
 #include "sound_collection_def_generated.h"
+#include "async_loader.h"
 #include "audio_engine.h"
 #include "utilities.h"
 
 namespace fpl {
 
+SoundCollection::SoundCollection()
+    : bus_index_(kInvalidBusIndex), sum_of_probabilities_(0),
+      samples_requested_(false) {}
+
 bool SoundCollection::LoadSoundCollectionDef(const std::string& source,
                                              AudioEngine* audio_engine) {
+  file_.Close();
   source_ = source;
+  return InitializeSources(audio_engine);
+}
+
+bool SoundCollection::InitializeSources(AudioEngine* audio_engine) {
   const SoundCollectionDef* def = GetSoundCollectionDef();
   unsigned int sample_count =
       def->audio_sample_set() ? def->audio_sample_set()->Length() : 0;
   sound_sources_.resize(sample_count);
+  sum_of_probabilities_ = 0;
+  samples_requested_ = false;
   for (unsigned int i = 0; i < sample_count; ++i) {
     const AudioSampleSetEntry* entry = def->audio_sample_set()->Get(i);
-    const char* entry_filename = entry->audio_sample()->filename()->c_str();
     auto& sound_source = sound_sources_[i];
     if (def->stream()) {
       sound_source.reset(new SoundStream(entry));
     } else {
-      sound_source.reset(new SoundBuffer(entry));
-    }
-    if (!sound_source->LoadFile(entry_filename)) {
-      return false;
+      const bool compressed = def->memory_mode() == MemoryMode_Compressed;
+      sound_source.reset(new SoundBuffer(
+          entry, compressed && audio_engine ? audio_engine->sound_cache() :
+                                              nullptr));
     }
     sum_of_probabilities_ += entry->playback_probability();
   }
@@ -53,8 +64,8 @@ bool SoundCollection::LoadSoundCollectionDef(const std::string& source,
     return false;
   }
   if (audio_engine) {
-    bus_ = audio_engine->FindBus(def->bus()->c_str());
-    if (!bus_) {
+    bus_index_ = audio_engine->FindBusIndex(def->bus()->c_str());
+    if (bus_index_ == kInvalidBusIndex) {
       return false;
     }
   }
@@ -63,28 +74,58 @@ bool SoundCollection::LoadSoundCollectionDef(const std::string& source,
 
 bool SoundCollection::LoadSoundCollectionDefFromFile(
     const char* filename, AudioEngine* audio_engine) {
-  std::string source;
-  return LoadFile(filename, &source) &&
-      LoadSoundCollectionDef(source, audio_engine);
+  source_.clear();
+  return file_.Open(filename) && InitializeSources(audio_engine);
+}
+
+bool SoundCollection::LoadSamples() {
+  assert(!samples_requested_);
+  samples_requested_ = true;
+  bool success = true;
+  for (size_t i = 0; i < sound_sources_.size(); ++i) {
+    if (!sound_sources_[i]->LoadSample()) {
+      success = false;
+    }
+  }
+  return success;
+}
+
+void SoundCollection::QueueSamples(AsyncLoader* loader, int priority) {
+  if (samples_requested_) return;
+  samples_requested_ = true;
+  for (size_t i = 0; i < sound_sources_.size(); ++i) {
+    sound_sources_[i]->QueueSample(loader, priority);
+  }
+}
+
+bool SoundCollection::Ready() const {
+  for (size_t i = 0; i < sound_sources_.size(); ++i) {
+    if (!sound_sources_[i]->finished()) return false;
+  }
+  return true;
 }
 
 void SoundCollection::Unload() {
+  file_.Close();
   source_.clear();
   sound_sources_.clear();
   sum_of_probabilities_ = 0;
+  samples_requested_ = false;
 }
 
 const SoundCollectionDef* SoundCollection::GetSoundCollectionDef() const {
-  assert(source_.size());
-  return fpl::GetSoundCollectionDef(source_.c_str());
+  assert(file_.size() || source_.size());
+  return fpl::GetSoundCollectionDef(
+      file_.empty() ? static_cast<const void*>(source_.c_str()) :
+                      static_cast<const void*>(file_.data()));
 }
 
-SoundSource* SoundCollection::Select() const {
+SoundSource* SoundCollection::Select(Rng* rng) const {
   const SoundCollectionDef* sound_def = GetSoundCollectionDef();
   // Choose a random number between 0 and the sum of the probabilities, then
   // iterate over the list, subtracting the weight of each entry until 0 is
   // reached.
-  float selection = mathfu::Random<float>() * sum_of_probabilities_;
+  float selection = rng->Float() * sum_of_probabilities_;
   for (unsigned int i = 0; i < sound_sources_.size(); ++i) {
     const AudioSampleSetEntry* entry = sound_def->audio_sample_set()->Get(i);
     selection -= entry->playback_probability();
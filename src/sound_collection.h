@@ -18,20 +18,28 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include "bus.h"
+#include "mapped_file.h"
+#include "rng.h"
 
 namespace fpl {
 
 struct SoundCollectionDef;
+class AsyncLoader;
 class SoundSource;
 class AudioEngine;
-class Bus;
 
 // SoundCollection represent an abstract sound (like a 'whoosh'), which contains
 // a number of pieces of audio with weighted probabilities to choose between
 // randomly when played. It holds objects of type `Audio`, which can be either
 // Sounds or Music
+//
+// Loading the def doesn't load the samples. Either load them right away with
+// LoadSamples(), or in the background with QueueSamples().
 class SoundCollection {
  public:
+  SoundCollection();
+
   // Load the given flatbuffer data representing a SoundCollectionDef.
   bool LoadSoundCollectionDef(const std::string& source,
                               AudioEngine* audio_engine);
@@ -40,25 +48,49 @@ class SoundCollection {
   bool LoadSoundCollectionDefFromFile(const char* filename,
                                       AudioEngine* audio_engine);
 
+  // Load every sample on this thread, instead of queueing them. Returns false
+  // if any fail to load.
+  bool LoadSamples();
+
+  // Queue every sample to load on 'loader', unless they have been queued
+  // already. The loader must be finalized, and the samples finished, before
+  // this collection is unloaded.
+  void QueueSamples(AsyncLoader* loader, int priority);
+
+  // True once QueueSamples() or LoadSamples() has been called.
+  bool samples_requested() const { return samples_requested_; }
+
+  // True once every sample has loaded or failed to load.
+  bool Ready() const;
+
   // Unload the data associated with this Sound.
   void Unload();
 
   // Return the SoundDef.
   const SoundCollectionDef* GetSoundCollectionDef() const;
 
-  // Return a random piece of audio from the set of audio for this sound.
-  SoundSource* Select() const;
+  // Return a random piece of audio from the set of audio for this sound,
+  // chosen with 'rng'. It may not have loaded yet; see SoundSource::loaded().
+  SoundSource* Select(Rng* rng) const;
 
-  // Return the bus this SoundCollection will play on.
-  Bus* bus() { return bus_; }
+  // Return the index of the bus this SoundCollection will play on, in the
+  // AudioEngine's buses.
+  BusIndex bus_index() const { return bus_index_; }
 
  private:
+  // Create the sound sources for the def currently held.
+  bool InitializeSources(AudioEngine* audio_engine);
+
   // The bus this SoundCollection will play on.
-  Bus* bus_;
+  BusIndex bus_index_;
 
+  // The def, mapped when it was loaded from a file, or else copied into
+  // source_.
+  MappedFile file_;
   std::string source_;
   std::vector<std::unique_ptr<SoundSource>> sound_sources_;
   float sum_of_probabilities_;
+  bool samples_requested_;
 };
 
 }  // namespace fpl
@@ -0,0 +1,89 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace fpl {
+
+// Bounded queue between exactly one producer thread and one consumer thread.
+// Neither side ever blocks or allocates: Push() fails when the ring is full,
+// and counts the dropped item, and Pop() fails when it is empty.
+//
+// 'kCapacity' must be a power of two. T must be copyable.
+template<class T, size_t kCapacity>
+class SpscRing {
+  static_assert(kCapacity > 0 && (kCapacity & (kCapacity - 1)) == 0,
+                "SpscRing capacity must be a power of two");
+
+ public:
+  SpscRing() : head_(0), tail_(0), overflows_(0) {}
+
+  // Producer only. Returns false, and drops 'item', if the ring is full.
+  bool Push(const T& item) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == kCapacity) {
+      overflows_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    items_[tail & (kCapacity - 1)] = item;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only. Returns false if the ring is empty.
+  bool Pop(T* item) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) return false;
+    *item = items_[head & (kCapacity - 1)];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Approximate when called while the other thread is active.
+  size_t size() const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_acquire);
+  }
+  bool empty() const { return size() == 0; }
+  static size_t capacity() { return kCapacity; }
+
+  // Number of items Push() has dropped since the ring was created.
+  uint32_t overflows() const {
+    return overflows_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  // Disallow copies. The other thread may be using the ring.
+  SpscRing(const SpscRing&);
+  SpscRing& operator=(const SpscRing&);
+
+  T items_[kCapacity];
+
+  // Count of items popped. Only the consumer writes it.
+  std::atomic<size_t> head_;
+
+  // Count of items pushed. Only the producer writes it.
+  std::atomic<size_t> tail_;
+
+  std::atomic<uint32_t> overflows_;
+};
+
+}  // fpl
+
+#endif  // SPSC_RING_H
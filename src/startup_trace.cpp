@@ -0,0 +1,146 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "precompiled.h"
+#include "startup_trace.h"
+
+#include <atomic>
+#include <mutex>
+
+namespace fpl {
+
+struct StartupEvent {
+  const char *category;
+  std::string name;
+  SDL_threadID thread;
+  uint64_t start;
+  uint64_t end;
+};
+
+struct StartupTraceState {
+  StartupTraceState() : enabled(false), start_counter(0) {}
+
+  std::atomic<bool> enabled;
+  uint64_t start_counter;
+
+  // Guards events, which every thread appends to.
+  std::mutex mutex;
+  std::vector<StartupEvent> events;
+};
+
+static StartupTraceState &State() {
+  static StartupTraceState state;
+  return state;
+}
+
+// Write 's' as a JSON string.
+static void WriteJsonString(const std::string &s, FILE *file) {
+  fputc('"', file);
+  for (size_t i = 0; i < s.size(); ++i) {
+    const char c = s[i];
+    if (c == '"' || c == '\\') {
+      fputc('\\', file);
+      fputc(c, file);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      fprintf(file, "\\u%04x", static_cast<unsigned int>(c));
+    } else {
+      fputc(c, file);
+    }
+  }
+  fputc('"', file);
+}
+
+void StartStartupTrace() {
+  StartupTraceState &state = State();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.events.clear();
+  state.start_counter = SDL_GetPerformanceCounter();
+  state.enabled = true;
+}
+
+bool StartupTraceEnabled() {
+  return State().enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t StartupTraceTime() {
+  const uint64_t ticks = SDL_GetPerformanceCounter() - State().start_counter;
+  return static_cast<uint64_t>(static_cast<double>(ticks) * 1000000.0 /
+      static_cast<double>(SDL_GetPerformanceFrequency()));
+}
+
+void RecordStartupEvent(const char *category, const std::string &name,
+                        uint64_t start, uint64_t end) {
+  StartupTraceState &state = State();
+  StartupEvent event = { category, name, SDL_ThreadID(), start, end };
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (state.enabled) state.events.push_back(event);
+}
+
+bool FinishStartupTrace(const char *filename) {
+  StartupTraceState &state = State();
+  const uint64_t now = StartupTraceTime();
+  const SDL_threadID main_thread = SDL_ThreadID();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.enabled = false;
+
+  // The steps on this thread are the critical path. Steps on other threads
+  // only matter where this thread waits for them.
+  for (size_t i = 0; i < state.events.size(); ++i) {
+    const StartupEvent &event = state.events[i];
+    if (event.thread == main_thread && strcmp(event.category, "phase") == 0) {
+      SDL_Log("startup: %s took %.1fms", event.name.c_str(),
+              static_cast<double>(event.end - event.start) / 1000.0);
+    }
+  }
+  SDL_Log("startup: first frame after %.1fms",
+          static_cast<double>(now) / 1000.0);
+
+  FILE *file = fopen(filename, "w");
+  if (!file) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Can't write %s", filename);
+    state.events.clear();
+    return false;
+  }
+  // Complete ("X") events, and an instant event for the first frame.
+  fprintf(file, "{\"traceEvents\":[\n");
+  for (size_t i = 0; i < state.events.size(); ++i) {
+    const StartupEvent &event = state.events[i];
+    fprintf(file, "{\"name\":");
+    WriteJsonString(event.name, file);
+    fprintf(file, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,"
+            "\"ts\":%llu,\"dur\":%llu},\n", event.category,
+            static_cast<unsigned long>(event.thread),
+            static_cast<unsigned long long>(event.start),
+            static_cast<unsigned long long>(event.end - event.start));
+  }
+  fprintf(file, "{\"name\":\"first frame\",\"cat\":\"phase\",\"ph\":\"i\","
+          "\"s\":\"g\",\"pid\":1,\"tid\":%lu,\"ts\":%llu}\n]}\n",
+          static_cast<unsigned long>(main_thread),
+          static_cast<unsigned long long>(now));
+  const bool ok = ferror(file) == 0;
+  fclose(file);
+  state.events.clear();
+  SDL_Log("startup: trace written to %s", filename);
+  return ok;
+}
+
+void CancelStartupTrace() {
+  StartupTraceState &state = State();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.enabled = false;
+  state.events.clear();
+}
+
+}  // fpl
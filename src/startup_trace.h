@@ -0,0 +1,75 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef FPL_STARTUP_TRACE_H
+#define FPL_STARTUP_TRACE_H
+
+#include <cstdint>
+#include <string>
+
+namespace fpl {
+
+// Records how long each step of starting the game takes, on every thread,
+// and writes it as a Chrome trace. Open the file in chrome://tracing or
+// ui.perfetto.dev to see which steps are on the critical path to the first
+// frame, and which could run in parallel.
+//
+// Recording is cheap, but only happens between StartStartupTrace() and
+// FinishStartupTrace() or CancelStartupTrace(). Any thread may record.
+
+// Begin recording. Times in the trace are relative to this call.
+void StartStartupTrace();
+
+// True while recording.
+bool StartupTraceEnabled();
+
+// Microseconds since StartStartupTrace().
+uint64_t StartupTraceTime();
+
+// Record that 'name' ran on this thread from 'start' to 'end', as returned
+// by StartupTraceTime(). 'category' groups events, such as "load", and must
+// be a string literal.
+void RecordStartupEvent(const char *category, const std::string &name,
+                        uint64_t start, uint64_t end);
+
+// Stop recording, log how long each step on the calling thread took and
+// when the first frame was shown, and write the trace to 'filename'.
+// Returns false if the file can't be written.
+bool FinishStartupTrace(const char *filename);
+
+// Stop recording, and discard everything recorded.
+void CancelStartupTrace();
+
+// Records the lifetime of the scope as one event.
+class StartupTraceScope {
+ public:
+  StartupTraceScope(const char *category, const char *name)
+      : category_(category), name_(name),
+        start_(StartupTraceEnabled() ? StartupTraceTime() : 0) {}
+  ~StartupTraceScope() {
+    if (StartupTraceEnabled()) {
+      RecordStartupEvent(category_, name_, start_, StartupTraceTime());
+    }
+  }
+
+ private:
+  const char *category_;
+  const char *name_;
+  uint64_t start_;
+};
+
+}  // fpl
+
+#endif  // FPL_STARTUP_TRACE_H
@@ -11,6 +11,7 @@ TouchscreenButton::TouchscreenButton()
     is_active_(true),
     is_visible_(true),
     is_highlighted_(false),
+    layout_changed_(true),
     one_over_cannonical_window_height_(0.0f)
 {}
 
@@ -56,6 +57,7 @@ void TouchscreenButton::AdvanceFrame(WorldTime delta_time,
     }
   }
   button_.Update(down);
+  layout_changed_ |= button_.went_down() || button_.went_up();
 }
 
 bool TouchscreenButton::IsTriggered()
@@ -66,11 +68,13 @@ bool TouchscreenButton::IsTriggered()
       button_.went_down());
 }
 
-void TouchscreenButton::Render(Renderer& renderer) {
+bool TouchscreenButton::Layout(const vec2& window_size,
+                               MenuQuad* quad) const {
   static const float kButtonZDepth = 0.0f;
+  static const float kPulseScale = 0.05f;
 
   if (!is_visible_) {
-    return;
+    return false;
   }
 
   Material* mat = button_.is_down()
@@ -78,9 +82,8 @@ void TouchscreenButton::Render(Renderer& renderer) {
                   : up_current_ < up_materials_.size()
                   ? up_materials_[up_current_]
                   : nullptr;
-  if (!mat) return;  // This is an invisible button.
+  if (!mat) return false;  // This is an invisible button.
 
-  const vec2 window_size = vec2(renderer.window_size());
   const float texture_scale = window_size.y() *
                               one_over_cannonical_window_height_;
 
@@ -90,29 +93,21 @@ void TouchscreenButton::Render(Renderer& renderer) {
                          ? button_def_->draw_scale_pressed()
                          : button_def_->draw_scale_normal()));
 
-  auto pulse = sinf(static_cast<float>(elapsed_time_)/100.0f);
-  if (is_highlighted_) {
-    base_size += mathfu::kOnes2f * pulse * 0.05f;
-  }
-
-  vec3 texture_size = texture_scale * vec3(
-       mat->textures()[0]->size().x() * base_size.x(),
-      -mat->textures()[0]->size().y() * base_size.y(), 0);
-
-  vec3 position = vec3(button_def()->texture_position()->x() * window_size.x(),
-                       button_def()->texture_position()->y() * window_size.y(),
-                       kButtonZDepth);
-
-  if (is_active_ || inactive_shader_ == nullptr) {
-    shader_->Set(renderer);
-  }
-  else {
-    inactive_shader_->Set(renderer);
-  }
-  mat->Set(renderer);
-  Mesh::RenderAAQuadAlongX(position - (texture_size / 2.0f),
-                           position + (texture_size / 2.0f),
-                           vec2(0, 1), vec2(1, 0));
+  // The highlighted button pulses in both directions by the same amount.
+  const vec3 image_size = texture_scale * vec3(mat->ImageSize().x(),
+                                               -mat->ImageSize().y(), 0);
+  quad->size = image_size * vec3(base_size.x(), base_size.y(), 0);
+  quad->pulse_size = is_highlighted_ ? image_size * kPulseScale :
+                     mathfu::kZeros3f;
+
+  quad->center = vec3(button_def()->texture_position()->x() * window_size.x(),
+                      button_def()->texture_position()->y() * window_size.y(),
+                      kButtonZDepth);
+
+  quad->shader = is_active_ || inactive_shader_ == nullptr ?
+                 shader_ : inactive_shader_;
+  quad->material = mat;
+  return true;
 }
 
 
@@ -121,6 +116,7 @@ StaticImage::StaticImage()
       current_material_index_(0),
       shader_(nullptr),
       scale_(mathfu::kZeros2f),
+      layout_changed_(true),
       one_over_cannonical_window_height_(0.0f) {
 }
 
@@ -134,6 +130,7 @@ void StaticImage::Initialize(const StaticImageDef& image_def,
   scale_ = LoadVec2(image_def_->draw_scale());
   one_over_cannonical_window_height_ =
       1.0f / static_cast<float>(cannonical_window_height);
+  layout_changed_ = true;
   assert(Valid());
 }
 
@@ -144,29 +141,25 @@ bool StaticImage::Valid() const {
          shader_ != nullptr;
 }
 
-void StaticImage::Render(Renderer& renderer) {
+bool StaticImage::Layout(const vec2& window_size, MenuQuad* quad) const {
   if (!Valid())
-    return;
+    return false;
 
   Material* material = materials_[current_material_index_];
-  const vec2 window_size = vec2(renderer.window_size());
   const float texture_scale = window_size.y() *
                               one_over_cannonical_window_height_;
   const vec2 texture_size = texture_scale *
-                            vec2(material->textures()[0]->size()) *
+                            material->ImageSize() *
                             scale_;
   const vec2 position_percent = LoadVec2(image_def_->texture_position());
   const vec2 position = window_size * position_percent;
 
-  const vec3 position3d(position.x(), position.y(), image_def_->z_depth());
-  const vec3 texture_size3d(texture_size.x(), -texture_size.y(), 0.0f);
-
-  shader_->Set(renderer);
-  material->Set(renderer);
-
-  Mesh::RenderAAQuadAlongX(position3d - texture_size3d * 0.5f,
-                           position3d + texture_size3d * 0.5f,
-                           vec2(0, 1), vec2(1, 0));
+  quad->shader = shader_;
+  quad->material = material;
+  quad->center = vec3(position.x(), position.y(), image_def_->z_depth());
+  quad->size = vec3(texture_size.x(), -texture_size.y(), 0.0f);
+  quad->pulse_size = mathfu::kZeros3f;
+  return true;
 }
 
 }  // pie_noon
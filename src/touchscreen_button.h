@@ -23,10 +23,26 @@
 #include "material.h"
 #include "renderer.h"
 #include "pie_noon_common_generated.h"
+#include "quad_batch.h"
 
 namespace fpl {
 namespace pie_noon {
 
+// A menu element laid out in window pixels, ready to be queued in a
+// QuadBatch.
+struct MenuQuad {
+  Shader* shader;
+  Material* material;
+  vec3 center;
+
+  // Width and height. The height is negative, to flip the texture.
+  vec3 size;
+
+  // Added to 'size', scaled by the highlight pulse. Zero unless the button
+  // is highlighted.
+  vec3 pulse_size;
+};
+
 class TouchscreenButton
 {
  public:
@@ -36,7 +52,8 @@ class TouchscreenButton
                     InputSystem* input, vec2 window_size);
 
   //bool HandlePointer(Pointer pointer, vec2 window_size);
-  void Render(Renderer& renderer);
+  // Work out where and how the button is drawn. Returns false if it isn't.
+  bool Layout(const vec2& window_size, MenuQuad* quad) const;
   void AdvanceFrame(WorldTime delta_time);
   ButtonId GetId() const;
   bool WillCapturePointer(const Pointer& pointer, vec2 window_size);
@@ -52,6 +69,7 @@ class TouchscreenButton
   }
   void set_current_up_material(size_t which) {
     assert(which < up_materials_.size());
+    layout_changed_ |= up_current_ != which;
     up_current_ = which;
   }
 
@@ -76,16 +94,29 @@ class TouchscreenButton
   void set_shader(Shader* shader) { shader_ = shader; }
 
   bool is_active() const { return is_active_; }
-  void set_is_active(bool is_active) { is_active_ = is_active; }
+  void set_is_active(bool is_active) {
+    layout_changed_ |= is_active_ != is_active;
+    is_active_ = is_active;
+  }
 
   bool is_visible() const { return is_visible_; }
-  void set_is_visible(bool is_visible) { is_visible_ = is_visible; }
+  void set_is_visible(bool is_visible) {
+    layout_changed_ |= is_visible_ != is_visible;
+    is_visible_ = is_visible;
+  }
 
   bool is_highlighted() const { return is_highlighted_; }
   void set_is_highlighted(bool is_highlighted) {
+    layout_changed_ |= is_highlighted_ != is_highlighted;
     is_highlighted_ = is_highlighted;
   }
 
+  // True if the button's Layout() may have changed since
+  // clear_layout_changed(), because it was pressed, released, focused or
+  // switched material, or became active or visible.
+  bool layout_changed() const { return layout_changed_; }
+  void clear_layout_changed() { layout_changed_ = false; }
+
   void SetCannonicalWindowHeight(int height) {
     one_over_cannonical_window_height_ = 1.0f / static_cast<float>(height);
   }
@@ -111,6 +142,7 @@ class TouchscreenButton
   bool is_active_;
   bool is_visible_;
   bool is_highlighted_;
+  bool layout_changed_;
 
   // Scale the textures by the y-axis so that they are (proportionally)
   // the same height on every platform.
@@ -124,15 +156,27 @@ class StaticImage
   void Initialize(const StaticImageDef& image_def,
                   std::vector<Material*> materials, Shader* shader,
                   int cannonical_window_height);
-  void Render(Renderer& renderer);
+  // Work out where and how the image is drawn. Returns false if it isn't.
+  bool Layout(const vec2& window_size, MenuQuad* quad) const;
   bool Valid() const;
   ButtonId GetId() const {
     return image_def_ == nullptr ? ButtonId_Undefined : image_def_->ID();
   }
   const StaticImageDef* image_def() const { return image_def_; }
   const mathfu::vec2& scale() const { return scale_; }
-  void set_scale(const mathfu::vec2& scale) { scale_ = scale; }
-  void set_current_material_index(int i) { current_material_index_ = i;}
+  void set_scale(const mathfu::vec2& scale) {
+    layout_changed_ |= scale_.x() != scale.x() || scale_.y() != scale.y();
+    scale_ = scale;
+  }
+  void set_current_material_index(int i) {
+    layout_changed_ |= current_material_index_ != i;
+    current_material_index_ = i;
+  }
+
+  // True if the image's Layout() may have changed since
+  // clear_layout_changed().
+  bool layout_changed() const { return layout_changed_; }
+  void clear_layout_changed() { layout_changed_ = false; }
 
  private:
   // Flatbuffer's definition of this image.
@@ -151,6 +195,8 @@ class StaticImage
   // Draw image bigger or smaller. (1.0f, 1.0f) means no scaling.
   mathfu::vec2 scale_;
 
+  bool layout_changed_;
+
   // Scale the textures by the y-axis so that they are (proportionally)
   // the same height on every platform.
   float one_over_cannonical_window_height_;
@@ -0,0 +1,85 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "update_thread.h"
+
+namespace fpl {
+
+UpdateThread::UpdateThread()
+    : fn_(nullptr),
+      context_(nullptr),
+      quit_(false) {
+}
+
+UpdateThread::~UpdateThread() {
+  if (!thread_.joinable())
+    return;
+
+  Wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  job_started_.notify_one();
+  thread_.join();
+}
+
+void UpdateThread::Start(JobFn* fn, void* context) {
+  if (!thread_.joinable()) {
+    thread_ = std::thread(&UpdateThread::ThreadMain, this);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    assert(fn_ == nullptr);
+    fn_ = fn;
+    context_ = context;
+  }
+  job_started_.notify_one();
+}
+
+void UpdateThread::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (fn_ != nullptr) {
+    job_finished_.wait(lock);
+  }
+}
+
+void UpdateThread::ThreadMain() {
+  for (;;) {
+    JobFn* fn;
+    void* context;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (!quit_ && fn_ == nullptr) {
+        job_started_.wait(lock);
+      }
+      if (quit_)
+        return;
+      fn = fn_;
+      context = context_;
+    }
+
+    fn(context);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      fn_ = nullptr;
+      context_ = nullptr;
+    }
+    job_finished_.notify_one();
+  }
+}
+
+}  // fpl
@@ -0,0 +1,75 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef UPDATE_THREAD_H
+#define UPDATE_THREAD_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace fpl {
+
+// A single long-lived thread that runs one job at a time, in parallel with
+// the thread that started it. Used to advance the game simulation while the
+// main thread issues draw calls.
+//
+// Start() hands off a job and returns immediately. Wait() blocks until the
+// job has finished. Every Start() must be matched by a Wait() before the
+// next Start().
+class UpdateThread {
+ public:
+  typedef void JobFn(void* context);
+
+  UpdateThread();
+  ~UpdateThread();
+
+  // Run fn(context) on the update thread. The thread is created the first
+  // time this is called.
+  void Start(JobFn* fn, void* context);
+
+  // Return once the job passed to Start() has completed. Returns immediately
+  // if no job is in flight.
+  void Wait();
+
+ private:
+  // Disallow copies. The thread is owned.
+  UpdateThread(const UpdateThread&);
+  UpdateThread& operator=(const UpdateThread&);
+
+  void ThreadMain();
+
+  std::thread thread_;
+
+  // Guards everything below.
+  std::mutex mutex_;
+
+  // Signalled when a job is started, or when the thread should quit.
+  std::condition_variable job_started_;
+
+  // Signalled when the job completes.
+  std::condition_variable job_finished_;
+
+  // The job in flight. Set by Start() and cleared by the update thread when
+  // the job completes.
+  JobFn* fn_;
+  void* context_;
+
+  // Set when the thread should exit.
+  bool quit_;
+};
+
+}  // fpl
+
+#endif  // UPDATE_THREAD_H
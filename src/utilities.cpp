@@ -15,21 +15,54 @@
 #include "precompiled.h"
 
 #include "utilities.h"
+#include "asset_archive.h"
 
 namespace fpl {
 
+static bool ReadFile(SDL_RWops *handle, std::string *dest) {
+  auto len = static_cast<size_t>(SDL_RWseek(handle, 0, RW_SEEK_END));
+  SDL_RWseek(handle, 0, RW_SEEK_SET);
+  dest->assign(len + 1, 0);
+  size_t rlen = static_cast<size_t>(SDL_RWread(handle, &(*dest)[0], 1, len));
+  SDL_RWclose(handle);
+  return len == rlen && len > 0;
+}
+
+// Copy 'filename' out of the mounted archives, if it's in one.
+static bool ReadFromArchive(const char *filename, std::string *dest) {
+  const uint8_t *data = nullptr;
+  size_t size = 0;
+  if (!FindInAssetArchives(filename, &data, &size)) return false;
+  dest->assign(reinterpret_cast<const char *>(data), size);
+  dest->push_back(0);
+  return size > 0;
+}
+
 bool LoadFile(const char *filename, std::string *dest) {
+  if (ReadFromArchive(filename, dest)) return true;
   auto handle = SDL_RWFromFile(filename, "rb");
   if (!handle) {
     SDL_LogError(SDL_LOG_CATEGORY_ERROR, "LoadFile fail on %s", filename);
     return false;
   }
-  auto len = static_cast<size_t>(SDL_RWseek(handle, 0, RW_SEEK_END));
-  SDL_RWseek(handle, 0, RW_SEEK_SET);
-  dest->assign(len + 1, 0);
-  size_t rlen = static_cast<size_t>(SDL_RWread(handle, &(*dest)[0], 1, len));
+  return ReadFile(handle, dest);
+}
+
+bool LoadOptionalFile(const char *filename, std::string *dest) {
+  if (ReadFromArchive(filename, dest)) return true;
+  auto handle = SDL_RWFromFile(filename, "rb");
+  return handle && ReadFile(handle, dest);
+}
+
+bool SaveFile(const char *filename, const void *data, size_t size) {
+  auto handle = SDL_RWFromFile(filename, "wb");
+  if (!handle) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "SaveFile fail on %s", filename);
+    return false;
+  }
+  size_t wlen = static_cast<size_t>(SDL_RWwrite(handle, data, 1, size));
   SDL_RWclose(handle);
-  return len == rlen && len > 0;
+  return wlen == size;
 }
 
 #if defined(_WIN32)
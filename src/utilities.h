@@ -28,6 +28,13 @@ namespace fpl {
 
 bool LoadFile(const char *filename, std::string *dest);
 
+// Same as LoadFile(), but a missing file is not an error, so nothing is
+// logged. For files that only some builds or platforms have.
+bool LoadOptionalFile(const char *filename, std::string *dest);
+
+// Write 'size' bytes from 'data' to 'filename', replacing its contents.
+bool SaveFile(const char *filename, const void *data, size_t size);
+
 inline const mathfu::vec3 LoadVec3(const pie_noon::Vec3* v) {
   // Note: eschew the constructor that loads contiguous floats. It's faster
   // than the x, y, z constructor we use here, but doesn't account for the
@@ -0,0 +1,73 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "affine_transform.h"
+#include "mathfu/quaternion.h"
+#include "gtest/gtest.h"
+
+using fpl::OrthogonalAffineInverse;
+using mathfu::mat4;
+using mathfu::quat;
+using mathfu::vec3;
+
+static const float kPrecision = 1e-4f;
+
+static void ExpectNear(const mat4& a, const mat4& b) {
+  for (int row = 0; row < 4; ++row) {
+    for (int col = 0; col < 4; ++col) {
+      EXPECT_NEAR(a(row, col), b(row, col), kPrecision);
+    }
+  }
+}
+
+// Translations and rotations have the same inverse as the general Inverse().
+TEST(AffineTransformTests, Rigid) {
+  const mat4 m =
+      mat4::FromTranslationVector(vec3(1.0f, -2.0f, 3.5f)) *
+      mat4::FromRotationMatrix(
+          quat::FromAngleAxis(0.7f, vec3(1.0f, 2.0f, 3.0f).Normalized())
+              .ToMatrix());
+  ExpectNear(m.Inverse(), OrthogonalAffineInverse(m));
+}
+
+// Per-axis scale, mirroring and rotations of the scaled axes are supported,
+// as the character and prop world matrices use them.
+TEST(AffineTransformTests, ScaledAndMirrored) {
+  const mat4 rotate_about_x = mat4::FromRotationMatrix(
+      quat::FromAngleAxis(1.5707963f, mathfu::kAxisX3f).ToMatrix());
+  const mat4 m =
+      mat4::FromTranslationVector(vec3(-4.0f, 0.5f, 10.0f)) *
+      mat4::FromRotationMatrix(
+          quat::FromAngleAxis(2.0f, mathfu::kAxisY3f).ToMatrix()) *
+      mat4::FromTranslationVector(vec3(0.25f, 1.0f, 0.0f)) *
+      mat4::FromScaleVector(vec3(2.0f, 0.5f, -1.0f)) * rotate_about_x;
+  const mat4 inverse = OrthogonalAffineInverse(m);
+  ExpectNear(m.Inverse(), inverse);
+
+  // Points make the round trip back to where they started.
+  const vec3 point(3.0f, -1.0f, 7.0f);
+  const vec3 round_trip = m * (inverse * point);
+  EXPECT_NEAR(point.x(), round_trip.x(), kPrecision);
+  EXPECT_NEAR(point.y(), round_trip.y(), kPrecision);
+  EXPECT_NEAR(point.z(), round_trip.z(), kPrecision);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
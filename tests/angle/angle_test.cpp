@@ -19,6 +19,7 @@
 #define FPL_ANGLE_UNIT_TESTS
 
 #include <string>
+#include <vector>
 #include "angle.h"
 #include "gtest/gtest.h"
 
@@ -251,6 +252,92 @@ TEST_F(AngleTests, ClampWithZeroDiff) {
   EXPECT_FLOAT_EQ(a.Clamp(center, max_diff).ToRadians(), center.ToRadians());
 }
 
+// A sweep of vectors around the XZ circle, at several lengths.
+static std::vector<mathfu::vec3> CircleVectors() {
+  static const float kLengths[] = { 0.001f, 1.0f, 37.5f, 10000.0f };
+  std::vector<mathfu::vec3> vectors;
+  for (size_t l = 0; l < sizeof(kLengths) / sizeof(kLengths[0]); ++l) {
+    for (int i = 0; i < 1001; ++i) {
+      const float radians = -kPi + 2.0f * kPi * static_cast<float>(i) / 1000.0f;
+      vectors.push_back(kLengths[l] * mathfu::vec3(cosf(radians), 0.0f,
+                                                   sinf(radians)));
+    }
+  }
+  // The axes, including negative zero, where atan2 has special cases.
+  vectors.push_back(mathfu::vec3(-1.0f, 0.0f, 0.0f));
+  vectors.push_back(mathfu::vec3(-1.0f, 0.0f, -0.0f));
+  vectors.push_back(mathfu::vec3(0.0f, 0.0f, -1.0f));
+  vectors.push_back(mathfu::vec3(0.0f, 0.0f, 0.0f));
+  return vectors;
+}
+
+// The fast atan2 should stay within its error bound all around the circle,
+// both one at a time and in batches.
+TEST_F(AngleTests, FastAtan2ErrorBound) {
+  const std::vector<mathfu::vec3> vectors = CircleVectors();
+  const int count = static_cast<int>(vectors.size());
+  std::vector<Angle> exact(count);
+  std::vector<Angle> fast(count);
+  AnglesFromXZVectors(&vectors[0], count, fpl::kAngleExact, &exact[0]);
+  AnglesFromXZVectors(&vectors[0], count, fpl::kAngleFast, &fast[0]);
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(Angle::FromXZVector(vectors[i]), exact[i]);
+    EXPECT_TRUE(fast[i].IsValid());
+    EXPECT_LE((fast[i] - exact[i]).Abs().ToRadians(),
+              fpl::kFastAtan2MaxError);
+    EXPECT_LE((Angle::FromXZVectorFast(vectors[i]) - exact[i]).Abs()
+                  .ToRadians(), fpl::kFastAtan2MaxError);
+  }
+}
+
+// The fast sin and cos should stay within their error bound all around the
+// circle, both one at a time and in batches.
+TEST_F(AngleTests, FastSinCosErrorBound) {
+  const int count = 1001;
+  std::vector<Angle> angles(count);
+  for (int i = 0; i < count; ++i) {
+    angles[i] = Angle::FromRadians(
+        -kPi + 2.0f * kPi * static_cast<float>(i + 1) / count);
+  }
+  std::vector<mathfu::vec3> exact(count);
+  std::vector<mathfu::vec3> fast(count);
+  AnglesToXZVectors(&angles[0], count, fpl::kAngleExact, &exact[0]);
+  AnglesToXZVectors(&angles[0], count, fpl::kAngleFast, &fast[0]);
+  for (int i = 0; i < count; ++i) {
+    const mathfu::vec3 single = angles[i].ToXZVectorFast();
+    EXPECT_NEAR(exact[i].x(), angles[i].ToXZVector().x(), 0.0f);
+    EXPECT_NEAR(exact[i].z(), angles[i].ToXZVector().z(), 0.0f);
+    EXPECT_NEAR(fast[i].x(), exact[i].x(), fpl::kFastSinCosMaxError);
+    EXPECT_NEAR(fast[i].z(), exact[i].z(), fpl::kFastSinCosMaxError);
+    EXPECT_NEAR(single.x(), exact[i].x(), fpl::kFastSinCosMaxError);
+    EXPECT_NEAR(single.z(), exact[i].z(), fpl::kFastSinCosMaxError);
+  }
+}
+
+// The batch add and subtract should match the operators exactly, including
+// at the wrap around pi.
+TEST_F(AngleTests, BatchAddSubtractMatchOperators) {
+  const int count = 103;
+  std::vector<Angle> a(count);
+  std::vector<Angle> b(count);
+  for (int i = 0; i < count; ++i) {
+    a[i] = Angle::FromRadians(static_cast<float>(i) * 0.37f);
+    b[i] = Angle::FromRadians(static_cast<float>(i) * -1.13f);
+  }
+  a[0] = Angle(kMaxUniqueAngle);
+  b[0] = Angle(kMaxUniqueAngle);
+  a[1] = Angle(kMinUniqueAngle);
+  b[1] = Angle(kMinUniqueAngle);
+  std::vector<Angle> sums(count);
+  std::vector<Angle> differences(count);
+  AddAngles(&a[0], &b[0], count, &sums[0]);
+  SubtractAngles(&a[0], &b[0], count, &differences[0]);
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(a[i] + b[i], sums[i]);
+    EXPECT_EQ(a[i] - b[i], differences[i]);
+  }
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -0,0 +1,140 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include "precompiled.h"
+#include "asset_archive.h"
+#include "gtest/gtest.h"
+
+using fpl::AssetArchive;
+using fpl::kAssetArchiveAlignment;
+
+typedef std::vector<std::pair<std::string, std::string>> Files;
+
+static void AppendWord(uint32_t word, std::string* out) {
+  out->append(reinterpret_cast<const char*>(&word), sizeof(word));
+}
+
+static size_t Align(size_t offset) {
+  return (offset + kAssetArchiveAlignment - 1) / kAssetArchiveAlignment *
+         kAssetArchiveAlignment;
+}
+
+// Lay out an archive as build_assets.py does. 'files' must be sorted.
+static std::string PackArchive(const Files& files) {
+  const size_t names_start = 16 + 16 * files.size();
+  std::string names;
+  std::vector<size_t> name_offsets;
+  for (size_t i = 0; i < files.size(); ++i) {
+    name_offsets.push_back(names_start + names.size());
+    names += files[i].first;
+    names += '\0';
+  }
+  std::string index;
+  std::vector<size_t> offsets;
+  size_t offset = Align(names_start + names.size());
+  for (size_t i = 0; i < files.size(); ++i) {
+    AppendWord(static_cast<uint32_t>(name_offsets[i]), &index);
+    AppendWord(static_cast<uint32_t>(files[i].first.size()), &index);
+    AppendWord(static_cast<uint32_t>(offset), &index);
+    AppendWord(static_cast<uint32_t>(files[i].second.size()), &index);
+    offsets.push_back(offset);
+    offset = Align(offset + files[i].second.size());
+  }
+  std::string archive;
+  AppendWord(0x4B415046, &archive);
+  AppendWord(1, &archive);
+  AppendWord(static_cast<uint32_t>(files.size()), &archive);
+  AppendWord(0, &archive);
+  archive += index + names;
+  for (size_t i = 0; i < files.size(); ++i) {
+    archive.resize(offsets[i], '\0');
+    archive += files[i].second;
+  }
+  return archive;
+}
+
+static Files TestFiles() {
+  Files files;
+  files.push_back(std::make_pair("config.bin", "config"));
+  files.push_back(std::make_pair("materials/pie.bin", "pie"));
+  files.push_back(std::make_pair("textures/pie.webp", "a longer texture"));
+  return files;
+}
+
+static const uint8_t* Bytes(const std::string& s) {
+  return reinterpret_cast<const uint8_t*>(s.data());
+}
+
+// Every file is found by name, aligned, with its contents.
+TEST(AssetArchiveTests, FindsEveryFile) {
+  const Files files = TestFiles();
+  const std::string data = PackArchive(files);
+  AssetArchive archive;
+  EXPECT_TRUE(archive.Initialize(Bytes(data), data.size()));
+  EXPECT_EQ(3, archive.num_files());
+  for (size_t i = 0; i < files.size(); ++i) {
+    const uint8_t* file = nullptr;
+    size_t size = 0;
+    EXPECT_TRUE(archive.Find(files[i].first.c_str(), &file, &size));
+    EXPECT_EQ(files[i].second.size(), size);
+    EXPECT_EQ(0, memcmp(files[i].second.data(), file, size));
+    EXPECT_EQ(0u, static_cast<size_t>(file - Bytes(data)) %
+                  kAssetArchiveAlignment);
+  }
+}
+
+// Names that aren't in the archive, including prefixes of ones that are,
+// aren't found.
+TEST(AssetArchiveTests, MissingFiles) {
+  const std::string data = PackArchive(TestFiles());
+  AssetArchive archive;
+  EXPECT_TRUE(archive.Initialize(Bytes(data), data.size()));
+  const uint8_t* file = nullptr;
+  size_t size = 0;
+  EXPECT_FALSE(archive.Find("a.bin", &file, &size));
+  EXPECT_FALSE(archive.Find("materials/pie", &file, &size));
+  EXPECT_FALSE(archive.Find("zebra.bin", &file, &size));
+}
+
+// Damaged archives are rejected.
+TEST(AssetArchiveTests, RejectsDamage) {
+  AssetArchive archive;
+  const std::string data = PackArchive(TestFiles());
+  EXPECT_FALSE(archive.Initialize(Bytes(data), 8));
+  EXPECT_FALSE(archive.Initialize(Bytes(data), data.size() - 1));
+
+  std::string bad_magic = data;
+  bad_magic[0] = 'X';
+  EXPECT_FALSE(archive.Initialize(Bytes(bad_magic), bad_magic.size()));
+
+  Files unsorted = TestFiles();
+  std::swap(unsorted[0], unsorted[1]);
+  const std::string bad_order = PackArchive(unsorted);
+  EXPECT_FALSE(archive.Initialize(Bytes(bad_order), bad_order.size()));
+  EXPECT_EQ(0, archive.num_files());
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,76 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <string>
+#include "asset_table.h"
+#include "gtest/gtest.h"
+
+using fpl::AssetHandle;
+using fpl::AssetTable;
+using fpl::kInvalidAssetHandle;
+
+// Interning a name twice gives the same handle.
+TEST(AssetTableTests, InternIsStable) {
+  AssetTable<int> table;
+  const AssetHandle a = table.Intern("materials/floor.bin");
+  const AssetHandle b = table.Intern("materials/sky.bin");
+  EXPECT_NE(a, b);
+  EXPECT_EQ(a, table.Intern("materials/floor.bin"));
+  EXPECT_EQ(b, table.Find("materials/sky.bin"));
+  EXPECT_EQ(std::string("materials/floor.bin"), table.Name(a));
+  EXPECT_EQ(2u, table.size());
+}
+
+// Names that were never interned have no handle, and no asset.
+TEST(AssetTableTests, FindUnknown) {
+  AssetTable<int> table;
+  EXPECT_EQ(kInvalidAssetHandle, table.Find("missing"));
+  EXPECT_TRUE(table.Get(kInvalidAssetHandle) == nullptr);
+  EXPECT_TRUE(table.Get("missing") == nullptr);
+}
+
+// Assets can be set, found by handle or name, and removed, and the handle
+// stays the same throughout.
+TEST(AssetTableTests, SetAndRemove) {
+  AssetTable<int> table;
+  int asset = 7;
+  const AssetHandle handle = table.Intern("textures/pie.webp");
+  EXPECT_TRUE(table.Get(handle) == nullptr);
+  table.Set(handle, &asset);
+  EXPECT_EQ(&asset, table.Get(handle));
+  EXPECT_EQ(&asset, table.Get("textures/pie.webp"));
+  table.Set(handle, nullptr);
+  EXPECT_TRUE(table.Get(handle) == nullptr);
+  EXPECT_EQ(handle, table.Intern("textures/pie.webp"));
+}
+
+// The estimated size grows with the names interned.
+TEST(AssetTableTests, MemorySize) {
+  AssetTable<int> table;
+  const size_t empty = table.MemorySize();
+  table.Intern("a fairly long name, to be sure it's on the heap");
+  const size_t one = table.MemorySize();
+  EXPECT_TRUE(one > empty);
+  table.Intern("a fairly long name, to be sure it's on the heap");
+  EXPECT_EQ(one, table.MemorySize());
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,467 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+// Measures the audio engine's per-sound work against a stub mixer, so that
+// prioritization, ducking and gain propagation can be timed without an audio
+// device.
+//
+// Results are written to stdout as CSV, one row per measurement:
+//   benchmark,mixer_channels,ns_per_operation
+// so that they can be collected and compared between builds.
+//
+// The engine loads its buses and sounds from files, so the benchmark writes
+// them to a directory called audio_engine_benchmark_data, under the current
+// directory.
+
+#include <chrono>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // _WIN32
+
+#include "SDL_mixer.h"
+#include "audio_config_generated.h"
+#include "audio_engine.h"
+#include "buses_generated.h"
+#include "sound_assets_generated.h"
+#include "sound_collection_def_generated.h"
+
+using fpl::AudioConfig;
+using fpl::AudioEngine;
+using fpl::ChannelId;
+using fpl::WorldTime;
+using fpl::pie_noon::SoundId;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static const char kDataDirectory[] = "audio_engine_benchmark_data";
+
+// Mixer channel counts to measure.
+static const int kChannelCounts[] = { 8, 16, 64, 256 };
+
+// The bus tree is a binary tree this deep, under the master bus.
+static const int kBusDepth = 6;
+
+static const int kSamplesPerSound = 4;
+static const int kSoundCount = fpl::pie_noon::SoundId_Count;
+
+// Operations per measurement.
+static const int kOperations = 200000;
+
+// Simulate a 60Hz game.
+static const WorldTime kTimePerFrame = 16;
+
+// Sounds play for this many frames, give or take half, unless stopped.
+static const int kSoundFrames = 40;
+
+// The stub mixer. Channels play for a while and then finish, when
+// AdvanceMixer() is called, the way the audio thread would finish them.
+static int mixer_channels = 0;
+static int mixer_frame = 0;
+static unsigned int mixer_random = 1;
+static bool channel_playing[fpl::kMaxChannels];
+static int channel_end_frame[fpl::kMaxChannels];
+static Mix_Chunk* channel_chunk[fpl::kMaxChannels];
+static void (*channel_finished)(int) = nullptr;
+
+static int NextRandom() {
+  mixer_random = mixer_random * 1103515245u + 12345u;
+  return static_cast<int>((mixer_random >> 16) & 0x7fff);
+}
+
+static void FinishChannel(int channel) {
+  if (channel_playing[channel]) {
+    channel_playing[channel] = false;
+    if (channel_finished) {
+      channel_finished(channel);
+    }
+  }
+}
+
+static void ResetMixer() {
+  for (int i = 0; i < fpl::kMaxChannels; ++i) {
+    channel_playing[i] = false;
+    channel_chunk[i] = nullptr;
+  }
+  mixer_frame = 0;
+}
+
+static void AdvanceMixer() {
+  mixer_frame++;
+  for (int i = 0; i < mixer_channels; ++i) {
+    if (channel_playing[i] && channel_end_frame[i] <= mixer_frame) {
+      FinishChannel(i);
+    }
+  }
+}
+
+extern "C" {
+Mix_Chunk* Mix_LoadWAV_RW(SDL_RWops* src, int freesrc) {
+  if (freesrc) {
+    SDL_RWclose(src);
+  }
+  // A second of 16 bit stereo silence.
+  static const Uint32 kChunkBytes = 44100 * 4;
+  Mix_Chunk* chunk = new Mix_Chunk;
+  chunk->allocated = 1;
+  chunk->abuf = new Uint8[kChunkBytes]();
+  chunk->alen = kChunkBytes;
+  chunk->volume = MIX_MAX_VOLUME;
+  return chunk;
+}
+void Mix_FreeChunk(Mix_Chunk* chunk) {
+  delete[] chunk->abuf;
+  delete chunk;
+}
+Mix_Music* Mix_LoadMUS_RW(SDL_RWops*, int) { return NULL; }
+void Mix_FreeMusic(Mix_Music*) {}
+int Mix_OpenAudio(int, Uint16, int, int) { return 0; }
+int Mix_Init(int flags) { return flags; }
+void Mix_CloseAudio() {}
+int Mix_QuerySpec(int* frequency, Uint16* format, int* channels) {
+  *frequency = 44100;
+  *format = AUDIO_S16LSB;
+  *channels = 2;
+  return 1;
+}
+int Mix_AllocateChannels(int channels) {
+  if (channels >= 0) {
+    mixer_channels = channels;
+  }
+  return mixer_channels;
+}
+void Mix_ChannelFinished(void (*callback)(int)) {
+  channel_finished = callback;
+}
+void Mix_HookMusicFinished(void (*)()) {}
+int Mix_PlayChannelTimed(int channel, Mix_Chunk* chunk, int, int) {
+  channel_playing[channel] = true;
+  channel_chunk[channel] = chunk;
+  channel_end_frame[channel] =
+      mixer_frame + kSoundFrames / 2 + NextRandom() % kSoundFrames;
+  return channel;
+}
+int Mix_HaltChannel(int channel) {
+  FinishChannel(channel);
+  return 0;
+}
+int Mix_FadeOutChannel(int channel, int) {
+  // Finishes on the next mixer frame.
+  channel_end_frame[channel] = mixer_frame;
+  return 1;
+}
+int Mix_Playing(int channel) {
+  if (channel >= 0) {
+    return channel_playing[channel] ? 1 : 0;
+  }
+  int playing = 0;
+  for (int i = 0; i < mixer_channels; ++i) {
+    playing += channel_playing[i] ? 1 : 0;
+  }
+  return playing;
+}
+Mix_Chunk* Mix_GetChunk(int channel) { return channel_chunk[channel]; }
+int Mix_Volume(int, int volume) { return volume; }
+int Mix_PlayMusic(Mix_Music*, int) { return 0; }
+int Mix_HaltMusic() { return 0; }
+int Mix_FadeOutMusic(int) { return 1; }
+int Mix_PlayingMusic() { return 0; }
+int Mix_SetMusicPosition(double) { return 0; }
+int Mix_VolumeMusic(int volume) { return volume; }
+void Mix_Pause(int) {}
+void Mix_Resume(int) {}
+void Mix_PauseMusic() {}
+void Mix_ResumeMusic() {}
+}
+
+namespace fpl {
+
+// The benchmark's sounds are never Compressed.
+bool LoadFile(const char*, std::string*) { return false; }
+
+}  // namespace fpl
+
+static bool WriteFile(const std::string& filename, const void* data,
+                      size_t size) {
+  FILE* file = fopen(filename.c_str(), "wb");
+  if (!file) {
+    fprintf(stderr, "can't write %s\n", filename.c_str());
+    return false;
+  }
+  const bool written = fwrite(data, 1, size, file) == size;
+  fclose(file);
+  return written;
+}
+
+static bool WriteBuffer(const std::string& filename,
+                        const flatbuffers::FlatBufferBuilder& builder) {
+  return WriteFile(filename, builder.GetBufferPointer(), builder.GetSize());
+}
+
+static std::string BusName(int index) {
+  char name[32];
+  if (index == 0) {
+    return "master";
+  }
+  snprintf(name, sizeof(name), "bus_%d", index);
+  return name;
+}
+
+static int BusCount() { return (1 << (kBusDepth + 1)) - 1; }
+
+// A binary tree of buses, in heap order, with the master bus at the root. The
+// left leaf of each pair ducks its sibling, as voices would duck effects.
+static bool WriteBuses() {
+  flatbuffers::FlatBufferBuilder builder;
+  const int bus_count = BusCount();
+  const int first_leaf = bus_count / 2;
+  std::vector<flatbuffers::Offset<fpl::BusDef>> buses;
+  for (int i = 0; i < bus_count; ++i) {
+    std::vector<flatbuffers::Offset<flatbuffers::String>> children;
+    std::vector<flatbuffers::Offset<flatbuffers::String>> ducked;
+    if (i < first_leaf) {
+      children.push_back(builder.CreateString(BusName(2 * i + 1)));
+      children.push_back(builder.CreateString(BusName(2 * i + 2)));
+    } else if (i % 2 == 1) {
+      ducked.push_back(builder.CreateString(BusName(i + 1)));
+    }
+    auto name = builder.CreateString(BusName(i));
+    flatbuffers::Offset<flatbuffers::Vector<
+        flatbuffers::Offset<flatbuffers::String>>> child_buses, duck_buses;
+    if (!children.empty()) {
+      child_buses = builder.CreateVector(children);
+    }
+    if (!ducked.empty()) {
+      duck_buses = builder.CreateVector(ducked);
+    }
+    fpl::BusDefBuilder bus(builder);
+    bus.add_name(name);
+    bus.add_gain(0.9f);
+    bus.add_child_buses(child_buses);
+    bus.add_duck_buses(duck_buses);
+    bus.add_duck_gain(0.5f);
+    bus.add_duck_fade_in_time(0.25f);
+    bus.add_duck_fade_out_time(0.5f);
+    buses.push_back(bus.Finish());
+  }
+  builder.Finish(fpl::CreateBusDefList(builder, builder.CreateVector(buses)));
+  return WriteBuffer("buses.bin", builder);
+}
+
+// Sounds with a spread of priorities, each on one of the leaf buses, and the
+// list of them.
+static bool WriteSounds() {
+  const int bus_count = BusCount();
+  const int first_leaf = bus_count / 2;
+  std::vector<std::string> def_names;
+  for (int i = 0; i < kSoundCount; ++i) {
+    char def_name[32];
+    snprintf(def_name, sizeof(def_name), "sound_%d.bin", i);
+    def_names.push_back(def_name);
+
+    flatbuffers::FlatBufferBuilder builder;
+    std::vector<flatbuffers::Offset<fpl::AudioSampleSetEntry>> samples;
+    for (int j = 0; j < kSamplesPerSound; ++j) {
+      char sample_name[32];
+      snprintf(sample_name, sizeof(sample_name), "sample_%d_%d.wav", i, j);
+      if (!WriteFile(sample_name, "", 0)) {
+        return false;
+      }
+      auto sample = fpl::CreateAudioSample(
+          builder, 1.0f, builder.CreateString(sample_name));
+      samples.push_back(fpl::CreateAudioSampleSetEntry(builder, 1.0f, sample));
+    }
+    auto bus = builder.CreateString(
+        BusName(first_leaf + i % (bus_count - first_leaf)));
+    auto sample_set = builder.CreateVector(samples);
+    fpl::SoundCollectionDefBuilder def(builder);
+    def.add_id(static_cast<SoundId>(i));
+    def.add_priority(static_cast<float>(i % 5));
+    def.add_bus(bus);
+    def.add_audio_sample_set(sample_set);
+    builder.Finish(def.Finish());
+    if (!WriteBuffer(def_name, builder)) {
+      return false;
+    }
+  }
+
+  flatbuffers::FlatBufferBuilder builder;
+  std::vector<flatbuffers::Offset<flatbuffers::String>> names;
+  for (size_t i = 0; i < def_names.size(); ++i) {
+    names.push_back(builder.CreateString(def_names[i]));
+  }
+  builder.Finish(fpl::CreateSoundAssets(builder, builder.CreateVector(names)));
+  return WriteBuffer("sound_assets.bin", builder);
+}
+
+static bool EnterDataDirectory() {
+#ifdef _WIN32
+  _mkdir(kDataDirectory);
+  return _chdir(kDataDirectory) == 0;
+#else
+  mkdir(kDataDirectory, 0755);
+  return chdir(kDataDirectory) == 0;
+#endif  // _WIN32
+}
+
+static double NanosecondsSince(const Clock::time_point& start) {
+  return static_cast<double>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          Clock::now() - start).count());
+}
+
+static void Report(const char* benchmark, int channels, double ns) {
+  printf("%s,%d,%.3f\n", benchmark, channels, ns);
+}
+
+static SoundId RandomSound() {
+  return static_cast<SoundId>(NextRandom() % kSoundCount);
+}
+
+// An engine initialized with 'channels' mixer channels, with every sound
+// loaded.
+class BenchmarkEngine {
+ public:
+  explicit BenchmarkEngine(int channels) : world_time_(0) {
+    ResetMixer();
+    flatbuffers::FlatBufferBuilder builder;
+    fpl::AudioConfigBuilder config(builder);
+    config.add_output_frequency(44100);
+    config.add_output_channels(fpl::OutputChannels_Stereo);
+    config.add_output_buffer_size(2048);
+    config.add_mixer_channels(static_cast<unsigned int>(channels));
+    config.add_loader_threads(2);
+    config.add_virtual_voices(16);
+    builder.Finish(config.Finish());
+    initialized_ = engine_.Initialize(
+        flatbuffers::GetRoot<AudioConfig>(builder.GetBufferPointer()));
+    while (initialized_ && !engine_.FinalizeLoadedSounds()) {
+      SDL_Delay(1);
+    }
+  }
+
+  bool initialized() const { return initialized_; }
+  AudioEngine& engine() { return engine_; }
+
+  // Let the mixer finish sounds, then time the engine's frame.
+  double AdvanceFrame() {
+    AdvanceMixer();
+    world_time_ += kTimePerFrame;
+    const Clock::time_point start = Clock::now();
+    engine_.AdvanceFrame(world_time_);
+    return NanosecondsSince(start);
+  }
+
+ private:
+  AudioEngine engine_;
+  WorldTime world_time_;
+  bool initialized_;
+};
+
+// Time PlaySound() when every channel is taken, so that each play request
+// either steals a channel or becomes a virtual sound.
+static void BenchmarkPlayFull(int channels) {
+  BenchmarkEngine bench(channels);
+  if (!bench.initialized()) return;
+  double ns = 0.0;
+  for (int i = 0; i < kOperations; ++i) {
+    const SoundId sound = RandomSound();
+    const Clock::time_point start = Clock::now();
+    bench.engine().PlaySound(sound);
+    ns += NanosecondsSince(start);
+    if (i % channels == 0) {
+      bench.AdvanceFrame();
+    }
+  }
+  Report("play_full", channels, ns / kOperations);
+}
+
+// Time PlaySound() and Stop() at the rate of a busy pie fight: a few sounds
+// every frame, some of which are cut short.
+static void BenchmarkPlayStop(int channels) {
+  BenchmarkEngine bench(channels);
+  if (!bench.initialized()) return;
+  static const int kSoundsPerFrame = 4;
+  double ns = 0.0;
+  int operations = 0;
+  while (operations < kOperations) {
+    for (int i = 0; i < kSoundsPerFrame; ++i) {
+      const SoundId sound = RandomSound();
+      const Clock::time_point start = Clock::now();
+      const ChannelId channel = bench.engine().PlaySound(sound);
+      if (channel != AudioEngine::kInvalidChannel && i == 0) {
+        bench.engine().Stop(channel);
+        operations++;
+      }
+      ns += NanosecondsSince(start);
+      operations++;
+    }
+    bench.AdvanceFrame();
+  }
+  Report("play_stop", channels, ns / operations);
+}
+
+// Time AdvanceFrame() while sounds keep starting on ducking buses, so duck
+// gains are always fading, and when nothing has changed.
+static void BenchmarkAdvanceFrame(int channels) {
+  BenchmarkEngine bench(channels);
+  if (!bench.initialized()) return;
+  const int frames = kOperations / 10;
+  double ns = 0.0;
+  for (int frame = 0; frame < frames; ++frame) {
+    for (int i = 0; i < 2; ++i) {
+      bench.engine().PlaySound(RandomSound());
+    }
+    ns += bench.AdvanceFrame();
+  }
+  Report("advance_frame_ducking", channels, ns / frames);
+
+  // Let everything finish and the duck gains settle, then time idle frames.
+  for (int frame = 0; frame < 4 * kSoundFrames; ++frame) {
+    bench.AdvanceFrame();
+  }
+  ns = 0.0;
+  for (int frame = 0; frame < frames; ++frame) {
+    ns += bench.AdvanceFrame();
+  }
+  Report("advance_frame_idle", channels, ns / frames);
+}
+
+int main() {
+  SDL_LogSetAllPriority(SDL_LOG_PRIORITY_WARN);
+  if (!EnterDataDirectory() || !WriteBuses() || !WriteSounds()) {
+    fprintf(stderr, "can't write the benchmark data\n");
+    return 1;
+  }
+
+  printf("benchmark,mixer_channels,ns_per_operation\n");
+  for (size_t c = 0; c < sizeof(kChannelCounts) / sizeof(kChannelCounts[0]);
+       ++c) {
+    const int channels = kChannelCounts[c];
+    BenchmarkPlayFull(channels);
+    BenchmarkPlayStop(channels);
+    BenchmarkAdvanceFrame(channels);
+  }
+  return 0;
+}
@@ -28,17 +28,22 @@
 // run.
 extern "C" {
 Mix_Chunk* Mix_LoadWAV_RW(SDL_RWops*, int) { return NULL; }
-Mix_Music* Mix_LoadMUS(const char*) { return NULL; }
+Mix_Music* Mix_LoadMUS_RW(SDL_RWops*, int) { return NULL; }
 int Mix_AllocateChannels(int) { return 0; }
+void Mix_ChannelFinished(void (*)(int)) {}
+void Mix_HookMusicFinished(void (*)()) {}
 int Mix_HaltChannel(int) { return 0; }
 int Mix_HaltMusic() { return 0; }
 int Mix_Init(int) { return 0; }
 int Mix_OpenAudio(int, Uint16, int, int) { return 0; }
 int Mix_PlayChannelTimed(int, Mix_Chunk*, int, int) { return 0; }
 int Mix_FadeOutChannel(int, int) { return 0; }
+Mix_Chunk* Mix_GetChunk(int) { return NULL; }
 int Mix_PlayMusic(Mix_Music*, int) { return 0; }
 int Mix_Playing(int) { return 0; }
 int Mix_PlayingMusic() { return 0; }
+int Mix_QuerySpec(int*, Uint16*, int*) { return 0; }
+int Mix_SetMusicPosition(double) { return 0; }
 int Mix_Volume(int, int) { return 0; }
 int Mix_VolumeMusic(int) { return 0; }
 void Mix_CloseAudio() {}
@@ -76,44 +81,73 @@ class AudioEngineTests : public ::testing::Test {
   }
   virtual void TearDown() {}
 
+  // A sound from collections_[collection], with no bus.
+  AudioEngine::PlayingSound Sound(int collection, ChannelId channel,
+                                  WorldTime start_time) {
+    return AudioEngine::PlayingSound(collections_[collection].get(), nullptr,
+                                     nullptr, channel, start_time);
+  }
+
  protected:
   fpl::AudioEngine::SoundCollections collections_;
 };
 
 TEST_F(AudioEngineTests, IncreasingPriority) {
-  std::vector<fpl::AudioEngine::PlayingSound> sounds;
-  sounds.push_back(AudioEngine::PlayingSound(collections_[0].get(), 0, 0));
-  sounds.push_back(AudioEngine::PlayingSound(collections_[1].get(), 1, 1));
-  sounds.push_back(AudioEngine::PlayingSound(collections_[2].get(), 2, 2));
-  sounds.push_back(AudioEngine::PlayingSound(collections_[3].get(), 3, 3));
-  sounds.push_back(AudioEngine::PlayingSound(collections_[4].get(), 4, 4));
-  sounds.push_back(AudioEngine::PlayingSound(collections_[5].get(), 5, 5));
-  AudioEngine::PrioritizeChannels(&sounds);
-  EXPECT_EQ(0, sounds[5].channel_id);
-  EXPECT_EQ(1, sounds[4].channel_id);
-  EXPECT_EQ(2, sounds[3].channel_id);
-  EXPECT_EQ(3, sounds[2].channel_id);
-  EXPECT_EQ(4, sounds[1].channel_id);
-  EXPECT_EQ(5, sounds[0].channel_id);
+  AudioEngine::PlayingSoundQueue sounds;
+  sounds.Reset(6);
+  sounds.Push(Sound(3, 3, 3));
+  sounds.Push(Sound(0, 0, 0));
+  sounds.Push(Sound(5, 5, 5));
+  sounds.Push(Sound(1, 1, 1));
+  sounds.Push(Sound(4, 4, 4));
+  sounds.Push(Sound(2, 2, 2));
+  // Lowest priority sounds lose their channels first.
+  for (ChannelId channel = 0; channel < 6; ++channel) {
+    EXPECT_EQ(channel, sounds.Lowest().channel_id);
+    sounds.Remove(channel);
+  }
+  EXPECT_TRUE(sounds.empty());
 }
 
 TEST_F(AudioEngineTests, SamePriorityDifferentStartTimes) {
-  std::vector<AudioEngine::PlayingSound> sounds;
+  AudioEngine::PlayingSoundQueue sounds;
+  sounds.Reset(6);
   // Sounds with the same priority but later start times should be higher
   // priority.
-  sounds.push_back(AudioEngine::PlayingSound(collections_[0].get(), 0, 1));
-  sounds.push_back(AudioEngine::PlayingSound(collections_[0].get(), 1, 0));
-  sounds.push_back(AudioEngine::PlayingSound(collections_[1].get(), 2, 1));
-  sounds.push_back(AudioEngine::PlayingSound(collections_[1].get(), 3, 0));
-  sounds.push_back(AudioEngine::PlayingSound(collections_[2].get(), 4, 1));
-  sounds.push_back(AudioEngine::PlayingSound(collections_[2].get(), 5, 0));
-  AudioEngine::PrioritizeChannels(&sounds);
-  EXPECT_EQ(0, sounds[5].channel_id);
-  EXPECT_EQ(1, sounds[4].channel_id);
-  EXPECT_EQ(2, sounds[3].channel_id);
-  EXPECT_EQ(3, sounds[2].channel_id);
-  EXPECT_EQ(4, sounds[1].channel_id);
-  EXPECT_EQ(5, sounds[0].channel_id);
+  sounds.Push(Sound(0, 0, 1));
+  sounds.Push(Sound(0, 1, 0));
+  sounds.Push(Sound(1, 2, 1));
+  sounds.Push(Sound(1, 3, 0));
+  sounds.Push(Sound(2, 4, 1));
+  sounds.Push(Sound(2, 5, 0));
+  const ChannelId expected[] = { 1, 0, 3, 2, 5, 4 };
+  for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i) {
+    EXPECT_EQ(expected[i], sounds.Lowest().channel_id);
+    sounds.Remove(sounds.Lowest().channel_id);
+  }
+  EXPECT_TRUE(sounds.empty());
+}
+
+TEST_F(AudioEngineTests, RemoveFromMiddle) {
+  AudioEngine::PlayingSoundQueue sounds;
+  sounds.Reset(6);
+  for (ChannelId channel = 0; channel < 6; ++channel) {
+    EXPECT_EQ(channel, sounds.FreeChannel());
+    sounds.Push(Sound(5 - channel, channel, channel));
+  }
+  EXPECT_EQ(AudioEngine::kInvalidChannel, sounds.FreeChannel());
+
+  // Sounds that finish free their channels, and the rest stay in order.
+  sounds.Remove(2);
+  sounds.Remove(4);
+  EXPECT_EQ(4, sounds.FreeChannel());
+  EXPECT_EQ(4u, sounds.size());
+  const ChannelId expected[] = { 5, 3, 1, 0 };
+  for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i) {
+    EXPECT_EQ(expected[i], sounds.Lowest().channel_id);
+    sounds.Remove(sounds.Lowest().channel_id);
+  }
+  EXPECT_TRUE(sounds.empty());
 }
 
 }  // namespace fpl
@@ -0,0 +1,341 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <algorithm>
+#include <vector>
+#include "precompiled.h"
+#include "character.h"
+#include "character_state_machine_def_generated.h"
+#include "config_generated.h"
+#include "impel_generated.h"
+#include "rng.h"
+#include "timeline_generated.h"
+#include "flatbuffers/flatbuffers.h"
+#include "gtest/gtest.h"
+
+namespace pn = ::fpl::pie_noon;
+namespace fb = ::flatbuffers;
+
+using fpl::WorldTime;
+
+// Step between queries, as the game would advance a character's animation.
+static const WorldTime kDeltaTime = 3;
+
+// A timeline with entries at the same time, accessories that end at
+// different times or never, and gaps. Every time is offset by 'shift'.
+static fb::Offset<fpl::Timeline> CreateTestTimeline(
+    fb::FlatBufferBuilder* builder, uint16_t shift) {
+  std::vector<fpl::TimelineRenderable> renderables;
+  renderables.push_back(fpl::TimelineRenderable(0, 1));
+  renderables.push_back(fpl::TimelineRenderable(10 + shift, 2));
+  renderables.push_back(fpl::TimelineRenderable(25 + shift, 3));
+  renderables.push_back(fpl::TimelineRenderable(40 + shift, 4));
+  std::vector<fpl::TimelineAccessory> accessories;
+  const fpl::PixelOffset offset(0, 0);
+  accessories.push_back(fpl::TimelineAccessory(0, 0, 5, offset));
+  accessories.push_back(fpl::TimelineAccessory(5 + shift, 20 + shift, 6,
+                                               offset));
+  accessories.push_back(fpl::TimelineAccessory(12 + shift, 15 + shift, 7,
+                                               offset));
+  accessories.push_back(fpl::TimelineAccessory(30 + shift, 0, 8, offset));
+  accessories.push_back(fpl::TimelineAccessory(30 + shift, 45 + shift, 9,
+                                               offset));
+  accessories.push_back(fpl::TimelineAccessory(50 + shift, 60 + shift, 10,
+                                               offset));
+  std::vector<fpl::TimelineSound> sounds;
+  for (uint16_t time = 0; time < 60; time += 15) {
+    sounds.push_back(fpl::TimelineSound(time + shift,
+                                        static_cast<pn::SoundId>(0)));
+    sounds.push_back(fpl::TimelineSound(time + shift,
+                                        static_cast<pn::SoundId>(1)));
+  }
+  std::vector<fpl::TimelineEvent> events;
+  events.push_back(fpl::TimelineEvent(5 + shift, 1, 0));
+  events.push_back(fpl::TimelineEvent(20 + shift, 2, 0));
+  events.push_back(fpl::TimelineEvent(20 + shift, 3, 0));
+  events.push_back(fpl::TimelineEvent(55 + shift, 4, 0));
+  return fpl::CreateTimeline(
+      *builder, 70 + shift,
+      builder->CreateVectorOfStructs(renderables.data(),
+                                     renderables.size()),
+      builder->CreateVectorOfStructs(accessories.data(),
+                                     accessories.size()),
+      builder->CreateVectorOfStructs(sounds.data(), sounds.size()),
+      builder->CreateVectorOfStructs(events.data(), events.size()));
+}
+
+// Holds the timelines the cursor is checked against. Each is a finished
+// buffer of its own.
+class TimelineCursorTests : public ::testing::Test {
+protected:
+  virtual void SetUp() {
+    builder_a_.Finish(CreateTestTimeline(&builder_a_, 0));
+    builder_b_.Finish(CreateTestTimeline(&builder_b_, 7));
+  }
+
+  const fpl::Timeline* timeline_a() const {
+    return fpl::GetTimeline(builder_a_.GetBufferPointer());
+  }
+  const fpl::Timeline* timeline_b() const {
+    return fpl::GetTimeline(builder_b_.GetBufferPointer());
+  }
+
+  fb::FlatBufferBuilder builder_a_;
+  fb::FlatBufferBuilder builder_b_;
+};
+
+// Query 'cursor' the way GameState does for one update from 'time', and
+// expect the same answers as the scans of the whole timeline.
+static void ExpectMatchesScans(pn::TimelineCursor* cursor,
+                               const fpl::Timeline* timeline,
+                               WorldTime time) {
+  const WorldTime end = time + kDeltaTime;
+  int start_index = -1;
+  int end_index = -1;
+  cursor->Sounds(timeline, time, end, &start_index, &end_index);
+  EXPECT_EQ(pn::TimelineIndexAfterTime(timeline->sounds(), 0, time),
+            start_index);
+  EXPECT_EQ(pn::TimelineIndexAfterTime(timeline->sounds(), 0, end),
+            end_index);
+
+  cursor->Events(timeline, time, end, &start_index, &end_index);
+  EXPECT_EQ(pn::TimelineIndexAfterTime(timeline->events(), 0, time),
+            start_index);
+  EXPECT_EQ(pn::TimelineIndexAfterTime(timeline->events(), 0, end),
+            end_index);
+
+  EXPECT_EQ(pn::TimelineIndexBeforeTime(timeline->renderables(), time),
+            cursor->Renderable(timeline, time));
+
+  std::vector<int> indices;
+  std::vector<int> expected;
+  cursor->Accessories(timeline, time, &indices);
+  pn::TimelineIndicesWithTime(timeline->accessories(), time, &expected);
+  EXPECT_EQ(expected, indices);
+}
+
+// Stepping forward through a timeline, past its end.
+TEST_F(TimelineCursorTests, MatchesScansAsTimeAdvances) {
+  pn::TimelineCursor cursor;
+  for (WorldTime time = 0; time < 90; time += kDeltaTime) {
+    ExpectMatchesScans(&cursor, timeline_a(), time);
+  }
+}
+
+// Steps of different sizes, including none, land on and between entries.
+TEST_F(TimelineCursorTests, MatchesScansWithUnevenSteps) {
+  fpl::Rng rng(17);
+  pn::TimelineCursor cursor;
+  for (WorldTime time = 0; time < 90; time += rng.IntInRange(0, 9)) {
+    ExpectMatchesScans(&cursor, timeline_a(), time);
+  }
+}
+
+// Moving to another timeline, at an earlier or a later time, starts over.
+TEST_F(TimelineCursorTests, MatchesScansAfterTimelineChange) {
+  pn::TimelineCursor cursor;
+  for (WorldTime time = 0; time < 40; time += kDeltaTime) {
+    ExpectMatchesScans(&cursor, timeline_a(), time);
+  }
+  for (WorldTime time = 10; time < 60; time += kDeltaTime) {
+    ExpectMatchesScans(&cursor, timeline_b(), time);
+  }
+  for (WorldTime time = 80; time < 90; time += kDeltaTime) {
+    ExpectMatchesScans(&cursor, timeline_a(), time);
+  }
+}
+
+// Going back in time on the same timeline, as a rollback does.
+TEST_F(TimelineCursorTests, MatchesScansAfterTimeGoesBack) {
+  pn::TimelineCursor cursor;
+  for (WorldTime time = 0; time < 70; time += kDeltaTime) {
+    ExpectMatchesScans(&cursor, timeline_a(), time);
+  }
+  for (WorldTime time = 14; time < 70; time += kDeltaTime) {
+    ExpectMatchesScans(&cursor, timeline_a(), time);
+  }
+  ExpectMatchesScans(&cursor, timeline_a(), 0);
+}
+
+// After Character::Restore() rolls a character back to another state, its
+// cursor answers for the restored state's timeline.
+TEST_F(TimelineCursorTests, MatchesScansAfterRestore) {
+  // The face angle parameters are the only part of the config that the
+  // Character reads when it is made.
+  fb::FlatBufferBuilder config_builder;
+  const auto at_target = impel::CreateSettled1fParameters(config_builder);
+  impel::VelocityParametersBuilder velocity(config_builder);
+  velocity.add_at_target(at_target);
+  const auto base = velocity.Finish();
+  impel::OvershootParametersBuilder overshoot(config_builder);
+  overshoot.add_base(base);
+  const auto face_angle_def = overshoot.Finish();
+  pn::ConfigBuilder config(config_builder);
+  config.add_face_angle_def(face_angle_def);
+  config_builder.Finish(config.Finish());
+
+  // The first state plays the unshifted timeline, and the rest play the
+  // shifted one.
+  fb::FlatBufferBuilder def_builder;
+  const auto first_timeline = CreateTestTimeline(&def_builder, 0);
+  const auto other_timeline = CreateTestTimeline(&def_builder, 7);
+  std::vector<fb::Offset<pn::CharacterState>> states;
+  for (int i = 0; i < pn::StateId_Count; ++i) {
+    auto transitions =
+        def_builder.CreateVector<fb::Offset<pn::Transition>>(nullptr, 0);
+    states.push_back(pn::CreateCharacterState(
+        def_builder, static_cast<pn::StateId>(i), transitions,
+        i == 0 ? first_timeline : other_timeline));
+  }
+  def_builder.Finish(pn::CreateCharacterStateMachineDef(
+      def_builder,
+      def_builder.CreateVector<fb::Offset<pn::CharacterState>>(
+          &states.front(), states.size()),
+      pn::StateId_Idling));
+
+  pn::Character character(0, nullptr,
+                          *pn::GetConfig(config_builder.GetBufferPointer()),
+                          pn::GetCharacterStateMachineDef(
+                              def_builder.GetBufferPointer()),
+                          nullptr);
+  character.state_machine()->SetCurrentState(0, 0);
+  const fpl::Timeline* first = character.CurrentTimeline();
+  for (WorldTime time = 0; time < 30; time += kDeltaTime) {
+    ExpectMatchesScans(character.timeline_cursor(), first, time);
+  }
+  pn::CharacterSnapshot snapshot;
+  character.Snapshot(&snapshot);
+
+  // Run on into another state, further through its timeline than the
+  // snapshot got through the first one.
+  character.state_machine()->SetCurrentState(1, 30);
+  const fpl::Timeline* other = character.CurrentTimeline();
+  ASSERT_NE(first, other);
+  for (WorldTime time = 0; time < 60; time += kDeltaTime) {
+    ExpectMatchesScans(character.timeline_cursor(), other, time);
+  }
+
+  character.Restore(snapshot);
+  ASSERT_EQ(first, character.CurrentTimeline());
+  for (WorldTime time = 30; time < 90; time += kDeltaTime) {
+    ExpectMatchesScans(character.timeline_cursor(), first, time);
+    const int index = pn::TimelineIndexBeforeTime(first->renderables(), time);
+    EXPECT_EQ(first->renderables()->Get(index)->renderable(),
+              character.RenderableId(time));
+  }
+}
+
+// The incoming counts and soonest arrivals follow the pies through adds
+// and swap-removes.
+TEST(AirbornePiesTests, IndexFollowsRemovals) {
+  pn::AirbornePies pies;
+  EXPECT_EQ(0, pies.IncomingCount(1));
+  EXPECT_EQ(pn::AirbornePies::kNoArrival, pies.SoonestArrival(1));
+
+  EXPECT_EQ(0, pies.Add(0, 0, 1, 0, 100, 1, 2.0f, 1));
+  EXPECT_EQ(1, pies.Add(0, 0, 2, 10, 50, 1, 2.0f, 1));
+  EXPECT_EQ(2, pies.Add(2, 2, 1, 20, 30, 1, 2.0f, 1));
+  EXPECT_EQ(3, pies.Add(3, 3, 1, 30, 90, 1, 2.0f, 1));
+  EXPECT_EQ(3, pies.IncomingCount(1));
+  EXPECT_EQ(1, pies.IncomingCount(2));
+  EXPECT_EQ(0, pies.IncomingCount(0));
+  EXPECT_EQ(50, pies.SoonestArrival(1));
+  EXPECT_EQ(60, pies.SoonestArrival(2));
+
+  // Removing the soonest pie aimed at 1 moves the last pie into its slot,
+  // and finds the next soonest.
+  pies.Remove(2);
+  EXPECT_EQ(3, pies.Count());
+  EXPECT_EQ(3, pies.source(2));
+  EXPECT_EQ(30, pies.start_time(2));
+  EXPECT_EQ(2, pies.IncomingCount(1));
+  EXPECT_EQ(100, pies.SoonestArrival(1));
+
+  pies.Remove(0);
+  EXPECT_EQ(3, pies.source(0));
+  EXPECT_EQ(1, pies.IncomingCount(1));
+  EXPECT_EQ(120, pies.SoonestArrival(1));
+  EXPECT_EQ(60, pies.SoonestArrival(2));
+
+  pies.Remove(1);
+  EXPECT_EQ(1, pies.Count());
+  EXPECT_EQ(0, pies.IncomingCount(2));
+  EXPECT_EQ(pn::AirbornePies::kNoArrival, pies.SoonestArrival(2));
+  EXPECT_EQ(1, pies.IncomingCount(1));
+
+  pies.Clear();
+  EXPECT_EQ(0, pies.Count());
+  EXPECT_EQ(0, pies.IncomingCount(1));
+  EXPECT_EQ(pn::AirbornePies::kNoArrival, pies.SoonestArrival(1));
+}
+
+// Over many random adds and removes, every pie keeps its fields, and the
+// index agrees with a scan of the pies.
+TEST(AirbornePiesTests, IndexMatchesScan) {
+  static const int kNumTargets = 4;
+  struct Pie {
+    fpl::CharacterId source;
+    fpl::CharacterId target;
+    WorldTime start_time;
+    WorldTime flight_time;
+  };
+  fpl::Rng rng(5);
+  pn::AirbornePies pies;
+  std::vector<Pie> expected;
+  for (int step = 0; step < 1000; ++step) {
+    if (expected.empty() || rng.IntInRange(0, 3) != 0) {
+      const Pie pie = { static_cast<fpl::CharacterId>(rng.IntInRange(0, 4)),
+                        static_cast<fpl::CharacterId>(
+                            rng.IntInRange(0, kNumTargets)),
+                        step, rng.IntInRange(10, 200) };
+      pies.Add(pie.source, pie.source, pie.target, pie.start_time,
+               pie.flight_time, 1, 2.0f, 1);
+      expected.push_back(pie);
+    } else {
+      const int i = rng.IntInRange(0, static_cast<int>(expected.size()));
+      pies.Remove(i);
+      expected[i] = expected.back();
+      expected.pop_back();
+    }
+
+    ASSERT_EQ(static_cast<int>(expected.size()), pies.Count());
+    for (int i = 0; i < pies.Count(); ++i) {
+      EXPECT_EQ(expected[i].source, pies.source(i));
+      EXPECT_EQ(expected[i].target, pies.target(i));
+      EXPECT_EQ(expected[i].start_time, pies.start_time(i));
+      EXPECT_EQ(expected[i].flight_time, pies.flight_time(i));
+    }
+    for (fpl::CharacterId target = 0; target < kNumTargets; ++target) {
+      int count = 0;
+      WorldTime soonest = pn::AirbornePies::kNoArrival;
+      for (size_t i = 0; i < expected.size(); ++i) {
+        if (expected[i].target != target) continue;
+        count++;
+        soonest = std::min(soonest,
+                           expected[i].start_time + expected[i].flight_time);
+      }
+      EXPECT_EQ(count, pies.IncomingCount(target));
+      EXPECT_EQ(soonest, pies.SoonestArrival(target));
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
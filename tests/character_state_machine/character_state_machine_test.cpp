@@ -133,6 +133,79 @@ TEST(CharacterStateMachineTests, FollowTransitions) {
   ASSERT_EQ(state_machine.current_state()->id(), 2);
 }
 
+// The first transition out of 'state' that EvaluateCondition() accepts, or
+// kNoTransition. This is what the compiled table must reproduce.
+static int ReferenceNextState(const pn::CharacterStateMachineDef* def,
+                              int state, const pn::ConditionInputs& inputs) {
+  auto transitions = def->states()->Get(state)->transitions();
+  for (fb::uoffset_t i = 0; transitions && i < transitions->Length(); ++i) {
+    auto transition = transitions->Get(i);
+    if (transition->condition() &&
+        pn::EvaluateCondition(transition->condition(), inputs)) {
+      return transition->target_state();
+    }
+  }
+  return pn::CompiledStateMachine::kNoTransition;
+}
+
+TEST(CharacterStateMachineTests, CompiledMatchesEvaluateCondition) {
+  flatbuffers::FlatBufferBuilder builder;
+  std::vector<flatbuffers::Offset<pn::CharacterState>> states;
+  for (uint8_t i = 0; i < pn::StateId_Count; i++) {
+    std::vector<flatbuffers::Offset<pn::Transition>> trans_vec;
+    const uint16_t bit = static_cast<uint16_t>(1 << (i % 8));
+    // Needs one input held and another released, within a time window.
+    trans_vec.push_back(pn::CreateTransition(builder,
+        static_cast<pn::StateId>((i + 1) % pn::StateId_Count),
+        pn::CreateCondition(builder, bit, static_cast<uint16_t>(bit << 1), 0,
+                            0, 100, 200)));
+    // No condition, so never followed.
+    trans_vec.push_back(pn::CreateTransition(builder,
+        static_cast<pn::StateId>((i + 2) % pn::StateId_Count)));
+    // Needs an input to have just gone down and another to have just gone up.
+    trans_vec.push_back(pn::CreateTransition(builder,
+        static_cast<pn::StateId>((i + 3) % pn::StateId_Count),
+        pn::CreateCondition(builder, 0, 0, bit,
+                            static_cast<uint16_t>(bit << 2))));
+    auto trans = builder.CreateVector<fb::Offset<pn::Transition>>(
+      &trans_vec.front(), trans_vec.size());
+    auto timeline = fpl::CreateTimeline(builder);
+    states.push_back(pn::CreateCharacterState(builder,
+                                              static_cast<pn::StateId>(i),
+                                              trans, timeline));
+  }
+  auto state_machine_offset = pn::CreateCharacterStateMachineDef(builder,
+      builder.CreateVector<fb::Offset<pn::CharacterState>>(
+          &states.front(), states.size()), pn::StateId_Idling);
+  builder.Finish(state_machine_offset);
+  auto def = pn::GetCharacterStateMachineDef(builder.GetBufferPointer());
+  ASSERT_TRUE(CharacterStateMachineDef_Validate(def));
+
+  pn::CompiledStateMachine compiled(def);
+  EXPECT_EQ(compiled.NumTransitions(), 2 * pn::StateId_Count);
+
+  static const int kTimes[] = { 0, 99, 100, 150, 199, 200 };
+  int num_transitions_followed = 0;
+  for (int state = 0; state < pn::StateId_Count; ++state) {
+    for (int32_t bits = 0; bits < 1 << 10; ++bits) {
+      for (size_t t = 0; t < sizeof(kTimes) / sizeof(kTimes[0]); ++t) {
+        pn::ConditionInputs inputs;
+        inputs.is_down = bits & 0x3FF;
+        inputs.went_down = (bits * 7) & 0x3FF;
+        inputs.went_up = (bits * 13) & 0x3FF;
+        inputs.animation_time = kTimes[t];
+        inputs.current_time = 0;
+        const int expected = ReferenceNextState(def, state, inputs);
+        EXPECT_EQ(expected, compiled.NextState(state, inputs));
+        if (expected != pn::CompiledStateMachine::kNoTransition)
+          num_transitions_followed++;
+      }
+    }
+  }
+  // Make sure the inputs actually exercised the transitions.
+  EXPECT_GT(num_transitions_followed, 0);
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -0,0 +1,96 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <vector>
+#include "controller.h"
+#include "fixed_step.h"
+#include "gtest/gtest.h"
+
+using fpl::WorldTime;
+using fpl::pie_noon::AdvanceFixedSteps;
+using fpl::pie_noon::Controller;
+
+// Stands in for LogicalInputs_Left.
+static const uint32_t kTurnInput = 1u << 2;
+
+// Turns only come from the inputs the controller's owner sets.
+class TestController : public Controller {
+ public:
+  virtual void AdvanceFrame(WorldTime /*delta_time*/) {}
+};
+
+// A simulation that turns once for every press it sees, as
+// GameState::RequestedTurn does, and counts the steps that saw it held.
+struct TurnCounter {
+  explicit TurnCounter(Controller* controller)
+      : controller(controller), turns(0), held_steps(0), steps(0) {}
+  Controller* controller;
+  int turns;
+  int held_steps;
+  int steps;
+};
+
+static void CountTurns(WorldTime /*step*/, void* context) {
+  TurnCounter* counter = static_cast<TurnCounter*>(context);
+  counter->turns += (counter->controller->went_down() & kTurnInput) ? 1 : 0;
+  counter->held_steps +=
+      (counter->controller->is_down() & kTurnInput) ? 1 : 0;
+  counter->steps++;
+}
+
+// A single press in a frame that takes three steps turns exactly once, but
+// the input stays held for every step.
+TEST(FixedStepTests, PressTurnsOnceOverSeveralSteps) {
+  TestController controller;
+  std::vector<Controller*> controllers(1, &controller);
+  TurnCounter counter(&controller);
+  WorldTime remainder = 0;
+  controller.SetLogicalInputs(kTurnInput, true);
+  EXPECT_EQ(3, AdvanceFixedSteps(10, 30, controllers, CountTurns, &counter,
+                                 &remainder));
+  EXPECT_EQ(3, counter.steps);
+  EXPECT_EQ(1, counter.turns);
+  EXPECT_EQ(3, counter.held_steps);
+  EXPECT_EQ(0u, controller.went_down());
+  EXPECT_EQ(kTurnInput, controller.is_down());
+}
+
+// Time that doesn't fill a step carries into the next frame, and a frame
+// with no whole step leaves the edges for the next frame that has one.
+TEST(FixedStepTests, RemainderCarries) {
+  TestController controller;
+  std::vector<Controller*> controllers(1, &controller);
+  TurnCounter counter(&controller);
+  WorldTime remainder = 0;
+  EXPECT_EQ(1, AdvanceFixedSteps(10, 15, controllers, CountTurns, &counter,
+                                 &remainder));
+  EXPECT_EQ(5, remainder);
+  controller.SetLogicalInputs(kTurnInput, true);
+  EXPECT_EQ(0, AdvanceFixedSteps(10, 4, controllers, CountTurns, &counter,
+                                 &remainder));
+  EXPECT_EQ(kTurnInput, controller.went_down());
+  EXPECT_EQ(1, AdvanceFixedSteps(10, 1, controllers, CountTurns, &counter,
+                                 &remainder));
+  EXPECT_EQ(0, remainder);
+  EXPECT_EQ(1, counter.turns);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
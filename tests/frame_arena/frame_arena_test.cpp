@@ -0,0 +1,83 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <cstdint>
+#include "frame_arena.h"
+#include "gtest/gtest.h"
+
+using fpl::ArenaAllocator;
+using fpl::ArenaVector;
+using fpl::FrameArena;
+
+// Allocations are aligned, and don't overlap.
+TEST(FrameArenaTests, AlignedAndDisjoint) {
+  FrameArena arena(256);
+  uint8_t* a = static_cast<uint8_t*>(arena.Allocate(3));
+  uint8_t* b = static_cast<uint8_t*>(arena.Allocate(5, 8));
+  uint8_t* c = static_cast<uint8_t*>(arena.Allocate(1, 64));
+  EXPECT_EQ(0u, reinterpret_cast<size_t>(a) % FrameArena::kDefaultAlignment);
+  EXPECT_EQ(0u, reinterpret_cast<size_t>(b) % 8);
+  EXPECT_EQ(0u, reinterpret_cast<size_t>(c) % 64);
+  EXPECT_TRUE(a + 3 <= b);
+  EXPECT_TRUE(b + 5 <= c);
+}
+
+// Reset() hands out the same memory again.
+TEST(FrameArenaTests, ResetReusesMemory) {
+  FrameArena arena(256);
+  void* first = arena.Allocate(100);
+  arena.Reset();
+  EXPECT_EQ(0u, arena.used());
+  EXPECT_EQ(first, arena.Allocate(100));
+}
+
+// A frame that overflows the arena still gets its memory, and the next
+// Reset() grows the arena so that the same frame then fits.
+TEST(FrameArenaTests, GrowsAfterOverflow) {
+  FrameArena arena(64);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_TRUE(arena.Allocate(48) != nullptr);
+  }
+  const size_t used = arena.used();
+  EXPECT_GT(used, arena.capacity());
+
+  arena.Reset();
+  EXPECT_GE(arena.capacity(), used);
+  for (int i = 0; i < 10; ++i) {
+    arena.Allocate(48);
+  }
+  EXPECT_LE(arena.used(), arena.capacity());
+}
+
+// Standard containers work with the ArenaAllocator.
+TEST(FrameArenaTests, ArenaVector) {
+  FrameArena arena(1024);
+  ArenaVector<int> values((ArenaAllocator<int>(&arena)));
+  for (int i = 0; i < 100; ++i) {
+    values.push_back(i);
+  }
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(i, values[i]);
+  }
+  EXPECT_GE(arena.used(), 100 * sizeof(int));
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,110 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "frame_pacer.h"
+#include "gtest/gtest.h"
+
+using fpl::FramePacer;
+
+static const double kPrecision = 1e-9;
+
+// Targets that divide the refresh rate are paced by vsync.
+TEST(FramePacerTests, SwapInterval) {
+  FramePacer pacer;
+  pacer.Initialize(60, 60, 0.01);
+  EXPECT_EQ(1, pacer.swap_interval());
+  pacer.Initialize(30, 60, 0.01);
+  EXPECT_EQ(2, pacer.swap_interval());
+  pacer.Initialize(30, 59, 0.01);
+  EXPECT_EQ(2, pacer.swap_interval());
+  pacer.Initialize(60, 120, 0.01);
+  EXPECT_EQ(2, pacer.swap_interval());
+  pacer.Initialize(0, 90, 0.01);
+  EXPECT_EQ(1, pacer.swap_interval());
+  EXPECT_NEAR(1.0 / 90.0, pacer.period(), kPrecision);
+
+  // 90Hz on a 60Hz display, or an unknown display, can't use vsync.
+  pacer.Initialize(90, 60, 0.01);
+  EXPECT_EQ(0, pacer.swap_interval());
+  pacer.Initialize(120, 0, 0.01);
+  EXPECT_EQ(0, pacer.swap_interval());
+  EXPECT_NEAR(0.01, pacer.period(), kPrecision);
+}
+
+// Without vsync, frames start a period apart, even when some are late.
+TEST(FramePacerTests, Deadlines) {
+  FramePacer pacer;
+  pacer.Initialize(50, 0, 0.0);
+  EXPECT_EQ(0.0, pacer.TimeToWait(1.0));
+  pacer.BeginFrame(1.0);
+  EXPECT_NEAR(0.02, pacer.TimeToWait(1.0), kPrecision);
+  EXPECT_NEAR(0.005, pacer.TimeToWait(1.015), kPrecision);
+
+  // A frame that starts 5ms late is followed by one that catches up.
+  pacer.BeginFrame(1.025);
+  EXPECT_NEAR(0.015, pacer.TimeToWait(1.025), kPrecision);
+
+  // A frame more than a period late starts a new schedule.
+  pacer.BeginFrame(1.2);
+  EXPECT_NEAR(0.02, pacer.TimeToWait(1.2), kPrecision);
+  EXPECT_EQ(1, pacer.missed_frames());
+}
+
+// With vsync, the pacer only waits if the swap returned far too early.
+TEST(FramePacerTests, VsyncGuard) {
+  FramePacer pacer;
+  pacer.Initialize(60, 60, 0.01);
+  pacer.BeginFrame(2.0);
+  EXPECT_NEAR(0.5 / 60.0, pacer.TimeToWait(2.0), kPrecision);
+  EXPECT_EQ(0.0, pacer.TimeToWait(2.0 + 1.0 / 60.0));
+}
+
+// The statistics cover the frame times.
+TEST(FramePacerTests, Statistics) {
+  FramePacer pacer;
+  pacer.Initialize(100, 0, 0.0);
+  double now = 0.0;
+  pacer.BeginFrame(now);
+  for (int i = 0; i < FramePacer::kNumSamples; ++i) {
+    now += i % 2 ? 0.008 : 0.012;
+    pacer.BeginFrame(now);
+  }
+  EXPECT_NEAR(0.01, pacer.MeanFrameTime(), kPrecision);
+  EXPECT_NEAR(0.002, pacer.FrameTimeDeviation(), kPrecision);
+  EXPECT_NEAR(0.008, pacer.LastFrameTime(), kPrecision);
+  EXPECT_EQ(0, pacer.missed_frames());
+}
+
+// A frame held back after Restart() isn't a sample or a missed frame, and
+// the schedule starts again from it.
+TEST(FramePacerTests, Restart) {
+  FramePacer pacer;
+  pacer.Initialize(100, 0, 0.0);
+  pacer.BeginFrame(0.0);
+  pacer.BeginFrame(0.01);
+  pacer.Restart();
+  pacer.BeginFrame(0.5);
+  EXPECT_NEAR(0.01, pacer.LastFrameTime(), kPrecision);
+  EXPECT_EQ(0, pacer.missed_frames());
+  EXPECT_NEAR(0.01, pacer.TimeToWait(0.5), kPrecision);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,141 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <cstdio>
+#include <string>
+#include "precompiled.h"
+#include "frame_profiler.h"
+#include "gtest/gtest.h"
+
+using fpl::BeginProfiledFrame;
+using fpl::EnableFrameProfiler;
+using fpl::FrameProfilePhases;
+using fpl::FrameProfileScope;
+using fpl::FrameProfilerEnabled;
+using fpl::NameFrameProfilerThread;
+using fpl::RecordFrameCounter;
+using fpl::ResetFrameProfiler;
+using fpl::WriteFrameTrace;
+
+static const char kFileName[] = "frame_profiler_test.json";
+
+class FrameProfilerTests : public ::testing::Test {
+protected:
+  virtual void SetUp() {}
+  virtual void TearDown() {
+    ResetFrameProfiler();
+    remove(kFileName);
+  }
+};
+
+static std::string ReadTrace() {
+  std::string contents;
+  FILE* file = fopen(kFileName, "rb");
+  if (!file) return contents;
+  char buffer[256];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    contents.append(buffer, read);
+  }
+  fclose(file);
+  return contents;
+}
+
+// Profile one frame holding a single scope called 'name'. The delays keep
+// the frames' times apart.
+static void ProfileFrame(const char* name) {
+  BeginProfiledFrame();
+  SDL_Delay(1);
+  {
+    FrameProfileScope scope(name);
+  }
+  SDL_Delay(1);
+}
+
+// Nothing is recorded until the profiler is enabled.
+TEST_F(FrameProfilerTests, DisabledRecordsNothing) {
+  EXPECT_FALSE(FrameProfilerEnabled());
+  ProfileFrame("Input");
+  ProfileFrame("Input");
+  EXPECT_FALSE(WriteFrameTrace(kFileName, 1));
+  EXPECT_EQ(std::string(), ReadTrace());
+}
+
+// Only the requested number of complete frames are written.
+TEST_F(FrameProfilerTests, WritesLastFrames) {
+  EnableFrameProfiler(true);
+  ProfileFrame("Input");
+  ProfileFrame("Render");
+  BeginProfiledFrame();
+  EXPECT_TRUE(WriteFrameTrace(kFileName, 1));
+
+  const std::string trace = ReadTrace();
+  EXPECT_EQ(0u, trace.find("{\"traceEvents\":["));
+  EXPECT_NE(std::string::npos,
+            trace.find("\"name\":\"Render\",\"cat\":\"frame\",\"ph\":\"X\""));
+  EXPECT_NE(std::string::npos, trace.find("\"name\":\"Frame\""));
+  EXPECT_EQ(std::string::npos, trace.find("\"name\":\"Input\""));
+
+  EXPECT_TRUE(WriteFrameTrace(kFileName, 10));
+  EXPECT_NE(std::string::npos, ReadTrace().find("\"name\":\"Input\""));
+}
+
+// Each phase becomes its own event, and the last ends with the object.
+TEST_F(FrameProfilerTests, PhasesRecordEachPhase) {
+  EnableFrameProfiler(true);
+  BeginProfiledFrame();
+  {
+    FrameProfilePhases phases("Pies");
+    phases.Next("Impel");
+  }
+  BeginProfiledFrame();
+  EXPECT_TRUE(WriteFrameTrace(kFileName, 1));
+
+  const std::string trace = ReadTrace();
+  EXPECT_NE(std::string::npos, trace.find("\"name\":\"Pies\""));
+  EXPECT_NE(std::string::npos, trace.find("\"name\":\"Impel\""));
+}
+
+// Counters become counter events, with their value.
+TEST_F(FrameProfilerTests, WritesCounters) {
+  EnableFrameProfiler(true);
+  BeginProfiledFrame();
+  RecordFrameCounter("draws", 42);
+  BeginProfiledFrame();
+  EXPECT_TRUE(WriteFrameTrace(kFileName, 1));
+  EXPECT_NE(std::string::npos,
+            ReadTrace().find("\"name\":\"draws\",\"ph\":\"C\""));
+  EXPECT_NE(std::string::npos, ReadTrace().find("{\"value\":42}"));
+}
+
+// Named threads are labelled with metadata events.
+TEST_F(FrameProfilerTests, WritesThreadNames) {
+  NameFrameProfilerThread("Main");
+  EnableFrameProfiler(true);
+  ProfileFrame("Input");
+  BeginProfiledFrame();
+  EXPECT_TRUE(WriteFrameTrace(kFileName, 1));
+  EXPECT_NE(std::string::npos,
+            ReadTrace().find("\"ph\":\"M\",\"pid\":1,\"tid\":"));
+  EXPECT_NE(std::string::npos, ReadTrace().find("{\"name\":\"Main\"}"));
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
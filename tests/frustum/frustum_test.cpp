@@ -0,0 +1,75 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "frustum.h"
+#include "gtest/gtest.h"
+
+using fpl::Frustum;
+using mathfu::mat4;
+using mathfu::vec3;
+
+class FrustumTests : public ::testing::Test {
+protected:
+  virtual void SetUp() {
+    // Same projection as PieNoonGame::Render(). With no camera transform,
+    // the view is down -z from the origin.
+    frustum_.Set(mat4::Perspective(0.8f, 1.5f, 1.0f, 100.0f, -1.0f));
+  }
+  virtual void TearDown() {}
+
+  Frustum frustum_;
+};
+
+// Points in front of the camera, between the near and far planes, are in.
+TEST_F(FrustumTests, Inside) {
+  EXPECT_TRUE(frustum_.IntersectsSphere(vec3(0.0f, 0.0f, -10.0f), 0.0f));
+  EXPECT_TRUE(frustum_.IntersectsSphere(vec3(1.0f, -1.0f, -50.0f), 0.0f));
+}
+
+// Spheres entirely outside any plane are out. Ones that cross a plane are in.
+TEST_F(FrustumTests, Outside) {
+  // Behind the camera, and past the far plane.
+  EXPECT_FALSE(frustum_.IntersectsSphere(vec3(0.0f, 0.0f, 5.0f), 1.0f));
+  EXPECT_FALSE(frustum_.IntersectsSphere(vec3(0.0f, 0.0f, -110.0f), 1.0f));
+  EXPECT_TRUE(frustum_.IntersectsSphere(vec3(0.0f, 0.0f, -110.0f), 20.0f));
+
+  // Far off to the side of, above and below the view.
+  EXPECT_FALSE(frustum_.IntersectsSphere(vec3(50.0f, 0.0f, -10.0f), 1.0f));
+  EXPECT_FALSE(frustum_.IntersectsSphere(vec3(-50.0f, 0.0f, -10.0f), 1.0f));
+  EXPECT_FALSE(frustum_.IntersectsSphere(vec3(0.0f, 50.0f, -10.0f), 1.0f));
+  EXPECT_FALSE(frustum_.IntersectsSphere(vec3(0.0f, -50.0f, -10.0f), 1.0f));
+  EXPECT_TRUE(frustum_.IntersectsSphere(vec3(50.0f, 0.0f, -10.0f), 50.0f));
+}
+
+// Plane normals are unit length, so distances are in world units.
+TEST_F(FrustumTests, Normalized) {
+  for (int i = 0; i < Frustum::kNumPlanes; ++i) {
+    const Frustum::Plane plane = static_cast<Frustum::Plane>(i);
+    EXPECT_NEAR(1.0f, frustum_.plane(plane).xyz().Length(), 1e-5f);
+  }
+  // The near plane is 1 unit in front of the camera, facing away from it.
+  const mathfu::vec4& near_plane = frustum_.plane(Frustum::kNear);
+  EXPECT_NEAR(0.0f, vec3::DotProduct(near_plane.xyz(),
+                                     vec3(0.0f, 0.0f, -1.0f)) +
+                    near_plane.w(), 1e-4f);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,91 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "gl_stats.h"
+#include "gtest/gtest.h"
+
+using fpl::AdvanceGLStatsFrame;
+using fpl::CategorizeGLCall;
+using fpl::CountGLBufferUpload;
+using fpl::CountGLCall;
+using fpl::CountGLTextureUpload;
+using fpl::EnableGLStats;
+using fpl::GLCallStats;
+using fpl::LastFrameGLStats;
+
+class GLStatsTests : public ::testing::Test {
+protected:
+  virtual void SetUp() {}
+  virtual void TearDown() { EnableGLStats(false); }
+};
+
+// Calls are sorted by their name, whichever prefix they have.
+TEST_F(GLStatsTests, Categorize) {
+  EXPECT_EQ(fpl::kGLCallDraw,
+            CategorizeGLCall("glDrawElements(GL_TRIANGLES, 6, type, 0)"));
+  EXPECT_EQ(fpl::kGLCallDraw,
+            CategorizeGLCall("fplDrawElementsInstanced(mode, n, t, 0, 4)"));
+  EXPECT_EQ(fpl::kGLCallProgram, CategorizeGLCall("glUseProgram(program_)"));
+  EXPECT_EQ(fpl::kGLCallTexture,
+            CategorizeGLCall("glBindTexture(GL_TEXTURE_2D, id)"));
+  EXPECT_EQ(fpl::kGLCallUniform,
+            CategorizeGLCall("glUniform4fv(location, 1, value)"));
+  EXPECT_EQ(fpl::kGLCallBuffer,
+            CategorizeGLCall("glBindBuffer(GL_ARRAY_BUFFER, vbo)"));
+  EXPECT_EQ(fpl::kGLCallBuffer,
+            CategorizeGLCall("glEnableVertexAttribArray(index)"));
+  EXPECT_EQ(fpl::kGLCallState, CategorizeGLCall("glEnable(GL_BLEND)"));
+  EXPECT_EQ(fpl::kGLCallState, CategorizeGLCall("glDepthMask(false)"));
+  EXPECT_EQ(fpl::kGLCallUpload,
+            CategorizeGLCall("glBufferSubData(GL_ARRAY_BUFFER, 0, n, p)"));
+  EXPECT_EQ(fpl::kGLCallOther, CategorizeGLCall("glGenBuffers(1, &vbo)"));
+  EXPECT_EQ(fpl::kGLCallOther, CategorizeGLCall("SomethingElse()"));
+}
+
+// Counts move to the last frame's stats when the frame advances, and
+// nothing is counted while disabled.
+TEST_F(GLStatsTests, CountsPerFrame) {
+  CountGLCall(fpl::kGLCallDraw);
+  AdvanceGLStatsFrame();
+  EXPECT_EQ(0, LastFrameGLStats().calls[fpl::kGLCallDraw]);
+
+  EnableGLStats(true);
+  CountGLCall(fpl::kGLCallDraw);
+  CountGLCall(fpl::kGLCallDraw);
+  CountGLCall(fpl::kGLCallUniform);
+  CountGLBufferUpload(100);
+  CountGLTextureUpload(64);
+  CountGLTextureUpload(16);
+  EXPECT_EQ(0, LastFrameGLStats().calls[fpl::kGLCallDraw]);
+  AdvanceGLStatsFrame();
+
+  const GLCallStats& stats = LastFrameGLStats();
+  EXPECT_EQ(2, stats.calls[fpl::kGLCallDraw]);
+  EXPECT_EQ(1, stats.calls[fpl::kGLCallUniform]);
+  EXPECT_EQ(0, stats.calls[fpl::kGLCallState]);
+  EXPECT_EQ(100u, stats.buffer_upload_bytes);
+  EXPECT_EQ(80u, stats.texture_upload_bytes);
+
+  AdvanceGLStatsFrame();
+  EXPECT_EQ(0, LastFrameGLStats().calls[fpl::kGLCallDraw]);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,61 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "idle_throttle.h"
+#include "gtest/gtest.h"
+
+using fpl::IdleThrottle;
+
+// Quiet frames only make the game idle once they've lasted the delay.
+TEST(IdleThrottleTests, IdleAfterDelay) {
+  IdleThrottle throttle;
+  throttle.Initialize(2.0, 0.1);
+  EXPECT_FALSE(throttle.Idle(0.0));
+  throttle.Update(1.0, true);
+  EXPECT_FALSE(throttle.Idle(2.5));
+  throttle.Update(2.5, true);
+  EXPECT_TRUE(throttle.Idle(3.0));
+}
+
+// A frame that isn't quiet, or input, restarts the delay.
+TEST(IdleThrottleTests, ActivityEndsIdle) {
+  IdleThrottle throttle;
+  throttle.Initialize(1.0, 0.1);
+  throttle.Update(0.0, true);
+  EXPECT_TRUE(throttle.Idle(1.0));
+  throttle.Update(1.0, false);
+  EXPECT_FALSE(throttle.Idle(1.1));
+  throttle.Update(1.1, true);
+  EXPECT_FALSE(throttle.Idle(2.0));
+  EXPECT_TRUE(throttle.Idle(2.1));
+  throttle.Wake();
+  EXPECT_FALSE(throttle.Idle(10.0));
+}
+
+// A zero idle period disables the throttle.
+TEST(IdleThrottleTests, Disabled) {
+  IdleThrottle throttle;
+  throttle.Initialize(0.0, 0.0);
+  throttle.Update(0.0, true);
+  EXPECT_FALSE(throttle.Idle(100.0));
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
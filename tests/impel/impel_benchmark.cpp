@@ -0,0 +1,283 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+// Measures how the impel system scales with the number of Impellers.
+//
+// Results are written to stdout as CSV, one row per measurement:
+//   benchmark,processor,impellers,ns_per_impeller
+// so that they can be collected and compared between builds.
+
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "impel_processor_overshoot.h"
+#include "impel_processor_smooth.h"
+#include "impel_processor_smooth_fixed.h"
+#include "impel_snapshot.h"
+
+using impel::ImpelEngine;
+using impel::ImpelId;
+using impel::ImpelInit;
+using impel::ImpelProcessor1f;
+using impel::ImpelSnapshot;
+using impel::Impeller1f;
+using impel::ImpelTime;
+using impel::OvershootImpelInit;
+using impel::SmoothFixedImpelInit;
+using impel::SmoothImpelInit;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+// Number of Impellers in each run.
+static const int kImpellerCounts[] = { 100, 1000, 10000, 100000 };
+
+// Total number of Impeller updates per measurement. Smaller runs are repeated
+// more often so that every measurement takes about the same time.
+static const int kUpdatesPerMeasurement = 4000000;
+
+// Simulate a 60Hz game, where targets change a few times a second.
+static const ImpelTime kTimePerFrame = 16;
+static const int kFramesPerRetarget = 20;
+
+static const float kPi = 3.14159265359f;
+
+// Same parameters as the character face angle, in config.json.
+static OvershootImpelInit FaceAngleInit() {
+  OvershootImpelInit init;
+  init.modular = true;
+  init.min = -kPi;
+  init.max = kPi;
+  init.max_velocity = 0.0126f;
+  init.max_delta = 3.141f;
+  init.at_target.max_difference = 0.087f;
+  init.at_target.max_velocity = 0.00059f;
+  init.accel_per_difference = 0.00032f;
+  init.wrong_direction_multiplier = 4.0f;
+  init.max_delta_time = 10;
+  return init;
+}
+
+// Same parameters as the camera movement, in config.json.
+static SmoothImpelInit CameraInit() {
+  SmoothImpelInit init;
+  init.modular = false;
+  init.min = 0.0f;
+  init.max = 1.0f;
+  init.max_velocity = 0.018f;
+  init.max_delta = 1.0f;
+  init.at_target.max_difference = 0.01f;
+  init.at_target.max_velocity = 0.0006f;
+  return init;
+}
+
+// A deterministic spread of values in [-pi, pi).
+static float SpreadValue(int i, int salt) {
+  const unsigned int hash = static_cast<unsigned int>(i) * 2654435761u +
+                            static_cast<unsigned int>(salt) * 40503u;
+  return (static_cast<float>(hash % 10000) / 10000.0f * 2.0f - 1.0f) * kPi;
+}
+
+static double NanosecondsSince(const Clock::time_point& start) {
+  return static_cast<double>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          Clock::now() - start).count());
+}
+
+static void Report(const char* benchmark, const char* processor, int count,
+                   double ns_per_impeller) {
+  printf("%s,%s,%d,%.3f\n", benchmark, processor, count, ns_per_impeller);
+}
+
+static int Repetitions(int count) {
+  const int repetitions = kUpdatesPerMeasurement / count;
+  return repetitions < 1 ? 1 : repetitions;
+}
+
+// Holds 'count' Impellers of one type, in their own engine.
+class ImpellerSet {
+ public:
+  ImpellerSet(const ImpelInit& init, int count, int num_worker_threads)
+      : impellers_(count), ids_(count), targets_(count), values_(count) {
+    engine_.SetNumWorkerThreads(num_worker_threads);
+    for (int i = 0; i < count; ++i) {
+      impellers_[i].Initialize(init, &engine_);
+      impellers_[i].SetValue(SpreadValue(i, 0));
+      impellers_[i].SetTargetTime(1000.0f);
+      ids_[i] = impellers_[i].Id();
+    }
+    processor_ = static_cast<ImpelProcessor1f*>(engine_.Processor(init.type));
+    Retarget(1);
+  }
+
+  ~ImpellerSet() {
+    // Impellers must be removed before their engine is destroyed.
+    impellers_.clear();
+    engine_.Reset();
+  }
+
+  // Give every Impeller a new target, as the game does when characters turn.
+  void Retarget(int salt) {
+    for (size_t i = 0; i < targets_.size(); ++i) {
+      targets_[i] = SpreadValue(static_cast<int>(i), salt);
+    }
+    processor_->SetTargetValues(&ids_[0], Count(), &targets_[0]);
+  }
+
+  int Count() const { return static_cast<int>(impellers_.size()); }
+  ImpelEngine& engine() { return engine_; }
+  ImpelProcessor1f& processor() { return *processor_; }
+  std::vector<Impeller1f>& impellers() { return impellers_; }
+  const std::vector<ImpelId>& ids() const { return ids_; }
+  std::vector<float>& values() { return values_; }
+
+ private:
+  ImpelEngine engine_;
+  ImpelProcessor1f* processor_;
+  std::vector<Impeller1f> impellers_;
+  std::vector<ImpelId> ids_;
+  std::vector<float> targets_;
+  std::vector<float> values_;
+};
+
+// Time ImpelEngine::AdvanceFrame(). Retargeting happens outside of the timed
+// region.
+static void BenchmarkAdvanceFrame(const char* benchmark, const char* name,
+                                  const ImpelInit& init, int count,
+                                  int num_worker_threads) {
+  ImpellerSet set(init, count, num_worker_threads);
+  const int frames = Repetitions(count);
+  double ns = 0.0;
+  for (int frame = 0; frame < frames; ++frame) {
+    if (frame % kFramesPerRetarget == 0) {
+      set.Retarget(frame + 2);
+    }
+    const Clock::time_point start = Clock::now();
+    set.engine().AdvanceFrame(kTimePerFrame);
+    ns += NanosecondsSince(start);
+  }
+  Report(benchmark, name, count, ns / (static_cast<double>(frames) * count));
+}
+
+// Time removing and re-adding a tenth of the Impellers, which exercises the
+// IdMap slot recycling and lane compaction.
+static void BenchmarkChurn(const char* name, const ImpelInit& init,
+                           int count) {
+  ImpellerSet set(init, count, 0);
+  std::vector<Impeller1f>& impellers = set.impellers();
+  const int repetitions = Repetitions(count) / 10 + 1;
+  double ns = 0.0;
+  int operations = 0;
+  for (int r = 0; r < repetitions; ++r) {
+    const Clock::time_point start = Clock::now();
+    for (int i = r % 10; i < count; i += 10) {
+      impellers[i].Invalidate();
+      operations++;
+    }
+    for (int i = r % 10; i < count; i += 10) {
+      impellers[i].Initialize(init, &set.engine());
+      operations++;
+    }
+    ns += NanosecondsSince(start);
+  }
+  Report("churn", name, count, ns / operations);
+}
+
+// Time reading every value, one virtual call at a time and in bulk.
+static void BenchmarkReads(const char* name, const ImpelInit& init,
+                           int count) {
+  ImpellerSet set(init, count, 0);
+  set.engine().AdvanceFrame(kTimePerFrame);
+  const std::vector<Impeller1f>& impellers = set.impellers();
+  std::vector<float>& values = set.values();
+  const int repetitions = Repetitions(count);
+
+  Clock::time_point start = Clock::now();
+  for (int r = 0; r < repetitions; ++r) {
+    for (int i = 0; i < count; ++i) {
+      values[i] = impellers[i].Value();
+    }
+  }
+  Report("read_single", name, count,
+         NanosecondsSince(start) / (static_cast<double>(repetitions) * count));
+
+  start = Clock::now();
+  for (int r = 0; r < repetitions; ++r) {
+    set.processor().Values(&set.ids()[0], count, &values[0]);
+  }
+  Report("read_bulk", name, count,
+         NanosecondsSince(start) / (static_cast<double>(repetitions) * count));
+}
+
+// Time saving and restoring the whole engine, as rollback would every frame.
+static void BenchmarkSnapshot(const char* name, const ImpelInit& init,
+                              int count) {
+  ImpellerSet set(init, count, 0);
+  set.engine().AdvanceFrame(kTimePerFrame);
+  ImpelSnapshot snapshot;
+  set.engine().Snapshot(&snapshot);
+  const int repetitions = Repetitions(count);
+
+  Clock::time_point start = Clock::now();
+  for (int r = 0; r < repetitions; ++r) {
+    set.engine().Snapshot(&snapshot);
+  }
+  Report("snapshot", name, count,
+         NanosecondsSince(start) / (static_cast<double>(repetitions) * count));
+
+  start = Clock::now();
+  for (int r = 0; r < repetitions; ++r) {
+    set.engine().Restore(snapshot);
+  }
+  Report("restore", name, count,
+         NanosecondsSince(start) / (static_cast<double>(repetitions) * count));
+}
+
+int main() {
+  impel::OvershootImpelProcessor::Register();
+  impel::SmoothImpelProcessor::Register();
+  impel::SmoothFixedImpelProcessor::Register();
+
+  const OvershootImpelInit overshoot_init = FaceAngleInit();
+  const SmoothImpelInit smooth_init = CameraInit();
+  const SmoothFixedImpelInit smooth_fixed_init(smooth_init);
+  const ImpelInit* inits[] = { &overshoot_init, &smooth_init,
+                               &smooth_fixed_init };
+  const char* names[] = { "overshoot", "smooth", "smooth_fixed" };
+  const int num_types = static_cast<int>(sizeof(inits) / sizeof(inits[0]));
+  const int hardware_threads =
+      static_cast<int>(std::thread::hardware_concurrency());
+  const int worker_threads = hardware_threads > 1 ? hardware_threads - 1 : 1;
+
+  printf("benchmark,processor,impellers,ns_per_impeller\n");
+  for (int type = 0; type < num_types; ++type) {
+    for (size_t c = 0; c < sizeof(kImpellerCounts) / sizeof(kImpellerCounts[0]);
+         ++c) {
+      const int count = kImpellerCounts[c];
+      BenchmarkAdvanceFrame("advance_frame", names[type], *inits[type], count,
+                            0);
+      BenchmarkAdvanceFrame("advance_frame_parallel", names[type],
+                            *inits[type], count, worker_threads);
+      BenchmarkChurn(names[type], *inits[type], count);
+      BenchmarkReads(names[type], *inits[type], count);
+      BenchmarkSnapshot(names[type], *inits[type], count);
+    }
+  }
+  return 0;
+}
@@ -20,15 +20,24 @@
 #include "flatbuffers/flatbuffers.h"
 #include "impel_processor_overshoot.h"
 #include "impel_processor_smooth.h"
+#include "impel_processor_smooth_fixed.h"
+#include "impel_snapshot.h"
 #include "mathfu/constants.h"
 #include "angle.h"
 
 using fpl::kPi;
 using impel::ImpelEngine;
+using impel::ImpelSnapshot;
 using impel::Impeller1f;
+using impel::Impeller3f;
 using impel::ImpelTime;
 using impel::OvershootImpelInit;
+using impel::OvershootImpelInit3f;
 using impel::Settled1f;
+using impel::SmoothFixedImpelInit;
+using impel::SmoothImpelInit;
+using impel::SmoothImpelInit3f;
+using mathfu::vec3;
 
 class ImpelTests : public ::testing::Test {
 protected:
@@ -36,6 +45,9 @@ protected:
   {
     impel::OvershootImpelProcessor::Register();
     impel::SmoothImpelProcessor::Register();
+    impel::OvershootImpelProcessor3f::Register();
+    impel::SmoothImpelProcessor3f::Register();
+    impel::SmoothFixedImpelProcessor::Register();
 
     // Create an OvershootImpelInit with reasonable values.
     overshoot_angle_init_.modular = true;
@@ -143,6 +155,429 @@ TEST_F(ImpelTests, StaysWithinBound) {
   EXPECT_EQ(impeller.Value(), overshoot_percent_init_.max);
 }
 
+// Ensure the smooth processor follows the same Bezier curve, to the bit, as
+// fpl::BezierCurve. Use enough impellers to exercise both the SIMD lanes and
+// the scalar remainder, and remove some of them part way through to exercise
+// the compaction of the per-lane arrays.
+TEST_F(ImpelTests, SmoothMatchesBezierCurve) {
+  static const int kNumImpellers = 13;
+  static const int kNumRemoved = 4;
+  static const ImpelTime kTimePerFrame = 16;
+  static const float kTargetTime = 500.0f;
+
+  SmoothImpelInit init;
+  init.modular = true;
+  init.min = -kPi;
+  init.max = kPi;
+
+  Impeller1f impellers[kNumImpellers];
+  impel::BezierCurve1f curves[kNumImpellers];
+  for (int i = 0; i < kNumImpellers; ++i) {
+    const float start_value = -2.0f + 0.3f * i;
+    const float start_velocity = 0.001f * (i - kNumImpellers / 2);
+    const float target_value = 2.5f - 0.35f * i;
+    impellers[i].Initialize(init, &engine_);
+    impellers[i].SetValue(start_value);
+    impellers[i].SetVelocity(start_velocity);
+    impellers[i].SetTargetValue(target_value);
+    impellers[i].SetTargetTime(kTargetTime + 10.0f * i);
+    curves[i].Initialize(start_value, start_velocity, target_value, 0.0f,
+                         0.0f, kTargetTime + 10.0f * i);
+  }
+
+  for (ImpelTime time = kTimePerFrame; time < 700; time += kTimePerFrame) {
+    engine_.AdvanceFrame(kTimePerFrame);
+    if (time == 10 * kTimePerFrame) {
+      for (int i = 0; i < kNumRemoved; ++i) {
+        impellers[i * 3].Invalidate();
+      }
+    }
+
+    for (int i = 0; i < kNumImpellers; ++i) {
+      if (!impellers[i].Valid())
+        continue;
+      const float t = static_cast<float>(time);
+      const bool at_target = t >= kTargetTime + 10.0f * i;
+      const float expected_value = at_target ? impellers[i].TargetValue() :
+                                   init.Normalize(curves[i].Evaluate(t));
+      const float expected_velocity = at_target ? 0.0f :
+                                      curves[i].Derivative(t);
+      EXPECT_EQ(expected_value, impellers[i].Value());
+      EXPECT_EQ(expected_velocity, impellers[i].Velocity());
+    }
+  }
+}
+
+// Ensure the fixed-point smooth processor follows the floating-point curves
+// to within the fixed-point resolution. More impellers than a SIMD register
+// holds, so that both the NEON and scalar paths are compared.
+TEST_F(ImpelTests, SmoothFixedMatchesFloat) {
+  static const int kNumImpellers = 7;
+  static const ImpelTime kTimePerFrame = 16;
+  static const float kTargetTime = 500.0f;
+  static const float kTolerance = 0.002f;
+
+  SmoothImpelInit init;
+  init.modular = true;
+  init.min = -kPi;
+  init.max = kPi;
+  const SmoothFixedImpelInit fixed_init(init);
+
+  Impeller1f floats[kNumImpellers];
+  Impeller1f fixeds[kNumImpellers];
+  for (int i = 0; i < kNumImpellers; ++i) {
+    floats[i].Initialize(init, &engine_);
+    fixeds[i].Initialize(fixed_init, &engine_);
+    Impeller1f* both[] = { &floats[i], &fixeds[i] };
+    for (int j = 0; j < 2; ++j) {
+      both[j]->SetValue(-2.0f + 0.6f * i);
+      both[j]->SetVelocity(0.002f * (i - kNumImpellers / 2));
+      both[j]->SetTargetValue(2.5f - 0.7f * i);
+      both[j]->SetTargetTime(kTargetTime + 20.0f * i);
+    }
+  }
+
+  for (ImpelTime time = kTimePerFrame; time < 700; time += kTimePerFrame) {
+    engine_.AdvanceFrame(kTimePerFrame);
+    for (int i = 0; i < kNumImpellers; ++i) {
+      EXPECT_NEAR(0.0f, init.Normalize(fixeds[i].Value() - floats[i].Value()),
+                  kTolerance);
+      EXPECT_NEAR(floats[i].Velocity(), fixeds[i].Velocity(), kTolerance);
+    }
+  }
+  for (int i = 0; i < kNumImpellers; ++i) {
+    EXPECT_NEAR(floats[i].TargetValue(), fixeds[i].Value(), kTolerance);
+    EXPECT_EQ(0.0f, fixeds[i].Velocity());
+  }
+}
+
+// Ensure the SIMD lanes of the overshoot processor give exactly the same
+// results as the scalar code. The first four impellers are processed by the
+// SIMD kernel (when available), and the last three, which duplicate the
+// first three, are processed by the scalar code.
+TEST_F(ImpelTests, OvershootSimdMatchesScalar) {
+  static const int kNumConfigs = 4;
+  static const int kNumDuplicates = 3;
+  static const ImpelTime kTimePerFrame = 33;
+
+  OvershootImpelInit inits[kNumConfigs] = {
+    overshoot_angle_init_, overshoot_percent_init_,
+    overshoot_angle_init_, overshoot_percent_init_
+  };
+  inits[0].max_delta_time = 10;
+  inits[1].max_delta_time = 7;
+  inits[2].max_delta_time = 0;
+  inits[3].wrong_direction_multiplier = 1.5f;
+  const float start_values[kNumConfigs] = { 3.0f, 10.0f, -3.0f, 99.0f };
+  const float target_values[kNumConfigs] = { -3.0f, 90.0f, 3.0f, 1.0f };
+
+  Impeller1f impellers[kNumConfigs + kNumDuplicates];
+  for (int i = 0; i < kNumConfigs + kNumDuplicates; ++i) {
+    const int config = i % kNumConfigs;
+    InitMagnet(inits[config], start_values[config], 0.0f,
+               target_values[config], &impellers[i]);
+  }
+
+  for (int frame = 0; frame < 100; ++frame) {
+    engine_.AdvanceFrame(kTimePerFrame);
+    for (int i = 0; i < kNumDuplicates; ++i) {
+      const Impeller1f& simd = impellers[i];
+      const Impeller1f& scalar = impellers[kNumConfigs + i];
+      EXPECT_EQ(scalar.Value(), simd.Value());
+      EXPECT_EQ(scalar.Velocity(), simd.Velocity());
+    }
+  }
+}
+
+// Ensure a copy of an impeller is detected as stale once the original has been
+// removed, even after its slot has been reused by another impeller.
+TEST_F(ImpelTests, StaleIdDetected) {
+  Impeller1f original;
+  InitMagnet(overshoot_percent_init_, 10.0f, 0.0f, 20.0f, &original);
+  Impeller1f stale(original);
+  original.Invalidate();
+  EXPECT_FALSE(stale.Valid());
+
+  // Reuse the slot. The stale copy should still be invalid, and should not
+  // be able to remove the new impeller.
+  Impeller1f replacement;
+  InitMagnet(overshoot_percent_init_, 30.0f, 0.0f, 40.0f, &replacement);
+  EXPECT_FALSE(stale.Valid());
+  stale.Invalidate();
+  EXPECT_TRUE(replacement.Valid());
+  EXPECT_EQ(30.0f, replacement.Value());
+}
+
+// Ensure removing impellers from the middle keeps every other impeller
+// mapped to its own data.
+TEST_F(ImpelTests, RemoveKeepsOtherIds) {
+  static const int kNumImpellers = 20;
+  Impeller1f impellers[kNumImpellers];
+  for (int i = 0; i < kNumImpellers; ++i) {
+    InitMagnet(overshoot_percent_init_, static_cast<float>(i), 0.0f,
+               static_cast<float>(i), &impellers[i]);
+  }
+  for (int i = 0; i < kNumImpellers; i += 3) {
+    impellers[i].Invalidate();
+  }
+  for (int i = 0; i < kNumImpellers; ++i) {
+    EXPECT_EQ(i % 3 != 0, impellers[i].Valid());
+    if (impellers[i].Valid()) {
+      EXPECT_EQ(static_cast<float>(i), impellers[i].Value());
+    }
+  }
+}
+
+// Ensure impellers created in bulk each get their own id and data, and that
+// reserving room does not create impellers.
+TEST_F(ImpelTests, InitializeManyMatchesSingle) {
+  static const int kNumImpellers = 10;
+  engine_.Reserve(OvershootImpelInit::kType, kNumImpellers);
+  impel::ImpelProcessorBase* base =
+      engine_.Processor(OvershootImpelInit::kType);
+  EXPECT_EQ(0, base->NumLanes());
+
+  impel::ImpelId ids[kNumImpellers];
+  impel::ImpelProcessor1f* processor = static_cast<impel::ImpelProcessor1f*>(
+      engine_.InitializeMany(overshoot_percent_init_, kNumImpellers, ids));
+  EXPECT_TRUE(processor == base);
+  EXPECT_EQ(kNumImpellers, processor->NumLanes());
+
+  float values[kNumImpellers];
+  for (int i = 0; i < kNumImpellers; ++i) {
+    EXPECT_TRUE(processor->ValidImpeller(ids[i]));
+    for (int j = 0; j < i; ++j) {
+      EXPECT_NE(ids[i], ids[j]);
+    }
+    values[i] = static_cast<float>(i);
+  }
+  processor->SetValues(ids, kNumImpellers, values);
+  processor->SetTargetValues(ids, kNumImpellers, values);
+
+  float read[kNumImpellers];
+  processor->Values(ids, kNumImpellers, read);
+  for (int i = 0; i < kNumImpellers; ++i) {
+    EXPECT_EQ(values[i], read[i]);
+    processor->RemoveImpeller(ids[i]);
+  }
+}
+
+// Ensure impellers at their target stop being processed, and wake up again
+// when their target changes.
+TEST_F(ImpelTests, SettledImpellersSleep) {
+  Impeller1f moving;
+  Impeller1f settled;
+  InitMagnet(overshoot_percent_init_, 10.0f, 0.0f, 90.0f, &moving);
+  InitMagnet(overshoot_percent_init_, 50.0f, 0.0f, 50.0f, &settled);
+  impel::ImpelProcessorBase* processor =
+      engine_.Processor(OvershootImpelInit::kType);
+  EXPECT_EQ(2, processor->NumLanes());
+
+  // The impeller at its target goes to sleep after one frame.
+  engine_.AdvanceFrame(10);
+  EXPECT_EQ(1, processor->NumLanes());
+  EXPECT_EQ(50.0f, settled.Value());
+
+  // Once the other impeller settles, neither is processed.
+  TimeToSettle(moving, overshoot_percent_init_.at_target);
+  EXPECT_EQ(0, processor->NumLanes());
+  EXPECT_EQ(90.0f, moving.Value());
+  EXPECT_EQ(50.0f, settled.Value());
+
+  // Changing the target wakes the impeller up.
+  settled.SetTargetValue(20.0f);
+  EXPECT_EQ(1, processor->NumLanes());
+  engine_.AdvanceFrame(10);
+  EXPECT_GT(50.0f, settled.Value());
+  EXPECT_EQ(90.0f, moving.Value());
+}
+
+// Ensure a native 3D impeller moves exactly like three 1D impellers with the
+// same parameters. One component starts at its target, so is at rest while
+// the others move.
+TEST_F(ImpelTests, Vector3MatchesScalar) {
+  static const ImpelTime kTimePerFrame = 33;
+  const vec3 start(10.0f, 80.0f, 50.0f);
+  const vec3 start_velocity(0.1f, -0.2f, 0.0f);
+  const vec3 target(90.0f, 20.0f, 50.0f);
+
+  SmoothImpelInit smooth_init;
+  Impeller3f overshoot;
+  Impeller3f smooth;
+  Impeller1f overshoot_components[3];
+  Impeller1f smooth_components[3];
+  overshoot.Initialize(OvershootImpelInit3f(overshoot_percent_init_),
+                       &engine_);
+  smooth.Initialize(SmoothImpelInit3f(smooth_init), &engine_);
+  overshoot.SetValue(start);
+  overshoot.SetTargetValue(target);
+  smooth.SetValue(start);
+  smooth.SetVelocity(start_velocity);
+  smooth.SetTargetValue(target);
+  smooth.SetTargetTime(1000.0f);
+  for (int i = 0; i < 3; ++i) {
+    InitMagnet(overshoot_percent_init_, start[i], 0.0f, target[i],
+               &overshoot_components[i]);
+    smooth_components[i].Initialize(smooth_init, &engine_);
+    smooth_components[i].SetValue(start[i]);
+    smooth_components[i].SetVelocity(start_velocity[i]);
+    smooth_components[i].SetTargetValue(target[i]);
+    smooth_components[i].SetTargetTime(1000.0f);
+  }
+
+  for (int frame = 0; frame < 100; ++frame) {
+    engine_.AdvanceFrame(kTimePerFrame);
+    for (int i = 0; i < 3; ++i) {
+      EXPECT_EQ(overshoot_components[i].Value(), overshoot.Value()[i]);
+      EXPECT_EQ(overshoot_components[i].Velocity(), overshoot.Velocity()[i]);
+      EXPECT_EQ(smooth_components[i].Value(), smooth.Value()[i]);
+      EXPECT_EQ(smooth_components[i].Velocity(), smooth.Velocity()[i]);
+    }
+  }
+  EXPECT_EQ(target[0], smooth.Value()[0]);
+}
+
+// Ensure the bulk accessors read and write the same data as the per-impeller
+// accessors, including for impellers that have gone to sleep.
+TEST_F(ImpelTests, BulkAccessorsMatchSingle) {
+  static const int kNumImpellers = 5;
+  Impeller1f impellers[kNumImpellers];
+  impel::ImpelId ids[kNumImpellers];
+  for (int i = 0; i < kNumImpellers; ++i) {
+    const float value = static_cast<float>(10 * i);
+    InitMagnet(overshoot_percent_init_, value, 0.0f, value, &impellers[i]);
+    ids[i] = impellers[i].Id();
+  }
+  engine_.AdvanceFrame(10);
+
+  impel::ImpelProcessor1f* processor = static_cast<impel::ImpelProcessor1f*>(
+      engine_.Processor(OvershootImpelInit::kType));
+  float values[kNumImpellers];
+  processor->Values(ids, kNumImpellers, values);
+  for (int i = 0; i < kNumImpellers; ++i) {
+    EXPECT_EQ(impellers[i].Value(), values[i]);
+  }
+
+  float targets[kNumImpellers];
+  for (int i = 0; i < kNumImpellers; ++i) {
+    targets[i] = 100.0f - values[i];
+  }
+  processor->SetTargetValues(ids, kNumImpellers, targets);
+  EXPECT_EQ(kNumImpellers, processor->NumLanes());
+  for (int i = 0; i < kNumImpellers; ++i) {
+    EXPECT_EQ(targets[i], impellers[i].TargetValue());
+  }
+}
+
+// Ensure stepping with worker threads gives exactly the same results as
+// stepping serially. Use enough impellers that processors are split into
+// several jobs, with a count that is not a multiple of the SIMD width.
+TEST_F(ImpelTests, ParallelMatchesSerial) {
+  static const int kNumImpellers = 1003;
+  static const ImpelTime kTimePerFrame = 33;
+
+  ImpelEngine serial_engine;
+  ImpelEngine parallel_engine;
+  parallel_engine.SetNumWorkerThreads(3);
+  EXPECT_EQ(3, parallel_engine.NumWorkerThreads());
+
+  SmoothImpelInit smooth_init;
+  smooth_init.min = 0.0f;
+  smooth_init.max = 100.0f;
+
+  std::vector<Impeller1f> serial(2 * kNumImpellers);
+  std::vector<Impeller1f> parallel(2 * kNumImpellers);
+  for (int i = 0; i < kNumImpellers; ++i) {
+    const float start = static_cast<float>(i % 100);
+    const float target = static_cast<float>((i * 7) % 100);
+    ImpelEngine* engines[] = { &serial_engine, &parallel_engine };
+    std::vector<Impeller1f>* impellers[] = { &serial, &parallel };
+    for (int e = 0; e < 2; ++e) {
+      Impeller1f& overshoot = (*impellers[e])[2 * i];
+      overshoot.Initialize(overshoot_percent_init_, engines[e]);
+      overshoot.SetValue(start);
+      overshoot.SetTargetValue(target);
+
+      Impeller1f& smooth = (*impellers[e])[2 * i + 1];
+      smooth.Initialize(smooth_init, engines[e]);
+      smooth.SetValue(start);
+      smooth.SetTargetValue(target);
+      smooth.SetTargetTime(static_cast<float>(100 + i));
+    }
+  }
+
+  for (int frame = 0; frame < 50; ++frame) {
+    serial_engine.AdvanceFrame(kTimePerFrame);
+    parallel_engine.AdvanceFrame(kTimePerFrame);
+    for (int i = 0; i < 2 * kNumImpellers; ++i) {
+      EXPECT_EQ(serial[i].Value(), parallel[i].Value());
+      EXPECT_EQ(serial[i].Velocity(), parallel[i].Velocity());
+    }
+  }
+}
+
+// Ensure that restoring a snapshot and resimulating gives exactly the same
+// results as the first simulation, including for impellers that have gone to
+// sleep or been retargeted in between.
+TEST_F(ImpelTests, SnapshotRestoreResimulates) {
+  static const int kNumImpellers = 9;
+  static const int kNumFrames = 40;
+  static const ImpelTime kTimePerFrame = 16;
+
+  SmoothImpelInit smooth_init;
+  smooth_init.min = 0.0f;
+  smooth_init.max = 100.0f;
+  const SmoothFixedImpelInit fixed_init(smooth_init);
+
+  Impeller1f impellers[3 * kNumImpellers];
+  for (int i = 0; i < kNumImpellers; ++i) {
+    InitMagnet(overshoot_angle_init_, -2.0f + 0.4f * i, 0.0f, 1.0f,
+               &impellers[3 * i]);
+    impellers[3 * i + 1].Initialize(smooth_init, &engine_);
+    impellers[3 * i + 2].Initialize(fixed_init, &engine_);
+    for (int j = 1; j < 3; ++j) {
+      impellers[3 * i + j].SetValue(10.0f * i);
+      impellers[3 * i + j].SetTargetValue(50.0f);
+      impellers[3 * i + j].SetTargetTime(100.0f + 50.0f * i);
+    }
+  }
+  for (int frame = 0; frame < 5; ++frame) {
+    engine_.AdvanceFrame(kTimePerFrame);
+  }
+
+  ImpelSnapshot snapshot;
+  engine_.Snapshot(&snapshot);
+  float saved[3 * kNumImpellers];
+  for (int i = 0; i < 3 * kNumImpellers; ++i) {
+    saved[i] = impellers[i].Value();
+  }
+
+  // Simulate, retargeting one impeller part way through, then rewind and do
+  // it again.
+  float first[kNumFrames][3 * kNumImpellers];
+  for (int pass = 0; pass < 2; ++pass) {
+    for (int frame = 0; frame < kNumFrames; ++frame) {
+      if (frame == kNumFrames / 2) {
+        impellers[4].SetTargetValue(5.0f);
+        impellers[4].SetTargetTime(200.0f);
+      }
+      engine_.AdvanceFrame(kTimePerFrame);
+      for (int i = 0; i < 3 * kNumImpellers; ++i) {
+        if (pass == 0) {
+          first[frame][i] = impellers[i].Value();
+        } else {
+          EXPECT_EQ(first[frame][i], impellers[i].Value());
+        }
+      }
+    }
+
+    engine_.Restore(snapshot);
+    for (int i = 0; i < 3 * kNumImpellers; ++i) {
+      EXPECT_EQ(saved[i], impellers[i].Value());
+    }
+  }
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
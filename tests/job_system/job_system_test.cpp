@@ -0,0 +1,140 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <atomic>
+#include <vector>
+#include "precompiled.h"
+#include "job_system.h"
+#include "gtest/gtest.h"
+
+using fpl::JobCounter;
+using fpl::JobSystem;
+
+static const int kNumWorkers = 3;
+
+static void CountRange(void* context, int begin, int end) {
+  std::vector<std::atomic<int>>& counts =
+      *static_cast<std::vector<std::atomic<int>>*>(context);
+  for (int i = begin; i < end; ++i) {
+    counts[i]++;
+  }
+}
+
+// Every index should be visited exactly once, including the remainder that
+// doesn't fill a whole grain.
+TEST(JobSystemTests, ParallelForVisitsEveryIndexOnce) {
+  JobSystem jobs(kNumWorkers);
+  std::vector<std::atomic<int>> counts(1000);
+  for (size_t i = 0; i < counts.size(); ++i) {
+    counts[i] = 0;
+  }
+  jobs.ParallelFor("count", 0, static_cast<int>(counts.size()), 7,
+                   CountRange, &counts);
+  for (size_t i = 0; i < counts.size(); ++i) {
+    EXPECT_EQ(1, counts[i].load());
+  }
+}
+
+struct Stages {
+  std::atomic<int> stage;
+  std::atomic<bool> in_order;
+};
+
+static void FirstStage(void* context) {
+  Stages* stages = static_cast<Stages*>(context);
+  stages->stage++;
+}
+
+static void SecondStage(void* context) {
+  Stages* stages = static_cast<Stages*>(context);
+  if (stages->stage.load() != 10) stages->in_order = false;
+}
+
+// A job submitted after a counter should only start once every job counted
+// by it has finished, even from a thread that isn't a worker.
+TEST(JobSystemTests, SubmitAfterWaitsForDependencies) {
+  JobSystem jobs(kNumWorkers);
+  Stages stages;
+  stages.stage = 0;
+  stages.in_order = true;
+  JobCounter first;
+  JobCounter second;
+  for (int i = 0; i < 10; ++i) {
+    jobs.Submit("first", FirstStage, &stages, &first);
+  }
+  jobs.SubmitAfter(&first, "second", SecondStage, &stages, &second);
+  jobs.Wait(&second);
+  EXPECT_TRUE(first.Done());
+  EXPECT_TRUE(stages.in_order.load());
+
+  // Dependencies that are already done don't hold the job back.
+  jobs.SubmitAfter(&first, "second", SecondStage, &stages, &second);
+  jobs.Wait(&second);
+  EXPECT_TRUE(stages.in_order.load());
+}
+
+struct NestedSum {
+  JobSystem* jobs;
+  std::atomic<int> sum;
+};
+
+static void AddRange(void* context, int begin, int end) {
+  NestedSum* nested = static_cast<NestedSum*>(context);
+  for (int i = begin; i < end; ++i) {
+    nested->sum += i;
+  }
+}
+
+static void NestedParallelFor(void* context, int begin, int end) {
+  NestedSum* nested = static_cast<NestedSum*>(context);
+  for (int i = begin; i < end; ++i) {
+    nested->jobs->ParallelFor("inner", 0, 100, 10, AddRange, nested);
+  }
+}
+
+// Jobs can wait for jobs of their own, without deadlocking the workers.
+TEST(JobSystemTests, NestedParallelFor) {
+  JobSystem jobs(kNumWorkers);
+  NestedSum nested;
+  nested.jobs = &jobs;
+  nested.sum = 0;
+  jobs.ParallelFor("outer", 0, 20, 1, NestedParallelFor, &nested);
+  EXPECT_EQ(20 * (99 * 100 / 2), nested.sum.load());
+}
+
+static void Increment(void* context) {
+  (*static_cast<std::atomic<int>*>(context))++;
+}
+
+// Background jobs are only run by the workers, but they do run.
+TEST(JobSystemTests, BackgroundJobsRun) {
+  JobSystem jobs(1);
+  std::atomic<int> count(0);
+  JobCounter done;
+  for (int i = 0; i < 5; ++i) {
+    jobs.Submit("background", Increment, &count, &done,
+                JobSystem::kBackground);
+  }
+  jobs.Wait(&done);
+  EXPECT_EQ(5, count.load());
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,127 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "ktx.h"
+#include "gtest/gtest.h"
+
+using fpl::KtxImage;
+using fpl::ParseKtx;
+
+static void PushUint32(uint32_t value, bool big_endian,
+                       std::vector<uint8_t>* file) {
+  for (int i = 0; i < 4; ++i) {
+    const int shift = big_endian ? 24 - 8 * i : 8 * i;
+    file->push_back(static_cast<uint8_t>(value >> shift));
+  }
+}
+
+// Build a KTX file of an ETC2 texture with 'num_levels' mips. Each level
+// is filled with its level number.
+static std::vector<uint8_t> MakeKtx(int width, int height, int num_levels,
+                                    bool big_endian) {
+  static const uint8_t kIdentifier[12] = {
+    0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+  };
+  std::vector<uint8_t> file(kIdentifier, kIdentifier + sizeof(kIdentifier));
+  const uint32_t header[] = {
+    0x04030201, 0, 1, 0, fpl::kKtxFormatEtc2Rgba8, 0x1908,
+    static_cast<uint32_t>(width), static_cast<uint32_t>(height), 0, 0, 1,
+    static_cast<uint32_t>(num_levels), 8
+  };
+  for (size_t i = 0; i < sizeof(header) / sizeof(header[0]); ++i) {
+    PushUint32(header[i], big_endian, &file);
+  }
+  // Key/value data, which should be skipped.
+  PushUint32(4, big_endian, &file);
+  PushUint32(0xFFFFFFFF, big_endian, &file);
+
+  for (int level = 0; level < num_levels; ++level) {
+    const int w = std::max(width >> level, 1);
+    const int h = std::max(height >> level, 1);
+    // 16 bytes for each 4x4 block. Always a multiple of four.
+    const uint32_t size = ((w + 3) / 4) * ((h + 3) / 4) * 16;
+    PushUint32(size, big_endian, &file);
+    file.insert(file.end(), size, static_cast<uint8_t>(level));
+  }
+  return file;
+}
+
+// A texture with a complete mip chain has a level for each size, down
+// to 1x1, and each level's offset points at its data.
+TEST(KtxTests, MipChain) {
+  const std::vector<uint8_t> file = MakeKtx(16, 8, 5, false);
+  KtxImage image;
+  EXPECT_TRUE(ParseKtx(&file[0], file.size(), &image));
+  EXPECT_EQ(static_cast<uint32_t>(fpl::kKtxFormatEtc2Rgba8),
+            image.internal_format);
+  EXPECT_TRUE(image.HasAlpha());
+  EXPECT_EQ(16, image.width);
+  EXPECT_EQ(8, image.height);
+  ASSERT_EQ(5u, image.levels.size());
+  const int widths[] = { 16, 8, 4, 2, 1 };
+  const int heights[] = { 8, 4, 2, 1, 1 };
+  for (size_t i = 0; i < image.levels.size(); ++i) {
+    const KtxImage::Level& level = image.levels[i];
+    EXPECT_EQ(widths[i], level.width);
+    EXPECT_EQ(heights[i], level.height);
+    EXPECT_LE(level.offset + level.size, file.size());
+    EXPECT_EQ(static_cast<uint8_t>(i), file[level.offset]);
+    EXPECT_EQ(static_cast<uint8_t>(i), file[level.offset + level.size - 1]);
+  }
+}
+
+// Files written on big-endian machines are swapped on load.
+TEST(KtxTests, BigEndian) {
+  const std::vector<uint8_t> file = MakeKtx(8, 8, 4, true);
+  KtxImage image;
+  EXPECT_TRUE(ParseKtx(&file[0], file.size(), &image));
+  EXPECT_EQ(static_cast<uint32_t>(fpl::kKtxFormatEtc2Rgba8),
+            image.internal_format);
+  EXPECT_EQ(8, image.width);
+  ASSERT_EQ(4u, image.levels.size());
+  EXPECT_EQ(64u, image.levels[0].size);
+  EXPECT_EQ(3, file[image.levels[3].offset]);
+}
+
+// Truncated files, and files that aren't KTX, are rejected.
+TEST(KtxTests, Invalid) {
+  std::vector<uint8_t> file = MakeKtx(8, 8, 4, false);
+  KtxImage image;
+  EXPECT_FALSE(ParseKtx(&file[0], 10, &image));
+  EXPECT_FALSE(ParseKtx(&file[0], file.size() - 1, &image));
+
+  file[1] = 'X';
+  EXPECT_FALSE(ParseKtx(&file[0], file.size(), &image));
+}
+
+// Uncompressed textures have a non-zero glType, and aren't supported.
+TEST(KtxTests, Uncompressed) {
+  std::vector<uint8_t> file = MakeKtx(8, 8, 1, false);
+  file[16] = 0x01;  // glType = GL_BYTE.
+  file[17] = 0x14;
+  KtxImage image;
+  EXPECT_FALSE(ParseKtx(&file[0], file.size(), &image));
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,75 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include "precompiled.h"
+#include "mapped_file.h"
+#include "gtest/gtest.h"
+
+using fpl::MappedFile;
+
+static const char kFileName[] = "mapped_file_test.bin";
+static const char kContents[] = "mapped file contents";
+
+class MappedFileTests : public ::testing::Test {
+protected:
+  virtual void SetUp() {
+    FILE* file = fopen(kFileName, "wb");
+    ASSERT_TRUE(file != nullptr);
+    fwrite(kContents, 1, sizeof(kContents) - 1, file);
+    fclose(file);
+  }
+  virtual void TearDown() { remove(kFileName); }
+};
+
+// The whole file is visible, without a terminator.
+TEST_F(MappedFileTests, MapsWholeFile) {
+  MappedFile file;
+  EXPECT_TRUE(file.Open(kFileName));
+  EXPECT_EQ(sizeof(kContents) - 1, file.size());
+  EXPECT_EQ(0, memcmp(kContents, file.data(), file.size()));
+}
+
+// Close() and failed opens leave the file empty.
+TEST_F(MappedFileTests, EmptyWhenClosed) {
+  MappedFile file;
+  EXPECT_TRUE(file.empty());
+  EXPECT_TRUE(file.Open(kFileName));
+  file.Close();
+  EXPECT_TRUE(file.empty());
+  EXPECT_TRUE(file.data() == nullptr);
+  EXPECT_TRUE(file.Open(kFileName));
+  EXPECT_FALSE(file.OpenOptional("mapped_file_test_missing.bin"));
+  EXPECT_TRUE(file.empty());
+}
+
+// Empty files can't be mapped, and are treated as missing, as with
+// LoadFile().
+TEST_F(MappedFileTests, EmptyFileFails) {
+  FILE* empty = fopen(kFileName, "wb");
+  ASSERT_TRUE(empty != nullptr);
+  fclose(empty);
+  MappedFile file;
+  EXPECT_FALSE(file.OpenOptional(kFileName));
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
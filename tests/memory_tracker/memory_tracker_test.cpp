@@ -0,0 +1,92 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <vector>
+
+#include "memory_tracker.h"
+#include "gtest/gtest.h"
+
+using fpl::CurrentMemory;
+using fpl::CurrentMemoryTotal;
+using fpl::PeakMemory;
+using fpl::PeakMemoryTotal;
+using fpl::ResetMemoryPeaks;
+using fpl::TrackedMemory;
+using fpl::TrackMemory;
+using fpl::VectorMemory;
+
+class MemoryTrackerTests : public ::testing::Test {
+protected:
+  virtual void SetUp() { ResetMemoryPeaks(); }
+  virtual void TearDown() {}
+};
+
+// The current total follows the allocations, and the peak remembers the
+// most there has been.
+TEST_F(MemoryTrackerTests, CurrentAndPeak) {
+  TrackMemory(fpl::kMemoryMeshes, 100);
+  TrackMemory(fpl::kMemoryMeshes, 50);
+  TrackMemory(fpl::kMemoryMeshes, -120);
+  TrackMemory(fpl::kMemorySounds, 10);
+  EXPECT_EQ(30u, CurrentMemory(fpl::kMemoryMeshes));
+  EXPECT_EQ(150u, PeakMemory(fpl::kMemoryMeshes));
+  EXPECT_EQ(10u, CurrentMemory(fpl::kMemorySounds));
+  EXPECT_EQ(40u, CurrentMemoryTotal());
+  EXPECT_EQ(150u, PeakMemoryTotal());
+
+  ResetMemoryPeaks();
+  EXPECT_EQ(30u, PeakMemory(fpl::kMemoryMeshes));
+  EXPECT_EQ(40u, PeakMemoryTotal());
+
+  TrackMemory(fpl::kMemoryMeshes, -30);
+  TrackMemory(fpl::kMemorySounds, -10);
+  EXPECT_EQ(0u, CurrentMemoryTotal());
+}
+
+// TrackedMemory counts its bytes until it is destroyed, and its copies
+// count them again.
+TEST_F(MemoryTrackerTests, TrackedMemory) {
+  {
+    TrackedMemory memory(fpl::kMemoryScene);
+    memory.Set(64);
+    EXPECT_EQ(64u, CurrentMemory(fpl::kMemoryScene));
+    memory.Set(16);
+    EXPECT_EQ(16u, CurrentMemory(fpl::kMemoryScene));
+    EXPECT_EQ(64u, PeakMemory(fpl::kMemoryScene));
+
+    TrackedMemory copy(memory);
+    EXPECT_EQ(32u, CurrentMemory(fpl::kMemoryScene));
+    TrackedMemory assigned(fpl::kMemoryImpel);
+    assigned.Set(8);
+    assigned = memory;
+    EXPECT_EQ(48u, CurrentMemory(fpl::kMemoryScene));
+    EXPECT_EQ(0u, CurrentMemory(fpl::kMemoryImpel));
+  }
+  EXPECT_EQ(0u, CurrentMemory(fpl::kMemoryScene));
+}
+
+TEST_F(MemoryTrackerTests, VectorMemory) {
+  std::vector<int> ints;
+  ints.reserve(10);
+  EXPECT_EQ(ints.capacity() * sizeof(int), VectorMemory(ints));
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
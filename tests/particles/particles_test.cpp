@@ -0,0 +1,127 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "precompiled.h"
+#include "job_system.h"
+#include "particles.h"
+#include "gtest/gtest.h"
+
+using fpl::JobSystem;
+using fpl::pie_noon::ParticleManager;
+using fpl::pie_noon::ParticleSpawnDef;
+
+static const int kNumWorkers = 3;
+static const uint32_t kSeed = 1234;
+
+// Several grains, and a remainder that doesn't fill one.
+static const int kBurstSize = ParticleManager::kSpawnGrain * 4 + 17;
+
+// Every property is drawn from a range, so that each one comes from the Rng.
+static ParticleSpawnDef RandomDef() {
+  ParticleSpawnDef def;
+  def.min_scale = mathfu::vec3(0.5f, 0.5f, 0.5f);
+  def.max_scale = mathfu::vec3(2.0f, 3.0f, 4.0f);
+  def.min_velocity = mathfu::vec3(-1.0f, 0.0f, -1.0f);
+  def.max_velocity = mathfu::vec3(1.0f, 5.0f, 1.0f);
+  def.acceleration = mathfu::vec3(0.0f, -9.8f, 0.0f);
+  def.min_position_offset = mathfu::vec3(-0.5f, -0.5f, -0.5f);
+  def.max_position_offset = mathfu::vec3(0.5f, 0.5f, 0.5f);
+  def.min_orientation_offset = mathfu::vec3(0.0f, 0.0f, 0.0f);
+  def.max_orientation_offset = mathfu::vec3(1.0f, 2.0f, 3.0f);
+  def.min_angular_velocity = mathfu::vec3(-1.0f, -1.0f, -1.0f);
+  def.max_angular_velocity = mathfu::vec3(1.0f, 1.0f, 1.0f);
+  def.min_duration = 500;
+  def.max_duration = 1500;
+  def.fade_duration = 200.0f;
+  def.shrink_duration = 300.0f;
+  def.renderable_ids.push_back(1);
+  def.renderable_ids.push_back(2);
+  def.tints.push_back(mathfu::vec4(1.0f, 0.0f, 0.0f, 0.5f));
+  return def;
+}
+
+static void ExpectVec3Eq(const mathfu::vec3& a, const mathfu::vec3& b) {
+  EXPECT_EQ(a.x(), b.x());
+  EXPECT_EQ(a.y(), b.y());
+  EXPECT_EQ(a.z(), b.z());
+}
+
+static void ExpectVec4Eq(const mathfu::vec4& a, const mathfu::vec4& b) {
+  EXPECT_EQ(a.x(), b.x());
+  EXPECT_EQ(a.y(), b.y());
+  EXPECT_EQ(a.z(), b.z());
+  EXPECT_EQ(a.w(), b.w());
+}
+
+// The same def and seed should spawn the same particles whether the burst
+// is filled serially or spread over a JobSystem.
+TEST(ParticlesTests, SpawnParticlesMatchesSerial) {
+  const ParticleSpawnDef def = RandomDef();
+  const mathfu::vec3 position(1.0f, 2.0f, 3.0f);
+  const mathfu::vec4 tint(0.5f, 1.0f, 1.0f, 1.0f);
+
+  ParticleManager serial;
+  EXPECT_EQ(kBurstSize, serial.SpawnParticles(def, position, tint, kSeed,
+                                              kBurstSize, nullptr));
+  JobSystem jobs(kNumWorkers);
+  ParticleManager parallel;
+  EXPECT_EQ(kBurstSize, parallel.SpawnParticles(def, position, tint, kSeed,
+                                                kBurstSize, &jobs));
+
+  // Age them a little, so that velocity and acceleration show up in the
+  // positions.
+  serial.AdvanceFrame(100.0f);
+  parallel.AdvanceFrame(100.0f);
+  ASSERT_EQ(serial.Count(), parallel.Count());
+  for (int i = 0; i < serial.Count(); ++i) {
+    EXPECT_EQ(serial.renderable_id(i), parallel.renderable_id(i));
+    EXPECT_EQ(serial.duration(i), parallel.duration(i));
+    ExpectVec3Eq(serial.CurrentPosition(i), parallel.CurrentPosition(i));
+    ExpectVec3Eq(serial.CurrentVelocity(i), parallel.CurrentVelocity(i));
+    ExpectVec3Eq(serial.CurrentScale(i), parallel.CurrentScale(i));
+    ExpectVec4Eq(serial.CurrentTint(i), parallel.CurrentTint(i));
+    const mathfu::mat4 a = serial.CalculateMatrix(i);
+    const mathfu::mat4 b = parallel.CalculateMatrix(i);
+    for (int j = 0; j < 16; ++j) {
+      EXPECT_EQ(a[j], b[j]);
+    }
+  }
+}
+
+// A different seed should give a different burst, so the test above isn't
+// passing on particles that are all alike.
+TEST(ParticlesTests, SeedChangesParticles) {
+  const ParticleSpawnDef def = RandomDef();
+  const mathfu::vec3 position(0.0f, 0.0f, 0.0f);
+  const mathfu::vec4 tint(1.0f, 1.0f, 1.0f, 1.0f);
+
+  ParticleManager first;
+  first.SpawnParticles(def, position, tint, kSeed, kBurstSize, nullptr);
+  ParticleManager second;
+  second.SpawnParticles(def, position, tint, kSeed + 1, kBurstSize, nullptr);
+  int differing = 0;
+  for (int i = 0; i < first.Count(); ++i) {
+    if (first.duration(i) != second.duration(i)) ++differing;
+  }
+  EXPECT_GT(differing, 0);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,338 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+// Measures GameState::AdvanceFrame() and GameState::PopulateScene() in
+// synthetic stress scenes, with more characters, airborne pies and particles
+// than a real match has. Used to compare data layout, batching and threading
+// changes between builds, on desktop and on device.
+//
+// Usage: pie_noon_benchmarks [characters pies particles [frames]]
+//
+// With no arguments, a fixed set of scenes is measured. Results are written
+// to stdout as JSON, one object per measurement.
+
+#include "precompiled.h"
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+#include "ai_controller.h"
+#include "asset_archive.h"
+#include "character_state_machine.h"
+#include "character_state_machine_def_generated.h"
+#include "config_generated.h"
+#include "game_state.h"
+#include "impel_processor_overshoot.h"
+#include "impel_processor_smooth.h"
+#include "impel_processor_smooth_fixed.h"
+#include "mapped_file.h"
+#include "rng.h"
+#include "runtime_config.h"
+#include "scene_description.h"
+#include "utilities.h"
+
+using fpl::WorldTime;
+using fpl::pie_noon::AiController;
+using fpl::pie_noon::Character;
+using fpl::pie_noon::CharacterStateMachineDef;
+using fpl::pie_noon::Config;
+using fpl::pie_noon::GameState;
+using fpl::pie_noon::Particle;
+using fpl::pie_noon::ParticleManager;
+using fpl::pie_noon::RuntimeConfig;
+using fpl::SceneDescription;
+using mathfu::vec3;
+using mathfu::vec4;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static const char kAssetsDir[] = "assets";
+static const char kConfigFileName[] = "config.bin";
+static const char kStateMachineFileName[] = "character_state_machine_def.bin";
+static const char kDataArchiveFileName[] = "data.pak";
+
+// Frames per measurement, and how many of them run first untimed, so that
+// every pool has grown to its final size.
+static const int kDefaultFrames = 2000;
+static const int kWarmupFrames = 100;
+
+// Same step as a 60Hz game.
+static const WorldTime kStep = 16;
+
+// Seeds every scene, so that runs are repeatable.
+static const uint32_t kSeed = 1;
+
+// Pies and particles that outlive any benchmark, so that the counts stay
+// where they are put.
+static const WorldTime kStressPieFlightTime = 1000 * 1000 * 1000;
+static const float kStressParticleDuration = 1e9f;
+
+struct SceneCounts {
+  int characters;
+  int pies;
+  int particles;
+};
+
+// Large lobbies, where the characters stand in the config's arena layout.
+static const int kLobbySizes[] = { 16, 32, 64 };
+static const int kMaxLobbySize = 64;
+
+// Most characters the config's hand-made arrangements can place.
+static int MaxArrangedCharacters(const Config& config) {
+  unsigned int max = 0;
+  for (unsigned int i = 0; i < config.character_arrangements()->Length();
+       ++i) {
+    max = std::max(max, config.character_arrangements()->Get(i)->
+                            character_data()->Length());
+  }
+  return static_cast<int>(max);
+}
+
+static double NanosecondsSince(const Clock::time_point& start) {
+  return static_cast<double>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          Clock::now() - start).count());
+}
+
+// A GameState of AI characters, which are kept alive and kept surrounded by
+// the requested number of pies and particles.
+class StressScene {
+ public:
+  StressScene(const Config& config,
+              const CharacterStateMachineDef* state_machine_def,
+              const SceneCounts& counts)
+      : config_(config), counts_(counts), gpu_particles_reset_(false) {
+    runtime_config_.Initialize(config);
+    game_state_.set_config(&config, &runtime_config_);
+    for (int i = 0; i < counts.characters; ++i) {
+      AiController* controller = new AiController();
+      controllers_.push_back(std::unique_ptr<AiController>(controller));
+      game_state_.characters().push_back(std::unique_ptr<Character>(
+          new Character(i, controller, config, state_machine_def, nullptr)));
+      controller->Initialize(&game_state_, &config, i);
+    }
+    game_state_.Reset();
+    game_state_.rng().Seed(kSeed);
+    rng_.Seed(kSeed);
+    for (size_t i = 0; i < controllers_.size(); ++i) {
+      controllers_[i]->Seed(i);
+    }
+  }
+
+  // Restore the requested counts, and let the controllers decide. Not
+  // timed.
+  void Prepare() {
+    auto& characters = game_state_.characters();
+    for (size_t i = 0; i < characters.size(); ++i) {
+      characters[i]->set_health(config_.character_health());
+    }
+    AddPies();
+    AddParticles();
+    for (size_t i = 0; i < controllers_.size(); ++i) {
+      controllers_[i]->AdvanceFrame(kStep);
+    }
+  }
+
+  void AdvanceFrame() {
+    game_state_.AdvanceFrame(kStep, nullptr);
+    gpu_particle_spawns_.clear();
+    game_state_.MoveGpuParticleSpawns(&gpu_particle_spawns_,
+                                      &gpu_particles_reset_);
+  }
+
+  void PopulateScene() { game_state_.PopulateScene(&scene_, 1.0f); }
+
+  int num_props() const {
+    return static_cast<int>(config_.props()->Length());
+  }
+
+ private:
+  // Pies fly between neighbors, and never land.
+  void AddPies() {
+    auto& pies = game_state_.pies();
+    const int num_characters = counts_.characters;
+    while (pies.Count() < counts_.pies) {
+      const int source = pies.Count() % num_characters;
+      const int target = (source + 1) % num_characters;
+      pies.Add(source, source, target, game_state_.time(),
+               kStressPieFlightTime, 1, 2.0f, 1);
+    }
+  }
+
+  // Confetti that never fades, spread over the stage.
+  void AddParticles() {
+    ParticleManager& particles = game_state_.particle_manager();
+    const auto confetti = config_.confetti_def();
+    Particle particle;
+    while (particles.Count() < counts_.particles && !particles.Full()) {
+      particle.set_base_position(vec3(rng_.FloatInRange(-10.0f, 10.0f),
+                                      rng_.FloatInRange(0.0f, 10.0f),
+                                      rng_.FloatInRange(-10.0f, 10.0f)));
+      particle.set_base_velocity(vec3(0.0f, 0.0f, 0.0f));
+      particle.set_rotational_velocity(vec3(0.0f, 0.0f, 0.01f));
+      particle.set_base_scale(vec3(0.1f, 0.1f, 0.1f));
+      particle.set_base_tint(vec4(1.0f, 1.0f, 1.0f, 1.0f));
+      particle.set_renderable_id(static_cast<uint16_t>(
+          confetti->renderable()->Get(rng_.IntInRange(
+              0, confetti->renderable()->size()))));
+      particle.set_duration(kStressParticleDuration);
+      particles.AddParticle(particle);
+    }
+  }
+
+  const Config& config_;
+  SceneCounts counts_;
+  RuntimeConfig runtime_config_;
+  fpl::Rng rng_;
+
+  // Declared before game_state_, since the characters refer to them.
+  std::vector<std::unique_ptr<AiController>> controllers_;
+  GameState game_state_;
+  SceneDescription scene_;
+  std::vector<fpl::pie_noon::GpuParticleSpawn> gpu_particle_spawns_;
+  bool gpu_particles_reset_;
+};
+
+static void Report(const char* benchmark, const SceneCounts& counts,
+                   int props, int frames, double ns_per_frame,
+                   bool* first) {
+  printf("%s  {\"benchmark\":\"%s\",\"characters\":%d,\"pies\":%d,"
+         "\"particles\":%d,\"props\":%d,\"frames\":%d,"
+         "\"ns_per_frame\":%.1f}", *first ? "" : ",\n", benchmark,
+         counts.characters, counts.pies, counts.particles, props, frames,
+         ns_per_frame);
+  *first = false;
+}
+
+static void Benchmark(const Config& config,
+                      const CharacterStateMachineDef* state_machine_def,
+                      const SceneCounts& counts, int frames, bool* first) {
+  StressScene scene(config, state_machine_def, counts);
+  for (int frame = 0; frame < kWarmupFrames; ++frame) {
+    scene.Prepare();
+    scene.AdvanceFrame();
+    scene.PopulateScene();
+  }
+
+  double advance_ns = 0.0;
+  double populate_ns = 0.0;
+  for (int frame = 0; frame < frames; ++frame) {
+    scene.Prepare();
+    Clock::time_point start = Clock::now();
+    scene.AdvanceFrame();
+    advance_ns += NanosecondsSince(start);
+    start = Clock::now();
+    scene.PopulateScene();
+    populate_ns += NanosecondsSince(start);
+  }
+  Report("advance_frame", counts, scene.num_props(), frames,
+         advance_ns / frames, first);
+  Report("populate_scene", counts, scene.num_props(), frames,
+         populate_ns / frames, first);
+}
+
+int main(int argc, char *argv[]) {
+  const char* binary_directory = argc > 0 ? argv[0] : "";
+  if (argc != 1 && argc != 4 && argc != 5) {
+    fprintf(stderr, "usage: %s [characters pies particles [frames]]\n",
+            binary_directory);
+    return 1;
+  }
+
+  // Only show problems.
+  SDL_LogSetAllPriority(SDL_LOG_PRIORITY_WARN);
+
+  if (!fpl::ChangeToUpstreamDir(binary_directory, kAssetsDir))
+    return 1;
+  fpl::MountAssetArchive(kDataArchiveFileName);
+
+  fpl::MappedFile config_file;
+  if (!config_file.Open(kConfigFileName)) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "can't load %s\n", kConfigFileName);
+    return 1;
+  }
+  const Config* config = fpl::pie_noon::GetConfig(config_file.data());
+
+  fpl::MappedFile state_machine_file;
+  if (!state_machine_file.Open(kStateMachineFileName)) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR,
+                 "Error loading character state machine.\n");
+    return 1;
+  }
+  const CharacterStateMachineDef* state_machine_def =
+      fpl::pie_noon::GetCharacterStateMachineDef(state_machine_file.data());
+  if (!fpl::pie_noon::CharacterStateMachineDef_Validate(state_machine_def)) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "State machine is invalid.\n");
+    return 1;
+  }
+
+  impel::OvershootImpelProcessor::Register();
+  impel::SmoothImpelProcessor::Register();
+  impel::SmoothImpelProcessor3f::Register();
+  impel::SmoothFixedImpelProcessor::Register();
+
+  // A normal match, a busy one, the most a hand-made arrangement holds, and
+  // large lobbies with a pie in the air for every character.
+  const int max_characters = MaxArrangedCharacters(*config);
+  const int num_characters = static_cast<int>(config->character_count());
+  std::vector<SceneCounts> scenes;
+  int frames = kDefaultFrames;
+  if (argc == 1) {
+    const SceneCounts normal = { num_characters, 0, 0 };
+    const SceneCounts busy = { num_characters, 32,
+                               ParticleManager::kMaxParticles / 4 };
+    const SceneCounts full = { max_characters, 256,
+                               ParticleManager::kMaxParticles };
+    scenes.push_back(normal);
+    scenes.push_back(busy);
+    scenes.push_back(full);
+    for (size_t i = 0; i < sizeof(kLobbySizes) / sizeof(kLobbySizes[0]);
+         ++i) {
+      const SceneCounts lobby = { kLobbySizes[i], kLobbySizes[i],
+                                  ParticleManager::kMaxParticles / 4 };
+      scenes.push_back(lobby);
+    }
+  } else {
+    const SceneCounts counts = { atoi(argv[1]), atoi(argv[2]),
+                                 atoi(argv[3]) };
+    scenes.push_back(counts);
+    if (argc == 5) frames = atoi(argv[4]);
+  }
+
+  for (size_t i = 0; i < scenes.size(); ++i) {
+    const SceneCounts& counts = scenes[i];
+    if (counts.characters < 2 || counts.characters > kMaxLobbySize ||
+        counts.pies < 0 || counts.particles < 0 ||
+        counts.particles > ParticleManager::kMaxParticles || frames <= 0) {
+      fprintf(stderr, "characters must be in [2, %d], particles in [0, %d], "
+              "pies at least 0, and frames at least 1\n", kMaxLobbySize,
+              ParticleManager::kMaxParticles);
+      return 1;
+    }
+  }
+
+  bool first = true;
+  printf("[\n");
+  for (size_t i = 0; i < scenes.size(); ++i) {
+    Benchmark(*config, state_machine_def, scenes[i], frames, &first);
+  }
+  printf("\n]\n");
+  return 0;
+}
+
+MATHFU_DEFINE_GLOBAL_SIMD_AWARE_NEW_DELETE
@@ -0,0 +1,84 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <vector>
+#include "pixel_conversion.h"
+#include "gtest/gtest.h"
+
+// Enough pixels to run the SIMD loops several times, and an odd count so
+// that the scalar code finishes some.
+static const size_t kNumPixels = 77;
+
+// Every byte value appears, in a different channel each time.
+static std::vector<uint8_t> TestPixels(size_t bytes_per_pixel) {
+  std::vector<uint8_t> pixels(kNumPixels * bytes_per_pixel);
+  for (size_t i = 0; i < pixels.size(); ++i) {
+    pixels[i] = static_cast<uint8_t>(i * 37 + 11);
+  }
+  return pixels;
+}
+
+TEST(PixelConversionTests, BgrToRgb) {
+  const std::vector<uint8_t> src = TestPixels(3);
+  std::vector<uint8_t> dest(src.size());
+  fpl::ConvertBgrToRgb(&src[0], &dest[0], kNumPixels);
+  for (size_t i = 0; i < kNumPixels; ++i) {
+    EXPECT_EQ(src[i * 3 + 2], dest[i * 3 + 0]);
+    EXPECT_EQ(src[i * 3 + 1], dest[i * 3 + 1]);
+    EXPECT_EQ(src[i * 3 + 0], dest[i * 3 + 2]);
+  }
+}
+
+TEST(PixelConversionTests, BgraToRgba) {
+  const std::vector<uint8_t> src = TestPixels(4);
+  std::vector<uint8_t> dest(src.size());
+  fpl::ConvertBgraToRgba(&src[0], &dest[0], kNumPixels);
+  for (size_t i = 0; i < kNumPixels; ++i) {
+    EXPECT_EQ(src[i * 4 + 2], dest[i * 4 + 0]);
+    EXPECT_EQ(src[i * 4 + 1], dest[i * 4 + 1]);
+    EXPECT_EQ(src[i * 4 + 0], dest[i * 4 + 2]);
+    EXPECT_EQ(src[i * 4 + 3], dest[i * 4 + 3]);
+  }
+}
+
+TEST(PixelConversionTests, RgbaTo5551) {
+  const std::vector<uint8_t> src = TestPixels(4);
+  std::vector<uint16_t> dest(kNumPixels);
+  fpl::ConvertRgbaTo5551(&src[0], &dest[0], kNumPixels);
+  for (size_t i = 0; i < kNumPixels; ++i) {
+    const uint8_t *c = &src[i * 4];
+    EXPECT_EQ(((c[0] >> 3) << 11) | ((c[1] >> 3) << 6) | ((c[2] >> 3) << 1) |
+              (c[3] >> 7), dest[i]);
+  }
+}
+
+TEST(PixelConversionTests, RgbTo565) {
+  const std::vector<uint8_t> src = TestPixels(3);
+  std::vector<uint16_t> dest(kNumPixels);
+  fpl::ConvertRgbTo565(&src[0], &dest[0], kNumPixels);
+  for (size_t i = 0; i < kNumPixels; ++i) {
+    const uint8_t *c = &src[i * 3];
+    EXPECT_EQ(((c[0] >> 3) << 11) | ((c[1] >> 2) << 5) | (c[2] >> 3),
+              dest[i]);
+  }
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
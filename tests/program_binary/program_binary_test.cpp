@@ -0,0 +1,95 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <cstring>
+#include <string>
+#include "program_binary.h"
+#include "gtest/gtest.h"
+
+using fpl::PackProgramBinary;
+using fpl::ProgramBinaryFileName;
+using fpl::ProgramBinaryKey;
+using fpl::UnpackProgramBinary;
+
+static const char kDriver[] = "Vendor Renderer 1.0";
+static const char kAttributes[] = "0 aPosition\n3 aTexCoord\n";
+static const char kVertexShader[] = "void main() { gl_Position = vec4(0); }";
+static const char kFragmentShader[] = "void main() { gl_FragColor = vec4(1); }";
+static const uint8_t kBinary[] = { 1, 2, 3, 4, 5, 6, 7 };
+static const uint32_t kFormat = 0x8741;
+
+// Any change to the source, the attribute bindings or the driver changes
+// the key.
+TEST(ProgramBinaryTests, Key) {
+  const uint64_t key = ProgramBinaryKey(kDriver, kAttributes, kVertexShader,
+                                        kFragmentShader);
+  EXPECT_EQ(key, ProgramBinaryKey(kDriver, kAttributes, kVertexShader,
+                                  kFragmentShader));
+  EXPECT_NE(key, ProgramBinaryKey("Vendor Renderer 1.1", kAttributes,
+                                  kVertexShader, kFragmentShader));
+  EXPECT_NE(key, ProgramBinaryKey(kDriver, "0 aPosition\n4 aTexCoord\n",
+                                  kVertexShader, kFragmentShader));
+  EXPECT_NE(key, ProgramBinaryKey(kDriver, kAttributes, kFragmentShader,
+                                  kVertexShader));
+  EXPECT_NE(ProgramBinaryKey("a", "", "bc", ""),
+            ProgramBinaryKey("a", "", "b", "c"));
+}
+
+TEST(ProgramBinaryTests, FileName) {
+  EXPECT_EQ(std::string("shader_0123456789abcdef.bin"),
+            ProgramBinaryFileName(0x0123456789abcdefULL));
+}
+
+// A packed binary unpacks to the same bytes, even with a terminator added.
+TEST(ProgramBinaryTests, RoundTrip) {
+  std::string file;
+  PackProgramBinary(42, kFormat, kBinary, sizeof(kBinary), &file);
+  file += '\0';
+  uint32_t format = 0;
+  const uint8_t *binary = nullptr;
+  size_t size = 0;
+  EXPECT_TRUE(UnpackProgramBinary(file, 42, &format, &binary, &size));
+  EXPECT_EQ(kFormat, format);
+  EXPECT_EQ(sizeof(kBinary), size);
+  EXPECT_EQ(0, memcmp(kBinary, binary, sizeof(kBinary)));
+}
+
+// Files for other keys, and damaged files, are rejected.
+TEST(ProgramBinaryTests, Rejected) {
+  std::string file;
+  PackProgramBinary(42, kFormat, kBinary, sizeof(kBinary), &file);
+  uint32_t format = 0;
+  const uint8_t *binary = nullptr;
+  size_t size = 0;
+  EXPECT_FALSE(UnpackProgramBinary(file, 43, &format, &binary, &size));
+
+  std::string truncated(file, 0, file.size() - 1);
+  EXPECT_FALSE(UnpackProgramBinary(truncated, 42, &format, &binary, &size));
+
+  std::string corrupt(file);
+  corrupt[0] ^= 1;
+  EXPECT_FALSE(UnpackProgramBinary(corrupt, 42, &format, &binary, &size));
+
+  EXPECT_FALSE(UnpackProgramBinary(std::string(), 42, &format, &binary,
+                                   &size));
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
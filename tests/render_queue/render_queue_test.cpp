@@ -0,0 +1,155 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <cstdint>
+#include "render_queue.h"
+#include "gtest/gtest.h"
+
+using fpl::RenderQueue;
+
+static const int kFar = RenderQueue::kNumDepthBuckets - 1;
+
+// Sort the queue and return the item of each draw, in order.
+static std::vector<int> SortedItems(RenderQueue* queue) {
+  queue->Sort();
+  std::vector<int> items;
+  for (size_t i = 0; i < queue->draws().size(); ++i) {
+    items.push_back(queue->draws()[i].item);
+  }
+  return items;
+}
+
+// Every opaque draw comes before every translucent one.
+TEST(RenderQueueTests, OpaqueBeforeTranslucent) {
+  RenderQueue queue;
+  queue.Add(RenderQueue::TranslucentKey(kFar, 0, 0), 0, nullptr,
+            nullptr, nullptr);
+  queue.Add(RenderQueue::OpaqueKey(RenderQueue::kNumShaders - 1, 0, 0, kFar),
+            1, nullptr, nullptr, nullptr);
+  EXPECT_EQ(RenderQueue::kPassTranslucent,
+            RenderQueue::KeyPass(queue.draws()[0].key));
+  EXPECT_EQ(RenderQueue::kPassOpaque,
+            RenderQueue::KeyPass(queue.draws()[1].key));
+  const std::vector<int> items = SortedItems(&queue);
+  EXPECT_EQ(1, items[0]);
+  EXPECT_EQ(0, items[1]);
+}
+
+// Opaque draws are grouped by shader, then material, then mesh, and only
+// then ordered front to back.
+TEST(RenderQueueTests, OpaqueGroupsState) {
+  RenderQueue queue;
+  queue.Add(RenderQueue::OpaqueKey(1, 0, 0, 0), 0, nullptr, nullptr, nullptr);
+  queue.Add(RenderQueue::OpaqueKey(0, 1, 0, 0), 1, nullptr, nullptr, nullptr);
+  queue.Add(RenderQueue::OpaqueKey(0, 0, 1, 0), 2, nullptr, nullptr, nullptr);
+  queue.Add(RenderQueue::OpaqueKey(0, 0, 0, 9), 3, nullptr, nullptr, nullptr);
+  queue.Add(RenderQueue::OpaqueKey(0, 0, 0, 5), 4, nullptr, nullptr, nullptr);
+  const std::vector<int> items = SortedItems(&queue);
+  EXPECT_EQ(4, items[0]);
+  EXPECT_EQ(3, items[1]);
+  EXPECT_EQ(2, items[2]);
+  EXPECT_EQ(1, items[3]);
+  EXPECT_EQ(0, items[4]);
+}
+
+// Translucent draws stay back to front, whatever their items. Draws of one
+// item in the same depth bucket are ordered by layer.
+TEST(RenderQueueTests, TranslucentBackToFront) {
+  RenderQueue queue;
+  queue.Add(RenderQueue::TranslucentKey(10, 0, 0), 0, nullptr, nullptr,
+            nullptr);
+  queue.Add(RenderQueue::TranslucentKey(20, 1, 2), 1, nullptr, nullptr,
+            nullptr);
+  queue.Add(RenderQueue::TranslucentKey(20, 1, 0), 1, nullptr, nullptr,
+            nullptr);
+  queue.Add(RenderQueue::TranslucentKey(20, 1, 1), 1, nullptr, nullptr,
+            nullptr);
+  queue.Add(RenderQueue::TranslucentKey(30, 2, 0), 2, nullptr, nullptr,
+            nullptr);
+  queue.Sort();
+  const std::vector<RenderQueue::Draw>& draws = queue.draws();
+  EXPECT_EQ(2, draws[0].item);
+  EXPECT_EQ(RenderQueue::TranslucentKey(20, 1, 0), draws[1].key);
+  EXPECT_EQ(RenderQueue::TranslucentKey(20, 1, 1), draws[2].key);
+  EXPECT_EQ(RenderQueue::TranslucentKey(20, 1, 2), draws[3].key);
+  EXPECT_EQ(0, draws[4].item);
+}
+
+// In the same depth bucket, an item is drawn before the items after it in
+// the scene, like an accessory after the character it sits on, even when
+// the later item is in a lower layer.
+TEST(RenderQueueTests, TranslucentKeepsSceneOrder) {
+  RenderQueue queue;
+  queue.Add(RenderQueue::TranslucentKey(20, 5, 0), 5, nullptr, nullptr,
+            nullptr);
+  queue.Add(RenderQueue::TranslucentKey(20, 4, 2), 4, nullptr, nullptr,
+            nullptr);
+  const std::vector<int> items = SortedItems(&queue);
+  EXPECT_EQ(4, items[0]);
+  EXPECT_EQ(5, items[1]);
+}
+
+// Draws with equal keys keep the order of their items.
+TEST(RenderQueueTests, EqualKeysOrderedByItem) {
+  RenderQueue queue;
+  const uint64_t key = RenderQueue::OpaqueKey(3, 4, 5, 6);
+  queue.Add(key, 7, nullptr, nullptr, nullptr);
+  queue.Add(key, 2, nullptr, nullptr, nullptr);
+  queue.Add(key, 5, nullptr, nullptr, nullptr);
+  const std::vector<int> items = SortedItems(&queue);
+  EXPECT_EQ(2, items[0]);
+  EXPECT_EQ(5, items[1]);
+  EXPECT_EQ(7, items[2]);
+}
+
+// Draws with the same key and item keep the order they were added in, even
+// among enough draws that the sort doesn't fall back to an insertion sort.
+TEST(RenderQueueTests, EqualKeysKeepQueueOrder) {
+  static const int kNumDraws = 100;
+  int materials[kNumDraws];
+  RenderQueue queue;
+  for (int i = 0; i < kNumDraws; ++i) {
+    queue.Add(RenderQueue::TranslucentKey(20, 1, i % 2), 1, nullptr, nullptr,
+              reinterpret_cast<fpl::Material*>(&materials[i]));
+  }
+  queue.Sort();
+  const std::vector<RenderQueue::Draw>& draws = queue.draws();
+  for (int i = 0; i < kNumDraws; ++i) {
+    const int layer = i < kNumDraws / 2 ? 0 : 1;
+    const int added = (i % (kNumDraws / 2)) * 2 + layer;
+    EXPECT_EQ(reinterpret_cast<fpl::Material*>(&materials[added]),
+              draws[i].material);
+  }
+}
+
+// Depths are clamped to the near and far planes.
+TEST(RenderQueueTests, DepthBucketRange) {
+  EXPECT_EQ(0, RenderQueue::DepthBucket(-5.0f, 1.0f, 101.0f));
+  EXPECT_EQ(0, RenderQueue::DepthBucket(1.0f, 1.0f, 101.0f));
+  EXPECT_EQ(kFar, RenderQueue::DepthBucket(101.0f, 1.0f, 101.0f));
+  EXPECT_EQ(kFar, RenderQueue::DepthBucket(500.0f, 1.0f, 101.0f));
+  const int middle = RenderQueue::DepthBucket(51.0f, 1.0f, 101.0f);
+  EXPECT_LT(0, middle);
+  EXPECT_GT(kFar, middle);
+  EXPECT_LT(RenderQueue::DepthBucket(50.0f, 1.0f, 101.0f), middle);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
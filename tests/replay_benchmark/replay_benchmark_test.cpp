@@ -0,0 +1,99 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <string>
+#include <vector>
+
+#include "replay_benchmark.h"
+#include "gtest/gtest.h"
+
+using fpl::BenchmarkBaseline;
+using fpl::BenchmarkMetric;
+using fpl::CompareToBaseline;
+using fpl::FormatBenchmarkMetrics;
+using fpl::ParseBenchmarkBaseline;
+using fpl::Percentile;
+using fpl::ReplayBenchmark;
+
+static double Metric(const std::vector<BenchmarkMetric>& metrics,
+                     const char* name) {
+  for (size_t i = 0; i < metrics.size(); ++i) {
+    if (metrics[i].name == name)
+      return metrics[i].value;
+  }
+  return -1.0;
+}
+
+// Percentiles are by nearest rank, whatever order the samples came in.
+TEST(ReplayBenchmarkTests, Percentile) {
+  std::vector<double> samples;
+  for (int i = 100; i >= 1; --i) {
+    samples.push_back(static_cast<double>(i));
+  }
+  EXPECT_EQ(50.0, Percentile(samples, 0.5));
+  EXPECT_EQ(95.0, Percentile(samples, 0.95));
+  EXPECT_EQ(99.0, Percentile(samples, 0.99));
+  EXPECT_EQ(100.0, Percentile(samples, 1.0));
+  EXPECT_EQ(1.0, Percentile(samples, 0.0));
+  EXPECT_EQ(0.0, Percentile(std::vector<double>(), 0.5));
+}
+
+// Frame times are reported in milliseconds, and the counts per frame.
+TEST(ReplayBenchmarkTests, Results) {
+  ReplayBenchmark benchmark;
+  benchmark.AddFrame(0.010, 4, 20);
+  benchmark.AddFrame(0.020, 0, 30);
+  const std::vector<BenchmarkMetric> metrics = benchmark.Results();
+  EXPECT_EQ(2.0, Metric(metrics, "frames"));
+  EXPECT_NEAR(10.0, Metric(metrics, "frame_ms_p50"), 1e-9);
+  EXPECT_NEAR(20.0, Metric(metrics, "frame_ms_p99"), 1e-9);
+  EXPECT_EQ(2.0, Metric(metrics, "allocations_per_frame"));
+  EXPECT_EQ(25.0, Metric(metrics, "draw_calls_per_frame"));
+}
+
+// Results can be read back as a baseline, and only metrics that grow past
+// their tolerance regress.
+TEST(ReplayBenchmarkTests, CompareToBaseline) {
+  std::vector<BenchmarkMetric> metrics;
+  metrics.push_back(BenchmarkMetric("frame_ms_p95", 10.0));
+  metrics.push_back(BenchmarkMetric("draw_calls_per_frame", 50.0));
+
+  std::vector<BenchmarkBaseline> baselines;
+  EXPECT_TRUE(ParseBenchmarkBaseline(FormatBenchmarkMetrics(metrics),
+                                     &baselines));
+  ASSERT_EQ(2u, baselines.size());
+  EXPECT_EQ(fpl::kDefaultBenchmarkTolerance, baselines[0].tolerance);
+  std::vector<std::string> regressions;
+  EXPECT_TRUE(CompareToBaseline(metrics, baselines, &regressions));
+
+  baselines.clear();
+  EXPECT_TRUE(ParseBenchmarkBaseline(
+      "# Reference device\n\nframe_ms_p95 8 0.2\ndraw_calls_per_frame 40 0.5\n"
+      "allocations_per_frame 0\n", &baselines));
+  ASSERT_EQ(3u, baselines.size());
+  EXPECT_FALSE(CompareToBaseline(metrics, baselines, &regressions));
+  ASSERT_EQ(1u, regressions.size());
+  EXPECT_EQ(0u, regressions[0].find("frame_ms_p95"));
+
+  EXPECT_FALSE(ParseBenchmarkBaseline("frame_ms_p95 fast\n", &baselines));
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
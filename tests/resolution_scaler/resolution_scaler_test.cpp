@@ -0,0 +1,100 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "resolution_scaler.h"
+#include "gtest/gtest.h"
+
+using fpl::ResolutionScaler;
+
+static const double kPeriod = 1.0 / 60.0;
+static const float kPrecision = 1e-5f;
+
+// Feed 'count' frames that each take 'frame_time'. Returns the number of
+// times the scale changed.
+static int Frames(ResolutionScaler* scaler, int count, double frame_time) {
+  int changes = 0;
+  for (int i = 0; i < count; ++i) {
+    if (scaler->Update(frame_time, kPeriod)) changes++;
+  }
+  return changes;
+}
+
+// A few late frames in a row lower the scale, down to the minimum.
+TEST(ResolutionScalerTests, LateFramesLower) {
+  ResolutionScaler scaler;
+  scaler.Initialize(0.5f, 0.1f);
+  EXPECT_EQ(0, Frames(&scaler, ResolutionScaler::kLateFramesToLower - 1,
+                      kPeriod * 2.0));
+  EXPECT_NEAR(1.0f, scaler.scale(), kPrecision);
+  EXPECT_EQ(1, Frames(&scaler, 1, kPeriod * 2.0));
+  EXPECT_NEAR(0.9f, scaler.scale(), kPrecision);
+  Frames(&scaler, 100, kPeriod * 2.0);
+  EXPECT_NEAR(0.5f, scaler.scale(), kPrecision);
+}
+
+// Isolated long frames, such as loading hitches, are ignored.
+TEST(ResolutionScalerTests, HitchesIgnored) {
+  ResolutionScaler scaler;
+  scaler.Initialize(0.5f, 0.1f);
+  for (int i = 0; i < 100; ++i) {
+    scaler.Update(kPeriod * 3.0, kPeriod);
+    scaler.Update(kPeriod, kPeriod);
+  }
+  EXPECT_NEAR(1.0f, scaler.scale(), kPrecision);
+}
+
+// On-time frames raise the scale back up, and a drop straight after a
+// raise makes the next raise wait twice as long.
+TEST(ResolutionScalerTests, RaiseBacksOff) {
+  ResolutionScaler scaler;
+  scaler.Initialize(0.5f, 0.1f);
+  Frames(&scaler, ResolutionScaler::kLateFramesToLower * 2, kPeriod * 2.0);
+  EXPECT_NEAR(0.8f, scaler.scale(), kPrecision);
+  EXPECT_EQ(1, Frames(&scaler, ResolutionScaler::kInitialRaiseDelay,
+                      kPeriod));
+  EXPECT_NEAR(0.9f, scaler.scale(), kPrecision);
+
+  Frames(&scaler, ResolutionScaler::kLateFramesToLower, kPeriod * 2.0);
+  EXPECT_NEAR(0.8f, scaler.scale(), kPrecision);
+  EXPECT_EQ(0, Frames(&scaler, ResolutionScaler::kInitialRaiseDelay,
+                      kPeriod));
+  EXPECT_EQ(1, Frames(&scaler, ResolutionScaler::kInitialRaiseDelay,
+                      kPeriod));
+  EXPECT_NEAR(0.9f, scaler.scale(), kPrecision);
+}
+
+// Sizes scale and round to the nearest pixel, but never reach zero.
+TEST(ResolutionScalerTests, ScaledSize) {
+  struct Size {
+    Size(int x, int y) : x_(x), y_(y) {}
+    int x() const { return x_; }
+    int y() const { return y_; }
+    int x_, y_;
+  };
+  ResolutionScaler scaler;
+  scaler.Initialize(0.5f, 0.5f);
+  Frames(&scaler, ResolutionScaler::kLateFramesToLower, kPeriod * 2.0);
+  const Size size = scaler.ScaledSize(Size(1281, 1));
+  EXPECT_EQ(641, size.x());
+  EXPECT_EQ(1, size.y());
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,89 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <cstdint>
+#include "gtest/gtest.h"
+#include "rng.h"
+
+using fpl::Rng;
+
+// The same seed gives the same sequence, and a copy carries on from where
+// the original is.
+TEST(RngTests, Reproducible) {
+  Rng a(1234);
+  Rng b(1234);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(a.Next(), b.Next());
+  }
+  Rng copy = a;
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(a.Next(), copy.Next());
+  }
+  b.Seed(1234);
+  Rng c(1234);
+  EXPECT_EQ(c.Next(), b.Next());
+}
+
+// Nearby seeds give unrelated sequences.
+TEST(RngTests, SeedsDiffer) {
+  Rng a(1);
+  Rng b(2);
+  int same = 0;
+  for (int i = 0; i < 100; ++i) {
+    same += a.Next() == b.Next() ? 1 : 0;
+  }
+  EXPECT_EQ(0, same);
+}
+
+// Floats stay in [0, 1), and cover the whole range.
+TEST(RngTests, FloatRange) {
+  Rng rng(7);
+  float lowest = 1.0f;
+  float highest = 0.0f;
+  for (int i = 0; i < 10000; ++i) {
+    const float f = rng.Float();
+    EXPECT_TRUE(0.0f <= f && f < 1.0f);
+    lowest = f < lowest ? f : lowest;
+    highest = f > highest ? f : highest;
+  }
+  EXPECT_TRUE(lowest < 0.01f);
+  EXPECT_TRUE(highest > 0.99f);
+
+  const float g = rng.FloatInRange(-2.0f, 3.0f);
+  EXPECT_TRUE(-2.0f <= g && g < 3.0f);
+}
+
+// Integers hit every value in [start, end), and nothing outside it.
+TEST(RngTests, IntRange) {
+  Rng rng(99);
+  int counts[5] = { 0, 0, 0, 0, 0 };
+  for (int i = 0; i < 1000; ++i) {
+    const int n = rng.IntInRange(-2, 3);
+    ASSERT_TRUE(-2 <= n && n < 3);
+    counts[n + 2]++;
+  }
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_TRUE(counts[i] > 100);
+  }
+  EXPECT_EQ(4, rng.IntInRange(4, 4));
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,184 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <cstdint>
+#include <vector>
+#include "gtest/gtest.h"
+#include "rollback_session.h"
+
+using fpl::RollbackInputs;
+using fpl::RollbackSession;
+using fpl::RollbackSimulation;
+
+static const int kNumPlayers = 2;
+static const int kLocal = 0;
+static const int kRemote = 1;
+
+// Hashes every input it is given into its state, so two runs end in the same
+// state only if they simulated the same inputs in the same order.
+class HashSimulation : public RollbackSimulation {
+ public:
+  HashSimulation() : state_(1), frames_(0), saved_(16, 0) {}
+
+  virtual void SaveState(int slot) { saved_[slot] = state_; }
+  virtual void LoadState(int slot) { state_ = saved_[slot]; }
+  virtual void SimulateFrame(int frame, const RollbackInputs* inputs,
+                             bool /*resimulating*/) {
+    state_ = state_ * 31 + static_cast<uint64_t>(frame);
+    for (int i = 0; i < kNumPlayers; ++i) {
+      state_ = state_ * 131 + inputs[i].is_down;
+      state_ = state_ * 137 + inputs[i].went_down;
+      state_ = state_ * 139 + inputs[i].went_up;
+    }
+    frames_++;
+  }
+
+  uint64_t state() const { return state_; }
+  int frames() const { return frames_; }
+
+ private:
+  uint64_t state_;
+  int frames_;
+  std::vector<uint64_t> saved_;
+};
+
+// Remote player's input on 'frame': press on 3, hold until 7, release.
+static RollbackInputs RemoteInput(int frame) {
+  if (frame == 3) return RollbackInputs(1, 1, 0);
+  if (frame > 3 && frame < 7) return RollbackInputs(1, 0, 0);
+  if (frame == 7) return RollbackInputs(0, 0, 1);
+  return RollbackInputs();
+}
+
+static RollbackInputs LocalInput(int frame) {
+  return RollbackInputs(frame & 2, 0, 0);
+}
+
+// Simulate 'num_frames' frames with every input known in time.
+static uint64_t ReferenceState(int num_frames) {
+  HashSimulation simulation;
+  RollbackInputs inputs[kNumPlayers];
+  for (int frame = 0; frame < num_frames; ++frame) {
+    inputs[kLocal] = LocalInput(frame);
+    inputs[kRemote] = RemoteInput(frame);
+    simulation.SimulateFrame(frame, inputs, false);
+  }
+  return simulation.state();
+}
+
+// Remote inputs that arrive late are predicted. Wrong predictions are
+// rolled back, and the result is the same as if nothing had been late.
+TEST(RollbackSessionTests, LateInputsMatchReference) {
+  static const int kFrames = 12;
+  static const int kLatency = 2;
+  HashSimulation simulation;
+  RollbackSession session;
+  session.Initialize(&simulation, kNumPlayers, 1 << kLocal, 4);
+  for (int frame = 0; frame < kFrames + kLatency; ++frame) {
+    if (frame >= kLatency) {
+      EXPECT_TRUE(session.AddRemoteInput(kRemote, frame - kLatency,
+                                         RemoteInput(frame - kLatency)));
+    }
+    if (frame < kFrames) {
+      session.SetLocalInput(kLocal, LocalInput(frame));
+      EXPECT_TRUE(session.AdvanceFrame());
+    }
+  }
+  EXPECT_EQ(kFrames, session.confirmed_frame());
+  EXPECT_EQ(kFrames, session.frame());
+
+  // The last inputs arrived after the last frame. Their rollback happens
+  // at the start of the next AdvanceFrame().
+  session.SetLocalInput(kLocal, LocalInput(kFrames));
+  session.AddRemoteInput(kRemote, kFrames, RemoteInput(kFrames));
+  EXPECT_TRUE(session.AdvanceFrame());
+  EXPECT_EQ(ReferenceState(kFrames + 1), simulation.state());
+
+  // The press and the release were mispredicted. The frames after them were
+  // too, but were already fixed when the press and release were redone.
+  EXPECT_EQ(2, session.rollbacks());
+  EXPECT_EQ(2 * kLatency, session.resimulated_frames());
+  EXPECT_EQ(kFrames + 1 + session.resimulated_frames(), simulation.frames());
+}
+
+// Inputs that match their prediction don't cause a rollback.
+TEST(RollbackSessionTests, CorrectPredictionsAreNotResimulated) {
+  HashSimulation simulation;
+  RollbackSession session;
+  session.Initialize(&simulation, kNumPlayers, 1 << kLocal, 4);
+  for (int frame = 0; frame < 3; ++frame) {
+    EXPECT_TRUE(session.AdvanceFrame());
+  }
+  for (int frame = 0; frame < 3; ++frame) {
+    session.AddRemoteInput(kRemote, frame, RollbackInputs());
+  }
+  EXPECT_TRUE(session.AdvanceFrame());
+  EXPECT_EQ(0, session.rollbacks());
+  EXPECT_EQ(4, simulation.frames());
+  EXPECT_EQ(3, session.confirmed_frame());
+}
+
+// The session stops when a remote player falls max_rollback_frames behind,
+// and carries on once their inputs arrive.
+TEST(RollbackSessionTests, StallsWhenTooFarBehind) {
+  HashSimulation simulation;
+  RollbackSession session;
+  session.Initialize(&simulation, kNumPlayers, 1 << kLocal, 2);
+  EXPECT_TRUE(session.AdvanceFrame());
+  EXPECT_TRUE(session.AdvanceFrame());
+  EXPECT_FALSE(session.AdvanceFrame());
+  EXPECT_EQ(2, session.frame());
+  EXPECT_EQ(1, session.stalls());
+
+  session.AddRemoteInput(kRemote, 0, RollbackInputs(1, 1, 0));
+  EXPECT_TRUE(session.AdvanceFrame());
+  EXPECT_EQ(1, session.rollbacks());
+  EXPECT_EQ(3, session.frame());
+}
+
+// With no frames to roll back, every frame waits for the remote input.
+TEST(RollbackSessionTests, LockstepWithoutRollback) {
+  HashSimulation simulation;
+  RollbackSession session;
+  session.Initialize(&simulation, kNumPlayers, 1 << kLocal, 0);
+  EXPECT_FALSE(session.AdvanceFrame());
+  session.AddRemoteInput(kRemote, 0, RemoteInput(0));
+  EXPECT_TRUE(session.AdvanceFrame());
+  EXPECT_FALSE(session.AdvanceFrame());
+  EXPECT_EQ(0, session.rollbacks());
+  EXPECT_EQ(1, simulation.frames());
+}
+
+// Inputs too far ahead to be held are dropped, and duplicates are ignored.
+TEST(RollbackSessionTests, DropsInputsOutsideWindow) {
+  HashSimulation simulation;
+  RollbackSession session;
+  session.Initialize(&simulation, kNumPlayers, 1 << kLocal, 1);
+  EXPECT_FALSE(session.AddRemoteInput(kRemote, 4, RollbackInputs()));
+  EXPECT_EQ(1, session.dropped_inputs());
+  EXPECT_TRUE(session.AddRemoteInput(kRemote, 0, RollbackInputs()));
+  EXPECT_TRUE(session.AddRemoteInput(kRemote, 0, RollbackInputs(1, 1, 0)));
+  EXPECT_TRUE(session.AdvanceFrame());
+  EXPECT_TRUE(session.AdvanceFrame());
+  EXPECT_EQ(0, session.rollbacks());
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
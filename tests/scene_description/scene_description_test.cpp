@@ -0,0 +1,107 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "scene_description.h"
+#include "gtest/gtest.h"
+
+using fpl::SceneDescription;
+using mathfu::mat4;
+using mathfu::vec3;
+
+static mat4 Translation(float x) {
+  return mat4::FromTranslationVector(vec3(x, 0.0f, 0.0f));
+}
+
+// Static renderables come first, in their own slots.
+TEST(SceneDescriptionTests, StaticRenderablesComeFirst) {
+  SceneDescription scene;
+  EXPECT_EQ(0u, scene.AddStaticRenderable(1, Translation(1.0f)));
+  EXPECT_EQ(1u, scene.AddStaticRenderable(2, Translation(2.0f)));
+  scene.AddRenderable(3, Translation(3.0f));
+  EXPECT_EQ(2u, scene.num_static_renderables());
+  ASSERT_EQ(3u, scene.renderables().size());
+  EXPECT_EQ(1, scene.renderables()[0].id());
+  EXPECT_EQ(2, scene.renderables()[1].id());
+  EXPECT_EQ(3, scene.renderables()[2].id());
+}
+
+// ClearDynamic() keeps the static renderables, unchanged, and the version.
+TEST(SceneDescriptionTests, ClearDynamicKeepsStatic) {
+  SceneDescription scene;
+  scene.AddStaticRenderable(1, Translation(1.0f));
+  scene.set_static_version(7);
+  scene.AddRenderable(2, Translation(2.0f));
+  scene.AddLight(vec3(0.0f, 1.0f, 0.0f));
+
+  scene.ClearDynamic();
+  ASSERT_EQ(1u, scene.renderables().size());
+  EXPECT_TRUE(scene.renderables()[0].Matches(
+      fpl::Renderable(1, Translation(1.0f))));
+  EXPECT_EQ(0u, scene.lights().size());
+  EXPECT_EQ(7u, scene.static_version());
+
+  // Dynamic renderables can be added again after the static ones.
+  scene.AddRenderable(3, Translation(3.0f));
+  ASSERT_EQ(2u, scene.renderables().size());
+  EXPECT_EQ(3, scene.renderables()[1].id());
+}
+
+// Clear() removes the static renderables too, and forgets the version.
+TEST(SceneDescriptionTests, ClearRemovesStatic) {
+  SceneDescription scene;
+  scene.AddStaticRenderable(1, Translation(1.0f));
+  scene.set_static_version(7);
+  scene.AddRenderable(2, Translation(2.0f));
+
+  scene.Clear();
+  EXPECT_EQ(0u, scene.renderables().size());
+  EXPECT_EQ(0u, scene.num_static_renderables());
+  EXPECT_EQ(0u, scene.static_version());
+  EXPECT_EQ(0u, scene.AddStaticRenderable(4, Translation(4.0f)));
+}
+
+// Overlays attach to the last renderable, and are cleared with it.
+TEST(SceneDescriptionTests, OverlaysFollowRenderables) {
+  SceneDescription scene;
+  scene.AddStaticRenderable(1, Translation(1.0f));
+  scene.AddRenderable(2, Translation(2.0f));
+  scene.AddRenderable(3, Translation(3.0f));
+  scene.AddOverlay(4, mathfu::vec2(0.5f, 0.25f));
+  ASSERT_EQ(1u, scene.overlays().size());
+  EXPECT_EQ(2u, scene.overlays()[0].renderable);
+  EXPECT_EQ(4, scene.overlays()[0].key);
+
+  // A missing overlay makes the scenes differ.
+  scene.set_camera(Translation(0.0f));
+  SceneDescription other;
+  other.set_camera(Translation(0.0f));
+  other.AddStaticRenderable(1, Translation(1.0f));
+  other.AddRenderable(2, Translation(2.0f));
+  other.AddRenderable(3, Translation(3.0f));
+  EXPECT_FALSE(scene.Matches(other));
+  other.AddOverlay(4, mathfu::vec2(0.5f, 0.25f));
+  EXPECT_TRUE(scene.Matches(other));
+
+  scene.ClearDynamic();
+  EXPECT_EQ(0u, scene.overlays().size());
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,96 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <thread>
+#include "spsc_ring.h"
+#include "gtest/gtest.h"
+
+using fpl::SpscRing;
+
+// Items come out in the order they went in.
+TEST(SpscRingTests, FirstInFirstOut) {
+  SpscRing<int, 4> ring;
+  EXPECT_TRUE(ring.empty());
+  EXPECT_TRUE(ring.Push(1));
+  EXPECT_TRUE(ring.Push(2));
+  EXPECT_EQ(2u, ring.size());
+  int item = 0;
+  EXPECT_TRUE(ring.Pop(&item));
+  EXPECT_EQ(1, item);
+  EXPECT_TRUE(ring.Pop(&item));
+  EXPECT_EQ(2, item);
+  EXPECT_FALSE(ring.Pop(&item));
+  EXPECT_TRUE(ring.empty());
+}
+
+// A full ring drops new items and counts them, and keeps the old ones.
+TEST(SpscRingTests, OverflowDropsNewest) {
+  SpscRing<int, 4> ring;
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_EQ(i < 4, ring.Push(i));
+  }
+  EXPECT_EQ(2u, ring.overflows());
+  int item = -1;
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(ring.Pop(&item));
+    EXPECT_EQ(i, item);
+  }
+  EXPECT_TRUE(ring.Push(10));
+  EXPECT_TRUE(ring.Pop(&item));
+  EXPECT_EQ(10, item);
+}
+
+// The indices keep counting up past the capacity, and wrap correctly.
+TEST(SpscRingTests, WrapsAround) {
+  SpscRing<int, 2> ring;
+  int item = 0;
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(ring.Push(i));
+    EXPECT_TRUE(ring.Pop(&item));
+    EXPECT_EQ(i, item);
+  }
+  EXPECT_EQ(0u, ring.overflows());
+}
+
+// Every item pushed by one thread is popped, in order, by another.
+TEST(SpscRingTests, TwoThreads) {
+  static const int kCount = 100000;
+  SpscRing<int, 64> ring;
+  std::thread producer([&ring]() {
+    for (int i = 0; i < kCount; ) {
+      if (ring.Push(i)) i++;
+    }
+  });
+  int expected = 0;
+  bool in_order = true;
+  while (expected < kCount) {
+    int item;
+    if (ring.Pop(&item)) {
+      in_order = in_order && item == expected;
+      expected++;
+    }
+  }
+  producer.join();
+  EXPECT_TRUE(in_order);
+  EXPECT_TRUE(ring.empty());
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,107 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <cstdio>
+#include <string>
+#include "precompiled.h"
+#include "startup_trace.h"
+#include "gtest/gtest.h"
+
+using fpl::CancelStartupTrace;
+using fpl::FinishStartupTrace;
+using fpl::RecordStartupEvent;
+using fpl::StartStartupTrace;
+using fpl::StartupTraceEnabled;
+using fpl::StartupTraceScope;
+
+static const char kFileName[] = "startup_trace_test.json";
+
+class StartupTraceTests : public ::testing::Test {
+protected:
+  virtual void TearDown() {
+    CancelStartupTrace();
+    remove(kFileName);
+  }
+};
+
+static std::string ReadTrace() {
+  std::string contents;
+  FILE* file = fopen(kFileName, "rb");
+  if (!file) return contents;
+  char buffer[256];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    contents.append(buffer, read);
+  }
+  fclose(file);
+  return contents;
+}
+
+// Nothing is recorded until the trace starts.
+TEST_F(StartupTraceTests, DisabledByDefault) {
+  EXPECT_FALSE(StartupTraceEnabled());
+  StartStartupTrace();
+  EXPECT_TRUE(StartupTraceEnabled());
+  CancelStartupTrace();
+  EXPECT_FALSE(StartupTraceEnabled());
+}
+
+// Scopes become complete events, and the first frame an instant event.
+TEST_F(StartupTraceTests, WritesEvents) {
+  StartStartupTrace();
+  {
+    StartupTraceScope trace("phase", "InitializeConfig");
+  }
+  RecordStartupEvent("load", "textures/pie.webp", 10, 25);
+  EXPECT_TRUE(FinishStartupTrace(kFileName));
+  EXPECT_FALSE(StartupTraceEnabled());
+
+  const std::string trace = ReadTrace();
+  EXPECT_EQ(0u, trace.find("{\"traceEvents\":["));
+  EXPECT_NE(std::string::npos, trace.find("\"name\":\"InitializeConfig\""));
+  EXPECT_NE(std::string::npos,
+            trace.find("\"name\":\"textures/pie.webp\",\"cat\":\"load\","
+                       "\"ph\":\"X\""));
+  EXPECT_NE(std::string::npos, trace.find("\"ts\":10,\"dur\":15}"));
+  EXPECT_NE(std::string::npos, trace.find("\"name\":\"first frame\""));
+}
+
+// Names are escaped, so any file name gives valid JSON.
+TEST_F(StartupTraceTests, EscapesNames) {
+  StartStartupTrace();
+  RecordStartupEvent("load", "a\"b\\c\n", 0, 1);
+  EXPECT_TRUE(FinishStartupTrace(kFileName));
+  EXPECT_NE(std::string::npos,
+            ReadTrace().find("\"name\":\"a\\\"b\\\\c\\u000a\""));
+}
+
+// Events recorded after cancelling are dropped.
+TEST_F(StartupTraceTests, CancelDiscardsEvents) {
+  StartStartupTrace();
+  RecordStartupEvent("load", "dropped", 0, 1);
+  CancelStartupTrace();
+  RecordStartupEvent("load", "also_dropped", 0, 1);
+  StartStartupTrace();
+  EXPECT_TRUE(FinishStartupTrace(kFileName));
+  EXPECT_EQ(std::string::npos, ReadTrace().find("dropped"));
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}